@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
@@ -135,15 +136,21 @@ ALWAYS_INLINE static void cpu_relax(void) {
 // MEMORY MANAGEMENT AND POOLS
 // =============================================================================
 
-// High-performance slab allocator for fixed-size objects
-typedef struct {
-    void* memory;
-    void* free_list;
+// High-performance slab allocator for fixed-size objects. Each thread keeps a
+// private magazine of free objects and trades whole magazines with a shared
+// depot; slabs are carved from the global arena as the depot runs dry.
+typedef struct SlabAllocator {
     size_t object_size;
     size_t objects_per_slab;
     size_t total_slabs;
-    size_t allocated_objects;
-    bool use_huge_pages;
+    unsigned long id;                      // Unique per allocator, stamped into its slabs
+    int cache_slot;                        // Per-thread magazine index, -1 if none was free
+    pthread_mutex_t depot_mutex;
+    struct SlabMagazine* full_magazines;   // Free objects returned by threads
+    struct SlabMagazine* empty_magazines;  // Spare magazine shells
+    char* slab_next;                       // Unclaimed objects of the newest slab
+    char* slab_end;
+    struct SlabAllocator* next_live;
 } SlabAllocator;
 
 // Global object pools for common allocations
@@ -163,6 +170,59 @@ void slab_allocator_destroy(SlabAllocator* allocator);
 void init_global_pools(void);
 void cleanup_global_pools(void);
 
+/**
+ * Request-scoped bump arena for cJSON allocations. While a thread has entered an
+ * arena, every cJSON node and string it allocates (including in range jobs it
+ * runs on a pool) comes from the arena and freeing it is a no-op, so a whole
+ * parse/transform result is released with one json_arena_reset(). Memory from
+ * the heap, e.g. trees built before entering, is still freed normally.
+ * Arena memory must not be used after a reset and must never reach free();
+ * library functions that return strings always return heap memory.
+ */
+typedef struct JsonArena JsonArena;
+
+/**
+ * Creates an arena that grows in blocks of block_size bytes (0 for
+ * JSON_ARENA_BLOCK_SIZE); blocks are recycled between arenas
+ */
+JsonArena* json_arena_create(size_t block_size);
+
+/**
+ * Makes arena (NULL for the heap) the calling thread's cJSON allocator and
+ * returns the previous one, which is passed back to json_arena_leave()
+ */
+JsonArena* json_arena_enter(JsonArena* arena);
+
+/**
+ * Restores the allocator that was current before json_arena_enter()
+ */
+void json_arena_leave(JsonArena* previous);
+
+/**
+ * Returns the calling thread's current arena, or NULL
+ */
+JsonArena* json_arena_current(void);
+
+/**
+ * Returns 1 if ptr was allocated from any arena
+ */
+int json_arena_owns(const void* ptr);
+
+/**
+ * Returns the number of bytes handed out since the last reset
+ */
+size_t json_arena_bytes_used(const JsonArena* arena);
+
+/**
+ * Releases everything allocated from the arena; no thread may be allocating from it
+ */
+void json_arena_reset(JsonArena* arena);
+
+/**
+ * Destroys the arena and everything allocated from it
+ */
+void json_arena_destroy(JsonArena* arena);
+
 // =============================================================================
 // STRING VIEW (ZERO-COPY STRING OPERATIONS)
 // =============================================================================
@@ -211,8 +271,12 @@ char* string_view_to_cstr(const StringView* sv);
 // =============================================================================
 
 /**
- * SIMD-optimized string length calculation
- * Falls back to standard strlen on non-SIMD platforms
+ * SIMD-optimized string length calculation (0 for NULL)
+ *
+ * These kernels, and the structural parser's block scanner, go through a
+ * dispatch table resolved once from the CPU features at load time, so one
+ * build runs the AVX-512, AVX2, SSE2, NEON or scalar version that fits the
+ * machine it runs on.
  */
 size_t strlen_simd(const char* str);
 
@@ -226,10 +290,30 @@ const char* skip_whitespace_optimized(const char* str, size_t len);
  */
 const char* find_delimiter_optimized(const char* str, size_t len);
 
+/**
+ * Name of the kernel set in use: "avx512", "avx2", "sse2", "neon" or "scalar"
+ */
+const char* cjson_tools_simd_level(void);
+
+/**
+ * Forces a kernel set by name, or the best supported one for NULL or "auto".
+ * Meant for testing and benchmarking the variants against each other.
+ * Returns 0 on success, -1 if the level is unknown or unsupported here.
+ */
+int cjson_tools_set_simd_level(const char* level);
+
 // =============================================================================
 // THREAD POOL AND TASK MANAGEMENT
 // =============================================================================
 
+/**
+ * Countdown latch for a group of tasks (e.g. one batch on a shared pool).
+ * Zero-initialize before use; it must outlive thread_pool_wait_latch().
+ */
+typedef struct TaskLatch {
+    volatile int state;       // Pending task count plus a waiter flag
+} TaskLatch;
+
 /**
  * Task structure for thread pool
  */
@@ -237,6 +321,7 @@ typedef struct Task {
     void (*function)(void*);  // Function to execute
     void* argument;           // Argument to pass to the function
     struct Task* next;        // Next task in the queue
+    TaskLatch* latch;         // Counted down when the task finishes (may be NULL)
 } Task;
 
 /**
@@ -256,15 +341,19 @@ typedef struct WorkStealingQueue {
 typedef struct WorkStealingPool {
     pthread_t* threads;
     WorkStealingQueue* queues;
+    void* thread_data;
     int num_threads;
     volatile int shutdown;
     _Alignas(CACHE_LINE_SIZE) volatile int global_task_count;
+    volatile int completion_waiters;
+    _Alignas(CACHE_LINE_SIZE) volatile int work_epoch;
+    volatile int parked_workers;
 } WorkStealingPool;
 
 /**
  * Thread pool structure (with work-stealing support)
  */
-typedef struct {
+typedef struct ThreadPool {
     WorkStealingPool* ws_pool;    // Work-stealing pool for high performance
     pthread_mutex_t mutex;        // Mutex for compatibility
     pthread_cond_t cond;          // Condition variable for compatibility
@@ -273,7 +362,9 @@ typedef struct {
     Task* task_queue_tail;        // Tail of the task queue (compatibility)
     int num_threads;              // Number of threads in the pool
     int active_threads;           // Number of currently active threads
+    int ref_count;                // References held via create/retain/acquire
     bool shutdown;                // Flag to indicate shutdown
+    struct ThreadPool* base;      // Shared pool a capped handle runs on (NULL if it owns workers)
 } ThreadPool;
 
 // Thread pool functions
@@ -284,6 +375,76 @@ void thread_pool_wait(ThreadPool* pool);
 size_t thread_pool_get_queue_size(ThreadPool* pool);
 int thread_pool_get_thread_count(ThreadPool* pool);
 
+/**
+ * Adds a task that counts down the latch when it finishes.
+ * Returns 0 on success, -1 if the queues are full (the latch is left unchanged).
+ */
+int thread_pool_add_task_latched(ThreadPool* pool, void (*function)(void*), void* argument,
+                                 TaskLatch* latch);
+
+/**
+ * Blocks until every task added with this latch has finished. Unlike
+ * thread_pool_wait, it ignores tasks other callers put on the same pool.
+ */
+void thread_pool_wait_latch(ThreadPool* pool, TaskLatch* latch);
+
+/**
+ * Body of a chunked loop: handles indices [begin, end). slot identifies the
+ * executing thread for per-thread scratch state and is always in
+ * [0, thread_pool_get_thread_count(pool)]; the calling thread is slot 0.
+ */
+typedef void (*RangeTaskFunction)(void* context, int begin, int end, int slot);
+
+/**
+ * Runs body over [0, count) on the pool and the calling thread. Ranges are
+ * claimed from a shared cursor in chunks that start at a fraction of the
+ * work and shrink (down to min_chunk) as it runs out, so one task per
+ * worker covers the whole loop and late workers pick up the tail.
+ * With a NULL pool the whole range runs inline as slot 0.
+ * Returns 0 on success, -1 on invalid arguments.
+ */
+int thread_pool_parallel_for(ThreadPool* pool, int count, int min_chunk,
+                             RangeTaskFunction body, void* context);
+
+/**
+ * Adds a reference to a pool; returns the pool for convenience
+ */
+ThreadPool* thread_pool_retain(ThreadPool* pool);
+
+/**
+ * Drops a reference taken by thread_pool_create, thread_pool_retain or
+ * thread_pool_acquire_shared; the pool is destroyed when the last one goes
+ */
+void thread_pool_release(ThreadPool* pool);
+
+/**
+ * Returns a handle on the process-wide pool, creating it on first use and
+ * replacing it with a larger one when more threads are requested than it has
+ * (0 = optimal count). The handle reports num_threads as its thread count and
+ * thread_pool_parallel_for runs at most that many threads on it, counting the
+ * caller, however large the shared pool has grown. Calls still running on a
+ * replaced pool finish there.
+ * The shared pool is torn down at exit and is not inherited across fork().
+ * Returns NULL when threading is unavailable.
+ */
+ThreadPool* thread_pool_acquire_shared(int num_threads);
+
+/**
+ * Sets the shared pool to exactly num_threads workers (0 = optimal count).
+ * Returns the new thread count, or -1 if the pool could not be created.
+ */
+int thread_pool_configure_shared(int num_threads);
+
+/**
+ * Releases the shared pool; the next threaded call creates a fresh one
+ */
+void thread_pool_shutdown_shared(void);
+
+/**
+ * Returns the shared pool's thread count, or 0 if it has not been created
+ */
+int thread_pool_shared_thread_count(void);
+
 // Global task queue functions
 size_t get_task_queue_size(void);
 
@@ -298,15 +459,235 @@ char* my_strdup(const char* str) HOT_PATH;
 void my_strfree(char* str);
 
 /**
- * Reads a JSON file into a string
+ * Contiguous view of a JSON container's children for O(1) indexed access
+ *
+ * cJSON children form a linked list, so cJSON_GetArrayItem(array, i) is O(i).
+ * Batch code builds a view once and indexes into it instead.
+ */
+typedef struct {
+    cJSON** items;
+    int count;
+} JsonArrayView;
+
+/**
+ * Materializes the children of an array or object in one pass
+ *
+ * The view borrows the children; it must not outlive the container.
+ *
+ * @param view The view to fill (count is 0 for an empty container)
+ * @param array The JSON array or object
+ * @return 0 on success, -1 on invalid arguments or allocation failure
+ */
+int json_array_view_init(JsonArrayView* view, const cJSON* array);
+
+/**
+ * Releases a view built by json_array_view_init (the children are untouched)
+ */
+void json_array_view_free(JsonArrayView* view);
+
+/**
+ * Prints the records of a view as one JSON array, like cjson_tools_print of
+ * the array they came from
+ *
+ * @return A new JSON string (must be freed by caller)
+ */
+char* json_array_view_print(const JsonArrayView* view, int pretty_print);
+
+/**
+ * Like json_array_view_print, writing the text to output in bounded chunks
+ *
+ * @return 0 on success, -1 on a write error
+ */
+int json_array_view_print_stream(const JsonArrayView* view, FILE* output, int pretty_print);
+
+/**
+ * Reads a JSON file into a string, decoding gzip and zstd files
  */
 char* read_json_file(const char* filename);
 
 /**
- * Reads JSON from stdin into a string
+ * Reads JSON from stdin into a string, decoding gzip and zstd input
  */
 char* read_json_stdin(void);
 
+/**
+ * Read-only JSON input: a file mapping when possible, otherwise a heap buffer
+ *
+ * data is not guaranteed to be NUL-terminated; parse it with json_input_parse()
+ * or cJSON_ParseWithLength(data, length).
+ */
+typedef struct {
+    const char* data;       // Start of the JSON text
+    size_t length;          // Length of the JSON text in bytes
+    void* mapping;          // mmap() region backing data, NULL if not mapped
+    size_t mapping_length;
+    char* buffer;           // Heap buffer backing data, NULL if mapped
+} JsonInput;
+
+/**
+ * Opens a file for parsing, mapping it read-only when the platform allows
+ *
+ * @return 0 on success, -1 if the file cannot be read
+ */
+int json_input_open_file(JsonInput* input, const char* filename);
+
+/**
+ * Opens stdin for parsing: redirected regular files are mapped, pipes are
+ * read with large block reads
+ *
+ * @return 0 on success, -1 on read failure
+ */
+int json_input_open_stdin(JsonInput* input);
+
+/**
+ * Parses an opened input without copying it (reports the error offset on failure)
+ *
+ * @return The parsed JSON (must be freed by caller), or NULL on invalid JSON
+ */
+cJSON* json_input_parse(const JsonInput* input);
+
+/**
+ * Releases the mapping or buffer behind an input; parsed trees stay valid
+ */
+void json_input_close(JsonInput* input);
+
+/**
+ * Maps, parses and unmaps a JSON file
+ *
+ * @return The parsed JSON (must be freed by caller), or NULL on failure
+ */
+cJSON* parse_json_file(const char* filename);
+
+// =============================================================================
+// COMPRESSED STREAMS
+// =============================================================================
+
+/**
+ * Compression formats for input and output. read_json_file, read_json_stdin
+ * and json_input_open_* decode gzip and zstd input transparently, recognized
+ * by its magic bytes. Each codec is only available when the library was built
+ * with it (HAVE_ZLIB, HAVE_ZSTD; see json_codec_available).
+ */
+typedef enum {
+    JSON_CODEC_NONE,    // Plain text
+    JSON_CODEC_GZIP,    // gzip (zlib); also reads zlib streams
+    JSON_CODEC_ZSTD     // Zstandard
+} JsonCodec;
+
+/**
+ * Recognizes gzip and zstd data by its first bytes
+ */
+JsonCodec json_codec_detect(const void* data, size_t length);
+
+/**
+ * Picks a codec from a file extension: .gz/.gzip or .zst/.zstd
+ */
+JsonCodec json_codec_from_path(const char* path);
+
+/**
+ * Parses a codec name: "gzip" (or "gz"), "zstd" (or "zst") or "none"
+ *
+ * @return 0 on success, -1 for an unknown name
+ */
+int json_codec_parse(const char* name, JsonCodec* codec);
+
+/**
+ * Returns 1 if codec is compiled into this build (JSON_CODEC_NONE always is)
+ */
+int json_codec_available(JsonCodec codec);
+
+/**
+ * Wraps input in a stream of its decoded text. A dedicated thread reads and
+ * decodes ahead into a bounded ring of 1 MiB blocks while the caller consumes
+ * the previous ones, so the NDJSON functions (flatten_json_stream etc.) parse
+ * while the next records are decompressed. Concatenated gzip members and zstd
+ * frames are read as one stream.
+ *
+ * input is read through its file descriptor and must not have been read
+ * through stdio; it is not closed with the returned stream. Closing the
+ * returned stream before the end of a pipe waits for the pending read.
+ *
+ * @param codec Codec of input, or JSON_CODEC_NONE to detect it from the first
+ *              bytes (plain input is then passed through unchanged)
+ * @return Readable stream (close with fclose), or NULL if the codec is not
+ *         available or the platform cannot wrap streams (glibc, BSD and macOS can)
+ */
+FILE* json_stream_open_decompressed(FILE* input, JsonCodec codec);
+
+/**
+ * Wraps output in a stream that compresses what is written to it. The text is
+ * cut into 1 MiB blocks that the shared thread pool compresses concurrently as
+ * independent gzip members or zstd frames, written to output in order, so
+ * producing the text and compressing it overlap. gunzip and zstd -d read the
+ * result as a single file.
+ *
+ * fclose on the returned stream writes the remaining blocks and flushes output
+ * (reporting failures as EOF) but leaves output open.
+ *
+ * @param codec JSON_CODEC_GZIP or JSON_CODEC_ZSTD
+ * @param level Compression level, or 0 for the codec's default
+ * @return Writable stream, or NULL if the codec is not available or the
+ *         platform cannot wrap streams
+ */
+FILE* json_stream_open_compressed(FILE* output, JsonCodec codec, int level);
+
+// =============================================================================
+// ASYNC OUTPUT
+// =============================================================================
+
+/**
+ * Wraps output in a stream whose writes are flushed by a background thread.
+ * Written text lands in a fixed pool of 1 MiB buffers that the thread writes
+ * out in order, batching consecutive full buffers into one writev() when
+ * output has a file descriptor, so producing output and writing it overlap.
+ * A writer only waits when every buffer is still queued, which bounds memory.
+ *
+ * output is flushed first and must not be written directly until the returned
+ * stream is closed. fclose on the returned stream waits for the pending
+ * buffers and flushes output (reporting failures as EOF) but leaves it open.
+ * Layer json_stream_open_compressed on top to compress in the background too.
+ *
+ * @return Writable stream, or NULL without threading or stream wrappers
+ *         (write to output directly then)
+ */
+FILE* json_stream_open_async(FILE* output);
+
+// =============================================================================
+// STRUCTURAL INDEX PARSER
+// =============================================================================
+
+/**
+ * Options for json_parse_structural
+ */
+#define JSON_PARSE_REQUIRE_NULL_TERMINATED 0x1  // Like cJSON's require_null_terminated
+#define JSON_PARSE_VALIDATE_UTF8           0x2  // Also reject malformed UTF-8, which cJSON accepts
+
+/**
+ * Two-stage parser: a SIMD pass (AVX-512BW, AVX2, SSE2 or NEON, picked at
+ * runtime) indexes quotes, brackets, colons and commas, then the tree is built
+ * from the index. Accepts the same input and builds the same tree as
+ * cJSON_ParseWithLengthOpts(), so it can replace it call by call. Errors are
+ * reported through return_parse_end only, not cJSON_GetErrorPtr(), and point at
+ * the token that failed rather than at cJSON's exact byte.
+ *
+ * @param value JSON text (need not be NUL-terminated)
+ * @param buffer_length Length of value in bytes
+ * @param return_parse_end Receives the end of the value, or the error position (may be NULL)
+ * @param options JSON_PARSE_* flags
+ * @return The parsed JSON (must be freed by caller), or NULL on invalid JSON
+ */
+cJSON* json_parse_structural(const char* value, size_t buffer_length, const char** return_parse_end, int options);
+
+/**
+ * NUL-terminated variant of json_parse_structural, like cJSON_Parse
+ */
+cJSON* json_parse_structural_string(const char* value);
+
+/**
+ * Like json_input_parse, using json_parse_structural
+ */
+cJSON* json_input_parse_structural(const JsonInput* input);
+
 /**
  * Determines the number of CPU cores available
  */
@@ -317,6 +698,29 @@ int get_num_cores(void) CONST_FUNC;
  */
 int get_optimal_threads(int requested_threads) PURE_FUNC;
 
+/**
+ * Prints json with cJSON_Print/cJSON_PrintUnformatted layout, but always into
+ * heap memory (released with free()) even while an arena is entered.
+ * Numbers get digits that read back to exactly the same double (almost
+ * always the shortest such digits), and strings are scanned for escapes with
+ * SIMD; everything else matches cJSON.
+ */
+char* cjson_tools_print(const cJSON* json, int pretty_print);
+
+/**
+ * Like cJSON_PrintPreallocated: prints into buffer (length bytes including the
+ * NUL) without allocating. Returns 1 on success, 0 if the text does not fit.
+ */
+int cjson_tools_print_preallocated(const cJSON* json, char* buffer, int length, int pretty_print);
+
+/**
+ * Like cjson_tools_print, writing the text to output in bounded chunks as it
+ * is produced instead of building it in memory first
+ *
+ * @return 0 on success, -1 on an invalid item or a write error
+ */
+int cjson_tools_print_stream(const cJSON* json, FILE* output, int pretty_print);
+
 /**
  * Removes all keys that have empty string values from a JSON object
  */
@@ -337,6 +741,44 @@ cJSON* replace_keys(const cJSON* json, const char* pattern, const char* replacem
  */
 cJSON* replace_values(const cJSON* json, const char* pattern, const char* replacement) HOT_PATH;
 
+/**
+ * Compiled match pattern (opaque handle)
+ *
+ * Plain literals with optional anchors such as "^old_", "_id$" or "^name$"
+ * are matched with string comparisons; everything else uses POSIX extended regex.
+ */
+typedef struct CompiledPattern CompiledPattern;
+
+/**
+ * Compiles a pattern once for reuse across many matches
+ *
+ * @param pattern The regex pattern to compile
+ * @return A new compiled pattern (free with cjson_tools_pattern_free), or NULL if invalid
+ */
+CompiledPattern* cjson_tools_pattern_compile(const char* pattern);
+
+/**
+ * Frees a compiled pattern
+ */
+void cjson_tools_pattern_free(CompiledPattern* pattern);
+
+/**
+ * Tests whether a string matches a compiled pattern
+ *
+ * @return 1 on match, 0 otherwise
+ */
+int cjson_tools_pattern_match(const CompiledPattern* pattern, const char* text) HOT_PATH;
+
+/**
+ * Replaces JSON keys that match a compiled pattern with a replacement string
+ */
+cJSON* replace_keys_compiled(const cJSON* json, const CompiledPattern* pattern, const char* replacement) HOT_PATH;
+
+/**
+ * Replaces JSON string values that match a compiled pattern with a replacement string
+ */
+cJSON* replace_values_compiled(const cJSON* json, const CompiledPattern* pattern, const char* replacement) HOT_PATH;
+
 // =============================================================================
 // JSON FLATTENER
 // =============================================================================
@@ -369,6 +811,107 @@ cJSON* flatten_json_batch(cJSON* json_array, int use_threads, int num_threads);
  */
 char* flatten_json_string(const char* json_string, int use_threads, int num_threads);
 
+/**
+ * Flattens a JSON string with control over output formatting
+ *
+ * Flattened pairs are written straight to text without building a flattened cJSON tree.
+ *
+ * @param json_string The JSON string to flatten
+ * @param use_threads Whether to use multi-threading
+ * @param num_threads Number of threads to use (0 for auto-detection)
+ * @param pretty_print Non-zero for formatted output (as returned by flatten_json_string)
+ * @return A new flattened JSON string (must be freed by caller)
+ */
+char* flatten_json_string_opts(const char* json_string, int use_threads, int num_threads, int pretty_print);
+
+/**
+ * Like flatten_json_string_opts for an already parsed document, e.g. one from
+ * json_parse_structural
+ *
+ * @return A new flattened JSON string (must be freed by caller)
+ */
+char* flatten_parsed_json_text(const cJSON* json, int use_threads, int num_threads, int pretty_print);
+
+/**
+ * Like flatten_parsed_json_text, writing the text to output as it is produced.
+ * A batch is flattened in windows of records on the pool and each window is
+ * written in record order, so only one window's text is held in memory.
+ *
+ * @return 0 on success, -1 on a write or allocation failure
+ */
+int flatten_parsed_json_stream(const cJSON* json, FILE* output, int use_threads, int num_threads, int pretty_print);
+
+/**
+ * Flattens a JSON value directly into JSON text
+ *
+ * @param json The JSON value to flatten
+ * @param pretty_print Non-zero for formatted output
+ * @return A new flattened JSON string (must be freed by caller)
+ */
+char* flatten_json_object_text(const cJSON* json, int pretty_print) HOT_PATH;
+
+/**
+ * Flattens every element of a JSON array directly into JSON text
+ *
+ * @param json_array The JSON array to flatten
+ * @param use_threads Whether to use multi-threading
+ * @param num_threads Number of threads to use (0 for auto-detection)
+ * @param pretty_print Non-zero for formatted output
+ * @return One string per array element; the caller frees each string and the array
+ */
+char** flatten_json_batch_text(const cJSON* json_array, int use_threads, int num_threads, int pretty_print);
+
+/**
+ * Flattens a batch of JSON objects on a caller-owned thread pool
+ *
+ * @param json_array The JSON array to flatten
+ * @param pool Pool to run on (NULL runs single-threaded); it stays owned by the caller
+ *             and may be shared by concurrent calls
+ * @return A new JSON array of flattened objects (must be freed by caller)
+ */
+cJSON* flatten_json_batch_with_pool(const cJSON* json_array, ThreadPool* pool);
+
+/**
+ * Cache of record shapes (structure and keys, without the values), shared by
+ * threads and batches. Records whose shape is cached reuse its flattened keys
+ * instead of rebuilding them. Holds at most max_shapes shapes (0 for
+ * FLATTEN_SHAPE_CACHE_SIZE); later shapes are flattened without it.
+ */
+typedef struct FlattenShapeCache FlattenShapeCache;
+FlattenShapeCache* flatten_shape_cache_create(int max_shapes);
+int flatten_shape_cache_count(const FlattenShapeCache* cache);
+void flatten_shape_cache_free(FlattenShapeCache* cache);
+
+/**
+ * Like flatten_json_batch_with_pool() (pool may be NULL), keeping shapes in a
+ * caller-owned cache across calls. Results of cached shapes link the cache's
+ * keys (cJSON_StringIsConst) instead of copying them, so delete the results,
+ * and any duplicates of them, before freeing the cache.
+ */
+cJSON* flatten_json_batch_with_cache(const cJSON* json_array, ThreadPool* pool, FlattenShapeCache* cache);
+
+/**
+ * Text variant of flatten_json_batch_with_pool, like flatten_json_batch_text
+ */
+char** flatten_json_batch_text_with_pool(const cJSON* json_array, ThreadPool* pool, int pretty_print);
+
+/**
+ * Flattens a batch of records held in a view (e.g. from json_parse_array_parallel)
+ * into one JSON array text, like flatten_parsed_json_text of the array
+ *
+ * @param pool Pool to run on (NULL runs single-threaded)
+ * @return A new flattened JSON string (must be freed by caller)
+ */
+char* flatten_json_view_text(const JsonArrayView* records, ThreadPool* pool, int pretty_print);
+
+/**
+ * Like flatten_json_view_text, writing the text to output window by window
+ * like flatten_parsed_json_stream
+ *
+ * @return 0 on success, -1 on a write or allocation failure
+ */
+int flatten_json_view_stream(const JsonArrayView* records, ThreadPool* pool, FILE* output, int pretty_print);
+
 /**
  * Gets flattened paths with their data types from a JSON object
  *
@@ -386,14 +929,215 @@ cJSON* get_flattened_paths_with_types(cJSON* json);
 char* get_flattened_paths_with_types_string(const char* json_string);
 
 // =============================================================================
-// JSON SCHEMA GENERATOR
+// JSON UNFLATTENER
 // =============================================================================
 
 /**
- * Generates a JSON schema from a single JSON object
- * 
- * @param json The JSON object to analyze
- * @return A new JSON schema object (must be freed by caller)
+ * Rebuilds nested JSON from a flattened object: "a.b" keys become members,
+ * "a[2]" keys array elements and a leading "[0]" a top-level array, and the
+ * empty key is a flattened scalar. Array positions no key names become null.
+ * When keys contradict each other (the same path twice, or a path used both
+ * as a value and as a container), the first one wins and later ones are
+ * dropped. Indexes above 1048575 are read as part of a member name.
+ *
+ * @param json The flattened object; anything else is returned as a copy
+ * @return A new nested JSON value (must be freed by caller)
+ */
+cJSON* unflatten_json_object(const cJSON* json);
+
+/**
+ * Unflattens each object of an array, in parallel for large batches
+ *
+ * @param json_array Array of flattened objects
+ * @param use_threads Whether to use multi-threading
+ * @param num_threads Number of threads to use (0 for auto-detection)
+ * @return A new JSON array of nested values (must be freed by caller)
+ */
+cJSON* unflatten_json_batch(const cJSON* json_array, int use_threads, int num_threads);
+
+/**
+ * Like unflatten_json_batch on a caller-owned pool (NULL runs single-threaded)
+ */
+cJSON* unflatten_json_batch_with_pool(const cJSON* json_array, ThreadPool* pool);
+
+/**
+ * Unflattens a parsed document: an array as a batch, anything else as one object
+ *
+ * @return A new nested JSON value (must be freed by caller)
+ */
+cJSON* unflatten_parsed_json(const cJSON* json, int use_threads, int num_threads);
+
+/**
+ * Unflattens a JSON string, like unflatten_parsed_json
+ *
+ * @param pretty_print Non-zero for formatted output
+ * @return A new JSON string (must be freed by caller)
+ */
+char* unflatten_json_string(const char* json_string, int use_threads, int num_threads, int pretty_print);
+
+// =============================================================================
+// PATH PROJECTION
+// =============================================================================
+
+/**
+ * Compiled set of selected paths (opaque handle), read-only once compiled so it
+ * can be shared by threads
+ */
+typedef struct JsonPathSet JsonPathSet;
+
+/**
+ * Compiles a comma-separated path list such as "a.b,c[*].d"
+ *
+ * Paths use the flattened key syntax: names joined by '.', "[n]" for an array
+ * position and "[*]" for every element. A backslash makes the next character of
+ * a name literal (e.g. "a\.b" for the key "a.b"). A path selects the whole
+ * subtree under it.
+ *
+ * @return A new path set (free with json_path_set_free), or NULL on a bad spec
+ */
+JsonPathSet* json_path_set_compile(const char* spec);
+
+/**
+ * Returns the number of paths in the set
+ */
+int json_path_set_count(const JsonPathSet* paths);
+
+/**
+ * Frees a path set
+ */
+void json_path_set_free(JsonPathSet* paths);
+
+/**
+ * Flattens only the selected paths of a JSON value; other subtrees are never walked
+ *
+ * @return A new flattened JSON object with the selected flattened keys (must be freed by caller)
+ */
+cJSON* flatten_json_object_paths(const cJSON* json, const JsonPathSet* paths);
+
+/**
+ * Copies only the selected paths of a JSON value, keeping its nesting
+ *
+ * Unselected array elements that precede a selected one are replaced by {} so
+ * positions are kept. With per_record, a root array is treated as a list of
+ * records and the paths apply to each element.
+ *
+ * @return A new JSON value (must be freed by caller)
+ */
+cJSON* extract_json_paths(const cJSON* json, const JsonPathSet* paths, int per_record);
+
+/**
+ * Parses only the selected paths of JSON text; equivalent to extract_json_paths()
+ * on the fully parsed text
+ *
+ * Unselected subtrees are skipped by scanning for structural characters and
+ * are neither built nor validated. The text need not be NUL-terminated.
+ *
+ * @param text JSON text
+ * @param length Length of text in bytes
+ * @param paths Compiled path set
+ * @param per_record Non-zero to apply the paths to each element of a root array
+ * @return A new JSON value (must be freed by caller), or NULL on invalid selected JSON
+ */
+cJSON* json_parse_paths(const char* text, size_t length, const JsonPathSet* paths, int per_record);
+
+/**
+ * Flattens only the selected paths of a JSON string (a single object or a batch
+ * of records, like flatten_json_string_opts), using the lazy parse
+ *
+ * @return A new flattened JSON string (must be freed by caller)
+ */
+char* flatten_json_string_paths(const char* json_string, const JsonPathSet* paths,
+                                int use_threads, int num_threads, int pretty_print);
+
+// =============================================================================
+// TRANSFORMATION PIPELINE
+// =============================================================================
+
+/**
+ * Pipeline step types, applied in the order they were added
+ */
+typedef enum {
+    PIPELINE_REMOVE_NULLS,
+    PIPELINE_REMOVE_EMPTY,
+    PIPELINE_REPLACE_KEYS,
+    PIPELINE_REPLACE_VALUES,
+    PIPELINE_FLATTEN
+} PipelineStepType;
+
+/**
+ * Ordered list of transformations fused into a single tree walk (opaque handle)
+ */
+typedef struct JsonPipeline JsonPipeline;
+
+/**
+ * Creates an empty pipeline
+ */
+JsonPipeline* json_pipeline_create(void);
+
+/**
+ * Appends a step to a pipeline
+ *
+ * @param pipeline The pipeline to extend
+ * @param type The step type
+ * @param pattern Regex pattern for replace steps (NULL otherwise)
+ * @param replacement Replacement string for replace steps (NULL otherwise)
+ * @return 0 on success, -1 on invalid arguments or pattern
+ */
+int json_pipeline_add_step(JsonPipeline* pipeline, PipelineStepType type,
+                           const char* pattern, const char* replacement);
+
+/**
+ * Parses a pipeline spec such as "remove-nulls,replace-keys:^old_:new_,flatten"
+ *
+ * Steps are comma-separated; replace-keys/replace-values take ":pattern:replacement".
+ * Use "\," and "\:" for literal commas and colons inside patterns.
+ *
+ * @return A new pipeline (free with json_pipeline_free), or NULL on a bad spec
+ */
+JsonPipeline* json_pipeline_parse(const char* spec);
+
+/**
+ * Applies all pipeline steps in one traversal without intermediate trees
+ *
+ * With a flatten step, arrays are treated as batches and each element is flattened.
+ *
+ * @return A new JSON value (must be freed by caller)
+ */
+cJSON* json_pipeline_apply(const JsonPipeline* pipeline, const cJSON* json) HOT_PATH;
+
+/**
+ * Frees a pipeline
+ */
+void json_pipeline_free(JsonPipeline* pipeline);
+
+// =============================================================================
+// JSON SCHEMA GENERATOR
+// =============================================================================
+
+/**
+ * Sampling and statistics settings for schema inference; zero-initialized
+ * options analyze every record and collect no statistics
+ *
+ * With collect_stats set, every schema node carries an "x-stats" annotation:
+ * record and null counts, an approximate distinct count (HyperLogLog with
+ * 2^SCHEMA_HLL_PRECISION registers, exact for small sets), numeric range,
+ * string length and array size bounds, and the values themselves while there
+ * are at most enum_limit of them. A sampled schema gets an "x-sample"
+ * annotation with the number of records seen and analyzed.
+ */
+typedef struct {
+    double sample_rate;        // Fraction of records analyzed, in (0, 1); 0 or 1 analyzes all
+    int sample_size;           // Most records analyzed (0 for no limit)
+    unsigned long long seed;   // Sampling seed; the same seed picks the same records
+    int collect_stats;         // Whether to add "x-stats" annotations
+    int enum_limit;            // Enum detection limit (0 for SCHEMA_ENUM_LIMIT, -1 to disable)
+} SchemaInferenceOptions;
+
+/**
+ * Generates a JSON schema from a single JSON object
+ * 
+ * @param json The JSON object to analyze
+ * @return A new JSON schema object (must be freed by caller)
  */
 cJSON* generate_schema_from_object(cJSON* json);
 
@@ -407,6 +1151,20 @@ cJSON* generate_schema_from_object(cJSON* json);
  */
 cJSON* generate_schema_from_batch(cJSON* json_array, int use_threads, int num_threads);
 
+/**
+ * Generates a JSON schema from multiple JSON objects on a caller-owned thread pool
+ *
+ * @param json_array The array of JSON objects to analyze
+ * @param pool Pool to run on (NULL runs single-threaded); it stays owned by the caller
+ * @return A new JSON schema object (must be freed by caller)
+ */
+cJSON* generate_schema_from_batch_with_pool(const cJSON* json_array, ThreadPool* pool);
+
+/**
+ * Like generate_schema_from_batch_with_pool for records held in a view
+ */
+cJSON* generate_schema_from_view(const JsonArrayView* records, ThreadPool* pool);
+
 /**
  * Generates a JSON schema from a JSON string (auto-detects single object or batch)
  * 
@@ -417,6 +1175,535 @@ cJSON* generate_schema_from_batch(cJSON* json_array, int use_threads, int num_th
  */
 char* generate_schema_from_string(const char* json_string, int use_threads, int num_threads);
 
+/**
+ * Like generate_schema_from_object with statistics options (sampling does not apply)
+ *
+ * @param options Inference options (NULL for the defaults)
+ */
+cJSON* generate_schema_from_object_opts(const cJSON* json, const SchemaInferenceOptions* options);
+
+/**
+ * Like generate_schema_from_batch with sampling and statistics options
+ *
+ * Records are sampled before any are analyzed, so a small sample of a large
+ * batch costs only the sampled records.
+ *
+ * @param options Inference options (NULL for the defaults)
+ */
+cJSON* generate_schema_from_batch_opts(const cJSON* json_array, const SchemaInferenceOptions* options,
+                                       int use_threads, int num_threads);
+
+/**
+ * Like generate_schema_from_view with sampling and statistics options
+ */
+cJSON* generate_schema_from_view_opts(const JsonArrayView* records, ThreadPool* pool,
+                                      const SchemaInferenceOptions* options);
+
+/**
+ * Like generate_schema_from_string with sampling and statistics options
+ */
+char* generate_schema_from_string_opts(const char* json_string, const SchemaInferenceOptions* options,
+                                       int use_threads, int num_threads);
+
+/**
+ * Accumulated schema state that can be extended, combined and persisted (opaque handle)
+ *
+ * Adding records costs only the new data, so schemas over rolling datasets can
+ * be kept up to date without re-reading history. A builder is not thread-safe;
+ * use one per thread and combine them with schema_builder_merge.
+ */
+typedef struct SchemaBuilder SchemaBuilder;
+
+/**
+ * Creates an empty schema builder
+ */
+SchemaBuilder* schema_builder_create(void);
+
+/**
+ * Creates an empty schema builder that samples and collects statistics as options set
+ *
+ * Single records are kept with probability sample_rate; batches are sampled
+ * as a whole and sample_size bounds each batch. Builders merged together
+ * should share the same statistics settings.
+ *
+ * @param options Inference options (NULL for the defaults); copied into the builder
+ */
+SchemaBuilder* schema_builder_create_with_options(const SchemaInferenceOptions* options);
+
+/**
+ * Merges one record into the builder
+ *
+ * @return 0 on success, -1 on invalid arguments or allocation failure
+ */
+int schema_builder_add(SchemaBuilder* builder, const cJSON* record);
+
+/**
+ * Merges every element of a JSON array into the builder
+ *
+ * @param use_threads Whether to use multi-threading
+ * @param num_threads Number of threads to use (0 for auto-detection)
+ * @return 0 on success, -1 on invalid arguments or allocation failure
+ */
+int schema_builder_add_batch(SchemaBuilder* builder, const cJSON* json_array, int use_threads, int num_threads);
+
+/**
+ * Merges every element of a JSON array into the builder on a caller-owned thread pool
+ *
+ * @param pool Pool to run on (NULL runs single-threaded); it stays owned by the caller
+ * @return 0 on success, -1 on invalid arguments or allocation failure
+ */
+int schema_builder_add_batch_with_pool(SchemaBuilder* builder, const cJSON* json_array, ThreadPool* pool);
+
+/**
+ * Merges the state of another builder into this one (other is left unchanged)
+ *
+ * @return 0 on success, -1 on invalid arguments or allocation failure
+ */
+int schema_builder_merge(SchemaBuilder* builder, const SchemaBuilder* other);
+
+/**
+ * Returns the number of records merged into the builder so far
+ */
+long schema_builder_record_count(const SchemaBuilder* builder);
+
+/**
+ * Renders the current schema, as generate_schema_from_batch would for the same records
+ *
+ * @return A new JSON schema object (must be freed by caller); empty for an empty builder
+ */
+cJSON* schema_builder_to_json(const SchemaBuilder* builder);
+
+/**
+ * Serializes the full builder state as compact JSON
+ *
+ * @return A new string (must be freed by caller) accepted by schema_builder_deserialize
+ */
+char* schema_builder_serialize(const SchemaBuilder* builder);
+
+/**
+ * Restores a builder from schema_builder_serialize output
+ *
+ * @return A new builder (free with schema_builder_free), or NULL on malformed state
+ */
+SchemaBuilder* schema_builder_deserialize(const char* state);
+
+/**
+ * Frees a schema builder
+ */
+void schema_builder_free(SchemaBuilder* builder);
+
+// =============================================================================
+// NDJSON (JSON LINES) STREAMING
+// =============================================================================
+
+/**
+ * Per-record transform used by process_json_stream
+ *
+ * @param record The parsed input record
+ * @param user_data Caller-supplied context
+ * @return A new JSON value to write (freed by the stream), or NULL to drop the record
+ */
+typedef cJSON* (*JsonRecordTransform)(const cJSON* record, void* user_data);
+
+/**
+ * Flattens newline-delimited JSON, one output line per input record
+ *
+ * Input is read in bounded chunks and records are flattened in batches of at
+ * most BATCH_SIZE, so memory stays constant regardless of input size.
+ *
+ * @param input Stream of NDJSON records
+ * @param output Stream that receives one flattened record per line
+ * @param use_threads Whether to use multi-threading within each batch
+ * @param num_threads Number of threads to use (0 for auto-detection)
+ * @return Number of records processed, or -1 on error
+ */
+long flatten_json_stream(FILE* input, FILE* output, int use_threads, int num_threads);
+
+/**
+ * Generates a JSON schema from newline-delimited JSON
+ *
+ * Each record is merged into a running schema as soon as it is read.
+ *
+ * @param input Stream of NDJSON records
+ * @return A new JSON schema object (must be freed by caller), or NULL on error
+ */
+cJSON* generate_schema_stream(FILE* input);
+
+/**
+ * Like generate_schema_stream with sampling and statistics options
+ *
+ * sample_rate is applied as records are read. sample_size keeps a uniform
+ * reservoir of that many parsed records, analyzed once the stream ends.
+ *
+ * @param options Inference options (NULL for the defaults)
+ */
+cJSON* generate_schema_stream_opts(FILE* input, const SchemaInferenceOptions* options);
+
+/**
+ * Applies a transform to every record of a newline-delimited JSON stream
+ *
+ * @param input Stream of NDJSON records
+ * @param output Stream that receives one transformed record per line
+ * @param transform Function applied to each record
+ * @param user_data Context passed to the transform
+ * @return Number of records processed, or -1 on error
+ */
+long process_json_stream(FILE* input, FILE* output, JsonRecordTransform transform, void* user_data);
+
+// =============================================================================
+// PARALLEL ARRAY PARSING
+// =============================================================================
+
+/**
+ * Byte range of one element of a top-level array, relative to the document
+ */
+typedef struct {
+    size_t offset;
+    size_t length;
+} JsonSpan;
+
+/**
+ * Finds the elements of a top-level array with one structural scan, without
+ * parsing them. Elements are checked later by json_parse_array_parallel.
+ *
+ * @param text JSON text (need not be NUL-terminated)
+ * @param length Length of text in bytes
+ * @param spans Receives a malloc'd array of element spans (NULL when empty)
+ * @param count Receives the number of elements
+ * @return 0 on success, -1 if text is not an array or its brackets do not balance
+ */
+int json_split_array(const char* text, size_t length, JsonSpan** spans, int* count);
+
+/**
+ * Parses the elements of a top-level array concurrently on pool (NULL parses
+ * inline), accepting exactly what one cJSON parse of the whole array accepts.
+ * No array node is built: records receives one root per element, in order.
+ *
+ * @param records Receives the parsed elements; release with json_array_view_delete
+ * @return 0 on success, -1 on invalid JSON or allocation failure
+ */
+int json_parse_array_parallel(const char* text, size_t length, ThreadPool* pool, JsonArrayView* records);
+
+/**
+ * Applies transform to every record concurrently on pool (NULL runs inline).
+ * Records the transform drops (NULL results) are left out of results, which
+ * keeps the input order.
+ *
+ * @param results Receives the new values; release with json_array_view_delete
+ * @return 0 on success, -1 on invalid arguments or allocation failure
+ */
+int json_array_view_transform(const JsonArrayView* records, ThreadPool* pool,
+                              JsonRecordTransform transform, void* user_data, JsonArrayView* results);
+
+/**
+ * Deletes every record of a view filled by json_parse_array_parallel or
+ * json_array_view_transform, then frees the view
+ */
+void json_array_view_delete(JsonArrayView* records);
+
+// =============================================================================
+// SCHEMA VALIDATION
+// =============================================================================
+
+/**
+ * A schema compiled for validation; immutable once built, so one validator
+ * can check records on any number of threads
+ */
+typedef struct SchemaValidator SchemaValidator;
+
+typedef enum {
+    SCHEMA_VALIDATE_FIRST_ERROR,  // Stop at the first error
+    SCHEMA_VALIDATE_ALL_ERRORS    // Report every error
+} SchemaValidationMode;
+
+/**
+ * Compiles a JSON schema for validation. Accepts the schemas this library
+ * generates and the matching Draft-07 subset: type, properties, required,
+ * items, enum and const (plus annotations such as title and description).
+ * Other keywords are reported and rejected.
+ *
+ * @param schema The schema
+ * @return A new validator (free with schema_validator_free), or NULL on error
+ */
+SchemaValidator* schema_validator_compile(const cJSON* schema);
+
+/**
+ * Compiles a schema given as JSON text
+ *
+ * @param schema_string The schema as a JSON string
+ * @return A new validator (free with schema_validator_free), or NULL on error
+ */
+SchemaValidator* schema_validator_compile_string(const char* schema_string);
+
+/**
+ * Compiles the schema a builder has inferred so far; a builder that has seen
+ * no records accepts anything
+ *
+ * @return A new validator (free with schema_validator_free), or NULL on error
+ */
+SchemaValidator* schema_validator_from_builder(const SchemaBuilder* builder);
+
+/**
+ * Frees a validator
+ */
+void schema_validator_free(SchemaValidator* validator);
+
+/**
+ * Validates one value
+ *
+ * Errors are objects with "path" (a flattened key such as "user.tags[2]",
+ * "" for the value itself) and "message". Values of the wrong type are not
+ * checked further; missing required properties are reported at their path.
+ *
+ * @param json The value to validate
+ * @param mode Whether to stop at the first error
+ * @param errors Receives a new array of errors (may be NULL to only count them)
+ * @return Number of errors (0 when valid), or -1 on error
+ */
+int schema_validate(const SchemaValidator* validator, const cJSON* json, SchemaValidationMode mode,
+                    cJSON** errors);
+
+/**
+ * Validates every element of an array as a separate record
+ *
+ * Errors also carry the "record" index and are ordered by it. With
+ * SCHEMA_VALIDATE_FIRST_ERROR only the first invalid record is reported,
+ * whichever thread finds it first.
+ *
+ * @param json_array Array of records
+ * @param mode Whether to stop at the first error
+ * @param use_threads Whether to use multi-threading
+ * @param num_threads Number of threads to use (0 for auto-detection)
+ * @param errors Receives a new array of errors (may be NULL to only count them)
+ * @return Number of invalid records, or -1 on error
+ */
+int schema_validate_batch(const SchemaValidator* validator, const cJSON* json_array, SchemaValidationMode mode,
+                          int use_threads, int num_threads, cJSON** errors);
+
+/**
+ * Like schema_validate_batch, but on a caller-owned pool
+ * (NULL or a small batch runs inline)
+ */
+int schema_validate_batch_with_pool(const SchemaValidator* validator, const cJSON* json_array,
+                                    SchemaValidationMode mode, ThreadPool* pool, cJSON** errors);
+
+/**
+ * Like schema_validate_batch_with_pool, for records viewed in place
+ */
+int schema_validate_view(const SchemaValidator* validator, const JsonArrayView* records, ThreadPool* pool,
+                         SchemaValidationMode mode, cJSON** errors);
+
+/**
+ * Validates newline-delimited JSON in batches of at most BATCH_SIZE records,
+ * writing one error object per line. Record numbers count from the start of
+ * the stream; with SCHEMA_VALIDATE_FIRST_ERROR reading stops at the first
+ * invalid record.
+ *
+ * @param input Stream of NDJSON records
+ * @param output Stream that receives the errors
+ * @return Number of invalid records, or -1 on error
+ */
+long schema_validate_stream(const SchemaValidator* validator, FILE* input, FILE* output,
+                            SchemaValidationMode mode, int use_threads, int num_threads);
+
+// =============================================================================
+// COLUMNAR OUTPUT
+// =============================================================================
+
+/**
+ * Columnar formats for flattened records: one row per record, one column per
+ * flattened path
+ */
+typedef enum {
+    COLUMNAR_CSV,    // RFC 4180 CSV with a header row
+    COLUMNAR_TSV,    // Tab-separated, with \t, \n, \r and \\ escaped
+    COLUMNAR_ARROW   // Apache Arrow IPC stream
+} ColumnarFormat;
+
+/**
+ * Streams flattened records as CSV, TSV or Arrow record batches. Columns and
+ * their types are fixed by the first write (or by columnar_writer_add_columns);
+ * later values under other paths, or of a type the column cannot hold, are
+ * left out and counted.
+ *
+ * Column types follow get_flattened_paths_with_types: booleans, integers that
+ * fit an int (Arrow int64), other numbers (float64) and strings (utf8). Nulls
+ * fit any column, integers and numbers mix as float64, and other mixes become
+ * string columns holding the JSON text of each value.
+ */
+typedef struct ColumnarWriter ColumnarWriter;
+
+/**
+ * Parses a format name: "csv", "tsv" or "arrow"
+ *
+ * @return 0 on success, -1 for an unknown name
+ */
+int columnar_format_parse(const char* name, ColumnarFormat* format);
+
+/**
+ * Creates a columnar writer
+ *
+ * @param output Stream to write to, or NULL to collect the output in memory
+ * @param batch_rows Rows per record batch (0 for COLUMNAR_BATCH_ROWS)
+ * @return New writer or NULL on failure
+ */
+ColumnarWriter* columnar_writer_create(FILE* output, ColumnarFormat format, int batch_rows);
+
+/**
+ * Adds a column for every flattened path of records, flattening them
+ * concurrently on pool (NULL runs inline). Columns keep the order in which
+ * paths first appear.
+ *
+ * @return 0 on success, -1 on failure or once output has started
+ */
+int columnar_writer_add_columns(ColumnarWriter* writer, const JsonArrayView* records, ThreadPool* pool);
+
+/**
+ * Writes records as rows, in record batches of the writer's batch size. The
+ * first call writes the header (or Arrow schema).
+ *
+ * @return 0 on success, -1 on failure
+ */
+int columnar_writer_write(ColumnarWriter* writer, const JsonArrayView* records, ThreadPool* pool);
+
+/**
+ * Ends the output (the Arrow end-of-stream marker) and flushes it. Left-out
+ * values are reported on stderr.
+ *
+ * @return Rows written, or -1 if any write failed
+ */
+long columnar_writer_finish(ColumnarWriter* writer);
+
+/**
+ * Output of a writer created without a stream; valid until the writer is freed
+ *
+ * @return Output bytes (not NUL-terminated), or NULL for stream writers and after a failure
+ */
+const char* columnar_writer_output(const ColumnarWriter* writer, size_t* length);
+
+/**
+ * Number of values left out so far for falling outside the writer's columns
+ */
+long columnar_writer_dropped(const ColumnarWriter* writer);
+
+/**
+ * Frees a columnar writer
+ */
+void columnar_writer_free(ColumnarWriter* writer);
+
+/**
+ * Writes records to output in one pass over a writer whose columns cover
+ * every record
+ *
+ * @return Rows written, or -1 on failure
+ */
+long flatten_json_view_columnar(const JsonArrayView* records, ThreadPool* pool, FILE* output, ColumnarFormat format);
+
+/**
+ * Flattens json to columnar output: an array gives one row per element,
+ * anything else a single row
+ *
+ * @return Rows written, or -1 on failure
+ */
+long flatten_json_columnar(const cJSON* json, FILE* output, ColumnarFormat format, int use_threads, int num_threads);
+
+/**
+ * Flattens NDJSON records from input to columnar output, one record batch per
+ * COLUMNAR_BATCH_ROWS records. The first batch decides the columns.
+ *
+ * @return Rows written, or -1 on failure
+ */
+long flatten_json_stream_columnar(FILE* input, FILE* output, ColumnarFormat format, int use_threads, int num_threads);
+
+// =============================================================================
+// RUNTIME STATISTICS
+// =============================================================================
+
+/**
+ * Process-wide counters and phase timers since start or the last reset
+ *
+ * Reports records and bytes processed, seconds spent parsing, transforming,
+ * merging and serializing on calling threads, allocations per slab pool
+ * (with heap fallbacks once the arena is exhausted), tasks queued or run
+ * inline because every queue was full, steal attempts and successes, and
+ * per-worker busy/idle time. Built with -DSTATS_DISABLED only
+ * {"enabled": false} is reported.
+ *
+ * @return A new JSON object (must be freed by caller), or NULL on allocation failure
+ */
+cJSON* cjson_tools_get_stats(void);
+
+/**
+ * Like cjson_tools_get_stats, as JSON text
+ *
+ * @return A new string (must be freed by caller), or NULL on allocation failure
+ */
+char* cjson_tools_get_stats_string(int pretty_print);
+
+/**
+ * Zeroes all counters and timers; work running meanwhile may be partly kept
+ */
+void cjson_tools_reset_stats(void);
+
+// =============================================================================
+// SERVER MODE
+// =============================================================================
+
+/**
+ * Status word of a server response
+ */
+typedef enum {
+    JSON_SERVER_OK = 0,       // The body is the result
+    JSON_SERVER_INVALID = 1,  // validate only: the body is a report with invalid records
+    JSON_SERVER_ERROR = 2     // The body is an error message
+} JsonServerStatus;
+
+/**
+ * Server settings; zero-initialized options use the defaults
+ */
+typedef struct {
+    int num_threads;           // Workers serving requests (0 for auto-detection)
+    int max_clients;           // Connections held open at once (0 for SERVER_MAX_CLIENTS)
+    unsigned int max_request;  // Largest header plus payload in bytes (0 for SERVER_MAX_REQUEST)
+} JsonServerOptions;
+
+/**
+ * Serves requests on a Unix domain socket until json_server_stop is called
+ *
+ * Keeps one warm process for many small calls: the thread pool stays up,
+ * patterns, pipelines and schemas are compiled once and cached, and each
+ * request's cJSON allocations come from an arena that is reset afterwards.
+ *
+ * A request is an 8-byte frame header (header length, payload length, both
+ * big-endian uint32), a JSON header and a JSON payload. The header names the
+ * operation and its options:
+ *   {"op": "flatten" | "unflatten" | "remove-empty" | "remove-nulls" |
+ *          "replace-keys" | "replace-values" | "pipeline" | "schema" |
+ *          "validate" | "stats" | "ping",
+ *    "pretty": bool, "pattern": str, "replacement": str, "steps": str,
+ *    "schema": object or str, "all_errors": bool, "sample_rate": number,
+ *    "sample_size": int, "seed": int, "collect_stats": bool, "enum_limit": int}
+ * ping and stats take an empty payload. The response is an 8-byte header
+ * (JsonServerStatus, body length) and the body. Clients may send further
+ * requests on the same connection.
+ *
+ * Requests run concurrently, one per pool worker, and each runs on its
+ * worker alone, so throughput comes from serving many requests at once.
+ * A stale socket file is replaced and the file is removed on exit. One
+ * server runs per process.
+ *
+ * @param socket_path Filesystem path of the socket
+ * @param options Server settings (NULL for the defaults)
+ * @return 0 after json_server_stop, -1 if the server could not start or failed
+ */
+int json_server_run(const char* socket_path, const JsonServerOptions* options);
+
+/**
+ * Asks a running json_server_run to return once requests in flight are
+ * answered. Async-signal-safe, so it may be called from a signal handler.
+ */
+void json_server_stop(void);
+
 // =============================================================================
 // WINDOWS PTHREAD COMPATIBILITY (when threading is disabled)
 // =============================================================================
@@ -444,6 +1731,9 @@ int pthread_cond_destroy(pthread_cond_t* cond);
 // Performance tuning constants
 #define MIN_OBJECTS_PER_THREAD 25   // Reduced for better parallelization
 #define MIN_BATCH_SIZE_FOR_MT 100   // Reduced threshold for multi-threading
+#define MIN_RECORDS_PER_CHUNK 16    // Smallest range of records handed to a worker
+#define SCHEMA_BLOCKS_PER_THREAD 4  // Schema accumulators per participating thread
+#define SCHEMA_INDEX_THRESHOLD 8    // Properties before a schema object gets a hash index
 #define INITIAL_ARRAY_CAPACITY 64   // Larger initial capacity
 #define KEY_BUFFER_SIZE 512         // Pre-allocated key buffer size
 #define MEMORY_POOL_SIZE 8192       // Memory pool for small allocations
@@ -451,6 +1741,17 @@ int pthread_cond_destroy(pthread_cond_t* cond);
 #define MAX_KEY_LENGTH 2048         // Maximum length for JSON keys
 #define BATCH_SIZE 1000             // Default batch processing size
 #define MAX_ARRAY_SAMPLE_SIZE 50    // Maximum array items to sample for type inference
+#define SCHEMA_HLL_PRECISION 10     // log2 of the registers behind a distinct-count estimate
+#define SCHEMA_ENUM_LIMIT 16        // Distinct values a field may have to be reported as an enum
+#define NDJSON_CHUNK_SIZE 65536     // Read chunk size for NDJSON streaming
+#define FLATTEN_SHAPE_CACHE_SIZE 64 // Shapes a per-batch flatten cache keeps
+#define FLATTEN_SHAPE_MISS_LIMIT 16 // Uncacheable shapes before a worker stops looking
+#define JSON_ARENA_BLOCK_SIZE (256 * 1024) // Default growth step of a cJSON arena
+#define COLUMNAR_BATCH_ROWS 8192    // Rows per columnar record batch
+#define SERVER_MAX_CLIENTS 1024     // Connections a server holds open by default
+#define SERVER_MAX_REQUEST (256u * 1024 * 1024) // Default limit on a request's header and payload
+#define SERVER_CACHE_SIZE 256       // Compiled patterns, pipelines and schemas a server keeps
+#define SERVER_IO_TIMEOUT_MS 10000  // Longest a server waits on a stalled client read or write
 
 #ifdef __cplusplus
 }
@@ -1,10 +1,29 @@
+// MAP_ANONYMOUS, fileno() and syscall() are not part of strict C99
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "cjson_tools.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <float.h>
 #include <time.h>
+#include <errno.h>
+#include <signal.h>
+#ifdef ENABLE_LOCALES
+#include <locale.h>
+#endif
+
+// Optional codecs for compressed input and output (ZLIB/ZSTD in the Makefile)
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 // Platform-specific includes
 #ifdef __WINDOWS__
@@ -18,12 +37,22 @@
     #include <unistd.h>
     #include <sys/stat.h>
     #include <fcntl.h>
+    #include <sys/uio.h>
     #ifndef THREADING_DISABLED
         #include <pthread.h>
     #endif
     #ifdef __unix__
         #include <sys/mman.h>
     #endif
+    #if defined(__unix__) || defined(__APPLE__)
+        #include <poll.h>
+        #include <sys/socket.h>
+        #include <sys/un.h>
+    #endif
+    #ifdef __linux__
+        #include <sys/syscall.h>
+        #include <linux/futex.h>
+    #endif
     #ifndef __WINDOWS__
         #include <regex.h>
     #endif
@@ -32,21 +61,33 @@
 // Advanced SIMD includes with runtime detection
 #if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
     #define CPU_X86_FAMILY 1
-    #ifdef __SSE2__
-        #include <emmintrin.h>
-        #define HAS_SSE2_INTRINSICS 1
-    #endif
-    #ifdef __SSE4_1__
-        #include <smmintrin.h>
-        #define HAS_SSE41_INTRINSICS 1
-    #endif
-    #ifdef __AVX2__
+    #if defined(__GNUC__) || defined(__clang__)
+        // Each kernel carries its own target attribute and is picked at runtime,
+        // so a build for the baseline ISA still has every vector variant
         #include <immintrin.h>
+        #define HAS_SSE2_INTRINSICS 1
         #define HAS_AVX2_INTRINSICS 1
-    #endif
-    #ifdef __AVX512F__
-        #include <immintrin.h>
         #define HAS_AVX512_INTRINSICS 1
+        #define TARGET_SSE2 __attribute__((target("sse2")))
+        #define TARGET_AVX2 __attribute__((target("avx2")))
+        #define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+    #else
+        // Other compilers only get the kernels the build flags enable
+        #ifdef __SSE2__
+            #include <emmintrin.h>
+            #define HAS_SSE2_INTRINSICS 1
+        #endif
+        #ifdef __AVX2__
+            #include <immintrin.h>
+            #define HAS_AVX2_INTRINSICS 1
+        #endif
+        #if defined(__AVX512F__) && defined(__AVX512BW__)
+            #include <immintrin.h>
+            #define HAS_AVX512_INTRINSICS 1
+        #endif
+        #define TARGET_SSE2
+        #define TARGET_AVX2
+        #define TARGET_AVX512
     #endif
 #elif defined(__aarch64__) || defined(_M_ARM64)
     #define CPU_ARM64_FAMILY 1
@@ -56,6 +97,14 @@
     #endif
 #endif
 
+// Vector loops may read past a terminator up to the end of an aligned block,
+// which never crosses a page but would trip the sanitizers
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+    #define NO_SANITIZE_OVERREAD __attribute__((no_sanitize("address", "thread")))
+#else
+    #define NO_SANITIZE_OVERREAD
+#endif
+
 // Apple-specific includes
 #ifdef __APPLE__
     #include <sys/sysctl.h>
@@ -78,6 +127,7 @@ typedef struct {
     int has_sse41;
     int has_avx2;
     int has_avx512;
+    int has_avx512bw;
     int has_neon;
     int has_popcnt;
     int has_bmi2;
@@ -101,26 +151,27 @@ static void detect_x86_features(void) {
     g_cpu.has_sse41 = (cpuid_info[2] & (1 << 19)) != 0;
     g_cpu.has_popcnt = (cpuid_info[2] & (1 << 23)) != 0;
     
-    __cpuid(cpuid_info, 7);
-    g_cpu.has_avx2 = (cpuid_info[1] & (1 << 5)) != 0;
+    // Vector registers are only usable if the OS saves them (OSXSAVE + XCR0)
+    unsigned long long xcr0 = (cpuid_info[2] & (1 << 27)) ? _xgetbv(0) : 0;
+    int os_avx = (xcr0 & 0x6) == 0x6;
+    int os_avx512 = (xcr0 & 0xE6) == 0xE6;
+    
+    __cpuidex(cpuid_info, 7, 0);
+    g_cpu.has_avx2 = os_avx && (cpuid_info[1] & (1 << 5)) != 0;
     g_cpu.has_bmi2 = (cpuid_info[1] & (1 << 8)) != 0;
-    g_cpu.has_avx512 = (cpuid_info[1] & (1 << 16)) != 0;
+    g_cpu.has_avx512 = os_avx512 && (cpuid_info[1] & (1 << 16)) != 0;
+    g_cpu.has_avx512bw = os_avx512 && (cpuid_info[1] & (1 << 30)) != 0;
     
     #elif defined(__GNUC__) || defined(__clang__)
-    unsigned int eax, ebx, ecx, edx;
-    
-    // Check CPUID availability
-    if (__builtin_cpu_supports("sse2")) g_cpu.has_sse2 = 1;
-    if (__builtin_cpu_supports("sse4.1")) g_cpu.has_sse41 = 1;
-    if (__builtin_cpu_supports("avx2")) g_cpu.has_avx2 = 1;
-    if (__builtin_cpu_supports("popcnt")) g_cpu.has_popcnt = 1;
-    if (__builtin_cpu_supports("bmi2")) g_cpu.has_bmi2 = 1;
-    
-    // AVX-512 detection (more complex)
-    __asm__ volatile ("cpuid"
-                     : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
-                     : "a" (7), "c" (0));
-    g_cpu.has_avx512 = (ebx & (1 << 16)) != 0;
+    // Unlike bare CPUID bits, these also check that the OS saves the registers
+    __builtin_cpu_init();
+    g_cpu.has_sse2 = __builtin_cpu_supports("sse2") != 0;
+    g_cpu.has_sse41 = __builtin_cpu_supports("sse4.1") != 0;
+    g_cpu.has_avx2 = __builtin_cpu_supports("avx2") != 0;
+    g_cpu.has_popcnt = __builtin_cpu_supports("popcnt") != 0;
+    g_cpu.has_bmi2 = __builtin_cpu_supports("bmi2") != 0;
+    g_cpu.has_avx512 = __builtin_cpu_supports("avx512f") != 0;
+    g_cpu.has_avx512bw = __builtin_cpu_supports("avx512bw") != 0;
     #endif
 }
 #endif
@@ -180,9 +231,13 @@ static void detect_cache_info(void) {
     if (g_cpu.l3_cache_size == 0) g_cpu.l3_cache_size = 8 * 1024 * 1024;
 }
 
-static void detect_cpu_features(void) {
-    if (__atomic_load_n(&g_cpu_detected, __ATOMIC_ACQUIRE)) return;
-    
+static void resolve_simd_dispatch(void);
+
+#ifndef THREADING_DISABLED
+static pthread_once_t g_cpu_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void detect_cpu_features_once(void) {
     memset(&g_cpu, 0, sizeof(g_cpu));
     
     #ifdef CPU_X86_FAMILY
@@ -193,115 +248,340 @@ static void detect_cpu_features(void) {
     
     detect_cache_info();
     g_cpu.num_cores = get_num_cores();
+    resolve_simd_dispatch();
     
     __atomic_store_n(&g_cpu_detected, 1, __ATOMIC_RELEASE);
 }
 
+static void detect_cpu_features(void) {
+    if (__atomic_load_n(&g_cpu_detected, __ATOMIC_ACQUIRE)) return;
+    
+    #ifndef THREADING_DISABLED
+    pthread_once(&g_cpu_once, detect_cpu_features_once);
+    #else
+    detect_cpu_features_once();
+    #endif
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+// Resolve the kernels when the library is loaded, before any call needs them
+__attribute__((constructor)) static void detect_cpu_features_at_load(void) {
+    detect_cpu_features();
+}
+#endif
+
 // =============================================================================
-// OPTIMIZED MEMORY OPERATIONS
+// RUNTIME STATISTICS
 // =============================================================================
 
-// Cache-optimized memory copy
-static ALWAYS_INLINE void fast_memcpy(void* restrict dst, const void* restrict src, size_t n) {
-    if (UNLIKELY(n == 0)) return;
-    
-    #ifdef HAS_AVX512_INTRINSICS
-    if (g_cpu.has_avx512 && n >= 64 && ((uintptr_t)dst & 63) == 0 && ((uintptr_t)src & 63) == 0) {
-        const __m512i* s = (const __m512i*)src;
-        __m512i* d = (__m512i*)dst;
-        size_t avx512_count = n / 64;
-        
-        for (size_t i = 0; i < avx512_count; i++) {
-            _mm512_store_si512(d + i, _mm512_load_si512(s + i));
-        }
-        
-        size_t remaining = n % 64;
-        if (remaining > 0) {
-            memcpy((char*)dst + avx512_count * 64, (const char*)src + avx512_count * 64, remaining);
-        }
-        return;
-    }
+// Counters and phase timers live in one block per thread, so hot paths only
+// write memory of their own thread and cjson_tools_get_stats() sums the blocks.
+// A value is only ever written by its thread, with relaxed atomic loads and
+// stores, so readers see whole values without the cost of atomic increments.
+// Build with -DSTATS_DISABLED to compile the instrumentation out.
+
+typedef enum {
+    STAT_RECORDS,
+    STAT_BYTES_IN,
+    STAT_BYTES_OUT,
+    STAT_TASKS_QUEUED,
+    STAT_TASKS_INLINE,      // Run by the submitter because every queue was full
+    STAT_STEAL_ATTEMPTS,    // Probes of another worker's non-empty queue
+    STAT_STEALS,
+    STAT_WORKER_TASKS,
+    STAT_WORKER_BUSY_NS,
+    STAT_WORKER_IDLE_NS,
+    STAT_COUNTER_COUNT
+} StatCounter;
+
+typedef enum {
+    STATS_PHASE_UNTRACKED = -2,  // Returned on pool workers, which report busy/idle time instead
+    STATS_PHASE_NONE = -1,
+    STATS_PHASE_PARSE,
+    STATS_PHASE_TRANSFORM,
+    STATS_PHASE_MERGE,
+    STATS_PHASE_SERIALIZE,
+    STATS_PHASE_COUNT
+} StatsPhase;
+
+// One slot per slab allocator that has a per-thread magazine slot (SLAB_MAX_CACHED_ALLOCATORS)
+#define STATS_POOL_SLOTS 16
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;           // Objects returned to the pool's slabs
+    uint64_t heap_fallbacks;  // Allocations served by malloc because the arena was exhausted
+} PoolStats;
+
+typedef struct StatsBlock {
+    uint64_t counters[STAT_COUNTER_COUNT];
+    uint64_t phase_ns[STATS_PHASE_COUNT];
+    uint64_t phase_calls[STATS_PHASE_COUNT];
+    PoolStats pools[STATS_POOL_SLOTS];
+    int worker;               // Set on thread pool workers
+    int exited;               // Worker block whose thread has ended, kept for the next worker
+    int phase;                // Innermost open phase, owner thread only
+    uint64_t phase_start;     // When that phase last started or resumed
+    struct StatsBlock* next;
+} StatsBlock;
+
+#ifndef STATS_DISABLED
+
+static uint64_t stats_clock_ns(void) {
+    #ifdef __WINDOWS__
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+    #else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
     #endif
-    
-    #ifdef HAS_AVX2_INTRINSICS
-    if (g_cpu.has_avx2 && n >= 32 && ((uintptr_t)dst & 31) == 0 && ((uintptr_t)src & 31) == 0) {
-        const __m256i* s = (const __m256i*)src;
-        __m256i* d = (__m256i*)dst;
-        size_t avx2_count = n / 32;
-        
-        for (size_t i = 0; i < avx2_count; i++) {
-            _mm256_store_si256(d + i, _mm256_load_si256(s + i));
-        }
-        
-        size_t remaining = n % 32;
-        if (remaining > 0) {
-            memcpy((char*)dst + avx2_count * 32, (const char*)src + avx2_count * 32, remaining);
-        }
+}
+
+// Live blocks and those of exited workers, and the sums of other threads that have exited
+static pthread_mutex_t g_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static StatsBlock* g_stats_blocks = NULL;
+static StatsBlock g_stats_retired;
+static const char* g_stats_pool_names[STATS_POOL_SLOTS];
+
+static void stats_bump(uint64_t* value, uint64_t amount) {
+    __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+// Adds src into dst; callers hold g_stats_mutex
+static void stats_fold(StatsBlock* dst, const StatsBlock* src) {
+    const uint64_t* from = (const uint64_t*)src;
+    uint64_t* to = (uint64_t*)dst;
+    size_t values = offsetof(StatsBlock, worker) / sizeof(uint64_t);
+    for (size_t i = 0; i < values; i++) {
+        stats_bump(&to[i], __atomic_load_n(&from[i], __ATOMIC_RELAXED));
+    }
+}
+
+static StatsBlock* stats_register_block(StatsBlock* block) {
+    block->phase = STATS_PHASE_NONE;
+    pthread_mutex_lock(&g_stats_mutex);
+    block->next = g_stats_blocks;
+    g_stats_blocks = block;
+    pthread_mutex_unlock(&g_stats_mutex);
+    return block;
+}
+
+#ifndef THREADING_DISABLED
+#if defined(__GNUC__) || defined(__clang__)
+#define STATS_THREAD_LOCAL __thread
+#else
+#define STATS_THREAD_LOCAL _Thread_local
+#endif
+static STATS_THREAD_LOCAL StatsBlock* t_stats = NULL;
+static pthread_key_t g_stats_key;
+static pthread_once_t g_stats_once = PTHREAD_ONCE_INIT;
+
+// Thread exit: keep the thread's totals, drop its block. Worker blocks stay
+// listed so per-worker times outlive pool shutdown; pools reuse them, which
+// bounds their number by the most workers ever alive at once.
+static void stats_retire_block(void* arg) {
+    StatsBlock* block = (StatsBlock*)arg;
+    
+    pthread_mutex_lock(&g_stats_mutex);
+    if (block->worker) {
+        block->exited = 1;
+        pthread_mutex_unlock(&g_stats_mutex);
+        t_stats = NULL;
         return;
     }
-    #endif
-    
-    #ifdef HAS_NEON_INTRINSICS
-    if (g_cpu.has_neon && n >= 16 && ((uintptr_t)dst & 15) == 0 && ((uintptr_t)src & 15) == 0) {
-        const uint8x16_t* s = (const uint8x16_t*)src;
-        uint8x16_t* d = (uint8x16_t*)dst;
-        size_t neon_count = n / 16;
-        
-        for (size_t i = 0; i < neon_count; i++) {
-            vst1q_u8((uint8_t*)(d + i), vld1q_u8((const uint8_t*)(s + i)));
-        }
-        
-        size_t remaining = n % 16;
-        if (remaining > 0) {
-            memcpy((char*)dst + neon_count * 16, (const char*)src + neon_count * 16, remaining);
+    for (StatsBlock** link = &g_stats_blocks; *link; link = &(*link)->next) {
+        if (*link == block) {
+            *link = block->next;
+            break;
         }
-        return;
     }
-    #endif
+    stats_fold(&g_stats_retired, block);
+    pthread_mutex_unlock(&g_stats_mutex);
     
-    // Fallback to standard memcpy
-    memcpy(dst, src, n);
+    t_stats = NULL;
+    free(block);
 }
 
-// Optimized memory comparison
-static ALWAYS_INLINE int fast_memcmp(const void* a, const void* b, size_t n) {
-    if (UNLIKELY(n == 0)) return 0;
-    if (UNLIKELY(a == b)) return 0;
-    
-    #ifdef HAS_AVX2_INTRINSICS
-    if (g_cpu.has_avx2 && n >= 32) {
-        const __m256i* pa = (const __m256i*)a;
-        const __m256i* pb = (const __m256i*)b;
-        size_t avx2_count = n / 32;
-        
-        for (size_t i = 0; i < avx2_count; i++) {
-            __m256i va = _mm256_loadu_si256(pa + i);
-            __m256i vb = _mm256_loadu_si256(pb + i);
-            __m256i cmp = _mm256_cmpeq_epi8(va, vb);
-            uint32_t mask = _mm256_movemask_epi8(cmp);
-            
-            if (mask != 0xFFFFFFFF) {
-                // Found difference, fall back to byte comparison
-                const char* ca = (const char*)a + i * 32;
-                const char* cb = (const char*)b + i * 32;
-                for (size_t j = 0; j < 32; j++) {
-                    if (ca[j] != cb[j]) {
-                        return (unsigned char)ca[j] - (unsigned char)cb[j];
-                    }
-                }
+static void stats_init_key(void) {
+    pthread_key_create(&g_stats_key, stats_retire_block);
+}
+
+static StatsBlock* stats_block_create(void) {
+    pthread_once(&g_stats_once, stats_init_key);
+    StatsBlock* block = calloc(1, sizeof(StatsBlock));
+    if (!block) return NULL;
+    
+    stats_register_block(block);
+    pthread_setspecific(g_stats_key, block);
+    t_stats = block;
+    return block;
+}
+
+static ALWAYS_INLINE StatsBlock* stats_block(void) {
+    StatsBlock* block = t_stats;
+    return LIKELY(block != NULL) ? block : stats_block_create();
+}
+
+// Called first thing on a pool worker: adopts the block of an exited worker if there is one
+static void stats_mark_worker(void) {
+    pthread_once(&g_stats_once, stats_init_key);
+    StatsBlock* block = t_stats;
+    
+    if (!block) {
+        pthread_mutex_lock(&g_stats_mutex);
+        for (StatsBlock* candidate = g_stats_blocks; candidate; candidate = candidate->next) {
+            if (candidate->exited) {
+                candidate->exited = 0;
+                block = candidate;
+                break;
             }
         }
+        pthread_mutex_unlock(&g_stats_mutex);
         
-        // Compare remaining bytes
-        size_t remaining = n % 32;
-        if (remaining > 0) {
-            return memcmp((const char*)a + avx2_count * 32, 
-                         (const char*)b + avx2_count * 32, remaining);
+        if (block) {
+            pthread_setspecific(g_stats_key, block);
+            t_stats = block;
+        } else {
+            block = stats_block_create();
         }
-        return 0;
     }
-    #endif
+    if (block) {
+        // cjson_tools_get_stats reads the flag while walking the blocks
+        pthread_mutex_lock(&g_stats_mutex);
+        block->worker = 1;
+        pthread_mutex_unlock(&g_stats_mutex);
+    }
+}
+#else
+static StatsBlock g_stats_single;
+static int g_stats_single_registered = 0;
+
+static ALWAYS_INLINE StatsBlock* stats_block(void) {
+    if (UNLIKELY(!g_stats_single_registered)) {
+        g_stats_single_registered = 1;
+        stats_register_block(&g_stats_single);
+    }
+    return &g_stats_single;
+}
+
+static void stats_mark_worker(void) {}
+#endif
+
+static ALWAYS_INLINE void stats_add(StatCounter counter, uint64_t amount) {
+    StatsBlock* block = stats_block();
+    if (LIKELY(block != NULL)) stats_bump(&block->counters[counter], amount);
+}
+
+// Timestamp for worker busy/idle accounting
+static ALWAYS_INLINE uint64_t stats_now(void) {
+    return stats_clock_ns();
+}
+
+static ALWAYS_INLINE void stats_pool_alloc(int slot, int from_heap) {
+    StatsBlock* block = stats_block();
+    if (UNLIKELY(!block || slot < 0)) return;
+    stats_bump(&block->pools[slot].allocs, 1);
+    if (UNLIKELY(from_heap)) stats_bump(&block->pools[slot].heap_fallbacks, 1);
+}
+
+static ALWAYS_INLINE void stats_pool_free(int slot) {
+    StatsBlock* block = stats_block();
+    if (LIKELY(block != NULL && slot >= 0)) stats_bump(&block->pools[slot].frees, 1);
+}
+
+// A new allocator in a slot starts from zero
+static void stats_clear_pool_slot(int slot) {
+    pthread_mutex_lock(&g_stats_mutex);
+    for (StatsBlock* block = g_stats_blocks; block; block = block->next) {
+        __atomic_store_n(&block->pools[slot].allocs, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&block->pools[slot].frees, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&block->pools[slot].heap_fallbacks, 0, __ATOMIC_RELAXED);
+    }
+    memset(&g_stats_retired.pools[slot], 0, sizeof(PoolStats));
+    g_stats_pool_names[slot] = NULL;
+    pthread_mutex_unlock(&g_stats_mutex);
+}
+
+static void stats_name_pool(int slot, const char* name) {
+    if (slot < 0) return;
+    pthread_mutex_lock(&g_stats_mutex);
+    g_stats_pool_names[slot] = name;
+    pthread_mutex_unlock(&g_stats_mutex);
+}
+
+// Phases nest: an inner phase pauses the outer one, so each phase reports the
+// wall time spent in it on the calling thread and nothing is counted twice.
+// stats_phase_begin returns the outer phase for the matching stats_phase_end.
+// Pool workers run pieces of a caller's phase, so they track no phases.
+static int stats_phase_begin(StatsPhase phase) {
+    StatsBlock* block = stats_block();
+    if (UNLIKELY(!block || block->worker)) return STATS_PHASE_UNTRACKED;
+    
+    uint64_t now = stats_clock_ns();
+    int outer = block->phase;
+    if (outer != STATS_PHASE_NONE) {
+        stats_bump(&block->phase_ns[outer], now - block->phase_start);
+    }
+    block->phase = phase;
+    block->phase_start = now;
+    return outer;
+}
+
+static void stats_phase_end(int outer) {
+    if (outer == STATS_PHASE_UNTRACKED) return;
+    StatsBlock* block = stats_block();
+    if (UNLIKELY(!block || block->phase == STATS_PHASE_NONE)) return;
     
+    uint64_t now = stats_clock_ns();
+    stats_bump(&block->phase_ns[block->phase], now - block->phase_start);
+    stats_bump(&block->phase_calls[block->phase], 1);
+    block->phase = outer;
+    block->phase_start = now;
+}
+
+// Records and bytes are counted by the outermost phase only, so a call made on
+// behalf of another instrumented call does not count its input again
+static ALWAYS_INLINE void stats_count(int outer, StatCounter counter, uint64_t amount) {
+    if (outer == STATS_PHASE_NONE) stats_add(counter, amount);
+}
+
+static ALWAYS_INLINE int stats_transform_begin(uint64_t records) {
+    int outer = stats_phase_begin(STATS_PHASE_TRANSFORM);
+    stats_count(outer, STAT_RECORDS, records);
+    return outer;
+}
+
+#else
+
+static ALWAYS_INLINE void stats_add(StatCounter counter, uint64_t amount) { (void)counter; (void)amount; }
+static ALWAYS_INLINE uint64_t stats_now(void) { return 0; }
+static ALWAYS_INLINE void stats_mark_worker(void) {}
+static ALWAYS_INLINE void stats_pool_alloc(int slot, int from_heap) { (void)slot; (void)from_heap; }
+static ALWAYS_INLINE void stats_pool_free(int slot) { (void)slot; }
+static ALWAYS_INLINE void stats_clear_pool_slot(int slot) { (void)slot; }
+static ALWAYS_INLINE void stats_name_pool(int slot, const char* name) { (void)slot; (void)name; }
+static ALWAYS_INLINE int stats_phase_begin(StatsPhase phase) { (void)phase; return STATS_PHASE_UNTRACKED; }
+static ALWAYS_INLINE void stats_phase_end(int outer) { (void)outer; }
+static ALWAYS_INLINE void stats_count(int outer, StatCounter counter, uint64_t amount) { (void)outer; (void)counter; (void)amount; }
+static ALWAYS_INLINE int stats_transform_begin(uint64_t records) { (void)records; return STATS_PHASE_UNTRACKED; }
+
+#endif
+
+// =============================================================================
+// OPTIMIZED MEMORY OPERATIONS
+// =============================================================================
+
+// libc's memcpy/memcmp already pick a vector implementation for the running
+// CPU when they are loaded, and the compiler expands small constant sizes
+// inline, so copies and compares go straight to them
+static ALWAYS_INLINE void fast_memcpy(void* restrict dst, const void* restrict src, size_t n) {
+    memcpy(dst, src, n);
+}
+
+static ALWAYS_INLINE int fast_memcmp(const void* a, const void* b, size_t n) {
     return memcmp(a, b, n);
 }
 
@@ -309,11 +589,10 @@ static ALWAYS_INLINE int fast_memcmp(const void* a, const void* b, size_t n) {
 // ULTRA-FAST STRING OPERATIONS
 // =============================================================================
 
-// Vectorized strlen with multiple implementations
-static size_t strlen_avx512(const char* str) {
-    #ifdef HAS_AVX512_INTRINSICS
-    if (!g_cpu.has_avx512) return strlen(str);
-    
+// Vectorized strlen kernels; each scans aligned blocks once the start is aligned.
+// strlen_simd reaches them through the dispatch table below.
+#ifdef HAS_AVX512_INTRINSICS
+static TARGET_AVX512 NO_SANITIZE_OVERREAD size_t strlen_avx512(const char* str) {
     const char* start = str;
     const __m512i zero = _mm512_setzero_si512();
     
@@ -324,27 +603,17 @@ static size_t strlen_avx512(const char* str) {
     }
     
     // Process 64 bytes at a time
-    while (1) {
-        __m512i chunk = _mm512_load_si512((const __m512i*)str);
-        __mmask64 mask = _mm512_cmpeq_epi8_mask(chunk, zero);
-        
+    for (;; str += 64) {
+        __mmask64 mask = _mm512_cmpeq_epi8_mask(_mm512_load_si512((const void*)str), zero);
         if (mask != 0) {
             return str - start + __builtin_ctzll(mask);
         }
-        str += 64;
-        
-        // Safety check
-        if (str - start > 1000000) break;
     }
-    #endif
-    
-    return strlen(str);
 }
+#endif
 
-static size_t strlen_avx2(const char* str) {
-    #ifdef HAS_AVX2_INTRINSICS
-    if (!g_cpu.has_avx2) return strlen(str);
-    
+#ifdef HAS_AVX2_INTRINSICS
+static TARGET_AVX2 NO_SANITIZE_OVERREAD size_t strlen_avx2(const char* str) {
     const char* start = str;
     const __m256i zero = _mm256_setzero_si256();
     
@@ -355,28 +624,18 @@ static size_t strlen_avx2(const char* str) {
     }
     
     // Process 32 bytes at a time
-    while (1) {
+    for (;; str += 32) {
         __m256i chunk = _mm256_load_si256((const __m256i*)str);
-        __m256i cmp = _mm256_cmpeq_epi8(chunk, zero);
-        uint32_t mask = _mm256_movemask_epi8(cmp);
-        
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, zero));
         if (mask != 0) {
             return str - start + __builtin_ctz(mask);
         }
-        str += 32;
-        
-        // Safety check
-        if (str - start > 1000000) break;
     }
-    #endif
-    
-    return strlen(str);
 }
+#endif
 
-static size_t strlen_neon(const char* str) {
-    #ifdef HAS_NEON_INTRINSICS
-    if (!g_cpu.has_neon) return strlen(str);
-    
+#ifdef HAS_NEON_INTRINSICS
+static NO_SANITIZE_OVERREAD size_t strlen_neon(const char* str) {
     const char* start = str;
     const uint8x16_t zero = vdupq_n_u8(0);
     
@@ -387,9 +646,8 @@ static size_t strlen_neon(const char* str) {
     }
     
     // Process 16 bytes at a time
-    while (1) {
-        uint8x16_t chunk = vld1q_u8((const uint8_t*)str);
-        uint8x16_t cmp = vceqq_u8(chunk, zero);
+    for (;; str += 16) {
+        uint8x16_t cmp = vceqq_u8(vld1q_u8((const uint8_t*)str), zero);
         
         // Convert to mask
         uint64x2_t mask64 = vreinterpretq_u64_u8(cmp);
@@ -401,71 +659,18 @@ static size_t strlen_neon(const char* str) {
                 if (str[i] == 0) return str - start + i;
             }
         }
-        
-        str += 16;
-        
-        // Safety check
-        if (str - start > 1000000) break;
     }
-    #endif
-    
-    return strlen(str);
-}
-
-size_t strlen_simd(const char* str) {
-    if (UNLIKELY(!str)) return 0;
-    
-    detect_cpu_features();
-    
-    #ifdef HAS_AVX512_INTRINSICS
-    if (g_cpu.has_avx512) return strlen_avx512(str);
-    #endif
-    
-    #ifdef HAS_AVX2_INTRINSICS
-    if (g_cpu.has_avx2) return strlen_avx2(str);
-    #endif
-    
-    #ifdef HAS_NEON_INTRINSICS
-    if (g_cpu.has_neon) return strlen_neon(str);
-    #endif
-    
-    return strlen(str);
 }
+#endif
 
-// Optimized string search
+// Optimized string search; libc's strstr is already vectorized and, unlike a
+// fixed-width scan, never reads past the end of the haystack
 const char* fast_strstr(const char* haystack, const char* needle) {
     if (!haystack || !needle || !*needle) return haystack;
     
-    size_t needle_len = strlen_simd(needle);
-    if (needle_len == 1) {
+    if (needle[1] == '\0') {
         return strchr(haystack, needle[0]);
     }
-    
-    #ifdef HAS_AVX2_INTRINSICS
-    if (g_cpu.has_avx2 && needle_len <= 32) {
-        const __m256i first_char = _mm256_set1_epi8(needle[0]);
-        const char* h = haystack;
-        
-        while (*h) {
-            // Find potential matches
-            __m256i chunk = _mm256_loadu_si256((const __m256i*)h);
-            __m256i cmp = _mm256_cmpeq_epi8(chunk, first_char);
-            uint32_t mask = _mm256_movemask_epi8(cmp);
-            
-            while (mask) {
-                int pos = __builtin_ctz(mask);
-                if (strncmp(h + pos, needle, needle_len) == 0) {
-                    return h + pos;
-                }
-                mask &= mask - 1; // Clear lowest set bit
-            }
-            
-            h += 32;
-        }
-        return NULL;
-    }
-    #endif
-    
     return strstr(haystack, needle);
 }
 
@@ -473,167 +678,351 @@ const char* fast_strstr(const char* haystack, const char* needle) {
 // ENHANCED MEMORY POOL SYSTEM
 // =============================================================================
 
-typedef struct MemoryBlock {
-    struct MemoryBlock* next;
+// Slabs are carved from large arena segments and aligned to their own size,
+// so the allocator that owns any slab object is found by masking its address
+#define ARENA_SEGMENT_SIZE (64 * 1024 * 1024)
+#define ARENA_MAX_SEGMENTS 64
+#define SLAB_CHUNK_SIZE (64 * 1024)
+#define SLAB_MAGAZINE_SIZE 32          // Objects moved per depot exchange
+#define SLAB_MAX_CACHED_ALLOCATORS 16  // Live allocators that get per-thread magazines
+
+typedef struct {
+    char* start;
     size_t size;
-    char data[];
-} MemoryBlock;
+    size_t used;
+    int mapped;
+} ArenaSegment;
 
 typedef struct {
-    MemoryBlock* free_blocks[16]; // Size classes: 64, 128, 256, ..., 1MB
-    MemoryBlock* large_blocks;
-    void* arena_start;
-    void* arena_current;
-    size_t arena_size;
-    size_t arena_used;
+    ArenaSegment segments[ARENA_MAX_SEGMENTS];
+    volatile int segment_count;  // Published with release order once a segment is ready
     pthread_mutex_t mutex;
-    _Alignas(CACHE_LINE_SIZE) volatile size_t alloc_count;
-    _Alignas(CACHE_LINE_SIZE) volatile size_t free_count;
 } AdvancedAllocator;
 
+typedef struct {
+    SlabAllocator* owner;
+    unsigned long owner_id;
+} SlabHeader;
+
+#define SLAB_HEADER_SIZE ((sizeof(SlabHeader) + 15) & ~(size_t)15)
+
+typedef struct SlabMagazine {
+    struct SlabMagazine* next;
+    int count;
+    void* objects[SLAB_MAGAZINE_SIZE];
+} SlabMagazine;
+
+// One thread's free objects for one allocator, refilled and drained a whole
+// magazine at a time so the depot lock is taken once per SLAB_MAGAZINE_SIZE calls
+typedef struct {
+    unsigned long owner_id;
+    int count;
+    void* objects[2 * SLAB_MAGAZINE_SIZE];
+} SlabThreadCache;
+
 static AdvancedAllocator* g_allocator = NULL;
 
-static size_t get_size_class(size_t size) {
-    if (size <= 64) return 0;
-    if (size <= 128) return 1;
-    if (size <= 256) return 2;
-    if (size <= 512) return 3;
-    if (size <= 1024) return 4;
-    if (size <= 2048) return 5;
-    if (size <= 4096) return 6;
-    if (size <= 8192) return 7;
-    if (size <= 16384) return 8;
-    if (size <= 32768) return 9;
-    if (size <= 65536) return 10;
-    if (size <= 131072) return 11;
-    if (size <= 262144) return 12;
-    if (size <= 524288) return 13;
-    if (size <= 1048576) return 14;
-    return 15; // Large allocation
-}
-
-static void* arena_alloc(AdvancedAllocator* alloc, size_t size) {
-    size = (size + 15) & ~15; // 16-byte alignment
+// Live allocators; the registry mutex orders before depot mutexes, which order before the arena's
+static pthread_mutex_t g_slab_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static SlabAllocator* g_slab_allocators = NULL;
+static SlabAllocator* g_slab_cache_slots[SLAB_MAX_CACHED_ALLOCATORS];
+static unsigned long g_slab_next_id = 0;
+
+#ifndef THREADING_DISABLED
+#if defined(__GNUC__) || defined(__clang__)
+#define SLAB_THREAD_LOCAL __thread
+#else
+#define SLAB_THREAD_LOCAL _Thread_local
+#endif
+static SLAB_THREAD_LOCAL SlabThreadCache* t_slab_caches = NULL;
+static pthread_key_t g_slab_cache_key;
+static pthread_once_t g_slab_once = PTHREAD_ONCE_INIT;
+#else
+static SlabThreadCache g_slab_caches[SLAB_MAX_CACHED_ALLOCATORS];
+#endif
+
+static int arena_add_segment(AdvancedAllocator* alloc, size_t min_size) {
+    int index = alloc->segment_count;
+    if (index >= ARENA_MAX_SEGMENTS) return -1;
+
+    ArenaSegment* segment = &alloc->segments[index];
+    // Oversized runs get a segment of their own, with slack for alignment
+    segment->size = min_size + SLAB_CHUNK_SIZE > ARENA_SEGMENT_SIZE ? min_size + SLAB_CHUNK_SIZE : ARENA_SEGMENT_SIZE;
+    segment->used = 0;
+    segment->mapped = 0;
     
-    if (alloc->arena_used + size > alloc->arena_size) {
-        return NULL; // Arena exhausted
+    #ifdef __unix__
+    segment->start = mmap(NULL, segment->size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    segment->mapped = segment->start != MAP_FAILED;
+    if (!segment->mapped) {
+        segment->start = malloc(segment->size);
     }
+    #else
+    segment->start = malloc(segment->size);
+    #endif
     
-    void* ptr = (char*)alloc->arena_current + alloc->arena_used;
-    alloc->arena_used += size;
+    if (!segment->start) return -1;
+    __atomic_store_n(&alloc->segment_count, index + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Returns a SLAB_CHUNK_SIZE-aligned run of size bytes (a multiple of the chunk
+// size), adding a segment when none of the existing ones has room
+static char* arena_alloc_run(AdvancedAllocator* alloc, size_t size) {
+    char* run = NULL;
+    
+    pthread_mutex_lock(&alloc->mutex);
+    for (;;) {
+        for (int i = alloc->segment_count - 1; i >= 0 && !run; i--) {
+            ArenaSegment* segment = &alloc->segments[i];
+            uintptr_t base = (uintptr_t)segment->start;
+            uintptr_t next = (base + segment->used + SLAB_CHUNK_SIZE - 1) & ~(uintptr_t)(SLAB_CHUNK_SIZE - 1);
+            if (next + size <= base + segment->size) {
+                segment->used = next + size - base;
+                run = (char*)next;
+            }
+        }
+        if (run || arena_add_segment(alloc, size) != 0) break;
+    }
+    pthread_mutex_unlock(&alloc->mutex);
     
-    return ptr;
+    return run;
 }
 
-SlabAllocator* slab_allocator_create(size_t object_size, size_t initial_objects) {
-    (void)initial_objects; // Suppress unused parameter warning
-    if (!g_allocator) {
-        g_allocator = calloc(1, sizeof(AdvancedAllocator));
-        if (!g_allocator) return NULL;
-        
-        // Allocate large arena (64MB)
-        g_allocator->arena_size = 64 * 1024 * 1024;
-        
+static char* arena_alloc_slab(AdvancedAllocator* alloc) {
+    return arena_alloc_run(alloc, SLAB_CHUNK_SIZE);
+}
+
+static void arena_destroy(AdvancedAllocator* alloc) {
+    for (int i = 0; i < alloc->segment_count; i++) {
+        ArenaSegment* segment = &alloc->segments[i];
         #ifdef __unix__
-        g_allocator->arena_start = mmap(NULL, g_allocator->arena_size,
-                                      PROT_READ | PROT_WRITE,
-                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-        if (g_allocator->arena_start == MAP_FAILED) {
-            g_allocator->arena_start = malloc(g_allocator->arena_size);
+        if (segment->mapped) {
+            munmap(segment->start, segment->size);
+            continue;
         }
-        #else
-        g_allocator->arena_start = malloc(g_allocator->arena_size);
         #endif
-        
-        if (!g_allocator->arena_start) {
-            free(g_allocator);
-            g_allocator = NULL;
-            return NULL;
+        free(segment->start);
+    }
+    pthread_mutex_destroy(&alloc->mutex);
+    free(alloc);
+}
+
+// True if ptr is an object from one of this allocator's slabs
+static int slab_contains(const SlabAllocator* allocator, const void* ptr) {
+    AdvancedAllocator* alloc = g_allocator;
+    if (!alloc) return 0;
+    
+    uintptr_t address = (uintptr_t)ptr;
+    int count = __atomic_load_n(&alloc->segment_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        const ArenaSegment* segment = &alloc->segments[i];
+        uintptr_t base = (uintptr_t)segment->start;
+        if (address >= base && address < base + segment->size) {
+            uintptr_t slab = address & ~(uintptr_t)(SLAB_CHUNK_SIZE - 1);
+            if (slab < base) return 0;
+            const SlabHeader* header = (const SlabHeader*)slab;
+            return header->owner == allocator && header->owner_id == allocator->id;
         }
-        
-        g_allocator->arena_current = g_allocator->arena_start;
-        pthread_mutex_init(&g_allocator->mutex, NULL);
     }
+    return 0;
+}
+
+// Caller holds the depot mutex
+static int slab_grow(SlabAllocator* allocator) {
+    if (allocator->objects_per_slab == 0 || !g_allocator) return -1;
     
-    // For compatibility, create a simple slab allocator
-    SlabAllocator* allocator = malloc(sizeof(SlabAllocator));
-    if (!allocator) return NULL;
-    
-    allocator->object_size = (object_size + 15) & ~15; // 16-byte align
-    allocator->objects_per_slab = 1000; // Fixed size for simplicity
-    allocator->total_slabs = 1;
-    allocator->allocated_objects = 0;
-    allocator->use_huge_pages = false;
+    char* slab = arena_alloc_slab(g_allocator);
+    if (!slab) return -1;
     
-    size_t total_size = allocator->object_size * allocator->objects_per_slab;
-    allocator->memory = arena_alloc(g_allocator, total_size);
+    SlabHeader* header = (SlabHeader*)slab;
+    header->owner = allocator;
+    header->owner_id = allocator->id;
+    allocator->slab_next = slab + SLAB_HEADER_SIZE;
+    allocator->slab_end = allocator->slab_next + allocator->objects_per_slab * allocator->object_size;
+    allocator->total_slabs++;
+    return 0;
+}
+
+// Moves up to max free objects into out, carving a new slab when the depot is dry
+static int slab_depot_take(SlabAllocator* allocator, void** out, int max) {
+    int taken = 0;
     
-    if (!allocator->memory) {
-        // Fallback to malloc
-        allocator->memory = malloc(total_size);
-        if (!allocator->memory) {
-            free(allocator);
-            return NULL;
+    pthread_mutex_lock(&allocator->depot_mutex);
+    while (taken < max) {
+        SlabMagazine* magazine = allocator->full_magazines;
+        if (magazine) {
+            while (taken < max && magazine->count > 0) {
+                out[taken++] = magazine->objects[--magazine->count];
+            }
+            if (magazine->count == 0) {
+                allocator->full_magazines = magazine->next;
+                magazine->next = allocator->empty_magazines;
+                allocator->empty_magazines = magazine;
+            }
+        } else if (allocator->slab_next < allocator->slab_end) {
+            out[taken++] = allocator->slab_next;
+            allocator->slab_next += allocator->object_size;
+        } else if (slab_grow(allocator) != 0) {
+            break;
         }
     }
+    pthread_mutex_unlock(&allocator->depot_mutex);
     
-    // Initialize free list
-    allocator->free_list = allocator->memory;
-    for (size_t i = 0; i < allocator->objects_per_slab - 1; i++) {
-        void** current = (void**)((char*)allocator->memory + i * allocator->object_size);
-        *current = (char*)allocator->memory + (i + 1) * allocator->object_size;
+    return taken;
+}
+
+static void slab_depot_put(SlabAllocator* allocator, void** objects, int count) {
+    pthread_mutex_lock(&allocator->depot_mutex);
+    while (count > 0) {
+        SlabMagazine* magazine = allocator->full_magazines;
+        if (!magazine || magazine->count == SLAB_MAGAZINE_SIZE) {
+            magazine = allocator->empty_magazines;
+            if (magazine) {
+                allocator->empty_magazines = magazine->next;
+            } else {
+                magazine = malloc(sizeof(SlabMagazine));
+                if (!magazine) break; // The objects stay unused in the arena
+            }
+            magazine->count = 0;
+            magazine->next = allocator->full_magazines;
+            allocator->full_magazines = magazine;
+        }
+        while (count > 0 && magazine->count < SLAB_MAGAZINE_SIZE) {
+            magazine->objects[magazine->count++] = objects[--count];
+        }
     }
+    pthread_mutex_unlock(&allocator->depot_mutex);
+}
+
+#ifndef THREADING_DISABLED
+// Thread exit: hand cached objects back to allocators that are still alive
+static void slab_flush_thread_caches(void* arg) {
+    SlabThreadCache* caches = (SlabThreadCache*)arg;
     
-    void** last = (void**)((char*)allocator->memory + 
-                          (allocator->objects_per_slab - 1) * allocator->object_size);
-    *last = NULL;
+    pthread_mutex_lock(&g_slab_registry_mutex);
+    for (int i = 0; i < SLAB_MAX_CACHED_ALLOCATORS; i++) {
+        SlabAllocator* allocator = g_slab_cache_slots[i];
+        if (allocator && caches[i].count > 0 && caches[i].owner_id == allocator->id) {
+            slab_depot_put(allocator, caches[i].objects, caches[i].count);
+        }
+    }
+    pthread_mutex_unlock(&g_slab_registry_mutex);
     
-    return allocator;
+    t_slab_caches = NULL;
+    free(caches);
 }
 
-void* slab_alloc(SlabAllocator* allocator) {
-    if (!allocator) {
-        size_t size_class = get_size_class(256);
-        pthread_mutex_lock(&g_allocator->mutex);
-        
-        MemoryBlock* block = g_allocator->free_blocks[size_class];
-        if (block) {
-            g_allocator->free_blocks[size_class] = block->next;
-            pthread_mutex_unlock(&g_allocator->mutex);
-            __atomic_fetch_add(&g_allocator->alloc_count, 1, __ATOMIC_RELAXED);
-            return block->data;
-        }
-        
-        pthread_mutex_unlock(&g_allocator->mutex);
-        return malloc(256);
+// A forked child must not inherit a depot or arena lock held by another thread
+static void slab_atfork_prepare(void) {
+    pthread_mutex_lock(&g_slab_registry_mutex);
+    for (SlabAllocator* allocator = g_slab_allocators; allocator; allocator = allocator->next_live) {
+        pthread_mutex_lock(&allocator->depot_mutex);
+    }
+    if (g_allocator) pthread_mutex_lock(&g_allocator->mutex);
+}
+
+static void slab_atfork_release(void) {
+    if (g_allocator) pthread_mutex_unlock(&g_allocator->mutex);
+    for (SlabAllocator* allocator = g_slab_allocators; allocator; allocator = allocator->next_live) {
+        pthread_mutex_unlock(&allocator->depot_mutex);
+    }
+    pthread_mutex_unlock(&g_slab_registry_mutex);
+}
+
+static void slab_init_thread_support(void) {
+    pthread_key_create(&g_slab_cache_key, slab_flush_thread_caches);
+    pthread_atfork(slab_atfork_prepare, slab_atfork_release, slab_atfork_release);
+}
+#endif
+
+static SlabThreadCache* slab_thread_cache(SlabAllocator* allocator) {
+    if (allocator->cache_slot < 0) return NULL;
+    
+    #ifndef THREADING_DISABLED
+    SlabThreadCache* caches = t_slab_caches;
+    if (UNLIKELY(!caches)) {
+        caches = calloc(SLAB_MAX_CACHED_ALLOCATORS, sizeof(SlabThreadCache));
+        if (!caches) return NULL;
+        pthread_setspecific(g_slab_cache_key, caches);
+        t_slab_caches = caches;
+    }
+    #else
+    SlabThreadCache* caches = g_slab_caches;
+    #endif
+    
+    SlabThreadCache* cache = &caches[allocator->cache_slot];
+    if (UNLIKELY(cache->owner_id != allocator->id)) {
+        // The slot's previous allocator was destroyed along with its slabs
+        cache->owner_id = allocator->id;
+        cache->count = 0;
+    }
+    return cache;
+}
+
+SlabAllocator* slab_allocator_create(size_t object_size, size_t initial_objects) {
+    (void)initial_objects; // Slabs are carved on demand
+    if (!g_allocator) {
+        g_allocator = calloc(1, sizeof(AdvancedAllocator));
+        if (!g_allocator) return NULL;
+        pthread_mutex_init(&g_allocator->mutex, NULL);
     }
     
     #ifndef THREADING_DISABLED
-    void* old_head;
-    void* new_head;
+    pthread_once(&g_slab_once, slab_init_thread_support);
+    #endif
     
-    do {
-        old_head = __atomic_load_n(&allocator->free_list, __ATOMIC_ACQUIRE);
-        if (!old_head) {
-            return malloc(allocator->object_size);
+    SlabAllocator* allocator = calloc(1, sizeof(SlabAllocator));
+    if (!allocator) return NULL;
+    
+    allocator->object_size = object_size ? (object_size + 15) & ~(size_t)15 : 16; // 16-byte align
+    allocator->objects_per_slab = (SLAB_CHUNK_SIZE - SLAB_HEADER_SIZE) / allocator->object_size;
+    pthread_mutex_init(&allocator->depot_mutex, NULL);
+    
+    pthread_mutex_lock(&g_slab_registry_mutex);
+    allocator->id = ++g_slab_next_id;
+    allocator->cache_slot = -1;
+    for (int i = 0; i < SLAB_MAX_CACHED_ALLOCATORS; i++) {
+        if (!g_slab_cache_slots[i]) {
+            g_slab_cache_slots[i] = allocator;
+            allocator->cache_slot = i;
+            stats_clear_pool_slot(i);
+            break;
         }
-        
-        new_head = *(void**)old_head;
-    } while (!__atomic_compare_exchange_n(&allocator->free_list, &old_head, new_head,
-                                         false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    allocator->next_live = g_slab_allocators;
+    g_slab_allocators = allocator;
+    pthread_mutex_unlock(&g_slab_registry_mutex);
     
-    __atomic_fetch_add(&allocator->allocated_objects, 1, __ATOMIC_RELAXED);
-    return old_head;
-    #else
-    void* old_head = allocator->free_list;
-    if (!old_head) {
-        return malloc(allocator->object_size);
+    return allocator;
+}
+
+void* slab_alloc(SlabAllocator* allocator) {
+    if (!allocator) {
+        return malloc(256);
     }
     
-    allocator->free_list = *(void**)old_head;
-    allocator->allocated_objects++;
-    return old_head;
-    #endif
+    SlabThreadCache* cache = slab_thread_cache(allocator);
+    if (LIKELY(cache != NULL)) {
+        if (UNLIKELY(cache->count == 0)) {
+            cache->count = slab_depot_take(allocator, cache->objects, SLAB_MAGAZINE_SIZE);
+        }
+        if (LIKELY(cache->count > 0)) {
+            stats_pool_alloc(allocator->cache_slot, 0);
+            return cache->objects[--cache->count];
+        }
+    } else {
+        void* object;
+        if (slab_depot_take(allocator, &object, 1) == 1) {
+            stats_pool_alloc(allocator->cache_slot, 0);
+            return object;
+        }
+    }
+    
+    // Arena exhausted: heap memory, which slab_free passes back to free()
+    stats_pool_alloc(allocator->cache_slot, 1);
+    return malloc(allocator->object_size);
 }
 
 void slab_free(SlabAllocator* allocator, void* ptr) {
@@ -647,34 +1036,50 @@ void slab_free(SlabAllocator* allocator, void* ptr) {
         return; // Invalid pointer
     }
     
-    char* pool_start = (char*)allocator->memory;
-    char* pool_end = pool_start + (allocator->object_size * allocator->objects_per_slab);
-    
-    if (ptr < (void*)pool_start || ptr >= (void*)pool_end) {
+    if (!slab_contains(allocator, ptr)) {
         free(ptr);
         return;
     }
+    stats_pool_free(allocator->cache_slot);
     
-    #ifndef THREADING_DISABLED
-    void* old_head;
-    do {
-        old_head = __atomic_load_n(&allocator->free_list, __ATOMIC_ACQUIRE);
-        *(void**)ptr = old_head;
-    } while (!__atomic_compare_exchange_n(&allocator->free_list, &old_head, ptr,
-                                         false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
-    
-    __atomic_fetch_sub(&allocator->allocated_objects, 1, __ATOMIC_RELAXED);
-    #else
-    *(void**)ptr = allocator->free_list;
-    allocator->free_list = ptr;
-    allocator->allocated_objects--;
-    #endif
+    SlabThreadCache* cache = slab_thread_cache(allocator);
+    if (LIKELY(cache != NULL)) {
+        if (UNLIKELY(cache->count == 2 * SLAB_MAGAZINE_SIZE)) {
+            cache->count -= SLAB_MAGAZINE_SIZE;
+            slab_depot_put(allocator, &cache->objects[cache->count], SLAB_MAGAZINE_SIZE);
+        }
+        cache->objects[cache->count++] = ptr;
+    } else {
+        slab_depot_put(allocator, &ptr, 1);
+    }
 }
 
 void slab_allocator_destroy(SlabAllocator* allocator) {
     if (!allocator) return;
     
-    // Don't free arena memory - it's managed globally
+    pthread_mutex_lock(&g_slab_registry_mutex);
+    if (allocator->cache_slot >= 0) {
+        g_slab_cache_slots[allocator->cache_slot] = NULL;
+    }
+    for (SlabAllocator** link = &g_slab_allocators; *link; link = &(*link)->next_live) {
+        if (*link == allocator) {
+            *link = allocator->next_live;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_slab_registry_mutex);
+    
+    SlabMagazine* lists[2] = {allocator->full_magazines, allocator->empty_magazines};
+    for (int i = 0; i < 2; i++) {
+        while (lists[i]) {
+            SlabMagazine* next = lists[i]->next;
+            free(lists[i]);
+            lists[i] = next;
+        }
+    }
+    
+    // Don't free slab memory - it belongs to the arena
+    pthread_mutex_destroy(&allocator->depot_mutex);
     free(allocator);
 }
 
@@ -691,6 +1096,10 @@ void init_global_pools(void) {
     g_cjson_node_pool = slab_allocator_create(256, 2000);
     g_property_node_pool = slab_allocator_create(128, 1000);
     g_task_pool = slab_allocator_create(64, 500);
+    
+    if (g_cjson_node_pool) stats_name_pool(g_cjson_node_pool->cache_slot, "cjson_nodes");
+    if (g_property_node_pool) stats_name_pool(g_property_node_pool->cache_slot, "property_nodes");
+    if (g_task_pool) stats_name_pool(g_task_pool->cache_slot, "tasks");
 }
 
 void cleanup_global_pools(void) {
@@ -708,20 +1117,257 @@ void cleanup_global_pools(void) {
     }
     
     if (g_allocator) {
-        #ifdef __unix__
-        if (g_allocator->arena_start != MAP_FAILED) {
-            munmap(g_allocator->arena_start, g_allocator->arena_size);
+        arena_destroy(g_allocator);
+        g_allocator = NULL;
+    }
+}
+
+// =============================================================================
+// REQUEST-SCOPED CJSON ARENAS
+// =============================================================================
+
+// Arena blocks come from an allocator of their own that lives for the whole
+// process, so "is this arena memory" is a range check over its segments and
+// cleanup_global_pools() can't pull blocks out from under a live arena.
+// Blocks of destroyed arenas are kept on a free list for the next arena.
+typedef struct JsonArenaBlock {
+    struct JsonArenaBlock* next;
+    size_t size;            // Bytes including this header
+    volatile size_t used;   // Bump offset; may overshoot size when threads race
+} JsonArenaBlock;
+
+#define JSON_ARENA_HEADER_SIZE ((sizeof(JsonArenaBlock) + 15) & ~(size_t)15)
+
+struct JsonArena {
+    JsonArenaBlock* blocks;            // Standard blocks in the order they were first used
+    JsonArenaBlock* tail;
+    JsonArenaBlock* volatile current;  // Block being bumped; NULL right after a reset
+    JsonArenaBlock* large;             // Dedicated blocks for oversized allocations
+    size_t block_size;
+    pthread_mutex_t mutex;             // Taken only to move to another block
+};
+
+static AdvancedAllocator g_json_arena_allocator = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+static pthread_mutex_t g_json_arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+static JsonArenaBlock* g_json_arena_free_blocks = NULL;
+
+#ifndef THREADING_DISABLED
+static SLAB_THREAD_LOCAL JsonArena* t_json_arena = NULL;
+static pthread_once_t g_json_arena_once = PTHREAD_ONCE_INIT;
+#else
+static JsonArena* t_json_arena = NULL;
+static int g_json_arena_hooks_installed = 0;
+#endif
+
+// Takes a recycled block of at least size bytes, or carves a new one
+static JsonArenaBlock* json_arena_acquire_block(size_t size) {
+    size = (size + SLAB_CHUNK_SIZE - 1) & ~(size_t)(SLAB_CHUNK_SIZE - 1);
+    JsonArenaBlock* block = NULL;
+    
+    pthread_mutex_lock(&g_json_arena_mutex);
+    for (JsonArenaBlock** link = &g_json_arena_free_blocks; *link; link = &(*link)->next) {
+        // Don't spend a big recycled block on a small request
+        if ((*link)->size >= size && (*link)->size <= 2 * size) {
+            block = *link;
+            *link = block->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_json_arena_mutex);
+    
+    if (!block) {
+        block = (JsonArenaBlock*)arena_alloc_run(&g_json_arena_allocator, size);
+        if (!block) return NULL;
+        block->size = size;
+    }
+    block->next = NULL;
+    block->used = JSON_ARENA_HEADER_SIZE;
+    return block;
+}
+
+static void json_arena_release_blocks(JsonArenaBlock* blocks) {
+    if (!blocks) return;
+    
+    JsonArenaBlock* last = blocks;
+    while (last->next) last = last->next;
+    
+    pthread_mutex_lock(&g_json_arena_mutex);
+    last->next = g_json_arena_free_blocks;
+    g_json_arena_free_blocks = blocks;
+    pthread_mutex_unlock(&g_json_arena_mutex);
+}
+
+// Moves past a full block: the next one kept from before a reset, else a fresh one
+static int json_arena_advance(JsonArena* arena, JsonArenaBlock* full) {
+    int status = 0;
+    
+    pthread_mutex_lock(&arena->mutex);
+    if (arena->current == full) {
+        JsonArenaBlock* next = full ? full->next : arena->blocks;
+        if (next) {
+            next->used = JSON_ARENA_HEADER_SIZE;
+        } else if ((next = json_arena_acquire_block(arena->block_size)) != NULL) {
+            if (arena->tail) {
+                arena->tail->next = next;
+            } else {
+                arena->blocks = next;
+            }
+            arena->tail = next;
         } else {
-            free(g_allocator->arena_start);
+            status = -1;
         }
-        #else
-        free(g_allocator->arena_start);
-        #endif
-        
-        pthread_mutex_destroy(&g_allocator->mutex);
-        free(g_allocator);
-        g_allocator = NULL;
+        if (next) __atomic_store_n(&arena->current, next, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&arena->mutex);
+    
+    return status;
+}
+
+static void* json_arena_alloc_large(JsonArena* arena, size_t size) {
+    JsonArenaBlock* block = json_arena_acquire_block(JSON_ARENA_HEADER_SIZE + size);
+    if (!block) return NULL;
+    
+    pthread_mutex_lock(&arena->mutex);
+    block->next = arena->large;
+    arena->large = block;
+    pthread_mutex_unlock(&arena->mutex);
+    
+    block->used = block->size;
+    return (char*)block + JSON_ARENA_HEADER_SIZE;
+}
+
+static void* json_arena_alloc(JsonArena* arena, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    if (UNLIKELY(size > (arena->block_size - JSON_ARENA_HEADER_SIZE) / 4)) {
+        return json_arena_alloc_large(arena, size);
+    }
+    
+    for (;;) {
+        JsonArenaBlock* block = __atomic_load_n(&arena->current, __ATOMIC_ACQUIRE);
+        if (LIKELY(block != NULL)) {
+            size_t offset = __atomic_fetch_add(&block->used, size, __ATOMIC_RELAXED);
+            if (LIKELY(offset + size <= block->size)) {
+                return (char*)block + offset;
+            }
+        }
+        if (json_arena_advance(arena, block) != 0) return NULL;
+    }
+}
+
+// cJSON hooks: the calling thread's arena if it entered one, the heap otherwise
+static void* json_arena_hook_malloc(size_t size) {
+    JsonArena* arena = t_json_arena;
+    return arena ? json_arena_alloc(arena, size) : malloc(size);
+}
+
+static void json_arena_hook_free(void* ptr) {
+    if (ptr && !json_arena_owns(ptr)) {
+        free(ptr);
+    }
+}
+
+static void json_arena_install_hooks(void) {
+    cJSON_Hooks hooks = {json_arena_hook_malloc, json_arena_hook_free};
+    cJSON_InitHooks(&hooks);
+}
+
+#ifndef THREADING_DISABLED
+static void json_arena_atfork_prepare(void) {
+    pthread_mutex_lock(&g_json_arena_mutex);
+    pthread_mutex_lock(&g_json_arena_allocator.mutex);
+}
+
+static void json_arena_atfork_release(void) {
+    pthread_mutex_unlock(&g_json_arena_allocator.mutex);
+    pthread_mutex_unlock(&g_json_arena_mutex);
+}
+
+static void json_arena_init_support(void) {
+    json_arena_install_hooks();
+    pthread_atfork(json_arena_atfork_prepare, json_arena_atfork_release, json_arena_atfork_release);
+}
+#endif
+
+JsonArena* json_arena_create(size_t block_size) {
+    #ifndef THREADING_DISABLED
+    pthread_once(&g_json_arena_once, json_arena_init_support);
+    #else
+    if (!g_json_arena_hooks_installed) {
+        json_arena_install_hooks();
+        g_json_arena_hooks_installed = 1;
+    }
+    #endif
+    
+    JsonArena* arena = calloc(1, sizeof(JsonArena));
+    if (!arena) return NULL;
+    
+    if (block_size == 0) block_size = JSON_ARENA_BLOCK_SIZE;
+    arena->block_size = (block_size + SLAB_CHUNK_SIZE - 1) & ~(size_t)(SLAB_CHUNK_SIZE - 1);
+    pthread_mutex_init(&arena->mutex, NULL);
+    return arena;
+}
+
+JsonArena* json_arena_enter(JsonArena* arena) {
+    JsonArena* previous = t_json_arena;
+    t_json_arena = arena;
+    return previous;
+}
+
+void json_arena_leave(JsonArena* previous) {
+    t_json_arena = previous;
+}
+
+JsonArena* json_arena_current(void) {
+    return t_json_arena;
+}
+
+int json_arena_owns(const void* ptr) {
+    uintptr_t address = (uintptr_t)ptr;
+    int count = __atomic_load_n(&g_json_arena_allocator.segment_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        const ArenaSegment* segment = &g_json_arena_allocator.segments[i];
+        uintptr_t base = (uintptr_t)segment->start;
+        if (address >= base && address < base + segment->size) return 1;
+    }
+    return 0;
+}
+
+size_t json_arena_bytes_used(const JsonArena* arena) {
+    if (!arena) return 0;
+    
+    size_t total = 0;
+    const JsonArenaBlock* current = arena->current;
+    for (const JsonArenaBlock* block = current ? arena->blocks : NULL; block; block = block->next) {
+        size_t used = block->used < block->size ? block->used : block->size;
+        total += used - JSON_ARENA_HEADER_SIZE;
+        if (block == current) break;
+    }
+    for (const JsonArenaBlock* block = arena->large; block; block = block->next) {
+        total += block->size - JSON_ARENA_HEADER_SIZE;
     }
+    return total;
+}
+
+void json_arena_reset(JsonArena* arena) {
+    if (!arena) return;
+    
+    pthread_mutex_lock(&arena->mutex);
+    json_arena_release_blocks(arena->large);
+    arena->large = NULL;
+    __atomic_store_n(&arena->current, NULL, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&arena->mutex);
+}
+
+void json_arena_destroy(JsonArena* arena) {
+    if (!arena) return;
+    
+    if (t_json_arena == arena) {
+        t_json_arena = NULL;
+    }
+    json_arena_release_blocks(arena->large);
+    json_arena_release_blocks(arena->blocks);
+    pthread_mutex_destroy(&arena->mutex);
+    free(arena);
 }
 
 // =============================================================================
@@ -782,197 +1428,496 @@ char* string_view_to_cstr(const StringView* sv) {
 // ADVANCED WHITESPACE SKIPPING
 // =============================================================================
 
-const char* skip_whitespace_optimized(const char* str, size_t len) {
-    if (!str || len == 0) return str;
-    
-    detect_cpu_features();
-    
-    #ifdef HAS_AVX512_INTRINSICS
-    if (g_cpu.has_avx512 && len >= 64) {
-        const __m512i spaces = _mm512_set1_epi8(' ');
-        const __m512i tabs = _mm512_set1_epi8('\t');
-        const __m512i newlines = _mm512_set1_epi8('\n');
-        const __m512i returns = _mm512_set1_epi8('\r');
-        
-        size_t i = 0;
-        for (; i + 64 <= len; i += 64) {
-            __m512i chunk = _mm512_loadu_si512((const __m512i*)(str + i));
-            
-            __mmask64 is_space = _mm512_cmpeq_epi8_mask(chunk, spaces);
-            __mmask64 is_tab = _mm512_cmpeq_epi8_mask(chunk, tabs);
-            __mmask64 is_newline = _mm512_cmpeq_epi8_mask(chunk, newlines);
-            __mmask64 is_return = _mm512_cmpeq_epi8_mask(chunk, returns);
-            
-            __mmask64 is_whitespace = is_space | is_tab | is_newline | is_return;
-            __mmask64 not_whitespace = ~is_whitespace;
-            
-            if (not_whitespace != 0) {
-                return str + i + __builtin_ctzll(not_whitespace);
-            }
+// Each kernel runs whole vectors and leaves the tail to the scalar version
+
+static const char* skip_whitespace_scalar(const char* str, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = str[i];
+        if (LIKELY(c != ' ' && c != '\t' && c != '\n' && c != '\r')) {
+            return str + i;
         }
-        
-        // Handle remaining bytes
-        for (; i < len; i++) {
-            char c = str[i];
-            if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
-                return str + i;
-            }
+    }
+    return str + len;
+}
+
+static const char* find_delimiter_scalar(const char* str, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = str[i];
+        if (c == '"' || c == ',' || c == ':' || c == '{' || c == '}' || c == '[' || c == ']') {
+            return str + i;
         }
-        
-        return str + len;
     }
-    #endif
-    
-    #ifdef HAS_AVX2_INTRINSICS
-    if (g_cpu.has_avx2 && len >= 32) {
-        const __m256i spaces = _mm256_set1_epi8(' ');
-        const __m256i tabs = _mm256_set1_epi8('\t');
-        const __m256i newlines = _mm256_set1_epi8('\n');
-        const __m256i returns = _mm256_set1_epi8('\r');
-        
-        size_t i = 0;
-        for (; i + 32 <= len; i += 32) {
-            __m256i chunk = _mm256_loadu_si256((const __m256i*)(str + i));
-            
-            __m256i is_space = _mm256_cmpeq_epi8(chunk, spaces);
-            __m256i is_tab = _mm256_cmpeq_epi8(chunk, tabs);
-            __m256i is_newline = _mm256_cmpeq_epi8(chunk, newlines);
-            __m256i is_return = _mm256_cmpeq_epi8(chunk, returns);
-            
-            __m256i is_whitespace = _mm256_or_si256(
-                _mm256_or_si256(is_space, is_tab),
-                _mm256_or_si256(is_newline, is_return)
-            );
-            
-            uint32_t mask = ~_mm256_movemask_epi8(is_whitespace);
-            if (mask != 0) {
-                return str + i + __builtin_ctz(mask);
-            }
+    return str + len;
+}
+
+// OR-ing 0x20 folds '[' onto '{' and ']' onto '}', so five compares find all
+// seven delimiters (the fold maps no other byte onto them)
+
+#ifdef HAS_AVX512_INTRINSICS
+static TARGET_AVX512 const char* skip_whitespace_avx512(const char* str, size_t len) {
+    const __m512i spaces = _mm512_set1_epi8(' ');
+    const __m512i tabs = _mm512_set1_epi8('\t');
+    const __m512i newlines = _mm512_set1_epi8('\n');
+    const __m512i returns = _mm512_set1_epi8('\r');
+    
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m512i chunk = _mm512_loadu_si512((const void*)(str + i));
+        __mmask64 is_whitespace = _mm512_cmpeq_epi8_mask(chunk, spaces) | _mm512_cmpeq_epi8_mask(chunk, tabs) |
+                                  _mm512_cmpeq_epi8_mask(chunk, newlines) | _mm512_cmpeq_epi8_mask(chunk, returns);
+        if (~is_whitespace != 0) {
+            return str + i + __builtin_ctzll(~is_whitespace);
         }
-        
-        // Handle remaining bytes
-        for (; i < len; i++) {
-            char c = str[i];
-            if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
-                return str + i;
-            }
+    }
+    return skip_whitespace_scalar(str + i, len - i);
+}
+
+static TARGET_AVX512 const char* find_delimiter_avx512(const char* str, size_t len) {
+    const __m512i fold = _mm512_set1_epi8(0x20);
+    
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m512i chunk = _mm512_loadu_si512((const void*)(str + i));
+        __m512i folded = _mm512_or_si512(chunk, fold);
+        __mmask64 match = _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('"')) |
+                          _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(',')) |
+                          _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(':')) |
+                          _mm512_cmpeq_epi8_mask(folded, _mm512_set1_epi8('{')) |
+                          _mm512_cmpeq_epi8_mask(folded, _mm512_set1_epi8('}'));
+        if (match != 0) {
+            return str + i + __builtin_ctzll(match);
         }
-        
-        return str + len;
     }
-    #endif
-    
-    #ifdef HAS_NEON_INTRINSICS
-    if (g_cpu.has_neon && len >= 16) {
-        const uint8x16_t spaces = vdupq_n_u8(' ');
-        const uint8x16_t tabs = vdupq_n_u8('\t');
-        const uint8x16_t newlines = vdupq_n_u8('\n');
-        const uint8x16_t returns = vdupq_n_u8('\r');
+    return find_delimiter_scalar(str + i, len - i);
+}
+#endif
+
+#ifdef HAS_AVX2_INTRINSICS
+static TARGET_AVX2 const char* skip_whitespace_avx2(const char* str, size_t len) {
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i tabs = _mm256_set1_epi8('\t');
+    const __m256i newlines = _mm256_set1_epi8('\n');
+    const __m256i returns = _mm256_set1_epi8('\r');
+    
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i is_whitespace = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, spaces), _mm256_cmpeq_epi8(chunk, tabs)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, newlines), _mm256_cmpeq_epi8(chunk, returns))
+        );
         
-        size_t i = 0;
-        for (; i + 16 <= len; i += 16) {
-            uint8x16_t chunk = vld1q_u8((const uint8_t*)(str + i));
-            
-            uint8x16_t is_space = vceqq_u8(chunk, spaces);
-            uint8x16_t is_tab = vceqq_u8(chunk, tabs);
-            uint8x16_t is_newline = vceqq_u8(chunk, newlines);
-            uint8x16_t is_return = vceqq_u8(chunk, returns);
-            
-            uint8x16_t is_whitespace = vorrq_u8(
-                vorrq_u8(is_space, is_tab),
-                vorrq_u8(is_newline, is_return)
-            );
-            
-            // Find first non-whitespace
-            uint64x2_t mask64 = vreinterpretq_u64_u8(is_whitespace);
-            uint64_t low = ~vgetq_lane_u64(mask64, 0);
-            uint64_t high = ~vgetq_lane_u64(mask64, 1);
-            
-            if (low || high) {
-                for (int j = 0; j < 16; j++) {
-                    char c = str[i + j];
-                    if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
-                        return str + i + j;
-                    }
-                }
-            }
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(is_whitespace);
+        if (mask != 0) {
+            return str + i + __builtin_ctz(mask);
         }
+    }
+    return skip_whitespace_scalar(str + i, len - i);
+}
+
+static TARGET_AVX2 const char* find_delimiter_avx2(const char* str, size_t len) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i lbrace = _mm256_set1_epi8('{');
+    const __m256i rbrace = _mm256_set1_epi8('}');
+    const __m256i fold = _mm256_set1_epi8(0x20);
+    
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i folded = _mm256_or_si256(chunk, fold);
+        __m256i match = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, comma)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(folded, lbrace), _mm256_cmpeq_epi8(folded, rbrace)))
+        );
         
-        // Handle remaining bytes
-        for (; i < len; i++) {
-            char c = str[i];
-            if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
-                return str + i;
-            }
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(match);
+        if (mask != 0) {
+            return str + i + __builtin_ctz(mask);
         }
+    }
+    return find_delimiter_scalar(str + i, len - i);
+}
+#endif
+
+#ifdef HAS_SSE2_INTRINSICS
+static TARGET_SSE2 const char* skip_whitespace_sse2(const char* str, size_t len) {
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i tabs = _mm_set1_epi8('\t');
+    const __m128i newlines = _mm_set1_epi8('\n');
+    const __m128i returns = _mm_set1_epi8('\r');
+    
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i is_whitespace = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, spaces), _mm_cmpeq_epi8(chunk, tabs)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, newlines), _mm_cmpeq_epi8(chunk, returns))
+        );
         
-        return str + len;
+        uint32_t mask = ~(uint32_t)_mm_movemask_epi8(is_whitespace) & 0xFFFF;
+        if (mask != 0) {
+            return str + i + __builtin_ctz(mask);
+        }
     }
-    #endif
-    
-    // Scalar fallback
-    for (size_t i = 0; i < len; i++) {
-        char c = str[i];
-        if (LIKELY(c != ' ' && c != '\t' && c != '\n' && c != '\r')) {
-            return str + i;
+    return skip_whitespace_scalar(str + i, len - i);
+}
+
+static TARGET_SSE2 const char* find_delimiter_sse2(const char* str, size_t len) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i lbrace = _mm_set1_epi8('{');
+    const __m128i rbrace = _mm_set1_epi8('}');
+    const __m128i fold = _mm_set1_epi8(0x20);
+    
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i folded = _mm_or_si128(chunk, fold);
+        __m128i match = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, comma)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, colon),
+                         _mm_or_si128(_mm_cmpeq_epi8(folded, lbrace), _mm_cmpeq_epi8(folded, rbrace)))
+        );
+        
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(match);
+        if (mask != 0) {
+            return str + i + __builtin_ctz(mask);
         }
     }
-    return str + len;
+    return find_delimiter_scalar(str + i, len - i);
+}
+#endif
+
+#ifdef HAS_NEON_INTRINSICS
+// Index of the first set byte of a compare result, or 16 when there is none
+static inline int neon_first_set(uint8x16_t cmp) {
+    // Narrow each byte to four bits, so the whole result fits one 64-bit lane
+    uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4)), 0);
+    return bits ? __builtin_ctzll(bits) >> 2 : 16;
 }
 
-const char* find_delimiter_optimized(const char* str, size_t len) {
-    if (!str || len == 0) return str;
-    
-    #ifdef HAS_AVX2_INTRINSICS
-    if (g_cpu.has_avx2 && len >= 32) {
-        const __m256i quote = _mm256_set1_epi8('"');
-        const __m256i comma = _mm256_set1_epi8(',');
-        const __m256i colon = _mm256_set1_epi8(':');
-        const __m256i lbrace = _mm256_set1_epi8('{');
-        const __m256i rbrace = _mm256_set1_epi8('}');
-        const __m256i lbracket = _mm256_set1_epi8('[');
-        const __m256i rbracket = _mm256_set1_epi8(']');
+static const char* skip_whitespace_neon(const char* str, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t*)(str + i));
+        uint8x16_t is_whitespace = vorrq_u8(
+            vorrq_u8(vceqq_u8(chunk, vdupq_n_u8(' ')), vceqq_u8(chunk, vdupq_n_u8('\t'))),
+            vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('\n')), vceqq_u8(chunk, vdupq_n_u8('\r')))
+        );
         
-        for (size_t i = 0; i + 32 <= len; i += 32) {
-            __m256i chunk = _mm256_loadu_si256((const __m256i*)(str + i));
-            
-            __m256i match = _mm256_or_si256(
-                _mm256_or_si256(
-                    _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, comma)),
-                    _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon), _mm256_cmpeq_epi8(chunk, lbrace))
-                ),
-                _mm256_or_si256(
-                    _mm256_or_si256(_mm256_cmpeq_epi8(chunk, rbrace), _mm256_cmpeq_epi8(chunk, lbracket)),
-                    _mm256_cmpeq_epi8(chunk, rbracket)
-                )
-            );
-            
-            uint32_t mask = _mm256_movemask_epi8(match);
-            if (mask != 0) {
-                return str + i + __builtin_ctz(mask);
-            }
+        int first = neon_first_set(vmvnq_u8(is_whitespace));
+        if (first < 16) {
+            return str + i + first;
         }
     }
-    #endif
-    
-    // Scalar fallback
-    for (size_t i = 0; i < len; i++) {
-        char c = str[i];
-        if (c == '"' || c == ',' || c == ':' || c == '{' || c == '}' || c == '[' || c == ']') {
-            return str + i;
+    return skip_whitespace_scalar(str + i, len - i);
+}
+
+static const char* find_delimiter_neon(const char* str, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t*)(str + i));
+        uint8x16_t folded = vorrq_u8(chunk, vdupq_n_u8(0x20));
+        uint8x16_t match = vorrq_u8(
+            vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('"')), vceqq_u8(chunk, vdupq_n_u8(','))),
+            vorrq_u8(vceqq_u8(chunk, vdupq_n_u8(':')),
+                     vorrq_u8(vceqq_u8(folded, vdupq_n_u8('{')), vceqq_u8(folded, vdupq_n_u8('}'))))
+        );
+        
+        int first = neon_first_set(match);
+        if (first < 16) {
+            return str + i + first;
         }
     }
-    return str + len;
+    return find_delimiter_scalar(str + i, len - i);
 }
+#endif
 
 // =============================================================================
-// OPTIMIZED STRING DUPLICATION
+// JSON STRING ESCAPE SCANNING
 // =============================================================================
 
-char* my_strdup(const char* str) {
-    if (UNLIKELY(str == NULL)) return NULL;
+// Bytes cJSON escapes when printing a string; the terminator counts as one so
+// the scan needs no length
+static ALWAYS_INLINE int needs_json_escape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
 
-    size_t len = strlen_simd(str) + 1;
+static const char* find_escape_scalar(const char* str) {
+    const unsigned char* p = (const unsigned char*)str;
+    while (LIKELY(!needs_json_escape(*p))) p++;
+    return (const char*)p;
+}
+
+// The vector versions load unaligned blocks as long as a block stays within the
+// current page. The last block of a page is loaded ending at the page boundary
+// instead, with the bytes already scanned masked off, so no load touches a page
+// the string does not reach.
+#define ESCAPE_SCAN_PAGE 4096
+
+#ifdef HAS_AVX512_INTRINSICS
+static TARGET_AVX512 NO_SANITIZE_OVERREAD const char* find_escape_avx512(const char* str) {
+    const __m512i quote = _mm512_set1_epi8('"');
+    const __m512i backslash = _mm512_set1_epi8('\\');
+    const __m512i control = _mm512_set1_epi8(0x20);
+    
+    const char* p = str;
+    for (;;) {
+        size_t in_page = ESCAPE_SCAN_PAGE - ((uintptr_t)p & (ESCAPE_SCAN_PAGE - 1));
+        const char* block = in_page >= 64 ? p : p + in_page - 64;
+        __m512i chunk = _mm512_loadu_si512((const void*)block);
+        uint64_t mask = _mm512_cmpeq_epi8_mask(chunk, quote) | _mm512_cmpeq_epi8_mask(chunk, backslash) |
+                        _mm512_cmplt_epu8_mask(chunk, control);
+        mask >>= p - block;
+        if (mask != 0) {
+            return p + __builtin_ctzll(mask);
+        }
+        p = block + 64;
+    }
+}
+#endif
+
+#ifdef HAS_AVX2_INTRINSICS
+static TARGET_AVX2 NO_SANITIZE_OVERREAD const char* find_escape_avx2(const char* str) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1F);
+    
+    const char* p = str;
+    for (;;) {
+        size_t in_page = ESCAPE_SCAN_PAGE - ((uintptr_t)p & (ESCAPE_SCAN_PAGE - 1));
+        const char* block = in_page >= 32 ? p : p + in_page - 32;
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)block);
+        __m256i hit = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control), chunk)
+        );
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(hit) >> (p - block);
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p = block + 32;
+    }
+}
+#endif
+
+#ifdef HAS_SSE2_INTRINSICS
+static TARGET_SSE2 NO_SANITIZE_OVERREAD const char* find_escape_sse2(const char* str) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    
+    const char* p = str;
+    for (;;) {
+        size_t in_page = ESCAPE_SCAN_PAGE - ((uintptr_t)p & (ESCAPE_SCAN_PAGE - 1));
+        const char* block = in_page >= 16 ? p : p + in_page - 16;
+        __m128i chunk = _mm_loadu_si128((const __m128i*)block);
+        __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk)
+        );
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(hit) >> (p - block);
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p = block + 16;
+    }
+}
+#endif
+
+#ifdef HAS_NEON_INTRINSICS
+static NO_SANITIZE_OVERREAD const char* find_escape_neon(const char* str) {
+    const char* p = str;
+    for (;;) {
+        size_t in_page = ESCAPE_SCAN_PAGE - ((uintptr_t)p & (ESCAPE_SCAN_PAGE - 1));
+        if (in_page < 16) {
+            // Rare enough that finishing the page a byte at a time is fine
+            for (const char* page_end = p + in_page; p < page_end; p++) {
+                if (needs_json_escape((unsigned char)*p)) return p;
+            }
+            continue;
+        }
+        uint8x16_t chunk = vld1q_u8((const uint8_t*)p);
+        uint8x16_t hit = vorrq_u8(
+            vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('"')), vceqq_u8(chunk, vdupq_n_u8('\\'))),
+            vcltq_u8(chunk, vdupq_n_u8(0x20))
+        );
+        int first = neon_first_set(hit);
+        if (first < 16) {
+            return p + first;
+        }
+        p += 16;
+    }
+}
+#endif
+
+// =============================================================================
+// SIMD KERNEL DISPATCH
+// =============================================================================
+
+typedef enum {
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_NEON,
+    SIMD_AVX2,
+    SIMD_AVX512,
+    SIMD_LEVEL_COUNT
+} SimdLevel;
+
+static const char* const g_simd_level_names[SIMD_LEVEL_COUNT] = {"scalar", "sse2", "neon", "avx2", "avx512"};
+
+// Kernels of the selected level, resolved once by detect_cpu_features (at load
+// time with GCC and Clang). Until then the portable versions run, so no call
+// has to check g_cpu itself. Every level gives the same results, which lets
+// the entries be switched one at a time while other threads use them.
+typedef struct {
+    SimdLevel level;
+    size_t (*strlen_fn)(const char* str);
+    const char* (*skip_whitespace)(const char* str, size_t len);
+    const char* (*find_delimiter)(const char* str, size_t len);
+    const char* (*find_escape)(const char* str);
+} SimdDispatch;
+
+static SimdDispatch g_simd = {SIMD_SCALAR, strlen, skip_whitespace_scalar, find_delimiter_scalar, find_escape_scalar};
+
+static int simd_level_supported(SimdLevel level) {
+    switch (level) {
+        case SIMD_SCALAR:
+            return 1;
+        #ifdef HAS_SSE2_INTRINSICS
+        case SIMD_SSE2:
+            return g_cpu.has_sse2;
+        #endif
+        #ifdef HAS_NEON_INTRINSICS
+        case SIMD_NEON:
+            return g_cpu.has_neon;
+        #endif
+        #ifdef HAS_AVX2_INTRINSICS
+        case SIMD_AVX2:
+            return g_cpu.has_avx2;
+        #endif
+        #ifdef HAS_AVX512_INTRINSICS
+        case SIMD_AVX512:
+            return g_cpu.has_avx512 && g_cpu.has_avx512bw;
+        #endif
+        default:
+            return 0;
+    }
+}
+
+static void apply_simd_level(SimdLevel level) {
+    size_t (*strlen_fn)(const char*) = strlen;
+    const char* (*skip_whitespace)(const char*, size_t) = skip_whitespace_scalar;
+    const char* (*find_delimiter)(const char*, size_t) = find_delimiter_scalar;
+    const char* (*find_escape)(const char*) = find_escape_scalar;
+    
+    switch (level) {
+        #ifdef HAS_AVX512_INTRINSICS
+        case SIMD_AVX512:
+            strlen_fn = strlen_avx512;
+            skip_whitespace = skip_whitespace_avx512;
+            find_delimiter = find_delimiter_avx512;
+            find_escape = find_escape_avx512;
+            break;
+        #endif
+        #ifdef HAS_AVX2_INTRINSICS
+        case SIMD_AVX2:
+            strlen_fn = strlen_avx2;
+            skip_whitespace = skip_whitespace_avx2;
+            find_delimiter = find_delimiter_avx2;
+            find_escape = find_escape_avx2;
+            break;
+        #endif
+        #ifdef HAS_SSE2_INTRINSICS
+        case SIMD_SSE2:
+            // libc's strlen is already at least SSE2 here
+            skip_whitespace = skip_whitespace_sse2;
+            find_delimiter = find_delimiter_sse2;
+            find_escape = find_escape_sse2;
+            break;
+        #endif
+        #ifdef HAS_NEON_INTRINSICS
+        case SIMD_NEON:
+            strlen_fn = strlen_neon;
+            skip_whitespace = skip_whitespace_neon;
+            find_delimiter = find_delimiter_neon;
+            find_escape = find_escape_neon;
+            break;
+        #endif
+        default:
+            level = SIMD_SCALAR;
+            break;
+    }
+    
+    __atomic_store_n(&g_simd.strlen_fn, strlen_fn, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_simd.skip_whitespace, skip_whitespace, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_simd.find_delimiter, find_delimiter, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_simd.find_escape, find_escape, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_simd.level, level, __ATOMIC_RELAXED);
+}
+
+static SimdLevel best_simd_level(void) {
+    SimdLevel level = SIMD_LEVEL_COUNT;
+    while (level-- > SIMD_SCALAR) {
+        if (simd_level_supported(level)) return level;
+    }
+    return SIMD_SCALAR;
+}
+
+// Called once from detect_cpu_features, after g_cpu is filled in
+static void resolve_simd_dispatch(void) {
+    apply_simd_level(best_simd_level());
+}
+
+const char* cjson_tools_simd_level(void) {
+    detect_cpu_features();
+    return g_simd_level_names[__atomic_load_n(&g_simd.level, __ATOMIC_RELAXED)];
+}
+
+int cjson_tools_set_simd_level(const char* name) {
+    detect_cpu_features();
+    
+    SimdLevel level = best_simd_level();
+    if (name && strcmp(name, "auto") != 0) {
+        for (level = SIMD_SCALAR; level < SIMD_LEVEL_COUNT; level++) {
+            if (strcmp(name, g_simd_level_names[level]) == 0) break;
+        }
+        if (level == SIMD_LEVEL_COUNT || !simd_level_supported(level)) {
+            fprintf(stderr, "Error: SIMD level '%s' is not available on this CPU\n", name);
+            return -1;
+        }
+    }
+    apply_simd_level(level);
+    return 0;
+}
+
+size_t strlen_simd(const char* str) {
+    if (UNLIKELY(!str)) return 0;
+    return __atomic_load_n(&g_simd.strlen_fn, __ATOMIC_RELAXED)(str);
+}
+
+const char* skip_whitespace_optimized(const char* str, size_t len) {
+    if (!str || len == 0) return str;
+    return __atomic_load_n(&g_simd.skip_whitespace, __ATOMIC_RELAXED)(str, len);
+}
+
+const char* find_delimiter_optimized(const char* str, size_t len) {
+    if (!str || len == 0) return str;
+    return __atomic_load_n(&g_simd.find_delimiter, __ATOMIC_RELAXED)(str, len);
+}
+
+// =============================================================================
+// OPTIMIZED STRING DUPLICATION
+// =============================================================================
+
+char* my_strdup(const char* str) {
+    if (UNLIKELY(str == NULL)) return NULL;
+
+    size_t len = strlen_simd(str) + 1;
 
     // Always use regular malloc to avoid mixing allocation methods
     // This ensures we can always use regular free() to deallocate
@@ -1009,14 +1954,9 @@ void my_strfree(char* str) {
     }
 
     // Try to free from slab pool first (for small strings that might have been slab-allocated)
-    if (g_cjson_node_pool) {
-        char* pool_start = (char*)g_cjson_node_pool->memory;
-        char* pool_end = pool_start + (g_cjson_node_pool->object_size * g_cjson_node_pool->objects_per_slab);
-
-        if (str >= pool_start && str < pool_end) {
-            slab_free(g_cjson_node_pool, str);
-            return;
-        }
+    if (g_cjson_node_pool && slab_contains(g_cjson_node_pool, str)) {
+        slab_free(g_cjson_node_pool, str);
+        return;
     }
 
     // Otherwise use regular free
@@ -1073,1941 +2013,11446 @@ int get_optimal_threads(int requested_threads) {
 }
 
 // =============================================================================
-// FILE I/O OPTIMIZATIONS
+// COMPRESSED STREAMS
 // =============================================================================
 
-char* read_json_file(const char* filename) {
-    if (!filename) return NULL;
-    
-    #ifdef __unix__
-    // Try memory mapping for large files
-    int fd = open(filename, O_RDONLY);
-    if (fd != -1) {
-        struct stat st;
-        if (fstat(fd, &st) == 0 && st.st_size > 8192) {
-            void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-            if (mapped != MAP_FAILED) {
-                char* buffer = malloc(st.st_size + 1);
-                if (buffer) {
-                    fast_memcpy(buffer, mapped, st.st_size);
-                    buffer[st.st_size] = '\0';
-                }
-                munmap(mapped, st.st_size);
-                close(fd);
-                return buffer;
-            }
-        }
-        close(fd);
-    }
-    #endif
-    
-    // Fallback to regular file I/O
-    FILE* file = fopen(filename, "rb");
-    if (!file) return NULL;
-    
-    if (fseek(file, 0, SEEK_END) != 0) {
-        fclose(file);
-        return NULL;
-    }
-    
-    long file_size = ftell(file);
-    if (file_size < 0) {
-        fclose(file);
-        return NULL;
-    }
-    
-    if (fseek(file, 0, SEEK_SET) != 0) {
-        fclose(file);
-        return NULL;
-    }
-    
-    char* buffer = malloc(file_size + 1);
-    if (!buffer) {
-        fclose(file);
-        return NULL;
-    }
-    
-    size_t read_size = fread(buffer, 1, file_size, file);
-    buffer[read_size] = '\0';
-    fclose(file);
-    
-    return buffer;
-}
+// Compressed input is decoded on a thread of its own into a ring of
+// CODEC_BLOCK_SIZE blocks that the reader drains while the next ones are
+// decoded. Compressed output is cut into CODEC_BLOCK_SIZE blocks that the
+// shared pool compresses as independent gzip members or zstd frames, written
+// back in order; gunzip and zstd -d read the concatenation as one file.
 
-char* read_json_stdin(void) {
-    size_t capacity = 8192;
-    size_t used = 0;
-    char* content = malloc(capacity);
-    
-    if (!content) return NULL;
-    
-    char buffer[4096];
-    while (fgets(buffer, sizeof(buffer), stdin)) {
-        size_t buffer_len = strlen_simd(buffer);
-        
-        // Ensure capacity
-        while (used + buffer_len + 1 > capacity) {
-            capacity *= 2;
-            char* new_content = realloc(content, capacity);
-            if (!new_content) {
-                free(content);
-                return NULL;
-            }
-            content = new_content;
-        }
-        
-        fast_memcpy(content + used, buffer, buffer_len);
-        used += buffer_len;
+#define CODEC_BLOCK_SIZE (1 << 20)     // Decoded bytes per ring block, plain bytes per output block
+#define CODEC_READ_SIZE (256 * 1024)   // Compressed bytes read at a time
+#define CODEC_RING_BLOCKS 4            // Decoded blocks kept ahead of the reader
+#define CODEC_MAX_WRITE_BLOCKS 16      // Output blocks in flight at most
+
+// The FILE* wrappers need fopencookie (glibc) or funopen (BSD, macOS)
+#if defined(__GLIBC__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define STREAM_WRAPPERS 1
+#endif
+
+static const char* codec_name(JsonCodec codec) {
+    switch (codec) {
+        case JSON_CODEC_GZIP: return "gzip";
+        case JSON_CODEC_ZSTD: return "zstd";
+        default: return "plain";
     }
-    
-    content[used] = '\0';
-    return content;
 }
 
-// =============================================================================
-// WINDOWS PTHREAD COMPATIBILITY
-// =============================================================================
+static void codec_unavailable(JsonCodec codec) {
+    fprintf(stderr, "Error: %s support is not compiled in\n", codec_name(codec));
+}
 
-#if defined(THREADING_DISABLED) && defined(__WINDOWS__) && !defined(__MINGW32__) && !defined(__MINGW64__)
+JsonCodec json_codec_detect(const void* data, size_t length) {
+    const unsigned char* bytes = data;
+    if (!bytes) return JSON_CODEC_NONE;
 
-int pthread_create(pthread_t* thread, void* attr, void* (*start_routine)(void*), void* arg) {
-    (void)thread; (void)attr;
-    start_routine(arg);
-    return 0;
+    // gzip: 1f 8b and method 8 (deflate); zstd: frame magic 0xFD2FB528, little endian
+    if (length >= 3 && bytes[0] == 0x1f && bytes[1] == 0x8b && bytes[2] == 0x08) return JSON_CODEC_GZIP;
+    if (length >= 4 && bytes[0] == 0x28 && bytes[1] == 0xb5 && bytes[2] == 0x2f && bytes[3] == 0xfd) {
+        return JSON_CODEC_ZSTD;
+    }
+    return JSON_CODEC_NONE;
 }
 
-int pthread_join(pthread_t thread, void** retval) {
-    (void)thread; (void)retval;
-    return 0;
+static int path_has_suffix(const char* path, size_t length, const char* suffix) {
+    size_t suffix_length = strlen(suffix);
+    return length >= suffix_length && strcmp(path + length - suffix_length, suffix) == 0;
 }
 
-void pthread_exit(void* retval) {
-    (void)retval;
-}
+JsonCodec json_codec_from_path(const char* path) {
+    if (!path) return JSON_CODEC_NONE;
 
-int pthread_mutex_init(pthread_mutex_t* mutex, void* attr) {
-    (void)mutex; (void)attr;
-    return 0;
+    size_t length = strlen(path);
+    if (path_has_suffix(path, length, ".gz") || path_has_suffix(path, length, ".gzip")) return JSON_CODEC_GZIP;
+    if (path_has_suffix(path, length, ".zst") || path_has_suffix(path, length, ".zstd")) return JSON_CODEC_ZSTD;
+    return JSON_CODEC_NONE;
 }
 
-int pthread_mutex_lock(pthread_mutex_t* mutex) {
-    (void)mutex;
-    return 0;
-}
+int json_codec_parse(const char* name, JsonCodec* codec) {
+    if (!name || !codec) return -1;
 
-int pthread_mutex_unlock(pthread_mutex_t* mutex) {
-    (void)mutex;
+    if (strcmp(name, "gzip") == 0 || strcmp(name, "gz") == 0) {
+        *codec = JSON_CODEC_GZIP;
+    } else if (strcmp(name, "zstd") == 0 || strcmp(name, "zst") == 0) {
+        *codec = JSON_CODEC_ZSTD;
+    } else if (strcmp(name, "none") == 0) {
+        *codec = JSON_CODEC_NONE;
+    } else {
+        return -1;
+    }
     return 0;
 }
 
-int pthread_mutex_destroy(pthread_mutex_t* mutex) {
-    (void)mutex;
-    return 0;
+int json_codec_available(JsonCodec codec) {
+    switch (codec) {
+        case JSON_CODEC_NONE: return 1;
+        #ifdef HAVE_ZLIB
+        case JSON_CODEC_GZIP: return 1;
+        #endif
+        #ifdef HAVE_ZSTD
+        case JSON_CODEC_ZSTD: return 1;
+        #endif
+        default: return 0;
+    }
 }
 
-int pthread_cond_init(pthread_cond_t* cond, void* attr) {
-    (void)cond; (void)attr;
-    return 0;
+// Input stream the CLI opened and reads only through stream_read_some, so no
+// stdio buffer of it can hold bytes the descriptor has already delivered
+static FILE* g_unbuffered_input = NULL;
+
+// Reads up to size bytes: 0 at end of input, -1 on error. Callers' streams go
+// through stdio, which hands over anything they buffered before (after an
+// fgets or ungetc, say). The CLI's own input is read from its descriptor
+// directly, so pipes are not held back until a full buffer has arrived.
+static long stream_read_some(FILE* stream, void* buffer, size_t size) {
+    #ifndef __WINDOWS__
+    int fd = stream == g_unbuffered_input ? fileno(stream) : -1;
+    if (fd >= 0) {
+        ssize_t n;
+        do {
+            n = read(fd, buffer, size);
+        } while (n < 0 && errno == EINTR);
+        return (long)n;
+    }
+    #endif
+    size_t n = fread(buffer, 1, size, stream);
+    return n == 0 && ferror(stream) ? -1 : (long)n;
 }
 
-int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex) {
-    (void)cond; (void)mutex;
-    return 0;
+// Incremental decoder over a stream or a memory buffer
+typedef struct {
+    JsonCodec codec;
+    int detect;                     // Codec still to be read from the first bytes
+    int started;                    // Codec state initialized
+    FILE* input;                    // NULL when decoding a buffer
+    unsigned char* buffer;          // Compressed bytes read from input
+    const unsigned char* next_in;
+    size_t avail_in;
+    int input_eof;
+    int short_read;                 // The last read returned less than asked
+    int at_boundary;                // Everything so far ends on a member/frame boundary
+    #ifdef HAVE_ZLIB
+    z_stream zlib;
+    #endif
+    #ifdef HAVE_ZSTD
+    ZSTD_DStream* zstd;
+    #endif
+} CodecDecoder;
+
+static int codec_decoder_start(CodecDecoder* decoder) {
+    switch (decoder->codec) {
+        case JSON_CODEC_NONE:
+            decoder->at_boundary = 1;
+            decoder->started = 1;
+            return 0;
+        #ifdef HAVE_ZLIB
+        case JSON_CODEC_GZIP:
+            // 15 + 32: gzip or zlib header, told apart by inflate
+            if (inflateInit2(&decoder->zlib, 15 + 32) != Z_OK) break;
+            decoder->started = 1;
+            return 0;
+        #endif
+        #ifdef HAVE_ZSTD
+        case JSON_CODEC_ZSTD:
+            decoder->zstd = ZSTD_createDStream();
+            if (!decoder->zstd || ZSTD_isError(ZSTD_initDStream(decoder->zstd))) break;
+            decoder->started = 1;
+            return 0;
+        #endif
+        default:
+            codec_unavailable(decoder->codec);
+            return -1;
+    }
+    fprintf(stderr, "Error: Failed to initialize the %s decoder\n", codec_name(decoder->codec));
+    return -1;
 }
 
-int pthread_cond_signal(pthread_cond_t* cond) {
-    (void)cond;
-    return 0;
+// Decodes input (a stream) or data/length (a buffer). With JSON_CODEC_NONE the
+// codec is detected from the first bytes and plain input is passed through.
+static int codec_decoder_init(CodecDecoder* decoder, JsonCodec codec, FILE* input,
+                              const void* data, size_t length) {
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->codec = codec;
+    decoder->input = input;
+
+    if (input) {
+        decoder->buffer = malloc(CODEC_READ_SIZE);
+        if (!decoder->buffer) return -1;
+        decoder->next_in = decoder->buffer;
+        decoder->detect = codec == JSON_CODEC_NONE;
+        return decoder->detect ? 0 : codec_decoder_start(decoder);
+    }
+
+    decoder->next_in = data;
+    decoder->avail_in = length;
+    decoder->input_eof = 1;
+    if (codec == JSON_CODEC_NONE) decoder->codec = json_codec_detect(data, length);
+    return codec_decoder_start(decoder);
 }
 
-int pthread_cond_broadcast(pthread_cond_t* cond) {
-    (void)cond;
-    return 0;
+static void codec_decoder_free(CodecDecoder* decoder) {
+    #ifdef HAVE_ZLIB
+    if (decoder->started && decoder->codec == JSON_CODEC_GZIP) inflateEnd(&decoder->zlib);
+    #endif
+    #ifdef HAVE_ZSTD
+    if (decoder->zstd) ZSTD_freeDStream(decoder->zstd);
+    #endif
+    free(decoder->buffer);
+    memset(decoder, 0, sizeof(*decoder));
 }
 
-int pthread_cond_destroy(pthread_cond_t* cond) {
-    (void)cond;
+// Appends more compressed input after what is still pending
+static int codec_decoder_refill(CodecDecoder* decoder) {
+    if (!decoder->input) {
+        decoder->input_eof = 1;
+        return 0;
+    }
+
+    if (decoder->avail_in > 0 && decoder->next_in != decoder->buffer) {
+        memmove(decoder->buffer, decoder->next_in, decoder->avail_in);
+    }
+    decoder->next_in = decoder->buffer;
+
+    size_t wanted = CODEC_READ_SIZE - decoder->avail_in;
+    long n = stream_read_some(decoder->input, decoder->buffer + decoder->avail_in, wanted);
+    if (n < 0) {
+        fprintf(stderr, "Error: Failed to read compressed input\n");
+        return -1;
+    }
+    decoder->avail_in += (size_t)n;
+    decoder->input_eof = n == 0;
+    decoder->short_read = (size_t)n < wanted;
+
+    if (decoder->detect && (decoder->avail_in >= 4 || decoder->input_eof)) {
+        decoder->detect = 0;
+        decoder->codec = json_codec_detect(decoder->buffer, decoder->avail_in);
+        return codec_decoder_start(decoder);
+    }
     return 0;
 }
 
-#endif
+// Decodes what the pending input allows into out; -1 on corrupt input
+static int codec_decoder_step(CodecDecoder* decoder, char* out, size_t capacity, size_t* produced) {
+    *produced = 0;
+    if (!decoder->started) return 0;
+
+    switch (decoder->codec) {
+        case JSON_CODEC_NONE: {
+            size_t n = decoder->avail_in < capacity ? decoder->avail_in : capacity;
+            memcpy(out, decoder->next_in, n);
+            decoder->next_in += n;
+            decoder->avail_in -= n;
+            *produced = n;
+            return 0;
+        }
+        #ifdef HAVE_ZLIB
+        case JSON_CODEC_GZIP: {
+            z_stream* zs = &decoder->zlib;
+            if (decoder->at_boundary) {
+                // Another member follows, as parallel writers emit one per block
+                if (decoder->avail_in == 0) return 0;
+                if (inflateReset(zs) != Z_OK) return -1;
+                decoder->at_boundary = 0;
+            }
 
-// =============================================================================
-// THREAD POOL WITH WORK-STEALING
-// =============================================================================
+            uInt in_size = decoder->avail_in < UINT_MAX ? (uInt)decoder->avail_in : UINT_MAX;
+            uInt out_size = capacity < UINT_MAX ? (uInt)capacity : UINT_MAX;
+            zs->next_in = (Bytef*)decoder->next_in;
+            zs->avail_in = in_size;
+            zs->next_out = (Bytef*)out;
+            zs->avail_out = out_size;
 
-// WorkStealingQueue and WorkStealingPool structures are now defined in the header
+            int rc = inflate(zs, Z_NO_FLUSH);
+            decoder->next_in += in_size - zs->avail_in;
+            decoder->avail_in -= in_size - zs->avail_in;
+            *produced = out_size - zs->avail_out;
 
-static WorkStealingQueue* create_queue(int capacity) {
-    WorkStealingQueue* queue = malloc(sizeof(WorkStealingQueue));
-    if (!queue) return NULL;
-    
-    // Ensure capacity is power of 2
-    capacity = 1;
-    while (capacity < 1024) capacity <<= 1;
-    
-    queue->tasks = malloc(capacity * sizeof(Task));
-    if (!queue->tasks) {
-        free(queue);
-        return NULL;
+            if (rc == Z_STREAM_END) decoder->at_boundary = 1;
+            return rc == Z_OK || rc == Z_STREAM_END || rc == Z_BUF_ERROR ? 0 : -1;
+        }
+        #endif
+        #ifdef HAVE_ZSTD
+        case JSON_CODEC_ZSTD: {
+            ZSTD_inBuffer in = {decoder->next_in, decoder->avail_in, 0};
+            ZSTD_outBuffer output = {out, capacity, 0};
+            size_t rc = ZSTD_decompressStream(decoder->zstd, &output, &in);
+            if (ZSTD_isError(rc)) return -1;
+
+            decoder->next_in += in.pos;
+            decoder->avail_in -= in.pos;
+            *produced = output.pos;
+            // 0 means a frame ended and all of it has been flushed
+            if (in.pos > 0 || output.pos > 0) decoder->at_boundary = rc == 0;
+            return 0;
+        }
+        #endif
+        default:
+            return -1;
     }
-    
-    queue->capacity = capacity;
-    queue->mask = capacity - 1;
-    queue->head = 0;
-    queue->tail = 0;
-    
-    return queue;
 }
 
-static int queue_push(WorkStealingQueue* queue, Task* task) {
-    int tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
-    int next_tail = (tail + 1) & queue->mask;
-    
-    if (next_tail == __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) {
-        return 0; // Queue full
+// Decodes up to capacity bytes into out: returns the count, 0 at the end of
+// the input or -1 on error. When a pipe has nothing more ready it returns what
+// it has, so slow producers are passed through as their data arrives.
+static long codec_decoder_read(CodecDecoder* decoder, char* out, size_t capacity) {
+    size_t total = 0;
+
+    while (total < capacity) {
+        size_t pending = decoder->avail_in;
+        size_t produced;
+        if (codec_decoder_step(decoder, out + total, capacity - total, &produced) != 0) {
+            fprintf(stderr, "Error: Corrupt %s input\n", codec_name(decoder->codec));
+            return -1;
+        }
+        total += produced;
+        if (produced > 0 || decoder->avail_in != pending) continue;
+
+        // No progress: the decoder needs more input
+        if (decoder->input_eof) {
+            if (!decoder->at_boundary) {
+                fprintf(stderr, "Error: Truncated %s input\n", codec_name(decoder->codec));
+                return -1;
+            }
+            break;
+        }
+        if (total > 0 && decoder->short_read) break;
+        if (codec_decoder_refill(decoder) != 0) return -1;
     }
-    
-    queue->tasks[tail] = *task;
-    __atomic_store_n(&queue->tail, next_tail, __ATOMIC_RELEASE);
-    
-    return 1;
-}
 
-static int queue_pop(WorkStealingQueue* queue, Task* task) {
-    int tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
-    int head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
-    
-    if (head == tail) {
-        return 0; // Queue empty
-    }
-    
-    tail = (tail - 1) & queue->mask;
-    *task = queue->tasks[tail];
-    
-    if (!__atomic_compare_exchange_n(&queue->tail, &tail, tail, false, 
-                                   __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
-        return 0; // Failed to pop
-    }
-    
-    return 1;
+    return (long)total;
 }
 
-static int queue_steal(WorkStealingQueue* queue, Task* task) {
-    int head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
-    int tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
-    
-    if (head == tail) {
-        return 0; // Queue empty
-    }
-    
-    *task = queue->tasks[head];
-    
-    if (!__atomic_compare_exchange_n(&queue->head, &head, (head + 1) & queue->mask,
-                                   false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
-        return 0; // Failed to steal
+// Decodes a whole buffer into a NUL-terminated heap string
+static char* codec_decompress_buffer(JsonCodec codec, const void* data, size_t length, size_t* out_length) {
+    CodecDecoder decoder;
+    if (codec_decoder_init(&decoder, codec, NULL, data, length) != 0) {
+        codec_decoder_free(&decoder);
+        return NULL;
     }
-    
-    return 1;
-}
 
-// Global task queue size tracking (improved)
-static _Alignas(CACHE_LINE_SIZE) volatile size_t g_global_task_count = 0;
-
-size_t get_task_queue_size(void) {
-    return __atomic_load_n(&g_global_task_count, __ATOMIC_RELAXED);
-}
-
-static void* worker_thread_stealing(void* arg) {
-    struct {
-        WorkStealingPool* pool;
-        int thread_id;
-    }* data = arg;
-    
-    WorkStealingPool* pool = data->pool;
-    int thread_id = data->thread_id;
-    WorkStealingQueue* my_queue = &pool->queues[thread_id];
-    
-    Task task;
-    int idle_count = 0;
-    
-    while (!__atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE)) {
-        // Try to pop from own queue first
-        if (queue_pop(my_queue, &task)) {
-            task.function(task.argument);
-            __atomic_fetch_sub(&pool->global_task_count, 1, __ATOMIC_RELAXED);
-            __atomic_fetch_sub(&g_global_task_count, 1, __ATOMIC_RELAXED);
-            idle_count = 0;
-            continue;
-        }
-        
-        // Try to steal from other queues
-        int stolen = 0;
-        for (int i = 1; i < pool->num_threads; i++) {
-            int victim = (thread_id + i) % pool->num_threads;
-            if (queue_steal(&pool->queues[victim], &task)) {
-                task.function(task.argument);
-                __atomic_fetch_sub(&pool->global_task_count, 1, __ATOMIC_RELAXED);
-                __atomic_fetch_sub(&g_global_task_count, 1, __ATOMIC_RELAXED);
-                stolen = 1;
-                idle_count = 0;
+    // JSON typically compresses 4-10x; the buffer doubles when that is not enough
+    size_t capacity = length * 4 + 65536;
+    size_t used = 0;
+    char* text = malloc(capacity);
+
+    while (text) {
+        if (capacity - used < 2) {
+            char* grown = realloc(text, capacity * 2);
+            if (!grown) {
+                free(text);
+                text = NULL;
                 break;
             }
+            text = grown;
+            capacity *= 2;
         }
-        
-        if (!stolen) {
-            idle_count++;
-            if (idle_count < 100) {
-                cpu_relax();
-            } else if (idle_count < 1000) {
-                sched_yield();
-            } else {
-                usleep(1000); // Sleep for 1ms
-            }
+
+        long n = codec_decoder_read(&decoder, text + used, capacity - used - 1);
+        if (n < 0) {
+            free(text);
+            text = NULL;
+        } else if (n == 0) {
+            text[used] = '\0';
+            if (out_length) *out_length = used;
+            break;
+        } else {
+            used += (size_t)n;
         }
     }
-    
-    return NULL;
+
+    codec_decoder_free(&decoder);
+    return text;
 }
 
-// Original ThreadPool structure for compatibility
-struct ThreadPool {
-    WorkStealingPool* ws_pool;
+#ifdef STREAM_WRAPPERS
+
+// Decoding side: a thread fills the ring ahead of the reader
+typedef struct {
+    CodecDecoder decoder;
+    char* blocks[CODEC_RING_BLOCKS];
+    size_t lengths[CODEC_RING_BLOCKS];
+    int head;                       // Oldest decoded block
+    int count;                      // Decoded blocks not consumed yet
+    size_t offset;                  // Bytes of the head block already consumed
+    int finished;                   // 1 at the end of the input, -1 after an error
+    #ifndef THREADING_DISABLED
+    int threaded;
+    int stop;
+    pthread_t thread;
     pthread_mutex_t mutex;
     pthread_cond_t cond;
-    pthread_cond_t idle_cond;
-    Task* task_queue;
-    Task* task_queue_tail;
-    int num_threads;
-    int active_threads;
-    bool shutdown;
-};
+    #endif
+} CodecReader;
 
-ThreadPool* thread_pool_create(int num_threads) {
-    detect_cpu_features();
-    
-    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
-    if (!pool) return NULL;
-    
-    pool->num_threads = get_optimal_threads(num_threads);
-    pool->shutdown = false;
-    
-    // Initialize traditional fields for compatibility
-    pthread_mutex_init(&pool->mutex, NULL);
-    pthread_cond_init(&pool->cond, NULL);
-    pthread_cond_init(&pool->idle_cond, NULL);
-    
-    // Create work-stealing pool
-    WorkStealingPool* ws_pool = malloc(sizeof(WorkStealingPool));
-    if (!ws_pool) {
-        free(pool);
-        return NULL;
-    }
-    
-    ws_pool->num_threads = pool->num_threads;
-    ws_pool->shutdown = 0;
-    ws_pool->global_task_count = 0;
-    
-    // Create per-thread queues
-    ws_pool->queues = malloc(pool->num_threads * sizeof(WorkStealingQueue));
-    if (!ws_pool->queues) {
-        free(ws_pool);
-        free(pool);
-        return NULL;
-    }
-    
-    for (int i = 0; i < pool->num_threads; i++) {
-        WorkStealingQueue* queue = create_queue(1024);
-        if (!queue) {
-            // Cleanup on failure
-            for (int j = 0; j < i; j++) {
-                free(ws_pool->queues[j].tasks);
-            }
-            free(ws_pool->queues);
-            free(ws_pool);
-            free(pool);
-            return NULL;
-        }
-        ws_pool->queues[i] = *queue;
-        free(queue);
-    }
-    
-    // Create threads
-    ws_pool->threads = malloc(pool->num_threads * sizeof(pthread_t));
-    if (!ws_pool->threads) {
-        for (int i = 0; i < pool->num_threads; i++) {
-            free(ws_pool->queues[i].tasks);
+#ifndef THREADING_DISABLED
+static void* codec_reader_thread(void* arg) {
+    CodecReader* reader = arg;
+
+    pthread_mutex_lock(&reader->mutex);
+    while (!reader->stop) {
+        if (reader->count == CODEC_RING_BLOCKS) {
+            pthread_cond_wait(&reader->cond, &reader->mutex);
+            continue;
         }
-        free(ws_pool->queues);
-        free(ws_pool);
-        free(pool);
-        return NULL;
-    }
-    
-    // Start worker threads
-    struct {
-        WorkStealingPool* pool;
-        int thread_id;
-    }* thread_data = malloc(pool->num_threads * sizeof(*thread_data));
-    
-    for (int i = 0; i < pool->num_threads; i++) {
-        thread_data[i].pool = ws_pool;
-        thread_data[i].thread_id = i;
-        
-        if (pthread_create(&ws_pool->threads[i], NULL, worker_thread_stealing, &thread_data[i]) != 0) {
-            // Cleanup on failure
-            ws_pool->shutdown = 1;
-            for (int j = 0; j < i; j++) {
-                pthread_join(ws_pool->threads[j], NULL);
-            }
-            free(thread_data);
-            for (int j = 0; j < pool->num_threads; j++) {
-                free(ws_pool->queues[j].tasks);
-            }
-            free(ws_pool->queues);
-            free(ws_pool->threads);
-            free(ws_pool);
-            free(pool);
-            return NULL;
+
+        // The slot stays the same while the reader consumes and is invisible
+        // to it until count includes it, so it is filled without the lock
+        int slot = (reader->head + reader->count) % CODEC_RING_BLOCKS;
+        pthread_mutex_unlock(&reader->mutex);
+        long n = codec_decoder_read(&reader->decoder, reader->blocks[slot], CODEC_BLOCK_SIZE);
+        pthread_mutex_lock(&reader->mutex);
+
+        if (n > 0) {
+            reader->lengths[slot] = (size_t)n;
+            reader->count++;
+        } else {
+            reader->finished = n < 0 ? -1 : 1;
         }
+        pthread_cond_broadcast(&reader->cond);
+        if (n <= 0) break;
     }
-    
-    pool->ws_pool = ws_pool;
-    return pool;
+    pthread_mutex_unlock(&reader->mutex);
+    return NULL;
 }
+#endif
 
-int thread_pool_add_task(ThreadPool* pool, void (*function)(void*), void* argument) {
-    if (!pool || !function) return -1;
-    
-    Task task = {function, argument, NULL};
-    
-    // Round-robin task distribution to minimize contention
-    static _Alignas(CACHE_LINE_SIZE) volatile int next_queue = 0;
-    int queue_id = __atomic_fetch_add(&next_queue, 1, __ATOMIC_RELAXED) % pool->num_threads;
-    
-    // Try the selected queue first
-    if (queue_push(&pool->ws_pool->queues[queue_id], &task)) {
-        __atomic_fetch_add(&pool->ws_pool->global_task_count, 1, __ATOMIC_RELAXED);
-        __atomic_fetch_add(&g_global_task_count, 1, __ATOMIC_RELAXED);
-        return 0;
-    }
-    
-    // If that fails, try other queues
-    for (int i = 0; i < pool->num_threads; i++) {
-        int try_queue = (queue_id + i) % pool->num_threads;
-        if (queue_push(&pool->ws_pool->queues[try_queue], &task)) {
-            __atomic_fetch_add(&pool->ws_pool->global_task_count, 1, __ATOMIC_RELAXED);
-            __atomic_fetch_add(&g_global_task_count, 1, __ATOMIC_RELAXED);
-            return 0;
+// 1 when the head block has data, 0 at the end of the input (or, without
+// wait, when none is decoded yet) and -1 after a decoding error
+static int codec_reader_head(CodecReader* reader, int wait) {
+    #ifndef THREADING_DISABLED
+    if (reader->threaded) {
+        pthread_mutex_lock(&reader->mutex);
+        while (wait && reader->count == 0 && !reader->finished) {
+            pthread_cond_wait(&reader->cond, &reader->mutex);
         }
+        int state = reader->count > 0 ? 1 : (reader->finished < 0 ? -1 : 0);
+        pthread_mutex_unlock(&reader->mutex);
+        return state;
     }
-    
-    return -1; // All queues full
-}
+    #endif
 
-void thread_pool_wait(ThreadPool* pool) {
-    if (!pool) return;
-    
-    // Spin-wait for better responsiveness on small workloads
-    int spin_count = 0;
-    while (__atomic_load_n(&pool->ws_pool->global_task_count, __ATOMIC_ACQUIRE) > 0) {
-        if (spin_count < 1000) {
-            cpu_relax();
-            spin_count++;
+    // Without a thread the block is decoded on demand
+    if (wait && reader->count == 0 && !reader->finished) {
+        long n = codec_decoder_read(&reader->decoder, reader->blocks[reader->head], CODEC_BLOCK_SIZE);
+        if (n > 0) {
+            reader->lengths[reader->head] = (size_t)n;
+            reader->count = 1;
         } else {
-            usleep(100); // 0.1ms
-            spin_count = 0;
+            reader->finished = n < 0 ? -1 : 1;
         }
     }
+    return reader->count > 0 ? 1 : (reader->finished < 0 ? -1 : 0);
 }
 
-void thread_pool_destroy(ThreadPool* pool) {
-    if (!pool) return;
-    
-    // Signal shutdown
-    __atomic_store_n(&pool->ws_pool->shutdown, 1, __ATOMIC_RELEASE);
-    
-    // Wait for all threads to finish
-    for (int i = 0; i < pool->num_threads; i++) {
-        pthread_join(pool->ws_pool->threads[i], NULL);
-    }
-    
-    // Cleanup
-    for (int i = 0; i < pool->num_threads; i++) {
-        free(pool->ws_pool->queues[i].tasks);
-    }
-    free(pool->ws_pool->queues);
-    free(pool->ws_pool->threads);
-    free(pool->ws_pool);
-    
-    pthread_mutex_destroy(&pool->mutex);
-    pthread_cond_destroy(&pool->cond);
-    pthread_cond_destroy(&pool->idle_cond);
-    
-    free(pool);
+static void codec_reader_pop(CodecReader* reader) {
+    #ifndef THREADING_DISABLED
+    pthread_mutex_lock(&reader->mutex);
+    #endif
+    reader->head = (reader->head + 1) % CODEC_RING_BLOCKS;
+    reader->count--;
+    reader->offset = 0;
+    #ifndef THREADING_DISABLED
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->mutex);
+    #endif
 }
 
-int thread_pool_get_thread_count(ThreadPool* pool) {
-    return pool ? pool->num_threads : 0;
+static long codec_reader_read(CodecReader* reader, char* buffer, size_t size) {
+    size_t copied = 0;
+
+    while (copied < size) {
+        // Once something was copied, hand it out instead of waiting for more
+        int state = codec_reader_head(reader, copied == 0);
+        if (state <= 0) {
+            if (copied > 0) break;
+            return state;
+        }
+
+        size_t available = reader->lengths[reader->head] - reader->offset;
+        size_t n = available < size - copied ? available : size - copied;
+        memcpy(buffer + copied, reader->blocks[reader->head] + reader->offset, n);
+        copied += n;
+        reader->offset += n;
+        if (reader->offset == reader->lengths[reader->head]) codec_reader_pop(reader);
+    }
+
+    return (long)copied;
 }
 
-size_t thread_pool_get_queue_size(ThreadPool* pool) {
-    if (!pool) return 0;
-    return __atomic_load_n(&pool->ws_pool->global_task_count, __ATOMIC_RELAXED);
+static int codec_reader_close(CodecReader* reader) {
+    #ifndef THREADING_DISABLED
+    if (reader->threaded) {
+        pthread_mutex_lock(&reader->mutex);
+        reader->stop = 1;
+        pthread_cond_broadcast(&reader->cond);
+        pthread_mutex_unlock(&reader->mutex);
+        pthread_join(reader->thread, NULL);
+    }
+    pthread_cond_destroy(&reader->cond);
+    pthread_mutex_destroy(&reader->mutex);
+    #endif
+
+    codec_decoder_free(&reader->decoder);
+    for (int i = 0; i < CODEC_RING_BLOCKS; i++) free(reader->blocks[i]);
+    free(reader);
+    return 0;
 }
 
-// =============================================================================
-// JSON UTILITY FUNCTIONS (OPTIMIZED)
-// =============================================================================
+static CodecReader* codec_reader_create(FILE* input, JsonCodec codec) {
+    CodecReader* reader = calloc(1, sizeof(*reader));
+    if (!reader) return NULL;
 
-static cJSON* filter_json_recursive(const cJSON* json, int remove_empty_strings, int remove_nulls) {
-    if (UNLIKELY(json == NULL)) return NULL;
+    #ifndef THREADING_DISABLED
+    pthread_mutex_init(&reader->mutex, NULL);
+    pthread_cond_init(&reader->cond, NULL);
+    #endif
 
-    if (cJSON_IsObject(json)) {
-        cJSON* new_obj = cJSON_CreateObject();
-        if (UNLIKELY(!new_obj)) return NULL;
+    int failed = codec_decoder_init(&reader->decoder, codec, input, NULL, 0) != 0;
+    for (int i = 0; i < CODEC_RING_BLOCKS && !failed; i++) {
+        reader->blocks[i] = malloc(CODEC_BLOCK_SIZE);
+        failed = reader->blocks[i] == NULL;
+    }
+    if (failed) {
+        codec_reader_close(reader);
+        return NULL;
+    }
 
-        const cJSON* child = json->child;
-        while (child) {
-            int should_skip = 0;
+    #ifndef THREADING_DISABLED
+    // Without the thread the reader still works, decoding on demand
+    reader->threaded = pthread_create(&reader->thread, NULL, codec_reader_thread, reader) == 0;
+    #endif
+    return reader;
+}
 
-            if (remove_empty_strings && cJSON_IsString(child) &&
-                child->valuestring && strlen_simd(child->valuestring) == 0) {
-                should_skip = 1;
-            }
+// Encoding side: blocks are compressed on the pool and written in order
+typedef struct {
+    JsonCodec codec;
+    int level;
+    char* input;
+    size_t input_length;
+    char* output;
+    size_t output_length;
+    size_t output_capacity;
+    int failed;
+    int pending;                    // Submitted and not written yet
+    TaskLatch latch;
+} CodecWriteBlock;
 
-            if (remove_nulls && cJSON_IsNull(child)) {
-                should_skip = 1;
-            }
+typedef struct {
+    FILE* output;
+    ThreadPool* pool;
+    CodecWriteBlock* blocks;
+    int block_count;
+    int current;                    // Block being filled; the ones after it are pending, oldest first
+    long submitted;
+    int failed;
+} CodecWriter;
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+static int codec_block_reserve(CodecWriteBlock* block, size_t capacity) {
+    if (block->output_capacity >= capacity) return 0;
+
+    char* output = realloc(block->output, capacity);
+    if (!output) return -1;
+    block->output = output;
+    block->output_capacity = capacity;
+    return 0;
+}
+#endif
 
-            if (!should_skip) {
-                cJSON* filtered_value = filter_json_recursive(child, remove_empty_strings, remove_nulls);
-                if (filtered_value) {
-                    cJSON_AddItemToObject(new_obj, child->string, filtered_value);
+static void codec_compress_block(void* arg) {
+    CodecWriteBlock* block = arg;
+    block->failed = 1;
+    block->output_length = 0;
+
+    switch (block->codec) {
+        #ifdef HAVE_ZLIB
+        case JSON_CODEC_GZIP: {
+            z_stream zs;
+            memset(&zs, 0, sizeof(zs));
+            // 15 + 16: a complete gzip member with header and trailer
+            if (deflateInit2(&zs, block->level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) break;
+
+            uLong bound = deflateBound(&zs, (uLong)block->input_length);
+            if (codec_block_reserve(block, bound) == 0) {
+                zs.next_in = (Bytef*)block->input;
+                zs.avail_in = (uInt)block->input_length;
+                zs.next_out = (Bytef*)block->output;
+                zs.avail_out = (uInt)bound;
+                if (deflate(&zs, Z_FINISH) == Z_STREAM_END) {
+                    block->output_length = zs.total_out;
+                    block->failed = 0;
                 }
             }
-
-            child = child->next;
+            deflateEnd(&zs);
+            break;
+        }
+        #endif
+        #ifdef HAVE_ZSTD
+        case JSON_CODEC_ZSTD: {
+            size_t bound = ZSTD_compressBound(block->input_length);
+            if (codec_block_reserve(block, bound) != 0) break;
+
+            size_t n = ZSTD_compress(block->output, bound, block->input, block->input_length, block->level);
+            if (!ZSTD_isError(n)) {
+                block->output_length = n;
+                block->failed = 0;
+            }
+            break;
         }
+        #endif
+        default:
+            break;
+    }
+}
 
-        return new_obj;
-    } else if (cJSON_IsArray(json)) {
-        cJSON* new_array = cJSON_CreateArray();
-        if (UNLIKELY(!new_array)) return NULL;
+// Waits for a submitted block and writes it out
+static void codec_writer_drain(CodecWriter* writer, CodecWriteBlock* block) {
+    if (!block->pending) return;
 
-        const cJSON* child = json->child;
-        while (child) {
-            int should_skip = 0;
+    if (writer->pool) thread_pool_wait_latch(writer->pool, &block->latch);
+    block->pending = 0;
+    block->input_length = 0;
+    if (writer->failed) return;
 
-            if (remove_empty_strings && cJSON_IsString(child) &&
-                child->valuestring && strlen_simd(child->valuestring) == 0) {
-                should_skip = 1;
-            }
+    if (block->failed) {
+        fprintf(stderr, "Error: %s compression failed\n", codec_name(block->codec));
+        writer->failed = 1;
+    } else if (fwrite(block->output, 1, block->output_length, writer->output) != block->output_length) {
+        fprintf(stderr, "Error writing compressed output\n");
+        writer->failed = 1;
+    }
+}
 
-            if (remove_nulls && cJSON_IsNull(child)) {
-                should_skip = 1;
-            }
+// Hands the current block to the pool and moves on to the oldest pending
+// one, writing it out first
+static void codec_writer_submit(CodecWriter* writer) {
+    CodecWriteBlock* block = &writer->blocks[writer->current];
+    block->pending = 1;
+    memset(&block->latch, 0, sizeof(block->latch));
+    if (!writer->pool ||
+        thread_pool_add_task_latched(writer->pool, codec_compress_block, block, &block->latch) != 0) {
+        codec_compress_block(block);
+    }
+    writer->submitted++;
 
-            if (!should_skip) {
-                cJSON* filtered_value = filter_json_recursive(child, remove_empty_strings, remove_nulls);
-                if (filtered_value) {
-                    cJSON_AddItemToArray(new_array, filtered_value);
-                }
-            }
+    writer->current = (writer->current + 1) % writer->block_count;
+    codec_writer_drain(writer, &writer->blocks[writer->current]);
+}
 
-            child = child->next;
+static long codec_writer_write(CodecWriter* writer, const char* data, size_t size) {
+    size_t done = 0;
+
+    while (done < size && !writer->failed) {
+        CodecWriteBlock* block = &writer->blocks[writer->current];
+        size_t n = CODEC_BLOCK_SIZE - block->input_length;
+        if (n > size - done) n = size - done;
+
+        memcpy(block->input + block->input_length, data + done, n);
+        block->input_length += n;
+        done += n;
+        if (block->input_length == CODEC_BLOCK_SIZE) codec_writer_submit(writer);
+    }
+
+    return writer->failed ? -1 : (long)size;
+}
+
+static int codec_writer_close(CodecWriter* writer) {
+    if (writer->blocks) {
+        // An empty stream still gets one (empty) member so it decompresses
+        CodecWriteBlock* last = &writer->blocks[writer->current];
+        if (!writer->failed && (last->input_length > 0 || writer->submitted == 0)) {
+            codec_writer_submit(writer);
+        }
+        for (int i = 0; i < writer->block_count; i++) {
+            codec_writer_drain(writer, &writer->blocks[(writer->current + i) % writer->block_count]);
         }
+        for (int i = 0; i < writer->block_count; i++) {
+            free(writer->blocks[i].input);
+            free(writer->blocks[i].output);
+        }
+        free(writer->blocks);
+    }
 
-        return new_array;
-    } else {
-        return cJSON_Duplicate(json, 1);
+    int status = writer->failed || fflush(writer->output) != 0 ? -1 : 0;
+    thread_pool_release(writer->pool);
+    free(writer);
+    return status;
+}
+
+static CodecWriter* codec_writer_create(FILE* output, JsonCodec codec, int level) {
+    CodecWriter* writer = calloc(1, sizeof(*writer));
+    if (!writer) return NULL;
+    writer->output = output;
+
+    // Two blocks per worker keep the pool busy while the caller fills the next one
+    writer->pool = thread_pool_acquire_shared(0);
+    int threads = writer->pool ? thread_pool_get_thread_count(writer->pool) : 0;
+    writer->block_count = threads > 0 ? 2 * threads : 1;
+    if (writer->block_count > CODEC_MAX_WRITE_BLOCKS) writer->block_count = CODEC_MAX_WRITE_BLOCKS;
+
+    #ifdef HAVE_ZLIB
+    if (codec == JSON_CODEC_GZIP) level = level <= 0 ? Z_DEFAULT_COMPRESSION : (level > 9 ? 9 : level);
+    #endif
+    #ifdef HAVE_ZSTD
+    if (codec == JSON_CODEC_ZSTD && level > ZSTD_maxCLevel()) level = ZSTD_maxCLevel();
+    #endif
+
+    writer->blocks = calloc((size_t)writer->block_count, sizeof(CodecWriteBlock));
+    int failed = writer->blocks == NULL;
+    for (int i = 0; i < writer->block_count && !failed; i++) {
+        writer->blocks[i].codec = codec;
+        writer->blocks[i].level = level;
+        writer->blocks[i].input = malloc(CODEC_BLOCK_SIZE);
+        failed = writer->blocks[i].input == NULL;
+    }
+    if (failed) {
+        writer->failed = 1;
+        codec_writer_close(writer);
+        return NULL;
     }
+    return writer;
 }
 
-cJSON* remove_empty_strings(const cJSON* json) {
-    if (UNLIKELY(json == NULL)) return NULL;
-    return filter_json_recursive(json, 1, 0);
+#ifdef __GLIBC__
+static ssize_t codec_cookie_read(void* cookie, char* buffer, size_t size) {
+    return (ssize_t)codec_reader_read(cookie, buffer, size);
 }
 
-cJSON* remove_nulls(const cJSON* json) {
-    if (UNLIKELY(json == NULL)) return NULL;
-    return filter_json_recursive(json, 0, 1);
+static ssize_t codec_cookie_write(void* cookie, const char* buffer, size_t size) {
+    // fopencookie takes 0 (not -1) as a failed write
+    long n = codec_writer_write(cookie, buffer, size);
+    return n < 0 ? 0 : (ssize_t)n;
+}
+#else
+static int codec_cookie_read(void* cookie, char* buffer, int size) {
+    return (int)codec_reader_read(cookie, buffer, (size_t)size);
 }
 
-#ifndef __WINDOWS__
-static cJSON* replace_keys_recursive(const cJSON* json, const char* pattern, const char* replacement) {
-    if (UNLIKELY(json == NULL)) return NULL;
+static int codec_cookie_write(void* cookie, const char* buffer, int size) {
+    return (int)codec_writer_write(cookie, buffer, (size_t)size);
+}
+#endif
 
-    regex_t regex;
-    int regex_result = regcomp(&regex, pattern, REG_EXTENDED);
-    if (regex_result != 0) {
-        return cJSON_Duplicate(json, 1);
+static int codec_cookie_close_reader(void* cookie) {
+    return codec_reader_close(cookie);
+}
+
+static int codec_cookie_close_writer(void* cookie) {
+    return codec_writer_close(cookie);
+}
+
+#endif // STREAM_WRAPPERS
+
+FILE* json_stream_open_decompressed(FILE* input, JsonCodec codec) {
+    if (!input) return NULL;
+
+    #ifdef STREAM_WRAPPERS
+    if (!json_codec_available(codec)) {
+        codec_unavailable(codec);
+        return NULL;
     }
 
-    if (cJSON_IsObject(json)) {
-        cJSON* new_obj = cJSON_CreateObject();
-        if (UNLIKELY(!new_obj)) {
-            regfree(&regex);
-            return NULL;
-        }
+    CodecReader* reader = codec_reader_create(input, codec);
+    if (!reader) return NULL;
 
-        const cJSON* child = json->child;
-        while (child) {
-            const char* key = child->string;
-            char* new_key = NULL;
+    #ifdef __GLIBC__
+    cookie_io_functions_t io = {codec_cookie_read, NULL, NULL, codec_cookie_close_reader};
+    FILE* stream = fopencookie(reader, "r", io);
+    #else
+    FILE* stream = funopen(reader, codec_cookie_read, NULL, NULL, codec_cookie_close_reader);
+    #endif
+    if (!stream) codec_reader_close(reader);
+    return stream;
+    #else
+    (void)codec;
+    fprintf(stderr, "Error: Compressed streams are not supported on this platform\n");
+    return NULL;
+    #endif
+}
 
-            if (key) {
-                regmatch_t match;
-                int match_result = regexec(&regex, key, 1, &match, 0);
+FILE* json_stream_open_compressed(FILE* output, JsonCodec codec, int level) {
+    if (!output || codec == JSON_CODEC_NONE) return NULL;
+    if (!json_codec_available(codec)) {
+        codec_unavailable(codec);
+        return NULL;
+    }
 
-                if (match_result == 0) {
-                    new_key = my_strdup(replacement);
-                } else {
-                    new_key = my_strdup(key);
-                }
-            }
+    #ifdef STREAM_WRAPPERS
+    CodecWriter* writer = codec_writer_create(output, codec, level);
+    if (!writer) return NULL;
 
-            if (new_key) {
-                cJSON* processed_value = replace_keys_recursive(child, pattern, replacement);
-                if (processed_value) {
-                    cJSON_AddItemToObject(new_obj, new_key, processed_value);
-                }
-                free(new_key);
-            }
+    #ifdef __GLIBC__
+    cookie_io_functions_t io = {NULL, codec_cookie_write, NULL, codec_cookie_close_writer};
+    FILE* stream = fopencookie(writer, "w", io);
+    #else
+    FILE* stream = funopen(writer, NULL, codec_cookie_write, NULL, codec_cookie_close_writer);
+    #endif
+    if (!stream) {
+        writer->failed = 1;
+        codec_writer_close(writer);
+    }
+    return stream;
+    #else
+    (void)level;
+    fprintf(stderr, "Error: Compressed streams are not supported on this platform\n");
+    return NULL;
+    #endif
+}
 
-            child = child->next;
+// =============================================================================
+// ASYNC OUTPUT
+// =============================================================================
+
+// Text written to an async stream is copied into a ring of ASYNC_BUFFER_SIZE
+// buffers. The caller fills one buffer while a writer thread writes out the
+// full ones, everything queued in a single writev(), so the caller only waits
+// on the disk or pipe once every buffer is queued.
+
+#define ASYNC_BUFFER_SIZE (1 << 20)   // Bytes per output buffer
+#define ASYNC_BUFFER_COUNT 8          // Buffers in the ring, the most output held in memory
+
+#if defined(STREAM_WRAPPERS) && !defined(THREADING_DISABLED)
+
+typedef struct {
+    FILE* output;
+    int fd;                             // Descriptor for writev, or -1 to go through stdio
+    char* buffers[ASYNC_BUFFER_COUNT];
+    size_t lengths[ASYNC_BUFFER_COUNT];
+    int head;                           // Oldest queued buffer
+    int queued;                         // Full buffers waiting for the writer
+    int current;                        // Buffer the caller fills, (head + queued) % ASYNC_BUFFER_COUNT
+    int closing;
+    int failed;                         // Set by the writer thread
+    int caller_failed;                  // Copy of failed the caller reads without the mutex
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t queued_cond;         // Buffers were queued or closing was set
+    pthread_cond_t drained_cond;        // Queued buffers were written
+} AsyncWriter;
+
+// Writes count buffers from first on; 0 on success
+static int async_writer_flush(AsyncWriter* writer, int first, int count) {
+    if (writer->fd < 0) {
+        for (int i = 0; i < count; i++) {
+            int b = (first + i) % ASYNC_BUFFER_COUNT;
+            if (fwrite(writer->buffers[b], 1, writer->lengths[b], writer->output) != writer->lengths[b]) return -1;
         }
+        return 0;
+    }
 
-        regfree(&regex);
-        return new_obj;
-    } else if (cJSON_IsArray(json)) {
-        cJSON* new_array = cJSON_CreateArray();
-        if (UNLIKELY(!new_array)) {
-            regfree(&regex);
-            return NULL;
+    struct iovec iov[ASYNC_BUFFER_COUNT];
+    for (int i = 0; i < count; i++) {
+        int b = (first + i) % ASYNC_BUFFER_COUNT;
+        iov[i].iov_base = writer->buffers[b];
+        iov[i].iov_len = writer->lengths[b];
+    }
+
+    // Pipes and signals can cut a writev short; resume after what was written
+    struct iovec* next = iov;
+    int left = count;
+    while (left > 0) {
+        ssize_t n = writev(writer->fd, next, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (left > 0 && (size_t)n >= next->iov_len) {
+            n -= (ssize_t)next->iov_len;
+            next++;
+            left--;
+        }
+        if (left > 0) {
+            next->iov_base = (char*)next->iov_base + n;
+            next->iov_len -= (size_t)n;
         }
+    }
+    return 0;
+}
 
-        const cJSON* child = json->child;
-        while (child) {
-            cJSON* processed_value = replace_keys_recursive(child, pattern, replacement);
-            if (processed_value) {
-                cJSON_AddItemToArray(new_array, processed_value);
-            }
-            child = child->next;
+static void* async_writer_thread(void* arg) {
+    AsyncWriter* writer = (AsyncWriter*)arg;
+
+    pthread_mutex_lock(&writer->mutex);
+    for (;;) {
+        while (writer->queued == 0 && !writer->closing) {
+            pthread_cond_wait(&writer->queued_cond, &writer->mutex);
         }
+        if (writer->queued == 0) break;
 
-        regfree(&regex);
-        return new_array;
-    } else {
-        regfree(&regex);
-        return cJSON_Duplicate(json, 1);
+        int first = writer->head;
+        int count = writer->queued;
+        int failed = writer->failed;
+        pthread_mutex_unlock(&writer->mutex);
+
+        // After a failure buffers are dropped unwritten so the caller never stalls
+        int status = failed ? -1 : async_writer_flush(writer, first, count);
+
+        pthread_mutex_lock(&writer->mutex);
+        if (status != 0) writer->failed = 1;
+        writer->head = (first + count) % ASYNC_BUFFER_COUNT;
+        writer->queued -= count;
+        pthread_cond_signal(&writer->drained_cond);
     }
+    pthread_mutex_unlock(&writer->mutex);
+    return NULL;
 }
 
-static cJSON* replace_values_recursive(const cJSON* json, const char* pattern, const char* replacement) {
-    if (UNLIKELY(json == NULL)) return NULL;
+// Queues the current buffer and moves on to a free one, waiting if there is none
+static void async_writer_queue(AsyncWriter* writer) {
+    pthread_mutex_lock(&writer->mutex);
+    writer->queued++;
+    pthread_cond_signal(&writer->queued_cond);
+    while (writer->queued == ASYNC_BUFFER_COUNT) {
+        pthread_cond_wait(&writer->drained_cond, &writer->mutex);
+    }
+    writer->current = (writer->head + writer->queued) % ASYNC_BUFFER_COUNT;
+    writer->caller_failed = writer->failed;
+    pthread_mutex_unlock(&writer->mutex);
 
-    regex_t regex;
-    int regex_result = regcomp(&regex, pattern, REG_EXTENDED);
-    if (regex_result != 0) {
-        return cJSON_Duplicate(json, 1);
+    writer->lengths[writer->current] = 0;
+}
+
+static long async_writer_write(AsyncWriter* writer, const char* data, size_t size) {
+    size_t done = 0;
+
+    while (done < size && !writer->caller_failed) {
+        size_t* length = &writer->lengths[writer->current];
+        size_t n = ASYNC_BUFFER_SIZE - *length;
+        if (n > size - done) n = size - done;
+
+        memcpy(writer->buffers[writer->current] + *length, data + done, n);
+        *length += n;
+        done += n;
+        if (*length == ASYNC_BUFFER_SIZE) async_writer_queue(writer);
     }
 
-    if (cJSON_IsObject(json)) {
-        cJSON* new_obj = cJSON_CreateObject();
-        if (UNLIKELY(!new_obj)) {
-            regfree(&regex);
-            return NULL;
-        }
+    return writer->caller_failed ? -1 : (long)size;
+}
 
-        const cJSON* child = json->child;
-        while (child) {
-            const char* key = child->string;
-            cJSON* processed_value = replace_values_recursive(child, pattern, replacement);
-            if (processed_value && key) {
-                cJSON_AddItemToObject(new_obj, key, processed_value);
-            }
-            child = child->next;
-        }
+static void async_writer_free(AsyncWriter* writer) {
+    for (int i = 0; i < ASYNC_BUFFER_COUNT; i++) free(writer->buffers[i]);
+    free(writer);
+}
 
-        regfree(&regex);
-        return new_obj;
-    } else if (cJSON_IsArray(json)) {
-        cJSON* new_array = cJSON_CreateArray();
-        if (UNLIKELY(!new_array)) {
-            regfree(&regex);
-            return NULL;
-        }
+static int async_writer_close(AsyncWriter* writer) {
+    pthread_mutex_lock(&writer->mutex);
+    if (writer->lengths[writer->current] > 0) writer->queued++;
+    writer->closing = 1;
+    pthread_cond_signal(&writer->queued_cond);
+    pthread_mutex_unlock(&writer->mutex);
+    pthread_join(writer->thread, NULL);
+
+    int status = writer->failed || fflush(writer->output) != 0 ? -1 : 0;
+    pthread_cond_destroy(&writer->drained_cond);
+    pthread_cond_destroy(&writer->queued_cond);
+    pthread_mutex_destroy(&writer->mutex);
+    async_writer_free(writer);
+    return status;
+}
 
-        const cJSON* child = json->child;
-        while (child) {
-            cJSON* processed_value = replace_values_recursive(child, pattern, replacement);
-            if (processed_value) {
-                cJSON_AddItemToArray(new_array, processed_value);
-            }
-            child = child->next;
-        }
+static AsyncWriter* async_writer_create(FILE* output) {
+    // Whatever output buffered goes first, since the thread bypasses stdio
+    if (fflush(output) != 0) return NULL;
 
-        regfree(&regex);
-        return new_array;
-    } else if (cJSON_IsString(json)) {
-        const char* string_value = cJSON_GetStringValue(json);
-        if (string_value) {
-            regmatch_t match;
-            int match_result = regexec(&regex, string_value, 1, &match, 0);
+    AsyncWriter* writer = calloc(1, sizeof(*writer));
+    if (!writer) return NULL;
+    writer->output = output;
+    writer->fd = fileno(output);  // -1 for wrapped streams such as compressed ones
 
-            if (match_result == 0) {
-                regfree(&regex);
-                return cJSON_CreateString(replacement);
-            } else {
-                regfree(&regex);
-                return cJSON_CreateString(string_value);
-            }
-        } else {
-            regfree(&regex);
-            return cJSON_Duplicate(json, 1);
-        }
-    } else {
-        regfree(&regex);
-        return cJSON_Duplicate(json, 1);
+    int failed = 0;
+    for (int i = 0; i < ASYNC_BUFFER_COUNT && !failed; i++) {
+        writer->buffers[i] = malloc(ASYNC_BUFFER_SIZE);
+        failed = writer->buffers[i] == NULL;
     }
+    if (!failed) {
+        pthread_mutex_init(&writer->mutex, NULL);
+        pthread_cond_init(&writer->queued_cond, NULL);
+        pthread_cond_init(&writer->drained_cond, NULL);
+        if (pthread_create(&writer->thread, NULL, async_writer_thread, writer) == 0) return writer;
+
+        pthread_cond_destroy(&writer->drained_cond);
+        pthread_cond_destroy(&writer->queued_cond);
+        pthread_mutex_destroy(&writer->mutex);
+    }
+    async_writer_free(writer);
+    return NULL;
 }
-#endif
 
-cJSON* replace_keys(const cJSON* json, const char* pattern, const char* replacement) {
-    if (UNLIKELY(json == NULL || pattern == NULL || replacement == NULL)) return NULL;
-    
-#ifdef __WINDOWS__
-    (void)pattern; (void)replacement;
-    return cJSON_Duplicate(json, 1);
+#ifdef __GLIBC__
+static ssize_t async_cookie_write(void* cookie, const char* buffer, size_t size) {
+    long n = async_writer_write(cookie, buffer, size);
+    return n < 0 ? 0 : (ssize_t)n;
+}
 #else
-    return replace_keys_recursive(json, pattern, replacement);
+static int async_cookie_write(void* cookie, const char* buffer, int size) {
+    return (int)async_writer_write(cookie, buffer, (size_t)size);
+}
 #endif
+
+static int async_cookie_close(void* cookie) {
+    return async_writer_close(cookie);
 }
 
-cJSON* replace_values(const cJSON* json, const char* pattern, const char* replacement) {
-    if (UNLIKELY(json == NULL || pattern == NULL || replacement == NULL)) return NULL;
-    
-#ifdef __WINDOWS__
-    (void)pattern; (void)replacement;
-    return cJSON_Duplicate(json, 1);
-#else
-    return replace_values_recursive(json, pattern, replacement);
-#endif
+#endif // STREAM_WRAPPERS && !THREADING_DISABLED
+
+FILE* json_stream_open_async(FILE* output) {
+    if (!output) return NULL;
+
+    #if defined(STREAM_WRAPPERS) && !defined(THREADING_DISABLED)
+    AsyncWriter* writer = async_writer_create(output);
+    if (!writer) return NULL;
+
+    #ifdef __GLIBC__
+    cookie_io_functions_t io = {NULL, async_cookie_write, NULL, async_cookie_close};
+    FILE* stream = fopencookie(writer, "w", io);
+    #else
+    FILE* stream = funopen(writer, NULL, async_cookie_write, NULL, async_cookie_close);
+    #endif
+    if (!stream) async_writer_close(writer);
+    return stream;
+    #else
+    return NULL;
+    #endif
 }
 
 // =============================================================================
-// JSON FLATTENER IMPLEMENTATION (ULTRA-OPTIMIZED)
+// FILE I/O OPTIMIZATIONS
 // =============================================================================
 
-typedef struct {
-    char* key;
-    cJSON* value;
-} FlattenedPair;
-
-typedef struct {
-    FlattenedPair* pairs;
-    int count;
-    int capacity;
-    char* memory_pool;
-    size_t pool_used;
-    size_t pool_size;
-    int is_sorted; // Track if pairs are sorted for binary search
-} FlattenedArray;
+// Reads a stream to EOF in large blocks; the result is NUL-terminated
+static char* read_stream_fully(FILE* stream, size_t size_hint, size_t* out_length) {
+    size_t capacity = size_hint + 1 > 65536 ? size_hint + 1 : 65536;
+    size_t used = 0;
+    char* content = malloc(capacity);
+    if (!content) return NULL;
 
-typedef struct {
-    cJSON* object;
-    cJSON* result;
-    pthread_mutex_t* result_mutex;
-    char* key_buffer;
-    size_t buffer_size;
-} ThreadData;
+    for (;;) {
+        if (used + 1 >= capacity) {
+            char* new_content = realloc(content, capacity * 2);
+            if (!new_content) {
+                free(content);
+                return NULL;
+            }
+            content = new_content;
+            capacity *= 2;
+        }
 
-// Optimized pool allocation with different size classes
-static char* pool_alloc(FlattenedArray* array, size_t size) {
-    size = (size + 15) & ~15; // 16-byte alignment
-    
-    if (array->pool_used + size <= array->pool_size) {
-        char* ptr = array->memory_pool + array->pool_used;
-        array->pool_used += size;
-        return ptr;
+        // stdio, not the descriptor: a caller's fseek() may not have reached it yet
+        size_t n = fread(content + used, 1, capacity - used - 1, stream);
+        if (n == 0 && ferror(stream)) {
+            free(content);
+            return NULL;
+        }
+        if (n == 0) break;
+        used += (size_t)n;
     }
-    
-    // Pool exhausted, fall back to regular allocation
-    return malloc(size);
+
+    content[used] = '\0';
+    if (out_length) *out_length = used;
+    return content;
 }
 
-static void init_flattened_array(FlattenedArray* array, int initial_capacity) {
-    int capacity = initial_capacity < INITIAL_ARRAY_CAPACITY ? INITIAL_ARRAY_CAPACITY : initial_capacity;
-    
-    detect_cpu_features();
-    init_global_pools();
-    
-    // Align capacity to cache line for better performance
-    capacity = (capacity + g_cpu.cache_line_size - 1) & ~(g_cpu.cache_line_size - 1);
-    
-    array->pairs = malloc(capacity * sizeof(FlattenedPair));
-    array->count = 0;
-    array->capacity = capacity;
-    array->is_sorted = 1; // Start sorted
-    
-    // Size pool based on expected usage
-    size_t pool_size = MEMORY_POOL_SIZE + (initial_capacity * 128);
-    
-    // Use huge pages if available
-    #ifdef __linux__
-    array->memory_pool = mmap(NULL, pool_size, PROT_READ | PROT_WRITE,
+#ifdef __unix__
+// Maps a regular file from its current offset; 0 on success
+static int json_input_map_fd(JsonInput* input, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (offset < 0 || offset >= st.st_size) return -1;
+
+    // mmap offsets must be page aligned
+    long page_size = sysconf(_SC_PAGESIZE);
+    off_t aligned = page_size > 0 ? offset - (offset % page_size) : 0;
+    size_t mapping_length = (size_t)(st.st_size - aligned);
+
+    void* mapping = mmap(NULL, mapping_length, PROT_READ, MAP_PRIVATE, fd, aligned);
+    if (mapping == MAP_FAILED) return -1;
+
+    // The parser reads front to back exactly once
+    #ifdef MADV_SEQUENTIAL
+    madvise(mapping, mapping_length, MADV_SEQUENTIAL);
+    #endif
+    #ifdef MADV_HUGEPAGE
+    madvise(mapping, mapping_length, MADV_HUGEPAGE);
+    #endif
+
+    input->mapping = mapping;
+    input->mapping_length = mapping_length;
+    input->data = (const char*)mapping + (offset - aligned);
+    input->length = (size_t)(st.st_size - offset);
+    return 0;
+}
+#endif
+
+// Swaps gzip or zstd input for its decoded text; 0 when the input is plain or was decoded
+static int json_input_decompress(JsonInput* input) {
+    JsonCodec codec = json_codec_detect(input->data, input->length);
+    if (codec == JSON_CODEC_NONE) return 0;
+
+    size_t length = 0;
+    char* text = codec_decompress_buffer(codec, input->data, input->length, &length);
+    json_input_close(input);
+    if (!text) return -1;
+
+    input->buffer = text;
+    input->data = text;
+    input->length = length;
+    return 0;
+}
+
+int json_input_open_file(JsonInput* input, const char* filename) {
+    if (!input) return -1;
+    memset(input, 0, sizeof(*input));
+    if (!filename) return -1;
+
+    #ifdef __unix__
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) return -1;
+
+    // The mapping stays valid after the descriptor is closed
+    int mapped = json_input_map_fd(input, fd) == 0;
+    close(fd);
+    if (mapped) return json_input_decompress(input);
+    #endif
+
+    FILE* file = fopen(filename, "rb");
+    if (!file) return -1;
+
+    input->buffer = read_stream_fully(file, 0, &input->length);
+    fclose(file);
+
+    input->data = input->buffer;
+    return input->buffer ? json_input_decompress(input) : -1;
+}
+
+int json_input_open_stdin(JsonInput* input) {
+    if (!input) return -1;
+    memset(input, 0, sizeof(*input));
+
+    #ifdef __unix__
+    // Redirected regular files are mapped; pipes and terminals are read in blocks
+    if (json_input_map_fd(input, STDIN_FILENO) == 0) return json_input_decompress(input);
+    #endif
+
+    input->buffer = read_stream_fully(stdin, 0, &input->length);
+    input->data = input->buffer;
+    return input->buffer ? json_input_decompress(input) : -1;
+}
+
+void json_input_close(JsonInput* input) {
+    if (!input) return;
+
+    #ifdef __unix__
+    if (input->mapping) {
+        munmap(input->mapping, input->mapping_length);
+    }
+    #endif
+    free(input->buffer);
+    memset(input, 0, sizeof(*input));
+}
+
+cJSON* json_input_parse(const JsonInput* input) {
+    if (!input || !input->data) return NULL;
+
+    int outer = stats_phase_begin(STATS_PHASE_PARSE);
+    const char* parse_end = NULL;
+    cJSON* json = cJSON_ParseWithLengthOpts(input->data, input->length, &parse_end, 0);
+    if (json) stats_count(outer, STAT_BYTES_IN, input->length);
+    stats_phase_end(outer);
+    if (!json) {
+        // The input is not NUL-terminated, so report a position instead of the text
+        size_t offset = parse_end ? (size_t)(parse_end - input->data) : 0;
+        fprintf(stderr, "Error parsing JSON at byte %zu\n", offset);
+    }
+    return json;
+}
+
+// cJSON_Parse, timed and counted as a parse
+static cJSON* parse_json_string(const char* text) {
+    int outer = stats_phase_begin(STATS_PHASE_PARSE);
+    const char* parse_end = NULL;
+    cJSON* json = cJSON_ParseWithOpts(text, &parse_end, 0);
+    if (json) stats_count(outer, STAT_BYTES_IN, (uint64_t)(parse_end - text));
+    stats_phase_end(outer);
+    return json;
+}
+
+cJSON* parse_json_file(const char* filename) {
+    JsonInput input;
+    if (json_input_open_file(&input, filename) != 0) return NULL;
+
+    // Parsed values own copies of their strings, so the mapping can go right away
+    cJSON* json = json_input_parse(&input);
+    json_input_close(&input);
+    return json;
+}
+
+// Replaces gzip or zstd text with its decoded form
+static char* decompress_text(char* text, size_t length) {
+    JsonCodec codec = text ? json_codec_detect(text, length) : JSON_CODEC_NONE;
+    if (codec == JSON_CODEC_NONE) return text;
+
+    char* decoded = codec_decompress_buffer(codec, text, length, NULL);
+    free(text);
+    return decoded;
+}
+
+char* read_json_file(const char* filename) {
+    if (!filename) return NULL;
+    
+    FILE* file = fopen(filename, "rb");
+    if (!file) return NULL;
+    
+    // Size the buffer up front so the file is read straight into it
+    size_t size_hint = 0;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long file_size = ftell(file);
+        if (file_size > 0) size_hint = (size_t)file_size;
+        if (fseek(file, 0, SEEK_SET) != 0) {
+            fclose(file);
+            return NULL;
+        }
+    }
+    
+    size_t length = 0;
+    char* buffer = read_stream_fully(file, size_hint, &length);
+    fclose(file);
+    
+    return decompress_text(buffer, length);
+}
+
+char* read_json_stdin(void) {
+    size_t length = 0;
+    char* buffer = read_stream_fully(stdin, 0, &length);
+    return decompress_text(buffer, length);
+}
+
+// =============================================================================
+// STRUCTURAL INDEX PARSER
+// =============================================================================
+
+// Stage 1 classifies the input 64 bytes at a time into bitmasks, resolves
+// backslash escapes and string spans with carry-propagating bit arithmetic and
+// records the offset of every unescaped quote and of every bracket, colon and
+// comma outside strings. Stage 2 walks those offsets and builds the tree with
+// cJSON's own rules (whitespace is any byte <= 32, literals are matched by
+// prefix, numbers go through strtod), so the result is node for node what
+// cJSON_ParseWithLengthOpts() returns.
+
+typedef struct {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;  // { } [ ] : ,
+} StructuralMasks;
+
+typedef void (*StructuralMaskFn)(const unsigned char* block, StructuralMasks* masks);
+
+static void structural_masks_scalar(const unsigned char* block, StructuralMasks* masks) {
+    memset(masks, 0, sizeof(*masks));
+    for (int i = 0; i < 64; i++) {
+        unsigned char c = block[i];
+        uint64_t bit = 1ULL << i;
+        if (c == '"') {
+            masks->quote |= bit;
+        } else if (c == '\\') {
+            masks->backslash |= bit;
+        } else if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') {
+            masks->op |= bit;
+        }
+    }
+}
+
+// OR-ing 0x20 folds '[' onto '{' and ']' onto '}', so four compares find all six operators
+
+#ifdef HAS_SSE2_INTRINSICS
+static TARGET_SSE2 void structural_masks_sse2(const unsigned char* block, StructuralMasks* masks) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i lbrace = _mm_set1_epi8('{');
+    const __m128i rbrace = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i fold = _mm_set1_epi8(0x20);
+
+    memset(masks, 0, sizeof(*masks));
+    for (int i = 0; i < 64; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(block + i));
+        __m128i folded = _mm_or_si128(chunk, fold);
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, lbrace), _mm_cmpeq_epi8(folded, rbrace)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, comma))
+        );
+
+        masks->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)) << i;
+        masks->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)) << i;
+        masks->op |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << i;
+    }
+}
+#endif
+
+#ifdef HAS_AVX2_INTRINSICS
+static TARGET_AVX2 void structural_masks_avx2(const unsigned char* block, StructuralMasks* masks) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i lbrace = _mm256_set1_epi8('{');
+    const __m256i rbrace = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i fold = _mm256_set1_epi8(0x20);
+
+    memset(masks, 0, sizeof(*masks));
+    for (int i = 0; i < 64; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(block + i));
+        __m256i folded = _mm256_or_si256(chunk, fold);
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, lbrace), _mm256_cmpeq_epi8(folded, rbrace)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon), _mm256_cmpeq_epi8(chunk, comma))
+        );
+
+        masks->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, quote)) << i;
+        masks->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslash)) << i;
+        masks->op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << i;
+    }
+}
+#endif
+
+#ifdef HAS_AVX512_INTRINSICS
+static TARGET_AVX512 void structural_masks_avx512(const unsigned char* block, StructuralMasks* masks) {
+    __m512i chunk = _mm512_loadu_si512((const void*)block);
+    __m512i folded = _mm512_or_si512(chunk, _mm512_set1_epi8(0x20));
+
+    masks->quote = _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('"'));
+    masks->backslash = _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\\'));
+    masks->op = _mm512_cmpeq_epi8_mask(folded, _mm512_set1_epi8('{')) |
+                _mm512_cmpeq_epi8_mask(folded, _mm512_set1_epi8('}')) |
+                _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(':')) |
+                _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(','));
+}
+#endif
+
+#ifdef HAS_NEON_INTRINSICS
+// One bit per byte of four compare results, like x86 movemask
+static inline uint64_t neon_movemask64(uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t d) {
+    const uint8x16_t bits = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t sum0 = vpaddq_u8(vandq_u8(a, bits), vandq_u8(b, bits));
+    uint8x16_t sum1 = vpaddq_u8(vandq_u8(c, bits), vandq_u8(d, bits));
+    sum0 = vpaddq_u8(sum0, sum1);
+    sum0 = vpaddq_u8(sum0, sum0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+static void structural_masks_neon(const unsigned char* block, StructuralMasks* masks) {
+    uint8x16_t quote[4], backslash[4], op[4];
+    for (int i = 0; i < 4; i++) {
+        uint8x16_t chunk = vld1q_u8(block + 16 * i);
+        uint8x16_t folded = vorrq_u8(chunk, vdupq_n_u8(0x20));
+        quote[i] = vceqq_u8(chunk, vdupq_n_u8('"'));
+        backslash[i] = vceqq_u8(chunk, vdupq_n_u8('\\'));
+        op[i] = vorrq_u8(vorrq_u8(vceqq_u8(folded, vdupq_n_u8('{')), vceqq_u8(folded, vdupq_n_u8('}'))),
+                         vorrq_u8(vceqq_u8(chunk, vdupq_n_u8(':')), vceqq_u8(chunk, vdupq_n_u8(','))));
+    }
+    masks->quote = neon_movemask64(quote[0], quote[1], quote[2], quote[3]);
+    masks->backslash = neon_movemask64(backslash[0], backslash[1], backslash[2], backslash[3]);
+    masks->op = neon_movemask64(op[0], op[1], op[2], op[3]);
+}
+#endif
+
+static StructuralMaskFn select_structural_kernel(void) {
+    detect_cpu_features();
+
+    switch (__atomic_load_n(&g_simd.level, __ATOMIC_RELAXED)) {
+        #ifdef HAS_AVX512_INTRINSICS
+        case SIMD_AVX512: return structural_masks_avx512;
+        #endif
+        #ifdef HAS_AVX2_INTRINSICS
+        case SIMD_AVX2: return structural_masks_avx2;
+        #endif
+        #ifdef HAS_SSE2_INTRINSICS
+        case SIMD_SSE2: return structural_masks_sse2;
+        #endif
+        #ifdef HAS_NEON_INTRINSICS
+        case SIMD_NEON: return structural_masks_neon;
+        #endif
+        default: return structural_masks_scalar;
+    }
+}
+
+// Bit i set when an odd number of quotes is at or below i
+static inline uint64_t prefix_xor64(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+// Characters escaped by a backslash. Runs of backslashes escape the character
+// after them when their length is odd; adding each run's odd-position start
+// to the run carries out past its end, which tells the two parities apart.
+// *carry marks the first character of the next block as escaped.
+static inline uint64_t escaped_mask(uint64_t backslash, uint64_t* carry) {
+    const uint64_t even_bits = 0x5555555555555555ULL;
+
+    backslash &= ~*carry;
+    uint64_t follows_escape = (backslash << 1) | *carry;
+    uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+    uint64_t even_sequences = odd_starts + backslash;
+    *carry = even_sequences < odd_starts;
+    return (even_bits ^ (even_sequences << 1)) & follows_escape;
+}
+
+// Rejects truncated or overlong sequences, surrogates and code points past U+10FFFF
+static int utf8_is_valid(const unsigned char* text, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        // Skip ASCII eight bytes at a time
+        if (i + 8 <= length) {
+            uint64_t word;
+            memcpy(&word, text + i, sizeof(word));
+            if ((word & 0x8080808080808080ULL) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+
+        unsigned char c = text[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+
+        size_t extra;
+        uint32_t codepoint;
+        if (c >= 0xC2 && c <= 0xDF) {
+            extra = 1;
+            codepoint = c & 0x1F;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            extra = 2;
+            codepoint = c & 0x0F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            extra = 3;
+            codepoint = c & 0x07;
+        } else {
+            return 0;
+        }
+        if (length - i <= extra) return 0;
+
+        for (size_t k = 1; k <= extra; k++) {
+            if ((text[i + k] & 0xC0) != 0x80) return 0;
+            codepoint = (codepoint << 6) | (text[i + k] & 0x3F);
+        }
+        if ((extra == 2 && (codepoint < 0x800 || (codepoint >= 0xD800 && codepoint <= 0xDFFF))) ||
+            (extra == 3 && (codepoint < 0x10000 || codepoint > 0x10FFFF))) {
+            return 0;
+        }
+        i += extra + 1;
+    }
+    return 1;
+}
+
+// Index entries kept in flight; stage 1 runs a few kilobytes ahead of stage 2
+// so the index never grows with the input
+#define STRUCTURAL_WINDOW 4096
+
+typedef struct {
+    const unsigned char* text;
+    size_t length;
+    StructuralMaskFn kernel;
+    size_t scanned;          // Bytes classified by stage 1 so far
+    uint64_t escape_carry;
+    uint64_t in_string;      // All ones when the last block ended inside a string
+    size_t positions[STRUCTURAL_WINDOW];
+    size_t count;
+    size_t next;    // First index entry not consumed yet
+    size_t offset;  // Current byte offset
+    size_t depth;
+} StructuralParser;
+
+// Stage 1: moves the unconsumed entries to the front of the window and
+// classifies more input until the window is full or the input ends
+static int structural_refill(StructuralParser* p, size_t needed) {
+    size_t pending = p->count - p->next;
+    memmove(p->positions, p->positions + p->next, pending * sizeof(size_t));
+    p->count = pending;
+    p->next = 0;
+
+    unsigned char tail[64];
+    while (p->scanned < p->length && p->count <= STRUCTURAL_WINDOW - 64) {
+        size_t base = p->scanned;
+        const unsigned char* block = p->text + base;
+        if (p->length - base < 64) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, p->length - base);
+            block = tail;
+        }
+
+        StructuralMasks masks;
+        p->kernel(block, &masks);
+
+        uint64_t quotes = masks.quote & ~escaped_mask(masks.backslash, &p->escape_carry);
+        uint64_t string_mask = prefix_xor64(quotes) ^ p->in_string;
+        p->in_string = (uint64_t)((int64_t)string_mask >> 63);
+        uint64_t structurals = (masks.op & ~string_mask) | quotes;
+
+        size_t* out = p->positions + p->count;
+        while (structurals) {
+            *out++ = base + (size_t)__builtin_ctzll(structurals);
+            structurals &= structurals - 1;
+        }
+        p->count = (size_t)(out - p->positions);
+        p->scanned = base + 64;
+    }
+    return p->count >= needed;
+}
+
+static inline int structural_ensure(StructuralParser* p, size_t needed) {
+    return p->count - p->next >= needed || structural_refill(p, needed);
+}
+
+static inline void structural_skip_whitespace(StructuralParser* p) {
+    while (p->offset < p->length && p->text[p->offset] <= 32) p->offset++;
+}
+
+// Consumes c at the current offset together with its index entry
+static inline int structural_take(StructuralParser* p, unsigned char c) {
+    if (p->offset >= p->length || p->text[p->offset] != c) return 0;
+    if (!structural_ensure(p, 1) || p->positions[p->next] != p->offset) return 0;
+    p->next++;
+    p->offset++;
+    return 1;
+}
+
+static unsigned structural_hex4(const unsigned char* input) {
+    unsigned h = 0;
+    for (int i = 0; i < 4; i++) {
+        unsigned char c = input[i];
+        if (c >= '0' && c <= '9') {
+            h = (h << 4) | (unsigned)(c - '0');
+        } else if (c >= 'A' && c <= 'F') {
+            h = (h << 4) | (unsigned)(10 + c - 'A');
+        } else if (c >= 'a' && c <= 'f') {
+            h = (h << 4) | (unsigned)(10 + c - 'a');
+        } else {
+            return 0;  // cJSON decodes invalid digits as U+0000 rather than failing
+        }
+    }
+    return h;
+}
+
+// \uXXXX (or a surrogate pair) to UTF-8, accepting exactly what cJSON accepts;
+// returns the escape length consumed, 0 on failure
+static size_t structural_utf16_to_utf8(const unsigned char* input, const unsigned char* end, unsigned char** output) {
+    if (end - input < 6) return 0;
+
+    unsigned long codepoint = structural_hex4(input + 2);
+    size_t sequence_length = 6;
+    if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) return 0;
+
+    if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+        const unsigned char* second = input + 6;
+        if (end - second < 6 || second[0] != '\\' || second[1] != 'u') return 0;
+
+        unsigned second_code = structural_hex4(second + 2);
+        if (second_code < 0xDC00 || second_code > 0xDFFF) return 0;
+
+        codepoint = 0x10000 + (((codepoint & 0x3FF) << 10) | (second_code & 0x3FF));
+        sequence_length = 12;
+    }
+
+    unsigned char* out = *output;
+    if (codepoint < 0x80) {
+        out[0] = (unsigned char)codepoint;
+        *output += 1;
+    } else if (codepoint < 0x800) {
+        out[0] = (unsigned char)(0xC0 | (codepoint >> 6));
+        out[1] = (unsigned char)(0x80 | (codepoint & 0x3F));
+        *output += 2;
+    } else if (codepoint < 0x10000) {
+        out[0] = (unsigned char)(0xE0 | (codepoint >> 12));
+        out[1] = (unsigned char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (unsigned char)(0x80 | (codepoint & 0x3F));
+        *output += 3;
+    } else {
+        out[0] = (unsigned char)(0xF0 | (codepoint >> 18));
+        out[1] = (unsigned char)(0x80 | ((codepoint >> 12) & 0x3F));
+        out[2] = (unsigned char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[3] = (unsigned char)(0x80 | (codepoint & 0x3F));
+        *output += 4;
+    }
+    return sequence_length;
+}
+
+// Decodes the string whose opening quote is at the current offset; its closing
+// quote is the next index entry. The result is allocated with cJSON_malloc.
+static char* structural_string(StructuralParser* p) {
+    size_t open = p->offset;
+    if (!structural_ensure(p, 2) || p->positions[p->next] != open) return NULL;
+
+    size_t close = p->positions[p->next + 1];
+    if (p->text[close] != '"') return NULL;
+
+    const unsigned char* input = p->text + open + 1;
+    const unsigned char* end = p->text + close;
+    size_t raw_length = (size_t)(end - input);
+
+    unsigned char* output = cJSON_malloc(raw_length + 1);
+    if (!output) return NULL;
+
+    // Short keys and values are the common case, where a byte loop beats
+    // the memchr and memcpy calls
+    const unsigned char* escape;
+    if (raw_length < 16) {
+        escape = NULL;
+        for (size_t i = 0; i < raw_length; i++) {
+            if (input[i] == '\\') {
+                escape = input + i;
+                break;
+            }
+            output[i] = input[i];
+        }
+    } else {
+        escape = memchr(input, '\\', raw_length);
+    }
+
+    if (!escape) {
+        if (raw_length >= 16) memcpy(output, input, raw_length);
+        output[raw_length] = '\0';
+    } else {
+        size_t plain = (size_t)(escape - input);
+        memcpy(output, input, plain);
+
+        unsigned char* out = output + plain;
+        input = escape;
+        while (input < end) {
+            if (*input != '\\') {
+                *out++ = *input++;
+                continue;
+            }
+
+            size_t sequence_length = 2;
+            switch (input[1]) {
+                case 'b': *out++ = '\b'; break;
+                case 'f': *out++ = '\f'; break;
+                case 'n': *out++ = '\n'; break;
+                case 'r': *out++ = '\r'; break;
+                case 't': *out++ = '\t'; break;
+                case '"':
+                case '\\':
+                case '/':
+                    *out++ = input[1];
+                    break;
+                case 'u':
+                    sequence_length = structural_utf16_to_utf8(input, end, &out);
+                    if (sequence_length == 0) {
+                        cJSON_free(output);
+                        return NULL;
+                    }
+                    break;
+                default:
+                    cJSON_free(output);
+                    return NULL;
+            }
+            input += sequence_length;
+        }
+        *out = '\0';
+    }
+
+    p->next += 2;
+    p->offset = close + 1;
+    return (char*)output;
+}
+
+static inline void structural_set_number(cJSON* item, double number) {
+    item->valuedouble = number;
+    if (number >= INT_MAX) {
+        item->valueint = INT_MAX;
+    } else if (number <= (double)INT_MIN) {
+        item->valueint = INT_MIN;
+    } else {
+        item->valueint = (int)number;
+    }
+    item->type = cJSON_Number;
+}
+
+// Same scan, strtod call and integer saturation as cJSON's parse_number
+static int structural_number(StructuralParser* p, cJSON* item) {
+    const unsigned char* start = p->text + p->offset;
+    size_t available = p->length - p->offset;
+    size_t length = 0;
+    int has_decimal_point = 0;
+
+    for (; length < available; length++) {
+        unsigned char c = start[length];
+        if (c == '.') {
+            has_decimal_point = 1;
+        } else if (!((c >= '0' && c <= '9') || c == '+' || c == '-' || c == 'e' || c == 'E')) {
+            break;
+        }
+    }
+
+    // Plain integers of up to 15 digits are exact in a double, so strtod
+    // would return the same value
+    size_t sign = length > 0 && start[0] == '-';
+    if (length > sign && length - sign <= 15) {
+        double magnitude = 0;
+        size_t i = sign;
+        while (i < length && start[i] >= '0' && start[i] <= '9') {
+            magnitude = magnitude * 10 + (start[i] - '0');
+            i++;
+        }
+        if (i == length) {
+            structural_set_number(item, sign ? -magnitude : magnitude);
+            p->offset += length;
+            return 1;
+        }
+    }
+
+    char small[64];
+    char* number_text = length < sizeof(small) ? small : malloc(length + 1);
+    if (!number_text) return 0;
+    memcpy(number_text, start, length);
+    number_text[length] = '\0';
+
+    #ifdef ENABLE_LOCALES
+    if (has_decimal_point) {
+        char decimal_point = localeconv()->decimal_point[0];
+        for (size_t i = 0; i < length; i++) {
+            if (number_text[i] == '.') number_text[i] = decimal_point;
+        }
+    }
+    #else
+    (void)has_decimal_point;
+    #endif
+
+    char* after = NULL;
+    double number = strtod(number_text, &after);
+    size_t consumed = (size_t)(after - number_text);
+    if (number_text != small) free(number_text);
+    if (consumed == 0) return 0;
+
+    structural_set_number(item, number);
+    p->offset += consumed;
+    return 1;
+}
+
+static int structural_value(StructuralParser* p, cJSON* item);
+
+// Appends a fresh node to the list being built, like cJSON's parse loops
+static cJSON* structural_append(cJSON** head, cJSON** tail) {
+    cJSON* node = cJSON_CreateNull();
+    if (!node) return NULL;
+
+    if (*head == NULL) {
+        *head = node;
+    } else {
+        (*tail)->next = node;
+        node->prev = *tail;
+    }
+    *tail = node;
+    return node;
+}
+
+static int structural_array(StructuralParser* p, cJSON* item) {
+    if (p->depth >= CJSON_NESTING_LIMIT || !structural_take(p, '[')) return 0;
+    p->depth++;
+
+    cJSON* head = NULL;
+    cJSON* tail = NULL;
+
+    structural_skip_whitespace(p);
+    if (!structural_take(p, ']')) {
+        for (;;) {
+            cJSON* child = structural_append(&head, &tail);
+            if (!child) goto fail;
+
+            structural_skip_whitespace(p);
+            if (!structural_value(p, child)) goto fail;
+            structural_skip_whitespace(p);
+
+            if (structural_take(p, ',')) continue;
+            if (structural_take(p, ']')) break;
+            goto fail;
+        }
+    }
+
+    p->depth--;
+    if (head) head->prev = tail;
+    item->type = cJSON_Array;
+    item->child = head;
+    return 1;
+
+fail:
+    cJSON_Delete(head);
+    return 0;
+}
+
+static int structural_object(StructuralParser* p, cJSON* item) {
+    if (p->depth >= CJSON_NESTING_LIMIT || !structural_take(p, '{')) return 0;
+    p->depth++;
+
+    cJSON* head = NULL;
+    cJSON* tail = NULL;
+
+    structural_skip_whitespace(p);
+    if (!structural_take(p, '}')) {
+        for (;;) {
+            cJSON* child = structural_append(&head, &tail);
+            if (!child) goto fail;
+
+            structural_skip_whitespace(p);
+            if (p->offset >= p->length || p->text[p->offset] != '"') goto fail;
+            child->string = structural_string(p);
+            if (!child->string) goto fail;
+
+            structural_skip_whitespace(p);
+            if (!structural_take(p, ':')) goto fail;
+
+            structural_skip_whitespace(p);
+            if (!structural_value(p, child)) goto fail;
+            structural_skip_whitespace(p);
+
+            if (structural_take(p, ',')) continue;
+            if (structural_take(p, '}')) break;
+            goto fail;
+        }
+    }
+
+    p->depth--;
+    if (head) head->prev = tail;
+    item->type = cJSON_Object;
+    item->child = head;
+    return 1;
+
+fail:
+    cJSON_Delete(head);
+    return 0;
+}
+
+static int structural_value(StructuralParser* p, cJSON* item) {
+    const unsigned char* s = p->text + p->offset;
+    size_t available = p->length - p->offset;
+    if (available == 0) return 0;
+
+    switch (*s) {
+        case '"':
+            item->valuestring = structural_string(p);
+            if (!item->valuestring) return 0;
+            item->type = cJSON_String;
+            return 1;
+        case '[':
+            return structural_array(p, item);
+        case '{':
+            return structural_object(p, item);
+        case 'n':
+            if (available < 4 || memcmp(s, "null", 4) != 0) return 0;
+            item->type = cJSON_NULL;
+            p->offset += 4;
+            return 1;
+        case 'f':
+            if (available < 5 || memcmp(s, "false", 5) != 0) return 0;
+            item->type = cJSON_False;
+            p->offset += 5;
+            return 1;
+        case 't':
+            if (available < 4 || memcmp(s, "true", 4) != 0) return 0;
+            item->type = cJSON_True;
+            item->valueint = 1;
+            p->offset += 4;
+            return 1;
+        default:
+            if (*s == '-' || (*s >= '0' && *s <= '9')) return structural_number(p, item);
+            return 0;
+    }
+}
+
+static void structural_parser_reset(StructuralParser* p, const unsigned char* text, size_t length) {
+    p->text = text;
+    p->length = length;
+    p->kernel = select_structural_kernel();
+    p->scanned = 0;
+    p->escape_carry = 0;
+    p->in_string = 0;
+    p->count = 0;
+    p->next = 0;
+    p->offset = 0;
+    p->depth = 0;
+}
+
+cJSON* json_parse_structural(const char* value, size_t buffer_length, const char** return_parse_end, int options) {
+    if (!value || buffer_length == 0) {
+        if (return_parse_end) *return_parse_end = value;
+        return NULL;
+    }
+
+    const unsigned char* text = (const unsigned char*)value;
+    if ((options & JSON_PARSE_VALIDATE_UTF8) && !utf8_is_valid(text, buffer_length)) {
+        if (return_parse_end) *return_parse_end = value;
+        return NULL;
+    }
+
+    StructuralParser* parser = malloc(sizeof(StructuralParser));
+    if (!parser) return NULL;
+    structural_parser_reset(parser, text, buffer_length);
+    int outer = stats_phase_begin(STATS_PHASE_PARSE);
+
+    // cJSON only looks for a byte order mark when more than four bytes follow it
+    if (buffer_length > 4 && memcmp(text, "\xEF\xBB\xBF", 3) == 0) parser->offset = 3;
+    structural_skip_whitespace(parser);
+
+    cJSON* item = cJSON_CreateNull();
+    int ok = item && structural_value(parser, item);
+
+    // cJSON wants only whitespace after the value and a NUL as the last byte
+    if (ok && (options & JSON_PARSE_REQUIRE_NULL_TERMINATED)) {
+        size_t value_end = parser->offset;
+        structural_skip_whitespace(parser);
+        ok = value_end < buffer_length && parser->offset == buffer_length && text[buffer_length - 1] == '\0';
+        parser->offset = buffer_length - 1;
+    }
+
+    if (!ok) {
+        cJSON_Delete(item);
+        item = NULL;
+        if (parser->offset >= buffer_length) parser->offset = buffer_length - 1;
+    }
+    if (return_parse_end) *return_parse_end = value + parser->offset;
+    free(parser);
+    if (item) stats_count(outer, STAT_BYTES_IN, buffer_length);
+    stats_phase_end(outer);
+    return item;
+}
+
+cJSON* json_parse_structural_string(const char* value) {
+    if (!value) return NULL;
+    return json_parse_structural(value, strlen_simd(value) + 1, NULL, 0);
+}
+
+cJSON* json_input_parse_structural(const JsonInput* input) {
+    if (!input || !input->data) return NULL;
+
+    const char* parse_end = NULL;
+    cJSON* json = json_parse_structural(input->data, input->length, &parse_end, 0);
+    if (!json) {
+        size_t offset = parse_end ? (size_t)(parse_end - input->data) : 0;
+        fprintf(stderr, "Error parsing JSON at byte %zu\n", offset);
+    }
+    return json;
+}
+
+// =============================================================================
+// PARALLEL ARRAY PARSING
+// =============================================================================
+
+// Element boundaries of a top-level array come from the same structural index:
+// a comma at depth one ends an element and the closing bracket ends the last.
+// Each element is then parsed on its own from its span with its depth starting
+// at one, so nesting limits, whitespace and literal rules match one cJSON parse
+// of the whole array.
+
+static int split_add_span(JsonSpan** spans, int* count, size_t* capacity, size_t offset, size_t length) {
+    if ((size_t)*count == *capacity) {
+        if (*count == INT_MAX) return -1;
+        size_t new_capacity = *capacity ? *capacity * 2 : 1024;
+        JsonSpan* grown = realloc(*spans, new_capacity * sizeof(JsonSpan));
+        if (!grown) return -1;
+        *spans = grown;
+        *capacity = new_capacity;
+    }
+    (*spans)[*count].offset = offset;
+    (*spans)[*count].length = length;
+    (*count)++;
+    return 0;
+}
+
+int json_split_array(const char* text, size_t length, JsonSpan** spans, int* count) {
+    if (!text || !spans || !count) return -1;
+    *spans = NULL;
+    *count = 0;
+
+    const unsigned char* bytes = (const unsigned char*)text;
+    StructuralParser* p = malloc(sizeof(StructuralParser));
+    if (!p) return -1;
+    structural_parser_reset(p, bytes, length);
+
+    if (length > 4 && memcmp(bytes, "\xEF\xBB\xBF", 3) == 0) p->offset = 3;
+    structural_skip_whitespace(p);
+
+    size_t capacity = 0;
+    int ok = structural_take(p, '[');
+    size_t start = p->offset;
+    size_t depth = 1;
+
+    while (ok) {
+        if (!structural_ensure(p, 1)) {
+            ok = 0;
+            break;
+        }
+        size_t position = p->positions[p->next++];
+        unsigned char c = bytes[position];
+
+        if (c == '{' || c == '[') {
+            ok = depth < CJSON_NESTING_LIMIT;
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (--depth > 0) continue;
+            ok = c == ']';
+            if (!ok) break;
+
+            // "[ ]" has no elements; anything else before the bracket is the last one
+            p->offset = start;
+            structural_skip_whitespace(p);
+            if (*count > 0 || p->offset < position) {
+                ok = split_add_span(spans, count, &capacity, start, position - start) == 0;
+            }
+            break;
+        } else if (c == ',' && depth == 1) {
+            ok = split_add_span(spans, count, &capacity, start, position - start) == 0;
+            start = position + 1;
+        }
+    }
+
+    free(p);
+    if (!ok) {
+        free(*spans);
+        *spans = NULL;
+        *count = 0;
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    const unsigned char* text;
+    const JsonSpan* spans;
+    cJSON** items;
+    StructuralParser** parsers;  // One per pool slot
+    int failed;
+} ArrayParseJob;
+
+static void parse_array_range(void* context, int begin, int end, int slot) {
+    ArrayParseJob* job = (ArrayParseJob*)context;
+    StructuralParser* p = job->parsers[slot];
+
+    for (int i = begin; i < end; i++) {
+        if (__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) return;
+
+        structural_parser_reset(p, job->text + job->spans[i].offset, job->spans[i].length);
+        p->depth = 1;  // Inside the top-level array
+        structural_skip_whitespace(p);
+
+        cJSON* item = cJSON_CreateNull();
+        int ok = item && structural_value(p, item);
+        if (ok) {
+            structural_skip_whitespace(p);
+            ok = p->offset == p->length;
+        }
+        if (!ok) {
+            cJSON_Delete(item);
+            item = NULL;
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        }
+        job->items[i] = item;
+    }
+}
+
+int json_parse_array_parallel(const char* text, size_t length, ThreadPool* pool, JsonArrayView* records) {
+    if (!records) return -1;
+    records->items = NULL;
+    records->count = 0;
+
+    int outer = stats_phase_begin(STATS_PHASE_PARSE);
+    JsonSpan* spans = NULL;
+    int count = 0;
+    int split = json_split_array(text, length, &spans, &count);
+    if (split != 0 || count == 0) {
+        if (split == 0) stats_count(outer, STAT_BYTES_IN, length);
+        stats_phase_end(outer);
+        return split;
+    }
+
+    int slots = thread_pool_get_thread_count(pool) + 1;
+    ArrayParseJob job = {
+        (const unsigned char*)text,
+        spans,
+        calloc((size_t)count, sizeof(cJSON*)),
+        calloc((size_t)slots, sizeof(StructuralParser*)),
+        0
+    };
+
+    int ok = job.items && job.parsers;
+    for (int i = 0; ok && i < slots; i++) {
+        job.parsers[i] = malloc(sizeof(StructuralParser));
+        ok = job.parsers[i] != NULL;
+    }
+    if (ok) {
+        thread_pool_parallel_for(pool, count, MIN_RECORDS_PER_CHUNK, parse_array_range, &job);
+        ok = !job.failed;
+    }
+
+    if (job.parsers) {
+        for (int i = 0; i < slots; i++) free(job.parsers[i]);
+        free(job.parsers);
+    }
+    free(spans);
+    if (ok) stats_count(outer, STAT_BYTES_IN, length);
+    stats_phase_end(outer);
+
+    records->items = job.items;
+    records->count = count;
+    if (!ok) {
+        json_array_view_delete(records);
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    const JsonArrayView* records;
+    cJSON** results;
+    JsonRecordTransform transform;
+    void* user_data;
+} ArrayTransformJob;
+
+static void transform_array_range(void* context, int begin, int end, int slot) {
+    (void)slot;
+    ArrayTransformJob* job = (ArrayTransformJob*)context;
+    for (int i = begin; i < end; i++) {
+        job->results[i] = job->transform(job->records->items[i], job->user_data);
+    }
+}
+
+int json_array_view_transform(const JsonArrayView* records, ThreadPool* pool,
+                              JsonRecordTransform transform, void* user_data, JsonArrayView* results) {
+    if (!records || !transform || !results) return -1;
+    results->items = NULL;
+    results->count = 0;
+    if (records->count == 0) return 0;
+
+    ArrayTransformJob job = {
+        records,
+        malloc((size_t)records->count * sizeof(cJSON*)),
+        transform,
+        user_data
+    };
+    if (!job.results) return -1;
+
+    int outer = stats_transform_begin((uint64_t)records->count);
+    thread_pool_parallel_for(pool, records->count, MIN_RECORDS_PER_CHUNK, transform_array_range, &job);
+    stats_phase_end(outer);
+
+    // Records the transform dropped (NULL) are left out, like the filters do for array elements
+    int kept = 0;
+    for (int i = 0; i < records->count; i++) {
+        if (job.results[i]) job.results[kept++] = job.results[i];
+    }
+    results->items = job.results;
+    results->count = kept;
+    return 0;
+}
+
+// For threaded string entry points: parses a top-level array on the shared
+// pool and returns the pool (release it when done), or NULL when the text is
+// not an array, threading would not help, or the text is invalid, in which
+// case the caller parses it whole and reports the error
+static ThreadPool* parse_array_on_shared_pool(const char* text, size_t length, int num_threads,
+                                              JsonArrayView* records) {
+    if (get_optimal_threads(num_threads) < 2) return NULL;
+
+    // Cheap rejection of non-arrays before any scanning
+    const char* start = skip_whitespace_optimized(text, length);
+    if (start == text + length || *start != '[') return NULL;
+
+    ThreadPool* pool = thread_pool_acquire_shared(num_threads);
+    if (pool && json_parse_array_parallel(text, length, pool, records) == 0) return pool;
+    thread_pool_release(pool);
+    return NULL;
+}
+
+void json_array_view_delete(JsonArrayView* records) {
+    if (!records) return;
+
+    if (records->items) {
+        for (int i = 0; i < records->count; i++) cJSON_Delete(records->items[i]);
+    }
+    json_array_view_free(records);
+}
+
+// =============================================================================
+// WINDOWS PTHREAD COMPATIBILITY
+// =============================================================================
+
+#if defined(THREADING_DISABLED) && defined(__WINDOWS__) && !defined(__MINGW32__) && !defined(__MINGW64__)
+
+int pthread_create(pthread_t* thread, void* attr, void* (*start_routine)(void*), void* arg) {
+    (void)thread; (void)attr;
+    start_routine(arg);
+    return 0;
+}
+
+int pthread_join(pthread_t thread, void** retval) {
+    (void)thread; (void)retval;
+    return 0;
+}
+
+void pthread_exit(void* retval) {
+    (void)retval;
+}
+
+int pthread_mutex_init(pthread_mutex_t* mutex, void* attr) {
+    (void)mutex; (void)attr;
+    return 0;
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) {
+    (void)mutex;
+    return 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t* mutex) {
+    (void)mutex;
+    return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t* mutex) {
+    (void)mutex;
+    return 0;
+}
+
+int pthread_cond_init(pthread_cond_t* cond, void* attr) {
+    (void)cond; (void)attr;
+    return 0;
+}
+
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex) {
+    (void)cond; (void)mutex;
+    return 0;
+}
+
+int pthread_cond_signal(pthread_cond_t* cond) {
+    (void)cond;
+    return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t* cond) {
+    (void)cond;
+    return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t* cond) {
+    (void)cond;
+    return 0;
+}
+
+#endif
+
+// =============================================================================
+// THREAD POOL WITH WORK-STEALING
+// =============================================================================
+
+// WorkStealingQueue and WorkStealingPool structures are now defined in the header
+
+// The queue structs are cache-line aligned, so their array must be as well
+static void* cache_aligned_calloc(size_t count, size_t size) {
+    size_t bytes = count * size;
+    void* ptr;
+    #ifdef _MSC_VER
+    ptr = _aligned_malloc(bytes, CACHE_LINE_SIZE);
+    #else
+    if (posix_memalign(&ptr, CACHE_LINE_SIZE, bytes) != 0) {
+        ptr = NULL;
+    }
+    #endif
+    if (ptr) memset(ptr, 0, bytes);
+    return ptr;
+}
+
+static void cache_aligned_free(void* ptr) {
+    #ifdef _MSC_VER
+    _aligned_free(ptr);
+    #else
+    free(ptr);
+    #endif
+}
+
+static int init_queue(WorkStealingQueue* queue, int capacity) {
+    // Ensure capacity is power of 2
+    int rounded = 1;
+    while (rounded < capacity) rounded <<= 1;
+    
+    queue->tasks = malloc(rounded * sizeof(Task));
+    if (!queue->tasks) return -1;
+    
+    queue->capacity = rounded;
+    queue->mask = rounded - 1;
+    queue->head = 0;
+    queue->tail = 0;
+    
+    return 0;
+}
+
+static int queue_push(WorkStealingQueue* queue, Task* task) {
+    int tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    int next_tail = (tail + 1) & queue->mask;
+    
+    if (next_tail == __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) {
+        return 0; // Queue full
+    }
+    
+    queue->tasks[tail] = *task;
+    __atomic_store_n(&queue->tail, next_tail, __ATOMIC_RELEASE);
+    
+    return 1;
+}
+
+// Returns 1 with a task, 0 if the queue is empty, -1 if another consumer won the race
+static int queue_steal(WorkStealingQueue* queue, Task* task) {
+    int head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    int tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    
+    if (head == tail) {
+        return 0; // Queue empty
+    }
+    
+    *task = queue->tasks[head];
+    
+    if (!__atomic_compare_exchange_n(&queue->head, &head, (head + 1) & queue->mask,
+                                   false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        return -1; // Failed to steal
+    }
+    
+    return 1;
+}
+
+// Tasks are pushed at the tail by the submitting thread, so the owning
+// worker takes from the head like any other consumer
+static int queue_pop(WorkStealingQueue* queue, Task* task) {
+    return queue_steal(queue, task);
+}
+
+// Global task queue size tracking (improved)
+static _Alignas(CACHE_LINE_SIZE) volatile size_t g_global_task_count = 0;
+
+size_t get_task_queue_size(void) {
+    return __atomic_load_n(&g_global_task_count, __ATOMIC_RELAXED);
+}
+
+// =============================================================================
+// WORKER PARKING AND COMPLETION
+// =============================================================================
+
+// Idle workers and waiters spin briefly to catch back-to-back batches, then block
+#define POOL_SPIN_ITERATIONS 2000
+#define POOL_YIELD_ITERATIONS 16
+
+// High bit of TaskLatch.state: the owner is blocked waiting for zero
+#define TASK_LATCH_WAITING 0x40000000
+
+#if defined(__linux__) && !defined(THREADING_DISABLED)
+#define POOL_USE_FUTEX 1
+
+// Blocks while *word == expected; returns on a wake, a change or a signal
+static void futex_wait_word(volatile int* word, int expected) {
+    syscall(SYS_futex, (int*)word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake_word(volatile int* word) {
+    syscall(SYS_futex, (int*)word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+#endif
+
+typedef struct {
+    ThreadPool* pool;
+    int thread_id;
+} WorkerStart;
+
+// Wakes parked workers after a submission or shutdown; callers hold pool->mutex
+static void pool_signal_work(ThreadPool* pool) {
+    WorkStealingPool* ws_pool = pool->ws_pool;
+    __atomic_fetch_add(&ws_pool->work_epoch, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ws_pool->parked_workers, __ATOMIC_SEQ_CST) > 0) {
+        #ifdef POOL_USE_FUTEX
+        futex_wake_word(&ws_pool->work_epoch);
+        #else
+        pthread_cond_broadcast(&pool->cond);
+        #endif
+    }
+}
+
+// Sleeps until the work epoch moves past the value read before the last queue check
+static void pool_park_worker(ThreadPool* pool, int epoch) {
+    WorkStealingPool* ws_pool = pool->ws_pool;
+    #ifdef POOL_USE_FUTEX
+    futex_wait_word(&ws_pool->work_epoch, epoch);
+    #else
+    pthread_mutex_lock(&pool->mutex);
+    while (__atomic_load_n(&ws_pool->work_epoch, __ATOMIC_SEQ_CST) == epoch) {
+        pthread_cond_wait(&pool->cond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    #endif
+}
+
+// Wakes threads blocked until *word reaches zero
+static void pool_notify_zero(ThreadPool* pool, volatile int* word) {
+    #ifdef POOL_USE_FUTEX
+    (void)pool;
+    futex_wake_word(word);
+    #else
+    (void)word;
+    pthread_mutex_lock(&pool->mutex);
+    pthread_cond_broadcast(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->mutex);
+    #endif
+}
+
+static int spin_until_zero(volatile int* word, int mask) {
+    for (int spin = 0; spin < POOL_SPIN_ITERATIONS; spin++) {
+        if ((__atomic_load_n(word, __ATOMIC_ACQUIRE) & mask) == 0) return 1;
+        cpu_relax();
+    }
+    return 0;
+}
+
+static void latch_count_down(ThreadPool* pool, TaskLatch* latch) {
+    int old = __atomic_fetch_sub(&latch->state, 1, __ATOMIC_ACQ_REL);
+    // The owner may return as soon as the count hits zero, so only the
+    // latch's address is used from here on
+    if (old == (TASK_LATCH_WAITING | 1)) {
+        pool_notify_zero(pool, &latch->state);
+    }
+}
+
+static void run_task(ThreadPool* pool, Task* task) {
+    WorkStealingPool* ws_pool = pool->ws_pool;
+    
+    task->function(task->argument);
+    __atomic_fetch_sub(&g_global_task_count, 1, __ATOMIC_RELAXED);
+    
+    // Retire the task from the pool counts before releasing its latch, so a
+    // latch waiter never sees its own task still counted as queued
+    if (__atomic_sub_fetch(&ws_pool->global_task_count, 1, __ATOMIC_SEQ_CST) == 0 &&
+        __atomic_load_n(&ws_pool->completion_waiters, __ATOMIC_SEQ_CST) > 0) {
+        pool_notify_zero(pool, &ws_pool->global_task_count);
+    }
+    if (task->latch) {
+        latch_count_down(pool, task->latch);
+    }
+}
+
+// Runs a task on a worker, charging the time since idle_since as idle and the task as busy
+static void worker_run_task(ThreadPool* pool, Task* task, uint64_t* idle_since) {
+    uint64_t start = stats_now();
+    run_task(pool, task);
+    uint64_t end = stats_now();
+    
+    stats_add(STAT_WORKER_IDLE_NS, start - *idle_since);
+    stats_add(STAT_WORKER_BUSY_NS, end - start);
+    stats_add(STAT_WORKER_TASKS, 1);
+    *idle_since = end;
+}
+
+static int pool_has_queued_tasks(WorkStealingPool* ws_pool) {
+    for (int i = 0; i < ws_pool->num_threads; i++) {
+        WorkStealingQueue* queue = &ws_pool->queues[i];
+        if (__atomic_load_n(&queue->head, __ATOMIC_SEQ_CST) !=
+            __atomic_load_n(&queue->tail, __ATOMIC_SEQ_CST)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void* worker_thread_stealing(void* arg) {
+    WorkerStart* data = arg;
+    
+    ThreadPool* thread_pool = data->pool;
+    WorkStealingPool* pool = thread_pool->ws_pool;
+    int thread_id = data->thread_id;
+    WorkStealingQueue* my_queue = &pool->queues[thread_id];
+    
+    Task task;
+    int idle_count = 0;
+    stats_mark_worker();
+    uint64_t idle_since = stats_now();
+    
+    while (!__atomic_load_n(&pool->shutdown, __ATOMIC_SEQ_CST)) {
+        // Try to pop from own queue first
+        if (queue_pop(my_queue, &task) > 0) {
+            worker_run_task(thread_pool, &task, &idle_since);
+            idle_count = 0;
+            continue;
+        }
+        
+        // Try to steal from other queues
+        int stolen = 0;
+        for (int i = 1; i < pool->num_threads; i++) {
+            int victim = (thread_id + i) % pool->num_threads;
+            int result = queue_steal(&pool->queues[victim], &task);
+            if (result == 0) continue;
+            
+            stats_add(STAT_STEAL_ATTEMPTS, 1);
+            if (result > 0) {
+                stats_add(STAT_STEALS, 1);
+                worker_run_task(thread_pool, &task, &idle_since);
+                stolen = 1;
+                idle_count = 0;
+                break;
+            }
+        }
+        
+        if (!stolen) {
+            idle_count++;
+            if (idle_count < POOL_SPIN_ITERATIONS) {
+                cpu_relax();
+            } else if (idle_count < POOL_SPIN_ITERATIONS + POOL_YIELD_ITERATIONS) {
+                sched_yield();
+            } else {
+                // Park until the next submission. The epoch is read and the worker
+                // registered before the final queue check, so a task pushed in
+                // between either shows up in the check or changes the epoch.
+                int epoch = __atomic_load_n(&pool->work_epoch, __ATOMIC_SEQ_CST);
+                __atomic_fetch_add(&pool->parked_workers, 1, __ATOMIC_SEQ_CST);
+                if (!pool_has_queued_tasks(pool) &&
+                    !__atomic_load_n(&pool->shutdown, __ATOMIC_SEQ_CST)) {
+                    pool_park_worker(thread_pool, epoch);
+                }
+                __atomic_fetch_sub(&pool->parked_workers, 1, __ATOMIC_SEQ_CST);
+                idle_count = 0;
+            }
+        }
+    }
+    
+    stats_add(STAT_WORKER_IDLE_NS, stats_now() - idle_since);
+    return NULL;
+}
+
+// A capped handle on the shared pool queues and waits on the pool it borrows
+static ThreadPool* pool_with_workers(ThreadPool* pool) {
+    return pool->base ? pool->base : pool;
+}
+
+static void free_ws_pool(WorkStealingPool* ws_pool) {
+    for (int i = 0; i < ws_pool->num_threads; i++) {
+        free(ws_pool->queues[i].tasks);
+    }
+    cache_aligned_free(ws_pool->queues);
+    free(ws_pool->threads);
+    free(ws_pool->thread_data);
+    free(ws_pool);
+}
+
+ThreadPool* thread_pool_create(int num_threads) {
+    detect_cpu_features();
+    
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+    
+    pool->num_threads = get_optimal_threads(num_threads);
+    pool->ref_count = 1;
+    pool->shutdown = false;
+    
+    // Initialize traditional fields for compatibility
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    pthread_cond_init(&pool->idle_cond, NULL);
+    
+    // Create work-stealing pool
+    WorkStealingPool* ws_pool = calloc(1, sizeof(WorkStealingPool));
+    if (!ws_pool) {
+        free(pool);
+        return NULL;
+    }
+    
+    ws_pool->num_threads = pool->num_threads;
+    ws_pool->shutdown = 0;
+    ws_pool->global_task_count = 0;
+    
+    // Create per-thread queues in place
+    ws_pool->queues = cache_aligned_calloc(pool->num_threads, sizeof(WorkStealingQueue));
+    ws_pool->threads = malloc(pool->num_threads * sizeof(pthread_t));
+    ws_pool->thread_data = malloc(pool->num_threads * sizeof(WorkerStart));
+    if (!ws_pool->queues || !ws_pool->threads || !ws_pool->thread_data) {
+        ws_pool->num_threads = 0;
+        free_ws_pool(ws_pool);
+        free(pool);
+        return NULL;
+    }
+    
+    for (int i = 0; i < pool->num_threads; i++) {
+        if (init_queue(&ws_pool->queues[i], 1024) != 0) {
+            // free_ws_pool only frees the queues that were initialized
+            ws_pool->num_threads = i;
+            free_ws_pool(ws_pool);
+            free(pool);
+            return NULL;
+        }
+    }
+    
+    // Start worker threads
+    pool->ws_pool = ws_pool;
+    WorkerStart* thread_data = ws_pool->thread_data;
+    for (int i = 0; i < pool->num_threads; i++) {
+        thread_data[i].pool = pool;
+        thread_data[i].thread_id = i;
+        
+        if (pthread_create(&ws_pool->threads[i], NULL, worker_thread_stealing, &thread_data[i]) != 0) {
+            // Cleanup on failure
+            pthread_mutex_lock(&pool->mutex);
+            __atomic_store_n(&ws_pool->shutdown, 1, __ATOMIC_SEQ_CST);
+            pool_signal_work(pool);
+            pthread_mutex_unlock(&pool->mutex);
+            for (int j = 0; j < i; j++) {
+                pthread_join(ws_pool->threads[j], NULL);
+            }
+            free_ws_pool(ws_pool);
+            free(pool);
+            return NULL;
+        }
+    }
+    
+    return pool;
+}
+
+int thread_pool_add_task_latched(ThreadPool* pool, void (*function)(void*), void* argument,
+                                 TaskLatch* latch) {
+    if (!pool || !function) return -1;
+    pool = pool_with_workers(pool);
+    
+    Task task = {function, argument, NULL, latch};
+    WorkStealingPool* ws_pool = pool->ws_pool;
+    int result = -1;
+    
+    // Round-robin task distribution to minimize contention
+    static _Alignas(CACHE_LINE_SIZE) volatile int next_queue = 0;
+    int queue_id = __atomic_fetch_add(&next_queue, 1, __ATOMIC_RELAXED) % pool->num_threads;
+    
+    // Counted before the push so a fast worker can never take them below zero
+    if (latch) __atomic_fetch_add(&latch->state, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ws_pool->global_task_count, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&g_global_task_count, 1, __ATOMIC_RELAXED);
+    
+    // Queues have a single producer; the lock serializes callers sharing a pool
+    pthread_mutex_lock(&pool->mutex);
+    for (int i = 0; i < pool->num_threads; i++) {
+        int try_queue = (queue_id + i) % pool->num_threads;
+        if (queue_push(&ws_pool->queues[try_queue], &task)) {
+            result = 0;
+            break;
+        }
+    }
+    if (result == 0) {
+        pool_signal_work(pool);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    
+    stats_add(result == 0 ? STAT_TASKS_QUEUED : STAT_TASKS_INLINE, 1);
+    if (result != 0) {
+        // All queues are full: undo the counts, the caller runs the task itself
+        if (latch) __atomic_fetch_sub(&latch->state, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&g_global_task_count, 1, __ATOMIC_RELAXED);
+        if (__atomic_sub_fetch(&ws_pool->global_task_count, 1, __ATOMIC_SEQ_CST) == 0 &&
+            __atomic_load_n(&ws_pool->completion_waiters, __ATOMIC_SEQ_CST) > 0) {
+            pool_notify_zero(pool, &ws_pool->global_task_count);
+        }
+    }
+    
+    return result;
+}
+
+int thread_pool_add_task(ThreadPool* pool, void (*function)(void*), void* argument) {
+    return thread_pool_add_task_latched(pool, function, argument, NULL);
+}
+
+void thread_pool_wait(ThreadPool* pool) {
+    if (!pool) return;
+    pool = pool_with_workers(pool);
+    
+    WorkStealingPool* ws_pool = pool->ws_pool;
+    
+    // Spin first for better responsiveness on small workloads
+    if (spin_until_zero(&ws_pool->global_task_count, ~0)) return;
+    
+    __atomic_fetch_add(&ws_pool->completion_waiters, 1, __ATOMIC_SEQ_CST);
+    #ifdef POOL_USE_FUTEX
+    int value;
+    while ((value = __atomic_load_n(&ws_pool->global_task_count, __ATOMIC_SEQ_CST)) != 0) {
+        futex_wait_word(&ws_pool->global_task_count, value);
+    }
+    #else
+    pthread_mutex_lock(&pool->mutex);
+    while (__atomic_load_n(&ws_pool->global_task_count, __ATOMIC_SEQ_CST) != 0) {
+        pthread_cond_wait(&pool->idle_cond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    #endif
+    __atomic_fetch_sub(&ws_pool->completion_waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+void thread_pool_wait_latch(ThreadPool* pool, TaskLatch* latch) {
+    if (!pool || !latch) return;
+    pool = pool_with_workers(pool);
+    
+    if (spin_until_zero(&latch->state, ~TASK_LATCH_WAITING)) return;
+    
+    #ifdef POOL_USE_FUTEX
+    int state = __atomic_or_fetch(&latch->state, TASK_LATCH_WAITING, __ATOMIC_SEQ_CST);
+    while ((state & ~TASK_LATCH_WAITING) != 0) {
+        futex_wait_word(&latch->state, state);
+        state = __atomic_load_n(&latch->state, __ATOMIC_SEQ_CST);
+    }
+    #else
+    pthread_mutex_lock(&pool->mutex);
+    __atomic_or_fetch(&latch->state, TASK_LATCH_WAITING, __ATOMIC_SEQ_CST);
+    while ((__atomic_load_n(&latch->state, __ATOMIC_SEQ_CST) & ~TASK_LATCH_WAITING) != 0) {
+        pthread_cond_wait(&pool->idle_cond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    #endif
+}
+
+void thread_pool_destroy(ThreadPool* pool) {
+    if (!pool) return;
+    if (pool->base) {
+        thread_pool_release(pool->base);
+        free(pool);
+        return;
+    }
+    
+    // Signal shutdown and wake any parked workers
+    pthread_mutex_lock(&pool->mutex);
+    __atomic_store_n(&pool->ws_pool->shutdown, 1, __ATOMIC_SEQ_CST);
+    pool_signal_work(pool);
+    pthread_mutex_unlock(&pool->mutex);
+    
+    // Wait for all threads to finish
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->ws_pool->threads[i], NULL);
+    }
+    
+    // Cleanup
+    free_ws_pool(pool->ws_pool);
+    
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->cond);
+    pthread_cond_destroy(&pool->idle_cond);
+    
+    free(pool);
+}
+
+int thread_pool_get_thread_count(ThreadPool* pool) {
+    return pool ? pool->num_threads : 0;
+}
+
+size_t thread_pool_get_queue_size(ThreadPool* pool) {
+    if (!pool) return 0;
+    int count = __atomic_load_n(&pool_with_workers(pool)->ws_pool->global_task_count, __ATOMIC_RELAXED);
+    return count > 0 ? (size_t)count : 0;
+}
+
+// =============================================================================
+// CHUNKED PARALLEL LOOPS
+// =============================================================================
+
+typedef struct {
+    RangeTaskFunction body;
+    void* context;
+    int count;
+    int min_chunk;
+    int divisor;         // Chunks are remaining / divisor records
+    volatile int next;   // First unclaimed index
+    volatile int slots;  // Last slot handed to a helper task
+    JsonArena* arena;    // Caller's cJSON arena, entered by helpers too
+} RangeJob;
+
+// Guided self-scheduling: big chunks while there is plenty left, smaller
+// ones near the end so the last workers to arrive still get a share
+static int range_job_claim(RangeJob* job, int* begin, int* end) {
+    int start = __atomic_load_n(&job->next, __ATOMIC_RELAXED);
+    for (;;) {
+        int remaining = job->count - start;
+        if (remaining <= 0) return 0;
+        
+        int chunk = remaining / job->divisor;
+        if (chunk < job->min_chunk) chunk = job->min_chunk;
+        if (chunk > remaining) chunk = remaining;
+        
+        if (__atomic_compare_exchange_n(&job->next, &start, start + chunk, false,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            *begin = start;
+            *end = start + chunk;
+            return 1;
+        }
+    }
+}
+
+static void range_job_run(RangeJob* job, int slot) {
+    int begin, end;
+    while (range_job_claim(job, &begin, &end)) {
+        job->body(job->context, begin, end, slot);
+    }
+}
+
+static void range_job_task(void* arg) {
+    RangeJob* job = (RangeJob*)arg;
+    JsonArena* previous = json_arena_enter(job->arena);
+    range_job_run(job, __atomic_add_fetch(&job->slots, 1, __ATOMIC_RELAXED));
+    json_arena_leave(previous);
+}
+
+int thread_pool_parallel_for(ThreadPool* pool, int count, int min_chunk,
+                             RangeTaskFunction body, void* context) {
+    if (!body || count < 0) return -1;
+    if (count == 0) return 0;
+    if (min_chunk < 1) min_chunk = 1;
+    
+    // One helper task per worker at most, and none that could only find leftovers.
+    // A capped handle's thread count includes the calling thread.
+    int helpers = pool ? (pool->base ? pool->num_threads - 1 : pool->num_threads) : 0;
+    int max_chunks = (count + min_chunk - 1) / min_chunk;
+    if (helpers > max_chunks - 1) helpers = max_chunks - 1;
+    
+    RangeJob job = {body, context, count, min_chunk, 2 * (helpers + 1), 0, 0, json_arena_current()};
+    TaskLatch latch = {0};
+    
+    for (int i = 0; i < helpers; i++) {
+        if (thread_pool_add_task_latched(pool, range_job_task, &job, &latch) != 0) {
+            break; // Queues full: the calling thread covers the rest
+        }
+    }
+    
+    range_job_run(&job, 0);
+    thread_pool_wait_latch(pool, &latch);
+    return 0;
+}
+
+ThreadPool* thread_pool_retain(ThreadPool* pool) {
+    if (pool) {
+        __atomic_fetch_add(&pool->ref_count, 1, __ATOMIC_RELAXED);
+    }
+    return pool;
+}
+
+void thread_pool_release(ThreadPool* pool) {
+    if (pool && __atomic_sub_fetch(&pool->ref_count, 1, __ATOMIC_ACQ_REL) == 0) {
+        thread_pool_destroy(pool);
+    }
+}
+
+// =============================================================================
+// SHARED THREAD POOL
+// =============================================================================
+
+// The shared slot holds one reference; every acquire adds another
+static pthread_mutex_t g_shared_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ThreadPool* g_shared_pool = NULL;
+
+#ifndef THREADING_DISABLED
+static int g_shared_pool_hooks_installed = 0;
+
+// Only the forking thread survives fork(), so the child starts without a pool
+static void shared_pool_after_fork(void) {
+    pthread_mutex_init(&g_shared_pool_mutex, NULL);
+    g_shared_pool = NULL;
+}
+
+// Swaps in a new shared pool; callers hold g_shared_pool_mutex
+static int replace_shared_pool(int num_threads) {
+    ThreadPool* pool = thread_pool_create(num_threads);
+    if (!pool) return -1;
+    
+    if (!g_shared_pool_hooks_installed) {
+        g_shared_pool_hooks_installed = 1;
+        atexit(thread_pool_shutdown_shared);
+        pthread_atfork(NULL, NULL, shared_pool_after_fork);
+    }
+    
+    ThreadPool* old = g_shared_pool;
+    g_shared_pool = pool;
+    thread_pool_release(old);
+    return 0;
+}
+#endif
+
+ThreadPool* thread_pool_acquire_shared(int num_threads) {
+    #ifdef THREADING_DISABLED
+    (void)num_threads;
+    return NULL;
+    #else
+    int wanted = get_optimal_threads(num_threads);
+    
+    pthread_mutex_lock(&g_shared_pool_mutex);
+    if (!g_shared_pool || g_shared_pool->num_threads < wanted) {
+        if (replace_shared_pool(wanted) != 0 && !g_shared_pool) {
+            fprintf(stderr, "Error: Failed to create shared thread pool\n");
+        }
+    }
+    ThreadPool* shared = thread_pool_retain(g_shared_pool);
+    pthread_mutex_unlock(&g_shared_pool_mutex);
+    if (!shared) return NULL;
+    
+    // The shared pool may have grown for an earlier, wider call; the handle
+    // keeps this caller to the threads it asked for
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) return shared;
+    pool->base = shared;
+    pool->num_threads = wanted;
+    pool->ref_count = 1;
+    return pool;
+    #endif
+}
+
+int thread_pool_configure_shared(int num_threads) {
+    #ifdef THREADING_DISABLED
+    (void)num_threads;
+    return -1;
+    #else
+    int wanted = get_optimal_threads(num_threads);
+    int result = wanted;
+    
+    pthread_mutex_lock(&g_shared_pool_mutex);
+    if (!g_shared_pool || g_shared_pool->num_threads != wanted) {
+        if (replace_shared_pool(wanted) != 0) {
+            fprintf(stderr, "Error: Failed to create shared thread pool\n");
+            result = -1;
+        }
+    }
+    pthread_mutex_unlock(&g_shared_pool_mutex);
+    
+    return result;
+    #endif
+}
+
+void thread_pool_shutdown_shared(void) {
+    pthread_mutex_lock(&g_shared_pool_mutex);
+    ThreadPool* old = g_shared_pool;
+    g_shared_pool = NULL;
+    pthread_mutex_unlock(&g_shared_pool_mutex);
+    
+    thread_pool_release(old);
+}
+
+int thread_pool_shared_thread_count(void) {
+    pthread_mutex_lock(&g_shared_pool_mutex);
+    int count = thread_pool_get_thread_count(g_shared_pool);
+    pthread_mutex_unlock(&g_shared_pool_mutex);
+    return count;
+}
+
+// =============================================================================
+// JSON UTILITY FUNCTIONS (OPTIMIZED)
+// =============================================================================
+
+int json_array_view_init(JsonArrayView* view, const cJSON* array) {
+    if (UNLIKELY(!view)) return -1;
+
+    view->items = NULL;
+    view->count = 0;
+    if (!array) return -1;
+
+    int count = 0;
+    for (const cJSON* child = array->child; child; child = child->next) {
+        count++;
+    }
+    if (count == 0) return 0;
+
+    view->items = malloc((size_t)count * sizeof(cJSON*));
+    if (UNLIKELY(!view->items)) return -1;
+
+    cJSON** out = view->items;
+    for (cJSON* child = array->child; child; child = child->next) {
+        *out++ = child;
+    }
+    view->count = count;
+    return 0;
+}
+
+void json_array_view_free(JsonArrayView* view) {
+    if (!view) return;
+
+    free(view->items);
+    view->items = NULL;
+    view->count = 0;
+}
+
+// Links the records under a temporary array for the printers; the returned
+// sibling pointers are restored by json_array_view_unlink
+static cJSON** json_array_view_link(const JsonArrayView* view, cJSON* array) {
+    cJSON** saved = malloc(((size_t)view->count + 1) * 2 * sizeof(cJSON*));
+    if (!saved) return NULL;
+
+    memset(array, 0, sizeof(*array));
+    array->type = cJSON_Array;
+    for (int i = 0; i < view->count; i++) {
+        cJSON* item = view->items[i];
+        saved[2 * i] = item->prev;
+        saved[2 * i + 1] = item->next;
+        item->prev = i > 0 ? view->items[i - 1] : view->items[view->count - 1];
+        item->next = i + 1 < view->count ? view->items[i + 1] : NULL;
+    }
+    array->child = view->count > 0 ? view->items[0] : NULL;
+    return saved;
+}
+
+static void json_array_view_unlink(const JsonArrayView* view, cJSON** saved) {
+    for (int i = 0; i < view->count; i++) {
+        view->items[i]->prev = saved[2 * i];
+        view->items[i]->next = saved[2 * i + 1];
+    }
+    free(saved);
+}
+
+char* json_array_view_print(const JsonArrayView* view, int pretty_print) {
+    if (!view) return NULL;
+
+    cJSON array;
+    cJSON** saved = json_array_view_link(view, &array);
+    if (!saved) return NULL;
+    char* text = cjson_tools_print(&array, pretty_print);
+    json_array_view_unlink(view, saved);
+    return text;
+}
+
+static cJSON* filter_json_recursive(const cJSON* json, int remove_empty_strings, int remove_nulls) {
+    if (UNLIKELY(json == NULL)) return NULL;
+
+    if (cJSON_IsObject(json)) {
+        cJSON* new_obj = cJSON_CreateObject();
+        if (UNLIKELY(!new_obj)) return NULL;
+
+        const cJSON* child = json->child;
+        while (child) {
+            int should_skip = 0;
+
+            if (remove_empty_strings && cJSON_IsString(child) &&
+                child->valuestring && strlen_simd(child->valuestring) == 0) {
+                should_skip = 1;
+            }
+
+            if (remove_nulls && cJSON_IsNull(child)) {
+                should_skip = 1;
+            }
+
+            if (!should_skip) {
+                cJSON* filtered_value = filter_json_recursive(child, remove_empty_strings, remove_nulls);
+                if (filtered_value) {
+                    cJSON_AddItemToObject(new_obj, child->string, filtered_value);
+                }
+            }
+
+            child = child->next;
+        }
+
+        return new_obj;
+    } else if (cJSON_IsArray(json)) {
+        cJSON* new_array = cJSON_CreateArray();
+        if (UNLIKELY(!new_array)) return NULL;
+
+        const cJSON* child = json->child;
+        while (child) {
+            int should_skip = 0;
+
+            if (remove_empty_strings && cJSON_IsString(child) &&
+                child->valuestring && strlen_simd(child->valuestring) == 0) {
+                should_skip = 1;
+            }
+
+            if (remove_nulls && cJSON_IsNull(child)) {
+                should_skip = 1;
+            }
+
+            if (!should_skip) {
+                cJSON* filtered_value = filter_json_recursive(child, remove_empty_strings, remove_nulls);
+                if (filtered_value) {
+                    cJSON_AddItemToArray(new_array, filtered_value);
+                }
+            }
+
+            child = child->next;
+        }
+
+        return new_array;
+    } else {
+        return cJSON_Duplicate(json, 1);
+    }
+}
+
+cJSON* remove_empty_strings(const cJSON* json) {
+    if (UNLIKELY(json == NULL)) return NULL;
+    int outer = stats_transform_begin(1);
+    cJSON* result = filter_json_recursive(json, 1, 0);
+    stats_phase_end(outer);
+    return result;
+}
+
+cJSON* remove_nulls(const cJSON* json) {
+    if (UNLIKELY(json == NULL)) return NULL;
+    int outer = stats_transform_begin(1);
+    cJSON* result = filter_json_recursive(json, 0, 1);
+    stats_phase_end(outer);
+    return result;
+}
+
+// =============================================================================
+// COMPILED PATTERNS (REGEX WITH LITERAL FAST PATHS)
+// =============================================================================
+
+typedef enum {
+    PATTERN_REGEX,
+    PATTERN_CONTAINS,  // Unanchored literal
+    PATTERN_PREFIX,    // ^literal
+    PATTERN_SUFFIX,    // literal$
+    PATTERN_EXACT      // ^literal$
+} PatternKind;
+
+struct CompiledPattern {
+    PatternKind kind;
+    char* literal;
+#ifndef __WINDOWS__
+    regex_t regex;
+#endif
+};
+
+static int is_regex_metachar(char c) {
+    return c != '\0' && strchr(".[]()*+?{}|\\^$", c) != NULL;
+}
+
+// Recognises patterns that are plain literals once anchors, backslash escapes
+// and a trailing ".*" are accounted for, e.g. "^old_", "_id$" or "^a\.b\..*$"
+static int parse_literal_pattern(const char* pattern, char* literal, PatternKind* kind) {
+    const char* start = pattern;
+    const char* end = pattern + strlen_simd(pattern);
+    int anchored_start = 0;
+    int anchored_end = 0;
+
+    if (*start == '^') {
+        anchored_start = 1;
+        start++;
+    }
+
+    // A '$' only anchors when it is not escaped (even number of preceding backslashes)
+    if (end > start && end[-1] == '$') {
+        size_t backslashes = 0;
+        for (const char* p = end - 1; p > start && p[-1] == '\\'; p--) backslashes++;
+        if (backslashes % 2 == 0) {
+            anchored_end = 1;
+            end--;
+        }
+    }
+
+    // A trailing ".*" matches any remainder, so it is the same as no end anchor
+    if (end - start >= 2 && end[-2] == '.' && end[-1] == '*' &&
+        (end - start == 2 || end[-3] != '\\')) {
+        anchored_end = 0;
+        end -= 2;
+    }
+
+    size_t len = 0;
+    for (const char* p = start; p < end; p++) {
+        if (*p == '\\') {
+            if (p + 1 >= end || !is_regex_metachar(p[1])) return 0;
+            p++;
+        } else if (is_regex_metachar(*p)) {
+            return 0;
+        }
+        literal[len++] = *p;
+    }
+    literal[len] = '\0';
+
+    if (anchored_start && anchored_end) {
+        *kind = PATTERN_EXACT;
+    } else if (anchored_start) {
+        *kind = PATTERN_PREFIX;
+    } else if (anchored_end) {
+        *kind = PATTERN_SUFFIX;
+    } else {
+        *kind = PATTERN_CONTAINS;
+    }
+    return 1;
+}
+
+CompiledPattern* cjson_tools_pattern_compile(const char* pattern) {
+    if (UNLIKELY(pattern == NULL)) return NULL;
+
+    CompiledPattern* compiled = calloc(1, sizeof(CompiledPattern));
+    if (!compiled) return NULL;
+
+    compiled->literal = malloc(strlen_simd(pattern) + 1);
+    if (!compiled->literal) {
+        free(compiled);
+        return NULL;
+    }
+
+    if (parse_literal_pattern(pattern, compiled->literal, &compiled->kind)) {
+        return compiled;
+    }
+
+    free(compiled->literal);
+    compiled->literal = NULL;
+    compiled->kind = PATTERN_REGEX;
+
+#ifndef __WINDOWS__
+    if (regcomp(&compiled->regex, pattern, REG_EXTENDED | REG_NOSUB) == 0) {
+        return compiled;
+    }
+#endif
+
+    free(compiled);
+    return NULL;
+}
+
+void cjson_tools_pattern_free(CompiledPattern* pattern) {
+    if (!pattern) return;
+
+#ifndef __WINDOWS__
+    if (pattern->kind == PATTERN_REGEX) {
+        regfree(&pattern->regex);
+    }
+#endif
+
+    free(pattern->literal);
+    free(pattern);
+}
+
+int cjson_tools_pattern_match(const CompiledPattern* pattern, const char* text) {
+    if (UNLIKELY(pattern == NULL || text == NULL)) return 0;
+
+    StringView sv;
+    switch (pattern->kind) {
+        case PATTERN_PREFIX:
+            sv = make_string_view_cstr(text);
+            return string_view_starts_with(&sv, pattern->literal);
+        case PATTERN_SUFFIX:
+            sv = make_string_view_cstr(text);
+            return string_view_ends_with(&sv, pattern->literal);
+        case PATTERN_EXACT:
+            sv = make_string_view_cstr(text);
+            return string_view_equals_cstr(&sv, pattern->literal);
+        case PATTERN_CONTAINS:
+            return strstr(text, pattern->literal) != NULL;
+        case PATTERN_REGEX:
+#ifndef __WINDOWS__
+            return regexec(&pattern->regex, text, 0, NULL, 0) == 0;
+#else
+            return 0;
+#endif
+    }
+    return 0;
+}
+
+static cJSON* replace_keys_recursive(const cJSON* json, const CompiledPattern* pattern, const char* replacement) {
+    if (UNLIKELY(json == NULL)) return NULL;
+
+    if (cJSON_IsObject(json)) {
+        cJSON* new_obj = cJSON_CreateObject();
+        if (UNLIKELY(!new_obj)) return NULL;
+
+        const cJSON* child = json->child;
+        while (child) {
+            const char* key = child->string;
+
+            if (key) {
+                const char* new_key = cjson_tools_pattern_match(pattern, key) ? replacement : key;
+                cJSON* processed_value = replace_keys_recursive(child, pattern, replacement);
+                if (processed_value) {
+                    cJSON_AddItemToObject(new_obj, new_key, processed_value);
+                }
+            }
+
+            child = child->next;
+        }
+
+        return new_obj;
+    } else if (cJSON_IsArray(json)) {
+        cJSON* new_array = cJSON_CreateArray();
+        if (UNLIKELY(!new_array)) return NULL;
+
+        const cJSON* child = json->child;
+        while (child) {
+            cJSON* processed_value = replace_keys_recursive(child, pattern, replacement);
+            if (processed_value) {
+                cJSON_AddItemToArray(new_array, processed_value);
+            }
+            child = child->next;
+        }
+
+        return new_array;
+    } else {
+        return cJSON_Duplicate(json, 1);
+    }
+}
+
+static cJSON* replace_values_recursive(const cJSON* json, const CompiledPattern* pattern, const char* replacement) {
+    if (UNLIKELY(json == NULL)) return NULL;
+
+    if (cJSON_IsObject(json)) {
+        cJSON* new_obj = cJSON_CreateObject();
+        if (UNLIKELY(!new_obj)) return NULL;
+
+        const cJSON* child = json->child;
+        while (child) {
+            const char* key = child->string;
+            cJSON* processed_value = replace_values_recursive(child, pattern, replacement);
+            if (processed_value && key) {
+                cJSON_AddItemToObject(new_obj, key, processed_value);
+            }
+            child = child->next;
+        }
+
+        return new_obj;
+    } else if (cJSON_IsArray(json)) {
+        cJSON* new_array = cJSON_CreateArray();
+        if (UNLIKELY(!new_array)) return NULL;
+
+        const cJSON* child = json->child;
+        while (child) {
+            cJSON* processed_value = replace_values_recursive(child, pattern, replacement);
+            if (processed_value) {
+                cJSON_AddItemToArray(new_array, processed_value);
+            }
+            child = child->next;
+        }
+
+        return new_array;
+    } else if (cJSON_IsString(json)) {
+        const char* string_value = cJSON_GetStringValue(json);
+        if (string_value) {
+            return cJSON_CreateString(cjson_tools_pattern_match(pattern, string_value) ? replacement : string_value);
+        }
+        return cJSON_Duplicate(json, 1);
+    } else {
+        return cJSON_Duplicate(json, 1);
+    }
+}
+
+cJSON* replace_keys_compiled(const cJSON* json, const CompiledPattern* pattern, const char* replacement) {
+    if (UNLIKELY(json == NULL || pattern == NULL || replacement == NULL)) return NULL;
+    int outer = stats_transform_begin(1);
+    cJSON* result = replace_keys_recursive(json, pattern, replacement);
+    stats_phase_end(outer);
+    return result;
+}
+
+cJSON* replace_values_compiled(const cJSON* json, const CompiledPattern* pattern, const char* replacement) {
+    if (UNLIKELY(json == NULL || pattern == NULL || replacement == NULL)) return NULL;
+    int outer = stats_transform_begin(1);
+    cJSON* result = replace_values_recursive(json, pattern, replacement);
+    stats_phase_end(outer);
+    return result;
+}
+
+cJSON* replace_keys(const cJSON* json, const char* pattern, const char* replacement) {
+    if (UNLIKELY(json == NULL || pattern == NULL || replacement == NULL)) return NULL;
+
+    // Patterns that fail to compile leave the document unchanged
+    CompiledPattern* compiled = cjson_tools_pattern_compile(pattern);
+    if (!compiled) return cJSON_Duplicate(json, 1);
+
+    int outer = stats_transform_begin(1);
+    cJSON* result = replace_keys_recursive(json, compiled, replacement);
+    stats_phase_end(outer);
+    cjson_tools_pattern_free(compiled);
+    return result;
+}
+
+cJSON* replace_values(const cJSON* json, const char* pattern, const char* replacement) {
+    if (UNLIKELY(json == NULL || pattern == NULL || replacement == NULL)) return NULL;
+
+    CompiledPattern* compiled = cjson_tools_pattern_compile(pattern);
+    if (!compiled) return cJSON_Duplicate(json, 1);
+
+    int outer = stats_transform_begin(1);
+    cJSON* result = replace_values_recursive(json, compiled, replacement);
+    stats_phase_end(outer);
+    cjson_tools_pattern_free(compiled);
+    return result;
+}
+
+// =============================================================================
+// JSON FLATTENER IMPLEMENTATION (ULTRA-OPTIMIZED)
+// =============================================================================
+
+typedef struct {
+    char* key;
+    cJSON* value;
+} FlattenedPair;
+
+typedef struct {
+    FlattenedPair* pairs;
+    int count;
+    int capacity;
+    char* memory_pool;
+    size_t pool_used;
+    size_t pool_size;
+    int pool_mapped; // Pool came from mmap rather than malloc
+    int is_sorted; // Track if pairs are sorted for binary search
+    int keys_borrowed; // Keys belong to a cached shape, not to this array
+    // Shape-cache scratch, used only by batch flattening
+    char* signature;
+    size_t signature_length;
+    size_t signature_capacity;
+    const struct FlattenShape* last_shape;
+    int shape_misses; // Uncacheable misses; the cache is skipped past FLATTEN_SHAPE_MISS_LIMIT
+} FlattenedArray;
+
+// Optimized pool allocation with different size classes
+static char* pool_alloc(FlattenedArray* array, size_t size) {
+    size = (size + 15) & ~15; // 16-byte alignment
+    
+    if (array->pool_used + size <= array->pool_size) {
+        char* ptr = array->memory_pool + array->pool_used;
+        array->pool_used += size;
+        return ptr;
+    }
+    
+    // Pool exhausted, fall back to regular allocation
+    return malloc(size);
+}
+
+static void init_flattened_array(FlattenedArray* array, int initial_capacity) {
+    int capacity = initial_capacity < INITIAL_ARRAY_CAPACITY ? INITIAL_ARRAY_CAPACITY : initial_capacity;
+    
+    detect_cpu_features();
+    init_global_pools();
+    
+    // Align capacity to cache line for better performance
+    capacity = (capacity + g_cpu.cache_line_size - 1) & ~(g_cpu.cache_line_size - 1);
+    
+    array->pairs = malloc(capacity * sizeof(FlattenedPair));
+    array->count = 0;
+    array->capacity = capacity;
+    array->is_sorted = 1; // Start sorted
+    array->keys_borrowed = 0;
+    array->signature = NULL;
+    array->signature_length = 0;
+    array->signature_capacity = 0;
+    array->last_shape = NULL;
+    array->shape_misses = 0;
+    
+    // Size pool based on expected usage
+    size_t pool_size = MEMORY_POOL_SIZE + (initial_capacity * 128);
+    
+    // Use huge pages if available
+    #ifdef __linux__
+    array->memory_pool = mmap(NULL, pool_size, PROT_READ | PROT_WRITE,
                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
-    if (array->memory_pool == MAP_FAILED) {
+    array->pool_mapped = array->memory_pool != MAP_FAILED;
+    if (!array->pool_mapped) {
         array->memory_pool = malloc(pool_size);
     }
-    #else
-    array->memory_pool = malloc(pool_size);
-    #endif
-    
-    array->pool_used = 0;
-    array->pool_size = pool_size;
+    #else
+    array->memory_pool = malloc(pool_size);
+    array->pool_mapped = 0;
+    #endif
+    
+    array->pool_used = 0;
+    array->pool_size = pool_size;
+}
+
+// Ultra-fast key building with SIMD-optimized operations
+static inline void build_key_optimized(char* restrict buffer, size_t buffer_size,
+                                     const char* restrict prefix, const char* restrict suffix,
+                                     int is_array_index, int index) {
+    if (UNLIKELY(!buffer || buffer_size == 0)) return;
+    
+    if (!prefix || *prefix == '\0') {
+        if (is_array_index) {
+            snprintf(buffer, buffer_size, "[%d]", index);
+        } else if (suffix) {
+            size_t suffix_len = strlen_simd(suffix);
+            if (suffix_len + 1 < buffer_size) {
+                fast_memcpy(buffer, suffix, suffix_len);
+                buffer[suffix_len] = '\0';
+            } else {
+                strncpy(buffer, suffix, buffer_size - 1);
+                buffer[buffer_size - 1] = '\0';
+            }
+        } else {
+            buffer[0] = '\0';
+        }
+        return;
+    }
+    
+    size_t prefix_len = strlen_simd(prefix);
+    
+    if (is_array_index) {
+        if (prefix_len == 0) {
+            snprintf(buffer, buffer_size, "[%d]", index);
+        } else {
+            snprintf(buffer, buffer_size, "%.*s[%d]", (int)prefix_len, prefix, index);
+        }
+    } else if (suffix) {
+        size_t suffix_len = strlen_simd(suffix);
+        if (prefix_len == 0) {
+            if (suffix_len + 1 < buffer_size) {
+                fast_memcpy(buffer, suffix, suffix_len);
+                buffer[suffix_len] = '\0';
+            } else {
+                strncpy(buffer, suffix, buffer_size - 1);
+                buffer[buffer_size - 1] = '\0';
+            }
+        } else {
+            // Optimized concatenation
+            if (prefix_len + suffix_len + 2 < buffer_size) {
+                fast_memcpy(buffer, prefix, prefix_len);
+                buffer[prefix_len] = '.';
+                fast_memcpy(buffer + prefix_len + 1, suffix, suffix_len);
+                buffer[prefix_len + suffix_len + 1] = '\0';
+            } else {
+                snprintf(buffer, buffer_size, "%.*s.%.*s", 
+                        (int)prefix_len, prefix, (int)suffix_len, suffix);
+            }
+        }
+    } else {
+        if (prefix_len + 1 < buffer_size) {
+            fast_memcpy(buffer, prefix, prefix_len);
+            buffer[prefix_len] = '\0';
+        } else {
+            strncpy(buffer, prefix, buffer_size - 1);
+            buffer[buffer_size - 1] = '\0';
+        }
+    }
+}
+
+static char* pool_strdup(FlattenedArray* array, const char* str) {
+    if (UNLIKELY(!str)) return NULL;
+    
+    size_t len = strlen_simd(str) + 1;
+    char* new_str;
+    
+    // Use pool for small strings
+    if (LIKELY(len <= 256)) {
+        new_str = pool_alloc(array, len);
+        if (LIKELY(new_str != NULL)) {
+            fast_memcpy(new_str, str, len);
+            return new_str;
+        }
+    }
+    
+    // Fallback to slab allocator
+    if (g_cjson_node_pool && len <= 256) {
+        new_str = slab_alloc(g_cjson_node_pool);
+        if (new_str) {
+            fast_memcpy(new_str, str, len);
+            return new_str;
+        }
+    }
+    
+    return my_strdup(str);
+}
+
+// Hot path function with aggressive optimization
+HOT_PATH void add_pair(FlattenedArray* array, const char* key, cJSON* value) {
+    if (UNLIKELY(array->count >= array->capacity)) {
+        int new_capacity = array->capacity << 1;
+        FlattenedPair* new_pairs = realloc(array->pairs, new_capacity * sizeof(FlattenedPair));
+        if (UNLIKELY(!new_pairs)) {
+            return;
+        }
+        array->pairs = new_pairs;
+        array->capacity = new_capacity;
+        
+        // Prefetch next cache lines
+        PREFETCH_WRITE(&array->pairs[array->count]);
+        PREFETCH_WRITE(&array->pairs[array->count + g_cpu.cache_line_size / sizeof(FlattenedPair)]);
+    }
+    
+    FlattenedPair* pair = &array->pairs[array->count];
+    pair->key = pool_strdup(array, key);
+    pair->value = value;
+    array->count++;
+    
+    // Check if still sorted (for optimization)
+    if (array->is_sorted && array->count > 1) {
+        if (strcmp(array->pairs[array->count - 2].key, pair->key) > 0) {
+            array->is_sorted = 0;
+        }
+    }
+    
+    // Prefetch next pair location
+    if (LIKELY(array->count < array->capacity)) {
+        PREFETCH_WRITE(&array->pairs[array->count]);
+    }
+}
+
+// Frees keys that aren't in the pool
+static void release_pair_keys(FlattenedArray* array) {
+    if (array->keys_borrowed) {
+        array->keys_borrowed = 0;
+        return;
+    }
+    for (int i = 0; i < array->count; i++) {
+        char* key = array->pairs[i].key;
+        if (key && (key < array->memory_pool || key >= array->memory_pool + array->pool_size)) {
+            my_strfree(key);
+        }
+    }
+}
+
+static void free_flattened_array(FlattenedArray* array) {
+    release_pair_keys(array);
+    
+    free(array->pairs);
+    free(array->signature);
+    
+    #ifdef __linux__
+    if (array->pool_mapped) {
+        munmap(array->memory_pool, array->pool_size);
+    } else {
+        free(array->memory_pool);
+    }
+    #else
+    free(array->memory_pool);
+    #endif
+    
+    memset(array, 0, sizeof(*array));
+}
+
+// Empties the array for the next record, keeping its pair storage and pool
+static void reset_flattened_array(FlattenedArray* array) {
+    release_pair_keys(array);
+    
+    array->count = 0;
+    array->pool_used = 0;
+    array->is_sorted = 1;
+}
+
+// Recursive flattening with tail-call optimization simulation
+static void flatten_json_recursive(cJSON* json, const char* prefix, FlattenedArray* result) {
+    if (UNLIKELY(!json)) return;
+    
+    char key_buffer[MAX_KEY_LENGTH];
+    
+    // Handle different JSON types with optimized dispatch
+    switch (json->type & 0xFF) {
+        case cJSON_Object: {
+            cJSON* child = json->child;
+            while (child) {
+                build_key_optimized(key_buffer, sizeof(key_buffer), prefix, child->string, 0, 0);
+                
+                // Tail recursion optimization for single child
+                if (!child->next && (child->type == cJSON_Object || child->type == cJSON_Array)) {
+                    json = child;
+                    prefix = my_strdup(key_buffer); // TODO: optimize this allocation
+                    goto tail_recurse;
+                }
+                
+                flatten_json_recursive(child, key_buffer, result);
+                child = child->next;
+            }
+            break;
+        }
+        
+        case cJSON_Array: {
+            cJSON* child = json->child;
+            int i = 0;
+            while (child) {
+                build_key_optimized(key_buffer, sizeof(key_buffer), prefix, NULL, 1, i);
+                
+                // Tail recursion optimization for single child
+                if (!child->next && (child->type == cJSON_Object || child->type == cJSON_Array)) {
+                    json = child;
+                    prefix = my_strdup(key_buffer); // TODO: optimize this allocation
+                    goto tail_recurse;
+                }
+                
+                flatten_json_recursive(child, key_buffer, result);
+                child = child->next;
+                i++;
+            }
+            break;
+        }
+        
+        default:
+            add_pair(result, prefix, json);
+            return;
+    }
+    
+    return;
+    
+tail_recurse:
+    // Simulate tail recursion
+    flatten_json_recursive(json, prefix, result);
+    free((char*)prefix);
+}
+
+// Highly optimized JSON creation with pre-calculated sizes. With const_keys,
+// borrowed shape keys are linked in place (cJSON_StringIsConst) instead of copied.
+static cJSON* create_flattened_json(FlattenedArray* flattened_array, int const_keys) {
+    cJSON* result = cJSON_CreateObject();
+    if (UNLIKELY(!result)) return NULL;
+    
+    // Sort pairs if not sorted for better cache locality during iteration
+    if (!flattened_array->is_sorted && flattened_array->count > 16) {
+        // Quick sort implementation would go here
+        // For now, keeping simple
+    }
+    
+    // Pre-allocate hashtable space if cJSON supported it
+    // This would significantly improve performance for large objects
+    
+    const_keys = const_keys && flattened_array->keys_borrowed;
+    
+    for (int i = 0; i < flattened_array->count; i++) {
+        FlattenedPair* pair = &flattened_array->pairs[i];
+        cJSON* item = NULL;
+        
+        // Optimized value creation based on type
+        switch (pair->value->type & 0xFF) {
+            case cJSON_False:
+                item = cJSON_CreateFalse();
+                break;
+            case cJSON_True:
+                item = cJSON_CreateTrue();
+                break;
+            case cJSON_NULL:
+                item = cJSON_CreateNull();
+                break;
+            case cJSON_Number:
+                // Optimize integer vs float detection
+                if (pair->value->valuedouble == (double)pair->value->valueint &&
+                    pair->value->valuedouble >= INT_MIN && pair->value->valuedouble <= INT_MAX) {
+                    item = cJSON_CreateNumber(pair->value->valueint);
+                } else {
+                    item = cJSON_CreateNumber(pair->value->valuedouble);
+                }
+                break;
+            case cJSON_String:
+                item = cJSON_CreateString(pair->value->valuestring);
+                break;
+            default:
+                break;
+        }
+        
+        if (item) {
+            cJSON_bool added = const_keys ? cJSON_AddItemToObjectCS(result, pair->key, item)
+                                          : cJSON_AddItemToObject(result, pair->key, item);
+            if (!added) cJSON_Delete(item);
+        }
+        
+        // Prefetch next pair for better cache utilization
+        if (i + 1 < flattened_array->count) {
+            PREFETCH_READ(&flattened_array->pairs[i + 1]);
+        }
+    }
+    
+    return result;
+}
+
+// Estimate initial capacity based on object complexity
+static int estimate_flattened_capacity(const cJSON* json) {
+    int estimated_capacity = INITIAL_ARRAY_CAPACITY;
+    if (json->type == cJSON_Object) {
+        // Count immediate children for better estimation
+        int child_count = 0;
+        const cJSON* child = json->child;
+        while (child && child_count < 100) { // Limit counting for performance
+            child_count++;
+            child = child->next;
+        }
+        estimated_capacity = child_count * 4; // Assume average nesting of 4
+    }
+    return estimated_capacity;
+}
+
+// =============================================================================
+// FLATTENED SHAPE CACHE
+// =============================================================================
+
+// A record's shape is its structure and keys with the values left out, encoded
+// in preorder as 'O'/'A' ... 'E' for containers, 'K' key '\0' (or 'N' for a
+// missing key) before each object member and 'L' for every leaf. Records with
+// the same signature flatten to the same keys in the same order.
+typedef struct FlattenShape {
+    uint32_t hash;
+    int leaf_count;
+    size_t signature_length;
+    const char* signature;
+    char** keys;       // Flattened key of each leaf; the shape owns them
+} FlattenShape;
+
+// Insert-only open-addressing table: lookups never lock, and a published
+// shape is immutable until the cache is freed
+struct FlattenShapeCache {
+    FlattenShape* volatile* slots;
+    int mask;
+    int max_shapes;
+    volatile int count;
+};
+
+static uint32_t shape_signature_hash(const char* data, size_t length) {
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0x100000001B3ULL;
+        hash ^= hash >> 29;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001B3ULL;
+    }
+    hash ^= hash >> 32;
+    return (uint32_t)hash;
+}
+
+static int shape_signature_append(FlattenedArray* scratch, const char* data, size_t length) {
+    if (UNLIKELY(scratch->signature_length + length > scratch->signature_capacity)) {
+        size_t capacity = scratch->signature_capacity ? scratch->signature_capacity * 2 : 1024;
+        while (capacity < scratch->signature_length + length) capacity *= 2;
+        char* grown = realloc(scratch->signature, capacity);
+        if (!grown) return -1;
+        scratch->signature = grown;
+        scratch->signature_capacity = capacity;
+    }
+    memcpy(scratch->signature + scratch->signature_length, data, length);
+    scratch->signature_length += length;
+    return 0;
+}
+
+static int push_leaf_value(FlattenedArray* scratch, cJSON* value) {
+    if (UNLIKELY(scratch->count >= scratch->capacity)) {
+        int new_capacity = scratch->capacity << 1;
+        FlattenedPair* new_pairs = realloc(scratch->pairs, new_capacity * sizeof(FlattenedPair));
+        if (!new_pairs) return -1;
+        scratch->pairs = new_pairs;
+        scratch->capacity = new_capacity;
+    }
+    scratch->pairs[scratch->count].key = NULL;
+    scratch->pairs[scratch->count].value = value;
+    scratch->count++;
+    return 0;
+}
+
+// Encodes json's shape into the scratch signature and collects its leaves, in
+// the order flatten_json_recursive visits them
+static int shape_signature_walk(FlattenedArray* scratch, cJSON* json) {
+    int type = json->type & 0xFF;
+    if (type != cJSON_Object && type != cJSON_Array) {
+        return shape_signature_append(scratch, "L", 1) == 0 ? push_leaf_value(scratch, json) : -1;
+    }
+    
+    if (shape_signature_append(scratch, type == cJSON_Object ? "O" : "A", 1) != 0) return -1;
+    for (cJSON* child = json->child; child; child = child->next) {
+        if (type == cJSON_Object) {
+            int failed = child->string ?
+                shape_signature_append(scratch, "K", 1) != 0 ||
+                shape_signature_append(scratch, child->string, strlen(child->string) + 1) != 0 :
+                shape_signature_append(scratch, "N", 1) != 0;
+            if (failed) return -1;
+        }
+        if (shape_signature_walk(scratch, child) != 0) return -1;
+    }
+    return shape_signature_append(scratch, "E", 1);
+}
+
+static ALWAYS_INLINE int shape_matches(const FlattenShape* shape, uint32_t hash,
+                                       const char* signature, size_t length) {
+    return shape->hash == hash && shape->signature_length == length &&
+           memcmp(shape->signature, signature, length) == 0;
+}
+
+static const FlattenShape* shape_cache_find(const FlattenShapeCache* cache, uint32_t hash,
+                                            const char* signature, size_t length) {
+    for (int i = (int)(hash & cache->mask);; i = (i + 1) & cache->mask) {
+        const FlattenShape* shape = __atomic_load_n(&cache->slots[i], __ATOMIC_ACQUIRE);
+        if (!shape) return NULL;
+        if (shape_matches(shape, hash, signature, length)) return shape;
+    }
+}
+
+// Snapshots the scratch's signature and freshly built keys as one allocation
+static FlattenShape* shape_create(const FlattenedArray* scratch, uint32_t hash) {
+    size_t key_bytes = 0;
+    for (int i = 0; i < scratch->count; i++) {
+        if (!scratch->pairs[i].key) return NULL;
+        key_bytes += strlen(scratch->pairs[i].key) + 1;
+    }
+    
+    size_t keys_offset = (sizeof(FlattenShape) + 15) & ~(size_t)15;
+    size_t signature_offset = keys_offset + scratch->count * sizeof(char*);
+    FlattenShape* shape = malloc(signature_offset + scratch->signature_length + key_bytes);
+    if (!shape) return NULL;
+    
+    char* base = (char*)shape;
+    shape->hash = hash;
+    shape->leaf_count = scratch->count;
+    shape->signature_length = scratch->signature_length;
+    shape->keys = (char**)(base + keys_offset);
+    memcpy(base + signature_offset, scratch->signature, scratch->signature_length);
+    shape->signature = base + signature_offset;
+    
+    char* next_key = base + signature_offset + scratch->signature_length;
+    for (int i = 0; i < scratch->count; i++) {
+        size_t length = strlen(scratch->pairs[i].key) + 1;
+        memcpy(next_key, scratch->pairs[i].key, length);
+        shape->keys[i] = next_key;
+        next_key += length;
+    }
+    return shape;
+}
+
+// Publishes shape, or returns the equal shape another thread published first
+// (shape is then freed); NULL once the cache is full
+static const FlattenShape* shape_cache_insert(FlattenShapeCache* cache, FlattenShape* shape) {
+    if (__atomic_add_fetch(&cache->count, 1, __ATOMIC_RELAXED) > cache->max_shapes) {
+        __atomic_sub_fetch(&cache->count, 1, __ATOMIC_RELAXED);
+        free(shape);
+        return NULL;
+    }
+    
+    for (int i = (int)(shape->hash & cache->mask);; i = (i + 1) & cache->mask) {
+        FlattenShape* expected = NULL;
+        if (__atomic_compare_exchange_n(&cache->slots[i], &expected, shape, false,
+                                       __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            return shape;
+        }
+        if (shape_matches(expected, shape->hash, shape->signature, shape->signature_length)) {
+            __atomic_sub_fetch(&cache->count, 1, __ATOMIC_RELAXED);
+            free(shape);
+            return expected;
+        }
+    }
+}
+
+static void borrow_shape_keys(FlattenedArray* scratch, const FlattenShape* shape) {
+    release_pair_keys(scratch);
+    for (int i = 0; i < shape->leaf_count; i++) {
+        scratch->pairs[i].key = shape->keys[i];
+    }
+    scratch->keys_borrowed = 1;
+    scratch->last_shape = shape;
+}
+
+// Fills scratch from a cached shape; on a miss flattens normally and caches the
+// new shape. Returns -1 when the caller should flatten without the cache.
+static int flatten_with_shape_cache(FlattenedArray* scratch, cJSON* json, FlattenShapeCache* cache) {
+    scratch->signature_length = 0;
+    if (shape_signature_walk(scratch, json) != 0) {
+        reset_flattened_array(scratch);
+        return -1;
+    }
+    
+    uint32_t hash = shape_signature_hash(scratch->signature, scratch->signature_length);
+    const FlattenShape* shape = scratch->last_shape;
+    if (!shape || !shape_matches(shape, hash, scratch->signature, scratch->signature_length)) {
+        shape = shape_cache_find(cache, hash, scratch->signature, scratch->signature_length);
+    }
+    if (LIKELY(shape != NULL)) {
+        borrow_shape_keys(scratch, shape);
+        return 0;
+    }
+    
+    // New shape: build its keys once, then keep them for every later record
+    int leaf_count = scratch->count;
+    reset_flattened_array(scratch);
+    flatten_json_recursive(json, "", scratch);
+    
+    FlattenShape* created = scratch->count == leaf_count ? shape_create(scratch, hash) : NULL;
+    const FlattenShape* published = created ? shape_cache_insert(cache, created) : NULL;
+    if (published) {
+        borrow_shape_keys(scratch, published);
+    } else {
+        scratch->shape_misses++;
+    }
+    return 0;
+}
+
+FlattenShapeCache* flatten_shape_cache_create(int max_shapes) {
+    if (max_shapes <= 0) max_shapes = FLATTEN_SHAPE_CACHE_SIZE;
+    
+    FlattenShapeCache* cache = calloc(1, sizeof(FlattenShapeCache));
+    if (!cache) return NULL;
+    
+    // At most half full, so probes stay short and always reach an empty slot
+    int capacity = 16;
+    while (capacity < 2 * max_shapes) capacity <<= 1;
+    cache->slots = calloc(capacity, sizeof(FlattenShape*));
+    if (!cache->slots) {
+        free(cache);
+        return NULL;
+    }
+    cache->mask = capacity - 1;
+    cache->max_shapes = max_shapes;
+    return cache;
+}
+
+int flatten_shape_cache_count(const FlattenShapeCache* cache) {
+    return cache ? __atomic_load_n(&cache->count, __ATOMIC_RELAXED) : 0;
+}
+
+void flatten_shape_cache_free(FlattenShapeCache* cache) {
+    if (!cache) return;
+    for (int i = 0; i <= cache->mask; i++) {
+        free(cache->slots[i]);
+    }
+    free((void*)cache->slots);
+    free(cache);
+}
+
+// Flattens one record into per-thread scratch that is reused across a batch,
+// taking keys from the shape cache when one is given
+static void flatten_into_scratch(FlattenedArray* scratch, const cJSON* json, FlattenShapeCache* cache) {
+    if (!scratch->pairs) {
+        init_flattened_array(scratch, estimate_flattened_capacity(json));
+    } else {
+        reset_flattened_array(scratch);
+    }
+    if (cache && scratch->shape_misses < FLATTEN_SHAPE_MISS_LIMIT &&
+        flatten_with_shape_cache(scratch, (cJSON*)json, cache) == 0) {
+        return;
+    }
+    flatten_json_recursive((cJSON*)json, "", scratch);
+}
+
+static void free_flattened_scratch(FlattenedArray* scratch, int slots) {
+    if (!scratch) return;
+    for (int i = 0; i < slots; i++) {
+        if (scratch[i].pairs) free_flattened_array(&scratch[i]);
+    }
+    free(scratch);
+}
+
+static cJSON* flatten_single_object(cJSON* json) {
+    if (UNLIKELY(!json)) return NULL;
+    
+    FlattenedArray flattened_array;
+    init_flattened_array(&flattened_array, estimate_flattened_capacity(json));
+    
+    flatten_json_recursive(json, "", &flattened_array);
+    
+    cJSON* flattened_json = create_flattened_json(&flattened_array, 0);
+    free_flattened_array(&flattened_array);
+    
+    return flattened_json;
+}
+
+cJSON* flatten_json_object(cJSON* json) {
+    int outer = stats_transform_begin(1);
+    cJSON* result = flatten_single_object(json);
+    stats_phase_end(outer);
+    return result;
+}
+
+// Enhanced heuristics for threading decision
+static int should_thread_batch(const cJSON* json_array, int array_size, int use_threads, int num_threads) {
+    int should_use_threads = use_threads && 
+                            array_size >= MIN_BATCH_SIZE_FOR_MT && 
+                            get_optimal_threads(num_threads) > 1;
+    
+    // Additional check: estimate work complexity
+    if (should_use_threads && array_size < 1000) {
+        // Sample first few objects to estimate complexity
+        int complex_objects = 0;
+        const cJSON* item = json_array->child;
+        for (int i = 0; item && i < 10; i++, item = item->next) {
+            if (item->type == cJSON_Object) {
+                int child_count = 0;
+                cJSON* child = item->child;
+                while (child && child_count < 20) {
+                    child_count++;
+                    child = child->next;
+                }
+                if (child_count > 5) complex_objects++;
+            }
+        }
+        
+        // Only use threading if objects are complex enough
+        if (complex_objects < 3) {
+            should_use_threads = 0;
+        }
+    }
+    return should_use_threads;
+}
+
+// Borrows the shared pool for a batch when threading is requested and worthwhile;
+// release the result with thread_pool_release (NULL means run inline)
+static ThreadPool* acquire_batch_pool(const cJSON* json_array, int array_size,
+                                      int use_threads, int num_threads) {
+    return should_thread_batch(json_array, array_size, use_threads, num_threads) ?
+        thread_pool_acquire_shared(num_threads) : NULL;
+}
+
+// A caller-owned pool is only worth the hand-off for batches big enough to split
+static ThreadPool* usable_batch_pool(ThreadPool* pool, int array_size) {
+    return pool && array_size >= MIN_BATCH_SIZE_FOR_MT &&
+           thread_pool_get_thread_count(pool) > 1 ? pool : NULL;
+}
+
+typedef struct {
+    const JsonArrayView* view;
+    cJSON** results;
+    FlattenedArray* scratch;  // One per pool slot
+    FlattenShapeCache* cache;
+    int const_keys;           // Results may point at the cache's keys
+} FlattenBatchJob;
+
+static void flatten_batch_range(void* context, int begin, int end, int slot) {
+    FlattenBatchJob* job = (FlattenBatchJob*)context;
+    FlattenedArray* scratch = &job->scratch[slot];
+    
+    for (int i = begin; i < end; i++) {
+        // Prefetch next item
+        if (i + 1 < end) {
+            PREFETCH_READ(job->view->items[i + 1]);
+        }
+        flatten_into_scratch(scratch, job->view->items[i], job->cache);
+        job->results[i] = create_flattened_json(scratch, job->const_keys);
+    }
+}
+
+// Without a caller's cache, a per-batch one supplies the keys and the results copy them
+static cJSON* flatten_batch_view(const JsonArrayView* view, ThreadPool* pool, FlattenShapeCache* cache) {
+    int array_size = view->count;
+    
+    cJSON* result = cJSON_CreateArray();
+    if (!result || array_size == 0) {
+        return result;
+    }
+    
+    int slots = thread_pool_get_thread_count(pool) + 1;
+    FlattenBatchJob job = {
+        view,
+        calloc(array_size, sizeof(cJSON*)),
+        calloc(slots, sizeof(FlattenedArray)),
+        cache ? cache : flatten_shape_cache_create(0),
+        cache != NULL
+    };
+    if (!job.results || !job.scratch) {
+        free(job.results);
+        free(job.scratch);
+        if (!cache) flatten_shape_cache_free(job.cache);
+        cJSON_Delete(result);
+        return NULL;
+    }
+    
+    // Chunks of records per task; without a pool this is a plain loop
+    int outer = stats_transform_begin((uint64_t)array_size);
+    thread_pool_parallel_for(pool, array_size, MIN_RECORDS_PER_CHUNK, flatten_batch_range, &job);
+    
+    // Collect results in order
+    for (int i = 0; i < array_size; i++) {
+        if (job.results[i]) {
+            cJSON_AddItemToArray(result, job.results[i]);
+        }
+    }
+    stats_phase_end(outer);
+    
+    free(job.results);
+    free_flattened_scratch(job.scratch, slots);
+    if (!cache) flatten_shape_cache_free(job.cache);
+    return result;
+}
+
+cJSON* flatten_json_batch(cJSON* json_array, int use_threads, int num_threads) {
+    if (!json_array || json_array->type != cJSON_Array) {
+        return NULL;
+    }
+    
+    JsonArrayView view;
+    if (json_array_view_init(&view, json_array) != 0) {
+        return NULL;
+    }
+    
+    ThreadPool* pool = acquire_batch_pool(json_array, view.count, use_threads, num_threads);
+    cJSON* result = flatten_batch_view(&view, pool, NULL);
+    thread_pool_release(pool);
+    
+    json_array_view_free(&view);
+    return result;
+}
+
+cJSON* flatten_json_batch_with_pool(const cJSON* json_array, ThreadPool* pool) {
+    if (!json_array || json_array->type != cJSON_Array) {
+        return NULL;
+    }
+    
+    JsonArrayView view;
+    if (json_array_view_init(&view, json_array) != 0) {
+        return NULL;
+    }
+    
+    cJSON* result = flatten_batch_view(&view, usable_batch_pool(pool, view.count), NULL);
+    
+    json_array_view_free(&view);
+    return result;
+}
+
+cJSON* flatten_json_batch_with_cache(const cJSON* json_array, ThreadPool* pool, FlattenShapeCache* cache) {
+    if (!json_array || json_array->type != cJSON_Array || !cache) {
+        return NULL;
+    }
+    
+    JsonArrayView view;
+    if (json_array_view_init(&view, json_array) != 0) {
+        return NULL;
+    }
+    
+    cJSON* result = flatten_batch_view(&view, usable_batch_pool(pool, view.count), cache);
+    
+    json_array_view_free(&view);
+    return result;
+}
+
+// =============================================================================
+// JSON UNFLATTENER
+// =============================================================================
+
+// The reverse of flattening: keys such as "user.tags[1]" are split into member
+// names and [i] indexes and rebuilt into nested objects and arrays. Each record
+// is first laid out as a trie of path segments, with a hash index over
+// (parent, segment) so any prefix resolves in O(1). Since flattened keys come
+// in document order, a key usually shares its leading segments with the
+// previous key, and those are taken from the previous key's path without even
+// hashing. Arrays are then built from slot tables sized by their highest index.
+
+#define UNFLATTEN_MAX_INDEX 1048575  // Larger [i] parts are read as part of a member name
+
+enum {
+    UNFLATTEN_UNSET = -1,
+    UNFLATTEN_VALUE,
+    UNFLATTEN_OBJECT,
+    UNFLATTEN_ARRAY
+};
+
+typedef struct {
+    int start;   // Offset of the segment in its key
+    int length;
+    int index;   // Array position, or -1 for a member name
+} UnflattenSegment;
+
+typedef struct {
+    int parent;
+    int kind;
+    const char* name;     // Member name inside its key (not NUL-terminated)
+    int name_length;
+    int index;            // Array position, or -1 for object members
+    uint32_t hash;
+    const cJSON* value;   // For UNFLATTEN_VALUE
+    int first_child;      // Children in key order
+    int last_child;
+    int next_sibling;
+    int length;           // Arrays: highest index + 1
+} UnflattenNode;
+
+// Per-thread working memory, reused across records
+typedef struct {
+    UnflattenNode* nodes;
+    int node_count;
+    int node_capacity;
+    int* table;                       // Node index + 1 per slot, 0 when empty
+    int table_size;                   // Power of two
+    UnflattenSegment* segments;       // Current key
+    UnflattenSegment* previous;       // Previous key, with its nodes in path
+    int* path;
+    int segment_capacity;
+    int previous_count;
+    const char* previous_key;
+    size_t previous_length;
+    char* name_buffer;                // NUL-terminated member names for cJSON
+    size_t name_capacity;
+} UnflattenScratch;
+
+static void unflatten_scratch_free(UnflattenScratch* scratch) {
+    free(scratch->nodes);
+    free(scratch->table);
+    free(scratch->segments);
+    free(scratch->previous);
+    free(scratch->path);
+    free(scratch->name_buffer);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+// Position after a "[digits]" part starting at p, or 0 if there is none
+static size_t unflatten_index_end(const char* key, size_t p, size_t length, int* index) {
+    size_t q = p + 1;
+    long value = 0;
+    while (q < length && key[q] >= '0' && key[q] <= '9' && value <= UNFLATTEN_MAX_INDEX) {
+        value = value * 10 + (key[q] - '0');
+        q++;
+    }
+    if (q == p + 1 || q >= length || key[q] != ']' || value > UNFLATTEN_MAX_INDEX) return 0;
+    *index = (int)value;
+    return q + 1;
+}
+
+// Splits a key into segments the way build_key_optimized joins them: names
+// after '.', [i] indexes, and a leading [i] for a top-level array. Returns the
+// segment count, or -1 if the key nests deeper than cJSON's nesting limit.
+static int unflatten_parse_key(UnflattenScratch* scratch, const char* key, size_t length) {
+    int count = 0;
+    size_t p = 0;
+    int after_dot = 0;
+
+    while (p < length || after_dot) {
+        if (count >= CJSON_NESTING_LIMIT) return -1;
+        if (count == scratch->segment_capacity) {
+            int capacity = scratch->segment_capacity ? scratch->segment_capacity * 2 : 16;
+            UnflattenSegment* segments = realloc(scratch->segments, (size_t)capacity * sizeof(UnflattenSegment));
+            if (segments) scratch->segments = segments;
+            UnflattenSegment* previous = realloc(scratch->previous, (size_t)capacity * sizeof(UnflattenSegment));
+            if (previous) scratch->previous = previous;
+            int* path = realloc(scratch->path, (size_t)capacity * sizeof(int));
+            if (path) scratch->path = path;
+            if (!segments || !previous || !path) return -1;
+            scratch->segment_capacity = capacity;
+        }
+
+        UnflattenSegment* segment = &scratch->segments[count++];
+        int index;
+        size_t end;
+        if (!after_dot && key[p] == '[' && (end = unflatten_index_end(key, p, length, &index)) > 0) {
+            segment->start = (int)p + 1;
+            segment->length = (int)(end - p - 2);
+            segment->index = index;
+            p = end;
+        } else {
+            // A name runs to the next '.' or [i]; right after a '.' even a
+            // bracket belongs to it
+            size_t q = p;
+            while (q < length && key[q] != '.' &&
+                   !(key[q] == '[' && q > p && unflatten_index_end(key, q, length, &index) > 0)) {
+                q++;
+            }
+            segment->start = (int)p;
+            segment->length = (int)(q - p);
+            segment->index = -1;
+            p = q;
+        }
+
+        after_dot = p < length && key[p] == '.';
+        if (after_dot) p++;
+    }
+    return count;
+}
+
+static int unflatten_grow_table(UnflattenScratch* scratch) {
+    int size = scratch->table_size ? scratch->table_size * 2 : 64;
+    int* table = calloc((size_t)size, sizeof(int));
+    if (!table) return -1;
+
+    for (int i = 1; i < scratch->node_count; i++) {
+        int slot = (int)(scratch->nodes[i].hash & (uint32_t)(size - 1));
+        while (table[slot]) slot = (slot + 1) & (size - 1);
+        table[slot] = i + 1;
+    }
+    free(scratch->table);
+    scratch->table = table;
+    scratch->table_size = size;
+    return 0;
+}
+
+// Finds or adds the child of parent named by segment; kind is what the
+// segment must be (a value for the last one). Returns -1 when the key
+// contradicts an earlier one: the first key wins.
+static int unflatten_child(UnflattenScratch* scratch, int parent, const char* key,
+                           const UnflattenSegment* segment, int kind) {
+    int container = segment->index >= 0 ? UNFLATTEN_ARRAY : UNFLATTEN_OBJECT;
+    if (scratch->nodes[parent].kind == UNFLATTEN_UNSET) scratch->nodes[parent].kind = container;
+    if (scratch->nodes[parent].kind != container) return -1;
+
+    const char* name = key + segment->start;
+    uint32_t hash = (uint32_t)parent * 0x9E3779B1u;
+    if (segment->index >= 0) {
+        hash ^= (uint32_t)segment->index * 0x85EBCA6Bu;
+    } else {
+        StringView view = make_string_view(name, (size_t)segment->length);
+        hash ^= string_view_hash(&view);
+    }
+
+    int mask = scratch->table_size - 1;
+    int slot = (int)(hash & (uint32_t)mask);
+    for (int entry; (entry = scratch->table[slot]) != 0; slot = (slot + 1) & mask) {
+        const UnflattenNode* node = &scratch->nodes[entry - 1];
+        if (node->hash != hash || node->parent != parent || node->index != segment->index) continue;
+        if (segment->index < 0 &&
+            (node->name_length != segment->length || memcmp(node->name, name, (size_t)segment->length) != 0)) {
+            continue;
+        }
+        // Only a container seen again with the same kind is shared
+        return kind != UNFLATTEN_VALUE && node->kind == kind ? entry - 1 : -1;
+    }
+
+    if (scratch->node_count == scratch->node_capacity) {
+        int capacity = scratch->node_capacity * 2;
+        UnflattenNode* nodes = realloc(scratch->nodes, (size_t)capacity * sizeof(UnflattenNode));
+        if (!nodes) return -1;
+        scratch->nodes = nodes;
+        scratch->node_capacity = capacity;
+    }
+
+    int child = scratch->node_count++;
+    UnflattenNode* node = &scratch->nodes[child];
+    node->parent = parent;
+    node->kind = kind;
+    node->name = name;
+    node->name_length = segment->length;
+    node->index = segment->index;
+    node->hash = hash;
+    node->value = NULL;
+    node->first_child = node->last_child = node->next_sibling = -1;
+    node->length = 0;
+
+    UnflattenNode* owner = &scratch->nodes[parent];
+    if (owner->last_child >= 0) {
+        scratch->nodes[owner->last_child].next_sibling = child;
+    } else {
+        owner->first_child = child;
+    }
+    owner->last_child = child;
+    if (segment->index >= owner->length) owner->length = segment->index + 1;
+
+    scratch->table[slot] = child + 1;
+    if (scratch->node_count * 2 > scratch->table_size && unflatten_grow_table(scratch) != 0) return -1;
+    return child;
+}
+
+// Places one flattened pair in the trie; contradicting keys are skipped
+static void unflatten_add_pair(UnflattenScratch* scratch, const char* key, const cJSON* value) {
+    size_t length = strlen_simd(key);
+    int count = unflatten_parse_key(scratch, key, length);
+    if (count < 0) {
+        scratch->previous_count = 0;
+        return;
+    }
+
+    if (count == 0) {
+        // The empty key is a flattened scalar: the value is the whole document
+        UnflattenNode* root = &scratch->nodes[0];
+        if (root->kind == UNFLATTEN_UNSET) {
+            root->kind = UNFLATTEN_VALUE;
+            root->value = value;
+        }
+        scratch->previous_count = 0;
+        return;
+    }
+
+    // Leading containers identical to the previous key's are already resolved
+    size_t common = 0;
+    if (scratch->previous_key) {
+        size_t limit = length < scratch->previous_length ? length : scratch->previous_length;
+        while (common < limit && key[common] == scratch->previous_key[common]) common++;
+    }
+    int reused = 0;
+    while (reused < count - 1 && reused < scratch->previous_count - 1) {
+        const UnflattenSegment* a = &scratch->segments[reused];
+        const UnflattenSegment* b = &scratch->previous[reused];
+        if (a->start != b->start || a->length != b->length || a->index != b->index ||
+            (size_t)(a->start + a->length) > common) break;
+        reused++;
+    }
+
+    int node = reused > 0 ? scratch->path[reused - 1] : 0;
+    int resolved = reused;
+    for (int i = reused; i < count && node >= 0; i++) {
+        int kind = i + 1 == count ? UNFLATTEN_VALUE :
+                   scratch->segments[i + 1].index >= 0 ? UNFLATTEN_ARRAY : UNFLATTEN_OBJECT;
+        node = unflatten_child(scratch, node, key, &scratch->segments[i], kind);
+        if (node >= 0) {
+            scratch->path[i] = node;
+            resolved = i + 1;
+        }
+    }
+    if (node >= 0) scratch->nodes[node].value = value;
+
+    // The resolved part of the key is the prefix the next key can reuse
+    UnflattenSegment* swap = scratch->previous;
+    scratch->previous = scratch->segments;
+    scratch->segments = swap;
+    scratch->previous_count = resolved;
+    scratch->previous_key = key;
+    scratch->previous_length = length;
+}
+
+// NUL-terminated copy of a member's name for cJSON
+static const char* unflatten_name(UnflattenScratch* scratch, const UnflattenNode* node) {
+    size_t needed = (size_t)node->name_length + 1;
+    if (needed > scratch->name_capacity) {
+        size_t capacity = needed < 256 ? 256 : needed * 2;
+        char* buffer = realloc(scratch->name_buffer, capacity);
+        if (!buffer) return NULL;
+        scratch->name_buffer = buffer;
+        scratch->name_capacity = capacity;
+    }
+    memcpy(scratch->name_buffer, node->name, (size_t)node->name_length);
+    scratch->name_buffer[node->name_length] = '\0';
+    return scratch->name_buffer;
+}
+
+static cJSON* unflatten_build(UnflattenScratch* scratch, int index) {
+    const UnflattenNode* node = &scratch->nodes[index];
+
+    if (node->kind == UNFLATTEN_VALUE) return cJSON_Duplicate(node->value, 1);
+
+    if (node->kind == UNFLATTEN_OBJECT) {
+        cJSON* object = cJSON_CreateObject();
+        for (int child = node->first_child; object && child >= 0; child = scratch->nodes[child].next_sibling) {
+            cJSON* item = unflatten_build(scratch, child);
+            const char* name = item ? unflatten_name(scratch, &scratch->nodes[child]) : NULL;
+            if (!name) {
+                cJSON_Delete(item);
+                cJSON_Delete(object);
+                return NULL;
+            }
+            cJSON_AddItemToObject(object, name, item);
+        }
+        return object;
+    }
+
+    // Elements go into slots by index; positions no key named (empty
+    // containers are dropped by flattening) become null
+    cJSON* array = cJSON_CreateArray();
+    cJSON** slots = calloc((size_t)node->length + 1, sizeof(cJSON*));
+    int failed = !array || !slots;
+    for (int child = node->first_child; !failed && child >= 0; child = scratch->nodes[child].next_sibling) {
+        cJSON* item = unflatten_build(scratch, child);
+        slots[scratch->nodes[child].index] = item;
+        failed = item == NULL;
+    }
+    for (int i = 0; i < node->length && slots; i++) {
+        cJSON* item = slots[i];
+        if (!failed && !item) item = cJSON_CreateNull();
+        if (failed || !item) {
+            cJSON_Delete(item);
+            failed = 1;
+            continue;
+        }
+        cJSON_AddItemToArray(array, item);
+    }
+    free(slots);
+    if (failed) {
+        cJSON_Delete(array);
+        return NULL;
+    }
+    return array;
+}
+
+// Rebuilds one flattened object; anything else is returned as a copy
+static cJSON* unflatten_record(UnflattenScratch* scratch, const cJSON* json) {
+    if ((json->type & 0xFF) != cJSON_Object) return cJSON_Duplicate(json, 1);
+
+    if (scratch->node_capacity == 0) {
+        scratch->nodes = malloc(64 * sizeof(UnflattenNode));
+        if (!scratch->nodes) return NULL;
+        scratch->node_capacity = 64;
+    }
+    if (!scratch->table && unflatten_grow_table(scratch) != 0) return NULL;
+    memset(scratch->table, 0, (size_t)scratch->table_size * sizeof(int));
+
+    UnflattenNode* root = &scratch->nodes[0];
+    memset(root, 0, sizeof(*root));
+    root->parent = -1;
+    root->kind = UNFLATTEN_UNSET;
+    root->index = -1;
+    root->first_child = root->last_child = root->next_sibling = -1;
+    scratch->node_count = 1;
+    scratch->previous_count = 0;
+    scratch->previous_key = NULL;
+
+    for (const cJSON* pair = json->child; pair; pair = pair->next) {
+        unflatten_add_pair(scratch, pair->string ? pair->string : "", pair);
+    }
+
+    // A record without keys was an empty object
+    if (scratch->nodes[0].kind == UNFLATTEN_UNSET) scratch->nodes[0].kind = UNFLATTEN_OBJECT;
+    return unflatten_build(scratch, 0);
+}
+
+cJSON* unflatten_json_object(const cJSON* json) {
+    if (UNLIKELY(!json)) return NULL;
+
+    int outer = stats_transform_begin(1);
+    UnflattenScratch scratch = {0};
+    cJSON* result = unflatten_record(&scratch, json);
+    unflatten_scratch_free(&scratch);
+    stats_phase_end(outer);
+    return result;
+}
+
+typedef struct {
+    const JsonArrayView* view;
+    cJSON** results;
+    UnflattenScratch* scratch;  // One per pool slot
+} UnflattenBatchJob;
+
+static void unflatten_batch_range(void* context, int begin, int end, int slot) {
+    UnflattenBatchJob* job = (UnflattenBatchJob*)context;
+    for (int i = begin; i < end; i++) {
+        if (i + 1 < end) {
+            PREFETCH_READ(job->view->items[i + 1]);
+        }
+        job->results[i] = unflatten_record(&job->scratch[slot], job->view->items[i]);
+    }
+}
+
+static cJSON* unflatten_batch_view(const JsonArrayView* view, ThreadPool* pool) {
+    cJSON* result = cJSON_CreateArray();
+    if (!result || view->count == 0) return result;
+
+    int slots = thread_pool_get_thread_count(pool) + 1;
+    UnflattenBatchJob job = {
+        view,
+        calloc((size_t)view->count, sizeof(cJSON*)),
+        calloc((size_t)slots, sizeof(UnflattenScratch))
+    };
+    if (!job.results || !job.scratch) {
+        free(job.results);
+        free(job.scratch);
+        cJSON_Delete(result);
+        return NULL;
+    }
+
+    int outer = stats_transform_begin((uint64_t)view->count);
+    thread_pool_parallel_for(pool, view->count, MIN_RECORDS_PER_CHUNK, unflatten_batch_range, &job);
+    for (int i = 0; i < view->count; i++) {
+        if (job.results[i]) cJSON_AddItemToArray(result, job.results[i]);
+    }
+    stats_phase_end(outer);
+
+    for (int i = 0; i < slots; i++) unflatten_scratch_free(&job.scratch[i]);
+    free(job.scratch);
+    free(job.results);
+    return result;
+}
+
+cJSON* unflatten_json_batch(const cJSON* json_array, int use_threads, int num_threads) {
+    if (!json_array || json_array->type != cJSON_Array) {
+        return NULL;
+    }
+
+    JsonArrayView view;
+    if (json_array_view_init(&view, json_array) != 0) {
+        return NULL;
+    }
+
+    ThreadPool* pool = acquire_batch_pool(json_array, view.count, use_threads, num_threads);
+    cJSON* result = unflatten_batch_view(&view, pool);
+    thread_pool_release(pool);
+
+    json_array_view_free(&view);
+    return result;
+}
+
+cJSON* unflatten_json_batch_with_pool(const cJSON* json_array, ThreadPool* pool) {
+    if (!json_array || json_array->type != cJSON_Array) {
+        return NULL;
+    }
+
+    JsonArrayView view;
+    if (json_array_view_init(&view, json_array) != 0) {
+        return NULL;
+    }
+
+    cJSON* result = unflatten_batch_view(&view, usable_batch_pool(pool, view.count));
+    json_array_view_free(&view);
+    return result;
+}
+
+cJSON* unflatten_parsed_json(const cJSON* json, int use_threads, int num_threads) {
+    if (!json) return NULL;
+    return json->type == cJSON_Array ? unflatten_json_batch(json, use_threads, num_threads) :
+                                       unflatten_json_object(json);
+}
+
+char* unflatten_json_string(const char* json_string, int use_threads, int num_threads, int pretty_print) {
+    if (!json_string) return NULL;
+
+    cJSON* json = parse_json_string(json_string);
+    if (!json) {
+        const char* error_ptr = cJSON_GetErrorPtr();
+        if (error_ptr) {
+            fprintf(stderr, "Error parsing JSON: %s\n", error_ptr);
+        }
+        return NULL;
+    }
+
+    cJSON* result = unflatten_parsed_json(json, use_threads, num_threads);
+    cJSON_Delete(json);
+    char* text = result ? cjson_tools_print(result, pretty_print) : NULL;
+    cJSON_Delete(result);
+    return text;
+}
+
+// =============================================================================
+// DIRECT-TO-TEXT FLATTENED OUTPUT
+// =============================================================================
+
+#define OUTPUT_SINK_CAPACITY (64 * 1024)  // Bytes a sink-backed buffer collects per write
+#define STREAM_WINDOW_RECORDS 4096         // Records flattened at a time when writing to a stream
+
+// Growable output buffer; after a failed allocation appends become no-ops
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+    int failed;
+    int fixed;       // Caller-provided storage that must not be reallocated
+    FILE* sink;      // When set, a full buffer is written here instead of growing
+    size_t flushed;  // Bytes already written to sink
+} OutputBuffer;
+
+static void output_buffer_init(OutputBuffer* out, size_t initial_capacity) {
+    out->data = malloc(initial_capacity);
+    out->length = 0;
+    out->capacity = out->data ? initial_capacity : 0;
+    out->failed = out->data == NULL;
+    out->fixed = 0;
+    out->sink = NULL;
+    out->flushed = 0;
+}
+
+// Collects text for sink, written out whenever the buffer fills up
+static void output_buffer_init_sink(OutputBuffer* out, FILE* sink) {
+    output_buffer_init(out, OUTPUT_SINK_CAPACITY);
+    out->sink = sink;
+}
+
+// Writes out what a sink-backed buffer holds; 0 on a write error
+static int output_buffer_flush(OutputBuffer* out) {
+    if (out->length > 0 && fwrite(out->data, 1, out->length, out->sink) != out->length) {
+        out->failed = 1;
+        return 0;
+    }
+    out->flushed += out->length;
+    out->length = 0;
+    return 1;
+}
+
+static ALWAYS_INLINE int output_buffer_reserve(OutputBuffer* out, size_t extra) {
+    if (UNLIKELY(out->failed)) return 0;
+    if (LIKELY(out->length + extra < out->capacity)) return 1;
+    if (out->fixed) {
+        out->failed = 1;
+        return 0;
+    }
+    if (out->sink) {
+        // Only text larger than the whole buffer still makes it grow
+        if (!output_buffer_flush(out)) return 0;
+        if (extra < out->capacity) return 1;
+    }
+
+    size_t new_capacity = out->capacity ? out->capacity : 256;
+    while (new_capacity <= out->length + extra) new_capacity <<= 1;
+
+    char* new_data = realloc(out->data, new_capacity);
+    if (UNLIKELY(!new_data)) {
+        out->failed = 1;
+        return 0;
+    }
+    out->data = new_data;
+    out->capacity = new_capacity;
+    return 1;
+}
+
+static ALWAYS_INLINE void output_buffer_append(OutputBuffer* out, const char* data, size_t len) {
+    if (LIKELY(output_buffer_reserve(out, len))) {
+        fast_memcpy(out->data + out->length, data, len);
+        out->length += len;
+    }
+}
+
+static ALWAYS_INLINE void output_buffer_append_char(OutputBuffer* out, char c) {
+    if (LIKELY(output_buffer_reserve(out, 1))) {
+        out->data[out->length++] = c;
+    }
+}
+
+static void output_buffer_append_tabs(OutputBuffer* out, int count) {
+    if (count > 0 && output_buffer_reserve(out, (size_t)count)) {
+        memset(out->data + out->length, '\t', (size_t)count);
+        out->length += (size_t)count;
+    }
+}
+
+// Hands the NUL-terminated text to the caller, or NULL if any append failed
+static char* output_buffer_finish(OutputBuffer* out) {
+    if (out->failed || !output_buffer_reserve(out, 1)) {
+        free(out->data);
+        memset(out, 0, sizeof(*out));
+        return NULL;
+    }
+    out->data[out->length] = '\0';
+    char* text = out->data;
+    memset(out, 0, sizeof(*out));
+    return text;
+}
+
+// output_buffer_finish for a result made under the phase opened as outer,
+// counting the text as output and closing the phase
+static char* output_buffer_finish_phase(OutputBuffer* out, int outer) {
+    if (!out->failed) stats_count(outer, STAT_BYTES_OUT, out->length);
+    char* text = output_buffer_finish(out);
+    stats_phase_end(outer);
+    return text;
+}
+
+static void output_buffer_free(OutputBuffer* out) {
+    free(out->data);
+    memset(out, 0, sizeof(*out));
+}
+
+// Writes the rest of a sink-backed buffer and frees it, counting the output of
+// the phase opened as outer and closing it; 0 on success, -1 if anything failed
+static int output_buffer_close_sink(OutputBuffer* out, int outer) {
+    int ok = !out->failed && output_buffer_flush(out);
+    if (ok) stats_count(outer, STAT_BYTES_OUT, out->flushed);
+    output_buffer_free(out);
+    stats_phase_end(outer);
+    return ok ? 0 : -1;
+}
+
+// Escapes like cJSON's print_string_ptr; the SIMD scan finds the next byte that
+// needs an escape, so clean runs are copied in one go
+static void write_json_string(OutputBuffer* out, const char* str) {
+    static const char hex_digits[] = "0123456789abcdef";
+    
+    output_buffer_append_char(out, '"');
+    if (!str) {
+        output_buffer_append_char(out, '"');
+        return;
+    }
+
+    const char* (*find_escape)(const char*) = __atomic_load_n(&g_simd.find_escape, __ATOMIC_RELAXED);
+    const char* run = str;
+    for (;;) {
+        const char* p = find_escape(run);
+        output_buffer_append(out, run, (size_t)(p - run));
+        unsigned char c = (unsigned char)*p;
+        if (c == '\0') break;
+
+        char escape[6] = {'\\', 0};
+        size_t escape_len = 2;
+        switch (c) {
+            case '"': escape[1] = '"'; break;
+            case '\\': escape[1] = '\\'; break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            default:
+                memcpy(escape + 1, "u00", 3);
+                escape[4] = hex_digits[c >> 4];
+                escape[5] = hex_digits[c & 15];
+                escape_len = 6;
+                break;
+        }
+        output_buffer_append(out, escape, escape_len);
+        run = p + 1;
+    }
+
+    output_buffer_append_char(out, '"');
+}
+
+// -----------------------------------------------------------------------------
+// Round-trip doubles (Grisu2)
+// -----------------------------------------------------------------------------
+
+// 64-bit significand and binary exponent: value = f * 2^e
+typedef struct {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+// 10^(8i - 348) normalized to a 64-bit significand, correctly rounded
+static const DiyFp g_cached_powers[87] = {
+    {0xfa8fd5a0081c0288ULL, -1220}, {0xbaaee17fa23ebf76ULL, -1193},
+    {0x8b16fb203055ac76ULL, -1166}, {0xcf42894a5dce35eaULL, -1140},
+    {0x9a6bb0aa55653b2dULL, -1113}, {0xe61acf033d1a45dfULL, -1087},
+    {0xab70fe17c79ac6caULL, -1060}, {0xff77b1fcbebcdc4fULL, -1034},
+    {0xbe5691ef416bd60cULL, -1007}, {0x8dd01fad907ffc3cULL, -980},
+    {0xd3515c2831559a83ULL, -954}, {0x9d71ac8fada6c9b5ULL, -927},
+    {0xea9c227723ee8bcbULL, -901}, {0xaecc49914078536dULL, -874},
+    {0x823c12795db6ce57ULL, -847}, {0xc21094364dfb5637ULL, -821},
+    {0x9096ea6f3848984fULL, -794}, {0xd77485cb25823ac7ULL, -768},
+    {0xa086cfcd97bf97f4ULL, -741}, {0xef340a98172aace5ULL, -715},
+    {0xb23867fb2a35b28eULL, -688}, {0x84c8d4dfd2c63f3bULL, -661},
+    {0xc5dd44271ad3cdbaULL, -635}, {0x936b9fcebb25c996ULL, -608},
+    {0xdbac6c247d62a584ULL, -582}, {0xa3ab66580d5fdaf6ULL, -555},
+    {0xf3e2f893dec3f126ULL, -529}, {0xb5b5ada8aaff80b8ULL, -502},
+    {0x87625f056c7c4a8bULL, -475}, {0xc9bcff6034c13053ULL, -449},
+    {0x964e858c91ba2655ULL, -422}, {0xdff9772470297ebdULL, -396},
+    {0xa6dfbd9fb8e5b88fULL, -369}, {0xf8a95fcf88747d94ULL, -343},
+    {0xb94470938fa89bcfULL, -316}, {0x8a08f0f8bf0f156bULL, -289},
+    {0xcdb02555653131b6ULL, -263}, {0x993fe2c6d07b7facULL, -236},
+    {0xe45c10c42a2b3b06ULL, -210}, {0xaa242499697392d3ULL, -183},
+    {0xfd87b5f28300ca0eULL, -157}, {0xbce5086492111aebULL, -130},
+    {0x8cbccc096f5088ccULL, -103}, {0xd1b71758e219652cULL, -77},
+    {0x9c40000000000000ULL, -50}, {0xe8d4a51000000000ULL, -24},
+    {0xad78ebc5ac620000ULL, 3}, {0x813f3978f8940984ULL, 30},
+    {0xc097ce7bc90715b3ULL, 56}, {0x8f7e32ce7bea5c70ULL, 83},
+    {0xd5d238a4abe98068ULL, 109}, {0x9f4f2726179a2245ULL, 136},
+    {0xed63a231d4c4fb27ULL, 162}, {0xb0de65388cc8ada8ULL, 189},
+    {0x83c7088e1aab65dbULL, 216}, {0xc45d1df942711d9aULL, 242},
+    {0x924d692ca61be758ULL, 269}, {0xda01ee641a708deaULL, 295},
+    {0xa26da3999aef774aULL, 322}, {0xf209787bb47d6b85ULL, 348},
+    {0xb454e4a179dd1877ULL, 375}, {0x865b86925b9bc5c2ULL, 402},
+    {0xc83553c5c8965d3dULL, 428}, {0x952ab45cfa97a0b3ULL, 455},
+    {0xde469fbd99a05fe3ULL, 481}, {0xa59bc234db398c25ULL, 508},
+    {0xf6c69a72a3989f5cULL, 534}, {0xb7dcbf5354e9beceULL, 561},
+    {0x88fcf317f22241e2ULL, 588}, {0xcc20ce9bd35c78a5ULL, 614},
+    {0x98165af37b2153dfULL, 641}, {0xe2a0b5dc971f303aULL, 667},
+    {0xa8d9d1535ce3b396ULL, 694}, {0xfb9b7cd9a4a7443cULL, 720},
+    {0xbb764c4ca7a44410ULL, 747}, {0x8bab8eefb6409c1aULL, 774},
+    {0xd01fef10a657842cULL, 800}, {0x9b10a4e5e9913129ULL, 827},
+    {0xe7109bfba19c0c9dULL, 853}, {0xac2820d9623bf429ULL, 880},
+    {0x80444b5e7aa7cf85ULL, 907}, {0xbf21e44003acdd2dULL, 933},
+    {0x8e679c2f5e44ff8fULL, 960}, {0xd433179d9c8cb841ULL, 986},
+    {0x9e19db92b4e31ba9ULL, 1013}, {0xeb96bf6ebadf77d9ULL, 1039},
+    {0xaf87023b9bf0ee6bULL, 1066},
+};
+
+static const uint64_t g_pow10_u64[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static ALWAYS_INLINE DiyFp diyfp_multiply(DiyFp x, DiyFp y) {
+    DiyFp product;
+    #ifdef __SIZEOF_INT128__
+    unsigned __int128 p = (unsigned __int128)x.f * y.f;
+    uint64_t high = (uint64_t)(p >> 64);
+    uint64_t low = (uint64_t)p;
+    product.f = high + (low >> 63);  // Round to nearest
+    #else
+    const uint64_t mask32 = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & mask32, c = y.f >> 32, d = y.f & mask32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t middle = (bd >> 32) + (ad & mask32) + (bc & mask32) + (1ULL << 31);  // Round to nearest
+    product.f = ac + (ad >> 32) + (bc >> 32) + (middle >> 32);
+    #endif
+    product.e = x.e + y.e + 64;
+    return product;
+}
+
+static ALWAYS_INLINE DiyFp diyfp_normalize(DiyFp x) {
+    int shift = __builtin_clzll(x.f);
+    x.f <<= shift;
+    x.e -= shift;
+    return x;
+}
+
+// Rounds the last digit towards the exact value while it stays inside the
+// rounding interval (Grisu's "weed" step)
+static void grisu_round(char* digits, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t distance) {
+    while (rest < distance && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < distance || distance - rest > rest + ten_kappa - distance)) {
+        digits[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+// Writes the digits of a value between the scaled boundaries; *K receives the
+// decimal exponent of the last digit
+static int grisu_digits(DiyFp w, DiyFp upper, uint64_t delta, char* digits, int* K) {
+    const int shift = -upper.e;
+    const uint64_t one = 1ULL << shift;
+    const uint64_t distance = upper.f - w.f;
+    uint32_t integral = (uint32_t)(upper.f >> shift);
+    uint64_t fraction = upper.f & (one - 1);
+    
+    int length = 0;
+    int kappa = 1;
+    while (kappa < 10 && integral >= g_pow10_u64[kappa]) kappa++;
+    
+    while (kappa > 0) {
+        uint32_t divisor = (uint32_t)g_pow10_u64[kappa - 1];
+        uint32_t digit = integral / divisor;
+        integral %= divisor;
+        if (digit || length) digits[length++] = (char)('0' + digit);
+        kappa--;
+        uint64_t rest = ((uint64_t)integral << shift) + fraction;
+        if (rest <= delta) {
+            *K += kappa;
+            grisu_round(digits, length, delta, rest, g_pow10_u64[kappa] << shift, distance);
+            return length;
+        }
+    }
+    
+    for (;;) {
+        fraction *= 10;
+        delta *= 10;
+        char digit = (char)(fraction >> shift);
+        if (digit || length) digits[length++] = (char)('0' + digit);
+        fraction &= one - 1;
+        kappa--;
+        if (fraction < delta) {
+            *K += kappa;
+            grisu_round(digits, length, delta, fraction, one, distance * (-kappa < 20 ? g_pow10_u64[-kappa] : 0));
+            return length;
+        }
+    }
+}
+
+// Shortest (in all but rare cases) digit string that reads back as `value`, which
+// must be finite and positive; the value is digits * 10^*K
+static int grisu2(double value, char* digits, int* K) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biased_exponent = (int)((bits >> 52) & 0x7FF);
+    uint64_t significand = bits & ((1ULL << 52) - 1);
+    
+    DiyFp v;
+    if (biased_exponent) {
+        v.f = significand | (1ULL << 52);
+        v.e = biased_exponent - 1075;
+    } else {
+        v.f = significand;
+        v.e = -1074;
+    }
+    
+    // Halfway points to the neighbouring doubles, on a common exponent
+    DiyFp upper = diyfp_normalize((DiyFp){(v.f << 1) + 1, v.e - 1});
+    DiyFp lower = v.f == (1ULL << 52) ? (DiyFp){(v.f << 2) - 1, v.e - 2} : (DiyFp){(v.f << 1) - 1, v.e - 1};
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+    
+    // Scale so the upper boundary's exponent lands in [-60, -32]
+    double dk = (-61 - upper.e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    if (dk - k > 0.0) k++;
+    int index = (k >> 3) + 1;
+    *K = -(-348 + index * 8);
+    DiyFp cached = g_cached_powers[index];
+    
+    DiyFp w = diyfp_multiply(diyfp_normalize(v), cached);
+    DiyFp scaled_upper = diyfp_multiply(upper, cached);
+    DiyFp scaled_lower = diyfp_multiply(lower, cached);
+    scaled_lower.f++;
+    scaled_upper.f--;
+    return grisu_digits(w, scaled_upper, scaled_upper.f - scaled_lower.f, digits, K);
+}
+
+// Integer digits, two at a time
+static int format_uint64(uint64_t value, char* buffer) {
+    static const char pairs[201] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char reversed[20];
+    int length = 0;
+    while (value >= 100) {
+        const char* pair = pairs + (value % 100) * 2;
+        value /= 100;
+        reversed[length++] = pair[1];
+        reversed[length++] = pair[0];
+    }
+    if (value >= 10) {
+        reversed[length++] = pairs[value * 2 + 1];
+        reversed[length++] = pairs[value * 2];
+    } else {
+        reversed[length++] = (char)('0' + value);
+    }
+    for (int i = 0; i < length; i++) buffer[i] = reversed[length - 1 - i];
+    return length;
+}
+
+// Lays the digits out the way printf's %g does at the precision cJSON would
+// have picked: 15 significant digits, or 17 when more than 15 are needed
+static int format_decimal(const char* digits, int length, int K, char* buffer) {
+    int exponent = length + K - 1;  // Of the first digit
+    int precision = length <= 15 ? 15 : 17;
+    char* p = buffer;
+    
+    if (exponent >= -4 && exponent < precision) {
+        if (K >= 0) {
+            memcpy(p, digits, (size_t)length);
+            p += length;
+            memset(p, '0', (size_t)K);
+            p += K;
+        } else if (exponent >= 0) {
+            memcpy(p, digits, (size_t)exponent + 1);
+            p += exponent + 1;
+            *p++ = '.';
+            memcpy(p, digits + exponent + 1, (size_t)(length - exponent - 1));
+            p += length - exponent - 1;
+        } else {
+            *p++ = '0';
+            *p++ = '.';
+            memset(p, '0', (size_t)(-exponent - 1));
+            p += -exponent - 1;
+            memcpy(p, digits, (size_t)length);
+            p += length;
+        }
+    } else {
+        *p++ = digits[0];
+        if (length > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, (size_t)length - 1);
+            p += length - 1;
+        }
+        *p++ = 'e';
+        *p++ = exponent < 0 ? '-' : '+';
+        int magnitude = exponent < 0 ? -exponent : exponent;
+        if (magnitude < 10) *p++ = '0';
+        p += format_uint64((uint64_t)magnitude, p);
+    }
+    return (int)(p - buffer);
+}
+
+// Same layout as cJSON's print_number, but with Grisu2 digits that read back
+// exactly (shortest in all but rare cases) instead of sprintf("%1.15g") with
+// a "%1.17g" retry.
+// Special values are told apart by their bits: -ffast-math builds drop isnan()
+// and treat subnormals as zero in comparisons.
+static int format_json_number(double d, char* buffer) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    uint64_t exponent_bits = bits & 0x7FF0000000000000ULL;
+    
+    if (UNLIKELY(exponent_bits == 0x7FF0000000000000ULL)) {
+        memcpy(buffer, "null", 4);  // NaN or infinity
+        return 4;
+    }
+    if ((bits << 1) == 0) {
+        buffer[0] = '0';  // -0 prints as 0, like cJSON
+        return 1;
+    }
+    
+    char* p = buffer;
+    if (bits >> 63) {
+        *p++ = '-';
+        bits &= ~(1ULL << 63);
+        memcpy(&d, &bits, sizeof(d));
+    }
+    // Integers below 10^15 print as plain digits under %1.15g too
+    if (exponent_bits != 0 && d < 1e15 && d == (double)(uint64_t)d) {
+        return (int)(p - buffer) + format_uint64((uint64_t)d, p);
+    }
+    
+    char digits[20];
+    int K = 0;
+    int length = grisu2(d, digits, &K);
+    while (length > 1 && digits[length - 1] == '0') {
+        length--;
+        K++;
+    }
+    return (int)(p - buffer) + format_decimal(digits, length, K, p);
+}
+
+static void write_json_number(OutputBuffer* out, const cJSON* item) {
+    if (LIKELY(output_buffer_reserve(out, 32))) {
+        out->length += (size_t)format_json_number(item->valuedouble, out->data + out->length);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Tree printer
+// -----------------------------------------------------------------------------
+
+// Byte-for-byte cJSON_Print/cJSON_PrintUnformatted layout for an item nested
+// `depth` containers deep; fails on the same inputs cJSON does
+static int write_json_value(OutputBuffer* out, const cJSON* item, int format, int depth) {
+    switch (item->type & 0xFF) {
+        case cJSON_NULL:  output_buffer_append(out, "null", 4); return 1;
+        case cJSON_False: output_buffer_append(out, "false", 5); return 1;
+        case cJSON_True:  output_buffer_append(out, "true", 4); return 1;
+        case cJSON_Number: write_json_number(out, item); return 1;
+        case cJSON_String: write_json_string(out, item->valuestring); return 1;
+        
+        case cJSON_Raw:
+            if (!item->valuestring) return 0;
+            output_buffer_append(out, item->valuestring, strlen_simd(item->valuestring));
+            return 1;
+        
+        case cJSON_Array:
+            output_buffer_append_char(out, '[');
+            for (const cJSON* child = item->child; child; child = child->next) {
+                if (!write_json_value(out, child, format, depth + 1)) return 0;
+                if (child->next) output_buffer_append(out, ", ", format ? 2 : 1);
+            }
+            output_buffer_append_char(out, ']');
+            return 1;
+        
+        case cJSON_Object:
+            output_buffer_append_char(out, '{');
+            if (format) output_buffer_append_char(out, '\n');
+            for (const cJSON* child = item->child; child; child = child->next) {
+                if (format) output_buffer_append_tabs(out, depth + 1);
+                write_json_string(out, child->string);
+                output_buffer_append(out, ":\t", format ? 2 : 1);
+                if (!write_json_value(out, child, format, depth + 1)) return 0;
+                if (child->next) output_buffer_append_char(out, ',');
+                if (format) output_buffer_append_char(out, '\n');
+            }
+            if (format) output_buffer_append_tabs(out, depth);
+            output_buffer_append_char(out, '}');
+            return 1;
+        
+        default:
+            return 0;
+    }
+}
+
+char* cjson_tools_print(const cJSON* json, int pretty_print) {
+    if (UNLIKELY(!json)) return NULL;
+    
+    int outer = stats_phase_begin(STATS_PHASE_SERIALIZE);
+    OutputBuffer out;
+    output_buffer_init(&out, 256);
+    if (!write_json_value(&out, json, pretty_print, 0)) {
+        output_buffer_free(&out);
+        stats_phase_end(outer);
+        return NULL;
+    }
+    return output_buffer_finish_phase(&out, outer);
+}
+
+int cjson_tools_print_stream(const cJSON* json, FILE* output, int pretty_print) {
+    if (UNLIKELY(!json || !output)) return -1;
+
+    int outer = stats_phase_begin(STATS_PHASE_SERIALIZE);
+    OutputBuffer out;
+    output_buffer_init_sink(&out, output);
+    if (!write_json_value(&out, json, pretty_print, 0)) out.failed = 1;
+    return output_buffer_close_sink(&out, outer);
+}
+
+int json_array_view_print_stream(const JsonArrayView* view, FILE* output, int pretty_print) {
+    if (!view || !output) return -1;
+
+    cJSON array;
+    cJSON** saved = json_array_view_link(view, &array);
+    if (!saved) return -1;
+    int status = cjson_tools_print_stream(&array, output, pretty_print);
+    json_array_view_unlink(view, saved);
+    return status;
+}
+
+int cjson_tools_print_preallocated(const cJSON* json, char* buffer, int length, int pretty_print) {
+    if (UNLIKELY(!json || !buffer || length <= 0)) return 0;
+    
+    int outer = stats_phase_begin(STATS_PHASE_SERIALIZE);
+    OutputBuffer out = {buffer, 0, (size_t)length, 0, 1, NULL, 0};
+    int ok = write_json_value(&out, json, pretty_print, 0) && !out.failed && out.length < out.capacity;
+    if (ok) {
+        buffer[out.length] = '\0';
+        stats_count(outer, STAT_BYTES_OUT, out.length);
+    }
+    stats_phase_end(outer);
+    return ok;
+}
+
+static ALWAYS_INLINE int is_flattened_leaf(const cJSON* value) {
+    switch (value->type & 0xFF) {
+        case cJSON_False:
+        case cJSON_True:
+        case cJSON_NULL:
+        case cJSON_Number:
+        case cJSON_String:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Serializes the pairs as one object, matching cJSON_Print/cJSON_PrintUnformatted
+// layout for an object nested `depth` levels deep
+static void write_flattened_pairs(OutputBuffer* out, const FlattenedArray* array, int format, int depth) {
+    output_buffer_append_char(out, '{');
+    if (format) output_buffer_append_char(out, '\n');
+
+    int written = 0;
+    for (int i = 0; i < array->count; i++) {
+        const FlattenedPair* pair = &array->pairs[i];
+        if (UNLIKELY(!is_flattened_leaf(pair->value))) continue;
+
+        if (written++) {
+            output_buffer_append_char(out, ',');
+            if (format) output_buffer_append_char(out, '\n');
+        }
+        if (format) output_buffer_append_tabs(out, depth + 1);
+
+        write_json_string(out, pair->key);
+        output_buffer_append_char(out, ':');
+        if (format) output_buffer_append_char(out, '\t');
+
+        const cJSON* value = pair->value;
+        switch (value->type & 0xFF) {
+            case cJSON_False: output_buffer_append(out, "false", 5); break;
+            case cJSON_True:  output_buffer_append(out, "true", 4); break;
+            case cJSON_NULL:  output_buffer_append(out, "null", 4); break;
+            case cJSON_Number: write_json_number(out, value); break;
+            default: write_json_string(out, value->valuestring); break;
+        }
+
+        if (i + 1 < array->count) {
+            PREFETCH_READ(&array->pairs[i + 1]);
+        }
+    }
+
+    if (format) {
+        if (written) output_buffer_append_char(out, '\n');
+        output_buffer_append_tabs(out, depth);
+    }
+    output_buffer_append_char(out, '}');
+}
+
+static void write_flattened_object(OutputBuffer* out, const cJSON* json, int format, int depth) {
+    FlattenedArray flattened_array;
+    init_flattened_array(&flattened_array, estimate_flattened_capacity(json));
+
+    flatten_json_recursive((cJSON*)json, "", &flattened_array);
+    write_flattened_pairs(out, &flattened_array, format, depth);
+
+    free_flattened_array(&flattened_array);
+}
+
+char* flatten_json_object_text(const cJSON* json, int pretty_print) {
+    if (UNLIKELY(!json)) return NULL;
+
+    int outer = stats_transform_begin(1);
+    OutputBuffer out;
+    output_buffer_init(&out, 1024);
+    write_flattened_object(&out, json, pretty_print, 0);
+    return output_buffer_finish_phase(&out, outer);
+}
+
+static void write_flattened_object_scratch(OutputBuffer* out, const cJSON* json, int format, int depth,
+                                           FlattenedArray* scratch, FlattenShapeCache* cache) {
+    flatten_into_scratch(scratch, json, cache);
+    write_flattened_pairs(out, scratch, format, depth);
+}
+
+typedef struct {
+    const JsonArrayView* view;
+    OutputBuffer* texts;
+    FlattenedArray* scratch;  // One per pool slot
+    FlattenShapeCache* cache;
+    int format;
+    int depth;
+} FlattenTextJob;
+
+static void flatten_text_range(void* context, int begin, int end, int slot) {
+    FlattenTextJob* job = (FlattenTextJob*)context;
+    for (int i = begin; i < end; i++) {
+        output_buffer_init(&job->texts[i], 1024);
+        write_flattened_object_scratch(&job->texts[i], job->view->items[i], job->format, job->depth,
+                                       &job->scratch[slot], job->cache);
+    }
+}
+
+// Fills one text buffer per record, in chunks on the pool when one is given
+static OutputBuffer* flatten_view_text_buffers(const JsonArrayView* view, ThreadPool* pool, int format, int depth) {
+    int slots = thread_pool_get_thread_count(pool) + 1;
+    FlattenTextJob job = {
+        view,
+        calloc(view->count > 0 ? view->count : 1, sizeof(OutputBuffer)),
+        calloc(slots, sizeof(FlattenedArray)),
+        flatten_shape_cache_create(0),  // Optional: NULL just means no key reuse
+        format,
+        depth
+    };
+    if (job.texts && job.scratch) {
+        thread_pool_parallel_for(pool, view->count, MIN_RECORDS_PER_CHUNK, flatten_text_range, &job);
+    } else {
+        free(job.texts);
+        job.texts = NULL;
+    }
+
+    free_flattened_scratch(job.scratch, slots);
+    flatten_shape_cache_free(job.cache);
+    return job.texts;
+}
+
+static OutputBuffer* flatten_batch_text_buffers(const cJSON* json_array, ThreadPool* pool, int format, int depth) {
+    JsonArrayView view;
+    if (json_array_view_init(&view, json_array) != 0) return NULL;
+
+    OutputBuffer* buffers = flatten_view_text_buffers(&view, pool, format, depth);
+    json_array_view_free(&view);
+    return buffers;
+}
+
+static char** flatten_batch_texts(const cJSON* json_array, int array_size, ThreadPool* pool, int pretty_print) {
+    int outer = stats_transform_begin((uint64_t)array_size);
+    OutputBuffer* buffers = flatten_batch_text_buffers(json_array, pool, pretty_print, 0);
+    if (!buffers) {
+        stats_phase_end(outer);
+        return NULL;
+    }
+
+    char** texts = calloc(array_size > 0 ? array_size : 1, sizeof(char*));
+    int failed = texts == NULL;
+
+    for (int i = 0; i < array_size; i++) {
+        if (failed) {
+            output_buffer_free(&buffers[i]);
+            continue;
+        }
+        stats_count(outer, STAT_BYTES_OUT, buffers[i].length);
+        texts[i] = output_buffer_finish(&buffers[i]);
+        if (!texts[i]) {
+            failed = 1;
+            for (int j = 0; j < i; j++) free(texts[j]);
+        }
+    }
+
+    free(buffers);
+    stats_phase_end(outer);
+    if (failed) {
+        free(texts);
+        return NULL;
+    }
+    return texts;
+}
+
+char** flatten_json_batch_text(const cJSON* json_array, int use_threads, int num_threads, int pretty_print) {
+    if (!json_array || json_array->type != cJSON_Array) {
+        return NULL;
+    }
+
+    int array_size = cJSON_GetArraySize(json_array);
+    ThreadPool* pool = acquire_batch_pool(json_array, array_size, use_threads, num_threads);
+    char** texts = flatten_batch_texts(json_array, array_size, pool, pretty_print);
+    thread_pool_release(pool);
+    return texts;
+}
+
+char** flatten_json_batch_text_with_pool(const cJSON* json_array, ThreadPool* pool, int pretty_print) {
+    if (!json_array || json_array->type != cJSON_Array) {
+        return NULL;
+    }
+
+    int array_size = cJSON_GetArraySize(json_array);
+    return flatten_batch_texts(json_array, array_size, usable_batch_pool(pool, array_size), pretty_print);
+}
+
+// Appends the records' texts with cJSON's array separators and frees the buffers
+static void join_text_buffers(OutputBuffer* out, OutputBuffer* buffers, int count, int format) {
+    for (int i = 0; i < count; i++) {
+        if (i > 0) output_buffer_append(out, ", ", format ? 2 : 1);
+        if (buffers[i].failed) out->failed = 1;
+        output_buffer_append(out, buffers[i].data, buffers[i].length);
+        output_buffer_free(&buffers[i]);
+    }
+    free(buffers);
+}
+
+// Writes a batch as one top-level array, like cJSON_Print of flatten_json_batch
+static char* flatten_batch_to_text(const cJSON* json_array, int use_threads, int num_threads, int format) {
+    int array_size = cJSON_GetArraySize(json_array);
+
+    int outer = stats_transform_begin((uint64_t)array_size);
+    OutputBuffer out;
+    output_buffer_init(&out, (size_t)array_size * 128 + 16);
+    output_buffer_append_char(&out, '[');
+
+    ThreadPool* pool = acquire_batch_pool(json_array, array_size, use_threads, num_threads);
+    if (!pool) {
+        // Single-threaded: write every record straight into the final buffer
+        FlattenedArray scratch = {0};
+        FlattenShapeCache* cache = flatten_shape_cache_create(0);
+        for (const cJSON* item = json_array->child; item; item = item->next) {
+            if (item != json_array->child) {
+                output_buffer_append(&out, ", ", format ? 2 : 1);
+            }
+            write_flattened_object_scratch(&out, item, format, 1, &scratch, cache);
+        }
+        if (scratch.pairs) free_flattened_array(&scratch);
+        flatten_shape_cache_free(cache);
+    } else {
+        OutputBuffer* buffers = flatten_batch_text_buffers(json_array, pool, format, 1);
+        thread_pool_release(pool);
+        if (!buffers) {
+            output_buffer_free(&out);
+            stats_phase_end(outer);
+            return NULL;
+        }
+        join_text_buffers(&out, buffers, array_size, format);
+    }
+
+    output_buffer_append_char(&out, ']');
+    return output_buffer_finish_phase(&out, outer);
+}
+
+// Like flatten_parsed_json_text: a batch without containers in its first
+// records is printed as-is
+static int view_has_containers(const JsonArrayView* records) {
+    for (int i = 0; i < records->count && i < 50; i++) {
+        if (records->items[i]->type == cJSON_Object || records->items[i]->type == cJSON_Array) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Writes records as one top-level array like flatten_batch_to_text. On a pool
+// each window of STREAM_WINDOW_RECORDS records is flattened in parallel and
+// appended in record order, so a sink-backed out holds one window at a time.
+static void write_flattened_view(OutputBuffer* out, const JsonArrayView* records, ThreadPool* pool, int format) {
+    int window = records->count < STREAM_WINDOW_RECORDS ? records->count : STREAM_WINDOW_RECORDS;
+    int slots = thread_pool_get_thread_count(pool) + 1;
+    FlattenTextJob job = {
+        NULL,
+        pool ? calloc(window > 0 ? window : 1, sizeof(OutputBuffer)) : NULL,
+        calloc(slots, sizeof(FlattenedArray)),
+        flatten_shape_cache_create(0),
+        format,
+        1
+    };
+    if (!job.scratch || (pool && !job.texts)) out->failed = 1;
+
+    output_buffer_append_char(out, '[');
+    for (int start = 0; start < records->count && !out->failed; start += window) {
+        JsonArrayView part = {records->items + start, records->count - start < window ? records->count - start : window};
+        if (!pool) {
+            for (int i = 0; i < part.count; i++) {
+                if (start + i > 0) output_buffer_append(out, ", ", format ? 2 : 1);
+                write_flattened_object_scratch(out, part.items[i], format, 1, &job.scratch[0], job.cache);
+            }
+            continue;
+        }
+
+        job.view = &part;
+        thread_pool_parallel_for(pool, part.count, MIN_RECORDS_PER_CHUNK, flatten_text_range, &job);
+        for (int i = 0; i < part.count; i++) {
+            if (start + i > 0) output_buffer_append(out, ", ", format ? 2 : 1);
+            if (job.texts[i].failed) out->failed = 1;
+            output_buffer_append(out, job.texts[i].data, job.texts[i].length);
+            output_buffer_free(&job.texts[i]);
+        }
+    }
+    output_buffer_append_char(out, ']');
+
+    free(job.texts);
+    free_flattened_scratch(job.scratch, slots);
+    flatten_shape_cache_free(job.cache);
+}
+
+char* flatten_json_view_text(const JsonArrayView* records, ThreadPool* pool, int pretty_print) {
+    if (!records) return NULL;
+    if (!view_has_containers(records)) return json_array_view_print(records, pretty_print);
+
+    int outer = stats_transform_begin((uint64_t)records->count);
+    OutputBuffer* buffers = flatten_view_text_buffers(records, usable_batch_pool(pool, records->count),
+                                                      pretty_print, 1);
+    if (!buffers) {
+        stats_phase_end(outer);
+        return NULL;
+    }
+
+    OutputBuffer out;
+    output_buffer_init(&out, (size_t)records->count * 128 + 16);
+    output_buffer_append_char(&out, '[');
+    join_text_buffers(&out, buffers, records->count, pretty_print);
+    output_buffer_append_char(&out, ']');
+    return output_buffer_finish_phase(&out, outer);
+}
+
+// Auto-detects a single object or a batch, like flatten_json_string
+char* flatten_parsed_json_text(const cJSON* json, int use_threads, int num_threads, int pretty_print) {
+    char* result = NULL;
+    
+    if (json->type == cJSON_Array) {
+        int has_objects = 0;
+        
+        // Quick scan for objects (limit scan for performance)
+        const cJSON* item = json->child;
+        for (int i = 0; item && i < 50; i++, item = item->next) {
+            if (item->type == cJSON_Object || item->type == cJSON_Array) {
+                has_objects = 1;
+                break;
+            }
+        }
+        
+        if (has_objects) {
+            result = flatten_batch_to_text(json, use_threads, num_threads, pretty_print);
+        } else {
+            // Nothing to flatten, print the input as-is
+            result = cjson_tools_print(json, pretty_print);
+        }
+    } else {
+        result = flatten_json_object_text(json, pretty_print);
+    }
+    
+    return result;
+}
+
+int flatten_parsed_json_stream(const cJSON* json, FILE* output, int use_threads, int num_threads, int pretty_print) {
+    if (!json || !output) return -1;
+
+    OutputBuffer out;
+    if (json->type != cJSON_Array) {
+        int outer = stats_transform_begin(1);
+        output_buffer_init_sink(&out, output);
+        write_flattened_object(&out, json, pretty_print, 0);
+        return output_buffer_close_sink(&out, outer);
+    }
+
+    JsonArrayView records;
+    if (json_array_view_init(&records, json) != 0) return -1;
+
+    int status;
+    if (!view_has_containers(&records)) {
+        status = cjson_tools_print_stream(json, output, pretty_print);
+    } else {
+        int outer = stats_transform_begin((uint64_t)records.count);
+        ThreadPool* pool = acquire_batch_pool(json, records.count, use_threads, num_threads);
+        output_buffer_init_sink(&out, output);
+        write_flattened_view(&out, &records, pool, pretty_print);
+        thread_pool_release(pool);
+        status = output_buffer_close_sink(&out, outer);
+    }
+
+    json_array_view_free(&records);
+    return status;
+}
+
+int flatten_json_view_stream(const JsonArrayView* records, ThreadPool* pool, FILE* output, int pretty_print) {
+    if (!records || !output) return -1;
+    if (!view_has_containers(records)) return json_array_view_print_stream(records, output, pretty_print);
+
+    int outer = stats_transform_begin((uint64_t)records->count);
+    OutputBuffer out;
+    output_buffer_init_sink(&out, output);
+    write_flattened_view(&out, records, usable_batch_pool(pool, records->count), pretty_print);
+    return output_buffer_close_sink(&out, outer);
+}
+
+char* flatten_json_string(const char* json_string, int use_threads, int num_threads) {
+    return flatten_json_string_opts(json_string, use_threads, num_threads, 1);
+}
+
+char* flatten_json_string_opts(const char* json_string, int use_threads, int num_threads, int pretty_print) {
+    if (!json_string) return NULL;
+    
+    // A top-level array is parsed element by element on the pool
+    if (use_threads) {
+        JsonArrayView records;
+        ThreadPool* pool = parse_array_on_shared_pool(json_string, strlen_simd(json_string), num_threads, &records);
+        if (pool) {
+            char* result = flatten_json_view_text(&records, pool, pretty_print);
+            json_array_view_delete(&records);
+            thread_pool_release(pool);
+            return result;
+        }
+    }
+    
+    cJSON* json = parse_json_string(json_string);
+    if (!json) {
+        const char* error_ptr = cJSON_GetErrorPtr();
+        if (error_ptr) {
+            fprintf(stderr, "Error parsing JSON: %s\n", error_ptr);
+        }
+        return NULL;
+    }
+    
+    char* result = flatten_parsed_json_text(json, use_threads, num_threads, pretty_print);
+    
+    cJSON_Delete(json);
+    return result;
+}
+
+// Path extraction with types (optimized)
+static const char* get_cjson_type_string(const cJSON* item) {
+    if (!item) return "null";
+    
+    switch (item->type & 0xFF) {
+        case cJSON_False:
+        case cJSON_True:
+            return "boolean";
+        case cJSON_NULL:
+            return "null";
+        case cJSON_Number:
+            if (item->valuedouble == (double)item->valueint &&
+                item->valuedouble >= INT_MIN && item->valuedouble <= INT_MAX) {
+                return "integer";
+            } else {
+                return "number";
+            }
+        case cJSON_String:
+            return "string";
+        case cJSON_Array:
+            return "array";
+        case cJSON_Object:
+            return "object";
+        default:
+            return "unknown";
+    }
+}
+
+static void collect_paths_with_types_recursive(const cJSON* json, const char* prefix, cJSON* result) {
+    if (!json || !result) return;
+
+    char key_buffer[MAX_KEY_LENGTH];
+    const cJSON* child = NULL;
+
+    if (cJSON_IsArray(json)) {
+        int index = 0;
+        cJSON_ArrayForEach(child, json) {
+            build_key_optimized(key_buffer, sizeof(key_buffer), prefix, NULL, 1, index);
+
+            if (cJSON_IsObject(child) && child->child) {
+                collect_paths_with_types_recursive(child, key_buffer, result);
+            } else if (cJSON_IsArray(child)) {
+                collect_paths_with_types_recursive(child, key_buffer, result);
+            } else {
+                const char* type_str = get_cjson_type_string(child);
+                cJSON* type_value = cJSON_CreateString(type_str);
+                if (type_value) {
+                    cJSON_AddItemToObject(result, key_buffer, type_value);
+                }
+            }
+            index++;
+        }
+    } else {
+        cJSON_ArrayForEach(child, json) {
+            const char* child_name = child->string;
+            if (!child_name) continue;
+
+            if (prefix && strlen_simd(prefix) > 0) {
+                build_key_optimized(key_buffer, sizeof(key_buffer), prefix, child_name, 0, 0);
+            } else {
+                strncpy(key_buffer, child_name, sizeof(key_buffer) - 1);
+                key_buffer[sizeof(key_buffer) - 1] = '\0';
+            }
+
+            if (cJSON_IsObject(child) && child->child) {
+                collect_paths_with_types_recursive(child, key_buffer, result);
+            } else if (cJSON_IsArray(child)) {
+                collect_paths_with_types_recursive(child, key_buffer, result);
+            } else {
+                const char* type_str = get_cjson_type_string(child);
+                cJSON* type_value = cJSON_CreateString(type_str);
+                if (type_value) {
+                    cJSON_AddItemToObject(result, key_buffer, type_value);
+                }
+            }
+        }
+    }
+}
+
+cJSON* get_flattened_paths_with_types(cJSON* json) {
+    if (!json) return NULL;
+
+    cJSON* result = cJSON_CreateObject();
+    if (!result) return NULL;
+
+    int outer = stats_transform_begin(1);
+    if (cJSON_IsObject(json)) {
+        collect_paths_with_types_recursive(json, "", result);
+    } else if (cJSON_IsArray(json)) {
+        collect_paths_with_types_recursive(json, "", result);
+    } else {
+        const char* type_str = get_cjson_type_string(json);
+        cJSON* type_value = cJSON_CreateString(type_str);
+        if (type_value) {
+            cJSON_AddItemToObject(result, "root", type_value);
+        }
+    }
+    stats_phase_end(outer);
+
+    return result;
+}
+
+char* get_flattened_paths_with_types_string(const char* json_string) {
+    if (!json_string) return NULL;
+
+    cJSON* json = parse_json_string(json_string);
+    if (!json) return NULL;
+
+    cJSON* paths_with_types = get_flattened_paths_with_types(json);
+    char* result = NULL;
+
+    if (paths_with_types) {
+        result = cjson_tools_print(paths_with_types, 1);
+        cJSON_Delete(paths_with_types);
+    }
+
+    cJSON_Delete(json);
+    return result;
+}
+
+// =============================================================================
+// PATH PROJECTION
+// =============================================================================
+
+// Trie of selected paths. Steps are object members (PATH_MEMBER plus a name),
+// array positions (index >= 0) or [*]; a terminal node selects its whole subtree.
+#define PATH_MEMBER (-2)
+#define PATH_ANY_INDEX (-1)
+
+typedef struct JsonPathNode {
+    char* name;
+    size_t name_len;
+    int index;
+    int terminal;
+    struct JsonPathNode* children;
+    struct JsonPathNode* next;
+} JsonPathNode;
+
+struct JsonPathSet {
+    JsonPathNode root;
+    int count;
+};
+
+static void path_node_free_children(JsonPathNode* node) {
+    JsonPathNode* child = node->children;
+    while (child) {
+        JsonPathNode* next = child->next;
+        path_node_free_children(child);
+        free(child->name);
+        free(child);
+        child = next;
+    }
+    node->children = NULL;
+}
+
+// Finds or appends the child for one step (name is only used by member steps)
+static JsonPathNode* path_node_child(JsonPathNode* node, const char* name, size_t name_len, int index) {
+    JsonPathNode** link = &node->children;
+    for (; *link; link = &(*link)->next) {
+        JsonPathNode* child = *link;
+        if (child->index == index && (index != PATH_MEMBER ||
+            (child->name_len == name_len && memcmp(child->name, name, name_len) == 0))) {
+            return child;
+        }
+    }
+
+    JsonPathNode* child = calloc(1, sizeof(JsonPathNode));
+    if (!child) return NULL;
+
+    child->index = index;
+    if (index == PATH_MEMBER) {
+        child->name = malloc(name_len + 1);
+        if (!child->name) {
+            free(child);
+            return NULL;
+        }
+        memcpy(child->name, name, name_len);
+        child->name[name_len] = '\0';
+        child->name_len = name_len;
+    }
+    *link = child;
+    return child;
+}
+
+// Adds one path such as "a.b[*].c"; a backslash makes the next name character literal
+static int path_set_add(JsonPathSet* set, const char* path, size_t len) {
+    JsonPathNode* node = &set->root;
+    char name[MAX_KEY_LENGTH];
+    size_t i = 0;
+    int after_dot = 0;
+
+    while (i < len) {
+        if (path[i] == '[') {
+            if (after_dot) return -1;
+
+            int index = PATH_ANY_INDEX;
+            if (++i < len && path[i] == '*') {
+                i++;
+            } else {
+                long value = 0;
+                size_t digits = 0;
+                for (; i < len && path[i] >= '0' && path[i] <= '9'; i++, digits++) {
+                    value = value * 10 + (path[i] - '0');
+                    if (value > INT_MAX) return -1;
+                }
+                if (digits == 0) return -1;
+                index = (int)value;
+            }
+            if (i >= len || path[i] != ']') return -1;
+            i++;
+
+            node = path_node_child(node, NULL, 0, index);
+            if (!node || (i < len && path[i] != '.' && path[i] != '[')) return -1;
+        } else {
+            size_t name_len = 0;
+            while (i < len && path[i] != '.' && path[i] != '[') {
+                char c = path[i++];
+                if (c == '\\' && i < len) c = path[i++];
+                if (name_len + 1 >= sizeof(name)) return -1;
+                name[name_len++] = c;
+            }
+            if (name_len == 0) return -1;
+
+            node = path_node_child(node, name, name_len, PATH_MEMBER);
+            if (!node) return -1;
+        }
+
+        after_dot = i < len && path[i] == '.';
+        if (after_dot && ++i == len) return -1;
+    }
+
+    if (node == &set->root) return -1;
+    node->terminal = 1;
+    return 0;
+}
+
+// Copies src's selections into dst
+static int path_node_merge(JsonPathNode* dst, const JsonPathNode* src) {
+    if (src->terminal) dst->terminal = 1;
+    for (const JsonPathNode* child = src->children; child; child = child->next) {
+        JsonPathNode* target = path_node_child(dst, child->name, child->name_len, child->index);
+        if (!target || path_node_merge(target, child) != 0) return -1;
+    }
+    return 0;
+}
+
+// [*] also covers elements that have their own [n] paths, so its subtree is
+// folded into each explicit index and matching only ever follows one node
+static int path_node_normalize(JsonPathNode* node) {
+    const JsonPathNode* any = NULL;
+    for (JsonPathNode* child = node->children; child; child = child->next) {
+        if (child->index == PATH_ANY_INDEX) any = child;
+    }
+    for (JsonPathNode* child = node->children; child; child = child->next) {
+        if (any && child->index >= 0 && path_node_merge(child, any) != 0) return -1;
+        if (path_node_normalize(child) != 0) return -1;
+    }
+    return 0;
+}
+
+static inline int is_path_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+JsonPathSet* json_path_set_compile(const char* spec) {
+    if (!spec) return NULL;
+
+    JsonPathSet* set = calloc(1, sizeof(JsonPathSet));
+    if (!set) return NULL;
+    set->root.index = PATH_MEMBER;
+
+    const char* p = spec;
+    for (;;) {
+        while (is_path_space(*p)) p++;
+
+        const char* start = p;
+        while (*p && *p != ',') {
+            if (*p == '\\' && p[1]) p++;
+            p++;
+        }
+        const char* end = p;
+        while (end > start && is_path_space(end[-1])) end--;
+
+        if (path_set_add(set, start, (size_t)(end - start)) != 0) {
+            fprintf(stderr, "Error: Invalid path '%.*s'\n", (int)(end - start), start);
+            json_path_set_free(set);
+            return NULL;
+        }
+        set->count++;
+
+        if (*p != ',') break;
+        p++;
+    }
+
+    if (path_node_normalize(&set->root) != 0) {
+        json_path_set_free(set);
+        return NULL;
+    }
+    return set;
+}
+
+int json_path_set_count(const JsonPathSet* paths) {
+    return paths ? paths->count : 0;
+}
+
+void json_path_set_free(JsonPathSet* paths) {
+    if (!paths) return;
+
+    path_node_free_children(&paths->root);
+    free(paths);
+}
+
+static const JsonPathNode* path_match_member(const JsonPathNode* node, const char* name, size_t name_len) {
+    for (const JsonPathNode* child = node->children; child; child = child->next) {
+        if (child->index == PATH_MEMBER && child->name_len == name_len &&
+            memcmp(child->name, name, name_len) == 0) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+// An explicit index wins over [*], which normalization already merged into it
+static const JsonPathNode* path_match_index(const JsonPathNode* node, int index) {
+    const JsonPathNode* any = NULL;
+    for (const JsonPathNode* child = node->children; child; child = child->next) {
+        if (child->index == index) return child;
+        if (child->index == PATH_ANY_INDEX) any = child;
+    }
+    return any;
+}
+
+// Walks only the selected branches, flattening whole subtrees at terminal nodes
+static void flatten_projected_recursive(cJSON* json, const JsonPathNode* node,
+                                        const char* prefix, FlattenedArray* result) {
+    if (node->terminal) {
+        flatten_json_recursive(json, prefix, result);
+        return;
+    }
+
+    char key_buffer[MAX_KEY_LENGTH];
+    if (cJSON_IsObject(json)) {
+        for (cJSON* child = json->child; child; child = child->next) {
+            if (!child->string) continue;
+            const JsonPathNode* match = path_match_member(node, child->string, strlen_simd(child->string));
+            if (!match) continue;
+
+            build_key_optimized(key_buffer, sizeof(key_buffer), prefix, child->string, 0, 0);
+            flatten_projected_recursive(child, match, key_buffer, result);
+        }
+    } else if (cJSON_IsArray(json)) {
+        int i = 0;
+        for (cJSON* child = json->child; child; child = child->next, i++) {
+            const JsonPathNode* match = path_match_index(node, i);
+            if (!match) continue;
+
+            build_key_optimized(key_buffer, sizeof(key_buffer), prefix, NULL, 1, i);
+            flatten_projected_recursive(child, match, key_buffer, result);
+        }
+    }
+}
+
+cJSON* flatten_json_object_paths(const cJSON* json, const JsonPathSet* paths) {
+    if (!json || !paths) return NULL;
+
+    int outer = stats_transform_begin(1);
+    FlattenedArray flattened_array;
+    init_flattened_array(&flattened_array, paths->count * 4);
+
+    flatten_projected_recursive((cJSON*)json, &paths->root, "", &flattened_array);
+
+    cJSON* flattened_json = create_flattened_json(&flattened_array, 0);
+    free_flattened_array(&flattened_array);
+    stats_phase_end(outer);
+
+    return flattened_json;
+}
+
+// Unselected array elements before a selected one become {} so positions
+// (and flattened [n] keys) are kept; {} flattens to nothing
+static int path_add_placeholders(cJSON* array, int count) {
+    for (; count > 0; count--) {
+        if (!cJSON_AddItemToArray(array, cJSON_CreateObject())) return -1;
+    }
+    return 0;
+}
+
+// *out is NULL when nothing under json is selected
+static int extract_projected(const cJSON* json, const JsonPathNode* node, int per_record, cJSON** out) {
+    *out = NULL;
+    if (node->terminal) {
+        *out = cJSON_Duplicate(json, 1);
+        return *out ? 0 : -1;
+    }
+
+    if (cJSON_IsObject(json)) {
+        cJSON* object = cJSON_CreateObject();
+        if (!object) return -1;
+
+        for (const cJSON* child = json->child; child; child = child->next) {
+            const JsonPathNode* match = child->string ?
+                path_match_member(node, child->string, strlen_simd(child->string)) : NULL;
+            cJSON* item = NULL;
+            if (match && extract_projected(child, match, 0, &item) != 0) {
+                cJSON_Delete(object);
+                return -1;
+            }
+            if (item) cJSON_AddItemToObject(object, match->name, item);
+        }
+        *out = object;
+    } else if (cJSON_IsArray(json)) {
+        cJSON* array = cJSON_CreateArray();
+        if (!array) return -1;
+
+        int i = 0;
+        int pending = 0;
+        for (const cJSON* child = json->child; child; child = child->next, i++) {
+            const JsonPathNode* match = per_record ? node : path_match_index(node, i);
+            cJSON* item = NULL;
+            if (match && extract_projected(child, match, 0, &item) != 0) {
+                cJSON_Delete(array);
+                return -1;
+            }
+            // Records are always kept, empty if nothing in them is selected
+            if (!item && !per_record) {
+                pending++;
+                continue;
+            }
+            if (path_add_placeholders(array, pending + !item) != 0 ||
+                (item && !cJSON_AddItemToArray(array, item))) {
+                cJSON_Delete(item);
+                cJSON_Delete(array);
+                return -1;
+            }
+            pending = 0;
+        }
+        *out = array;
+    }
+    return 0;
+}
+
+cJSON* extract_json_paths(const cJSON* json, const JsonPathSet* paths, int per_record) {
+    if (!json || !paths) return NULL;
+
+    int outer = stats_transform_begin(1);
+    cJSON* result = NULL;
+    int status = extract_projected(json, &paths->root, per_record, &result);
+    stats_phase_end(outer);
+    if (status != 0) return NULL;
+    return result ? result : cJSON_CreateObject();
+}
+
+// Lazy parsing: selected values are parsed by cJSON, everything else is
+// skipped by jumping between structural characters without building it
+typedef struct {
+    const char* p;
+    const char* end;
+} PathScanner;
+
+static inline void path_scan_whitespace(PathScanner* s) {
+    s->p = skip_whitespace_optimized(s->p, (size_t)(s->end - s->p));
+}
+
+// Moves past the string that starts at s->p without decoding it
+static int path_scan_string(PathScanner* s) {
+    const char* p = s->p + 1;
+    for (;;) {
+        const char* quote = p < s->end ? memchr(p, '"', (size_t)(s->end - p)) : NULL;
+        if (!quote) return -1;
+
+        // The quote is escaped when an odd number of backslashes precede it
+        const char* escapes = quote;
+        while (escapes > p && escapes[-1] == '\\') escapes--;
+        if (((quote - escapes) & 1) == 0) {
+            s->p = quote + 1;
+            return 0;
+        }
+        p = quote + 1;
+    }
+}
+
+// Skips one value. Only nesting and strings are tracked, so skipped
+// content is not validated.
+static int path_scan_skip_value(PathScanner* s) {
+    path_scan_whitespace(s);
+    if (s->p >= s->end) return -1;
+
+    char c = *s->p;
+    if (c == '"') return path_scan_string(s);
+    if (c != '{' && c != '[') {
+        // Scalars end at the next structural character
+        s->p = find_delimiter_optimized(s->p, (size_t)(s->end - s->p));
+        return 0;
+    }
+
+    int depth = 0;
+    while (s->p < s->end) {
+        const char* q = find_delimiter_optimized(s->p, (size_t)(s->end - s->p));
+        if (q >= s->end) return -1;
+
+        s->p = q;
+        if (*q == '"') {
+            if (path_scan_string(s) != 0) return -1;
+            continue;
+        }
+        s->p = q + 1;
+        if (*q == '{' || *q == '[') {
+            depth++;
+        } else if ((*q == '}' || *q == ']') && --depth == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static cJSON* path_scan_parse_value(PathScanner* s) {
+    const char* parse_end = NULL;
+    cJSON* item = cJSON_ParseWithLengthOpts(s->p, (size_t)(s->end - s->p), &parse_end, 0);
+    if (item) s->p = parse_end;
+    return item;
+}
+
+// Reads a member name and its ':' and matches the name against node's children
+static int path_scan_member(PathScanner* s, const JsonPathNode* node, const JsonPathNode** match) {
+    if (s->p >= s->end || *s->p != '"') return -1;
+
+    const char* name = s->p + 1;
+    if (path_scan_string(s) != 0) return -1;
+    size_t name_len = (size_t)(s->p - 1 - name);
+
+    if (!memchr(name, '\\', name_len)) {
+        *match = path_match_member(node, name, name_len);
+    } else {
+        // Escaped names are decoded by cJSON before matching
+        PathScanner name_scanner = {name - 1, s->p};
+        cJSON* decoded = path_scan_parse_value(&name_scanner);
+        if (!decoded) return -1;
+        *match = path_match_member(node, decoded->valuestring, strlen_simd(decoded->valuestring));
+        cJSON_Delete(decoded);
+    }
+
+    path_scan_whitespace(s);
+    if (s->p >= s->end || *s->p != ':') return -1;
+    s->p++;
+    return 0;
+}
+
+static int path_scan_project(PathScanner* s, const JsonPathNode* node, int per_record, cJSON** out);
+
+// Parses a selected value: whole at terminal nodes, projected otherwise
+static int path_scan_select(PathScanner* s, const JsonPathNode* node, cJSON** out) {
+    if (!node->terminal) return path_scan_project(s, node, 0, out);
+
+    *out = path_scan_parse_value(s);
+    return *out ? 0 : -1;
+}
+
+static int path_scan_object(PathScanner* s, const JsonPathNode* node, cJSON** out) {
+    cJSON* object = cJSON_CreateObject();
+    if (!object) return -1;
+
+    s->p++;
+    path_scan_whitespace(s);
+    if (s->p < s->end && *s->p == '}') {
+        s->p++;
+        *out = object;
+        return 0;
+    }
+
+    for (;;) {
+        const JsonPathNode* match = NULL;
+        cJSON* item = NULL;
+
+        path_scan_whitespace(s);
+        if (path_scan_member(s, node, &match) != 0) break;
+        if (match) {
+            if (path_scan_select(s, match, &item) != 0) break;
+            if (item) cJSON_AddItemToObject(object, match->name, item);
+        } else if (path_scan_skip_value(s) != 0) {
+            break;
+        }
+
+        path_scan_whitespace(s);
+        if (s->p >= s->end) break;
+        if (*s->p == ',') {
+            s->p++;
+            continue;
+        }
+        if (*s->p == '}') {
+            s->p++;
+            *out = object;
+            return 0;
+        }
+        break;
+    }
+
+    cJSON_Delete(object);
+    return -1;
+}
+
+static int path_scan_array(PathScanner* s, const JsonPathNode* node, int per_record, cJSON** out) {
+    cJSON* array = cJSON_CreateArray();
+    if (!array) return -1;
+
+    s->p++;
+    path_scan_whitespace(s);
+    if (s->p < s->end && *s->p == ']') {
+        s->p++;
+        *out = array;
+        return 0;
+    }
+
+    int pending = 0;
+    for (int i = 0;; i++) {
+        const JsonPathNode* match = per_record ? node : path_match_index(node, i);
+        cJSON* item = NULL;
+
+        if ((match ? path_scan_select(s, match, &item) : path_scan_skip_value(s)) != 0) break;
+
+        // Same placeholder rules as extract_projected
+        if (item || per_record) {
+            if (path_add_placeholders(array, pending + !item) != 0 ||
+                (item && !cJSON_AddItemToArray(array, item))) {
+                cJSON_Delete(item);
+                break;
+            }
+            pending = 0;
+        } else {
+            pending++;
+        }
+
+        path_scan_whitespace(s);
+        if (s->p >= s->end) break;
+        if (*s->p == ',') {
+            s->p++;
+            continue;
+        }
+        if (*s->p == ']') {
+            s->p++;
+            *out = array;
+            return 0;
+        }
+        break;
+    }
+
+    cJSON_Delete(array);
+    return -1;
+}
+
+// *out stays NULL for a scalar, which an unfinished path cannot descend into
+static int path_scan_project(PathScanner* s, const JsonPathNode* node, int per_record, cJSON** out) {
+    *out = NULL;
+    path_scan_whitespace(s);
+    if (s->p >= s->end) return -1;
+
+    if (*s->p == '{') return path_scan_object(s, node, out);
+    if (*s->p == '[') return path_scan_array(s, node, per_record, out);
+    return path_scan_skip_value(s);
+}
+
+cJSON* json_parse_paths(const char* text, size_t length, const JsonPathSet* paths, int per_record) {
+    if (!text || !paths) return NULL;
+
+    PathScanner scanner = {text, text + length};
+    if (length >= 3 && memcmp(text, "\xEF\xBB\xBF", 3) == 0) scanner.p += 3;
+
+    int outer = stats_phase_begin(STATS_PHASE_PARSE);
+    cJSON* result = NULL;
+    int status = path_scan_project(&scanner, &paths->root, per_record, &result);
+    if (status == 0) {
+        path_scan_whitespace(&scanner);
+        status = scanner.p == scanner.end ? 0 : -1;
+    }
+    if (status == 0) stats_count(outer, STAT_BYTES_IN, length);
+    stats_phase_end(outer);
+
+    if (status != 0) {
+        fprintf(stderr, "Error parsing JSON at byte %zu\n", (size_t)(scanner.p - text));
+        cJSON_Delete(result);
+        return NULL;
+    }
+    return result ? result : cJSON_CreateObject();
+}
+
+char* flatten_json_string_paths(const char* json_string, const JsonPathSet* paths,
+                                int use_threads, int num_threads, int pretty_print) {
+    if (!json_string || !paths) return NULL;
+
+    cJSON* json = json_parse_paths(json_string, strlen_simd(json_string), paths, 1);
+    if (!json) return NULL;
+
+    char* result = flatten_parsed_json_text(json, use_threads, num_threads, pretty_print);
+
+    cJSON_Delete(json);
+    return result;
+}
+
+// =============================================================================
+// FUSED TRANSFORMATION PIPELINE
+// =============================================================================
+
+typedef struct {
+    PipelineStepType type;
+    CompiledPattern* pattern;
+    char* replacement;
+} PipelineStep;
+
+struct JsonPipeline {
+    PipelineStep* steps;
+    int count;
+    int capacity;
+    int flatten_index;  // Position of the first flatten step, -1 if none
+};
+
+JsonPipeline* json_pipeline_create(void) {
+    JsonPipeline* pipeline = calloc(1, sizeof(JsonPipeline));
+    if (!pipeline) return NULL;
+
+    pipeline->flatten_index = -1;
+    return pipeline;
+}
+
+void json_pipeline_free(JsonPipeline* pipeline) {
+    if (!pipeline) return;
+
+    for (int i = 0; i < pipeline->count; i++) {
+        cjson_tools_pattern_free(pipeline->steps[i].pattern);
+        free(pipeline->steps[i].replacement);
+    }
+    free(pipeline->steps);
+    free(pipeline);
+}
+
+int json_pipeline_add_step(JsonPipeline* pipeline, PipelineStepType type,
+                           const char* pattern, const char* replacement) {
+    if (!pipeline) return -1;
+
+    int needs_pattern = type == PIPELINE_REPLACE_KEYS || type == PIPELINE_REPLACE_VALUES;
+    if (needs_pattern && (!pattern || !replacement)) return -1;
+
+    if (pipeline->count >= pipeline->capacity) {
+        int new_capacity = pipeline->capacity ? pipeline->capacity * 2 : 8;
+        PipelineStep* new_steps = realloc(pipeline->steps, new_capacity * sizeof(PipelineStep));
+        if (!new_steps) return -1;
+        pipeline->steps = new_steps;
+        pipeline->capacity = new_capacity;
+    }
+
+    PipelineStep step = {type, NULL, NULL};
+    if (needs_pattern) {
+        step.pattern = cjson_tools_pattern_compile(pattern);
+        step.replacement = my_strdup(replacement);
+        if (!step.pattern || !step.replacement) {
+            cjson_tools_pattern_free(step.pattern);
+            free(step.replacement);
+            return -1;
+        }
+    }
+
+    // Flattening an already flat object is a no-op, so only the first one counts
+    if (type == PIPELINE_FLATTEN && pipeline->flatten_index < 0) {
+        pipeline->flatten_index = pipeline->count;
+    }
+
+    pipeline->steps[pipeline->count++] = step;
+    return 0;
+}
+
+// Copies the next spec field up to an unescaped delimiter, turning "\," and
+// "\:" into literal characters. Other backslashes are kept for the regex.
+static const char* pipeline_spec_field(const char* spec, char* field, size_t field_size, int stop_at_colon) {
+    size_t len = 0;
+    while (*spec && *spec != ',' && !(stop_at_colon && *spec == ':')) {
+        char c = *spec++;
+        if (c == '\\' && (*spec == ',' || *spec == ':')) c = *spec++;
+        if (len + 1 < field_size) field[len++] = c;
+    }
+    field[len] = '\0';
+    return spec;
+}
+
+JsonPipeline* json_pipeline_parse(const char* spec) {
+    if (!spec) return NULL;
+
+    JsonPipeline* pipeline = json_pipeline_create();
+    if (!pipeline) return NULL;
+
+    char name[64];
+    char pattern[MAX_KEY_LENGTH];
+    char replacement[MAX_KEY_LENGTH];
+
+    const char* p = spec;
+    while (*p) {
+        p = pipeline_spec_field(p, name, sizeof(name), 1);
+
+        int status = -1;
+        if (strcmp(name, "remove-nulls") == 0 && *p != ':') {
+            status = json_pipeline_add_step(pipeline, PIPELINE_REMOVE_NULLS, NULL, NULL);
+        } else if (strcmp(name, "remove-empty") == 0 && *p != ':') {
+            status = json_pipeline_add_step(pipeline, PIPELINE_REMOVE_EMPTY, NULL, NULL);
+        } else if (strcmp(name, "flatten") == 0 && *p != ':') {
+            status = json_pipeline_add_step(pipeline, PIPELINE_FLATTEN, NULL, NULL);
+        } else if ((strcmp(name, "replace-keys") == 0 || strcmp(name, "replace-values") == 0) && *p == ':') {
+            p = pipeline_spec_field(p + 1, pattern, sizeof(pattern), 1);
+            if (*p == ':') {
+                p = pipeline_spec_field(p + 1, replacement, sizeof(replacement), 0);
+                PipelineStepType type = name[8] == 'k' ? PIPELINE_REPLACE_KEYS : PIPELINE_REPLACE_VALUES;
+                status = json_pipeline_add_step(pipeline, type, pattern, replacement);
+            }
+        }
+
+        if (status != 0 || (*p != ',' && *p != '\0')) {
+            fprintf(stderr, "Error: Invalid pipeline step '%s'\n", name);
+            json_pipeline_free(pipeline);
+            return NULL;
+        }
+        if (*p == ',') p++;
+    }
+
+    return pipeline;
+}
+
+// Runs the leaf steps in [from, to) on a scalar. *string_value tracks the
+// current string after replacements. Returns 0 if a filter drops the leaf.
+static int pipeline_keep_leaf(const JsonPipeline* pipeline, int from, int to,
+                              const cJSON* value, const char** string_value, int allow_drop) {
+    for (int i = from; i < to; i++) {
+        const PipelineStep* step = &pipeline->steps[i];
+        switch (step->type) {
+            case PIPELINE_REMOVE_NULLS:
+                if (allow_drop && cJSON_IsNull(value)) return 0;
+                break;
+            case PIPELINE_REMOVE_EMPTY:
+                if (allow_drop && *string_value && (*string_value)[0] == '\0') return 0;
+                break;
+            case PIPELINE_REPLACE_VALUES:
+                if (*string_value && cjson_tools_pattern_match(step->pattern, *string_value)) {
+                    *string_value = step->replacement;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return 1;
+}
+
+static const char* pipeline_map_key(const JsonPipeline* pipeline, int from, int to, const char* key) {
+    for (int i = from; i < to; i++) {
+        const PipelineStep* step = &pipeline->steps[i];
+        if (step->type == PIPELINE_REPLACE_KEYS && cjson_tools_pattern_match(step->pattern, key)) {
+            key = step->replacement;
+        }
+    }
+    return key;
+}
+
+static cJSON* pipeline_leaf_value(const cJSON* value, const char* string_value) {
+    if (string_value && string_value != value->valuestring) {
+        return cJSON_CreateString(string_value);
+    }
+    return cJSON_Duplicate(value, 0);
+}
+
+static ALWAYS_INLINE int is_container(const cJSON* json) {
+    return cJSON_IsObject(json) || cJSON_IsArray(json);
+}
+
+// Builds the transformed tree directly from the source in one walk
+static cJSON* pipeline_build_tree(const JsonPipeline* pipeline, const cJSON* json, int allow_drop) {
+    if (!is_container(json)) {
+        const char* string_value = cJSON_IsString(json) ? json->valuestring : NULL;
+        if (!pipeline_keep_leaf(pipeline, 0, pipeline->count, json, &string_value, allow_drop)) {
+            return NULL;
+        }
+        return pipeline_leaf_value(json, string_value);
+    }
+
+    int is_object = cJSON_IsObject(json);
+    cJSON* result = is_object ? cJSON_CreateObject() : cJSON_CreateArray();
+    if (UNLIKELY(!result)) return NULL;
+
+    for (const cJSON* child = json->child; child; child = child->next) {
+        if (is_object && !child->string) continue;
+
+        cJSON* value = pipeline_build_tree(pipeline, child, 1);
+        if (!value) continue;
+
+        if (is_object) {
+            cJSON_AddItemToObject(result, pipeline_map_key(pipeline, 0, pipeline->count, child->string), value);
+        } else {
+            cJSON_AddItemToArray(result, value);
+        }
+    }
+
+    return result;
+}
+
+// Flattening walk: key steps before the flatten step rename path components,
+// key steps after it rename the full dotted path. Array elements dropped
+// before flattening do not consume an index; ones dropped after it do.
+static void pipeline_flatten_walk(const JsonPipeline* pipeline, const cJSON* json,
+                                  const char* prefix, cJSON* result) {
+    const int split = pipeline->flatten_index;
+    char key_buffer[MAX_KEY_LENGTH];
+    int is_object = cJSON_IsObject(json);
+    int index = 0;
+
+    for (const cJSON* child = json->child; child; child = child->next) {
+        if (is_object) {
+            if (!child->string) continue;
+            const char* key = pipeline_map_key(pipeline, 0, split, child->string);
+            build_key_optimized(key_buffer, sizeof(key_buffer), prefix, key, 0, 0);
+        }
+
+        if (is_container(child)) {
+            if (!is_object) build_key_optimized(key_buffer, sizeof(key_buffer), prefix, NULL, 1, index++);
+            pipeline_flatten_walk(pipeline, child, key_buffer, result);
+            continue;
+        }
+
+        const char* string_value = cJSON_IsString(child) ? child->valuestring : NULL;
+        if (!pipeline_keep_leaf(pipeline, 0, split, child, &string_value, 1)) continue;
+
+        if (!is_object) build_key_optimized(key_buffer, sizeof(key_buffer), prefix, NULL, 1, index++);
+        if (!pipeline_keep_leaf(pipeline, split + 1, pipeline->count, child, &string_value, 1)) continue;
+
+        cJSON* value = pipeline_leaf_value(child, string_value);
+        if (value) {
+            const char* key = pipeline_map_key(pipeline, split + 1, pipeline->count, key_buffer);
+            cJSON_AddItemToObject(result, key, value);
+        }
+    }
+}
+
+static cJSON* pipeline_flatten_record(const JsonPipeline* pipeline, const cJSON* json) {
+    cJSON* result = cJSON_CreateObject();
+    if (UNLIKELY(!result)) return NULL;
+
+    if (is_container(json)) {
+        pipeline_flatten_walk(pipeline, json, "", result);
+        return result;
+    }
+
+    // A scalar flattens to the empty path, as in flatten_json_object
+    const char* string_value = cJSON_IsString(json) ? json->valuestring : NULL;
+    if (pipeline_keep_leaf(pipeline, 0, pipeline->count, json, &string_value, 1)) {
+        cJSON* value = pipeline_leaf_value(json, string_value);
+        if (value) {
+            const char* key = pipeline_map_key(pipeline, pipeline->flatten_index + 1, pipeline->count, "");
+            cJSON_AddItemToObject(result, key, value);
+        }
+    }
+    return result;
+}
+
+static cJSON* pipeline_apply(const JsonPipeline* pipeline, const cJSON* json) {
+    if (pipeline->flatten_index < 0) {
+        return pipeline_build_tree(pipeline, json, 0);
+    }
+
+    if (!cJSON_IsArray(json)) {
+        return pipeline_flatten_record(pipeline, json);
+    }
+
+    // Arrays are batches: every element is flattened on its own
+    cJSON* result = cJSON_CreateArray();
+    if (!result) return NULL;
+
+    for (const cJSON* item = json->child; item; item = item->next) {
+        cJSON* processed = pipeline_flatten_record(pipeline, item);
+        if (processed) {
+            cJSON_AddItemToArray(result, processed);
+        }
+    }
+    return result;
+}
+
+cJSON* json_pipeline_apply(const JsonPipeline* pipeline, const cJSON* json) {
+    if (!pipeline || !json) return NULL;
+
+    int outer = stats_transform_begin(1);
+    cJSON* result = pipeline_apply(pipeline, json);
+    stats_phase_end(outer);
+    return result;
+}
+
+// =============================================================================
+// ULTRA-OPTIMIZED JSON SCHEMA GENERATOR
+// =============================================================================
+
+typedef enum {
+    TYPE_NULL,
+    TYPE_BOOLEAN,
+    TYPE_INTEGER,
+    TYPE_NUMBER,
+    TYPE_STRING,
+    TYPE_ARRAY,
+    TYPE_OBJECT,
+    TYPE_MIXED
+} SchemaType;
+
+typedef struct SchemaNode {
+    SchemaType type;
+    int required;
+    int nullable;
+    struct SchemaNode* items;
+    struct PropertyNode* properties;
+    char** required_props;
+    int required_count;
+    int required_capacity;
+    cJSON* enum_values;
+    int enum_count;
+    unsigned type_mask;  // Types a TYPE_MIXED node read from a schema allows (1 << SchemaType), 0 for any
+    struct SchemaStats* stats;  // Value statistics, when inference collects them
+    // Open-addressing index over the property list, built once it is wide
+    struct PropertyNode** property_index;
+    int index_capacity;
+    int property_count;
+} SchemaNode;
+
+typedef struct PropertyNode {
+    char* name;
+    size_t name_len;
+    uint32_t name_hash; // Cache hash for faster lookups
+    SchemaNode* schema;
+    int required;
+    struct PropertyNode* next;
+} PropertyNode;
+
+// Fast hash function for property names
+static uint32_t hash_property_name(const char* name, size_t len) {
+    uint32_t hash = 2166136261u; // FNV-1a offset basis
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u; // FNV-1a prime
+    }
+    return hash;
+}
+
+// Per-path value statistics, attached to schema nodes when inference is asked
+// for them. Every field merges associatively, so blocks folded on different
+// threads and builders filled on different machines combine in any grouping.
+// Distinct values are counted exactly while they fit the enum set or a few
+// inline hashes, and by a HyperLogLog sketch of SCHEMA_HLL_PRECISION after.
+#define SCHEMA_HLL_REGISTERS (1 << SCHEMA_HLL_PRECISION)
+#define SCHEMA_STATS_INLINE_HASHES 8
+
+typedef struct SchemaStats {
+    uint64_t count;           // Values seen, nulls included
+    uint64_t nulls;
+    uint64_t numbers;         // Values behind min and max
+    double min;
+    double max;
+    uint64_t strings;         // Values behind the length range, counted in code points
+    uint64_t min_length;
+    uint64_t max_length;
+    uint64_t arrays;          // Values behind the item count range
+    uint64_t min_items;
+    uint64_t max_items;
+    uint8_t* registers;       // HyperLogLog registers, or NULL while hashes holds every distinct value
+    uint64_t hashes[SCHEMA_STATS_INLINE_HASHES];
+    int hash_count;
+    int enum_limit;           // Distinct values enum detection keeps, 0 when disabled
+    int enum_overflow;        // More than enum_limit distinct values were seen
+    int enum_count;
+    cJSON* enum_values;       // The distinct scalars while within enum_limit
+    uint64_t* enum_hashes;
+} SchemaStats;
+
+static uint64_t stats_mix64(uint64_t hash) {
+    // splitmix64 finalizer, so the register index and rank bits are independent
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+}
+
+// Hash of a scalar value; equal values hash alike whatever their spelling (1, 1.0)
+static uint64_t schema_value_hash(const cJSON* value) {
+    uint64_t hash = 0x9E3779B97F4A7C15ULL * (uint64_t)((value->type & 0xFF) | 1);
+    if (cJSON_IsString(value)) {
+        const char* data = value->valuestring;
+        size_t length = strlen_simd(data);
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            hash = (hash ^ word) * 0x100000001B3ULL;
+            hash ^= hash >> 29;
+        }
+        for (; i < length; i++) {
+            hash = (hash ^ (unsigned char)data[i]) * 0x100000001B3ULL;
+        }
+        hash ^= length;
+    } else if (cJSON_IsNumber(value)) {
+        double number = value->valuedouble;
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        if ((bits << 1) == 0) bits = 0;  // -0 is 0
+        hash ^= bits;
+    }
+    return stats_mix64(hash);
+}
+
+static void hll_add(uint8_t* registers, uint64_t hash) {
+    uint32_t index = (uint32_t)(hash >> (64 - SCHEMA_HLL_PRECISION));
+    uint64_t rest = hash << SCHEMA_HLL_PRECISION;
+    uint8_t rank = rest ? (uint8_t)(__builtin_clzll(rest) + 1) : (uint8_t)(65 - SCHEMA_HLL_PRECISION);
+    if (rank > registers[index]) registers[index] = rank;
+}
+
+// Switches to registers once the inline hashes are full; on allocation
+// failure the hash is dropped and the estimate runs low
+static void stats_note_hash(SchemaStats* stats, uint64_t hash) {
+    if (stats->registers) {
+        hll_add(stats->registers, hash);
+        return;
+    }
+    for (int i = 0; i < stats->hash_count; i++) {
+        if (stats->hashes[i] == hash) return;
+    }
+    if (stats->hash_count < SCHEMA_STATS_INLINE_HASHES) {
+        stats->hashes[stats->hash_count++] = hash;
+        return;
+    }
+
+    stats->registers = calloc(SCHEMA_HLL_REGISTERS, 1);
+    if (!stats->registers) return;
+    for (int i = 0; i < stats->hash_count; i++) {
+        hll_add(stats->registers, stats->hashes[i]);
+    }
+    stats->hash_count = 0;
+    hll_add(stats->registers, hash);
+}
+
+static void stats_drop_enum(SchemaStats* stats) {
+    stats->enum_overflow = 1;
+    stats->enum_count = 0;
+    cJSON_Delete(stats->enum_values);
+    stats->enum_values = NULL;
+    free(stats->enum_hashes);
+    stats->enum_hashes = NULL;
+}
+
+// Adds a copy of value to the enum set unless it is there already
+static void stats_note_enum(SchemaStats* stats, const cJSON* value, uint64_t hash) {
+    if (stats->enum_limit <= 0 || stats->enum_overflow) return;
+
+    const cJSON* known = stats->enum_values ? stats->enum_values->child : NULL;
+    for (int i = 0; known; i++, known = known->next) {
+        if (stats->enum_hashes[i] == hash && cJSON_Compare(known, value, 1)) return;
+    }
+    if (stats->enum_count >= stats->enum_limit) {
+        stats_drop_enum(stats);
+        return;
+    }
+
+    if (!stats->enum_values) {
+        stats->enum_values = cJSON_CreateArray();
+        stats->enum_hashes = malloc((size_t)stats->enum_limit * sizeof(uint64_t));
+    }
+    cJSON* copy = stats->enum_values && stats->enum_hashes ? cJSON_Duplicate(value, 0) : NULL;
+    if (!copy) {
+        stats_drop_enum(stats);  // Cannot tell the set is complete any more
+        return;
+    }
+    cJSON_AddItemToArray(stats->enum_values, copy);
+    stats->enum_hashes[stats->enum_count++] = hash;
+}
+
+static void schema_stats_free(SchemaStats* stats) {
+    if (!stats) return;
+    free(stats->registers);
+    cJSON_Delete(stats->enum_values);
+    free(stats->enum_hashes);
+    free(stats);
+}
+
+// Code points of a UTF-8 string, as minLength and maxLength count them
+static uint64_t utf8_length(const char* text) {
+    uint64_t length = 0;
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        length += (*p & 0xC0) != 0x80;
+    }
+    return length;
+}
+
+// Statistics of a single value
+static SchemaStats* schema_stats_create(const cJSON* value, int enum_limit) {
+    SchemaStats* stats = calloc(1, sizeof(SchemaStats));
+    if (!stats) return NULL;
+    stats->enum_limit = enum_limit;
+    stats->count = 1;
+
+    switch (value->type & 0xFF) {
+        case cJSON_NULL:
+            stats->nulls = 1;
+            return stats;
+        case cJSON_Number:
+            stats->numbers = 1;
+            stats->min = stats->max = value->valuedouble;
+            break;
+        case cJSON_String:
+            stats->strings = 1;
+            stats->min_length = stats->max_length = utf8_length(value->valuestring);
+            break;
+        case cJSON_Array:
+            stats->arrays = 1;
+            stats->min_items = stats->max_items = (uint64_t)cJSON_GetArraySize(value);
+            return stats;
+        case cJSON_Object:
+            return stats;
+        default:
+            break;
+    }
+
+    uint64_t hash = schema_value_hash(value);
+    stats_note_hash(stats, hash);
+    stats_note_enum(stats, value, hash);
+    return stats;
+}
+
+// Folds src into dst; src is left unchanged
+static void schema_stats_merge(SchemaStats* dst, const SchemaStats* src) {
+    if (src->numbers) {
+        if (!dst->numbers || src->min < dst->min) dst->min = src->min;
+        if (!dst->numbers || src->max > dst->max) dst->max = src->max;
+    }
+    if (src->strings) {
+        if (!dst->strings || src->min_length < dst->min_length) dst->min_length = src->min_length;
+        if (!dst->strings || src->max_length > dst->max_length) dst->max_length = src->max_length;
+    }
+    if (src->arrays) {
+        if (!dst->arrays || src->min_items < dst->min_items) dst->min_items = src->min_items;
+        if (!dst->arrays || src->max_items > dst->max_items) dst->max_items = src->max_items;
+    }
+    dst->count += src->count;
+    dst->nulls += src->nulls;
+    dst->numbers += src->numbers;
+    dst->strings += src->strings;
+    dst->arrays += src->arrays;
+
+    if (src->registers) {
+        if (!dst->registers) {
+            uint8_t* registers = malloc(SCHEMA_HLL_REGISTERS);
+            if (registers) {
+                memcpy(registers, src->registers, SCHEMA_HLL_REGISTERS);
+                for (int i = 0; i < dst->hash_count; i++) hll_add(registers, dst->hashes[i]);
+                dst->registers = registers;
+                dst->hash_count = 0;
+            }
+        } else {
+            for (int i = 0; i < SCHEMA_HLL_REGISTERS; i++) {
+                if (src->registers[i] > dst->registers[i]) dst->registers[i] = src->registers[i];
+            }
+        }
+    } else {
+        for (int i = 0; i < src->hash_count; i++) stats_note_hash(dst, src->hashes[i]);
+    }
+
+    if (src->enum_overflow) {
+        if (!dst->enum_overflow) stats_drop_enum(dst);
+    } else {
+        const cJSON* value = src->enum_values ? src->enum_values->child : NULL;
+        for (int i = 0; value && i < src->enum_count; i++, value = value->next) {
+            stats_note_enum(dst, value, src->enum_hashes[i]);
+        }
+    }
+}
+
+static SchemaStats* schema_stats_clone(const SchemaStats* stats) {
+    SchemaStats* copy = calloc(1, sizeof(SchemaStats));
+    if (!copy) return NULL;
+    copy->enum_limit = stats->enum_limit;
+    schema_stats_merge(copy, stats);
+    return copy;
+}
+
+// Distinct non-null scalars: exact within the enum set or the inline hashes,
+// estimated from the registers beyond
+static double schema_stats_distinct(const SchemaStats* stats) {
+    if (stats->enum_limit > 0 && !stats->enum_overflow) return stats->enum_count;
+    if (!stats->registers) return stats->hash_count;
+
+    double sum = 0.0;
+    int zeros = 0;
+    for (int i = 0; i < SCHEMA_HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -stats->registers[i]);
+        zeros += stats->registers[i] == 0;
+    }
+    double m = SCHEMA_HLL_REGISTERS;
+    double estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / zeros);  // Linear counting is closer for small sets
+    }
+    return estimate;
+}
+
+// "x-stats" annotation of a schema node
+static cJSON* schema_stats_to_json(const SchemaStats* stats) {
+    cJSON* json = cJSON_CreateObject();
+    if (!json) return NULL;
+
+    cJSON_AddNumberToObject(json, "count", (double)stats->count);
+    cJSON_AddNumberToObject(json, "nulls", (double)stats->nulls);
+    cJSON_AddNumberToObject(json, "null_ratio", stats->count ? (double)stats->nulls / (double)stats->count : 0.0);
+    if (stats->registers || stats->hash_count > 0) {
+        // The estimate can overshoot; there are never more values than non-null records
+        double distinct = floor(schema_stats_distinct(stats) + 0.5);
+        double values = (double)(stats->count - stats->nulls);
+        cJSON_AddNumberToObject(json, "distinct", distinct < values ? distinct : values);
+    }
+    if (stats->numbers) {
+        cJSON_AddNumberToObject(json, "minimum", stats->min);
+        cJSON_AddNumberToObject(json, "maximum", stats->max);
+    }
+    if (stats->strings) {
+        cJSON_AddNumberToObject(json, "min_length", (double)stats->min_length);
+        cJSON_AddNumberToObject(json, "max_length", (double)stats->max_length);
+    }
+    if (stats->arrays) {
+        cJSON_AddNumberToObject(json, "min_items", (double)stats->min_items);
+        cJSON_AddNumberToObject(json, "max_items", (double)stats->max_items);
+    }
+    if (stats->enum_values && stats->enum_count > 0) {
+        cJSON* values = cJSON_Duplicate(stats->enum_values, 1);
+        if (values) cJSON_AddItemToObject(json, "enum", values);
+    }
+    return json;
+}
+
+static void stats_hex_append(char* text, uint64_t value, int digits) {
+    static const char hex[] = "0123456789abcdef";
+    for (int i = digits - 1; i >= 0; i--, value >>= 4) text[i] = hex[value & 0xF];
+}
+
+static int stats_hex_parse(const char* text, int digits, uint64_t* value) {
+    *value = 0;
+    for (int i = 0; i < digits; i++) {
+        char c = text[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (digit < 0) return -1;
+        *value = *value << 4 | (uint64_t)digit;
+    }
+    return 0;
+}
+
+// Builder state of a node's statistics; hashes and registers are written in hex
+static cJSON* schema_stats_to_state(const SchemaStats* stats) {
+    cJSON* state = cJSON_CreateObject();
+    if (!state) return NULL;
+
+    cJSON_AddNumberToObject(state, "count", (double)stats->count);
+    cJSON_AddNumberToObject(state, "nulls", (double)stats->nulls);
+    cJSON_AddNumberToObject(state, "numbers", (double)stats->numbers);
+    cJSON_AddNumberToObject(state, "min", stats->numbers ? stats->min : 0.0);
+    cJSON_AddNumberToObject(state, "max", stats->numbers ? stats->max : 0.0);
+    cJSON_AddNumberToObject(state, "strings", (double)stats->strings);
+    cJSON_AddNumberToObject(state, "min_length", (double)stats->min_length);
+    cJSON_AddNumberToObject(state, "max_length", (double)stats->max_length);
+    cJSON_AddNumberToObject(state, "arrays", (double)stats->arrays);
+    cJSON_AddNumberToObject(state, "min_items", (double)stats->min_items);
+    cJSON_AddNumberToObject(state, "max_items", (double)stats->max_items);
+    cJSON_AddNumberToObject(state, "enum_limit", stats->enum_limit);
+    cJSON_AddBoolToObject(state, "enum_overflow", stats->enum_overflow);
+    if (stats->enum_values) {
+        cJSON* values = cJSON_Duplicate(stats->enum_values, 1);
+        if (!values) {
+            cJSON_Delete(state);
+            return NULL;
+        }
+        cJSON_AddItemToObject(state, "enum", values);
+    }
+
+    char text[2 * SCHEMA_HLL_REGISTERS + 1];
+    if (stats->registers) {
+        for (int i = 0; i < SCHEMA_HLL_REGISTERS; i++) stats_hex_append(text + 2 * i, stats->registers[i], 2);
+        text[2 * SCHEMA_HLL_REGISTERS] = '\0';
+        cJSON_AddStringToObject(state, "registers", text);
+    } else {
+        cJSON* hashes = cJSON_AddArrayToObject(state, "hashes");
+        for (int i = 0; hashes && i < stats->hash_count; i++) {
+            stats_hex_append(text, stats->hashes[i], 16);
+            text[16] = '\0';
+            cJSON_AddItemToArray(hashes, cJSON_CreateString(text));
+        }
+    }
+    return state;
+}
+
+static uint64_t stats_state_count(const cJSON* state, const char* name) {
+    const cJSON* value = cJSON_GetObjectItemCaseSensitive(state, name);
+    return cJSON_IsNumber(value) && value->valuedouble > 0 ? (uint64_t)value->valuedouble : 0;
+}
+
+static SchemaStats* schema_stats_from_state(const cJSON* state) {
+    SchemaStats* stats = calloc(1, sizeof(SchemaStats));
+    if (!stats || !cJSON_IsObject(state)) {
+        free(stats);
+        return NULL;
+    }
+
+    stats->count = stats_state_count(state, "count");
+    stats->nulls = stats_state_count(state, "nulls");
+    stats->numbers = stats_state_count(state, "numbers");
+    stats->strings = stats_state_count(state, "strings");
+    stats->min_length = stats_state_count(state, "min_length");
+    stats->max_length = stats_state_count(state, "max_length");
+    stats->arrays = stats_state_count(state, "arrays");
+    stats->min_items = stats_state_count(state, "min_items");
+    stats->max_items = stats_state_count(state, "max_items");
+    stats->enum_limit = (int)stats_state_count(state, "enum_limit");
+    const cJSON* min = cJSON_GetObjectItemCaseSensitive(state, "min");
+    const cJSON* max = cJSON_GetObjectItemCaseSensitive(state, "max");
+    stats->min = cJSON_IsNumber(min) ? min->valuedouble : 0.0;
+    stats->max = cJSON_IsNumber(max) ? max->valuedouble : 0.0;
+
+    int failed = 0;
+    const cJSON* registers = cJSON_GetObjectItemCaseSensitive(state, "registers");
+    const cJSON* hashes = cJSON_GetObjectItemCaseSensitive(state, "hashes");
+    if (registers) {
+        stats->registers = malloc(SCHEMA_HLL_REGISTERS);
+        failed = !stats->registers || !cJSON_IsString(registers) ||
+                 strlen_simd(registers->valuestring) != 2 * SCHEMA_HLL_REGISTERS;
+        for (int i = 0; !failed && i < SCHEMA_HLL_REGISTERS; i++) {
+            uint64_t rank;
+            failed = stats_hex_parse(registers->valuestring + 2 * i, 2, &rank) != 0;
+            stats->registers[i] = (uint8_t)rank;
+        }
+    } else {
+        const cJSON* hash = NULL;
+        cJSON_ArrayForEach(hash, hashes) {
+            uint64_t value;
+            if (!cJSON_IsString(hash) || strlen_simd(hash->valuestring) != 16 ||
+                stats_hex_parse(hash->valuestring, 16, &value) != 0) {
+                failed = 1;
+                break;
+            }
+            stats_note_hash(stats, value);
+        }
+    }
+
+    // The enum set is rebuilt value by value, which also recomputes its hashes
+    const cJSON* values = cJSON_GetObjectItemCaseSensitive(state, "enum");
+    if (cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(state, "enum_overflow"))) {
+        stats->enum_overflow = 1;
+    } else if (cJSON_IsArray(values)) {
+        const cJSON* value = NULL;
+        cJSON_ArrayForEach(value, values) {
+            stats_note_enum(stats, value, schema_value_hash(value));
+        }
+    }
+
+    if (failed) {
+        schema_stats_free(stats);
+        return NULL;
+    }
+    return stats;
+}
+
+static SchemaNode* create_schema_node(SchemaType type) {
+    // Temporarily use regular malloc to avoid memory pool issues
+    SchemaNode* node = malloc(sizeof(SchemaNode));
+    if (!node) return NULL;
+
+    memset(node, 0, sizeof(SchemaNode));
+    node->type = type;
+    node->required = 1;
+
+    return node;
+}
+
+static int rebuild_property_index(SchemaNode* node, int capacity) {
+    PropertyNode** index = calloc(capacity, sizeof(PropertyNode*));
+    if (UNLIKELY(!index)) return -1;
+
+    size_t mask = (size_t)capacity - 1;
+    for (PropertyNode* prop = node->properties; prop; prop = prop->next) {
+        size_t slot = prop->name_hash & mask;
+        while (index[slot]) slot = (slot + 1) & mask;
+        index[slot] = prop;
+    }
+
+    free(node->property_index);
+    node->property_index = index;
+    node->index_capacity = capacity;
+    return 0;
+}
+
+// Call after linking prop into node->properties; keeps the index at most half full
+static void index_property(SchemaNode* node, PropertyNode* prop) {
+    node->property_count++;
+    if (node->property_count <= SCHEMA_INDEX_THRESHOLD) return;
+
+    if (!node->property_index || node->property_count * 2 > node->index_capacity) {
+        int capacity = node->property_index ? node->index_capacity * 2 : SCHEMA_INDEX_THRESHOLD * 4;
+        if (rebuild_property_index(node, capacity) != 0) {
+            // Out of memory: drop the index and fall back to scanning the list
+            free(node->property_index);
+            node->property_index = NULL;
+            node->index_capacity = 0;
+        }
+        return;
+    }
+
+    size_t mask = (size_t)node->index_capacity - 1;
+    size_t slot = prop->name_hash & mask;
+    while (node->property_index[slot]) slot = (slot + 1) & mask;
+    node->property_index[slot] = prop;
+}
+
+static PropertyNode* create_property_node(const char* name, SchemaNode* property_schema, int required) {
+    PropertyNode* prop = slab_alloc(g_property_node_pool);
+    if (UNLIKELY(!prop)) {
+        prop = malloc(sizeof(PropertyNode));
+        if (!prop) return NULL;
+    }
+
+    size_t name_len = strlen_simd(name);
+    prop->name = my_strdup(name);
+    prop->name_len = name_len;
+    prop->name_hash = hash_property_name(name, name_len);
+    prop->schema = property_schema;
+    prop->required = required;
+    prop->next = NULL;
+    return prop;
+}
+
+static void note_required_property(SchemaNode* node, const char* name) {
+    if (UNLIKELY(node->required_count >= node->required_capacity)) {
+        int new_capacity = node->required_capacity == 0 ? 8 : node->required_capacity * 2;
+        char** new_props = realloc(node->required_props, new_capacity * sizeof(char*));
+        if (UNLIKELY(!new_props)) return;
+
+        node->required_props = new_props;
+        node->required_capacity = new_capacity;
+    }
+    node->required_props[node->required_count++] = my_strdup(name);
+}
+
+HOT_PATH void add_property(SchemaNode* node, const char* name, SchemaNode* property_schema, int required) {
+    PropertyNode* prop = create_property_node(name, property_schema, required);
+    if (UNLIKELY(!prop)) return;
+
+    prop->next = node->properties;
+    node->properties = prop;
+    index_property(node, prop);
+
+    if (required) {
+        note_required_property(node, name);
+    }
+}
+
+// Like add_property, but links after *tail so the list keeps insertion order
+static int append_property(SchemaNode* node, PropertyNode*** tail, const char* name,
+                           SchemaNode* property_schema, int required) {
+    PropertyNode* prop = create_property_node(name, property_schema, required);
+    if (UNLIKELY(!prop)) return -1;
+
+    **tail = prop;
+    *tail = &prop->next;
+    index_property(node, prop);
+
+    if (required) {
+        note_required_property(node, name);
+    }
+    return 0;
+}
+
+// Hash-indexed lookup for wide objects, list scan for narrow ones
+static PropertyNode* find_property(const SchemaNode* node, const char* name,
+                                   size_t name_len, uint32_t name_hash) {
+    if (node->property_index) {
+        size_t mask = (size_t)node->index_capacity - 1;
+        for (size_t slot = name_hash & mask; node->property_index[slot]; slot = (slot + 1) & mask) {
+            PropertyNode* prop = node->property_index[slot];
+            if (prop->name_hash == name_hash &&
+                prop->name_len == name_len &&
+                fast_memcmp(prop->name, name, name_len) == 0) {
+                return prop;
+            }
+        }
+        return NULL;
+    }
+
+    for (PropertyNode* prop = node->properties; prop; prop = prop->next) {
+        if (prop->name_hash == name_hash &&
+            prop->name_len == name_len &&
+            fast_memcmp(prop->name, name, name_len) == 0) {
+            return prop;
+        }
+    }
+    return NULL;
+}
+
+static void free_schema_node(SchemaNode* node) {
+    if (!node) return;
+
+    // Safety check for valid pointer
+    if ((uintptr_t)node < 0x1000) {
+        return; // Invalid pointer
+    }
+
+    if (node->items) {
+        free_schema_node(node->items);
+    }
+
+    PropertyNode* prop = node->properties;
+    while (prop) {
+        PropertyNode* next = prop->next;
+        my_strfree(prop->name);
+        free_schema_node(prop->schema);
+        slab_free(g_property_node_pool, prop);
+        prop = next;
+    }
+
+    free(node->property_index);
+
+    for (int i = 0; i < node->required_count; i++) {
+        my_strfree(node->required_props[i]);
+    }
+    free(node->required_props);
+
+    if (node->enum_values) {
+        cJSON_Delete(node->enum_values);
+    }
+    schema_stats_free(node->stats);
+
+    slab_free(g_cjson_node_pool, node);
+}
+
+static SchemaType get_schema_type(cJSON* json) {
+    switch (json->type & 0xFF) {
+        case cJSON_False:
+        case cJSON_True:
+            return TYPE_BOOLEAN;
+        case cJSON_NULL:
+            return TYPE_NULL;
+        case cJSON_Number:
+            if (json->valuedouble == (double)json->valueint &&
+                json->valuedouble >= INT_MIN && json->valuedouble <= INT_MAX) {
+                return TYPE_INTEGER;
+            }
+            return TYPE_NUMBER;
+        case cJSON_String:
+            return TYPE_STRING;
+        case cJSON_Array:
+            return TYPE_ARRAY;
+        case cJSON_Object:
+            return TYPE_OBJECT;
+        default:
+            return TYPE_NULL;
+    }
+}
+
+static SchemaNode* analyze_json_value(cJSON* json, const SchemaInferenceOptions* options);
+
+// Optimized schema merging with type compatibility matrix
+static const int type_compatibility[8][8] = {
+    // NULL, BOOL, INT, NUM, STR, ARR, OBJ, MIX
+    {1, 0, 0, 0, 0, 0, 0, 1}, // NULL
+    {0, 1, 0, 0, 0, 0, 0, 1}, // BOOLEAN
+    {0, 0, 1, 1, 0, 0, 0, 1}, // INTEGER
+    {0, 0, 1, 1, 0, 0, 0, 1}, // NUMBER
+    {0, 0, 0, 0, 1, 0, 0, 1}, // STRING
+    {0, 0, 0, 0, 0, 1, 0, 1}, // ARRAY
+    {0, 0, 0, 0, 0, 0, 1, 1}, // OBJECT
+    {1, 1, 1, 1, 1, 1, 1, 1}  // MIXED
+};
+
+static SchemaType merge_schema_types(SchemaType type1, SchemaType type2) {
+    if (!type_compatibility[type1][type2]) return TYPE_MIXED;
+    if (type1 == type2) return type1;
+    if ((type1 == TYPE_INTEGER && type2 == TYPE_NUMBER) ||
+        (type1 == TYPE_NUMBER && type2 == TYPE_INTEGER)) {
+        return TYPE_NUMBER;
+    }
+    return TYPE_MIXED;
+}
+
+static void free_property_node(PropertyNode* prop) {
+    my_strfree(prop->name);
+    free_schema_node(prop->schema);
+    slab_free(g_property_node_pool, prop);
+}
+
+// Drops items and properties once a node has widened to TYPE_MIXED
+static void clear_schema_children(SchemaNode* node) {
+    free_schema_node(node->items);
+    node->items = NULL;
+
+    PropertyNode* prop = node->properties;
+    while (prop) {
+        PropertyNode* next = prop->next;
+        free_property_node(prop);
+        prop = next;
+    }
+    node->properties = NULL;
+    free(node->property_index);
+    node->property_index = NULL;
+    node->index_capacity = 0;
+    node->property_count = 0;
+
+    for (int i = 0; i < node->required_count; i++) {
+        my_strfree(node->required_props[i]);
+    }
+    node->required_count = 0;
+}
+
+static void make_property_optional(SchemaNode* node, PropertyNode* prop) {
+    if (!prop->required) return;
+    prop->required = 0;
+
+    for (int i = 0; i < node->required_count; i++) {
+        if (strcmp(node->required_props[i], prop->name) == 0) {
+            my_strfree(node->required_props[i]);
+            node->required_props[i] = node->required_props[--node->required_count];
+            break;
+        }
+    }
+}
+
+/*
+ * Merges src into dst in place and consumes src. Subtrees that only one
+ * side has are moved rather than copied, and properties keep the order in
+ * which they first appeared, so folding contiguous runs of records and then
+ * merging the runs left to right gives the same schema as one long fold.
+ */
+static SchemaNode* merge_schema_into(SchemaNode* dst, SchemaNode* src) {
+    if (!dst) return src;
+    if (!src) return dst;
+
+    // Statistics describe the path whatever its type, and are kept only where
+    // both sides collected them
+    if (dst->stats && src->stats) {
+        schema_stats_merge(dst->stats, src->stats);
+    } else if (dst->stats) {
+        schema_stats_free(dst->stats);
+        dst->stats = NULL;
+    }
+
+    SchemaType merged_type = merge_schema_types(dst->type, src->type);
+    dst->required = dst->required && src->required;
+    dst->nullable = dst->nullable || src->nullable ||
+                    dst->type == TYPE_NULL || src->type == TYPE_NULL;
+    if (merged_type == TYPE_MIXED) {
+        clear_schema_children(dst);
+    }
+    dst->type = merged_type;
+
+    switch (merged_type) {
+        case TYPE_ARRAY:
+            dst->items = merge_schema_into(dst->items, src->items);
+            src->items = NULL;
+            break;
+
+        case TYPE_OBJECT: {
+            // Properties present on both sides merge; the rest turn optional
+            PropertyNode** tail = &dst->properties;
+            for (PropertyNode* prop = dst->properties; prop; prop = prop->next) {
+                PropertyNode* other = find_property(src, prop->name, prop->name_len, prop->name_hash);
+                if (other && other->schema) {
+                    prop->schema = merge_schema_into(prop->schema, other->schema);
+                    other->schema = NULL;
+                    if (!other->required) make_property_optional(dst, prop);
+                } else {
+                    prop->schema->nullable = 1;
+                    make_property_optional(dst, prop);
+                }
+                tail = &prop->next;
+            }
+
+            // Properties only src has move over to the end of dst's list
+            PropertyNode* prop = src->properties;
+            src->properties = NULL;
+            while (prop) {
+                PropertyNode* next = prop->next;
+                if (prop->schema &&
+                    !find_property(dst, prop->name, prop->name_len, prop->name_hash)) {
+                    prop->schema->nullable = 1;
+                    prop->required = 0;
+                    prop->next = NULL;
+                    *tail = prop;
+                    tail = &prop->next;
+                    index_property(dst, prop);
+                } else {
+                    free_property_node(prop);
+                }
+                prop = next;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    free_schema_node(src);
+    return dst;
+}
+
+// Distinct values enum detection keeps under options (0 when disabled)
+static int schema_enum_limit(const SchemaInferenceOptions* options) {
+    if (options->enum_limit == 0) return SCHEMA_ENUM_LIMIT;
+    return options->enum_limit > 0 ? options->enum_limit : 0;
+}
+
+// Node for an empty array's items, with empty statistics when they are
+// collected so merging with real items keeps them
+static SchemaNode* create_items_placeholder(const SchemaInferenceOptions* options) {
+    SchemaNode* node = create_schema_node(TYPE_NULL);
+    if (node && options && options->collect_stats) {
+        node->stats = calloc(1, sizeof(SchemaStats));
+        if (node->stats) node->stats->enum_limit = schema_enum_limit(options);
+    }
+    return node;
+}
+
+// Optimized JSON analysis with early type detection; options may be NULL
+static SchemaNode* analyze_json_value(cJSON* json, const SchemaInferenceOptions* options) {
+    if (!json) return NULL;
+    
+    SchemaType type = get_schema_type(json);
+    SchemaNode* node = create_schema_node(type);
+    int collect_stats = options && options->collect_stats;
+    if (collect_stats) {
+        node->stats = schema_stats_create(json, schema_enum_limit(options));
+    }
+    
+    if (type == TYPE_NULL) {
+        node->required = 0;
+        node->nullable = 1;
+        return node;
+    }
+    
+    switch (type) {
+        case TYPE_ARRAY: {
+            if (LIKELY(json->child != NULL)) {
+                // Sample the whole array when it is short, else its first and last
+                // MAX_ARRAY_SAMPLE_SIZE / 2 items. cJSON keeps the tail in
+                // child->prev, so sampling costs O(sample) however long the array is.
+                cJSON* samples[MAX_ARRAY_SAMPLE_SIZE];
+                int sample_size = 0;
+                cJSON* next = json->child;
+                while (next && sample_size < MAX_ARRAY_SAMPLE_SIZE) {
+                    samples[sample_size++] = next;
+                    next = next->next;
+                }
+                cJSON* tail = json->child->prev;
+                if (next && tail) {
+                    int from_tail = MAX_ARRAY_SAMPLE_SIZE / 2;
+                    for (int i = MAX_ARRAY_SAMPLE_SIZE - 1; i >= MAX_ARRAY_SAMPLE_SIZE - from_tail; i--) {
+                        samples[i] = tail;
+                        tail = tail->prev;
+                    }
+                }
+                
+                SchemaNode* items_schema = NULL;
+                SchemaType first_type = TYPE_NULL;
+                bool types_uniform = true;
+
+                for (int sampled = 0; sampled < sample_size; sampled++) {
+                    cJSON* item = samples[sampled];
+                    SchemaType item_type = get_schema_type(item);
+                    
+                    if (first_type == TYPE_NULL) {
+                        first_type = item_type;
+                        items_schema = analyze_json_value(item, options);
+                    } else if (item_type != first_type) {
+                        types_uniform = false;
+                        items_schema = merge_schema_into(items_schema, analyze_json_value(item, options));
+                    } else if (collect_stats) {
+                        // Statistics need every sampled item, not one per type
+                        items_schema = merge_schema_into(items_schema, analyze_json_value(item, options));
+                    }
+                    
+                    // Early exit if we know it's mixed
+                    if (!types_uniform && !collect_stats && items_schema && items_schema->type == TYPE_MIXED) {
+                        break;
+                    }
+                }
+
+                node->items = items_schema ? items_schema : create_items_placeholder(options);
+            } else {
+                node->items = create_items_placeholder(options);
+            }
+            break;
+        }
+        
+        case TYPE_OBJECT: {
+            cJSON* child = json->child;
+            while (child) {
+                SchemaNode* prop_schema = analyze_json_value(child, options);
+                add_property(node, child->string, prop_schema, prop_schema->required);
+                child = child->next;
+            }
+            break;
+        }
+        
+        default:
+            break;
+    }
+    
+    return node;
+}
+
+static const char* schema_type_to_string(SchemaType type) {
+    switch (type) {
+        case TYPE_NULL: return "null";
+        case TYPE_BOOLEAN: return "boolean";
+        case TYPE_INTEGER: return "integer";
+        case TYPE_NUMBER: return "number";
+        case TYPE_STRING: return "string";
+        case TYPE_ARRAY: return "array";
+        case TYPE_OBJECT: return "object";
+        case TYPE_MIXED: return "mixed";
+        default: return "unknown";
+    }
+}
+
+static cJSON* schema_node_to_json(SchemaNode* node);
+
+// Statistics go under a vendor keyword, which validators treat as an annotation
+static void add_schema_stats(cJSON* schema, const SchemaNode* node) {
+    cJSON* stats = node->stats ? schema_stats_to_json(node->stats) : NULL;
+    if (stats) cJSON_AddItemToObject(schema, "x-stats", stats);
+}
+
+// Optimized schema JSON generation with reusable components
+static cJSON* schema_node_to_json(SchemaNode* node) {
+    if (!node) return NULL;
+    
+    cJSON* schema = cJSON_CreateObject();
+    if (!schema) return NULL;
+    
+    cJSON_AddStringToObject(schema, "$schema", "http://json-schema.org/draft-07/schema#");
+    
+    if (node->type == TYPE_MIXED) {
+        cJSON* type_array = cJSON_CreateArray();
+        const char* types[] = {"string", "number", "integer", "boolean", "object", "array"};
+        for (int i = 0; i < 6; i++) {
+            cJSON_AddItemToArray(type_array, cJSON_CreateString(types[i]));
+        }
+        
+        if (node->nullable) {
+            cJSON_AddItemToArray(type_array, cJSON_CreateString("null"));
+        }
+        
+        cJSON_AddItemToObject(schema, "type", type_array);
+        add_schema_stats(schema, node);
+        return schema;
+    }
+    
+    if (node->nullable) {
+        cJSON* type_array = cJSON_CreateArray();
+        cJSON_AddItemToArray(type_array, cJSON_CreateString(schema_type_to_string(node->type)));
+        cJSON_AddItemToArray(type_array, cJSON_CreateString("null"));
+        cJSON_AddItemToObject(schema, "type", type_array);
+    } else {
+        cJSON_AddStringToObject(schema, "type", schema_type_to_string(node->type));
+    }
+    
+    switch (node->type) {
+        case TYPE_ARRAY:
+            if (node->items) {
+                cJSON* items_schema = schema_node_to_json(node->items);
+                if (items_schema) {
+                    cJSON_DeleteItemFromObject(items_schema, "$schema");
+                    cJSON_AddItemToObject(schema, "items", items_schema);
+                }
+            }
+            break;
+            
+        case TYPE_OBJECT:
+            if (node->properties) {
+                cJSON* props = cJSON_CreateObject();
+                cJSON* required = cJSON_CreateArray();
+                
+                PropertyNode* prop = node->properties;
+                while (prop) {
+                    cJSON* prop_schema = schema_node_to_json(prop->schema);
+                    if (prop_schema) {
+                        cJSON_DeleteItemFromObject(prop_schema, "$schema");
+                        cJSON_AddItemToObject(props, prop->name, prop_schema);
+                        
+                        if (prop->required) {
+                            cJSON_AddItemToArray(required, cJSON_CreateString(prop->name));
+                        }
+                    }
+                    prop = prop->next;
+                }
+                
+                cJSON_AddItemToObject(schema, "properties", props);
+                
+                if (cJSON_GetArraySize(required) > 0) {
+                    cJSON_AddItemToObject(schema, "required", required);
+                } else {
+                    cJSON_Delete(required);
+                }
+            }
+            break;
+            
+        default:
+            break;
+    }
+    
+    add_schema_stats(schema, node);
+    return schema;
+}
+
+typedef struct {
+    const JsonArrayView* view;
+    const SchemaInferenceOptions* options;
+    SchemaNode** accumulators;
+    int block_count;
+    int stride;  // Distance between the accumulators paired in a reduction round
+} SchemaBatchJob;
+
+// Each block folds a fixed, contiguous run of records into its accumulator
+static void analyze_schema_range(void* context, int begin, int end, int slot) {
+    (void)slot;
+    SchemaBatchJob* job = (SchemaBatchJob*)context;
+    long long count = job->view->count;
+    for (int block = begin; block < end; block++) {
+        int first = (int)(count * block / job->block_count);
+        int last = (int)(count * (block + 1) / job->block_count);
+        SchemaNode* accumulator = NULL;
+        for (int i = first; i < last; i++) {
+            accumulator = merge_schema_into(accumulator, analyze_json_value(job->view->items[i], job->options));
+        }
+        job->accumulators[block] = accumulator;
+    }
+}
+
+static void reduce_schema_range(void* context, int begin, int end, int slot) {
+    (void)slot;
+    SchemaBatchJob* job = (SchemaBatchJob*)context;
+    for (int pair = begin; pair < end; pair++) {
+        int left = pair * 2 * job->stride;
+        int right = left + job->stride;
+        if (right < job->block_count) {
+            job->accumulators[left] = merge_schema_into(job->accumulators[left], job->accumulators[right]);
+            job->accumulators[right] = NULL;
+        }
+    }
+}
+
+cJSON* generate_schema_from_object_opts(const cJSON* json, const SchemaInferenceOptions* options) {
+    if (!json) return NULL;
+
+    init_global_pools();
+
+    int outer = stats_transform_begin(1);
+    SchemaNode* schema_node = analyze_json_value((cJSON*)json, options);
+    stats_phase_end(outer);
+    if (!schema_node) return NULL;
+    
+    cJSON* schema = schema_node_to_json(schema_node);
+    free_schema_node(schema_node);
+    
+    return schema;
+}
+
+cJSON* generate_schema_from_object(cJSON* json) {
+    return generate_schema_from_object_opts(json, NULL);
+}
+
+// Merged schema of every record in the view; *out stays NULL for an empty view
+static int schema_node_from_view(const JsonArrayView* view, ThreadPool* pool,
+                                 const SchemaInferenceOptions* options, SchemaNode** out) {
+    *out = NULL;
+    int array_size = view->count;
+    if (array_size == 0) {
+        return 0;
+    }
+
+    // A few accumulators per thread keep memory independent of the batch size
+    int block_count = pool ? (pool->num_threads + 1) * SCHEMA_BLOCKS_PER_THREAD : 1;
+    if (block_count > array_size) block_count = array_size;
+
+    SchemaNode** accumulators = calloc(block_count, sizeof(SchemaNode*));
+    if (!accumulators) {
+        return -1;
+    }
+
+    int outer = stats_transform_begin((uint64_t)array_size);
+    SchemaBatchJob job = {view, options, accumulators, block_count, 1};
+    thread_pool_parallel_for(pool, block_count, 1, analyze_schema_range, &job);
+
+    // Pairwise tree reduction: log2(block_count) rounds, each one parallel
+    int merge_outer = stats_phase_begin(STATS_PHASE_MERGE);
+    for (job.stride = 1; job.stride < block_count; job.stride *= 2) {
+        int pairs = (block_count + 2 * job.stride - 1) / (2 * job.stride);
+        thread_pool_parallel_for(pool, pairs, 1, reduce_schema_range, &job);
+    }
+    stats_phase_end(merge_outer);
+    stats_phase_end(outer);
+
+    *out = accumulators[0];
+    free(accumulators);
+    return 0;
+}
+
+// Records analyzed out of count under a sample rate and size
+static int schema_sample_target(int count, double sample_rate, int sample_size) {
+    int target = count;
+    if (sample_rate > 0.0 && sample_rate < 1.0 && count > 0) {
+        target = (int)ceil(count * sample_rate);
+        if (target < 1) target = 1;
+    }
+    if (sample_size > 0 && sample_size < target) target = sample_size;
+    return target;
+}
+
+// splitmix64 step; samples are reproducible from the seed
+static uint64_t sample_next(uint64_t* state) {
+    *state += 0x9E3779B97F4A7C15ULL;
+    return stats_mix64(*state);
+}
+
+// Uniform in (0, 1)
+static double sample_uniform(uint64_t* state) {
+    return ((double)(sample_next(state) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static int compare_record_indices(const void* a, const void* b) {
+    int left = *(const int*)a;
+    int right = *(const int*)b;
+    return (left > right) - (left < right);
+}
+
+// Picks target of count indices uniformly with reservoir sampling (Li's
+// Algorithm L, which jumps straight to the next index it keeps), in ascending
+// order so the sample keeps record order
+static int* sample_record_indices(int count, int target, uint64_t seed) {
+    int* reservoir = malloc((size_t)target * sizeof(int));
+    if (!reservoir) return NULL;
+    for (int i = 0; i < target; i++) reservoir[i] = i;
+
+    uint64_t state = seed;
+    double weight = exp(log(sample_uniform(&state)) / target);
+    long long next = target - 1;
+    while (weight > 0.0) {
+        double gap = floor(log(sample_uniform(&state)) / log1p(-weight));
+        if (gap >= (double)(count - 1 - next)) break;
+        next += (long long)gap + 1;
+        reservoir[sample_next(&state) % (uint64_t)target] = (int)next;
+        weight *= exp(log(sample_uniform(&state)) / target);
+    }
+
+    qsort(reservoir, (size_t)target, sizeof(int), compare_record_indices);
+    return reservoir;
+}
+
+// Merged schema of a sample of the view's records as options set it, with
+// the number of records analyzed in *analyzed
+static int schema_node_from_sample(const JsonArrayView* view, ThreadPool* pool, const SchemaInferenceOptions* options,
+                                   uint64_t seed, SchemaNode** out, int* analyzed) {
+    int target = options ? schema_sample_target(view->count, options->sample_rate, options->sample_size) :
+                           view->count;
+    *analyzed = target;
+    if (target == view->count) {
+        return schema_node_from_view(view, pool, options, out);
+    }
+
+    *out = NULL;
+    int* indices = sample_record_indices(view->count, target, seed);
+    JsonArrayView sample = {malloc((size_t)target * sizeof(cJSON*)), target};
+    int status = -1;
+    if (indices && sample.items) {
+        for (int i = 0; i < target; i++) sample.items[i] = view->items[indices[i]];
+        status = schema_node_from_view(&sample, usable_batch_pool(pool, target), options, out);
+    }
+    free(sample.items);
+    free(indices);
+    return status;
+}
+
+// Records how much of the input a sampled schema describes
+static void add_sample_annotation(cJSON* schema, long records, long analyzed) {
+    if (analyzed >= records) return;
+
+    cJSON* sample = cJSON_AddObjectToObject(schema, "x-sample");
+    if (sample) {
+        cJSON_AddNumberToObject(sample, "records", (double)records);
+        cJSON_AddNumberToObject(sample, "sampled", (double)analyzed);
+    }
+}
+
+static cJSON* schema_from_view(const JsonArrayView* view, ThreadPool* pool, const SchemaInferenceOptions* options) {
+    SchemaNode* merged_schema;
+    int analyzed;
+    if (schema_node_from_sample(view, pool, options, options ? options->seed : 0, &merged_schema, &analyzed) != 0) {
+        return NULL;
+    }
+    if (!merged_schema) {
+        return cJSON_CreateObject();
+    }
+
+    cJSON* result = schema_node_to_json(merged_schema);
+    free_schema_node(merged_schema);
+    if (result) add_sample_annotation(result, view->count, analyzed);
+    return result;
+}
+
+cJSON* generate_schema_from_batch_opts(const cJSON* json_array, const SchemaInferenceOptions* options,
+                                       int use_threads, int num_threads) {
+    if (!json_array || json_array->type != cJSON_Array) {
+        return NULL;
+    }
+
+    init_global_pools();
+
+    JsonArrayView view;
+    if (json_array_view_init(&view, json_array) != 0) {
+        return NULL;
+    }
+
+    // Enhanced threading heuristics for schema generation
+    bool should_use_threads = use_threads && 
+                             view.count >= MIN_BATCH_SIZE_FOR_MT && 
+                             get_optimal_threads(num_threads) > 1;
+
+    ThreadPool* pool = should_use_threads ? thread_pool_acquire_shared(num_threads) : NULL;
+    cJSON* result = schema_from_view(&view, pool, options);
+    thread_pool_release(pool);
+
+    json_array_view_free(&view);
+    return result;
+}
+
+cJSON* generate_schema_from_batch(cJSON* json_array, int use_threads, int num_threads) {
+    return generate_schema_from_batch_opts(json_array, NULL, use_threads, num_threads);
+}
+
+cJSON* generate_schema_from_view_opts(const JsonArrayView* records, ThreadPool* pool,
+                                      const SchemaInferenceOptions* options) {
+    if (!records) return NULL;
+
+    init_global_pools();
+    return schema_from_view(records, usable_batch_pool(pool, records->count), options);
+}
+
+cJSON* generate_schema_from_view(const JsonArrayView* records, ThreadPool* pool) {
+    return generate_schema_from_view_opts(records, pool, NULL);
+}
+
+cJSON* generate_schema_from_batch_with_pool(const cJSON* json_array, ThreadPool* pool) {
+    if (!json_array || json_array->type != cJSON_Array) {
+        return NULL;
+    }
+
+    init_global_pools();
+
+    JsonArrayView view;
+    if (json_array_view_init(&view, json_array) != 0) {
+        return NULL;
+    }
+
+    cJSON* result = schema_from_view(&view, usable_batch_pool(pool, view.count), NULL);
+
+    json_array_view_free(&view);
+    return result;
+}
+
+// Schema text for a parsed object or batch, like generate_schema_from_string_opts
+static char* schema_parsed_json_text(cJSON* json, const SchemaInferenceOptions* options,
+                                     int use_threads, int num_threads) {
+    cJSON* schema = NULL;
+    
+    if (json->type == cJSON_Array) {
+        schema = generate_schema_from_batch_opts(json, options, use_threads, num_threads);
+    } else {
+        schema = generate_schema_from_object_opts(json, options);
+    }
+    
+    char* result = NULL;
+    if (schema) {
+        result = cjson_tools_print(schema, 1);
+        cJSON_Delete(schema);
+    }
+    return result;
+}
+
+char* generate_schema_from_string_opts(const char* json_string, const SchemaInferenceOptions* options,
+                                       int use_threads, int num_threads) {
+    if (!json_string) return NULL;
+    
+    if (use_threads) {
+        JsonArrayView records;
+        ThreadPool* pool = parse_array_on_shared_pool(json_string, strlen_simd(json_string), num_threads, &records);
+        if (pool) {
+            cJSON* schema = generate_schema_from_view_opts(&records, pool, options);
+            char* result = schema ? cjson_tools_print(schema, 1) : NULL;
+            cJSON_Delete(schema);
+            json_array_view_delete(&records);
+            thread_pool_release(pool);
+            return result;
+        }
+    }
+    
+    cJSON* json = parse_json_string(json_string);
+    if (!json) {
+        const char* error_ptr = cJSON_GetErrorPtr();
+        if (error_ptr) {
+            fprintf(stderr, "Error parsing JSON: %s\n", error_ptr);
+        }
+        return NULL;
+    }
+    
+    char* result = schema_parsed_json_text(json, options, use_threads, num_threads);
+    
+    cJSON_Delete(json);
+    return result;
+}
+
+char* generate_schema_from_string(const char* json_string, int use_threads, int num_threads) {
+    return generate_schema_from_string_opts(json_string, NULL, use_threads, num_threads);
+}
+
+// =============================================================================
+// INCREMENTAL SCHEMA BUILDER
+// =============================================================================
+
+#define SCHEMA_STATE_FORMAT "cjson-tools-schema-state"
+#define SCHEMA_STATE_VERSION 1
+
+struct SchemaBuilder {
+    SchemaNode* root;
+    long record_count;
+    long sampled_count;              // Records analyzed, below record_count when sampling
+    SchemaInferenceOptions options;
+    uint64_t random;                 // Sampling state, advanced per record or batch
+};
+
+static SchemaNode* clone_schema_node(const SchemaNode* node) {
+    if (!node) return NULL;
+
+    SchemaNode* copy = create_schema_node(node->type);
+    if (!copy) return NULL;
+    copy->required = node->required;
+    copy->nullable = node->nullable;
+    copy->type_mask = node->type_mask;
+    if (node->stats) {
+        copy->stats = schema_stats_clone(node->stats);
+        if (!copy->stats) {
+            free_schema_node(copy);
+            return NULL;
+        }
+    }
+
+    if (node->items) {
+        copy->items = clone_schema_node(node->items);
+        if (!copy->items) {
+            free_schema_node(copy);
+            return NULL;
+        }
+    }
+
+    PropertyNode** tail = &copy->properties;
+    for (const PropertyNode* prop = node->properties; prop; prop = prop->next) {
+        SchemaNode* prop_schema = clone_schema_node(prop->schema);
+        if (!prop_schema || append_property(copy, &tail, prop->name, prop_schema, prop->required) != 0) {
+            free_schema_node(prop_schema);
+            free_schema_node(copy);
+            return NULL;
+        }
+    }
+    return copy;
+}
+
+static cJSON* schema_node_to_state(const SchemaNode* node) {
+    cJSON* state = cJSON_CreateObject();
+    if (!state) return NULL;
+
+    cJSON_AddStringToObject(state, "type", schema_type_to_string(node->type));
+    cJSON_AddBoolToObject(state, "required", node->required);
+    cJSON_AddBoolToObject(state, "nullable", node->nullable);
+    if (node->stats) {
+        cJSON* stats = schema_stats_to_state(node->stats);
+        if (!stats) {
+            cJSON_Delete(state);
+            return NULL;
+        }
+        cJSON_AddItemToObject(state, "stats", stats);
+    }
+
+    if (node->items) {
+        cJSON* items = schema_node_to_state(node->items);
+        if (!items) {
+            cJSON_Delete(state);
+            return NULL;
+        }
+        cJSON_AddItemToObject(state, "items", items);
+    }
+
+    if (node->properties) {
+        cJSON* props = cJSON_AddArrayToObject(state, "properties");
+        for (const PropertyNode* prop = node->properties; prop; prop = prop->next) {
+            cJSON* entry = cJSON_CreateObject();
+            cJSON* prop_state = schema_node_to_state(prop->schema);
+            if (!props || !entry || !prop_state) {
+                cJSON_Delete(entry);
+                cJSON_Delete(prop_state);
+                cJSON_Delete(state);
+                return NULL;
+            }
+            cJSON_AddStringToObject(entry, "name", prop->name);
+            cJSON_AddBoolToObject(entry, "required", prop->required);
+            cJSON_AddItemToObject(entry, "schema", prop_state);
+            cJSON_AddItemToArray(props, entry);
+        }
+    }
+    return state;
+}
+
+static int schema_type_from_string(const char* name, SchemaType* type) {
+    for (int t = TYPE_NULL; t <= TYPE_MIXED; t++) {
+        if (strcmp(schema_type_to_string((SchemaType)t), name) == 0) {
+            *type = (SchemaType)t;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static SchemaNode* schema_node_from_state(const cJSON* state) {
+    const cJSON* type_name = cJSON_GetObjectItemCaseSensitive(state, "type");
+    SchemaType type;
+    if (!cJSON_IsString(type_name) || schema_type_from_string(type_name->valuestring, &type) != 0) {
+        return NULL;
+    }
+
+    SchemaNode* node = create_schema_node(type);
+    if (!node) return NULL;
+    node->required = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(state, "required"));
+    node->nullable = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(state, "nullable"));
+
+    const cJSON* stats = cJSON_GetObjectItemCaseSensitive(state, "stats");
+    if (stats) {
+        node->stats = schema_stats_from_state(stats);
+        if (!node->stats) {
+            free_schema_node(node);
+            return NULL;
+        }
+    }
+
+    const cJSON* items = cJSON_GetObjectItemCaseSensitive(state, "items");
+    if (items) {
+        node->items = schema_node_from_state(items);
+        if (!node->items) {
+            free_schema_node(node);
+            return NULL;
+        }
+    }
+
+    const cJSON* props = cJSON_GetObjectItemCaseSensitive(state, "properties");
+    if (props && !cJSON_IsArray(props)) {
+        free_schema_node(node);
+        return NULL;
+    }
+
+    PropertyNode** tail = &node->properties;
+    const cJSON* entry = NULL;
+    cJSON_ArrayForEach(entry, props) {
+        const cJSON* name = cJSON_GetObjectItemCaseSensitive(entry, "name");
+        const cJSON* prop_state = cJSON_GetObjectItemCaseSensitive(entry, "schema");
+        SchemaNode* prop_schema = cJSON_IsString(name) && prop_state ? schema_node_from_state(prop_state) : NULL;
+        int required = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(entry, "required"));
+        if (!prop_schema || append_property(node, &tail, name->valuestring, prop_schema, required) != 0) {
+            free_schema_node(prop_schema);
+            free_schema_node(node);
+            return NULL;
+        }
+    }
+    return node;
+}
+
+SchemaBuilder* schema_builder_create_with_options(const SchemaInferenceOptions* options) {
+    init_global_pools();
+    SchemaBuilder* builder = calloc(1, sizeof(SchemaBuilder));
+    if (builder && options) {
+        builder->options = *options;
+        builder->random = options->seed;
+    }
+    return builder;
+}
+
+SchemaBuilder* schema_builder_create(void) {
+    return schema_builder_create_with_options(NULL);
+}
+
+int schema_builder_add(SchemaBuilder* builder, const cJSON* record) {
+    if (!builder || !record) return -1;
+
+    // Single records are kept with probability sample_rate; sample_size
+    // only bounds batches, as a running reservoir would need the records
+    double rate = builder->options.sample_rate;
+    if (rate > 0.0 && rate < 1.0 && sample_uniform(&builder->random) >= rate) {
+        builder->record_count++;
+        return 0;
+    }
+
+    int outer = stats_transform_begin(1);
+    SchemaNode* record_schema = analyze_json_value((cJSON*)record, &builder->options);
+    if (record_schema) {
+        builder->root = merge_schema_into(builder->root, record_schema);
+        builder->record_count++;
+        builder->sampled_count++;
+    }
+    stats_phase_end(outer);
+    return record_schema ? 0 : -1;
+}
+
+static int schema_builder_add_view(SchemaBuilder* builder, const cJSON* json_array, int use_threads,
+                                   int num_threads, ThreadPool* pool) {
+    if (!builder || !json_array || json_array->type != cJSON_Array) {
+        return -1;
+    }
+
+    JsonArrayView view;
+    if (json_array_view_init(&view, json_array) != 0) {
+        return -1;
+    }
+
+    ThreadPool* shared = NULL;
+    if (pool) {
+        pool = usable_batch_pool(pool, view.count);
+    } else if (use_threads && view.count >= MIN_BATCH_SIZE_FOR_MT && get_optimal_threads(num_threads) > 1) {
+        pool = shared = thread_pool_acquire_shared(num_threads);
+    }
+
+    SchemaNode* batch_schema;
+    int analyzed;
+    int status = schema_node_from_sample(&view, pool, &builder->options, sample_next(&builder->random),
+                                         &batch_schema, &analyzed);
+    thread_pool_release(shared);
+
+    if (status == 0) {
+        int outer = stats_phase_begin(STATS_PHASE_MERGE);
+        builder->root = merge_schema_into(builder->root, batch_schema);
+        stats_phase_end(outer);
+        builder->record_count += view.count;
+        builder->sampled_count += analyzed;
+    }
+
+    json_array_view_free(&view);
+    return status;
+}
+
+int schema_builder_add_batch(SchemaBuilder* builder, const cJSON* json_array, int use_threads, int num_threads) {
+    return schema_builder_add_view(builder, json_array, use_threads, num_threads, NULL);
+}
+
+int schema_builder_add_batch_with_pool(SchemaBuilder* builder, const cJSON* json_array, ThreadPool* pool) {
+    return schema_builder_add_view(builder, json_array, 0, 0, pool);
+}
+
+int schema_builder_merge(SchemaBuilder* builder, const SchemaBuilder* other) {
+    if (!builder || !other) return -1;
+
+    int outer = stats_phase_begin(STATS_PHASE_MERGE);
+    SchemaNode* copy = NULL;
+    if (other->root) {
+        copy = clone_schema_node(other->root);
+        if (!copy) {
+            stats_phase_end(outer);
+            return -1;
+        }
+    }
+
+    builder->root = merge_schema_into(builder->root, copy);
+    stats_phase_end(outer);
+    builder->record_count += other->record_count;
+    builder->sampled_count += other->sampled_count;
+    return 0;
+}
+
+long schema_builder_record_count(const SchemaBuilder* builder) {
+    return builder ? builder->record_count : 0;
+}
+
+cJSON* schema_builder_to_json(const SchemaBuilder* builder) {
+    if (!builder) return NULL;
+    if (!builder->root) return cJSON_CreateObject();
+
+    cJSON* schema = schema_node_to_json(builder->root);
+    if (schema) add_sample_annotation(schema, builder->record_count, builder->sampled_count);
+    return schema;
+}
+
+char* schema_builder_serialize(const SchemaBuilder* builder) {
+    if (!builder) return NULL;
+
+    cJSON* state = cJSON_CreateObject();
+    if (!state) return NULL;
+
+    cJSON_AddStringToObject(state, "format", SCHEMA_STATE_FORMAT);
+    cJSON_AddNumberToObject(state, "version", SCHEMA_STATE_VERSION);
+    cJSON_AddNumberToObject(state, "records", (double)builder->record_count);
+    cJSON_AddNumberToObject(state, "sampled", (double)builder->sampled_count);
+
+    // Options and the sampling state let a restored builder carry on the same way
+    char random[17];
+    stats_hex_append(random, builder->random, 16);
+    random[16] = '\0';
+    cJSON* options = cJSON_AddObjectToObject(state, "options");
+    if (options) {
+        cJSON_AddNumberToObject(options, "sample_rate", builder->options.sample_rate);
+        cJSON_AddNumberToObject(options, "sample_size", builder->options.sample_size);
+        cJSON_AddBoolToObject(options, "collect_stats", builder->options.collect_stats);
+        cJSON_AddNumberToObject(options, "enum_limit", builder->options.enum_limit);
+        cJSON_AddStringToObject(options, "random", random);
+    }
+
+    char* result = NULL;
+    cJSON* root = builder->root ? schema_node_to_state(builder->root) : cJSON_CreateNull();
+    if (root) {
+        cJSON_AddItemToObject(state, "root", root);
+        result = cjson_tools_print(state, 0);
+    }
+
+    cJSON_Delete(state);
+    return result;
+}
+
+// Sampling fields are optional so states written before them still load
+static void schema_builder_restore_options(SchemaBuilder* builder, const cJSON* state) {
+    const cJSON* sampled = cJSON_GetObjectItemCaseSensitive(state, "sampled");
+    if (cJSON_IsNumber(sampled) && sampled->valuedouble >= 0 && sampled->valuedouble <= builder->record_count) {
+        builder->sampled_count = (long)sampled->valuedouble;
+    }
+
+    const cJSON* options = cJSON_GetObjectItemCaseSensitive(state, "options");
+    if (!cJSON_IsObject(options)) return;
+
+    const cJSON* rate = cJSON_GetObjectItemCaseSensitive(options, "sample_rate");
+    const cJSON* size = cJSON_GetObjectItemCaseSensitive(options, "sample_size");
+    const cJSON* enum_limit = cJSON_GetObjectItemCaseSensitive(options, "enum_limit");
+    const cJSON* random = cJSON_GetObjectItemCaseSensitive(options, "random");
+    if (cJSON_IsNumber(rate)) builder->options.sample_rate = rate->valuedouble;
+    if (cJSON_IsNumber(size)) builder->options.sample_size = size->valueint;
+    if (cJSON_IsNumber(enum_limit)) builder->options.enum_limit = enum_limit->valueint;
+    builder->options.collect_stats = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(options, "collect_stats"));
+    if (cJSON_IsString(random) && strlen_simd(random->valuestring) == 16) {
+        stats_hex_parse(random->valuestring, 16, &builder->random);
+    }
+}
+
+SchemaBuilder* schema_builder_deserialize(const char* state_string) {
+    if (!state_string) return NULL;
+
+    cJSON* state = cJSON_Parse(state_string);
+    if (!state) {
+        fprintf(stderr, "Error parsing schema builder state\n");
+        return NULL;
+    }
+
+    const cJSON* format = cJSON_GetObjectItemCaseSensitive(state, "format");
+    const cJSON* version = cJSON_GetObjectItemCaseSensitive(state, "version");
+    const cJSON* records = cJSON_GetObjectItemCaseSensitive(state, "records");
+    const cJSON* root = cJSON_GetObjectItemCaseSensitive(state, "root");
+    if (!cJSON_IsString(format) || strcmp(format->valuestring, SCHEMA_STATE_FORMAT) != 0 ||
+        !cJSON_IsNumber(version) || version->valueint != SCHEMA_STATE_VERSION ||
+        !cJSON_IsNumber(records) || records->valuedouble < 0 || !root) {
+        fprintf(stderr, "Error: unsupported schema builder state\n");
+        cJSON_Delete(state);
+        return NULL;
+    }
+
+    SchemaBuilder* builder = schema_builder_create();
+    if (builder) {
+        builder->record_count = (long)records->valuedouble;
+        builder->sampled_count = builder->record_count;
+        schema_builder_restore_options(builder, state);
+        if (!cJSON_IsNull(root)) {
+            builder->root = schema_node_from_state(root);
+            if (!builder->root) {
+                fprintf(stderr, "Error: malformed schema builder state\n");
+                schema_builder_free(builder);
+                builder = NULL;
+            }
+        }
+    }
+
+    cJSON_Delete(state);
+    return builder;
+}
+
+void schema_builder_free(SchemaBuilder* builder) {
+    if (!builder) return;
+    free_schema_node(builder->root);
+    free(builder);
+}
+
+// =============================================================================
+// NDJSON (JSON LINES) STREAMING
+// =============================================================================
+
+// Bounded line reader: input is consumed in NDJSON_CHUNK_SIZE reads and lines
+// that fit in a chunk are handed out in place without copying
+typedef struct {
+    FILE* input;
+    char* chunk;
+    size_t chunk_len;
+    size_t chunk_pos;
+    char* line;              // Spill buffer for lines crossing chunk boundaries
+    size_t line_len;
+    size_t line_capacity;
+    long line_number;
+    int eof;
+} NdjsonReader;
+
+static int ndjson_reader_init(NdjsonReader* reader, FILE* input) {
+    memset(reader, 0, sizeof(*reader));
+    reader->input = input;
+    reader->chunk = malloc(NDJSON_CHUNK_SIZE);
+    return reader->chunk ? 0 : -1;
+}
+
+static void ndjson_reader_free(NdjsonReader* reader) {
+    free(reader->chunk);
+    free(reader->line);
+    memset(reader, 0, sizeof(*reader));
+}
+
+static int ndjson_fill_chunk(NdjsonReader* reader) {
+    long n = stream_read_some(reader->input, reader->chunk, NDJSON_CHUNK_SIZE);
+    if (n < 0) return -1;
+    reader->chunk_len = (size_t)n;
+
+    reader->chunk_pos = 0;
+    if (reader->chunk_len == 0) reader->eof = 1;
+    return 0;
+}
+
+static int ndjson_line_append(NdjsonReader* reader, const char* data, size_t len) {
+    if (reader->line_len + len > reader->line_capacity) {
+        size_t new_capacity = reader->line_capacity ? reader->line_capacity : NDJSON_CHUNK_SIZE;
+        while (new_capacity < reader->line_len + len) new_capacity <<= 1;
+
+        char* new_line = realloc(reader->line, new_capacity);
+        if (!new_line) return -1;
+        reader->line = new_line;
+        reader->line_capacity = new_capacity;
+    }
+
+    fast_memcpy(reader->line + reader->line_len, data, len);
+    reader->line_len += len;
+    return 0;
+}
+
+// Returns 1 when a line is available, 0 at end of input and -1 on error.
+// The line is not NUL-terminated and stays valid until the next call.
+static int ndjson_next_line(NdjsonReader* reader, const char** line, size_t* length) {
+    reader->line_len = 0;
+
+    for (;;) {
+        if (reader->chunk_pos >= reader->chunk_len) {
+            if (reader->eof || ndjson_fill_chunk(reader) != 0) {
+                if (!reader->eof) return -1;
+                if (reader->line_len == 0) return 0;
+
+                // Final line without a trailing newline
+                *line = reader->line;
+                *length = reader->line_len;
+                reader->line_number++;
+                return 1;
+            }
+            continue;
+        }
+
+        const char* start = reader->chunk + reader->chunk_pos;
+        size_t available = reader->chunk_len - reader->chunk_pos;
+        const char* newline = memchr(start, '\n', available);
+
+        if (!newline) {
+            if (ndjson_line_append(reader, start, available) != 0) return -1;
+            reader->chunk_pos = reader->chunk_len;
+            continue;
+        }
+
+        size_t segment = (size_t)(newline - start);
+        reader->chunk_pos += segment + 1;
+        reader->line_number++;
+
+        if (reader->line_len == 0) {
+            *line = start;
+            *length = segment;
+        } else {
+            if (ndjson_line_append(reader, start, segment) != 0) return -1;
+            *line = reader->line;
+            *length = reader->line_len;
+        }
+
+        if (*length > 0 && (*line)[*length - 1] == '\r') (*length)--;
+        return 1;
+    }
 }
 
-// Ultra-fast key building with SIMD-optimized operations
-static inline void build_key_optimized(char* restrict buffer, size_t buffer_size,
-                                     const char* restrict prefix, const char* restrict suffix,
-                                     int is_array_index, int index) {
-    if (UNLIKELY(!buffer || buffer_size == 0)) return;
-    
-    if (!prefix || *prefix == '\0') {
-        if (is_array_index) {
-            snprintf(buffer, buffer_size, "[%d]", index);
-        } else if (suffix) {
-            size_t suffix_len = strlen_simd(suffix);
-            if (suffix_len + 1 < buffer_size) {
-                fast_memcpy(buffer, suffix, suffix_len);
-                buffer[suffix_len] = '\0';
-            } else {
-                strncpy(buffer, suffix, buffer_size - 1);
-                buffer[buffer_size - 1] = '\0';
+// Reads up to max_records records into a fresh array. Blank lines are skipped.
+// Returns the number of records read, or -1 on read or parse errors.
+static int ndjson_read_batch(NdjsonReader* reader, int max_records, cJSON** batch_out) {
+    cJSON* batch = cJSON_CreateArray();
+    if (!batch) return -1;
+
+    int outer = stats_phase_begin(STATS_PHASE_PARSE);
+    size_t bytes = 0;
+    int count = 0;
+    while (count < max_records) {
+        const char* line;
+        size_t length;
+        int status = ndjson_next_line(reader, &line, &length);
+        if (status == 0) break;
+        if (status < 0) {
+            fprintf(stderr, "Error reading NDJSON input\n");
+            cJSON_Delete(batch);
+            stats_phase_end(outer);
+            return -1;
+        }
+
+        const char* content = skip_whitespace_optimized(line, length);
+        if (content == line + length) continue;
+
+        const char* parse_end = NULL;
+        cJSON* record = cJSON_ParseWithLengthOpts(line, length, &parse_end, 0);
+        if (record && skip_whitespace_optimized(parse_end, (size_t)(line + length - parse_end)) != line + length) {
+            cJSON_Delete(record);
+            record = NULL;
+        }
+        if (!record) {
+            fprintf(stderr, "Error parsing JSON at line %ld\n", reader->line_number);
+            cJSON_Delete(batch);
+            stats_phase_end(outer);
+            return -1;
+        }
+
+        cJSON_AddItemToArray(batch, record);
+        bytes += length;
+        count++;
+    }
+    stats_count(outer, STAT_BYTES_IN, bytes);
+    stats_phase_end(outer);
+
+    *batch_out = batch;
+    return count;
+}
+
+// Writes one line of text and takes ownership of it
+static int ndjson_write_text(FILE* output, char* text) {
+    if (!text) return -1;
+
+    int ok = fputs(text, output) >= 0 && fputc('\n', output) != EOF;
+    free(text);
+    return ok ? 0 : -1;
+}
+
+// Prints one record into a line buffer reused across records
+static int ndjson_write_record(FILE* output, const cJSON* record, OutputBuffer* line) {
+    int outer = stats_phase_begin(STATS_PHASE_SERIALIZE);
+    line->length = 0;
+    int ok = write_json_value(line, record, 0, 0);
+    output_buffer_append_char(line, '\n');
+    ok = ok && !line->failed;
+    if (ok) stats_count(outer, STAT_BYTES_OUT, line->length - 1);
+    stats_phase_end(outer);
+    if (!ok) return -1;
+    return fwrite(line->data, 1, line->length, output) == line->length ? 0 : -1;
+}
+
+long flatten_json_stream(FILE* input, FILE* output, int use_threads, int num_threads) {
+    if (!input || !output) return -1;
+
+    NdjsonReader reader;
+    if (ndjson_reader_init(&reader, input) != 0) return -1;
+
+    // Single-threaded runs go record by record so output starts immediately
+    int batch_size = use_threads ? BATCH_SIZE : 1;
+    long processed = 0;
+
+    for (;;) {
+        cJSON* batch = NULL;
+        int count = ndjson_read_batch(&reader, batch_size, &batch);
+        if (count < 0) {
+            processed = -1;
+            break;
+        }
+        if (count == 0) {
+            cJSON_Delete(batch);
+            break;
+        }
+
+        int write_failed = 0;
+        if (count > 1) {
+            char** texts = flatten_json_batch_text(batch, use_threads, num_threads, 0);
+            write_failed = texts == NULL;
+            for (int i = 0; texts && i < count; i++) {
+                if (!write_failed && ndjson_write_text(output, texts[i]) != 0) {
+                    write_failed = 1;
+                } else if (write_failed) {
+                    free(texts[i]);
+                }
             }
+            free(texts);
         } else {
-            buffer[0] = '\0';
+            write_failed = ndjson_write_text(output, flatten_json_object_text(batch->child, 0)) != 0;
         }
-        return;
+
+        cJSON_Delete(batch);
+        if (write_failed) {
+            fprintf(stderr, "Error writing NDJSON output\n");
+            processed = -1;
+            break;
+        }
+        processed += count;
     }
+
+    ndjson_reader_free(&reader);
+    if (processed >= 0) fflush(output);
+    return processed;
+}
+
+// Keeps a uniform sample of up to size records seen so far (Algorithm R);
+// offered records are detached from their batch when kept
+typedef struct {
+    cJSON** records;
+    int size;
+    int count;
+    long offered;
+} SchemaStreamReservoir;
+
+static void schema_reservoir_offer(SchemaStreamReservoir* reservoir, cJSON* batch, cJSON* record,
+                                   uint64_t* random) {
+    long slot = reservoir->offered++;
+    if (slot >= reservoir->size) {
+        slot = (long)(sample_next(random) % (uint64_t)reservoir->offered);
+        if (slot >= reservoir->size) return;
+        cJSON_Delete(reservoir->records[slot]);
+    } else {
+        reservoir->count++;
+    }
+    reservoir->records[slot] = cJSON_DetachItemViaPointer(batch, record);
+}
+
+cJSON* generate_schema_stream_opts(FILE* input, const SchemaInferenceOptions* options) {
+    if (!input) return NULL;
+
+    init_global_pools();
+
+    NdjsonReader reader;
+    if (ndjson_reader_init(&reader, input) != 0) return NULL;
+
+    // sample_rate thins each batch as it arrives; sample_size needs the whole
+    // stream, so those records wait in a reservoir until the end
+    SchemaStreamReservoir reservoir = {NULL, options ? options->sample_size : 0, 0, 0};
+    double rate = options ? options->sample_rate : 0.0;
+    uint64_t random = options ? options->seed : 0;
+    if (reservoir.size > 0) {
+        reservoir.records = calloc((size_t)reservoir.size, sizeof(cJSON*));
+        if (!reservoir.records) {
+            ndjson_reader_free(&reader);
+            return NULL;
+        }
+    }
+
+    SchemaNode* merged_schema = NULL;
+    long records = 0;
+    long analyzed = 0;
+    int failed = 0;
+
+    for (;;) {
+        cJSON* batch = NULL;
+        int count = ndjson_read_batch(&reader, BATCH_SIZE, &batch);
+        if (count < 0) {
+            failed = 1;
+            break;
+        }
+        records += count;
+
+        int outer = stats_transform_begin((uint64_t)count);
+        cJSON* record = batch->child;
+        while (record) {
+            cJSON* next = record->next;
+            if (rate <= 0.0 || rate >= 1.0 || sample_uniform(&random) < rate) {
+                if (reservoir.records) {
+                    schema_reservoir_offer(&reservoir, batch, record, &random);
+                } else {
+                    merged_schema = merge_schema_into(merged_schema, analyze_json_value(record, options));
+                    analyzed++;
+                }
+            }
+            record = next;
+        }
+        stats_phase_end(outer);
+
+        cJSON_Delete(batch);
+        if (count == 0) break;
+    }
+
+    ndjson_reader_free(&reader);
+
+    if (reservoir.records) {
+        int outer = stats_transform_begin((uint64_t)reservoir.count);
+        for (int i = 0; i < reservoir.count; i++) {
+            if (!failed) merged_schema = merge_schema_into(merged_schema, analyze_json_value(reservoir.records[i], options));
+            cJSON_Delete(reservoir.records[i]);
+        }
+        stats_phase_end(outer);
+        analyzed = reservoir.count;
+        free(reservoir.records);
+    }
+
+    cJSON* result = NULL;
+    if (!failed) {
+        result = merged_schema ? schema_node_to_json(merged_schema) : cJSON_CreateObject();
+        if (result && merged_schema) add_sample_annotation(result, records, analyzed);
+    }
+    free_schema_node(merged_schema);
+    return result;
+}
+
+cJSON* generate_schema_stream(FILE* input) {
+    return generate_schema_stream_opts(input, NULL);
+}
+
+long process_json_stream(FILE* input, FILE* output, JsonRecordTransform transform, void* user_data) {
+    if (!input || !output || !transform) return -1;
+
+    NdjsonReader reader;
+    if (ndjson_reader_init(&reader, input) != 0) return -1;
+
+    OutputBuffer line;
+    output_buffer_init(&line, 4096);
     
-    size_t prefix_len = strlen_simd(prefix);
-    
-    if (is_array_index) {
-        if (prefix_len == 0) {
-            snprintf(buffer, buffer_size, "[%d]", index);
+    long processed = 0;
+    for (;;) {
+        cJSON* batch = NULL;
+        int count = ndjson_read_batch(&reader, 1, &batch);
+        if (count <= 0) {
+            cJSON_Delete(batch);
+            if (count < 0) processed = -1;
+            break;
+        }
+
+        cJSON* transformed = transform(batch->child, user_data);
+        int write_failed = transformed && ndjson_write_record(output, transformed, &line) != 0;
+        cJSON_Delete(transformed);
+        cJSON_Delete(batch);
+
+        if (write_failed) {
+            fprintf(stderr, "Error writing NDJSON output\n");
+            processed = -1;
+            break;
+        }
+        processed++;
+    }
+
+    output_buffer_free(&line);
+    ndjson_reader_free(&reader);
+    if (processed >= 0) fflush(output);
+    return processed;
+}
+
+// =============================================================================
+// SCHEMA VALIDATION
+// =============================================================================
+
+// Validation shares inference's representation: a schema is read into a
+// SchemaNode tree (Draft-07's type, properties, required, items, enum and
+// const) and compiled into a flat table with one ValidatorOp per node, in
+// depth-first order. Each object's properties are a contiguous run of one
+// property table with its own open-addressing slots keyed on the FNV-1a name
+// hash, and its required properties a precomputed bitset that is checked
+// against the members seen with one AND per 64 properties.
+
+#define VALIDATOR_TYPE(type) (1u << (type))
+#define VALIDATOR_ALL_TYPES (VALIDATOR_TYPE(TYPE_MIXED) - 1)  // TYPE_NULL through TYPE_OBJECT
+
+typedef struct {
+    unsigned types;            // VALIDATOR_TYPE bits of the accepted types
+    int items;                 // Op for array elements, or -1
+    int first_property;        // Run in the property table
+    int property_count;
+    int first_slot;            // Hash slots of the run: property + 1, or 0 when empty
+    int slot_mask;
+    int first_word;            // Required properties, one bit per property of the run
+    int word_count;
+    const cJSON* enum_values;  // Allowed values, or NULL
+} ValidatorOp;
+
+typedef struct {
+    size_t name;               // Offset in the name pool
+    size_t length;
+    uint32_t hash;
+    int op;                    // -1 for a required name without a schema
+} ValidatorProperty;
+
+struct SchemaValidator {
+    ValidatorOp* ops;
+    int op_count;
+    int op_capacity;
+    ValidatorProperty* properties;
+    int property_count;
+    int property_capacity;
+    int* slots;
+    int slot_count;
+    int slot_capacity;
+    uint64_t* words;
+    int word_count;
+    int word_capacity;
+    char* names;
+    size_t names_length;
+    size_t names_capacity;
+    cJSON* enums;              // Owns every op's enum_values
+};
+
+// Keywords that only annotate a schema and are skipped
+static const char* const g_schema_annotations[] = {
+    "$schema", "$id", "$comment", "title", "description", "default", "examples",
+    "definitions", "format", "readOnly", "writeOnly", "x-stats", "x-sample", NULL
+};
+
+static SchemaNode* schema_node_from_draft(const cJSON* schema, int depth);
+
+static int schema_draft_types(SchemaNode* node, const cJSON* type) {
+    if (!cJSON_IsString(type) && !(cJSON_IsArray(type) && type->child)) {
+        fprintf(stderr, "Error: schema \"type\" must be a string or a list of strings\n");
+        return -1;
+    }
+
+    unsigned mask = 0;
+    int nullable = 0;
+    const cJSON* name = cJSON_IsString(type) ? type : type->child;
+    for (; name; name = cJSON_IsString(type) ? NULL : name->next) {
+        SchemaType parsed;
+        if (!cJSON_IsString(name) || schema_type_from_string(name->valuestring, &parsed) != 0 ||
+            parsed == TYPE_MIXED) {
+            fprintf(stderr, "Error: unknown schema type %s\n", cJSON_IsString(name) ? name->valuestring : "");
+            return -1;
+        }
+        if (parsed == TYPE_NULL) {
+            nullable = 1;
         } else {
-            snprintf(buffer, buffer_size, "%.*s[%d]", (int)prefix_len, prefix, index);
+            mask |= VALIDATOR_TYPE(parsed);
         }
-    } else if (suffix) {
-        size_t suffix_len = strlen_simd(suffix);
-        if (prefix_len == 0) {
-            if (suffix_len + 1 < buffer_size) {
-                fast_memcpy(buffer, suffix, suffix_len);
-                buffer[suffix_len] = '\0';
+    }
+
+    // "number" includes integers
+    if (mask & VALIDATOR_TYPE(TYPE_NUMBER)) mask &= ~VALIDATOR_TYPE(TYPE_INTEGER);
+
+    node->nullable = nullable;
+    node->type_mask = 0;
+    if (mask == 0) {
+        node->type = TYPE_NULL;
+        node->nullable = 0;
+    } else if ((mask & (mask - 1)) == 0) {
+        node->type = (SchemaType)__builtin_ctz(mask);
+    } else {
+        node->type = TYPE_MIXED;
+        node->type_mask = mask;
+    }
+    return 0;
+}
+
+static int schema_draft_properties(SchemaNode* node, const cJSON* properties, int depth) {
+    if (!cJSON_IsObject(properties) || node->properties) {
+        fprintf(stderr, "Error: schema \"properties\" must be one object\n");
+        return -1;
+    }
+
+    PropertyNode** tail = &node->properties;
+    const cJSON* property = NULL;
+    cJSON_ArrayForEach(property, properties) {
+        SchemaNode* schema = schema_node_from_draft(property, depth + 1);
+        if (!schema || append_property(node, &tail, property->string, schema, 0) != 0) {
+            free_schema_node(schema);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Marks the listed properties required; names without a property schema are
+// only kept in required_props
+static int schema_draft_required(SchemaNode* node, const cJSON* required) {
+    const cJSON* name = NULL;
+    cJSON_ArrayForEach(name, required) {
+        if (!cJSON_IsString(name)) {
+            fprintf(stderr, "Error: schema \"required\" must be a list of strings\n");
+            return -1;
+        }
+        size_t length = strlen_simd(name->valuestring);
+        PropertyNode* prop = find_property(node, name->valuestring, length,
+                                           hash_property_name(name->valuestring, length));
+        if (prop && prop->required) continue;
+        if (prop) prop->required = 1;
+        note_required_property(node, name->valuestring);
+    }
+    return 0;
+}
+
+static int schema_draft_enum(SchemaNode* node, const cJSON* keyword) {
+    if (node->enum_values || (!cJSON_IsArray(keyword) && strcmp(keyword->string, "enum") == 0)) {
+        fprintf(stderr, "Error: schema \"enum\" must be a list, and not combined with \"const\"\n");
+        return -1;
+    }
+
+    if (strcmp(keyword->string, "const") == 0) {
+        node->enum_values = cJSON_CreateArray();
+        cJSON* value = cJSON_Duplicate(keyword, 1);
+        if (!node->enum_values || !value) {
+            cJSON_Delete(value);
+            return -1;
+        }
+        cJSON_AddItemToArray(node->enum_values, value);
+    } else {
+        node->enum_values = cJSON_Duplicate(keyword, 1);
+        if (!node->enum_values) return -1;
+    }
+    node->enum_count = cJSON_GetArraySize(node->enum_values);
+    return 0;
+}
+
+// Reads the subset of a Draft-07 schema that SchemaNode can express; other
+// assertions and composition keywords are rejected rather than ignored
+static SchemaNode* schema_node_from_draft(const cJSON* schema, int depth) {
+    if (depth > CJSON_NESTING_LIMIT) {
+        fprintf(stderr, "Error: schema nests too deeply\n");
+        return NULL;
+    }
+    if (!cJSON_IsBool(schema) && !cJSON_IsObject(schema)) {
+        fprintf(stderr, "Error: a schema must be an object or a boolean\n");
+        return NULL;
+    }
+
+    // Without "type" every value is allowed; false allows none
+    SchemaNode* node = create_schema_node(TYPE_MIXED);
+    if (!node) return NULL;
+    node->nullable = 1;
+    if (cJSON_IsBool(schema)) {
+        if (cJSON_IsFalse(schema)) {
+            node->enum_values = cJSON_CreateArray();
+            if (!node->enum_values) {
+                free_schema_node(node);
+                return NULL;
+            }
+        }
+        return node;
+    }
+
+    int status = 0;
+    const cJSON* keyword = NULL;
+    cJSON_ArrayForEach(keyword, schema) {
+        const char* name = keyword->string;
+        if (strcmp(name, "type") == 0) {
+            status = schema_draft_types(node, keyword);
+        } else if (strcmp(name, "properties") == 0) {
+            status = schema_draft_properties(node, keyword, depth);
+        } else if (strcmp(name, "items") == 0) {
+            if (!node->items && (cJSON_IsObject(keyword) || cJSON_IsBool(keyword))) {
+                node->items = schema_node_from_draft(keyword, depth + 1);
             } else {
-                strncpy(buffer, suffix, buffer_size - 1);
-                buffer[buffer_size - 1] = '\0';
+                fprintf(stderr, "Error: schema \"items\" must be one schema\n");
             }
-        } else {
-            // Optimized concatenation
-            if (prefix_len + suffix_len + 2 < buffer_size) {
-                fast_memcpy(buffer, prefix, prefix_len);
-                buffer[prefix_len] = '.';
-                fast_memcpy(buffer + prefix_len + 1, suffix, suffix_len);
-                buffer[prefix_len + suffix_len + 1] = '\0';
+            status = node->items ? 0 : -1;
+        } else if (strcmp(name, "enum") == 0 || strcmp(name, "const") == 0) {
+            status = schema_draft_enum(node, keyword);
+        } else if (strcmp(name, "additionalProperties") == 0 || strcmp(name, "additionalItems") == 0) {
+            // Only the defaults, which allow anything
+            status = cJSON_IsTrue(keyword) || (cJSON_IsObject(keyword) && !keyword->child) ? 0 : -1;
+            if (status) fprintf(stderr, "Error: unsupported schema keyword %s\n", name);
+        } else if (strcmp(name, "required") != 0) {
+            int annotation = 0;
+            for (int i = 0; g_schema_annotations[i] && !annotation; i++) {
+                annotation = strcmp(name, g_schema_annotations[i]) == 0;
+            }
+            if (!annotation) {
+                fprintf(stderr, "Error: unsupported schema keyword %s\n", name);
+                status = -1;
+            }
+        }
+        if (status != 0) break;
+    }
+
+    // Properties are all read by now, so required names can be matched to them
+    const cJSON* required = cJSON_GetObjectItemCaseSensitive(schema, "required");
+    if (status == 0 && required) {
+        status = cJSON_IsArray(required) ? schema_draft_required(node, required) : -1;
+        if (!cJSON_IsArray(required)) fprintf(stderr, "Error: schema \"required\" must be a list of strings\n");
+    }
+    if (status != 0) {
+        free_schema_node(node);
+        return NULL;
+    }
+    return node;
+}
+
+// Room for needed elements in a growing table; returns the (possibly moved)
+// table, or NULL with the old one intact
+static void* validator_grow(void* table, int* capacity, int needed, size_t size) {
+    if (needed <= *capacity) return table;
+
+    int grown_capacity = *capacity ? *capacity : 64;
+    while (grown_capacity < needed) grown_capacity *= 2;
+    void* grown = realloc(table, (size_t)grown_capacity * size);
+    if (grown) *capacity = grown_capacity;
+    return grown;
+}
+
+static unsigned validator_type_mask(const SchemaNode* node) {
+    unsigned types;
+    if (node->type == TYPE_MIXED) {
+        types = node->type_mask ? node->type_mask : VALIDATOR_ALL_TYPES & ~VALIDATOR_TYPE(TYPE_NULL);
+    } else {
+        types = VALIDATOR_TYPE(node->type);
+    }
+    if (node->nullable) types |= VALIDATOR_TYPE(TYPE_NULL);
+    if (types & VALIDATOR_TYPE(TYPE_NUMBER)) types |= VALIDATOR_TYPE(TYPE_INTEGER);
+    return types;
+}
+
+static int validator_add_property(SchemaValidator* validator, const char* name, size_t length) {
+    ValidatorProperty* properties = validator_grow(validator->properties, &validator->property_capacity,
+                                                   validator->property_count + 1, sizeof(ValidatorProperty));
+    if (!properties) return -1;
+    validator->properties = properties;
+
+    if (validator->names_length + length + 1 > validator->names_capacity) {
+        size_t capacity = validator->names_capacity ? validator->names_capacity : 1024;
+        while (capacity < validator->names_length + length + 1) capacity *= 2;
+        char* names = realloc(validator->names, capacity);
+        if (!names) return -1;
+        validator->names = names;
+        validator->names_capacity = capacity;
+    }
+    memcpy(validator->names + validator->names_length, name, length);
+    validator->names[validator->names_length + length] = '\0';
+
+    ValidatorProperty* property = &properties[validator->property_count++];
+    property->name = validator->names_length;
+    property->length = length;
+    property->hash = hash_property_name(name, length);
+    property->op = -1;
+    validator->names_length += length + 1;
+    return 0;
+}
+
+// Index of name in the op's property run, or -1
+static int validator_lookup(const SchemaValidator* validator, const ValidatorOp* op,
+                            const char* name, size_t length) {
+    uint32_t hash = hash_property_name(name, length);
+    const int* slots = validator->slots + op->first_slot;
+    for (int slot = (int)(hash & (uint32_t)op->slot_mask); slots[slot]; slot = (slot + 1) & op->slot_mask) {
+        const ValidatorProperty* property = &validator->properties[op->first_property + slots[slot] - 1];
+        if (property->hash == hash && property->length == length &&
+            fast_memcmp(validator->names + property->name, name, length) == 0) {
+            return slots[slot] - 1;
+        }
+    }
+    return -1;
+}
+
+static int validator_compile_node(SchemaValidator* validator, const SchemaNode* node);
+
+// Lays out an object's property run, its hash slots and its required bitset
+static int validator_compile_properties(SchemaValidator* validator, const SchemaNode* node, int index) {
+    int first = validator->property_count;
+    for (const PropertyNode* prop = node->properties; prop; prop = prop->next) {
+        if (validator_add_property(validator, prop->name, prop->name_len) != 0) return -1;
+    }
+    int with_schema = validator->property_count - first;
+
+    // Required names without a schema get a property of their own to mark
+    for (int i = 0; i < node->required_count; i++) {
+        const char* name = node->required_props[i];
+        size_t length = strlen_simd(name);
+        int known = find_property(node, name, length, hash_property_name(name, length)) != NULL;
+        for (int p = first + with_schema; p < validator->property_count && !known; p++) {
+            const ValidatorProperty* property = &validator->properties[p];
+            known = property->length == length && memcmp(validator->names + property->name, name, length) == 0;
+        }
+        if (!known && validator_add_property(validator, name, length) != 0) return -1;
+    }
+    int count = validator->property_count - first;
+
+    int slot_count = 4;
+    while (slot_count < count * 2) slot_count *= 2;
+    int word_count = (count + 63) / 64;
+    int* slots = validator_grow(validator->slots, &validator->slot_capacity,
+                                validator->slot_count + slot_count, sizeof(int));
+    if (slots) validator->slots = slots;
+    uint64_t* words = validator_grow(validator->words, &validator->word_capacity,
+                                     validator->word_count + word_count, sizeof(uint64_t));
+    if (words) validator->words = words;
+    if (!slots || !words) return -1;
+
+    int first_slot = validator->slot_count;
+    int first_word = validator->word_count;
+    validator->slot_count += slot_count;
+    validator->word_count += word_count;
+    memset(slots + first_slot, 0, (size_t)slot_count * sizeof(int));
+    memset(words + first_word, 0, (size_t)word_count * sizeof(uint64_t));
+
+    int p = 0;
+    for (const PropertyNode* prop = node->properties; prop; prop = prop->next, p++) {
+        if (prop->required) words[first_word + p / 64] |= 1ULL << (p % 64);
+    }
+    for (; p < count; p++) {
+        words[first_word + p / 64] |= 1ULL << (p % 64);
+    }
+    for (p = 0; p < count; p++) {
+        int slot = (int)(validator->properties[first + p].hash & (uint32_t)(slot_count - 1));
+        while (slots[first_slot + slot]) slot = (slot + 1) & (slot_count - 1);
+        slots[first_slot + slot] = p + 1;
+    }
+
+    ValidatorOp* op = &validator->ops[index];
+    op->first_property = first;
+    op->property_count = count;
+    op->first_slot = first_slot;
+    op->slot_mask = slot_count - 1;
+    op->first_word = first_word;
+    op->word_count = word_count;
+
+    // Property schemas are compiled once the run is complete, after it
+    p = 0;
+    for (const PropertyNode* prop = node->properties; prop; prop = prop->next, p++) {
+        int child = validator_compile_node(validator, prop->schema);
+        if (child < 0) return -1;
+        validator->properties[first + p].op = child;
+    }
+    return 0;
+}
+
+// Appends the ops of node's subtree and returns the index of node's op
+static int validator_compile_node(SchemaValidator* validator, const SchemaNode* node) {
+    ValidatorOp* ops = validator_grow(validator->ops, &validator->op_capacity,
+                                      validator->op_count + 1, sizeof(ValidatorOp));
+    if (!ops) return -1;
+    validator->ops = ops;
+
+    int index = validator->op_count++;
+    ValidatorOp* op = &ops[index];
+    memset(op, 0, sizeof(*op));
+    op->types = validator_type_mask(node);
+    op->items = -1;
+
+    if (node->enum_values) {
+        cJSON* values = cJSON_Duplicate(node->enum_values, 1);
+        if (!values) return -1;
+        cJSON_AddItemToArray(validator->enums, values);
+        op->enum_values = values;
+    }
+
+    if ((node->properties || node->required_count > 0) &&
+        validator_compile_properties(validator, node, index) != 0) {
+        return -1;
+    }
+    if (node->items) {
+        int items = validator_compile_node(validator, node->items);
+        if (items < 0) return -1;
+        validator->ops[index].items = items;
+    }
+    return index;
+}
+
+static SchemaValidator* validator_from_node(const SchemaNode* root) {
+    SchemaValidator* validator = calloc(1, sizeof(SchemaValidator));
+    if (!validator) return NULL;
+
+    validator->enums = cJSON_CreateArray();
+    if (!validator->enums || validator_compile_node(validator, root) != 0) {
+        schema_validator_free(validator);
+        return NULL;
+    }
+    return validator;
+}
+
+SchemaValidator* schema_validator_compile(const cJSON* schema) {
+    if (!schema) return NULL;
+
+    init_global_pools();
+    SchemaNode* root = schema_node_from_draft(schema, 0);
+    if (!root) return NULL;
+
+    SchemaValidator* validator = validator_from_node(root);
+    free_schema_node(root);
+    return validator;
+}
+
+SchemaValidator* schema_validator_compile_string(const char* schema_string) {
+    if (!schema_string) return NULL;
+
+    cJSON* schema = parse_json_string(schema_string);
+    if (!schema) {
+        const char* error_ptr = cJSON_GetErrorPtr();
+        if (error_ptr) {
+            fprintf(stderr, "Error parsing JSON: %s\n", error_ptr);
+        }
+        return NULL;
+    }
+
+    SchemaValidator* validator = schema_validator_compile(schema);
+    cJSON_Delete(schema);
+    return validator;
+}
+
+SchemaValidator* schema_validator_from_builder(const SchemaBuilder* builder) {
+    if (!builder) return NULL;
+
+    init_global_pools();
+    if (builder->root) return validator_from_node(builder->root);
+
+    // Like the empty schema an empty builder prints, this allows anything
+    SchemaNode* any = create_schema_node(TYPE_MIXED);
+    if (!any) return NULL;
+    any->nullable = 1;
+    SchemaValidator* validator = validator_from_node(any);
+    free_schema_node(any);
+    return validator;
+}
+
+void schema_validator_free(SchemaValidator* validator) {
+    if (!validator) return;
+    free(validator->ops);
+    free(validator->properties);
+    free(validator->slots);
+    free(validator->words);
+    free(validator->names);
+    cJSON_Delete(validator->enums);
+    free(validator);
+}
+
+// One step of the path to the value being checked
+typedef struct {
+    const char* name;  // Member name, or NULL for an array element
+    int index;
+} ValidationStep;
+
+// Per-thread validation state, reused across records
+typedef struct {
+    const SchemaValidator* validator;
+    int all_errors;
+    cJSON* errors;           // Error objects, or NULL to only count them
+    int record;              // Batch index stored in error objects, or -1
+    int error_count;
+    int failed;              // Out of memory
+    ValidationStep* path;
+    int depth;
+    int path_capacity;
+    uint64_t* seen;          // Members seen, per object being checked
+    int seen_used;
+    int seen_capacity;
+    OutputBuffer text;       // Path of the current error
+} ValidationContext;
+
+static void validation_context_init(ValidationContext* context, const SchemaValidator* validator,
+                                    SchemaValidationMode mode) {
+    memset(context, 0, sizeof(*context));
+    context->validator = validator;
+    context->all_errors = mode == SCHEMA_VALIDATE_ALL_ERRORS;
+    context->record = -1;
+    output_buffer_init(&context->text, 256);
+}
+
+static void validation_context_free(ValidationContext* context) {
+    free(context->path);
+    free(context->seen);
+    output_buffer_free(&context->text);
+}
+
+static int validation_push(ValidationContext* context, const char* name, int index) {
+    ValidationStep* path = validator_grow(context->path, &context->path_capacity,
+                                          context->depth + 1, sizeof(ValidationStep));
+    if (!path) {
+        context->failed = 1;
+        return -1;
+    }
+    context->path = path;
+    path[context->depth].name = name;
+    path[context->depth].index = index;
+    context->depth++;
+    return 0;
+}
+
+// Counts an error at the current path and records it when errors are kept;
+// returns nonzero when validation should stop
+static int validation_error(ValidationContext* context, const char* message) {
+    context->error_count++;
+    if (context->errors) {
+        // Paths are written like flattened keys: "a.b[2]", "" for the root
+        OutputBuffer* text = &context->text;
+        text->length = 0;
+        for (int i = 0; i < context->depth; i++) {
+            const ValidationStep* step = &context->path[i];
+            if (step->name) {
+                if (i > 0) output_buffer_append_char(text, '.');
+                output_buffer_append(text, step->name, strlen_simd(step->name));
             } else {
-                snprintf(buffer, buffer_size, "%.*s.%.*s", 
-                        (int)prefix_len, prefix, (int)suffix_len, suffix);
+                char index[16];
+                output_buffer_append(text, index, (size_t)snprintf(index, sizeof(index), "[%d]", step->index));
             }
         }
-    } else {
-        if (prefix_len + 1 < buffer_size) {
-            fast_memcpy(buffer, prefix, prefix_len);
-            buffer[prefix_len] = '\0';
-        } else {
-            strncpy(buffer, prefix, buffer_size - 1);
-            buffer[buffer_size - 1] = '\0';
+        output_buffer_append_char(text, '\0');
+
+        cJSON* error = cJSON_CreateObject();
+        if (!error || text->failed) {
+            cJSON_Delete(error);
+            context->failed = 1;
+            return 1;
         }
+        if (context->record >= 0) cJSON_AddNumberToObject(error, "record", context->record);
+        cJSON_AddStringToObject(error, "path", text->data);
+        cJSON_AddStringToObject(error, "message", message);
+        cJSON_AddItemToArray(context->errors, error);
     }
+    return !context->all_errors || context->failed;
 }
 
-static char* pool_strdup(FlattenedArray* array, const char* str) {
-    if (UNLIKELY(!str)) return NULL;
-    
-    size_t len = strlen_simd(str) + 1;
-    char* new_str;
-    
-    // Use pool for small strings
-    if (LIKELY(len <= 256)) {
-        new_str = pool_alloc(array, len);
-        if (LIKELY(new_str != NULL)) {
-            fast_memcpy(new_str, str, len);
-            return new_str;
-        }
+// Integral numbers are "integer" as in Draft-07, whatever their size; read
+// from the bits so -ffast-math builds agree
+static int validator_number_is_integral(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int exponent = (int)((bits >> 52) & 0x7FF) - 1023;
+    if (exponent == 1024) return 0;            // NaN or infinity
+    if (exponent >= 52) return 1;
+    if (exponent < 0) return (bits << 1) == 0; // Only zero
+    return (bits & ((1ULL << (52 - exponent)) - 1)) == 0;
+}
+
+static SchemaType validator_value_type(const cJSON* value) {
+    switch (value->type & 0xFF) {
+        case cJSON_False:
+        case cJSON_True:
+            return TYPE_BOOLEAN;
+        case cJSON_Number:
+            return validator_number_is_integral(value->valuedouble) ? TYPE_INTEGER : TYPE_NUMBER;
+        case cJSON_String:
+            return TYPE_STRING;
+        case cJSON_Array:
+            return TYPE_ARRAY;
+        case cJSON_Object:
+            return TYPE_OBJECT;
+        default:
+            return TYPE_NULL;
     }
-    
-    // Fallback to slab allocator
-    if (g_cjson_node_pool && len <= 256) {
-        new_str = slab_alloc(g_cjson_node_pool);
-        if (new_str) {
-            fast_memcpy(new_str, str, len);
-            return new_str;
-        }
+}
+
+// "expected string or null, got integer"
+static void validator_type_message(unsigned types, SchemaType actual, char* message, size_t size) {
+    static const SchemaType order[] = {
+        TYPE_OBJECT, TYPE_ARRAY, TYPE_STRING, TYPE_NUMBER, TYPE_INTEGER, TYPE_BOOLEAN, TYPE_NULL
+    };
+    if (types & VALIDATOR_TYPE(TYPE_NUMBER)) types &= ~VALIDATOR_TYPE(TYPE_INTEGER);
+
+    size_t length = (size_t)snprintf(message, size, "expected ");
+    int remaining = __builtin_popcount(types);
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]) && length < size; i++) {
+        if (!(types & VALIDATOR_TYPE(order[i]))) continue;
+        remaining--;
+        const char* separator = length == strlen("expected ") ? "" : remaining == 0 ? " or " : ", ";
+        length += (size_t)snprintf(message + length, size - length, "%s%s", separator,
+                                   schema_type_to_string(order[i]));
+    }
+    if (length < size) {
+        snprintf(message + length, size - length, ", got %s", schema_type_to_string(actual));
     }
-    
-    return my_strdup(str);
 }
 
-// Hot path function with aggressive optimization
-HOT_PATH void add_pair(FlattenedArray* array, const char* key, cJSON* value) {
-    if (UNLIKELY(array->count >= array->capacity)) {
-        int new_capacity = array->capacity << 1;
-        FlattenedPair* new_pairs = realloc(array->pairs, new_capacity * sizeof(FlattenedPair));
-        if (UNLIKELY(!new_pairs)) {
-            return;
-        }
-        array->pairs = new_pairs;
-        array->capacity = new_capacity;
-        
-        // Prefetch next cache lines
-        PREFETCH_WRITE(&array->pairs[array->count]);
-        PREFETCH_WRITE(&array->pairs[array->count + g_cpu.cache_line_size / sizeof(FlattenedPair)]);
+static int validate_value(ValidationContext* context, int op_index, const cJSON* value);
+
+static int validate_object(ValidationContext* context, const ValidatorOp* op, const cJSON* object) {
+    const SchemaValidator* validator = context->validator;
+    int base = context->seen_used;
+    uint64_t* seen = validator_grow(context->seen, &context->seen_capacity,
+                                    base + op->word_count, sizeof(uint64_t));
+    if (!seen) {
+        context->failed = 1;
+        return 1;
     }
-    
-    FlattenedPair* pair = &array->pairs[array->count];
-    pair->key = pool_strdup(array, key);
-    pair->value = value;
-    array->count++;
-    
-    // Check if still sorted (for optimization)
-    if (array->is_sorted && array->count > 1) {
-        if (strcmp(array->pairs[array->count - 2].key, pair->key) > 0) {
-            array->is_sorted = 0;
+    context->seen = seen;
+    memset(seen + base, 0, (size_t)op->word_count * sizeof(uint64_t));
+    context->seen_used += op->word_count;
+
+    int stop = 0;
+    for (const cJSON* member = object->child; member && !stop; member = member->next) {
+        const char* name = member->string ? member->string : "";
+        int property = validator_lookup(validator, op, name, strlen_simd(name));
+        if (property < 0) continue;
+
+        context->seen[base + property / 64] |= 1ULL << (property % 64);
+        int child = validator->properties[op->first_property + property].op;
+        if (child >= 0) {
+            stop = validation_push(context, name, -1) != 0 || validate_value(context, child, member);
+            context->depth--;
         }
     }
-    
-    // Prefetch next pair location
-    if (LIKELY(array->count < array->capacity)) {
-        PREFETCH_WRITE(&array->pairs[array->count]);
+
+    // Required properties not seen, in schema order
+    for (int word = 0; word < op->word_count && !stop; word++) {
+        uint64_t missing = validator->words[op->first_word + word] & ~context->seen[base + word];
+        while (missing && !stop) {
+            int property = word * 64 + __builtin_ctzll(missing);
+            missing &= missing - 1;
+            const ValidatorProperty* required = &validator->properties[op->first_property + property];
+            stop = validation_push(context, validator->names + required->name, -1) != 0 ||
+                   validation_error(context, "required property is missing");
+            context->depth--;
+        }
     }
+
+    context->seen_used = base;
+    return stop;
 }
 
-static void free_flattened_array(FlattenedArray* array) {
-    // Free keys that aren't in the pool
-    for (int i = 0; i < array->count; i++) {
-        char* key = array->pairs[i].key;
-        if (key && (key < array->memory_pool || key >= array->memory_pool + array->pool_size)) {
-            free(key);
+// Checks value against an op; nonzero when validation should stop
+static int validate_value(ValidationContext* context, int op_index, const cJSON* value) {
+    const ValidatorOp* op = &context->validator->ops[op_index];
+    SchemaType type = validator_value_type(value);
+
+    // Nothing inside a value of the wrong type is checked
+    if (!(op->types & VALIDATOR_TYPE(type))) {
+        char message[128];
+        validator_type_message(op->types, type, message, sizeof(message));
+        return validation_error(context, message);
+    }
+
+    if (op->enum_values) {
+        const cJSON* allowed = op->enum_values->child;
+        while (allowed && !cJSON_Compare(value, allowed, 1)) allowed = allowed->next;
+        if (!allowed && validation_error(context, "value is not one of the allowed values")) return 1;
+    }
+
+    if (type == TYPE_OBJECT && op->property_count > 0) {
+        return validate_object(context, op, value);
+    }
+    if (type == TYPE_ARRAY && op->items >= 0) {
+        int index = 0;
+        for (const cJSON* item = value->child; item; item = item->next, index++) {
+            int stop = validation_push(context, NULL, index) != 0 || validate_value(context, op->items, item);
+            context->depth--;
+            if (stop) return 1;
         }
     }
-    
-    free(array->pairs);
-    
-    #ifdef __linux__
-    if (array->memory_pool != MAP_FAILED) {
-        munmap(array->memory_pool, array->pool_size);
-    } else {
-        free(array->memory_pool);
+    return 0;
+}
+
+// Number of errors in value, or -1 when out of memory
+static int validation_run(ValidationContext* context, const cJSON* value, int record) {
+    context->record = record;
+    context->error_count = 0;
+    context->failed = 0;
+    context->depth = 0;
+    context->seen_used = 0;
+    validate_value(context, 0, value);
+    return context->failed ? -1 : context->error_count;
+}
+
+int schema_validate(const SchemaValidator* validator, const cJSON* json, SchemaValidationMode mode,
+                    cJSON** errors) {
+    if (errors) *errors = NULL;
+    if (!validator || !json) return -1;
+
+    ValidationContext context;
+    validation_context_init(&context, validator, mode);
+    context.errors = errors ? cJSON_CreateArray() : NULL;
+
+    int outer = stats_transform_begin(1);
+    int result = errors && !context.errors ? -1 : validation_run(&context, json, -1);
+    stats_phase_end(outer);
+    validation_context_free(&context);
+
+    if (result < 0) {
+        cJSON_Delete(context.errors);
+        return -1;
     }
-    #else
-    free(array->memory_pool);
-    #endif
-    
-    memset(array, 0, sizeof(*array));
+    if (errors) *errors = context.errors;
+    return result;
 }
 
-// Recursive flattening with tail-call optimization simulation
-static void flatten_json_recursive(cJSON* json, const char* prefix, FlattenedArray* result) {
-    if (UNLIKELY(!json)) return;
-    
-    char key_buffer[MAX_KEY_LENGTH];
-    
-    // Handle different JSON types with optimized dispatch
-    switch (json->type & 0xFF) {
-        case cJSON_Object: {
-            cJSON* child = json->child;
-            while (child) {
-                build_key_optimized(key_buffer, sizeof(key_buffer), prefix, child->string, 0, 0);
-                
-                // Tail recursion optimization for single child
-                if (!child->next && (child->type == cJSON_Object || child->type == cJSON_Array)) {
-                    json = child;
-                    prefix = my_strdup(key_buffer); // TODO: optimize this allocation
-                    goto tail_recurse;
-                }
-                
-                flatten_json_recursive(child, key_buffer, result);
-                child = child->next;
+typedef struct {
+    const JsonArrayView* view;
+    ValidationContext* contexts;  // One per pool slot
+    int* counts;                  // Errors per record, -1 on failure
+    cJSON** errors;               // Error objects per record, when kept
+    int first_invalid;            // Lowest invalid record so far in first-error mode
+} ValidationBatchJob;
+
+static void validate_batch_range(void* context, int begin, int end, int slot) {
+    ValidationBatchJob* job = (ValidationBatchJob*)context;
+    ValidationContext* validation = &job->contexts[slot];
+
+    for (int i = begin; i < end; i++) {
+        // Records after an invalid one do not matter when stopping at the first error
+        if (!validation->all_errors && i > __atomic_load_n(&job->first_invalid, __ATOMIC_RELAXED)) break;
+        if (i + 1 < end) {
+            PREFETCH_READ(job->view->items[i + 1]);
+        }
+
+        validation->errors = job->errors ? cJSON_CreateArray() : NULL;
+        job->counts[i] = job->errors && !validation->errors ? -1 :
+                         validation_run(validation, job->view->items[i], i);
+        if (job->errors) job->errors[i] = validation->errors;
+
+        if (job->counts[i] != 0 && !validation->all_errors) {
+            int first = __atomic_load_n(&job->first_invalid, __ATOMIC_RELAXED);
+            while (i < first && !__atomic_compare_exchange_n(&job->first_invalid, &first, i, false,
+                                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
             }
-            break;
         }
-        
-        case cJSON_Array: {
-            cJSON* child = json->child;
-            int i = 0;
-            while (child) {
-                build_key_optimized(key_buffer, sizeof(key_buffer), prefix, NULL, 1, i);
-                
-                // Tail recursion optimization for single child
-                if (!child->next && (child->type == cJSON_Object || child->type == cJSON_Array)) {
-                    json = child;
-                    prefix = my_strdup(key_buffer); // TODO: optimize this allocation
-                    goto tail_recurse;
-                }
-                
-                flatten_json_recursive(child, key_buffer, result);
-                child = child->next;
-                i++;
+    }
+}
+
+static int validate_batch_view(const SchemaValidator* validator, const JsonArrayView* view, ThreadPool* pool,
+                               SchemaValidationMode mode, cJSON** errors) {
+    int count = view->count;
+    int slots = thread_pool_get_thread_count(pool) + 1;
+    ValidationBatchJob job = {
+        view,
+        calloc((size_t)slots, sizeof(ValidationContext)),
+        calloc((size_t)count + 1, sizeof(int)),
+        errors ? calloc((size_t)count + 1, sizeof(cJSON*)) : NULL,
+        INT_MAX
+    };
+    cJSON* collected = errors ? cJSON_CreateArray() : NULL;
+    int invalid = 0;
+    if (!job.contexts || !job.counts || (errors && (!job.errors || !collected))) {
+        invalid = -1;
+    } else {
+        for (int i = 0; i < slots; i++) validation_context_init(&job.contexts[i], validator, mode);
+
+        int outer = stats_transform_begin((uint64_t)count);
+        thread_pool_parallel_for(pool, count, MIN_RECORDS_PER_CHUNK, validate_batch_range, &job);
+        stats_phase_end(outer);
+
+        // In first-error mode only the first invalid record counts
+        int last = mode == SCHEMA_VALIDATE_ALL_ERRORS || job.first_invalid >= count ? count : job.first_invalid + 1;
+        for (int i = 0; i < last && invalid >= 0; i++) {
+            if (job.counts[i] < 0) {
+                invalid = -1;
+            } else if (job.counts[i] > 0) {
+                invalid++;
+            }
+            for (cJSON* error; job.errors && job.errors[i] &&
+                               (error = cJSON_DetachItemViaPointer(job.errors[i], job.errors[i]->child)) != NULL;) {
+                cJSON_AddItemToArray(collected, error);
             }
-            break;
         }
-        
-        default:
-            add_pair(result, prefix, json);
-            return;
+        for (int i = 0; i < slots; i++) validation_context_free(&job.contexts[i]);
     }
-    
-    return;
-    
-tail_recurse:
-    // Simulate tail recursion
-    flatten_json_recursive(json, prefix, result);
+
+    for (int i = 0; job.errors && i < count; i++) cJSON_Delete(job.errors[i]);
+    free(job.errors);
+    free(job.counts);
+    free(job.contexts);
+
+    if (invalid < 0) {
+        cJSON_Delete(collected);
+        collected = NULL;
+    }
+    if (errors) *errors = collected;
+    return invalid;
 }
 
-// Highly optimized JSON creation with pre-calculated sizes
-static cJSON* create_flattened_json(FlattenedArray* flattened_array) {
-    cJSON* result = cJSON_CreateObject();
-    if (UNLIKELY(!result)) return NULL;
-    
-    // Sort pairs if not sorted for better cache locality during iteration
-    if (!flattened_array->is_sorted && flattened_array->count > 16) {
-        // Quick sort implementation would go here
-        // For now, keeping simple
+int schema_validate_batch(const SchemaValidator* validator, const cJSON* json_array, SchemaValidationMode mode,
+                          int use_threads, int num_threads, cJSON** errors) {
+    if (errors) *errors = NULL;
+    if (!validator || !json_array || json_array->type != cJSON_Array) {
+        return -1;
     }
-    
-    // Pre-allocate hashtable space if cJSON supported it
-    // This would significantly improve performance for large objects
-    
-    for (int i = 0; i < flattened_array->count; i++) {
-        FlattenedPair* pair = &flattened_array->pairs[i];
-        
-        // Optimized value creation based on type
-        switch (pair->value->type & 0xFF) {
-            case cJSON_False:
-                cJSON_AddFalseToObject(result, pair->key);
-                break;
-            case cJSON_True:
-                cJSON_AddTrueToObject(result, pair->key);
-                break;
-            case cJSON_NULL:
-                cJSON_AddNullToObject(result, pair->key);
-                break;
-            case cJSON_Number:
-                // Optimize integer vs float detection
-                if (pair->value->valuedouble == (double)pair->value->valueint &&
-                    pair->value->valuedouble >= INT_MIN && pair->value->valuedouble <= INT_MAX) {
-                    cJSON_AddNumberToObject(result, pair->key, pair->value->valueint);
-                } else {
-                    cJSON_AddNumberToObject(result, pair->key, pair->value->valuedouble);
-                }
-                break;
-            case cJSON_String:
-                cJSON_AddStringToObject(result, pair->key, pair->value->valuestring);
-                break;
-            default:
-                break;
+
+    JsonArrayView view;
+    if (json_array_view_init(&view, json_array) != 0) {
+        return -1;
+    }
+
+    ThreadPool* pool = acquire_batch_pool(json_array, view.count, use_threads, num_threads);
+    int result = validate_batch_view(validator, &view, pool, mode, errors);
+    thread_pool_release(pool);
+
+    json_array_view_free(&view);
+    return result;
+}
+
+int schema_validate_batch_with_pool(const SchemaValidator* validator, const cJSON* json_array,
+                                    SchemaValidationMode mode, ThreadPool* pool, cJSON** errors) {
+    if (errors) *errors = NULL;
+    if (!validator || !json_array || json_array->type != cJSON_Array) {
+        return -1;
+    }
+
+    JsonArrayView view;
+    if (json_array_view_init(&view, json_array) != 0) {
+        return -1;
+    }
+
+    int result = validate_batch_view(validator, &view, usable_batch_pool(pool, view.count), mode, errors);
+    json_array_view_free(&view);
+    return result;
+}
+
+int schema_validate_view(const SchemaValidator* validator, const JsonArrayView* records, ThreadPool* pool,
+                         SchemaValidationMode mode, cJSON** errors) {
+    if (errors) *errors = NULL;
+    if (!validator || !records) return -1;
+    return validate_batch_view(validator, records, usable_batch_pool(pool, records->count), mode, errors);
+}
+
+long schema_validate_stream(const SchemaValidator* validator, FILE* input, FILE* output,
+                            SchemaValidationMode mode, int use_threads, int num_threads) {
+    if (!validator || !input || !output) return -1;
+
+    NdjsonReader reader;
+    if (ndjson_reader_init(&reader, input) != 0) return -1;
+
+    OutputBuffer line;
+    output_buffer_init(&line, 4096);
+
+    long invalid = 0;
+    long records = 0;
+    for (;;) {
+        cJSON* batch = NULL;
+        int count = ndjson_read_batch(&reader, BATCH_SIZE, &batch);
+        if (count <= 0) {
+            cJSON_Delete(batch);
+            if (count < 0) invalid = -1;
+            break;
         }
-        
-        // Prefetch next pair for better cache utilization
-        if (i + 1 < flattened_array->count) {
-            PREFETCH_READ(&flattened_array->pairs[i + 1]);
+
+        cJSON* errors = NULL;
+        int batch_invalid = schema_validate_batch(validator, batch, mode, use_threads, num_threads, &errors);
+        cJSON_Delete(batch);
+        if (batch_invalid < 0) {
+            invalid = -1;
+            break;
+        }
+
+        // One error per line, numbered by the record's position in the stream
+        int write_failed = 0;
+        for (cJSON* error = errors->child; error && !write_failed; error = error->next) {
+            cJSON* record = cJSON_GetObjectItemCaseSensitive(error, "record");
+            cJSON_SetNumberValue(record, record->valuedouble + (double)records);
+            write_failed = ndjson_write_record(output, error, &line) != 0;
+        }
+        cJSON_Delete(errors);
+        if (write_failed) {
+            fprintf(stderr, "Error writing NDJSON output\n");
+            invalid = -1;
+            break;
         }
+
+        invalid += batch_invalid;
+        records += count;
+        if (batch_invalid > 0 && mode == SCHEMA_VALIDATE_FIRST_ERROR) break;
+    }
+
+    output_buffer_free(&line);
+    ndjson_reader_free(&reader);
+    if (invalid >= 0) fflush(output);
+    return invalid;
+}
+
+// =============================================================================
+// COLUMNAR OUTPUT
+// =============================================================================
+
+// Column types, classified like get_flattened_paths_with_types reports them:
+// "integer" numbers fit an int, every other number is a double
+typedef enum {
+    COLUMN_NULL,     // Only nulls so far
+    COLUMN_BOOL,
+    COLUMN_INT64,
+    COLUMN_DOUBLE,
+    COLUMN_STRING
+} ColumnType;
+
+typedef struct {
+    char* name;
+    size_t length;
+    uint32_t hash;
+    ColumnType type;
+    long first_record;  // Where the path first appeared, so columns keep record order
+    int first_pair;
+} ColumnarColumn;
+
+// Columns keyed by flattened path, with an open-addressing index
+typedef struct {
+    ColumnarColumn* columns;
+    int count;
+    int capacity;
+    int* index;         // Column + 1, 0 for an empty slot
+    int index_mask;
+} ColumnDictionary;
+
+static ColumnType column_type_of(const cJSON* value) {
+    switch (value->type & 0xFF) {
+        case cJSON_False:
+        case cJSON_True:
+            return COLUMN_BOOL;
+        case cJSON_Number:
+            return value->valuedouble == (double)value->valueint &&
+                   value->valuedouble >= INT_MIN && value->valuedouble <= INT_MAX ?
+                   COLUMN_INT64 : COLUMN_DOUBLE;
+        case cJSON_String:
+            return COLUMN_STRING;
+        default:
+            return COLUMN_NULL;
     }
-    
-    return result;
 }
 
-static cJSON* flatten_single_object(cJSON* json) {
-    if (UNLIKELY(!json)) return NULL;
-    
-    // Estimate initial capacity based on object complexity
-    int estimated_capacity = INITIAL_ARRAY_CAPACITY;
-    if (json->type == cJSON_Object) {
-        // Count immediate children for better estimation
-        int child_count = 0;
-        cJSON* child = json->child;
-        while (child && child_count < 100) { // Limit counting for performance
-            child_count++;
-            child = child->next;
+// Nulls take any type, integers widen to doubles and other mixes become strings
+static ColumnType merge_column_types(ColumnType a, ColumnType b) {
+    if (a == b || b == COLUMN_NULL) return a;
+    if (a == COLUMN_NULL) return b;
+    if ((a == COLUMN_INT64 && b == COLUMN_DOUBLE) || (a == COLUMN_DOUBLE && b == COLUMN_INT64)) {
+        return COLUMN_DOUBLE;
+    }
+    return COLUMN_STRING;
+}
+
+static void column_dictionary_free(ColumnDictionary* dict) {
+    for (int i = 0; i < dict->count; i++) {
+        free(dict->columns[i].name);
+    }
+    free(dict->columns);
+    free(dict->index);
+    memset(dict, 0, sizeof(*dict));
+}
+
+static int column_dictionary_find(const ColumnDictionary* dict, const char* name, size_t length, uint32_t hash) {
+    if (!dict->index) return -1;
+    for (int i = (int)(hash & dict->index_mask);; i = (i + 1) & dict->index_mask) {
+        int entry = dict->index[i];
+        if (entry == 0) return -1;
+        const ColumnarColumn* column = &dict->columns[entry - 1];
+        if (column->hash == hash && column->length == length && memcmp(column->name, name, length) == 0) {
+            return entry - 1;
         }
-        estimated_capacity = child_count * 4; // Assume average nesting of 4
     }
-    
-    FlattenedArray flattened_array;
-    init_flattened_array(&flattened_array, estimated_capacity);
-    
-    flatten_json_recursive(json, "", &flattened_array);
-    
-    cJSON* flattened_json = create_flattened_json(&flattened_array);
-    free_flattened_array(&flattened_array);
-    
-    return flattened_json;
 }
 
-static void flatten_object_task(void* arg) {
-    ThreadData* data = (ThreadData*)arg;
-    data->result = flatten_single_object(data->object);
+// Rebuilds the index at a size that keeps it at most half full
+static int column_dictionary_reindex(ColumnDictionary* dict, int min_columns) {
+    int size = 16;
+    while (size < 2 * min_columns) size <<= 1;
+
+    int* index = calloc((size_t)size, sizeof(int));
+    if (!index) return -1;
+    for (int c = 0; c < dict->count; c++) {
+        int i = (int)(dict->columns[c].hash & (size - 1));
+        while (index[i]) i = (i + 1) & (size - 1);
+        index[i] = c + 1;
+    }
+    free(dict->index);
+    dict->index = index;
+    dict->index_mask = size - 1;
+    return 0;
 }
 
-cJSON* flatten_json_object(cJSON* json) {
-    return flatten_single_object(json);
+static int column_dictionary_add(ColumnDictionary* dict, const char* name, size_t length, uint32_t hash,
+                                 ColumnType type, long first_record, int first_pair) {
+    if (dict->count >= dict->capacity) {
+        int capacity = dict->capacity ? dict->capacity * 2 : 64;
+        ColumnarColumn* columns = realloc(dict->columns, (size_t)capacity * sizeof(ColumnarColumn));
+        if (!columns) return -1;
+        dict->columns = columns;
+        dict->capacity = capacity;
+    }
+    if (!dict->index || 2 * (dict->count + 1) > dict->index_mask + 1) {
+        if (column_dictionary_reindex(dict, dict->count + 1) != 0) return -1;
+    }
+
+    char* copy = malloc(length + 1);
+    if (!copy) return -1;
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+
+    int c = dict->count++;
+    dict->columns[c] = (ColumnarColumn){copy, length, hash, type, first_record, first_pair};
+    int i = (int)(hash & dict->index_mask);
+    while (dict->index[i]) i = (i + 1) & dict->index_mask;
+    dict->index[i] = c + 1;
+    return c;
 }
 
-cJSON* flatten_json_batch(cJSON* json_array, int use_threads, int num_threads) {
-    if (!json_array || json_array->type != cJSON_Array) {
-        return NULL;
+static int compare_column_positions(const void* a, const void* b) {
+    const ColumnarColumn* x = a;
+    const ColumnarColumn* y = b;
+    if (x->first_record != y->first_record) return x->first_record < y->first_record ? -1 : 1;
+    return (x->first_pair > y->first_pair) - (x->first_pair < y->first_pair);
+}
+
+struct ColumnarWriter {
+    FILE* output;             // NULL keeps the output in memory
+    OutputBuffer memory;
+    ColumnarFormat format;
+    int batch_rows;
+    ColumnDictionary columns;
+    FlattenShapeCache* shapes;  // Shared by every batch, so recurring shapes keep their keys
+    long records_seen;        // Records offered to columnar_writer_add_columns
+    long rows;
+    long dropped;             // Values outside the columns or of a conflicting type
+    int started;              // Header or schema written; the columns are fixed
+    int failed;
+};
+
+// Per-slot state; pair_columns maps the pairs of mapped_shape to columns so
+// records of a known shape skip the key lookups
+typedef struct {
+    FlattenedArray scratch;
+    ColumnDictionary local;     // Columns found by this slot while building the dictionary
+    const FlattenShape* mapped_shape;
+    int* pair_columns;
+    int pair_capacity;
+    long dropped;
+    int failed;
+} ColumnarSlot;
+
+static ColumnarSlot* columnar_slots_create(ThreadPool* pool, int* slot_count) {
+    *slot_count = thread_pool_get_thread_count(pool) + 1;
+    return calloc((size_t)*slot_count, sizeof(ColumnarSlot));
+}
+
+static void columnar_slots_free(ColumnarSlot* slots, int slot_count) {
+    if (!slots) return;
+    for (int i = 0; i < slot_count; i++) {
+        if (slots[i].scratch.pairs) free_flattened_array(&slots[i].scratch);
+        column_dictionary_free(&slots[i].local);
+        free(slots[i].pair_columns);
     }
-    
-    int array_size = cJSON_GetArraySize(json_array);
-    if (array_size == 0) {
-        return cJSON_CreateArray();
+    free(slots);
+}
+
+// Flattens a record into the slot and returns the column of each pair (-1 for
+// none), resolved against dict by name unless the record's shape was just mapped
+static const int* columnar_map_record(ColumnarSlot* slot, const cJSON* record, FlattenShapeCache* shapes,
+                                      ColumnDictionary* dict, int add_missing, long record_index) {
+    FlattenedArray* scratch = &slot->scratch;
+    flatten_into_scratch(scratch, record, shapes);
+
+    const FlattenShape* shape = scratch->keys_borrowed ? scratch->last_shape : NULL;
+    if (shape && shape == slot->mapped_shape) {
+        return slot->pair_columns;
     }
-    
-    cJSON* result = cJSON_CreateArray();
-    if (!result) return NULL;
-    
-    // Enhanced heuristics for threading decision
-    int should_use_threads = use_threads && 
-                            array_size >= MIN_BATCH_SIZE_FOR_MT && 
-                            get_optimal_threads(num_threads) > 1;
-    
-    // Additional check: estimate work complexity
-    if (should_use_threads && array_size < 1000) {
-        // Sample first few objects to estimate complexity
-        int complex_objects = 0;
-        for (int i = 0; i < MIN(array_size, 10); i++) {
-            cJSON* item = cJSON_GetArrayItem(json_array, i);
-            if (item && item->type == cJSON_Object) {
-                int child_count = 0;
-                cJSON* child = item->child;
-                while (child && child_count < 20) {
-                    child_count++;
-                    child = child->next;
-                }
-                if (child_count > 5) complex_objects++;
-            }
-        }
-        
-        // Only use threading if objects are complex enough
-        if (complex_objects < 3) {
-            should_use_threads = 0;
+
+    if (scratch->count > slot->pair_capacity) {
+        int capacity = scratch->count * 2;
+        int* grown = realloc(slot->pair_columns, (size_t)capacity * sizeof(int));
+        if (!grown) {
+            slot->failed = 1;
+            return NULL;
         }
-    }
-    
-    if (!should_use_threads) {
-        // Single-threaded path with optimizations
-        for (int i = 0; i < array_size; i++) {
-            cJSON* item = cJSON_GetArrayItem(json_array, i);
-            cJSON* flattened = flatten_single_object(item);
-            if (flattened) {
-                cJSON_AddItemToArray(result, flattened);
-            }
-            
-            // Prefetch next item
-            if (i + 1 < array_size) {
-                PREFETCH_READ(cJSON_GetArrayItem(json_array, i + 1));
+        slot->pair_columns = grown;
+        slot->pair_capacity = capacity;
+    }
+
+    for (int p = 0; p < scratch->count; p++) {
+        const FlattenedPair* pair = &scratch->pairs[p];
+        int column = -1;
+        if (LIKELY(pair->key && is_flattened_leaf(pair->value))) {
+            size_t length = strlen_simd(pair->key);
+            uint32_t hash = hash_property_name(pair->key, length);
+            column = column_dictionary_find(dict, pair->key, length, hash);
+            if (column < 0 && add_missing) {
+                column = column_dictionary_add(dict, pair->key, length, hash, COLUMN_NULL, record_index, p);
+                if (column < 0) slot->failed = 1;
             }
         }
-        return result;
+        slot->pair_columns[p] = column;
     }
-    
-    // Multi-threaded path
-    ThreadPool* pool = thread_pool_create(num_threads);
-    if (!pool) {
-        // Fallback to single-threaded
-        for (int i = 0; i < array_size; i++) {
-            cJSON* item = cJSON_GetArrayItem(json_array, i);
-            cJSON* flattened = flatten_single_object(item);
-            if (flattened) {
-                cJSON_AddItemToArray(result, flattened);
+    slot->mapped_shape = shape;
+    return slot->pair_columns;
+}
+
+typedef struct {
+    const JsonArrayView* records;
+    ColumnarSlot* slots;
+    FlattenShapeCache* shapes;
+    long first_record;
+} ColumnDiscoveryJob;
+
+static void discover_columns_range(void* context, int begin, int end, int slot_index) {
+    ColumnDiscoveryJob* job = context;
+    ColumnarSlot* slot = &job->slots[slot_index];
+
+    for (int i = begin; i < end && !slot->failed; i++) {
+        const int* columns = columnar_map_record(slot, job->records->items[i], job->shapes, &slot->local, 1,
+                                                 job->first_record + i);
+        if (!columns) break;
+
+        for (int p = 0; p < slot->scratch.count; p++) {
+            if (columns[p] < 0) continue;
+            ColumnarColumn* column = &slot->local.columns[columns[p]];
+            column->type = merge_column_types(column->type, column_type_of(slot->scratch.pairs[p].value));
+            if (job->first_record + i < column->first_record) {
+                column->first_record = job->first_record + i;
+                column->first_pair = p;
             }
         }
-        return result;
     }
-    
-    ThreadData* thread_data_array = calloc(array_size, sizeof(ThreadData));
-    if (!thread_data_array) {
-        thread_pool_destroy(pool);
-        return result;
+}
+
+// Emits output bytes; after a failure later writes are skipped
+static void columnar_emit(ColumnarWriter* writer, const void* data, size_t length) {
+    if (writer->failed || length == 0) return;
+    if (writer->output) {
+        if (fwrite(data, 1, length, writer->output) != length) {
+            fprintf(stderr, "Error writing columnar output\n");
+            writer->failed = 1;
+        }
+    } else {
+        output_buffer_append(&writer->memory, data, length);
+        if (writer->memory.failed) writer->failed = 1;
     }
-    
-    // Submit all tasks
-    for (int i = 0; i < array_size; i++) {
-        thread_data_array[i].object = cJSON_GetArrayItem(json_array, i);
-        thread_data_array[i].result = NULL;
-        
-        if (thread_pool_add_task(pool, flatten_object_task, &thread_data_array[i]) != 0) {
-            // Queue full, execute synchronously
-            flatten_object_task(&thread_data_array[i]);
+    if (!writer->failed) stats_add(STAT_BYTES_OUT, length);
+}
+
+// -----------------------------------------------------------------------------
+// CSV / TSV
+// -----------------------------------------------------------------------------
+
+#define COLUMNAR_TEXT_BLOCK 256  // Rows rendered per task
+
+static void write_delimited_text(OutputBuffer* out, const char* text, size_t length, ColumnarFormat format) {
+    if (format == COLUMNAR_TSV) {
+        // Tabs and line breaks cannot appear in a TSV field, so they are escaped
+        const char* run = text;
+        for (size_t i = 0; i < length; i++) {
+            char c = text[i];
+            const char* escape = c == '\t' ? "\\t" : c == '\n' ? "\\n" : c == '\r' ? "\\r" : c == '\\' ? "\\\\" : NULL;
+            if (!escape) continue;
+            output_buffer_append(out, run, (size_t)(text + i - run));
+            output_buffer_append(out, escape, 2);
+            run = text + i + 1;
         }
+        output_buffer_append(out, run, (size_t)(text + length - run));
+        return;
     }
-    
-    // Wait for completion
-    thread_pool_wait(pool);
-    
-    // Collect results in order
-    for (int i = 0; i < array_size; i++) {
-        if (thread_data_array[i].result) {
-            cJSON_AddItemToArray(result, thread_data_array[i].result);
+
+    // RFC 4180: fields with separators, quotes or line breaks are quoted, quotes doubled
+    int quote = 0;
+    for (size_t i = 0; i < length && !quote; i++) {
+        quote = text[i] == ',' || text[i] == '"' || text[i] == '\n' || text[i] == '\r';
+    }
+    if (!quote) {
+        output_buffer_append(out, text, length);
+        return;
+    }
+
+    output_buffer_append_char(out, '"');
+    const char* run = text;
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '"') {
+            output_buffer_append(out, run, (size_t)(text + i - run + 1));
+            run = text + i;
         }
     }
-    
-    free(thread_data_array);
-    thread_pool_destroy(pool);
-    
-    return result;
+    output_buffer_append(out, run, (size_t)(text + length - run));
+    output_buffer_append_char(out, '"');
 }
 
-char* flatten_json_string(const char* json_string, int use_threads, int num_threads) {
-    if (!json_string) return NULL;
-    
-    cJSON* json = cJSON_Parse(json_string);
-    if (!json) {
-        const char* error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr) {
-            fprintf(stderr, "Error parsing JSON: %s\n", error_ptr);
+static void write_delimited_cell(OutputBuffer* out, const cJSON* value, ColumnarFormat format) {
+    if (!value) return;
+    switch (value->type & 0xFF) {
+        case cJSON_False: output_buffer_append(out, "false", 5); break;
+        case cJSON_True:  output_buffer_append(out, "true", 4); break;
+        case cJSON_Number: write_json_number(out, value); break;
+        case cJSON_String:
+            write_delimited_text(out, value->valuestring, strlen_simd(value->valuestring), format);
+            break;
+        default: break;  // Nulls are empty fields
+    }
+}
+
+typedef struct {
+    const cJSON** cells;      // cells[column * rows + row], NULL when missing
+    int rows;
+    int column_count;
+    ColumnarFormat format;
+    OutputBuffer* blocks;
+} DelimitedRenderJob;
+
+static void render_delimited_range(void* context, int begin, int end, int slot) {
+    (void)slot;
+    DelimitedRenderJob* job = context;
+    char separator = job->format == COLUMNAR_TSV ? '\t' : ',';
+
+    for (int b = begin; b < end; b++) {
+        OutputBuffer* out = &job->blocks[b];
+        int last = (b + 1) * COLUMNAR_TEXT_BLOCK < job->rows ? (b + 1) * COLUMNAR_TEXT_BLOCK : job->rows;
+        output_buffer_init(out, (size_t)(last - b * COLUMNAR_TEXT_BLOCK) * 16 * (job->column_count + 1) + 64);
+        for (int row = b * COLUMNAR_TEXT_BLOCK; row < last; row++) {
+            for (int c = 0; c < job->column_count; c++) {
+                if (c > 0) output_buffer_append_char(out, separator);
+                write_delimited_cell(out, job->cells[(size_t)c * job->rows + row], job->format);
+            }
+            output_buffer_append_char(out, '\n');
         }
-        return NULL;
     }
-    
-    cJSON* flattened = NULL;
-    
-    if (json->type == cJSON_Array) {
-        int array_size = cJSON_GetArraySize(json);
-        int has_objects = 0;
-        
-        // Quick scan for objects (limit scan for performance)
-        for (int i = 0; i < MIN(array_size, 50); i++) {
-            cJSON* item = cJSON_GetArrayItem(json, i);
-            if (item && (item->type == cJSON_Object || item->type == cJSON_Array)) {
-                has_objects = 1;
+}
+
+static void write_delimited_header(ColumnarWriter* writer) {
+    if (writer->columns.count == 0) return;
+
+    OutputBuffer out;
+    output_buffer_init(&out, 1024);
+    for (int c = 0; c < writer->columns.count; c++) {
+        if (c > 0) output_buffer_append_char(&out, writer->format == COLUMNAR_TSV ? '\t' : ',');
+        write_delimited_text(&out, writer->columns.columns[c].name, writer->columns.columns[c].length, writer->format);
+    }
+    output_buffer_append_char(&out, '\n');
+    if (out.failed) writer->failed = 1;
+    columnar_emit(writer, out.data, out.length);
+    output_buffer_free(&out);
+}
+
+static void write_delimited_batch(ColumnarWriter* writer, const cJSON** cells, int rows, ThreadPool* pool) {
+    if (writer->columns.count == 0) return;
+
+    int block_count = (rows + COLUMNAR_TEXT_BLOCK - 1) / COLUMNAR_TEXT_BLOCK;
+    DelimitedRenderJob job = {cells, rows, writer->columns.count, writer->format,
+                              calloc((size_t)block_count, sizeof(OutputBuffer))};
+    if (!job.blocks) {
+        writer->failed = 1;
+        return;
+    }
+
+    thread_pool_parallel_for(pool, block_count, 1, render_delimited_range, &job);
+    for (int b = 0; b < block_count; b++) {
+        if (job.blocks[b].failed) writer->failed = 1;
+        columnar_emit(writer, job.blocks[b].data, job.blocks[b].length);
+        output_buffer_free(&job.blocks[b]);
+    }
+    free(job.blocks);
+}
+
+// -----------------------------------------------------------------------------
+// Apache Arrow IPC stream
+// -----------------------------------------------------------------------------
+
+// Minimal FlatBuffers writer for the IPC metadata. Objects are laid out front
+// to back: each table has 8-byte field slots right behind its vtable, and
+// children are appended after their parent, which stores the forward offset.
+#define ARROW_METADATA_V5 4
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_RECORD_BATCH 3
+#define ARROW_TYPE_NULL 1
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_BOOL 6
+#define ARROW_PRECISION_DOUBLE 2
+
+static size_t fb_pad(OutputBuffer* fb, size_t alignment, size_t extra) {
+    // Pads so that position + extra is a multiple of alignment
+    while ((fb->length + extra) % alignment) output_buffer_append_char(fb, '\0');
+    return fb->length;
+}
+
+static void fb_put(OutputBuffer* fb, size_t position, const void* value, size_t size) {
+    if (!fb->failed && position + size <= fb->length) memcpy(fb->data + position, value, size);
+}
+
+static void fb_append_zeros(OutputBuffer* fb, size_t size) {
+    if (output_buffer_reserve(fb, size)) {
+        memset(fb->data + fb->length, 0, size);
+        fb->length += size;
+    }
+}
+
+// Starts a table of field_count slots; fields whose bit is clear in present
+// are absent. Returns the table position.
+static size_t fb_table(OutputBuffer* fb, int field_count, unsigned present) {
+    uint16_t vtable_size = (uint16_t)(4 + 2 * field_count);
+    uint16_t table_size = (uint16_t)(8 + 8 * field_count);
+
+    size_t vtable = fb_pad(fb, 8, vtable_size);
+    output_buffer_append(fb, (const char*)&vtable_size, 2);
+    output_buffer_append(fb, (const char*)&table_size, 2);
+    for (int i = 0; i < field_count; i++) {
+        uint16_t offset = (present >> i) & 1 ? (uint16_t)(8 + 8 * i) : 0;
+        output_buffer_append(fb, (const char*)&offset, 2);
+    }
+
+    size_t table = fb->length;
+    int32_t vtable_offset = (int32_t)(table - vtable);
+    output_buffer_append(fb, (const char*)&vtable_offset, 4);
+    fb_append_zeros(fb, table_size - 4);
+    return table;
+}
+
+static void fb_set(OutputBuffer* fb, size_t table, int field, const void* value, size_t size) {
+    fb_put(fb, table + 8 + 8 * (size_t)field, value, size);
+}
+
+static void fb_set_offset(OutputBuffer* fb, size_t slot, size_t target) {
+    uint32_t offset = (uint32_t)(target - slot);
+    fb_put(fb, slot, &offset, 4);
+}
+
+static void fb_set_field_offset(OutputBuffer* fb, size_t table, int field, size_t target) {
+    fb_set_offset(fb, table + 8 + 8 * (size_t)field, target);
+}
+
+// Vector of count elements aligned for element_alignment; returns its position
+// (the length prefix). Elements start 4 bytes later.
+static size_t fb_vector(OutputBuffer* fb, uint32_t count, size_t element_size, size_t element_alignment,
+                        const void* elements) {
+    size_t vector = fb_pad(fb, element_alignment > 4 ? element_alignment : 4, 4);
+    output_buffer_append(fb, (const char*)&count, 4);
+    if (elements) {
+        output_buffer_append(fb, elements, count * element_size);
+    } else {
+        fb_append_zeros(fb, count * element_size);
+    }
+    return vector;
+}
+
+static size_t fb_string(OutputBuffer* fb, const char* text, size_t length) {
+    size_t string = fb_pad(fb, 4, 0);
+    uint32_t count = (uint32_t)length;
+    output_buffer_append(fb, (const char*)&count, 4);
+    output_buffer_append(fb, text, length);
+    output_buffer_append_char(fb, '\0');
+    return string;
+}
+
+// Starts a Message flatbuffer; the root offset is patched by arrow_message_finish
+static size_t arrow_message_begin(OutputBuffer* fb, uint8_t header_type, int64_t body_length) {
+    output_buffer_init(fb, 1024);
+    fb_append_zeros(fb, 4);
+
+    size_t message = fb_table(fb, 4, 0xF);
+    int16_t version = ARROW_METADATA_V5;
+    fb_set(fb, message, 0, &version, 2);
+    fb_set(fb, message, 1, &header_type, 1);
+    fb_set(fb, message, 3, &body_length, 8);
+    fb_set_offset(fb, 0, message);
+    return message;
+}
+
+// Frames the metadata as an encapsulated IPC message
+static void arrow_message_emit(ColumnarWriter* writer, OutputBuffer* fb) {
+    fb_pad(fb, 8, 0);
+    if (fb->failed) {
+        writer->failed = 1;
+        output_buffer_free(fb);
+        return;
+    }
+    int32_t prefix[2] = {-1, (int32_t)fb->length};
+    columnar_emit(writer, prefix, sizeof(prefix));
+    columnar_emit(writer, fb->data, fb->length);
+    output_buffer_free(fb);
+}
+
+static void write_arrow_schema(ColumnarWriter* writer) {
+    OutputBuffer fb;
+    size_t message = arrow_message_begin(&fb, ARROW_HEADER_SCHEMA, 0);
+
+    size_t schema = fb_table(&fb, 2, 0x3);
+    fb_set_field_offset(&fb, message, 2, schema);
+    int count = writer->columns.count;
+    size_t fields = fb_vector(&fb, (uint32_t)count, 4, 4, NULL);
+    fb_set_field_offset(&fb, schema, 1, fields);
+
+    for (int c = 0; c < count; c++) {
+        const ColumnarColumn* column = &writer->columns.columns[c];
+
+        // Field: name, nullable, type_type, type, (dictionary), children
+        size_t field = fb_table(&fb, 6, 0x2F);
+        fb_set_offset(&fb, fields + 4 + 4 * (size_t)c, field);
+        uint8_t nullable = 1;
+        fb_set(&fb, field, 1, &nullable, 1);
+
+        uint8_t type_type;
+        size_t type;
+        switch (column->type) {
+            case COLUMN_BOOL:
+                type_type = ARROW_TYPE_BOOL;
+                type = fb_table(&fb, 0, 0);
+                break;
+            case COLUMN_INT64: {
+                type_type = ARROW_TYPE_INT;
+                type = fb_table(&fb, 2, 0x3);
+                int32_t bit_width = 64;
+                uint8_t is_signed = 1;
+                fb_set(&fb, type, 0, &bit_width, 4);
+                fb_set(&fb, type, 1, &is_signed, 1);
+                break;
+            }
+            case COLUMN_DOUBLE: {
+                type_type = ARROW_TYPE_FLOATING_POINT;
+                type = fb_table(&fb, 1, 0x1);
+                int16_t precision = ARROW_PRECISION_DOUBLE;
+                fb_set(&fb, type, 0, &precision, 2);
                 break;
             }
+            case COLUMN_STRING:
+                type_type = ARROW_TYPE_UTF8;
+                type = fb_table(&fb, 0, 0);
+                break;
+            default:
+                type_type = ARROW_TYPE_NULL;
+                type = fb_table(&fb, 0, 0);
+                break;
         }
-        
-        if (has_objects) {
-            flattened = flatten_json_batch(json, use_threads, num_threads);
+        fb_set(&fb, field, 2, &type_type, 1);
+        fb_set_field_offset(&fb, field, 3, type);
+        fb_set_field_offset(&fb, field, 0, fb_string(&fb, column->name, column->length));
+        fb_set_field_offset(&fb, field, 5, fb_vector(&fb, 0, 4, 4, NULL));
+    }
+
+    arrow_message_emit(writer, &fb);
+}
+
+// One column of a record batch: validity bitmap, then values (or offsets and
+// UTF-8 data for strings). Bitmaps are written only when there are nulls.
+typedef struct {
+    OutputBuffer validity;
+    OutputBuffer values;
+    OutputBuffer data;
+    long null_count;
+    long conflicts;
+} ArrowColumnBuffers;
+
+typedef struct {
+    const cJSON** cells;
+    int rows;
+    const ColumnarColumn* columns;
+    ArrowColumnBuffers* buffers;
+} ArrowEncodeJob;
+
+// Text of a non-string value in a string column, as it appears in JSON
+static void write_arrow_text(OutputBuffer* out, const cJSON* value) {
+    switch (value->type & 0xFF) {
+        case cJSON_False: output_buffer_append(out, "false", 5); break;
+        case cJSON_True:  output_buffer_append(out, "true", 4); break;
+        case cJSON_Number: write_json_number(out, value); break;
+        default: output_buffer_append(out, value->valuestring, strlen_simd(value->valuestring)); break;
+    }
+}
+
+static void encode_arrow_column(const ArrowEncodeJob* job, int c) {
+    const ColumnarColumn* column = &job->columns[c];
+    ArrowColumnBuffers* buffers = &job->buffers[c];
+    const cJSON** cells = job->cells + (size_t)c * job->rows;
+    int rows = job->rows;
+    size_t bitmap_bytes = ((size_t)rows + 7) / 8;
+
+    if (column->type == COLUMN_NULL) {
+        for (int r = 0; r < rows; r++) {
+            if (cells[r] && column_type_of(cells[r]) != COLUMN_NULL) buffers->conflicts++;
+        }
+        buffers->null_count = rows;
+        return;
+    }
+
+    output_buffer_init(&buffers->validity, bitmap_bytes + 8);
+    fb_append_zeros(&buffers->validity, bitmap_bytes);
+    size_t value_size = column->type == COLUMN_BOOL ? 0 : column->type == COLUMN_STRING ? 4 : 8;
+    output_buffer_init(&buffers->values, value_size ? value_size * ((size_t)rows + 1) : bitmap_bytes + 8);
+    if (column->type == COLUMN_BOOL) fb_append_zeros(&buffers->values, bitmap_bytes);
+    if (column->type == COLUMN_STRING) {
+        output_buffer_init(&buffers->data, (size_t)rows * 16 + 8);
+        int32_t zero = 0;
+        output_buffer_append(&buffers->values, (const char*)&zero, 4);
+    }
+
+    for (int r = 0; r < rows; r++) {
+        const cJSON* value = cells[r];
+        ColumnType type = value ? column_type_of(value) : COLUMN_NULL;
+
+        // A value fits if the column type would not change by merging it in
+        int fits = type != COLUMN_NULL && merge_column_types(column->type, type) == column->type;
+        if (type != COLUMN_NULL && !fits) buffers->conflicts++;
+        if (fits && !buffers->validity.failed) {
+            buffers->validity.data[r >> 3] |= (unsigned char)(1u << (r & 7));
         } else {
-            flattened = cJSON_Duplicate(json, 1);
+            buffers->null_count++;
+        }
+
+        switch (column->type) {
+            case COLUMN_BOOL:
+                if (fits && cJSON_IsTrue(value) && !buffers->values.failed) {
+                    buffers->values.data[r >> 3] |= (unsigned char)(1u << (r & 7));
+                }
+                break;
+            case COLUMN_INT64: {
+                int64_t number = fits ? (int64_t)value->valueint : 0;
+                output_buffer_append(&buffers->values, (const char*)&number, 8);
+                break;
+            }
+            case COLUMN_DOUBLE: {
+                double number = fits ? value->valuedouble : 0.0;
+                output_buffer_append(&buffers->values, (const char*)&number, 8);
+                break;
+            }
+            default: {
+                if (fits) write_arrow_text(&buffers->data, value);
+                if (buffers->data.length > INT32_MAX) buffers->data.failed = 1;
+                int32_t offset = (int32_t)buffers->data.length;
+                output_buffer_append(&buffers->values, (const char*)&offset, 4);
+                break;
+            }
         }
-    } else {
-        flattened = flatten_json_object(json);
     }
-    
-    char* result = NULL;
-    if (flattened) {
-        result = cJSON_Print(flattened);
-        cJSON_Delete(flattened);
+}
+
+static void encode_arrow_range(void* context, int begin, int end, int slot) {
+    (void)slot;
+    for (int c = begin; c < end; c++) {
+        encode_arrow_column(context, c);
     }
-    
-    cJSON_Delete(json);
-    return result;
 }
 
-// Path extraction with types (optimized)
-static const char* get_cjson_type_string(const cJSON* item) {
-    if (!item) return "null";
-    
-    switch (item->type & 0xFF) {
-        case cJSON_False:
-        case cJSON_True:
-            return "boolean";
-        case cJSON_NULL:
-            return "null";
-        case cJSON_Number:
-            if (item->valuedouble == (double)item->valueint &&
-                item->valuedouble >= INT_MIN && item->valuedouble <= INT_MAX) {
-                return "integer";
-            } else {
-                return "number";
-            }
-        case cJSON_String:
-            return "string";
-        case cJSON_Array:
-            return "array";
-        case cJSON_Object:
-            return "object";
-        default:
-            return "unknown";
+static void emit_arrow_buffer(ColumnarWriter* writer, const OutputBuffer* buffer) {
+    static const char padding[8] = {0};
+    columnar_emit(writer, buffer->data, buffer->length);
+    columnar_emit(writer, padding, (8 - buffer->length % 8) % 8);
+}
+
+static void write_arrow_batch(ColumnarWriter* writer, const cJSON** cells, int rows, ThreadPool* pool) {
+    int count = writer->columns.count;
+    ArrowEncodeJob job = {cells, rows, writer->columns.columns,
+                          calloc(count > 0 ? (size_t)count : 1, sizeof(ArrowColumnBuffers))};
+    if (!job.buffers) {
+        writer->failed = 1;
+        return;
+    }
+    thread_pool_parallel_for(pool, count, 1, encode_arrow_range, &job);
+
+    // Buffer layout per column: Null has none, Bool/Int/FloatingPoint have
+    // validity and values, Utf8 has validity, offsets and data
+    int buffer_count = 0;
+    for (int c = 0; c < count; c++) {
+        ColumnType type = writer->columns.columns[c].type;
+        buffer_count += type == COLUMN_NULL ? 0 : type == COLUMN_STRING ? 3 : 2;
+    }
+
+    int64_t* nodes = calloc(2 * (size_t)(count > 0 ? count : 1), sizeof(int64_t));
+    int64_t* spans = calloc(2 * (size_t)(buffer_count > 0 ? buffer_count : 1), sizeof(int64_t));
+    int64_t body_length = 0;
+    int span = 0;
+    for (int c = 0; nodes && spans && c < count; c++) {
+        ArrowColumnBuffers* buffers = &job.buffers[c];
+        ColumnType type = writer->columns.columns[c].type;
+        writer->dropped += buffers->conflicts;
+        nodes[2 * c] = rows;
+        nodes[2 * c + 1] = buffers->null_count;
+        if (buffers->validity.failed || buffers->values.failed || buffers->data.failed) writer->failed = 1;
+        if (type == COLUMN_NULL) continue;
+
+        // Without nulls the validity bitmap is left out
+        if (buffers->null_count == 0) buffers->validity.length = 0;
+        OutputBuffer* parts[3] = {&buffers->validity, &buffers->values, &buffers->data};
+        for (int b = 0; b < (type == COLUMN_STRING ? 3 : 2); b++) {
+            spans[2 * span] = body_length;
+            spans[2 * span + 1] = (int64_t)parts[b]->length;
+            body_length += (int64_t)((parts[b]->length + 7) & ~(size_t)7);
+            span++;
+        }
+    }
+
+    if (!nodes || !spans) {
+        writer->failed = 1;
+    } else if (!writer->failed) {
+        OutputBuffer fb;
+        size_t message = arrow_message_begin(&fb, ARROW_HEADER_RECORD_BATCH, body_length);
+
+        // RecordBatch: length, nodes (FieldNode structs), buffers (Buffer structs)
+        size_t batch = fb_table(&fb, 3, 0x7);
+        fb_set_field_offset(&fb, message, 2, batch);
+        int64_t length = rows;
+        fb_set(&fb, batch, 0, &length, 8);
+        fb_set_field_offset(&fb, batch, 1, fb_vector(&fb, (uint32_t)count, 16, 8, nodes));
+        fb_set_field_offset(&fb, batch, 2, fb_vector(&fb, (uint32_t)buffer_count, 16, 8, spans));
+        arrow_message_emit(writer, &fb);
+
+        for (int c = 0; c < count; c++) {
+            ColumnType type = writer->columns.columns[c].type;
+            if (type == COLUMN_NULL) continue;
+            emit_arrow_buffer(writer, &job.buffers[c].validity);
+            emit_arrow_buffer(writer, &job.buffers[c].values);
+            if (type == COLUMN_STRING) emit_arrow_buffer(writer, &job.buffers[c].data);
+        }
+    }
+
+    for (int c = 0; c < count; c++) {
+        output_buffer_free(&job.buffers[c].validity);
+        output_buffer_free(&job.buffers[c].values);
+        output_buffer_free(&job.buffers[c].data);
     }
+    free(job.buffers);
+    free(nodes);
+    free(spans);
 }
 
-static void collect_paths_with_types_recursive(const cJSON* json, const char* prefix, cJSON* result) {
-    if (!json || !result) return;
+// -----------------------------------------------------------------------------
+// Writer
+// -----------------------------------------------------------------------------
+
+int columnar_format_parse(const char* name, ColumnarFormat* format) {
+    if (!name || !format) return -1;
+    if (strcmp(name, "csv") == 0) {
+        *format = COLUMNAR_CSV;
+    } else if (strcmp(name, "tsv") == 0) {
+        *format = COLUMNAR_TSV;
+    } else if (strcmp(name, "arrow") == 0) {
+        *format = COLUMNAR_ARROW;
+    } else {
+        return -1;
+    }
+    return 0;
+}
 
-    char key_buffer[MAX_KEY_LENGTH];
-    const cJSON* child = NULL;
+ColumnarWriter* columnar_writer_create(FILE* output, ColumnarFormat format, int batch_rows) {
+    if (format != COLUMNAR_CSV && format != COLUMNAR_TSV && format != COLUMNAR_ARROW) return NULL;
 
-    if (cJSON_IsArray(json)) {
-        int index = 0;
-        cJSON_ArrayForEach(child, json) {
-            build_key_optimized(key_buffer, sizeof(key_buffer), prefix, NULL, 1, index);
+    init_global_pools();
 
-            if (cJSON_IsObject(child) && child->child) {
-                collect_paths_with_types_recursive(child, key_buffer, result);
-            } else if (cJSON_IsArray(child)) {
-                collect_paths_with_types_recursive(child, key_buffer, result);
-            } else {
-                const char* type_str = get_cjson_type_string(child);
-                cJSON* type_value = cJSON_CreateString(type_str);
-                if (type_value) {
-                    cJSON_AddItemToObject(result, key_buffer, type_value);
-                }
-            }
-            index++;
+    ColumnarWriter* writer = calloc(1, sizeof(ColumnarWriter));
+    if (!writer) return NULL;
+
+    writer->output = output;
+    writer->format = format;
+    writer->batch_rows = batch_rows > 0 ? batch_rows : COLUMNAR_BATCH_ROWS;
+    writer->shapes = flatten_shape_cache_create(0);  // Optional: NULL just means no key reuse
+    if (!output) {
+        output_buffer_init(&writer->memory, 4096);
+        if (writer->memory.failed) {
+            flatten_shape_cache_free(writer->shapes);
+            free(writer);
+            return NULL;
         }
-    } else {
-        cJSON_ArrayForEach(child, json) {
-            const char* child_name = child->string;
-            if (!child_name) continue;
+    }
+    return writer;
+}
 
-            if (prefix && strlen_simd(prefix) > 0) {
-                build_key_optimized(key_buffer, sizeof(key_buffer), prefix, child_name, 0, 0);
-            } else {
-                strncpy(key_buffer, child_name, sizeof(key_buffer) - 1);
-                key_buffer[sizeof(key_buffer) - 1] = '\0';
+int columnar_writer_add_columns(ColumnarWriter* writer, const JsonArrayView* records, ThreadPool* pool) {
+    if (!writer || !records) return -1;
+    if (writer->started) {
+        fprintf(stderr, "Error: columns cannot be added once output has started\n");
+        return -1;
+    }
+
+    int slot_count;
+    ColumnarSlot* slots = columnar_slots_create(pool, &slot_count);
+    if (!slots) return -1;
+
+    // Records are counted when they are written
+    int outer = stats_phase_begin(STATS_PHASE_TRANSFORM);
+    ColumnDiscoveryJob job = {records, slots, writer->shapes, writer->records_seen};
+    thread_pool_parallel_for(pool, records->count, MIN_RECORDS_PER_CHUNK, discover_columns_range, &job);
+    stats_phase_end(outer);
+
+    // Merge the per-slot columns, then order them by first appearance
+    outer = stats_phase_begin(STATS_PHASE_MERGE);
+    ColumnDictionary* dict = &writer->columns;
+    int failed = 0;
+    for (int s = 0; s < slot_count && !failed; s++) {
+        failed = slots[s].failed;
+        for (int i = 0; i < slots[s].local.count && !failed; i++) {
+            const ColumnarColumn* local = &slots[s].local.columns[i];
+            int c = column_dictionary_find(dict, local->name, local->length, local->hash);
+            if (c < 0) {
+                failed = column_dictionary_add(dict, local->name, local->length, local->hash, local->type,
+                                               local->first_record, local->first_pair) < 0;
+                continue;
+            }
+            ColumnarColumn* column = &dict->columns[c];
+            column->type = merge_column_types(column->type, local->type);
+            if (compare_column_positions(local, column) < 0) {
+                column->first_record = local->first_record;
+                column->first_pair = local->first_pair;
             }
+        }
+    }
+    columnar_slots_free(slots, slot_count);
 
-            if (cJSON_IsObject(child) && child->child) {
-                collect_paths_with_types_recursive(child, key_buffer, result);
-            } else if (cJSON_IsArray(child)) {
-                collect_paths_with_types_recursive(child, key_buffer, result);
-            } else {
-                const char* type_str = get_cjson_type_string(child);
-                cJSON* type_value = cJSON_CreateString(type_str);
-                if (type_value) {
-                    cJSON_AddItemToObject(result, key_buffer, type_value);
-                }
+    if (!failed && dict->count > 0) {
+        qsort(dict->columns, (size_t)dict->count, sizeof(ColumnarColumn), compare_column_positions);
+        failed = column_dictionary_reindex(dict, dict->count) != 0;
+    }
+    stats_phase_end(outer);
+    writer->records_seen += records->count;
+    if (failed) writer->failed = 1;
+    return failed ? -1 : 0;
+}
+
+typedef struct {
+    const JsonArrayView* records;
+    int first;
+    int rows;
+    const cJSON** cells;
+    ColumnarSlot* slots;
+    ColumnarWriter* writer;
+} ColumnFillJob;
+
+static void fill_columns_range(void* context, int begin, int end, int slot_index) {
+    ColumnFillJob* job = context;
+    ColumnarSlot* slot = &job->slots[slot_index];
+
+    for (int row = begin; row < end && !slot->failed; row++) {
+        const int* columns = columnar_map_record(slot, job->records->items[job->first + row],
+                                                 job->writer->shapes, &job->writer->columns, 0, 0);
+        if (!columns) break;
+
+        for (int p = 0; p < slot->scratch.count; p++) {
+            if (columns[p] >= 0) {
+                // Repeated keys keep the last value, as they would in an object
+                job->cells[(size_t)columns[p] * job->rows + row] = slot->scratch.pairs[p].value;
+            } else if (is_flattened_leaf(slot->scratch.pairs[p].value)) {
+                slot->dropped++;
             }
         }
     }
 }
 
-cJSON* get_flattened_paths_with_types(cJSON* json) {
-    if (!json) return NULL;
+int columnar_writer_write(ColumnarWriter* writer, const JsonArrayView* records, ThreadPool* pool) {
+    if (!writer || !records || writer->failed) return -1;
 
-    cJSON* result = cJSON_CreateObject();
-    if (!result) return NULL;
+    // The first write fixes the columns, from these records unless some were added
+    if (!writer->started) {
+        if (writer->columns.count == 0 && columnar_writer_add_columns(writer, records, pool) != 0) return -1;
+        if (writer->format == COLUMNAR_ARROW) {
+            write_arrow_schema(writer);
+        } else {
+            write_delimited_header(writer);
+        }
+        writer->started = 1;
+    }
+
+    int slot_count;
+    ColumnarSlot* slots = columnar_slots_create(pool, &slot_count);
+    int batch_rows = records->count < writer->batch_rows ? records->count : writer->batch_rows;
+    size_t cell_count = (size_t)writer->columns.count * (size_t)(batch_rows > 0 ? batch_rows : 1);
+    const cJSON** cells = malloc((cell_count > 0 ? cell_count : 1) * sizeof(cJSON*));
+    if (!slots || !cells) {
+        columnar_slots_free(slots, slot_count);
+        free(cells);
+        writer->failed = 1;
+        return -1;
+    }
+
+    // Each record batch is flattened in chunks on the pool straight into its
+    // cells, then rendered and written before the next one starts
+    int outer = stats_transform_begin((uint64_t)records->count);
+    for (int first = 0; first < records->count && !writer->failed; first += batch_rows) {
+        int rows = records->count - first < batch_rows ? records->count - first : batch_rows;
+        memset(cells, 0, (size_t)writer->columns.count * (size_t)rows * sizeof(cJSON*));
+
+        ColumnFillJob job = {records, first, rows, cells, slots, writer};
+        thread_pool_parallel_for(pool, rows, MIN_RECORDS_PER_CHUNK, fill_columns_range, &job);
+        for (int s = 0; s < slot_count; s++) {
+            if (slots[s].failed) writer->failed = 1;
+        }
+        if (writer->failed) break;
 
-    if (cJSON_IsObject(json)) {
-        collect_paths_with_types_recursive(json, "", result);
-    } else if (cJSON_IsArray(json)) {
-        collect_paths_with_types_recursive(json, "", result);
-    } else {
-        const char* type_str = get_cjson_type_string(json);
-        cJSON* type_value = cJSON_CreateString(type_str);
-        if (type_value) {
-            cJSON_AddItemToObject(result, "root", type_value);
+        int serialize_outer = stats_phase_begin(STATS_PHASE_SERIALIZE);
+        if (writer->format == COLUMNAR_ARROW) {
+            write_arrow_batch(writer, cells, rows, pool);
+        } else {
+            write_delimited_batch(writer, cells, rows, pool);
         }
+        stats_phase_end(serialize_outer);
+        writer->rows += rows;
     }
+    stats_phase_end(outer);
 
-    return result;
+    for (int s = 0; s < slot_count; s++) {
+        writer->dropped += slots[s].dropped;
+    }
+    columnar_slots_free(slots, slot_count);
+    free(cells);
+    return writer->failed ? -1 : 0;
 }
 
-char* get_flattened_paths_with_types_string(const char* json_string) {
-    if (!json_string) return NULL;
-
-    cJSON* json = cJSON_Parse(json_string);
-    if (!json) return NULL;
-
-    cJSON* paths_with_types = get_flattened_paths_with_types(json);
-    char* result = NULL;
+long columnar_writer_finish(ColumnarWriter* writer) {
+    if (!writer) return -1;
 
-    if (paths_with_types) {
-        result = cJSON_Print(paths_with_types);
-        cJSON_Delete(paths_with_types);
+    // An input without records still gets its header and schema
+    if (!writer->started && !writer->failed) {
+        JsonArrayView empty = {NULL, 0};
+        columnar_writer_write(writer, &empty, NULL);
+    }
+    if (writer->format == COLUMNAR_ARROW) {
+        int32_t end_of_stream[2] = {-1, 0};
+        columnar_emit(writer, end_of_stream, sizeof(end_of_stream));
+    }
+    if (writer->output && !writer->failed && fflush(writer->output) != 0) {
+        writer->failed = 1;
     }
+    if (writer->dropped > 0) {
+        fprintf(stderr, "Warning: %ld values outside the columns of the first batch were left out\n",
+                writer->dropped);
+    }
+    return writer->failed ? -1 : writer->rows;
+}
 
-    cJSON_Delete(json);
-    return result;
+const char* columnar_writer_output(const ColumnarWriter* writer, size_t* length) {
+    if (!writer || writer->output || writer->failed) return NULL;
+    if (length) *length = writer->memory.length;
+    return writer->memory.data;
 }
 
-// =============================================================================
-// ULTRA-OPTIMIZED JSON SCHEMA GENERATOR
-// =============================================================================
+long columnar_writer_dropped(const ColumnarWriter* writer) {
+    return writer ? writer->dropped : 0;
+}
 
-typedef enum {
-    TYPE_NULL,
-    TYPE_BOOLEAN,
-    TYPE_INTEGER,
-    TYPE_NUMBER,
-    TYPE_STRING,
-    TYPE_ARRAY,
-    TYPE_OBJECT,
-    TYPE_MIXED
-} SchemaType;
+void columnar_writer_free(ColumnarWriter* writer) {
+    if (!writer) return;
+    column_dictionary_free(&writer->columns);
+    flatten_shape_cache_free(writer->shapes);
+    output_buffer_free(&writer->memory);
+    free(writer);
+}
 
-typedef struct SchemaNode {
-    SchemaType type;
-    int required;
-    int nullable;
-    struct SchemaNode* items;
-    struct PropertyNode* properties;
-    char** required_props;
-    int required_count;
-    int required_capacity;
-    cJSON* enum_values;
-    int enum_count;
-    // Optimization: cache frequently accessed properties
-    struct PropertyNode* property_cache[8];
-    int cache_size;
-} SchemaNode;
+long flatten_json_view_columnar(const JsonArrayView* records, ThreadPool* pool, FILE* output, ColumnarFormat format) {
+    if (!records || !output) return -1;
 
-typedef struct PropertyNode {
-    char* name;
-    size_t name_len;
-    uint32_t name_hash; // Cache hash for faster lookups
-    SchemaNode* schema;
-    int required;
-    struct PropertyNode* next;
-} PropertyNode;
+    ColumnarWriter* writer = columnar_writer_create(output, format, 0);
+    if (!writer) return -1;
 
-// Fast hash function for property names
-static uint32_t hash_property_name(const char* name, size_t len) {
-    uint32_t hash = 2166136261u; // FNV-1a offset basis
-    for (size_t i = 0; i < len; i++) {
-        hash ^= (uint8_t)name[i];
-        hash *= 16777619u; // FNV-1a prime
+    // The whole input is known, so every path gets a column before the first batch
+    pool = usable_batch_pool(pool, records->count);
+    long rows = -1;
+    if (columnar_writer_add_columns(writer, records, pool) == 0 &&
+        columnar_writer_write(writer, records, pool) == 0) {
+        rows = columnar_writer_finish(writer);
     }
-    return hash;
+    columnar_writer_free(writer);
+    return rows;
 }
 
-static SchemaNode* create_schema_node(SchemaType type) {
-    // Temporarily use regular malloc to avoid memory pool issues
-    SchemaNode* node = malloc(sizeof(SchemaNode));
-    if (!node) return NULL;
+long flatten_json_columnar(const cJSON* json, FILE* output, ColumnarFormat format, int use_threads, int num_threads) {
+    if (!json || !output) return -1;
 
-    memset(node, 0, sizeof(SchemaNode));
-    node->type = type;
-    node->required = 1;
+    // An array is a batch of records, anything else a single record
+    JsonArrayView records;
+    cJSON* single = (cJSON*)json;
+    if (cJSON_IsArray(json)) {
+        if (json_array_view_init(&records, json) != 0) return -1;
+    } else {
+        records.items = &single;
+        records.count = 1;
+    }
 
-    return node;
+    ThreadPool* pool = cJSON_IsArray(json) ?
+        acquire_batch_pool(json, records.count, use_threads, num_threads) : NULL;
+    long rows = flatten_json_view_columnar(&records, pool, output, format);
+    thread_pool_release(pool);
+
+    if (cJSON_IsArray(json)) json_array_view_free(&records);
+    return rows;
 }
 
-// Optimized property addition with caching
-HOT_PATH void add_property(SchemaNode* node, const char* name, SchemaNode* property_schema, int required) {
-    PropertyNode* prop = slab_alloc(g_property_node_pool);
-    if (UNLIKELY(!prop)) {
-        prop = malloc(sizeof(PropertyNode));
-        if (!prop) return;
-    }
+long flatten_json_stream_columnar(FILE* input, FILE* output, ColumnarFormat format, int use_threads, int num_threads) {
+    if (!input || !output) return -1;
 
-    size_t name_len = strlen_simd(name);
-    prop->name = my_strdup(name);
-    prop->name_len = name_len;
-    prop->name_hash = hash_property_name(name, name_len);
-    prop->schema = property_schema;
-    prop->required = required;
-    prop->next = node->properties;
-    node->properties = prop;
+    NdjsonReader reader;
+    if (ndjson_reader_init(&reader, input) != 0) return -1;
 
-    // Add to cache if there's space
-    if (node->cache_size < 8) {
-        node->property_cache[node->cache_size++] = prop;
+    ColumnarWriter* writer = columnar_writer_create(output, format, 0);
+    if (!writer) {
+        ndjson_reader_free(&reader);
+        return -1;
     }
 
-    if (required) {
-        if (UNLIKELY(node->required_count >= node->required_capacity)) {
-            int new_capacity = node->required_capacity == 0 ? 8 : node->required_capacity * 2;
-            char** new_props = realloc(node->required_props, new_capacity * sizeof(char*));
-            if (UNLIKELY(!new_props)) return;
+    // The first batch decides the columns; each batch becomes one record batch
+    int failed = 0;
+    for (;;) {
+        cJSON* batch = NULL;
+        int count = ndjson_read_batch(&reader, writer->batch_rows, &batch);
+        if (count <= 0) {
+            cJSON_Delete(batch);
+            failed = count < 0;
+            break;
+        }
 
-            node->required_props = new_props;
-            node->required_capacity = new_capacity;
+        JsonArrayView records;
+        failed = json_array_view_init(&records, batch) != 0;
+        if (!failed) {
+            ThreadPool* pool = acquire_batch_pool(batch, count, use_threads, num_threads);
+            failed = columnar_writer_write(writer, &records, pool) != 0;
+            thread_pool_release(pool);
+            json_array_view_free(&records);
         }
-        node->required_props[node->required_count++] = my_strdup(name);
+        cJSON_Delete(batch);
+        if (failed) break;
     }
+
+    long rows = failed ? -1 : columnar_writer_finish(writer);
+    columnar_writer_free(writer);
+    ndjson_reader_free(&reader);
+    return rows;
+}
+
+// =============================================================================
+// RUNTIME STATISTICS REPORT
+// =============================================================================
+
+#ifndef STATS_DISABLED
+
+static void stats_add_seconds(cJSON* object, const char* name, uint64_t ns) {
+    cJSON_AddNumberToObject(object, name, (double)ns / 1e9);
+}
+
+static cJSON* stats_worker_json(const StatsBlock* block) {
+    cJSON* worker = cJSON_CreateObject();
+    if (!worker) return NULL;
+    cJSON_AddNumberToObject(worker, "tasks", (double)block->counters[STAT_WORKER_TASKS]);
+    stats_add_seconds(worker, "busy_seconds", block->counters[STAT_WORKER_BUSY_NS]);
+    stats_add_seconds(worker, "idle_seconds", block->counters[STAT_WORKER_IDLE_NS]);
+    return worker;
 }
 
-// Optimized property lookup with cache and hash
-static PropertyNode* find_property(SchemaNode* node, const char* name) {
-    if (!node || !name) return NULL;
+cJSON* cjson_tools_get_stats(void) {
+    static const char* const phase_names[STATS_PHASE_COUNT] = {"parse", "transform", "merge", "serialize"};
+    
+    StatsBlock total;
+    memset(&total, 0, sizeof(total));
+    cJSON* threads = cJSON_CreateArray();
+    const char* pool_names[STATS_POOL_SLOTS];
+    
+    pthread_mutex_lock(&g_stats_mutex);
+    stats_fold(&total, &g_stats_retired);
+    for (StatsBlock* block = g_stats_blocks; block; block = block->next) {
+        stats_fold(&total, block);
+        if (block->worker && threads) {
+            StatsBlock snapshot;
+            memset(&snapshot, 0, sizeof(snapshot));
+            stats_fold(&snapshot, block);
+            cJSON* worker = stats_worker_json(&snapshot);
+            if (worker) cJSON_AddItemToArray(threads, worker);
+        }
+    }
+    memcpy(pool_names, g_stats_pool_names, sizeof(pool_names));
+    pthread_mutex_unlock(&g_stats_mutex);
     
-    size_t name_len = strlen_simd(name);
-    uint32_t name_hash = hash_property_name(name, name_len);
+    cJSON* stats = cJSON_CreateObject();
+    if (!stats || !threads) {
+        cJSON_Delete(stats);
+        cJSON_Delete(threads);
+        return NULL;
+    }
     
-    // Check cache first
-    for (int i = 0; i < node->cache_size; i++) {
-        PropertyNode* cached = node->property_cache[i];
-        if (cached->name_hash == name_hash && 
-            cached->name_len == name_len &&
-            fast_memcmp(cached->name, name, name_len) == 0) {
-            return cached;
-        }
+    cJSON_AddTrueToObject(stats, "enabled");
+    cJSON_AddNumberToObject(stats, "records", (double)total.counters[STAT_RECORDS]);
+    cJSON_AddNumberToObject(stats, "bytes_in", (double)total.counters[STAT_BYTES_IN]);
+    cJSON_AddNumberToObject(stats, "bytes_out", (double)total.counters[STAT_BYTES_OUT]);
+    
+    cJSON* phases = cJSON_AddObjectToObject(stats, "phases");
+    for (int i = 0; phases && i < STATS_PHASE_COUNT; i++) {
+        cJSON* phase = cJSON_AddObjectToObject(phases, phase_names[i]);
+        if (!phase) continue;
+        cJSON_AddNumberToObject(phase, "calls", (double)total.phase_calls[i]);
+        stats_add_seconds(phase, "seconds", total.phase_ns[i]);
     }
     
-    // Search in linked list
-    PropertyNode* prop = node->properties;
-    while (prop) {
-        if (prop->name_hash == name_hash && 
-            prop->name_len == name_len &&
-            fast_memcmp(prop->name, name, name_len) == 0) {
-            
-            // Add to cache if there's space
-            if (node->cache_size < 8) {
-                node->property_cache[node->cache_size++] = prop;
-            }
-            return prop;
+    // Slots without a name belong to allocators created outside init_global_pools
+    cJSON* pools = cJSON_AddObjectToObject(stats, "pools");
+    for (int i = 0; pools && i < STATS_POOL_SLOTS; i++) {
+        const PoolStats* counts = &total.pools[i];
+        if (!pool_names[i] && counts->allocs == 0 && counts->frees == 0) continue;
+        
+        char name[32];
+        if (!pool_names[i]) snprintf(name, sizeof(name), "slab_%d", i);
+        cJSON* pool = cJSON_AddObjectToObject(pools, pool_names[i] ? pool_names[i] : name);
+        if (!pool) continue;
+        cJSON_AddNumberToObject(pool, "allocs", (double)counts->allocs);
+        cJSON_AddNumberToObject(pool, "frees", (double)counts->frees);
+        cJSON_AddNumberToObject(pool, "heap_fallbacks", (double)counts->heap_fallbacks);
+    }
+    
+    cJSON* tasks = cJSON_AddObjectToObject(stats, "tasks");
+    if (tasks) {
+        cJSON_AddNumberToObject(tasks, "queued", (double)total.counters[STAT_TASKS_QUEUED]);
+        cJSON_AddNumberToObject(tasks, "inline", (double)total.counters[STAT_TASKS_INLINE]);
+        cJSON_AddNumberToObject(tasks, "pending", (double)get_task_queue_size());
+        cJSON_AddNumberToObject(tasks, "steal_attempts", (double)total.counters[STAT_STEAL_ATTEMPTS]);
+        cJSON_AddNumberToObject(tasks, "steals", (double)total.counters[STAT_STEALS]);
+    }
+    
+    cJSON* workers = stats_worker_json(&total);
+    if (workers) {
+        cJSON_AddItemToObject(workers, "threads", threads);
+        cJSON_AddItemToObject(stats, "workers", workers);
+    } else {
+        cJSON_Delete(threads);
+    }
+    return stats;
+}
+
+void cjson_tools_reset_stats(void) {
+    pthread_mutex_lock(&g_stats_mutex);
+    for (StatsBlock* block = g_stats_blocks; block; block = block->next) {
+        uint64_t* values = (uint64_t*)block;
+        size_t count = offsetof(StatsBlock, worker) / sizeof(uint64_t);
+        for (size_t i = 0; i < count; i++) {
+            __atomic_store_n(&values[i], 0, __ATOMIC_RELAXED);
         }
-        prop = prop->next;
     }
-    return NULL;
+    memset(&g_stats_retired, 0, offsetof(StatsBlock, worker));
+    pthread_mutex_unlock(&g_stats_mutex);
 }
 
-static void free_schema_node(SchemaNode* node) {
-    if (!node) return;
+#else
 
-    // Safety check for valid pointer
-    if ((uintptr_t)node < 0x1000) {
-        return; // Invalid pointer
+cJSON* cjson_tools_get_stats(void) {
+    cJSON* stats = cJSON_CreateObject();
+    if (stats) cJSON_AddFalseToObject(stats, "enabled");
+    return stats;
+}
+
+void cjson_tools_reset_stats(void) {}
+
+#endif
+
+char* cjson_tools_get_stats_string(int pretty_print) {
+    cJSON* stats = cjson_tools_get_stats();
+    if (!stats) return NULL;
+
+    // Printed without the phase timer so reading stats does not show up in them
+    char* text = pretty_print ? cJSON_Print(stats) : cJSON_PrintUnformatted(stats);
+    cJSON_Delete(stats);
+    return text;
+}
+
+// =============================================================================
+// SERVER MODE
+// =============================================================================
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(THREADING_DISABLED)
+
+typedef enum {
+    SERVER_CACHED_PATTERN,
+    SERVER_CACHED_PIPELINE,
+    SERVER_CACHED_VALIDATOR
+} ServerCacheKind;
+
+typedef struct {
+    ServerCacheKind kind;
+    uint32_t hash;
+    char* key;
+    size_t key_length;
+    void* object;
+} ServerCacheEntry;
+
+typedef struct {
+    int listen_fd;
+    int wake[2];                  // Self-pipe: hand-backs and stop requests wake the poll loop
+    ThreadPool* pool;
+    TaskLatch latch;              // Requests in flight
+    unsigned int max_request;
+    volatile int busy;            // Connections owned by request tasks or waiting in ready
+
+    pthread_mutex_t mutex;        // Guards everything below
+    int* ready;                   // Connections handed back after a response
+    int ready_count;
+    int ready_capacity;
+    JsonArena** arenas;           // Idle per-request arenas
+    int arena_count;
+    int arena_capacity;
+    ServerCacheEntry cache[SERVER_CACHE_SIZE];
+    int cache_count;
+} JsonServer;
+
+typedef struct {
+    JsonServer* server;
+    int fd;
+} ServerRequestTask;
+
+// Lock-free atomics, so json_server_stop may run on another thread or in a signal handler
+static volatile int g_server_stop = 0;
+static volatile int g_server_wake_fd = -1;
+static volatile int g_server_wake_writers = 0;  // Stop calls that may still write to the wake fd
+
+void json_server_stop(void) {
+    __atomic_store_n(&g_server_stop, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&g_server_wake_writers, 1, __ATOMIC_SEQ_CST);
+    int fd = __atomic_load_n(&g_server_wake_fd, __ATOMIC_SEQ_CST);
+    if (fd >= 0) {
+        char byte = 0;
+        ssize_t written = write(fd, &byte, 1);
+        (void)written;  // A full pipe already holds a wake-up
+    }
+    __atomic_sub_fetch(&g_server_wake_writers, 1, __ATOMIC_RELEASE);
+}
+
+static void server_cache_free_object(ServerCacheKind kind, void* object) {
+    switch (kind) {
+        case SERVER_CACHED_PATTERN: cjson_tools_pattern_free(object); break;
+        case SERVER_CACHED_PIPELINE: json_pipeline_free(object); break;
+        case SERVER_CACHED_VALIDATOR: schema_validator_free(object); break;
+    }
+}
+
+static void* server_cache_find(JsonServer* server, ServerCacheKind kind, const char* key, size_t key_length,
+                               uint32_t hash) {
+    for (int i = 0; i < server->cache_count; i++) {
+        const ServerCacheEntry* entry = &server->cache[i];
+        if (entry->hash == hash && entry->kind == kind && entry->key_length == key_length &&
+            memcmp(entry->key, key, key_length) == 0) {
+            return entry->object;
+        }
     }
+    return NULL;
+}
 
-    if (node->items) {
-        free_schema_node(node->items);
+// Compiled form of key, built on a miss and kept for later requests. Entries
+// live until the server stops, so they are used without holding the lock.
+// Once the table is full, *uncached is set and the caller frees the object.
+static void* server_cache_get(JsonServer* server, ServerCacheKind kind, const char* key, size_t key_length,
+                              int* uncached) {
+    uint32_t hash = hash_property_name(key, key_length);
+    *uncached = 0;
+
+    pthread_mutex_lock(&server->mutex);
+    void* object = server_cache_find(server, kind, key, key_length, hash);
+    pthread_mutex_unlock(&server->mutex);
+    if (object) return object;
+
+    // Cached objects outlive the request, so they must not come from its arena
+    JsonArena* previous = json_arena_enter(NULL);
+    char* text = malloc(key_length + 1);
+    if (text) {
+        memcpy(text, key, key_length);
+        text[key_length] = '\0';
+        switch (kind) {
+            case SERVER_CACHED_PATTERN: object = cjson_tools_pattern_compile(text); break;
+            case SERVER_CACHED_PIPELINE: object = json_pipeline_parse(text); break;
+            case SERVER_CACHED_VALIDATOR: object = schema_validator_compile_string(text); break;
+        }
+    }
+    json_arena_leave(previous);
+    if (!object) {
+        free(text);
+        return NULL;
     }
 
-    PropertyNode* prop = node->properties;
-    while (prop) {
-        PropertyNode* next = prop->next;
-        my_strfree(prop->name);
-        free_schema_node(prop->schema);
-        slab_free(g_property_node_pool, prop);
-        prop = next;
+    int cached = 0;
+    pthread_mutex_lock(&server->mutex);
+    void* existing = server_cache_find(server, kind, key, key_length, hash);
+    if (!existing && server->cache_count < SERVER_CACHE_SIZE) {
+        ServerCacheEntry* entry = &server->cache[server->cache_count++];
+        entry->kind = kind;
+        entry->hash = hash;
+        entry->key = text;
+        entry->key_length = key_length;
+        entry->object = object;
+        cached = 1;
     }
+    pthread_mutex_unlock(&server->mutex);
 
-    for (int i = 0; i < node->required_count; i++) {
-        my_strfree(node->required_props[i]);
+    if (existing) {
+        server_cache_free_object(kind, object);  // Another request compiled it first
+        free(text);
+        return existing;
     }
-    free(node->required_props);
+    if (!cached) {
+        free(text);
+        *uncached = 1;
+    }
+    return object;
+}
 
-    if (node->enum_values) {
-        cJSON_Delete(node->enum_values);
+static JsonArena* server_take_arena(JsonServer* server) {
+    JsonArena* arena = NULL;
+    pthread_mutex_lock(&server->mutex);
+    if (server->arena_count > 0) arena = server->arenas[--server->arena_count];
+    pthread_mutex_unlock(&server->mutex);
+    return arena ? arena : json_arena_create(0);
+}
+
+static void server_return_arena(JsonServer* server, JsonArena* arena) {
+    if (!arena) return;
+    json_arena_reset(arena);
+
+    pthread_mutex_lock(&server->mutex);
+    if (server->arena_count == server->arena_capacity) {
+        int capacity = server->arena_capacity ? server->arena_capacity * 2 : 8;
+        JsonArena** arenas = realloc(server->arenas, (size_t)capacity * sizeof(JsonArena*));
+        if (arenas) {
+            server->arenas = arenas;
+            server->arena_capacity = capacity;
+        }
+    }
+    if (server->arena_count < server->arena_capacity) {
+        server->arenas[server->arena_count++] = arena;
+        arena = NULL;
+    }
+    pthread_mutex_unlock(&server->mutex);
+    json_arena_destroy(arena);
+}
+
+// Reads exactly length bytes; 0 on success, 1 on a clean end of stream before
+// the first byte, -1 on errors, timeouts and truncated frames
+static int server_read_full(int fd, void* buffer, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = recv(fd, (char*)buffer + done, length - done, 0);
+        if (n > 0) {
+            done += (size_t)n;
+        } else if (n == 0) {
+            return done == 0 ? 1 : -1;
+        } else if (errno != EINTR) {
+            return -1;
+        }
     }
+    return 0;
+}
 
-    slab_free(g_cjson_node_pool, node);
+static void server_put_u32(unsigned char* out, uint32_t value) {
+    out[0] = (unsigned char)(value >> 24);
+    out[1] = (unsigned char)(value >> 16);
+    out[2] = (unsigned char)(value >> 8);
+    out[3] = (unsigned char)value;
 }
 
-static SchemaType get_schema_type(cJSON* json) {
-    switch (json->type & 0xFF) {
-        case cJSON_False:
-        case cJSON_True:
-            return TYPE_BOOLEAN;
-        case cJSON_NULL:
-            return TYPE_NULL;
-        case cJSON_Number:
-            if (json->valuedouble == (double)json->valueint &&
-                json->valuedouble >= INT_MIN && json->valuedouble <= INT_MAX) {
-                return TYPE_INTEGER;
-            }
-            return TYPE_NUMBER;
-        case cJSON_String:
-            return TYPE_STRING;
-        case cJSON_Array:
-            return TYPE_ARRAY;
-        case cJSON_Object:
-            return TYPE_OBJECT;
-        default:
-            return TYPE_NULL;
-    }
+static uint32_t server_get_u32(const unsigned char* in) {
+    return (uint32_t)in[0] << 24 | (uint32_t)in[1] << 16 | (uint32_t)in[2] << 8 | (uint32_t)in[3];
 }
 
-static SchemaNode* analyze_json_value(cJSON* json);
+static int server_write_response(int fd, JsonServerStatus status, const char* body, size_t length) {
+    unsigned char header[8];
+    server_put_u32(header, (uint32_t)status);
+    server_put_u32(header + 4, (uint32_t)length);
 
-// Optimized schema merging with type compatibility matrix
-static const int type_compatibility[8][8] = {
-    // NULL, BOOL, INT, NUM, STR, ARR, OBJ, MIX
-    {1, 0, 0, 0, 0, 0, 0, 1}, // NULL
-    {0, 1, 0, 0, 0, 0, 0, 1}, // BOOLEAN
-    {0, 0, 1, 1, 0, 0, 0, 1}, // INTEGER
-    {0, 0, 1, 1, 0, 0, 0, 1}, // NUMBER
-    {0, 0, 0, 0, 1, 0, 0, 1}, // STRING
-    {0, 0, 0, 0, 0, 1, 0, 1}, // ARRAY
-    {0, 0, 0, 0, 0, 0, 1, 1}, // OBJECT
-    {1, 1, 1, 1, 1, 1, 1, 1}  // MIXED
-};
+    struct iovec parts[2] = {{header, sizeof(header)}, {(void*)body, length}};
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = parts;
+    message.msg_iovlen = length ? 2 : 1;
 
-static SchemaNode* merge_schema_nodes(SchemaNode* node1, SchemaNode* node2) {
-    if (!node1) return node2;
-    if (!node2) return node1;
-    
-    SchemaType merged_type;
-    if (type_compatibility[node1->type][node2->type]) {
-        merged_type = (node1->type == node2->type) ? node1->type : 
-                     (node1->type == TYPE_INTEGER && node2->type == TYPE_NUMBER) ? TYPE_NUMBER :
-                     (node1->type == TYPE_NUMBER && node2->type == TYPE_INTEGER) ? TYPE_NUMBER :
-                     TYPE_MIXED;
-    } else {
-        merged_type = TYPE_MIXED;
-    }
-    
-    SchemaNode* merged = create_schema_node(merged_type);
-    merged->required = node1->required && node2->required;
-    merged->nullable = node1->nullable || node2->nullable || 
-                      node1->type == TYPE_NULL || node2->type == TYPE_NULL;
-    
-    switch (merged_type) {
-        case TYPE_ARRAY:
-            if (node1->items && node2->items) {
-                merged->items = merge_schema_nodes(node1->items, node2->items);
-            } else if (node1->items) {
-                merged->items = create_schema_node(node1->items->type);
-                merged->items->nullable = node1->items->nullable;
-                merged->items->required = node1->items->required;
-            } else if (node2->items) {
-                merged->items = create_schema_node(node2->items->type);
-                merged->items->nullable = node2->items->nullable;
-                merged->items->required = node2->items->required;
-            }
-            break;
-            
-        case TYPE_OBJECT: {
-            // Merge properties efficiently
-            PropertyNode* prop1 = node1->properties;
-            while (prop1) {
-                PropertyNode* prop2 = find_property(node2, prop1->name);
-                if (prop2) {
-                    SchemaNode* merged_prop = merge_schema_nodes(prop1->schema, prop2->schema);
-                    add_property(merged, prop1->name, merged_prop, prop1->required && prop2->required);
-                } else {
-                    SchemaNode* prop_copy = create_schema_node(prop1->schema->type);
-                    prop_copy->nullable = 1;
-                    add_property(merged, prop1->name, prop_copy, 0);
-                }
-                prop1 = prop1->next;
-            }
-            
-            PropertyNode* prop2 = node2->properties;
-            while (prop2) {
-                if (!find_property(merged, prop2->name)) {
-                    SchemaNode* prop_copy = create_schema_node(prop2->schema->type);
-                    prop_copy->nullable = 1;
-                    add_property(merged, prop2->name, prop_copy, 0);
-                }
-                prop2 = prop2->next;
-            }
-            break;
+    #ifdef MSG_NOSIGNAL
+    int flags = MSG_NOSIGNAL;  // A vanished client is an error, not SIGPIPE
+    #else
+    int flags = 0;             // SO_NOSIGPIPE is set on the socket instead
+    #endif
+    while (message.msg_iovlen > 0) {
+        ssize_t n = sendmsg(fd, &message, flags);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (message.msg_iovlen > 0 && (size_t)n >= message.msg_iov->iov_len) {
+            n -= (ssize_t)message.msg_iov->iov_len;
+            message.msg_iov++;
+            message.msg_iovlen--;
+        }
+        if (message.msg_iovlen > 0) {
+            message.msg_iov->iov_base = (char*)message.msg_iov->iov_base + n;
+            message.msg_iov->iov_len -= (size_t)n;
         }
-            
-        default:
-            break;
     }
-    
-    return merged;
+    return 0;
 }
 
-// Optimized JSON analysis with early type detection
-static SchemaNode* analyze_json_value(cJSON* json) {
-    if (!json) return NULL;
-    
-    SchemaType type = get_schema_type(json);
-    SchemaNode* node = create_schema_node(type);
-    
-    if (type == TYPE_NULL) {
-        node->required = 0;
-        node->nullable = 1;
-        return node;
-    }
-    
-    switch (type) {
-        case TYPE_ARRAY: {
-            int array_size = cJSON_GetArraySize(json);
-            if (LIKELY(array_size > 0)) {
-                // Optimized sampling strategy
-                int sample_size = MIN(array_size, MAX_ARRAY_SAMPLE_SIZE);
-                int step = array_size > MAX_ARRAY_SAMPLE_SIZE ? array_size / MAX_ARRAY_SAMPLE_SIZE : 1;
-                
-                SchemaNode* items_schema = NULL;
-                SchemaType first_type = TYPE_NULL;
-                bool types_uniform = true;
+static int server_header_flag(const cJSON* header, const char* name) {
+    return cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(header, name));
+}
 
-                for (int i = 0; i < array_size && i / step < sample_size; i += step) {
-                    cJSON* item = cJSON_GetArrayItem(json, i);
-                    if (!item) continue;
-                    
-                    SchemaType item_type = get_schema_type(item);
-                    
-                    if (first_type == TYPE_NULL) {
-                        first_type = item_type;
-                        items_schema = analyze_json_value(item);
-                    } else if (item_type != first_type) {
-                        types_uniform = false;
-                        SchemaNode* item_schema = analyze_json_value(item);
-                        items_schema = merge_schema_nodes(items_schema, item_schema);
-                        free_schema_node(item_schema);
-                    }
-                    
-                    // Early exit if we know it's mixed
-                    if (!types_uniform && items_schema && items_schema->type == TYPE_MIXED) {
-                        break;
-                    }
-                }
+static const char* server_header_string(const cJSON* header, const char* name) {
+    const cJSON* value = cJSON_GetObjectItemCaseSensitive(header, name);
+    return cJSON_IsString(value) ? value->valuestring : NULL;
+}
 
-                node->items = items_schema ? items_schema : create_schema_node(TYPE_NULL);
-            } else {
-                node->items = create_schema_node(TYPE_NULL);
-            }
-            break;
+static double server_header_number(const cJSON* header, const char* name) {
+    const cJSON* value = cJSON_GetObjectItemCaseSensitive(header, name);
+    return cJSON_IsNumber(value) ? value->valuedouble : 0.0;
+}
+
+// Cached object named by a header field, compiled on first use
+static void* server_cached_argument(JsonServer* server, ServerCacheKind kind, const cJSON* header,
+                                    const char* name, int* uncached, const char** error) {
+    const cJSON* value = cJSON_GetObjectItemCaseSensitive(header, name);
+    char* printed = NULL;
+    const char* key = NULL;
+    if (cJSON_IsString(value)) {
+        key = value->valuestring;
+    } else if (kind == SERVER_CACHED_VALIDATOR && cJSON_IsObject(value)) {
+        key = printed = cjson_tools_print(value, 0);
+    }
+
+    void* object = key ? server_cache_get(server, kind, key, strlen_simd(key), uncached) : NULL;
+    free(printed);
+    if (!object) *error = kind == SERVER_CACHED_VALIDATOR ? "invalid or missing schema" :
+                          kind == SERVER_CACHED_PIPELINE ? "invalid or missing steps" :
+                          "invalid or missing pattern";
+    return object;
+}
+
+// Runs one operation on a parsed payload. Work stays on the calling worker:
+// concurrency comes from serving many requests at once, and a request that
+// waited on helper tasks could block the pool it runs on.
+static char* server_run_operation(JsonServer* server, const char* op, const cJSON* header, const cJSON* payload,
+                                  JsonServerStatus* status, const char** error) {
+    int pretty = server_header_flag(header, "pretty");
+    cJSON* result = NULL;
+    char* text = NULL;
+    int uncached = 0;
+
+    if (strcmp(op, "flatten") == 0) {
+        text = flatten_parsed_json_text(payload, 0, 0, pretty);
+    } else if (strcmp(op, "unflatten") == 0) {
+        result = unflatten_parsed_json(payload, 0, 0);
+    } else if (strcmp(op, "remove-empty") == 0) {
+        result = remove_empty_strings(payload);
+    } else if (strcmp(op, "remove-nulls") == 0) {
+        result = remove_nulls(payload);
+    } else if (strcmp(op, "replace-keys") == 0 || strcmp(op, "replace-values") == 0) {
+        const char* replacement = server_header_string(header, "replacement");
+        CompiledPattern* pattern = server_cached_argument(server, SERVER_CACHED_PATTERN, header, "pattern",
+                                                          &uncached, error);
+        if (pattern && !replacement) *error = "missing replacement";
+        if (pattern && replacement) {
+            result = strcmp(op, "replace-keys") == 0 ? replace_keys_compiled(payload, pattern, replacement) :
+                                                       replace_values_compiled(payload, pattern, replacement);
         }
-        
-        case TYPE_OBJECT: {
-            cJSON* child = json->child;
-            while (child) {
-                SchemaNode* prop_schema = analyze_json_value(child);
-                add_property(node, child->string, prop_schema, prop_schema->required);
-                child = child->next;
+        if (uncached) cjson_tools_pattern_free(pattern);
+    } else if (strcmp(op, "pipeline") == 0) {
+        JsonPipeline* pipeline = server_cached_argument(server, SERVER_CACHED_PIPELINE, header, "steps",
+                                                        &uncached, error);
+        if (pipeline) result = json_pipeline_apply(pipeline, payload);
+        if (uncached) json_pipeline_free(pipeline);
+    } else if (strcmp(op, "schema") == 0) {
+        SchemaInferenceOptions options = {0};
+        options.sample_rate = server_header_number(header, "sample_rate");
+        options.sample_size = (int)server_header_number(header, "sample_size");
+        options.seed = (unsigned long long)server_header_number(header, "seed");
+        options.collect_stats = server_header_flag(header, "collect_stats");
+        options.enum_limit = (int)server_header_number(header, "enum_limit");
+        result = cJSON_IsArray(payload) ? generate_schema_from_batch_opts(payload, &options, 0, 0) :
+                                          generate_schema_from_object_opts(payload, &options);
+    } else if (strcmp(op, "validate") == 0) {
+        SchemaValidator* validator = server_cached_argument(server, SERVER_CACHED_VALIDATOR, header, "schema",
+                                                            &uncached, error);
+        if (validator) {
+            // Like the CLI: an array is a batch of records, anything else one record
+            SchemaValidationMode mode = server_header_flag(header, "all_errors") ?
+                SCHEMA_VALIDATE_ALL_ERRORS : SCHEMA_VALIDATE_FIRST_ERROR;
+            cJSON* errors = NULL;
+            int invalid = cJSON_IsArray(payload) ?
+                schema_validate_batch(validator, payload, mode, 0, 0, &errors) :
+                schema_validate(validator, payload, mode, &errors);
+            result = invalid >= 0 ? cJSON_CreateObject() : NULL;
+            if (result) {
+                cJSON_AddBoolToObject(result, "valid", invalid == 0);
+                cJSON_AddItemToObject(result, "errors", errors);
+                if (invalid > 0) *status = JSON_SERVER_INVALID;
+            } else {
+                cJSON_Delete(errors);
             }
-            break;
         }
-        
-        default:
-            break;
+        if (uncached) schema_validator_free(validator);
+    } else {
+        *error = "unknown operation";
+        return NULL;
     }
-    
-    return node;
-}
 
-static const char* schema_type_to_string(SchemaType type) {
-    switch (type) {
-        case TYPE_NULL: return "null";
-        case TYPE_BOOLEAN: return "boolean";
-        case TYPE_INTEGER: return "integer";
-        case TYPE_NUMBER: return "number";
-        case TYPE_STRING: return "string";
-        case TYPE_ARRAY: return "array";
-        case TYPE_OBJECT: return "object";
-        case TYPE_MIXED: return "mixed";
-        default: return "unknown";
+    if (result) {
+        text = cjson_tools_print(result, pretty);
+        cJSON_Delete(result);
     }
+    if (!text && !*error) *error = "operation failed";
+    return text;
 }
 
-static cJSON* schema_node_to_json(SchemaNode* node);
+// Serves one request frame; returns 1 to keep the connection, 0 to close it
+static int server_handle_request(JsonServer* server, int fd) {
+    unsigned char frame[8];
+    if (server_read_full(fd, frame, sizeof(frame)) != 0) return 0;
 
-// Optimized schema JSON generation with reusable components
-static cJSON* schema_node_to_json(SchemaNode* node) {
-    if (!node) return NULL;
-    
-    cJSON* schema = cJSON_CreateObject();
-    if (!schema) return NULL;
-    
-    cJSON_AddStringToObject(schema, "$schema", "http://json-schema.org/draft-07/schema#");
-    
-    if (node->type == TYPE_MIXED) {
-        cJSON* type_array = cJSON_CreateArray();
-        const char* types[] = {"string", "number", "integer", "boolean", "object", "array"};
-        for (int i = 0; i < 6; i++) {
-            cJSON_AddItemToArray(type_array, cJSON_CreateString(types[i]));
+    uint32_t header_length = server_get_u32(frame);
+    uint32_t payload_length = server_get_u32(frame + 4);
+    if (header_length == 0 || header_length > server->max_request ||
+        payload_length > server->max_request - header_length) {
+        static const char message[] = "request too large or malformed";
+        server_write_response(fd, JSON_SERVER_ERROR, message, sizeof(message) - 1);
+        return 0;  // The rest of the frame cannot be skipped reliably
+    }
+
+    char* request = malloc((size_t)header_length + payload_length + 1);
+    if (!request || server_read_full(fd, request, (size_t)header_length + payload_length) != 0) {
+        free(request);
+        return 0;
+    }
+    request[header_length + payload_length] = '\0';
+
+    JsonServerStatus status = JSON_SERVER_OK;
+    const char* error = NULL;
+    char* body = NULL;
+
+    // Everything cJSON allocates for the request comes from one arena
+    JsonArena* arena = server_take_arena(server);
+    JsonArena* previous = json_arena_enter(arena);
+    cJSON* header = cJSON_ParseWithLength(request, header_length);
+    const char* op = server_header_string(header, "op");
+    if (!op) {
+        error = "header must be a JSON object with an \"op\"";
+    } else if (strcmp(op, "ping") == 0) {
+        body = cjson_tools_print(header, 0);
+    } else if (strcmp(op, "stats") == 0) {
+        cJSON* stats = cjson_tools_get_stats();
+        body = stats ? cjson_tools_print(stats, server_header_flag(header, "pretty")) : NULL;
+        cJSON_Delete(stats);
+    } else {
+        const char* text = request + header_length;
+        const char* end = NULL;
+        cJSON* payload = cJSON_ParseWithLengthOpts(text, payload_length, &end, 0);
+        if (payload && skip_whitespace_optimized(end, (size_t)(text + payload_length - end)) != text + payload_length) {
+            cJSON_Delete(payload);
+            payload = NULL;
         }
-        
-        if (node->nullable) {
-            cJSON_AddItemToArray(type_array, cJSON_CreateString("null"));
+        if (payload) {
+            body = server_run_operation(server, op, header, payload, &status, &error);
+            cJSON_Delete(payload);
+        } else {
+            error = "invalid JSON payload";
         }
-        
-        cJSON_AddItemToObject(schema, "type", type_array);
-        return schema;
     }
-    
-    if (node->nullable) {
-        cJSON* type_array = cJSON_CreateArray();
-        cJSON_AddItemToArray(type_array, cJSON_CreateString(schema_type_to_string(node->type)));
-        cJSON_AddItemToArray(type_array, cJSON_CreateString("null"));
-        cJSON_AddItemToObject(schema, "type", type_array);
+    cJSON_Delete(header);
+    json_arena_leave(previous);
+    server_return_arena(server, arena);
+    free(request);
+
+    int ok;
+    if (body) {
+        ok = server_write_response(fd, status, body, strlen_simd(body)) == 0;
+        free(body);
     } else {
-        cJSON_AddStringToObject(schema, "type", schema_type_to_string(node->type));
+        if (!error) error = "out of memory";
+        ok = server_write_response(fd, JSON_SERVER_ERROR, error, strlen(error)) == 0;
     }
-    
-    switch (node->type) {
-        case TYPE_ARRAY:
-            if (node->items) {
-                cJSON* items_schema = schema_node_to_json(node->items);
-                if (items_schema) {
-                    cJSON_DeleteItemFromObject(items_schema, "$schema");
-                    cJSON_AddItemToObject(schema, "items", items_schema);
-                }
-            }
-            break;
-            
-        case TYPE_OBJECT:
-            if (node->properties) {
-                cJSON* props = cJSON_CreateObject();
-                cJSON* required = cJSON_CreateArray();
-                
-                PropertyNode* prop = node->properties;
-                while (prop) {
-                    cJSON* prop_schema = schema_node_to_json(prop->schema);
-                    if (prop_schema) {
-                        cJSON_DeleteItemFromObject(prop_schema, "$schema");
-                        cJSON_AddItemToObject(props, prop->name, prop_schema);
-                        
-                        if (prop->required) {
-                            cJSON_AddItemToArray(required, cJSON_CreateString(prop->name));
-                        }
-                    }
-                    prop = prop->next;
-                }
-                
-                cJSON_AddItemToObject(schema, "properties", props);
-                
-                if (cJSON_GetArraySize(required) > 0) {
-                    cJSON_AddItemToObject(schema, "required", required);
-                } else {
-                    cJSON_Delete(required);
-                }
+    return ok;
+}
+
+static void server_wake(JsonServer* server) {
+    char byte = 0;
+    ssize_t written = write(server->wake[1], &byte, 1);
+    (void)written;
+}
+
+static void server_request_task(void* arg) {
+    ServerRequestTask* task = (ServerRequestTask*)arg;
+    JsonServer* server = task->server;
+    int fd = task->fd;
+    free(task);
+
+    int keep = server_handle_request(server, fd);
+    if (keep) {
+        pthread_mutex_lock(&server->mutex);
+        if (server->ready_count == server->ready_capacity) {
+            int capacity = server->ready_capacity ? server->ready_capacity * 2 : 64;
+            int* ready = realloc(server->ready, (size_t)capacity * sizeof(int));
+            if (ready) {
+                server->ready = ready;
+                server->ready_capacity = capacity;
             }
-            break;
-            
-        default:
-            break;
+        }
+        keep = server->ready_count < server->ready_capacity;
+        if (keep) server->ready[server->ready_count++] = fd;
+        pthread_mutex_unlock(&server->mutex);
     }
-    
-    return schema;
+    // A kept connection stays counted as busy until the poll loop takes it back,
+    // so it always holds a slot in the poll set
+    if (!keep) {
+        close(fd);
+        __atomic_sub_fetch(&server->busy, 1, __ATOMIC_RELEASE);
+    }
+    server_wake(server);
 }
 
-static void generate_schema_task(void* arg) {
-    ThreadData* data = (ThreadData*)arg;
-    data->result = (cJSON*)analyze_json_value(data->object);
+// Hands a readable connection to the pool; it is served inline if every queue is full
+static void server_dispatch(JsonServer* server, int fd) {
+    __atomic_add_fetch(&server->busy, 1, __ATOMIC_RELAXED);
+    ServerRequestTask* task = malloc(sizeof(ServerRequestTask));
+    if (!task) {
+        close(fd);
+        __atomic_sub_fetch(&server->busy, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    task->server = server;
+    task->fd = fd;
+    if (thread_pool_add_task_latched(server->pool, server_request_task, task, &server->latch) != 0) {
+        server_request_task(task);
+    }
 }
 
-cJSON* generate_schema_from_object(cJSON* json) {
-    if (!json) return NULL;
-
-    init_global_pools();
+static int server_set_flags(int fd, int nonblocking) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) return -1;
+    flags = nonblocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+    return fcntl(fd, F_SETFL, flags) == 0 && fcntl(fd, F_SETFD, FD_CLOEXEC) == 0 ? 0 : -1;
+}
 
-    SchemaNode* schema_node = analyze_json_value(json);
-    if (!schema_node) return NULL;
-    
-    cJSON* schema = schema_node_to_json(schema_node);
-    free_schema_node(schema_node);
-    
-    return schema;
+static void server_configure_client(int fd) {
+    struct timeval timeout = {SERVER_IO_TIMEOUT_MS / 1000, (SERVER_IO_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    #ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    #endif
 }
 
-cJSON* generate_schema_from_batch(cJSON* json_array, int use_threads, int num_threads) {
-    if (!json_array || json_array->type != cJSON_Array) {
-        return NULL;
+// Binds the socket path, replacing a stale socket file left by a server that
+// did not exit cleanly but never one that still accepts connections
+static int server_listen(const char* socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path is too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || server_set_flags(fd, 1) != 0) {
+        if (fd >= 0) close(fd);
+        fprintf(stderr, "Error: Could not create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    int bound = bind(fd, (struct sockaddr*)&address, sizeof(address)) == 0;
+    if (!bound && errno == EADDRINUSE) {
+        struct stat info;
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        int stale = probe >= 0 && lstat(socket_path, &info) == 0 && S_ISSOCK(info.st_mode) &&
+                    connect(probe, (struct sockaddr*)&address, sizeof(address)) != 0 && errno == ECONNREFUSED;
+        if (probe >= 0) close(probe);
+        if (!stale) {
+            fprintf(stderr, "Error: %s is already in use\n", socket_path);
+            close(fd);
+            return -1;
+        }
+        unlink(socket_path);
+        bound = bind(fd, (struct sockaddr*)&address, sizeof(address)) == 0;
+    }
+    if (!bound || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Error: Could not listen on %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
     }
+    return fd;
+}
 
-    init_global_pools();
+static int server_init(JsonServer* server, const char* socket_path, const JsonServerOptions* options) {
+    memset(server, 0, sizeof(*server));
+    server->listen_fd = -1;
+    server->wake[0] = server->wake[1] = -1;
+    server->max_request = options && options->max_request ? options->max_request : SERVER_MAX_REQUEST;
+    pthread_mutex_init(&server->mutex, NULL);
 
-    int array_size = cJSON_GetArraySize(json_array);
-    if (array_size == 0) {
-        return cJSON_CreateObject();
+    if (pipe(server->wake) != 0 || server_set_flags(server->wake[0], 1) != 0 ||
+        server_set_flags(server->wake[1], 1) != 0) {
+        fprintf(stderr, "Error: Could not create wake-up pipe: %s\n", strerror(errno));
+        return -1;
     }
+    server->pool = thread_pool_acquire_shared(options ? options->num_threads : 0);
+    if (!server->pool) return -1;
 
-    // Enhanced threading heuristics for schema generation
-    bool should_use_threads = use_threads && 
-                             array_size >= MIN_BATCH_SIZE_FOR_MT && 
-                             get_optimal_threads(num_threads) > 1;
+    server->listen_fd = server_listen(socket_path);
+    return server->listen_fd >= 0 ? 0 : -1;
+}
+
+static void server_cleanup(JsonServer* server) {
+    for (int i = 0; i < server->ready_count; i++) close(server->ready[i]);
+    free(server->ready);
+    for (int i = 0; i < server->arena_count; i++) json_arena_destroy(server->arenas[i]);
+    free(server->arenas);
+    for (int i = 0; i < server->cache_count; i++) {
+        server_cache_free_object(server->cache[i].kind, server->cache[i].object);
+        free(server->cache[i].key);
+    }
+    if (server->listen_fd >= 0) close(server->listen_fd);
+    if (server->wake[0] >= 0) close(server->wake[0]);
+    if (server->wake[1] >= 0) close(server->wake[1]);
+    thread_pool_release(server->pool);
+    pthread_mutex_destroy(&server->mutex);
+}
+
+int json_server_run(const char* socket_path, const JsonServerOptions* options) {
+    if (!socket_path) return -1;
+
+    init_global_pools();
+
+    JsonServer server;
+    if (server_init(&server, socket_path, options) != 0) {
+        server_cleanup(&server);
+        return -1;
+    }
+    int max_clients = options && options->max_clients > 0 ? options->max_clients : SERVER_MAX_CLIENTS;
+
+    // Slot 0 is the wake-up pipe, slot 1 the listening socket, the rest idle connections
+    struct pollfd* fds = malloc(((size_t)max_clients + 2) * sizeof(struct pollfd));
+    if (!fds) {
+        unlink(socket_path);
+        server_cleanup(&server);
+        return -1;
+    }
+    fds[0] = (struct pollfd){server.wake[0], POLLIN, 0};
+    fds[1] = (struct pollfd){server.listen_fd, POLLIN, 0};
+    int idle = 0;
+
+    __atomic_store_n(&g_server_stop, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_server_wake_fd, server.wake[1], __ATOMIC_RELEASE);
+    int status = 0;
+
+    while (!__atomic_load_n(&g_server_stop, __ATOMIC_ACQUIRE)) {
+        // Stop accepting while every connection slot is taken
+        int busy = __atomic_load_n(&server.busy, __ATOMIC_ACQUIRE);
+        fds[1].events = idle + busy < max_clients ? POLLIN : 0;
+        if (poll(fds, (nfds_t)idle + 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error: poll failed: %s\n", strerror(errno));
+            status = -1;
+            break;
+        }
 
-    SchemaNode** schemas = malloc(array_size * sizeof(SchemaNode*));
-    if (!schemas) return NULL;
+        if (fds[0].revents) {
+            char drain[64];
+            while (read(server.wake[0], drain, sizeof(drain)) > 0) {}
 
-    if (should_use_threads) {
-        ThreadPool* pool = thread_pool_create(num_threads);
-        if (pool) {
-            ThreadData* thread_data_array = malloc(array_size * sizeof(ThreadData));
-            if (thread_data_array) {
-                // Submit all tasks
-                for (int i = 0; i < array_size; i++) {
-                    thread_data_array[i].object = cJSON_GetArrayItem(json_array, i);
-                    thread_data_array[i].result = NULL;
-                    
-                    if (thread_pool_add_task(pool, generate_schema_task, &thread_data_array[i]) != 0) {
-                        generate_schema_task(&thread_data_array[i]);
-                    }
-                }
-                
-                thread_pool_wait(pool);
-                
-                // Collect results
-                for (int i = 0; i < array_size; i++) {
-                    schemas[i] = (SchemaNode*)thread_data_array[i].result;
+            pthread_mutex_lock(&server.mutex);
+            for (int i = 0; i < server.ready_count; i++) {
+                if (idle < max_clients) {
+                    fds[2 + idle++] = (struct pollfd){server.ready[i], POLLIN, 0};
+                } else {
+                    close(server.ready[i]);
                 }
-                
-                free(thread_data_array);
-            } else {
-                should_use_threads = false;
             }
-            thread_pool_destroy(pool);
-        } else {
-            should_use_threads = false;
+            __atomic_sub_fetch(&server.busy, server.ready_count, __ATOMIC_RELEASE);
+            server.ready_count = 0;
+            pthread_mutex_unlock(&server.mutex);
         }
-    }
 
-    if (!should_use_threads) {
-        // Single-threaded fallback
-        for (int i = 0; i < array_size; i++) {
-            schemas[i] = analyze_json_value(cJSON_GetArrayItem(json_array, i));
+        // Readable connections leave the poll set until their request is answered
+        for (int i = 0; i < idle;) {
+            struct pollfd* entry = &fds[2 + i];
+            if (!entry->revents) {
+                i++;
+                continue;
+            }
+            int fd = entry->fd;
+            int readable = (entry->revents & POLLIN) != 0;
+            *entry = fds[2 + --idle];
+            if (readable) {
+                server_dispatch(&server, fd);
+            } else {
+                close(fd);
+            }
         }
-    }
 
-    // Merge schemas efficiently
-    SchemaNode* merged_schema = schemas[0];
-    for (int i = 1; i < array_size; i++) {
-        if (schemas[i]) {
-            SchemaNode* new_merged = merge_schema_nodes(merged_schema, schemas[i]);
-            if (merged_schema != schemas[0]) {
-                free_schema_node(merged_schema);
+        if (fds[1].revents & POLLIN) {
+            while (idle + __atomic_load_n(&server.busy, __ATOMIC_ACQUIRE) < max_clients) {
+                int fd = accept(server.listen_fd, NULL, NULL);
+                if (fd < 0) break;  // EAGAIN once the backlog is drained
+                if (server_set_flags(fd, 0) != 0) {
+                    close(fd);
+                    continue;
+                }
+                server_configure_client(fd);
+                fds[2 + idle++] = (struct pollfd){fd, POLLIN, 0};
             }
-            free_schema_node(schemas[i]);
-            merged_schema = new_merged;
         }
     }
 
-    cJSON* result = NULL;
-    if (merged_schema) {
-        result = schema_node_to_json(merged_schema);
-        if (merged_schema != schemas[0]) {
-            free_schema_node(merged_schema);
-        }
+    // A stop call that already read the wake fd finishes its write before the pipe closes
+    __atomic_store_n(&g_server_wake_fd, -1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&g_server_wake_writers, __ATOMIC_ACQUIRE) > 0) {
+        sched_yield();
     }
-    
-    free(schemas);
-    return result;
+
+    // Requests in flight finish and hand their connections back to be closed
+    close(server.listen_fd);
+    server.listen_fd = -1;
+    unlink(socket_path);
+    thread_pool_wait_latch(server.pool, &server.latch);
+    for (int i = 0; i < idle; i++) close(fds[2 + i].fd);
+    free(fds);
+    server_cleanup(&server);
+    return status;
 }
 
-char* generate_schema_from_string(const char* json_string, int use_threads, int num_threads) {
-    if (!json_string) return NULL;
-    
-    cJSON* json = cJSON_Parse(json_string);
-    if (!json) {
-        const char* error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr) {
-            fprintf(stderr, "Error parsing JSON: %s\n", error_ptr);
-        }
-        return NULL;
-    }
-    
-    cJSON* schema = NULL;
-    
-    if (json->type == cJSON_Array) {
-        schema = generate_schema_from_batch(json, use_threads, num_threads);
-    } else {
-        schema = generate_schema_from_object(json);
-    }
-    
-    char* result = NULL;
-    if (schema) {
-        result = cJSON_Print(schema);
-        cJSON_Delete(schema);
-    }
-    
-    cJSON_Delete(json);
-    return result;
+#else
+
+void json_server_stop(void) {}
+
+int json_server_run(const char* socket_path, const JsonServerOptions* options) {
+    (void)socket_path;
+    (void)options;
+    fprintf(stderr, "Error: Server mode is not supported on this platform\n");
+    return -1;
 }
 
+#endif
+
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -3036,11 +13481,32 @@ void print_usage(const char* program_name) {
     printf("  -r, --replace-keys <pattern> <replacement>\n");
     printf("                             Replace keys matching regex pattern\n");
     printf("  -v, --replace-values <pattern> <replacement>\n");
-    printf("                             Replace string values matching regex pattern\n\n");
+    printf("                             Replace string values matching regex pattern\n");
+    printf("  -u, --unflatten            Rebuild nested JSON from flattened keys (a.b, a[0])\n");
+    printf("  --pipeline <steps>         Run several steps in one pass, e.g.\n");
+    printf("                             remove-nulls,replace-keys:^old_:new_,flatten\n");
+    printf("  --paths <list>             Keep only these paths (e.g. a.b,c[*].d, applied per\n");
+    printf("                             record for arrays); other subtrees are skipped unparsed\n");
+    printf("  --validate <schema_file>   Check records against a JSON schema (generated by -s,\n");
+    printf("                             or Draft-07 type/properties/required/items/enum)\n");
+    printf("  --all-errors               Report every validation error, not just the first\n");
+    printf("  --sample <rate|count>      Infer the schema (-s) from a random sample: a fraction\n");
+    printf("                             below 1 or a number of records\n");
+    printf("  --schema-stats             Annotate the schema with value statistics (x-stats):\n");
+    printf("                             counts, null ratio, distinct values, ranges, enums\n\n");
     
     printf("📄 OUTPUT OPTIONS:\n");
     printf("  -p, --pretty               Pretty-print output (formatted JSON)\n");
     printf("  -o, --output <file>        Write output to file instead of stdout\n");
+    printf("  --ndjson                   Stream newline-delimited JSON, one record per line\n");
+    printf("  --simd-parser              Parse whole-document input with the SIMD structural index\n");
+    printf("  --format <csv|tsv|arrow>   Write flattened records as columns: CSV, TSV or an\n");
+    printf("                             Arrow IPC stream (one row per record, with -f)\n");
+    printf("  --compress <gzip|zstd>     Compress the output (default: from the -o extension,\n");
+    printf("                             .gz or .zst); compressed input is detected by itself\n");
+    printf("  --stats                    Report counters and phase timings as JSON on stderr\n");
+    printf("  --serve <socket>           Serve length-prefixed requests on a Unix socket until\n");
+    printf("                             SIGINT/SIGTERM (see json_server_run; -t sets workers)\n");
     printf("  -h, --help                 Show this help message\n\n");
     
     printf("📥 INPUT:\n");
@@ -3054,14 +13520,341 @@ void print_usage(const char* program_name) {
     printf("  %s -s -t 4 batch_data.json               # 4-thread schema generation\n", program_name);
     printf("  cat data.json | %s -f -t 0              # Streaming with auto-threading\n", program_name);
     printf("  %s -e -p messy_data.json                 # Clean & format\n", program_name);
+    printf("  %s -u -t 0 flat_data.json                # Undo flattening\n", program_name);
     printf("  %s -r '^old_' 'new_' -t 2 data.json     # Regex replace with threading\n", program_name);
+    printf("  %s -f --ndjson -t 0 events.ndjson        # Constant-memory NDJSON flatten\n", program_name);
+    printf("  %s --pipeline remove-nulls,flatten data.json  # Fused clean & flatten\n", program_name);
+    printf("  %s -f --paths user.id,items[*].sku data.json  # Flatten selected fields only\n", program_name);
+    printf("  %s -f --ndjson --format arrow -o events.arrow events.ndjson  # Arrow record batches\n", program_name);
+    printf("  %s -f -t 0 --stats -o out.json data.json  # Counters and timings on stderr\n", program_name);
+    printf("  %s -f --ndjson -t 0 -o out.ndjson.gz events.ndjson.zst  # Compressed in and out\n", program_name);
+    printf("  %s --validate schema.json --all-errors -t 0 data.json  # Exit status 1 if invalid\n", program_name);
+    printf("  %s -s --ndjson --sample 10000 --schema-stats events.ndjson  # Profile a sample\n", program_name);
+    printf("  %s --serve /tmp/json_tools.sock -t 8    # Warm server for many small calls\n", program_name);
     
     printf("\n🎯 OPTIMIZATION TIPS:\n");
     printf("  • Use threading (-t) for files >100KB or >1000 objects\n");
     printf("  • Auto-threading (-t 0) adapts to your CPU and workload\n");
     printf("  • Regex operations work on Unix-like systems (Linux, macOS)\n");
     printf("  • Memory usage scales with input size and threading level\n");
-    printf("  • For huge datasets, consider processing in smaller batches\n\n");
+    printf("  • For huge datasets, use --ndjson to stream records with constant memory\n\n");
+}
+
+static void cli_stop_server(int signal_number) {
+    (void)signal_number;
+    json_server_stop();
+}
+
+// Serves until SIGINT or SIGTERM; requests in flight are answered before exit
+static int cli_serve(const char* socket_path, int num_threads) {
+    JsonServerOptions options = {num_threads, 0, 0};
+    signal(SIGINT, cli_stop_server);
+    signal(SIGTERM, cli_stop_server);
+    if (isatty(STDERR_FILENO)) {
+        fprintf(stderr, "Serving on %s\n", socket_path);
+    }
+    int status = json_server_run(socket_path, &options) == 0 ? 0 : 1;
+    cleanup_global_pools();
+    return status;
+}
+
+// Writes the run's statistics to stderr on exit, whichever path main() returns through
+static void cli_print_stats(void) {
+    char* text = cjson_tools_get_stats_string(1);
+    if (text) {
+        fprintf(stderr, "%s\n", text);
+        free(text);
+    }
+}
+
+// Per-record options for the NDJSON filter, replace, unflatten and validate
+// actions, and the inference options of schema generation
+typedef struct {
+    int remove_empty;
+    int remove_nulls;
+    const char* keys_pattern;
+    const char* keys_replacement;
+    const char* values_pattern;
+    const char* values_replacement;
+    const JsonPipeline* pipeline;
+    int unflatten;
+    const SchemaValidator* validator;
+    SchemaValidationMode validation_mode;
+    const SchemaInferenceOptions* schema_options;
+} CliRecordOptions;
+
+// {"valid": ..., "errors": [...]}, taking errors; NULL when validation failed
+static cJSON* cli_validation_report(int invalid, cJSON* errors) {
+    cJSON* report = invalid >= 0 ? cJSON_CreateObject() : NULL;
+    if (!report) {
+        cJSON_Delete(errors);
+        return NULL;
+    }
+    cJSON_AddBoolToObject(report, "valid", invalid == 0);
+    cJSON_AddItemToObject(report, "errors", errors);
+    return report;
+}
+
+static cJSON* cli_transform_record(const cJSON* record, void* user_data) {
+    const CliRecordOptions* options = user_data;
+
+    if (options->pipeline) return json_pipeline_apply(options->pipeline, record);
+    if (options->remove_empty) return remove_empty_strings(record);
+    if (options->remove_nulls) return remove_nulls(record);
+    if (options->keys_pattern) return replace_keys(record, options->keys_pattern, options->keys_replacement);
+    if (options->values_pattern) return replace_values(record, options->values_pattern, options->values_replacement);
+    if (options->unflatten) return unflatten_json_object(record);
+    return cJSON_Duplicate(record, 1);
+}
+
+// Output of a CLI run: the file (or stdout), a background writer over it when
+// threads are available, and a compressing stream on top for compressed output
+typedef struct {
+    FILE* raw;
+    FILE* async;   // NULL when writing to raw directly
+    FILE* stream;  // Where results are written
+} CliOutput;
+
+// Closes what cli_output_open opened; nonzero if writing failed
+static int cli_output_close(CliOutput* output) {
+    int status = 0;
+    if (output->stream && output->stream != output->async && output->stream != output->raw &&
+        fclose(output->stream) != 0) status = 1;
+    if (output->async && fclose(output->async) != 0) status = 1;
+    if (output->raw && output->raw != stdout && fclose(output->raw) != 0) status = 1;
+    if (output->raw == stdout && fflush(stdout) != 0) status = 1;
+    memset(output, 0, sizeof(*output));
+    return status;
+}
+
+// Opens output_file (or stdout), compressed with codec unless it is
+// JSON_CODEC_NONE; 0 on success
+static int cli_output_open(CliOutput* output, const char* output_file, JsonCodec codec, int binary) {
+    memset(output, 0, sizeof(*output));
+    output->raw = stdout;
+    if (output_file) {
+        output->raw = fopen(output_file, binary || codec != JSON_CODEC_NONE ? "wb" : "w");
+        if (!output->raw) {
+            fprintf(stderr, "Error: Could not open output file %s\n", output_file);
+            return 1;
+        }
+    }
+
+    output->async = json_stream_open_async(output->raw);
+    output->stream = output->async ? output->async : output->raw;
+    if (codec == JSON_CODEC_NONE) return 0;
+
+    FILE* compressed = json_stream_open_compressed(output->stream, codec, 0);
+    if (!compressed) {
+        cli_output_close(output);
+        return 1;
+    }
+    output->stream = compressed;
+    return 0;
+}
+
+// Wraps compressed NDJSON input in a decoding stream. Files are peeked at so
+// plain ones are still read directly; a pipe cannot be, so the decoder thread
+// detects the codec and passes plain input through.
+static FILE* cli_open_ndjson_input(FILE* raw) {
+    unsigned char magic[4];
+    long peeked = -1;
+    #ifndef __WINDOWS__
+    off_t offset = lseek(fileno(raw), 0, SEEK_CUR);
+    if (offset >= 0) peeked = (long)pread(fileno(raw), magic, sizeof(magic), offset);
+    #endif
+
+    if (peeked >= 0) {
+        JsonCodec codec = json_codec_detect(magic, (size_t)peeked);
+        return codec == JSON_CODEC_NONE ? raw : json_stream_open_decompressed(raw, codec);
+    }
+    if (!json_codec_available(JSON_CODEC_GZIP) && !json_codec_available(JSON_CODEC_ZSTD)) return raw;
+
+    FILE* input = json_stream_open_decompressed(raw, JSON_CODEC_NONE);
+    return input ? input : raw;
+}
+
+// Streams NDJSON from input_file (or stdin) to output_file (or stdout)
+static int run_ndjson_mode(const char* input_file, const char* output_file, JsonCodec output_codec,
+                           int action_flatten, int action_schema, int pretty_print,
+                           int use_threads, int num_threads, const CliRecordOptions* options,
+                           const ColumnarFormat* columnar) {
+    FILE* raw_input = stdin;
+    if (input_file != NULL && strcmp(input_file, "-") != 0) {
+        raw_input = fopen(input_file, "rb");
+        if (!raw_input) {
+            fprintf(stderr, "Error: Could not open input file %s\n", input_file);
+            return 1;
+        }
+    }
+
+    // Nothing reads raw_input through stdio, so its descriptor can be read directly
+    g_unbuffered_input = raw_input;
+    FILE* input = cli_open_ndjson_input(raw_input);
+    CliOutput cli_output;
+    if (!input || cli_output_open(&cli_output, output_file, output_codec, columnar != NULL) != 0) {
+        if (input && input != raw_input) fclose(input);
+        if (raw_input != stdin) fclose(raw_input);
+        g_unbuffered_input = NULL;
+        return 1;
+    }
+    FILE* output = cli_output.stream;
+
+    int status = 0;
+    long invalid = 0;
+    if (action_flatten && columnar) {
+        status = flatten_json_stream_columnar(input, output, *columnar, use_threads, num_threads) < 0;
+    } else if (action_flatten) {
+        status = flatten_json_stream(input, output, use_threads, num_threads) < 0;
+    } else if (action_schema) {
+        // The schema describes the whole stream, so it is written once at the end
+        cJSON* schema = generate_schema_stream_opts(input, options->schema_options);
+        char* text = schema ? cjson_tools_print(schema, pretty_print) : NULL;
+        status = !text || fprintf(output, "%s\n", text) < 0;
+        free(text);
+        cJSON_Delete(schema);
+    } else if (options->validator) {
+        invalid = schema_validate_stream(options->validator, input, output, options->validation_mode,
+                                         use_threads, num_threads);
+        status = invalid < 0;
+    } else {
+        status = process_json_stream(input, output, cli_transform_record, (void*)options) < 0;
+    }
+
+    if (input != raw_input) fclose(input);
+    if (raw_input != stdin) fclose(raw_input);
+    g_unbuffered_input = NULL;
+    if (cli_output_close(&cli_output) != 0) status = 1;
+
+    if (status) {
+        fprintf(stderr, "Error: Failed to process NDJSON stream\n");
+    }
+    // Invalid records make the run fail once their errors are written
+    return status || invalid > 0;
+}
+
+// Closes output after a result was written to it (or with nothing opened when
+// producing the result failed first), reports timing and releases the pools;
+// returns the exit status
+static int cli_finish_result(CliOutput* output, int failed, const char* output_file,
+                             size_t input_size, clock_t start_time) {
+    // A producer stopped by a write error reports it as its own failure
+    int write_failed = output->stream && ferror(output->stream);
+    if (cli_output_close(output) != 0) write_failed = 1;
+    if (failed || write_failed) {
+        fprintf(stderr, write_failed ? "Error: Failed to write complete output\n" : "Error: Failed to process JSON\n");
+        cleanup_global_pools();
+        return 1;
+    }
+
+    // Show performance information; the output was written while it was produced
+    clock_t end_time = clock();
+    double processing_time = ((double)(end_time - start_time)) / CLOCKS_PER_SEC;
+    
+    if (processing_time > 0.1 && isatty(STDERR_FILENO)) {
+        double throughput = input_size / processing_time / 1024.0 / 1024.0;
+        fprintf(stderr, "⚡ Processed %.1fMB in %.3fs (%.1fMB/s)\n", 
+                input_size / 1024.0 / 1024.0, processing_time, throughput);
+    }
+    
+    if (output_file && isatty(STDERR_FILENO)) {
+        fprintf(stderr, "✅ Output written to %s\n", output_file);
+    }
+
+    cleanup_global_pools();
+    return 0;
+}
+
+// Writes flattened rows of json, or of records when json is NULL, to
+// output_file (or stdout) in a columnar format
+static int cli_write_columnar(const cJSON* json, const JsonArrayView* records, ThreadPool* pool,
+                              ColumnarFormat format, const char* output_file, JsonCodec output_codec,
+                              int use_threads, int num_threads) {
+    CliOutput output;
+    if (cli_output_open(&output, output_file, output_codec, 1) != 0) return 1;
+
+    long rows = json ? flatten_json_columnar(json, output.stream, format, use_threads, num_threads) :
+                       flatten_json_view_columnar(records, pool, output.stream, format);
+    int status = rows < 0;
+    if (cli_output_close(&output) != 0) status = 1;
+
+    if (status) {
+        fprintf(stderr, "Error: Failed to write columnar output\n");
+    } else if (output_file && isatty(STDERR_FILENO)) {
+        fprintf(stderr, "✅ %ld rows written to %s\n", rows, output_file);
+    }
+    return status;
+}
+
+// Top-level array elements are dropped by the filters like nested ones
+static cJSON* cli_transform_element(const cJSON* record, void* user_data) {
+    const CliRecordOptions* options = user_data;
+
+    if (options->remove_nulls && cJSON_IsNull(record)) return NULL;
+    if (options->remove_empty && cJSON_IsString(record) && record->valuestring[0] == '\0') return NULL;
+    return cli_transform_record(record, user_data);
+}
+
+// Parses a top-level array element by element on the pool and runs the action
+// on the records directly, writing the result to output_file (or stdout) into
+// *status. Returns 0 when the input is not an array (or is invalid), leaving
+// the caller to parse it whole and report errors.
+static int run_parallel_array(const JsonInput* input, int action_flatten, int action_schema, int pretty_print,
+                              int num_threads, const CliRecordOptions* options, const char* output_file,
+                              JsonCodec output_codec, clock_t start_time, int* status) {
+    JsonArrayView records;
+    ThreadPool* pool = parse_array_on_shared_pool(input->data, input->length, num_threads, &records);
+    if (!pool) return 0;
+
+    // Schemas and transformed records are made before the output is opened, so
+    // a failure leaves no file behind; flattening writes as it goes
+    cJSON* schema = NULL;
+    cJSON* report = NULL;
+    JsonArrayView processed = {NULL, 0};
+    int failed = 0;
+    int invalid = 0;
+    if (action_schema && !action_flatten) {
+        schema = generate_schema_from_view_opts(&records, pool, options->schema_options);
+        failed = schema == NULL;
+    } else if (options->validator) {
+        cJSON* errors = NULL;
+        invalid = schema_validate_view(options->validator, &records, pool, options->validation_mode, &errors);
+        report = cli_validation_report(invalid, errors);
+        failed = report == NULL;
+    } else if (!action_flatten) {
+        failed = json_array_view_transform(&records, pool, cli_transform_element, (void*)options, &processed) != 0;
+    }
+
+    CliOutput output = {NULL, NULL, NULL};
+    int opened = !failed && cli_output_open(&output, output_file, output_codec, 0) == 0;
+    if (opened) {
+        if (action_flatten) {
+            failed = flatten_json_view_stream(&records, pool, output.stream, pretty_print) != 0;
+        } else if (schema) {
+            failed = cjson_tools_print_stream(schema, output.stream, 1) != 0;
+        } else if (report) {
+            failed = cjson_tools_print_stream(report, output.stream, pretty_print) != 0;
+        } else {
+            failed = json_array_view_print_stream(&processed, output.stream, pretty_print) != 0;
+        }
+        if (!failed) failed = fputc('\n', output.stream) == EOF;
+    }
+
+    cJSON_Delete(schema);
+    cJSON_Delete(report);
+    json_array_view_delete(&processed);
+    json_array_view_delete(&records);
+    thread_pool_release(pool);
+
+    if (!failed && !opened) {
+        // cli_output_open has reported why
+        cleanup_global_pools();
+        *status = 1;
+    } else {
+        *status = cli_finish_result(&output, failed, output_file, input->length, start_time);
+        if (*status == 0 && invalid > 0) *status = 1;
+    }
+    return 1;
 }
 
 int main(int argc, char* argv[]) {
@@ -3080,12 +13873,27 @@ int main(int argc, char* argv[]) {
     int action_replace_values = 0;
     char* replace_values_pattern = NULL;
     char* replace_values_replacement = NULL;
+    int action_unflatten = 0;
+    int action_validate = 0;
+    char* validate_schema_file = NULL;
+    SchemaValidationMode validation_mode = SCHEMA_VALIDATE_FIRST_ERROR;
+    SchemaInferenceOptions schema_options = {0};
     int use_threads = 0;
     int num_threads = 0;
     int pretty_print = 0;
+    int ndjson_mode = 0;
+    char* pipeline_spec = NULL;
+    char* paths_spec = NULL;
+    int structural_parser = 0;
+    int columnar_output = 0;
+    ColumnarFormat columnar_format = COLUMNAR_CSV;
+    int report_stats = 0;
+    int compress_output = 0;
+    JsonCodec output_codec = JSON_CODEC_NONE;
 
     char* output_file = NULL;
     char* input_file = NULL;
+    char* serve_socket = NULL;
 
     // Optimized command line argument parsing with jump table
     for (int i = 1; i < argc; i++) {
@@ -3101,22 +13909,27 @@ int main(int argc, char* argv[]) {
                 case 'f':
                     action_flatten = 1;
                     action_schema = action_remove_empty = action_remove_nulls = 0;
-                    action_replace_keys = action_replace_values = 0;
+                    action_replace_keys = action_replace_values = action_unflatten = action_validate = 0;
                     continue;
                 case 's':
                     action_schema = 1;
                     action_flatten = action_remove_empty = action_remove_nulls = 0;
-                    action_replace_keys = action_replace_values = 0;
+                    action_replace_keys = action_replace_values = action_unflatten = action_validate = 0;
                     break;
                 case 'e':
                     action_remove_empty = 1;
                     action_flatten = action_schema = action_remove_nulls = 0;
-                    action_replace_keys = action_replace_values = 0;
+                    action_replace_keys = action_replace_values = action_unflatten = action_validate = 0;
                     break;
                 case 'n':
                     action_remove_nulls = 1;
                     action_flatten = action_schema = action_remove_empty = 0;
-                    action_replace_keys = action_replace_values = 0;
+                    action_replace_keys = action_replace_values = action_unflatten = action_validate = 0;
+                    break;
+                case 'u':
+                    action_unflatten = 1;
+                    action_flatten = action_schema = action_remove_empty = action_remove_nulls = 0;
+                    action_replace_keys = action_replace_values = action_validate = 0;
                     break;
                 case 'r':
                     if (i + 2 >= argc) {
@@ -3126,7 +13939,7 @@ int main(int argc, char* argv[]) {
                     }
                     action_replace_keys = 1;
                     action_flatten = action_schema = action_remove_empty = action_remove_nulls = 0;
-                    action_replace_values = 0;
+                    action_replace_values = action_unflatten = action_validate = 0;
                     replace_pattern = argv[++i];
                     replace_replacement = argv[++i];
                     break;
@@ -3138,7 +13951,7 @@ int main(int argc, char* argv[]) {
                     }
                     action_replace_values = 1;
                     action_flatten = action_schema = action_remove_empty = action_remove_nulls = 0;
-                    action_replace_keys = 0;
+                    action_replace_keys = action_unflatten = action_validate = 0;
                     replace_values_pattern = argv[++i];
                     replace_values_replacement = argv[++i];
                     break;
@@ -3180,19 +13993,50 @@ int main(int argc, char* argv[]) {
             } else if (strcmp(long_opt, "flatten") == 0) {
                 action_flatten = 1;
                 action_schema = action_remove_empty = action_remove_nulls = 0;
-                action_replace_keys = action_replace_values = 0;
+                action_replace_keys = action_replace_values = action_unflatten = action_validate = 0;
             } else if (strcmp(long_opt, "schema") == 0) {
                 action_schema = 1;
                 action_flatten = action_remove_empty = action_remove_nulls = 0;
-                action_replace_keys = action_replace_values = 0;
+                action_replace_keys = action_replace_values = action_unflatten = action_validate = 0;
             } else if (strcmp(long_opt, "remove-empty") == 0) {
                 action_remove_empty = 1;
                 action_flatten = action_schema = action_remove_nulls = 0;
-                action_replace_keys = action_replace_values = 0;
+                action_replace_keys = action_replace_values = action_unflatten = action_validate = 0;
             } else if (strcmp(long_opt, "remove-nulls") == 0) {
                 action_remove_nulls = 1;
                 action_flatten = action_schema = action_remove_empty = 0;
-                action_replace_keys = action_replace_values = 0;
+                action_replace_keys = action_replace_values = action_unflatten = action_validate = 0;
+            } else if (strcmp(long_opt, "unflatten") == 0) {
+                action_unflatten = 1;
+                action_flatten = action_schema = action_remove_empty = action_remove_nulls = 0;
+                action_replace_keys = action_replace_values = action_validate = 0;
+            } else if (strcmp(long_opt, "validate") == 0) {
+                if (i + 1 >= argc) {
+                    fprintf(stderr, "Error: --validate requires a schema file\n");
+                    cleanup_global_pools();
+                    return 1;
+                }
+                action_validate = 1;
+                action_flatten = action_schema = action_remove_empty = action_remove_nulls = 0;
+                action_replace_keys = action_replace_values = action_unflatten = 0;
+                validate_schema_file = argv[++i];
+            } else if (strcmp(long_opt, "all-errors") == 0) {
+                validation_mode = SCHEMA_VALIDATE_ALL_ERRORS;
+            } else if (strcmp(long_opt, "sample") == 0) {
+                // Below 1 a fraction of the records, otherwise a record count
+                char* end = NULL;
+                double sample = i + 1 < argc ? strtod(argv[i + 1], &end) : 0.0;
+                if (!end || *end != '\0' || end == argv[i + 1] || !(sample > 0.0) || sample > INT_MAX ||
+                    (sample >= 1.0 && sample != floor(sample))) {
+                    fprintf(stderr, "Error: --sample requires a rate in (0, 1) or a record count\n");
+                    cleanup_global_pools();
+                    return 1;
+                }
+                i++;
+                schema_options.sample_rate = sample < 1.0 ? sample : 0.0;
+                schema_options.sample_size = sample < 1.0 ? 0 : (int)sample;
+            } else if (strcmp(long_opt, "schema-stats") == 0) {
+                schema_options.collect_stats = 1;
             } else if (strcmp(long_opt, "replace-keys") == 0) {
                 if (i + 2 >= argc) {
                     fprintf(stderr, "Error: --replace-keys requires pattern and replacement arguments\n");
@@ -3201,7 +14045,7 @@ int main(int argc, char* argv[]) {
                 }
                 action_replace_keys = 1;
                 action_flatten = action_schema = action_remove_empty = action_remove_nulls = 0;
-                action_replace_values = 0;
+                action_replace_values = action_unflatten = action_validate = 0;
                 replace_pattern = argv[++i];
                 replace_replacement = argv[++i];
             } else if (strcmp(long_opt, "replace-values") == 0) {
@@ -3212,9 +14056,25 @@ int main(int argc, char* argv[]) {
                 }
                 action_replace_values = 1;
                 action_flatten = action_schema = action_remove_empty = action_remove_nulls = 0;
-                action_replace_keys = 0;
+                action_replace_keys = action_unflatten = action_validate = 0;
                 replace_values_pattern = argv[++i];
                 replace_values_replacement = argv[++i];
+            } else if (strcmp(long_opt, "pipeline") == 0) {
+                if (i + 1 >= argc) {
+                    fprintf(stderr, "Error: --pipeline requires a list of steps\n");
+                    cleanup_global_pools();
+                    return 1;
+                }
+                action_flatten = action_schema = action_remove_empty = action_remove_nulls = 0;
+                action_replace_keys = action_replace_values = action_unflatten = action_validate = 0;
+                pipeline_spec = argv[++i];
+            } else if (strcmp(long_opt, "paths") == 0) {
+                if (i + 1 >= argc) {
+                    fprintf(stderr, "Error: --paths requires a list of paths\n");
+                    cleanup_global_pools();
+                    return 1;
+                }
+                paths_spec = argv[++i];
             } else if (strcmp(long_opt, "threads") == 0) {
                 use_threads = 1;
                 if (i + 1 < argc && argv[i + 1][0] != '-') {
@@ -3224,6 +14084,28 @@ int main(int argc, char* argv[]) {
                 }
             } else if (strcmp(long_opt, "pretty") == 0) {
                 pretty_print = 1;
+            } else if (strcmp(long_opt, "ndjson") == 0) {
+                ndjson_mode = 1;
+            } else if (strcmp(long_opt, "simd-parser") == 0) {
+                structural_parser = 1;
+            } else if (strcmp(long_opt, "stats") == 0) {
+                report_stats = 1;
+            } else if (strcmp(long_opt, "compress") == 0) {
+                if (i + 1 >= argc || json_codec_parse(argv[i + 1], &output_codec) != 0) {
+                    fprintf(stderr, "Error: --compress requires gzip, zstd or none\n");
+                    cleanup_global_pools();
+                    return 1;
+                }
+                compress_output = 1;
+                i++;
+            } else if (strcmp(long_opt, "format") == 0) {
+                if (i + 1 >= argc || columnar_format_parse(argv[i + 1], &columnar_format) != 0) {
+                    fprintf(stderr, "Error: --format requires csv, tsv or arrow\n");
+                    cleanup_global_pools();
+                    return 1;
+                }
+                columnar_output = 1;
+                i++;
             } else if (strcmp(long_opt, "output") == 0) {
                 if (i + 1 >= argc) {
                     fprintf(stderr, "Error: --output requires output file argument\n");
@@ -3231,6 +14113,13 @@ int main(int argc, char* argv[]) {
                     return 1;
                 }
                 output_file = argv[++i];
+            } else if (strcmp(long_opt, "serve") == 0) {
+                if (i + 1 >= argc) {
+                    fprintf(stderr, "Error: --serve requires a socket path\n");
+                    cleanup_global_pools();
+                    return 1;
+                }
+                serve_socket = argv[++i];
             } else {
                 fprintf(stderr, "Error: Unknown long option '--%s'\n", long_opt);
                 cleanup_global_pools();
@@ -3245,6 +14134,22 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (report_stats) atexit(cli_print_stats);
+
+    // Operations and their options come with each request
+    if (serve_socket) {
+        return cli_serve(serve_socket, use_threads ? num_threads : 0);
+    }
+
+    // Without --compress, an output file named .gz or .zst is compressed to match
+    if (!compress_output) output_codec = json_codec_from_path(output_file);
+    if (!json_codec_available(output_codec)) {
+        fprintf(stderr, "Error: %s output is not supported by this build\n",
+                output_codec == JSON_CODEC_GZIP ? "gzip" : "zstd");
+        cleanup_global_pools();
+        return 1;
+    }
+
     // Performance information for user
     if (use_threads && num_threads == 0) {
         num_threads = get_optimal_threads(0);
@@ -3253,119 +14158,216 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    // Read JSON input with optimizations
-    char* json_string = NULL;
+    // A later single action overrides --pipeline, like actions override each other
+    JsonPipeline* pipeline = NULL;
+    if (pipeline_spec && !(action_flatten || action_schema || action_remove_empty ||
+                           action_remove_nulls || action_replace_keys || action_replace_values ||
+                           action_unflatten || action_validate)) {
+        pipeline = json_pipeline_parse(pipeline_spec);
+        if (!pipeline) {
+            cleanup_global_pools();
+            return 1;
+        }
+    }
 
-    if (input_file == NULL || strcmp(input_file, "-") == 0) {
-        json_string = read_json_stdin();
-    } else {
-        json_string = read_json_file(input_file);
+    if (columnar_output && (!action_flatten || pipeline)) {
+        fprintf(stderr, "Error: --format only applies to flattening (-f)\n");
+        json_pipeline_free(pipeline);
+        cleanup_global_pools();
+        return 1;
+    }
+
+    if (paths_spec && ndjson_mode) {
+        fprintf(stderr, "Error: --paths is not supported with --ndjson\n");
+        json_pipeline_free(pipeline);
+        cleanup_global_pools();
+        return 1;
+    }
+
+    SchemaValidator* validator = NULL;
+    if (action_validate) {
+        char* schema_text = read_json_file(validate_schema_file);
+        validator = schema_text ? schema_validator_compile_string(schema_text) : NULL;
+        free(schema_text);
+        if (!validator) {
+            fprintf(stderr, "Error: Could not load schema %s\n", validate_schema_file);
+            cleanup_global_pools();
+            return 1;
+        }
+    }
+
+    CliRecordOptions options = {
+        action_remove_empty,
+        action_remove_nulls,
+        action_replace_keys ? replace_pattern : NULL,
+        replace_replacement,
+        action_replace_values ? replace_values_pattern : NULL,
+        replace_values_replacement,
+        pipeline,
+        action_unflatten,
+        validator,
+        validation_mode,
+        &schema_options
+    };
+
+    // NDJSON input is streamed record by record instead of being read whole
+    if (ndjson_mode) {
+        int status = run_ndjson_mode(input_file, output_file, output_codec, action_flatten, action_schema,
+                                     pretty_print, use_threads, num_threads, &options,
+                                     columnar_output ? &columnar_format : NULL);
+        json_pipeline_free(pipeline);
+        schema_validator_free(validator);
+        cleanup_global_pools();
+        return status;
+    }
+
+    JsonPathSet* paths = NULL;
+    if (paths_spec) {
+        paths = json_path_set_compile(paths_spec);
+        if (!paths) {
+            json_pipeline_free(pipeline);
+            schema_validator_free(validator);
+            cleanup_global_pools();
+            return 1;
+        }
     }
 
-    if (!json_string) {
+    // Map (or block-read) the input and parse it in place without a copy
+    JsonInput input;
+    int opened = (input_file == NULL || strcmp(input_file, "-") == 0) ?
+        json_input_open_stdin(&input) : json_input_open_file(&input, input_file);
+
+    if (opened != 0) {
         fprintf(stderr, "Error: Failed to read JSON input\n");
+        json_path_set_free(paths);
+        json_pipeline_free(pipeline);
+        schema_validator_free(validator);
         cleanup_global_pools();
         return 1;
     }
 
     // Show performance hint for large inputs
-    size_t input_size = strlen_simd(json_string);
+    size_t input_size = input.length;
     if (input_size > 100000 && !use_threads && isatty(STDERR_FILENO)) {
         fprintf(stderr, "💡 Tip: Use -t 0 for auto-threading on large files (%.1fMB detected)\n", 
                 input_size / 1024.0 / 1024.0);
     }
 
     // Process JSON based on selected action with timing
-    char* result = NULL;
     clock_t start_time = clock();
 
-    if (action_flatten) {
-        result = flatten_json_string(json_string, use_threads, num_threads);
-    } else if (action_schema) {
-        result = generate_schema_from_string(json_string, use_threads, num_threads);
-    } else if (action_remove_empty || action_remove_nulls || action_replace_keys || action_replace_values) {
-        cJSON* json = cJSON_Parse(json_string);
-        if (!json) {
-            fprintf(stderr, "Error: Invalid JSON input\n");
-            free(json_string);
+    // A threaded run over a top-level array parses its elements concurrently
+    // and never builds the array itself
+    int has_action = action_flatten || action_schema || action_remove_empty || action_remove_nulls ||
+                     action_replace_keys || action_replace_values || action_unflatten || action_validate;
+    if (use_threads && !paths && columnar_output) {
+        JsonArrayView records;
+        ThreadPool* pool = parse_array_on_shared_pool(input.data, input.length, num_threads, &records);
+        if (pool) {
+            json_input_close(&input);
+            int status = cli_write_columnar(NULL, &records, pool, columnar_format, output_file, output_codec,
+                                            1, num_threads);
+            json_array_view_delete(&records);
+            thread_pool_release(pool);
             cleanup_global_pools();
-            return 1;
-        }
-
-        cJSON* processed = json;
-
-        if (action_remove_empty) {
-            processed = remove_empty_strings(json);
-            cJSON_Delete(json);
-        } else if (action_remove_nulls) {
-            processed = remove_nulls(json);
-            cJSON_Delete(json);
-        } else if (action_replace_keys) {
-            processed = replace_keys(json, replace_pattern, replace_replacement);
-            cJSON_Delete(json);
-        } else if (action_replace_values) {
-            processed = replace_values(json, replace_values_pattern, replace_values_replacement);
-            cJSON_Delete(json);
+            return status;
         }
-
-        if (processed) {
-            result = pretty_print ? cJSON_Print(processed) : cJSON_PrintUnformatted(processed);
-            cJSON_Delete(processed);
+    } else if (use_threads && !paths && !pipeline && has_action) {
+        int status;
+        if (run_parallel_array(&input, action_flatten, action_schema, pretty_print, num_threads, &options,
+                               output_file, output_codec, start_time, &status)) {
+            json_input_close(&input);
+            schema_validator_free(validator);
+            return status;
         }
     }
 
-    free(json_string);
+    // The tree owns copies of all strings, so the input is released right after parsing.
+    // With --paths only the selected subtrees are parsed and every action sees the projection.
+    cJSON* json;
+    if (paths) {
+        json = json_parse_paths(input.data, input.length, paths, 1);
+    } else {
+        json = structural_parser ? json_input_parse_structural(&input) : json_input_parse(&input);
+    }
+    json_input_close(&input);
+    json_path_set_free(paths);
 
-    if (!result) {
-        fprintf(stderr, "Error: Failed to process JSON\n");
+    if (!json) {
+        fprintf(stderr, "Error: Invalid JSON input\n");
+        json_pipeline_free(pipeline);
+        schema_validator_free(validator);
         cleanup_global_pools();
         return 1;
     }
 
-    // Show performance information
-    clock_t end_time = clock();
-    double processing_time = ((double)(end_time - start_time)) / CLOCKS_PER_SEC;
-    
-    if (processing_time > 0.1 && isatty(STDERR_FILENO)) {
-        double throughput = input_size / processing_time / 1024.0 / 1024.0;
-        fprintf(stderr, "⚡ Processed %.1fMB in %.3fs (%.1fMB/s)\n", 
-                input_size / 1024.0 / 1024.0, processing_time, throughput);
-    }
-
-    // Output result with error handling
-    if (output_file) {
-        FILE* output = fopen(output_file, "w");
-        if (!output) {
-            fprintf(stderr, "Error: Could not open output file %s\n", output_file);
-            free(result);
-            cleanup_global_pools();
-            return 1;
-        }
-        
-        size_t result_len = strlen_simd(result);
-        size_t written = fwrite(result, 1, result_len, output);
-        fputc('\n', output);
-        
-        if (written != result_len) {
-            fprintf(stderr, "Error: Failed to write complete output\n");
-            fclose(output);
-            free(result);
-            cleanup_global_pools();
-            return 1;
-        }
-        
-        fclose(output);
-        
-        if (isatty(STDERR_FILENO)) {
-            fprintf(stderr, "✅ Output written to %s\n", output_file);
+    if (columnar_output) {
+        int status = cli_write_columnar(json, NULL, NULL, columnar_format, output_file, output_codec,
+                                        use_threads, num_threads);
+        cJSON_Delete(json);
+        cleanup_global_pools();
+        return status;
+    }
+
+    // Transformed trees and schemas are made before the output is opened, so a
+    // failure leaves no file behind; they are then printed straight into it.
+    // Flattening writes as it goes.
+    cJSON* processed = NULL;
+    char* schema = NULL;
+    int flatten = 0;
+    int invalid = 0;
+    if (pipeline) {
+        processed = json_pipeline_apply(pipeline, json);
+        json_pipeline_free(pipeline);
+    } else if (action_flatten) {
+        flatten = 1;
+    } else if (action_schema) {
+        schema = schema_parsed_json_text(json, &schema_options, use_threads, num_threads);
+    } else if (action_remove_empty) {
+        processed = remove_empty_strings(json);
+    } else if (action_remove_nulls) {
+        processed = remove_nulls(json);
+    } else if (action_replace_keys) {
+        processed = replace_keys(json, replace_pattern, replace_replacement);
+    } else if (action_replace_values) {
+        processed = replace_values(json, replace_values_pattern, replace_values_replacement);
+    } else if (action_unflatten) {
+        processed = unflatten_parsed_json(json, use_threads, num_threads);
+    } else if (validator) {
+        // An array is a batch of records, anything else one record
+        cJSON* errors = NULL;
+        invalid = cJSON_IsArray(json) ?
+            schema_validate_batch(validator, json, validation_mode, use_threads, num_threads, &errors) :
+            schema_validate(validator, json, validation_mode, &errors);
+        processed = cli_validation_report(invalid, errors);
+        schema_validator_free(validator);
+    }
+
+    CliOutput output = {NULL, NULL, NULL};
+    int failed = !flatten && !processed && !schema;
+    int output_opened = !failed && cli_output_open(&output, output_file, output_codec, 0) == 0;
+    if (output_opened) {
+        if (flatten) {
+            failed = flatten_parsed_json_stream(json, output.stream, use_threads, num_threads, pretty_print) != 0;
+        } else if (processed) {
+            failed = cjson_tools_print_stream(processed, output.stream, pretty_print) != 0;
+        } else {
+            failed = fputs(schema, output.stream) == EOF;
         }
-    } else {
-        printf("%s\n", result);
+        if (!failed) failed = fputc('\n', output.stream) == EOF;
     }
 
-    free(result);
-    cleanup_global_pools();
-    return 0;
+    cJSON_Delete(processed);
+    free(schema);
+    cJSON_Delete(json);
+
+    if (!failed && !output_opened) {
+        // cli_output_open has reported why
+        cleanup_global_pools();
+        return 1;
+    }
+    int status = cli_finish_result(&output, failed, output_file, input_size, start_time);
+    return status ? status : invalid > 0;
 }
 
 #endif // CJSON_TOOLS_NO_MAIN
\ No newline at end of file
@@ -0,0 +1,524 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <string.h>
+#include "cjson_tools.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+
+#ifndef __WINDOWS__
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Benchmark harness: deterministic synthetic corpora, throughput, per-record
+// latency percentiles, peak RSS and thread scaling, reported as JSON.
+
+#define BENCH_SEED 0x9E3779B97F4A7C15ULL
+#define BENCH_DEFAULT_RECORDS 10000
+#define BENCH_QUICK_RECORDS 1000
+#define BENCH_DEFAULT_ITERATIONS 3
+#define BENCH_LATENCY_SAMPLES 2000
+
+// =============================================================================
+// DETERMINISTIC CORPUS GENERATION
+// =============================================================================
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} BenchBuffer;
+
+static void bench_appendf(BenchBuffer* buf, const char* fmt, ...) {
+    for (;;) {
+        va_list args;
+        va_start(args, fmt);
+        size_t available = buf->capacity - buf->length;
+        int written = vsnprintf(buf->data + buf->length, available, fmt, args);
+        va_end(args);
+
+        if (written < 0) return;
+        if ((size_t)written < available) {
+            buf->length += (size_t)written;
+            return;
+        }
+
+        size_t new_capacity = buf->capacity ? buf->capacity * 2 : 65536;
+        while (new_capacity - buf->length <= (size_t)written) new_capacity *= 2;
+        char* new_data = realloc(buf->data, new_capacity);
+        if (!new_data) {
+            fprintf(stderr, "Error: Out of memory generating corpus\n");
+            exit(1);
+        }
+        buf->data = new_data;
+        buf->capacity = new_capacity;
+    }
+}
+
+// xorshift64* so every run and platform produces identical corpora
+static uint64_t bench_rng_state = BENCH_SEED;
+
+static uint32_t bench_rand(void) {
+    bench_rng_state ^= bench_rng_state >> 12;
+    bench_rng_state ^= bench_rng_state << 25;
+    bench_rng_state ^= bench_rng_state >> 27;
+    return (uint32_t)((bench_rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static void gen_wide(BenchBuffer* buf, int id) {
+    bench_appendf(buf, "{\"id\":%d", id);
+    for (int i = 0; i < 64; i++) {
+        switch (bench_rand() % 5) {
+            case 0: bench_appendf(buf, ",\"field_%d\":%u", i, bench_rand() % 100000); break;
+            case 1: bench_appendf(buf, ",\"field_%d\":\"value_%u\"", i, bench_rand() % 1000); break;
+            case 2: bench_appendf(buf, ",\"field_%d\":%s", i, bench_rand() % 2 ? "true" : "false"); break;
+            case 3: bench_appendf(buf, ",\"field_%d\":null", i); break;
+            default: bench_appendf(buf, ",\"field_%d\":\"\"", i); break;
+        }
+    }
+    bench_appendf(buf, "}");
+}
+
+static void gen_deep(BenchBuffer* buf, int id) {
+    const int depth = 16;
+    bench_appendf(buf, "{\"id\":%d", id);
+    for (int d = 0; d < depth; d++) {
+        bench_appendf(buf, ",\"level_%d\":{\"value\":%u,\"name\":\"n%u\",\"empty\":null", d,
+                      bench_rand() % 1000, bench_rand() % 100);
+    }
+    for (int d = 0; d < depth; d++) bench_appendf(buf, "}");
+    bench_appendf(buf, "}");
+}
+
+static void gen_long_arrays(BenchBuffer* buf, int id) {
+    bench_appendf(buf, "{\"id\":%d,\"samples\":[", id);
+    for (int i = 0; i < 256; i++) {
+        bench_appendf(buf, "%s%u", i ? "," : "", bench_rand() % 10000);
+    }
+    bench_appendf(buf, "],\"tags\":[");
+    for (int i = 0; i < 32; i++) {
+        bench_appendf(buf, "%s\"tag_%u\"", i ? "," : "", bench_rand() % 50);
+    }
+    bench_appendf(buf, "]}");
+}
+
+static void gen_strings(BenchBuffer* buf, int id) {
+    static const char* words[] = {"alpha", "beta", "gamma", "delta", "quote\\\"d", "tab\\tbed",
+                                  "line\\nbreak", "unicode\\u00e9", "path\\\\to", "omega"};
+    bench_appendf(buf, "{\"id\":%d", id);
+    for (int i = 0; i < 16; i++) {
+        bench_appendf(buf, ",\"text_%d\":\"", i);
+        int words_in_field = 8 + (int)(bench_rand() % 24);
+        for (int w = 0; w < words_in_field; w++) {
+            bench_appendf(buf, "%s%s", w ? " " : "", words[bench_rand() % 10]);
+        }
+        bench_appendf(buf, "\"");
+    }
+    bench_appendf(buf, "}");
+}
+
+static void gen_numbers(BenchBuffer* buf, int id) {
+    bench_appendf(buf, "{\"id\":%d", id);
+    for (int i = 0; i < 48; i++) {
+        uint32_t r = bench_rand();
+        if (i % 3 == 0) {
+            bench_appendf(buf, ",\"int_%d\":%d", i, (int)(r % 2000000) - 1000000);
+        } else if (i % 3 == 1) {
+            bench_appendf(buf, ",\"float_%d\":%u.%06u", i, r % 1000, bench_rand() % 1000000);
+        } else {
+            bench_appendf(buf, ",\"exp_%d\":%u.%ue%d", i, r % 10, bench_rand() % 1000, (int)(bench_rand() % 40) - 20);
+        }
+    }
+    bench_appendf(buf, "}");
+}
+
+typedef struct {
+    const char* name;
+    void (*generate)(BenchBuffer* buf, int id);
+} CorpusKind;
+
+static const CorpusKind corpus_kinds[] = {
+    {"wide", gen_wide},
+    {"deep", gen_deep},
+    {"long_arrays", gen_long_arrays},
+    {"strings", gen_strings},
+    {"numbers", gen_numbers},
+};
+
+#define CORPUS_KIND_COUNT ((int)(sizeof(corpus_kinds) / sizeof(corpus_kinds[0])))
+
+// Generates a JSON array of `records` records; the same kind and size always
+// yield byte-identical text
+static char* generate_corpus(const CorpusKind* kind, int records, size_t* length) {
+    BenchBuffer buf = {NULL, 0, 0};
+    bench_rng_state = BENCH_SEED;
+
+    bench_appendf(&buf, "[");
+    for (int i = 0; i < records; i++) {
+        if (i) bench_appendf(&buf, ",");
+        kind->generate(&buf, i);
+    }
+    bench_appendf(&buf, "]");
+
+    *length = buf.length;
+    return buf.data;
+}
+
+// =============================================================================
+// MEASUREMENT
+// =============================================================================
+
+static double now_seconds(void) {
+#if defined(CLOCK_MONOTONIC) && !defined(__WINDOWS__)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static long peak_rss_kb(void) {
+#ifndef __WINDOWS__
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // bytes on macOS
+#else
+    return usage.ru_maxrss;         // kilobytes on Linux and BSD
+#endif
+#else
+    return 0;
+#endif
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, int count, double p) {
+    if (count == 0) return 0.0;
+    int index = (int)(p * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+typedef enum {
+    OP_FLATTEN,
+    OP_SCHEMA,
+    OP_REMOVE_NULLS,
+    OP_REPLACE_KEYS
+} BenchOp;
+
+static const char* op_names[] = {"flatten_json_batch", "generate_schema_from_batch", "remove_nulls", "replace_keys"};
+
+// Runs the whole-batch form of an operation once and discards the result
+static void run_batch_op(BenchOp op, cJSON* batch, int use_threads, int num_threads) {
+    cJSON* result = NULL;
+    switch (op) {
+        case OP_FLATTEN: result = flatten_json_batch(batch, use_threads, num_threads); break;
+        case OP_SCHEMA: result = generate_schema_from_batch(batch, use_threads, num_threads); break;
+        case OP_REMOVE_NULLS: result = remove_nulls(batch); break;
+        case OP_REPLACE_KEYS: result = replace_keys(batch, "^field_1", "renamed"); break;
+    }
+    cJSON_Delete(result);
+}
+
+// Runs the single-record form used for latency percentiles
+static void run_record_op(BenchOp op, cJSON* record) {
+    cJSON* result = NULL;
+    switch (op) {
+        case OP_FLATTEN: result = flatten_json_object(record); break;
+        case OP_SCHEMA: result = generate_schema_from_object(record); break;
+        case OP_REMOVE_NULLS: result = remove_nulls(record); break;
+        case OP_REPLACE_KEYS: result = replace_keys(record, "^field_1", "renamed"); break;
+    }
+    cJSON_Delete(result);
+}
+
+// Median wall time of `iterations` batch runs
+static double time_batch_op(BenchOp op, cJSON* batch, int use_threads, int num_threads, int iterations) {
+    double* times = malloc((size_t)iterations * sizeof(double));
+    if (!times) return 0.0;
+
+    for (int i = 0; i < iterations; i++) {
+        double start = now_seconds();
+        run_batch_op(op, batch, use_threads, num_threads);
+        times[i] = now_seconds() - start;
+    }
+
+    qsort(times, (size_t)iterations, sizeof(double), compare_doubles);
+    double median = percentile(times, iterations, 0.5);
+    free(times);
+    return median;
+}
+
+static cJSON* bench_operation(BenchOp op, cJSON* batch, const JsonArrayView* records,
+                              size_t corpus_bytes, int iterations) {
+    double seconds = time_batch_op(op, batch, 0, 0, iterations);
+
+    // Per-record latency over (at most) BENCH_LATENCY_SAMPLES evenly spaced records
+    int samples = records->count < BENCH_LATENCY_SAMPLES ? records->count : BENCH_LATENCY_SAMPLES;
+    double* latencies = malloc((size_t)(samples > 0 ? samples : 1) * sizeof(double));
+    int step = samples > 0 ? records->count / samples : 1;
+    for (int i = 0; latencies && i < samples; i++) {
+        double start = now_seconds();
+        run_record_op(op, records->items[i * step]);
+        latencies[i] = now_seconds() - start;
+    }
+    if (latencies) qsort(latencies, (size_t)samples, sizeof(double), compare_doubles);
+
+    cJSON* result = cJSON_CreateObject();
+    cJSON_AddStringToObject(result, "operation", op_names[op]);
+    cJSON_AddNumberToObject(result, "seconds", seconds);
+    cJSON_AddNumberToObject(result, "mb_per_sec", seconds > 0 ? corpus_bytes / seconds / (1024.0 * 1024.0) : 0);
+    cJSON_AddNumberToObject(result, "records_per_sec", seconds > 0 ? records->count / seconds : 0);
+    cJSON_AddNumberToObject(result, "p50_us", latencies ? percentile(latencies, samples, 0.50) * 1e6 : 0);
+    cJSON_AddNumberToObject(result, "p99_us", latencies ? percentile(latencies, samples, 0.99) * 1e6 : 0);
+    free(latencies);
+    return result;
+}
+
+static cJSON* bench_thread_scaling(cJSON* batch, size_t corpus_bytes, int record_count,
+                                   int max_threads, int iterations) {
+    cJSON* scaling = cJSON_CreateArray();
+    const BenchOp ops[] = {OP_FLATTEN, OP_SCHEMA};
+
+    for (int threads = 1; threads <= max_threads; threads++) {
+        cJSON* point = cJSON_CreateObject();
+        cJSON_AddNumberToObject(point, "threads", threads);
+
+        for (int i = 0; i < 2; i++) {
+            double seconds = time_batch_op(ops[i], batch, threads > 1, threads, iterations);
+            cJSON* entry = cJSON_AddObjectToObject(point, op_names[ops[i]]);
+            cJSON_AddNumberToObject(entry, "seconds", seconds);
+            cJSON_AddNumberToObject(entry, "mb_per_sec", seconds > 0 ? corpus_bytes / seconds / (1024.0 * 1024.0) : 0);
+            cJSON_AddNumberToObject(entry, "records_per_sec", seconds > 0 ? record_count / seconds : 0);
+        }
+
+        cJSON_AddItemToArray(scaling, point);
+        fprintf(stderr, "  scaling: %d thread(s) done\n", threads);
+    }
+    return scaling;
+}
+
+// =============================================================================
+// DRIVER
+// =============================================================================
+
+// Generates, parses and benchmarks one corpus; returns its report entry
+static cJSON* bench_corpus(const CorpusKind* kind, int records, int iterations, int max_threads, int scaling) {
+    size_t corpus_bytes = 0;
+    char* text = generate_corpus(kind, records, &corpus_bytes);
+    double parse_start = now_seconds();
+    cJSON* batch = text ? cJSON_ParseWithLength(text, corpus_bytes) : NULL;
+    double parse_seconds = now_seconds() - parse_start;
+
+    // Same corpus through the structural index parser; the tree is identical
+    double structural_start = now_seconds();
+    cJSON* structural_batch = text ? json_parse_structural(text, corpus_bytes, NULL, 0) : NULL;
+    double structural_parse_seconds = now_seconds() - structural_start;
+    cJSON_Delete(structural_batch);
+    free(text);
+
+    JsonArrayView view;
+    if (!batch || json_array_view_init(&view, batch) != 0) {
+        fprintf(stderr, "Error: Failed to build corpus '%s'\n", kind->name);
+        cJSON_Delete(batch);
+        return NULL;
+    }
+
+    fprintf(stderr, "📊 %s: %d records, %.1f MB\n", kind->name, records, corpus_bytes / (1024.0 * 1024.0));
+
+    cJSON* entry = cJSON_CreateObject();
+    cJSON_AddStringToObject(entry, "corpus", kind->name);
+    cJSON_AddNumberToObject(entry, "bytes", (double)corpus_bytes);
+    cJSON_AddNumberToObject(entry, "parse_seconds", parse_seconds);
+    cJSON_AddNumberToObject(entry, "structural_parse_seconds", structural_parse_seconds);
+
+    cJSON* operations = cJSON_AddArrayToObject(entry, "operations");
+    for (int op = OP_FLATTEN; op <= OP_REPLACE_KEYS; op++) {
+        cJSON_AddItemToArray(operations, bench_operation((BenchOp)op, batch, &view, corpus_bytes, iterations));
+    }
+    if (scaling) {
+        cJSON_AddItemToObject(entry, "thread_scaling",
+                              bench_thread_scaling(batch, corpus_bytes, view.count, max_threads, iterations));
+    }
+
+    json_array_view_free(&view);
+    cJSON_Delete(batch);
+    cJSON_AddNumberToObject(entry, "peak_rss_kb", (double)peak_rss_kb());
+    return entry;
+}
+
+// ru_maxrss only ever grows, so each corpus runs in a child process of its own
+// and reports that child's peak; the entry comes back through a pipe
+static cJSON* bench_corpus_isolated(const CorpusKind* kind, int records, int iterations, int max_threads,
+                                    int scaling) {
+#ifndef __WINDOWS__
+    int fds[2];
+    if (pipe(fds) != 0) {
+        fprintf(stderr, "Error: Failed to create a pipe for corpus '%s'\n", kind->name);
+        return NULL;
+    }
+    fflush(NULL);
+    pid_t child = fork();
+    if (child < 0) {
+        fprintf(stderr, "Error: Failed to fork for corpus '%s'\n", kind->name);
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    }
+    if (child == 0) {
+        close(fds[0]);
+        cJSON* entry = bench_corpus(kind, records, iterations, max_threads, scaling);
+        char* json = entry ? cJSON_PrintUnformatted(entry) : NULL;
+        int ok = json != NULL;
+        for (size_t written = 0, length = json ? strlen(json) : 0; ok && written < length;) {
+            ssize_t n = write(fds[1], json + written, length - written);
+            ok = n > 0;
+            written += ok ? (size_t)n : 0;
+        }
+        _exit(ok ? 0 : 1);
+    }
+
+    close(fds[1]);
+    BenchBuffer reply = {0};
+    char chunk[4096];
+    ssize_t n;
+    while ((n = read(fds[0], chunk, sizeof(chunk))) > 0) {
+        bench_appendf(&reply, "%.*s", (int)n, chunk);
+    }
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    cJSON* entry = WIFEXITED(status) && WEXITSTATUS(status) == 0 && reply.data ?
+        cJSON_Parse(reply.data) : NULL;
+    free(reply.data);
+    if (!entry) fprintf(stderr, "Error: Benchmark of corpus '%s' failed\n", kind->name);
+    return entry;
+#else
+    return bench_corpus(kind, records, iterations, max_threads, scaling);
+#endif
+}
+
+static void print_usage(const char* program_name) {
+    printf("Usage: %s [options]\n\n", program_name);
+    printf("  --records N            Records per corpus (default %d)\n", BENCH_DEFAULT_RECORDS);
+    printf("  --iterations N         Timed runs per measurement, median reported (default %d)\n", BENCH_DEFAULT_ITERATIONS);
+    printf("  --threads N            Largest thread count in the scaling curve (default: all cores)\n");
+    printf("  --corpus NAME          Only run one corpus (wide, deep, long_arrays, strings, numbers)\n");
+    printf("  --quick                %d records, 1 iteration (smoke test / PGO training)\n", BENCH_QUICK_RECORDS);
+    printf("  --output FILE          Write the JSON report to FILE instead of stdout\n");
+    printf("  --emit-corpus NAME     Print the corpus itself and exit\n");
+    printf("  -h, --help             Show this help message\n");
+}
+
+static const CorpusKind* find_corpus(const char* name) {
+    for (int i = 0; i < CORPUS_KIND_COUNT; i++) {
+        if (strcmp(corpus_kinds[i].name, name) == 0) return &corpus_kinds[i];
+    }
+    fprintf(stderr, "Error: Unknown corpus '%s'\n", name);
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    int records = BENCH_DEFAULT_RECORDS;
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    int max_threads = 0;
+    const char* output_file = NULL;
+    const CorpusKind* only_corpus = NULL;
+    const CorpusKind* emit_corpus = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        int has_value = i + 1 < argc;
+
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (strcmp(arg, "--quick") == 0) {
+            records = BENCH_QUICK_RECORDS;
+            iterations = 1;
+        } else if (strcmp(arg, "--records") == 0 && has_value) {
+            records = atoi(argv[++i]);
+        } else if (strcmp(arg, "--iterations") == 0 && has_value) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(arg, "--threads") == 0 && has_value) {
+            max_threads = atoi(argv[++i]);
+        } else if (strcmp(arg, "--output") == 0 && has_value) {
+            output_file = argv[++i];
+        } else if (strcmp(arg, "--corpus") == 0 && has_value) {
+            if (!(only_corpus = find_corpus(argv[++i]))) return 1;
+        } else if (strcmp(arg, "--emit-corpus") == 0 && has_value) {
+            if (!(emit_corpus = find_corpus(argv[++i]))) return 1;
+        } else {
+            fprintf(stderr, "Error: Unknown or incomplete option '%s'\n", arg);
+            return 1;
+        }
+    }
+
+    if (records < 1 || iterations < 1) {
+        fprintf(stderr, "Error: --records and --iterations must be positive\n");
+        return 1;
+    }
+
+    if (emit_corpus) {
+        size_t length = 0;
+        char* text = generate_corpus(emit_corpus, records, &length);
+        int ok = text && fwrite(text, 1, length, stdout) == length;
+        free(text);
+        return ok ? 0 : 1;
+    }
+
+    init_global_pools();
+    if (max_threads <= 0) max_threads = get_num_cores();
+
+    cJSON* report = cJSON_CreateObject();
+    cJSON_AddNumberToObject(report, "records_per_corpus", records);
+    cJSON_AddNumberToObject(report, "iterations", iterations);
+    cJSON_AddNumberToObject(report, "cores", get_num_cores());
+    cJSON* corpora = cJSON_AddArrayToObject(report, "corpora");
+
+    long peak_kb = 0;
+    for (int k = 0; k < CORPUS_KIND_COUNT; k++) {
+        const CorpusKind* kind = &corpus_kinds[k];
+        if (only_corpus && only_corpus != kind) continue;
+
+        // The scaling curve only needs one representative corpus
+        cJSON* entry = bench_corpus_isolated(kind, records, iterations, max_threads, k == 0 || only_corpus);
+        if (!entry) {
+            cJSON_Delete(report);
+            cleanup_global_pools();
+            return 1;
+        }
+        cJSON* rss = cJSON_GetObjectItem(entry, "peak_rss_kb");
+        if (rss && rss->valuedouble > peak_kb) peak_kb = (long)rss->valuedouble;
+        cJSON_AddItemToArray(corpora, entry);
+    }
+
+    cJSON_AddNumberToObject(report, "peak_rss_kb", (double)peak_kb);
+
+    char* json = cJSON_Print(report);
+    cJSON_Delete(report);
+    cleanup_global_pools();
+    if (!json) return 1;
+
+    FILE* output = output_file ? fopen(output_file, "w") : stdout;
+    if (!output) {
+        fprintf(stderr, "Error: Could not open output file %s\n", output_file);
+        free(json);
+        return 1;
+    }
+    fprintf(output, "%s\n", json);
+    if (output != stdout) fclose(output);
+    free(json);
+    return 0;
+}
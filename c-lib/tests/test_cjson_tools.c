@@ -1,10 +1,19 @@
+#define _GNU_SOURCE
 #include <string.h>
 #include "cjson_tools.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <math.h>
 #include <assert.h>
 
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(THREADING_DISABLED)
+#define TEST_SERVER_SUPPORTED
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
 // Test framework macros
 #define ANSI_COLOR_GREEN   "\x1b[32m"
 #define ANSI_COLOR_RED     "\x1b[31m"
@@ -152,6 +161,34 @@ static char* create_large_test_json(int num_objects) {
 // BASIC FUNCTIONALITY TESTS
 // =============================================================================
 
+typedef struct {
+    SlabAllocator* allocator;
+    void** objects;
+} SlabStress;
+
+static void slab_alloc_range(void* context, int begin, int end, int slot) {
+    SlabStress* stress = (SlabStress*)context;
+    for (int i = begin; i < end; i++) {
+        stress->objects[i] = slab_alloc(stress->allocator);
+        if (stress->objects[i]) memset(stress->objects[i], slot, 64);
+    }
+}
+
+// After sorting, each thread frees a mix of objects allocated by the others
+static void slab_free_range(void* context, int begin, int end, int slot) {
+    (void)slot;
+    SlabStress* stress = (SlabStress*)context;
+    for (int i = begin; i < end; i++) {
+        slab_free(stress->allocator, stress->objects[i]);
+    }
+}
+
+static int compare_pointers(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t)*(void* const*)a;
+    uintptr_t y = (uintptr_t)*(void* const*)b;
+    return (x > y) - (x < y);
+}
+
 void test_memory_pools() {
     TEST_SECTION("Memory Pool Tests");
     
@@ -180,11 +217,136 @@ void test_memory_pools() {
     TEST_ASSERT_NOT_NULL(ptr3, "Reallocation after free successful");
     
     slab_free(allocator, ptr3);
+    
+    // Slabs grow on demand: far more objects than one slab holds, all distinct
+    enum { STRESS_OBJECTS = 20000 };
+    void** objects = malloc(STRESS_OBJECTS * sizeof(void*));
+    SlabStress stress = {allocator, objects};
+    slab_alloc_range(&stress, 0, STRESS_OBJECTS, 1);
+    qsort(objects, STRESS_OBJECTS, sizeof(void*), compare_pointers);
+    int distinct = objects[0] != NULL;
+    for (int i = 1; i < STRESS_OBJECTS; i++) {
+        if (!objects[i] || objects[i] == objects[i - 1]) distinct = 0;
+    }
+    TEST_ASSERT(distinct, "Slab hands out distinct objects beyond its first slab");
+    
+    void* last = objects[STRESS_OBJECTS - 1];
+    slab_free(allocator, last);
+    TEST_ASSERT(slab_alloc(allocator) == last, "Freed object is reused from the thread cache");
+    slab_free_range(&stress, 0, STRESS_OBJECTS, 0);
+    
+#ifndef THREADING_DISABLED
+    // Allocate on several threads, sort, free on whichever thread claims each range
+    ThreadPool* pool = thread_pool_create(4);
+    if (pool) {
+        for (int round = 0; round < 3; round++) {
+            thread_pool_parallel_for(pool, STRESS_OBJECTS, 64, slab_alloc_range, &stress);
+            qsort(objects, STRESS_OBJECTS, sizeof(void*), compare_pointers);
+            distinct = objects[0] != NULL;
+            for (int i = 1; i < STRESS_OBJECTS; i++) {
+                if (!objects[i] || objects[i] == objects[i - 1]) distinct = 0;
+            }
+            TEST_ASSERT(distinct, "Concurrent slab allocations are distinct");
+            thread_pool_parallel_for(pool, STRESS_OBJECTS, 64, slab_free_range, &stress);
+        }
+        thread_pool_destroy(pool);
+    }
+#endif
+    free(objects);
     slab_allocator_destroy(allocator);
     
     cleanup_global_pools();
 }
 
+void test_json_arena() {
+    TEST_SECTION("cJSON Arena Tests");
+    init_global_pools();
+    
+    const char* input = "{\"user\": {\"name\": \"Ada\", \"nick\": null, \"tags\": [\"a\", \"b\"]}, \"id\": 7}";
+    cJSON* heap_json = cJSON_Parse(input);
+    cJSON* heap_filtered = remove_nulls(heap_json);
+    char* expected = cjson_tools_print(heap_filtered, 0);
+    TEST_ASSERT(heap_json && !json_arena_owns(heap_json), "Trees built outside an arena use the heap");
+    
+    JsonArena* arena = json_arena_create(0);
+    TEST_ASSERT_NOT_NULL(arena, "Arena created");
+    JsonArena* previous = json_arena_enter(arena);
+    TEST_ASSERT(previous == NULL && json_arena_current() == arena, "Arena is current after enter");
+    
+    // Heap nodes freed while the arena is entered still go back to the heap
+    cJSON_Delete(heap_filtered);
+    cJSON_Delete(heap_json);
+    
+    cJSON* json = cJSON_Parse(input);
+    cJSON* filtered = remove_nulls(json);
+    TEST_ASSERT(json && filtered && json_arena_owns(json) && json_arena_owns(filtered),
+                "Parsed and transformed trees come from the arena");
+    TEST_ASSERT(json_arena_bytes_used(arena) > 0, "Arena accounts for its allocations");
+    
+    char* text = cjson_tools_print(filtered, 0);
+    TEST_ASSERT(text && !json_arena_owns(text), "Printed results are heap memory");
+    TEST_ASSERT(expected && text && strcmp(expected, text) == 0, "Arena result matches heap result");
+    free(text);
+    cJSON_Delete(filtered); // No-op for arena nodes
+    
+    // Allocations bigger than a block get a dedicated one
+    size_t long_length = 3 * JSON_ARENA_BLOCK_SIZE;
+    char* long_input = malloc(long_length + 16);
+    long_input[0] = '"';
+    memset(long_input + 1, 'x', long_length);
+    strcpy(long_input + 1 + long_length, "\"");
+    cJSON* long_string = cJSON_Parse(long_input);
+    TEST_ASSERT(long_string && json_arena_owns(long_string->valuestring) &&
+                strlen(long_string->valuestring) == long_length, "Oversized strings are served by the arena");
+    free(long_input);
+    
+    json_arena_leave(previous);
+    TEST_ASSERT(json_arena_current() == NULL, "Leave restores the previous allocator");
+    json_arena_reset(arena);
+    TEST_ASSERT(json_arena_bytes_used(arena) == 0, "Reset releases everything at once");
+    
+#ifndef THREADING_DISABLED
+    // Range jobs run on pool workers allocate from the caller's arena too
+    cJSON* batch = cJSON_CreateArray();
+    for (int i = 0; i < 400; i++) {
+        cJSON* record = cJSON_CreateObject();
+        cJSON* nested = cJSON_AddObjectToObject(record, "nested");
+        cJSON_AddNumberToObject(nested, "index", i);
+        cJSON_AddStringToObject(nested, "label", "value");
+        cJSON_AddItemToArray(batch, record);
+    }
+    ThreadPool* pool = thread_pool_create(4);
+    cJSON* heap_flat = flatten_json_batch_with_pool(batch, pool);
+    char* heap_text = cjson_tools_print(heap_flat, 0);
+    
+    for (int round = 0; round < 3; round++) {
+        previous = json_arena_enter(arena);
+        cJSON* flat = flatten_json_batch_with_pool(batch, pool);
+        int owned = flat != NULL && json_arena_owns(flat);
+        for (cJSON* item = flat ? flat->child : NULL; item; item = item->next) {
+            if (!json_arena_owns(item) || !json_arena_owns(item->child)) owned = 0;
+        }
+        char* flat_text = cjson_tools_print(flat, 0);
+        json_arena_leave(previous);
+        
+        TEST_ASSERT(owned, "Threaded batch results come from the arena");
+        TEST_ASSERT(heap_text && flat_text && strcmp(heap_text, flat_text) == 0,
+                    "Threaded arena batch matches heap batch");
+        free(flat_text);
+        json_arena_reset(arena);
+    }
+    
+    free(heap_text);
+    cJSON_Delete(heap_flat);
+    thread_pool_destroy(pool);
+    cJSON_Delete(batch);
+#endif
+    
+    json_arena_destroy(arena);
+    free(expected);
+    cleanup_global_pools();
+}
+
 void test_string_utilities() {
     TEST_SECTION("String Utility Tests");
     
@@ -313,6 +475,698 @@ void test_json_flattening() {
     
     free(flattened_string);
     free(test_string);
+    
+    // Direct-to-text output must match printing the flattened cJSON tree
+    const char* tricky_json =
+        "{\"s\":\"q\\\"b\\\\n\\n\\t\\u0001\",\"n\":{\"i\":-42,\"d\":3.14159,\"big\":1e300,\"x\":0.1},"
+        "\"a\":[true,false,null,[],{}],\"e\":{}}";
+    json = cJSON_Parse(tricky_json);
+    TEST_ASSERT_NOT_NULL(json, "Escaping/number test JSON parsed");
+    if (json) {
+        flattened = flatten_json_object(json);
+        for (int format = 0; format <= 1; format++) {
+            char* expected = format ? cJSON_Print(flattened) : cJSON_PrintUnformatted(flattened);
+            char* text = flatten_json_object_text(json, format);
+            TEST_ASSERT(expected && text && strcmp(expected, text) == 0,
+                        format ? "Direct-to-text matches cJSON_Print" : "Direct-to-text matches cJSON_PrintUnformatted");
+            free(expected);
+            free(text);
+        }
+        cJSON_Delete(flattened);
+        cJSON_Delete(json);
+    }
+    
+    // Batches, threaded and not, match the tree-based output too
+    char* batch_string = malloc(200 * 160 + 16);
+    if (batch_string) {
+        size_t pos = 0;
+        batch_string[pos++] = '[';
+        for (int i = 0; i < 200; i++) {
+            pos += (size_t)sprintf(batch_string + pos,
+                "%s{\"id\":%d,\"a\":1,\"b\":\"x\",\"c\":{\"d\":[%d,2]},\"e\":null,\"f\":true,\"g\":%d.5}",
+                i ? "," : "", i, i, i);
+        }
+        batch_string[pos++] = ']';
+        batch_string[pos] = '\0';
+        
+        json_array = cJSON_Parse(batch_string);
+        flattened_array = flatten_json_batch(json_array, 0, 0);
+        char* expected = cJSON_Print(flattened_array);
+        char* text = flatten_json_string(batch_string, 0, 0);
+        char* text_mt = flatten_json_string(batch_string, 1, 2);
+        TEST_ASSERT(expected && text && strcmp(expected, text) == 0, "Batch direct-to-text matches cJSON_Print");
+        TEST_ASSERT(text && text_mt && strcmp(text, text_mt) == 0, "Threaded batch text matches single-threaded");
+        
+        char** texts = flatten_json_batch_text(json_array, 1, 2, 0);
+        TEST_ASSERT_NOT_NULL(texts, "Batch flattened to per-record text");
+        if (texts) {
+            char* first = cJSON_PrintUnformatted(cJSON_GetArrayItem(flattened_array, 0));
+            TEST_ASSERT(first && strcmp(first, texts[0]) == 0, "Per-record text matches cJSON_PrintUnformatted");
+            free(first);
+            for (int i = 0; i < 200; i++) free(texts[i]);
+            free(texts);
+        }
+        
+        free(expected);
+        free(text);
+        free(text_mt);
+        cJSON_Delete(flattened_array);
+        cJSON_Delete(json_array);
+        free(batch_string);
+    }
+}
+
+// The printer must keep cJSON's layout and only change how numbers are spelled
+void test_json_printer() {
+    TEST_SECTION("JSON Printer Tests");
+    
+    const char* document =
+        "{\"s\":\"q\\\"b\\\\n\\n\\t\\u0001\\u001f\x7f caf\xC3\xA9\",\"n\":{\"i\":-42,\"d\":3.14159,\"big\":1e300,\"x\":0.1},"
+        "\"a\":[true,false,null,[],{},[{\"deep\":[1,{\"k\":\"v\"}]}]],\"e\":{},\"\":\"\"}";
+    cJSON* json = cJSON_Parse(document);
+    TEST_ASSERT_NOT_NULL(json, "Printer test JSON parsed");
+    cJSON_AddItemToObject(json, "raw", cJSON_CreateRaw("[1, 2]"));
+    for (int format = 0; format <= 1; format++) {
+        char* expected = format ? cJSON_Print(json) : cJSON_PrintUnformatted(json);
+        char* text = cjson_tools_print(json, format);
+        TEST_ASSERT(expected && text && strcmp(expected, text) == 0,
+                    format ? "Formatted output matches cJSON_Print" : "Compact output matches cJSON_PrintUnformatted");
+        
+        size_t length = text ? strlen(text) : 0;
+        char* buffer = malloc(length + 1);
+        TEST_ASSERT(buffer && cjson_tools_print_preallocated(json, buffer, (int)length + 1, format) &&
+                    strcmp(buffer, text) == 0, "Preallocated print fills an exact-size buffer");
+        TEST_ASSERT(buffer && !cjson_tools_print_preallocated(json, buffer, (int)length, format),
+                    "Preallocated print fails when the buffer is one byte short");
+        free(buffer);
+        free(expected);
+        free(text);
+    }
+    cJSON_Delete(json);
+    
+    // Exact digits, in printf %g layout
+    const struct { double value; const char* text; } numbers[] = {
+        {0.1, "0.1"}, {0.30000000000000004, "0.30000000000000004"}, {-42, "-42"}, {-0.0, "0"},
+        {123456789012345.0, "123456789012345"}, {1e15, "1e+15"}, {1e21, "1e+21"}, {2.5, "2.5"},
+        {1e-5, "1e-05"}, {0.0001, "0.0001"}, {5e-324, "5e-324"}, {1.7976931348623157e308, "1.7976931348623157e+308"},
+        {-3.5e-7, "-3.5e-07"}, {2147483648.0, "2147483648"}, {1234567890123456.5, "1234567890123456.5"}
+    };
+    int numbers_ok = 1;
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        cJSON* number = cJSON_CreateNumber(numbers[i].value);
+        char* text = cjson_tools_print(number, 0);
+        if (!text || strcmp(text, numbers[i].text) != 0) {
+            printf("    %s printed as %s\n", numbers[i].text, text ? text : "(null)");
+            numbers_ok = 0;
+        }
+        free(text);
+        cJSON_Delete(number);
+    }
+    TEST_ASSERT(numbers_ok, "Numbers print with exact digits in %g layout");
+    
+    cJSON* not_a_number = cJSON_CreateNumber(NAN);
+    char* nan_text = cjson_tools_print(not_a_number, 0);
+    TEST_ASSERT(nan_text && strcmp(nan_text, "null") == 0, "NaN prints as null like cJSON");
+    free(nan_text);
+    cJSON_Delete(not_a_number);
+    
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    int round_trips = 1;
+    for (int i = 0; i < 100000 && round_trips; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        double value;
+        memcpy(&value, &state, sizeof(value));
+        if (isnan(value) || isinf(value)) continue;
+        
+        cJSON* number = cJSON_CreateNumber(value);
+        char* text = cjson_tools_print(number, 0);
+        if (!text || strtod(text, NULL) != value) round_trips = 0;
+        free(text);
+        cJSON_Delete(number);
+    }
+    TEST_ASSERT(round_trips, "Random doubles read back exactly");
+    
+    // Decimal-range values, where Grisu2 now and then keeps one digit more than
+    // the shortest form: the text must still read back exactly in 17 digits or fewer
+    int decimal_round_trips = 1;
+    for (int i = 0; i < 200000 && decimal_round_trips; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        double value = i == 0 ? -57103.442153131124 : ((double)(state >> 11) / 9007199254740992.0 - 0.5) * 2e5;
+        
+        cJSON* number = cJSON_CreateNumber(value);
+        char* text = cjson_tools_print(number, 0);
+        int digits = 0;
+        for (const char* c = text; c && *c && *c != 'e'; c++) {
+            if (*c >= '0' && *c <= '9' && (digits > 0 || *c != '0')) digits++;
+        }
+        if (!text || strtod(text, NULL) != value || digits > 17) decimal_round_trips = 0;
+        free(text);
+        cJSON_Delete(number);
+    }
+    TEST_ASSERT(decimal_round_trips, "Decimal-range doubles read back exactly in at most 17 digits");
+    
+    cJSON invalid;
+    memset(&invalid, 0, sizeof(invalid));
+    TEST_ASSERT_NULL(cjson_tools_print(&invalid, 0), "Invalid item is not printed, like cJSON");
+}
+
+void test_flatten_shape_cache() {
+    TEST_SECTION("Flatten Shape Cache Tests");
+    
+    // Two alternating shapes, values that differ per record, and some one-offs
+    cJSON* batch = cJSON_CreateArray();
+    for (int i = 0; i < 300; i++) {
+        char text[256];
+        if (i % 50 == 49) {
+            snprintf(text, sizeof(text), "{\"odd%d\":{\"k\":[%d]},\"\":{\"\":1}}", i, i);
+        } else if (i % 2) {
+            snprintf(text, sizeof(text), "{\"id\":%d,\"user\":{\"name\":\"u%d\",\"tags\":[\"a\",%d]},\"ok\":true}", i, i, i);
+        } else {
+            snprintf(text, sizeof(text), "{\"id\":%d.5,\"user\":{\"name\":null,\"tags\":[{},[]]},\"ok\":false}", i);
+        }
+        cJSON_AddItemToArray(batch, cJSON_Parse(text));
+    }
+    
+    char** expected = calloc(300, sizeof(char*));
+    int index = 0;
+    for (cJSON* item = batch->child; item; item = item->next) {
+        cJSON* flat = flatten_json_object(item);
+        expected[index++] = cJSON_PrintUnformatted(flat);
+        cJSON_Delete(flat);
+    }
+    
+    FlattenShapeCache* cache = flatten_shape_cache_create(0);
+    TEST_ASSERT_NOT_NULL(cache, "Shape cache created");
+    
+#ifndef THREADING_DISABLED
+    ThreadPool* pool = thread_pool_create(4);
+#else
+    ThreadPool* pool = NULL;
+#endif
+    for (int round = 0; round < 2; round++) {
+        cJSON* results[3] = {
+            flatten_json_batch(batch, 0, 0),
+            flatten_json_batch_with_cache(batch, NULL, cache),
+            flatten_json_batch_with_cache(batch, pool, cache)
+        };
+        for (int r = 0; r < 3; r++) {
+            int matches = results[r] && cJSON_GetArraySize(results[r]) == 300;
+            index = 0;
+            for (cJSON* item = results[r] ? results[r]->child : NULL; item; item = item->next) {
+                char* text = cJSON_PrintUnformatted(item);
+                if (!text || strcmp(text, expected[index++]) != 0) matches = 0;
+                free(text);
+            }
+            TEST_ASSERT(matches, r == 0 ? "Per-batch shape cache matches uncached flattening" :
+                                 "Persistent shape cache matches uncached flattening");
+        }
+        cJSON* second = cJSON_GetArrayItem(results[1], 1);
+        TEST_ASSERT(second && second->child && (second->child->type & cJSON_StringIsConst),
+                    "Cached shapes link their keys instead of copying them");
+        for (int r = 0; r < 3; r++) cJSON_Delete(results[r]);
+        TEST_ASSERT_EQUAL(8, flatten_shape_cache_count(cache), "One cached shape per distinct structure");
+    }
+    
+    // A full cache still flattens every record correctly
+    FlattenShapeCache* tiny = flatten_shape_cache_create(1);
+    cJSON* limited = flatten_json_batch_with_cache(batch, NULL, tiny);
+    char* limited_text = cJSON_PrintUnformatted(cJSON_GetArrayItem(limited, 49));
+    TEST_ASSERT(limited_text && strcmp(limited_text, expected[49]) == 0, "Shapes beyond the cache limit are flattened uncached");
+    TEST_ASSERT_EQUAL(1, flatten_shape_cache_count(tiny), "Cache stops at its shape limit");
+    free(limited_text);
+    cJSON_Delete(limited);
+    flatten_shape_cache_free(tiny);
+    
+#ifndef THREADING_DISABLED
+    thread_pool_destroy(pool);
+#endif
+    flatten_shape_cache_free(cache);
+    for (int i = 0; i < 300; i++) free(expected[i]);
+    free(expected);
+    cJSON_Delete(batch);
+}
+
+// Unflattens the flattened text and compares it with the expected JSON text
+static int unflattens_to(const char* flat, const char* expected) {
+    cJSON* json = cJSON_Parse(flat);
+    cJSON* nested = unflatten_json_object(json);
+    char* text = nested ? cJSON_PrintUnformatted(nested) : NULL;
+    int matches = text && strcmp(text, expected) == 0;
+    if (!matches) printf("    got %s, expected %s\n", text ? text : "NULL", expected);
+    free(text);
+    cJSON_Delete(nested);
+    cJSON_Delete(json);
+    return matches;
+}
+
+void test_unflatten() {
+    TEST_SECTION("Unflatten Tests");
+    
+    // Flattened documents without empty containers come back unchanged
+    const char* documents[] = {
+        "{\"id\":1,\"user\":{\"name\":\"a\",\"tags\":[\"x\",{\"k\":[1,[2,3]]}]},\"ok\":true}",
+        "[[1,{\"a\":null}],\"s\",{\"b\":{\"c\":2.5}}]",
+        "{\"a\":{\"b\":{\"c\":{\"d\":1}},\"e\":2},\"a2\":{\"b\":3}}",
+        "\"scalar\"",
+        "42"
+    };
+    int round_trips = 1;
+    for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); i++) {
+        cJSON* json = cJSON_Parse(documents[i]);
+        cJSON* flat = flatten_json_object(json);
+        char* flat_text = flat ? cJSON_PrintUnformatted(flat) : NULL;
+        if (!flat_text || !unflattens_to(flat_text, documents[i])) round_trips = 0;
+        free(flat_text);
+        cJSON_Delete(flat);
+        cJSON_Delete(json);
+    }
+    TEST_ASSERT(round_trips, "Flattened documents unflatten to the originals");
+    
+    TEST_ASSERT(unflattens_to("{\"a[3]\":1,\"a[1]\":2}", "{\"a\":[null,2,null,1]}"),
+                "Array holes become null and elements go by index");
+    TEST_ASSERT(unflattens_to("{\"a\":1,\"a.b\":2,\"c.d\":3,\"c\":4,\"e[0]\":5,\"e.f\":6}",
+                              "{\"a\":1,\"c\":{\"d\":3},\"e\":[5]}"),
+                "Contradicting keys keep the first");
+    TEST_ASSERT(unflattens_to("{\"x.y\":1,\"x.y\":2}", "{\"x\":{\"y\":1}}"), "Duplicate paths keep the first value");
+    TEST_ASSERT(unflattens_to("{\"a.\":1,\"b.[0]\":2,\"c[99999999]\":3,\"d[0]x\":4}",
+                              "{\"a\":{\"\":1},\"b\":{\"[0]\":2},\"c[99999999]\":3,\"d\":[{\"x\":4}]}"),
+                "Empty names, bracketed names and oversized indexes");
+    TEST_ASSERT(unflattens_to("{}", "{}"), "Empty object stays empty");
+    TEST_ASSERT(unflattens_to("[1]", "[1]"), "Non-objects are copied");
+    
+    char deep[4 * CJSON_NESTING_LIMIT + 16];
+    size_t length = 0;
+    deep[length++] = '{';
+    deep[length++] = '"';
+    for (int i = 0; i <= CJSON_NESTING_LIMIT; i++) {
+        deep[length++] = 'k';
+        deep[length++] = '.';
+    }
+    memcpy(deep + length, "k\":1,\"ok\":2}", 13);
+    TEST_ASSERT(unflattens_to(deep, "{\"ok\":2}"), "Keys nested beyond the limit are dropped");
+    
+    // Batches match record-by-record results with and without a pool
+    cJSON* batch = cJSON_CreateArray();
+    for (int i = 0; i < 2000; i++) {
+        char text[256];
+        snprintf(text, sizeof(text),
+                 "{\"id\":%d,\"user.name\":\"u%d\",\"user.tags[%d]\":%d,\"user.tags[0]\":true,\"m[0][1].v\":null}",
+                 i, i, i % 5, i);
+        cJSON_AddItemToArray(batch, cJSON_Parse(text));
+    }
+    
+#ifndef THREADING_DISABLED
+    ThreadPool* pool = thread_pool_create(4);
+#else
+    ThreadPool* pool = NULL;
+#endif
+    cJSON* results[3] = {
+        unflatten_json_batch(batch, 0, 0),
+        unflatten_json_batch(batch, 1, 4),
+        unflatten_json_batch_with_pool(batch, pool)
+    };
+    for (int r = 0; r < 3; r++) {
+        int matches = results[r] && cJSON_GetArraySize(results[r]) == 2000;
+        const cJSON* record = batch->child;
+        for (const cJSON* item = results[r] ? results[r]->child : NULL; item && record; item = item->next) {
+            cJSON* single = unflatten_json_object(record);
+            if (!cJSON_Compare(item, single, 1)) matches = 0;
+            cJSON_Delete(single);
+            record = record->next;
+        }
+        TEST_ASSERT(matches, r == 0 ? "Sequential batch matches single records" :
+                             r == 1 ? "Threaded batch matches single records" :
+                                      "Batch on a caller's pool matches single records");
+        cJSON_Delete(results[r]);
+    }
+    
+    char* text = unflatten_json_string("[{\"a.b\":1},{\"[1]\":2}]", 1, 2, 0);
+    TEST_ASSERT(text && strcmp(text, "[{\"a\":{\"b\":1}},[null,2]]") == 0, "String API unflattens arrays as batches");
+    free(text);
+    
+#ifndef THREADING_DISABLED
+    thread_pool_destroy(pool);
+#endif
+    cJSON_Delete(batch);
+}
+
+void test_path_projection() {
+    TEST_SECTION("Path Projection Tests");
+    
+    const char* text = "{\"id\":7,\"user\":{\"id\":1,\"name\":\"a\\\"b\\\\\",\"tags\":[1,2]},"
+                       "\"items\":[{\"sku\":\"x\",\"q\":1},{\"sku\":\"y\",\"q\":2},{\"q\":3}],\"na.me\":true,"
+                       "\"big\":{\"deep\":[1,{\"z\":\"}]\\\"\"}],\"n\":null},\"k\\u0065y\":\"v\"}";
+    const char* expected = "{\"user.id\":1,\"items[0].sku\":\"x\",\"items[1].sku\":\"y\",\"items[1].q\":2,"
+                           "\"na.me\":true,\"big.deep[1].z\":\"}]\\\"\",\"key\":\"v\"}";
+    
+    JsonPathSet* paths = json_path_set_compile("user.id, items[*].sku,items[1].q,big.deep[1],na\\.me,key");
+    TEST_ASSERT_NOT_NULL(paths, "Path set compiled");
+    TEST_ASSERT_EQUAL(6, json_path_set_count(paths), "Every path in the list is counted");
+    
+    cJSON* json = cJSON_Parse(text);
+    cJSON* projected = flatten_json_object_paths(json, paths);
+    char* projected_text = cJSON_PrintUnformatted(projected);
+    TEST_ASSERT(projected_text && strcmp(projected_text, expected) == 0, "Projected flatten keeps only selected keys");
+    
+    // The lazy parse builds the same projection that extraction copies out of the full tree
+    cJSON* lazy = json_parse_paths(text, strlen(text), paths, 0);
+    cJSON* extracted = extract_json_paths(json, paths, 0);
+    char* lazy_text = cJSON_PrintUnformatted(lazy);
+    char* extracted_text = cJSON_PrintUnformatted(extracted);
+    TEST_ASSERT(lazy_text && extracted_text && strcmp(lazy_text, extracted_text) == 0,
+                "Lazy parse matches extraction from the full tree");
+    cJSON* lazy_flat = flatten_json_object(lazy);
+    char* lazy_flat_text = cJSON_PrintUnformatted(lazy_flat);
+    TEST_ASSERT(lazy_flat_text && strcmp(lazy_flat_text, expected) == 0, "Flattening the lazy parse matches projected flatten");
+    
+    free(projected_text);
+    free(lazy_text);
+    free(extracted_text);
+    free(lazy_flat_text);
+    cJSON_Delete(projected);
+    cJSON_Delete(lazy);
+    cJSON_Delete(extracted);
+    cJSON_Delete(lazy_flat);
+    cJSON_Delete(json);
+    
+    // Records of a root array are projected one by one and stay aligned
+    const char* records = " [{\"user\":{\"id\":1},\"x\":[{}]}, 5, {\"key\":\"b\"}] ";
+    char* flattened = flatten_json_string_paths(records, paths, 0, 0, 0);
+    TEST_ASSERT(flattened && strcmp(flattened, "[{\"user.id\":1},{},{\"key\":\"b\"}]") == 0, "Paths apply to each record");
+    free(flattened);
+    
+    // Selected values are still validated, skipped ones only need balanced nesting
+    TEST_ASSERT_NULL(json_parse_paths("{\"key\":tru}", 11, paths, 0), "Invalid selected value rejected");
+    TEST_ASSERT_NULL(json_parse_paths("{\"skip\":[1,2}", 13, paths, 0), "Unterminated skipped value rejected");
+    TEST_ASSERT_NULL(json_parse_paths("{\"key\":1} x", 11, paths, 0), "Trailing content rejected");
+    json_path_set_free(paths);
+    
+    const char* invalid[] = {"", "a..b", "a.", "a[", "a[x]", "a[0]b", "a.[0]", "x,,y"};
+    int rejected = 1;
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        JsonPathSet* bad = json_path_set_compile(invalid[i]);
+        if (bad) rejected = 0;
+        json_path_set_free(bad);
+    }
+    TEST_ASSERT(rejected, "Malformed path lists rejected");
+}
+
+// Parses with both front ends; they must agree on the tree and, on success, on parse_end
+static int structural_matches_cjson(const char* text, size_t length, int require_null_terminated) {
+    const char* expected_end = NULL;
+    const char* actual_end = NULL;
+    cJSON* expected = cJSON_ParseWithLengthOpts(text, length, &expected_end, require_null_terminated);
+    cJSON* actual = json_parse_structural(text, length, &actual_end,
+                                          require_null_terminated ? JSON_PARSE_REQUIRE_NULL_TERMINATED : 0);
+    
+    int same = (expected == NULL) == (actual == NULL);
+    if (same && expected) {
+        char* expected_text = cJSON_PrintUnformatted(expected);
+        char* actual_text = cJSON_PrintUnformatted(actual);
+        same = expected_end == actual_end && expected_text && actual_text &&
+               strcmp(expected_text, actual_text) == 0 && cJSON_Compare(expected, actual, 1);
+        free(expected_text);
+        free(actual_text);
+    }
+    cJSON_Delete(expected);
+    cJSON_Delete(actual);
+    return same;
+}
+
+void test_structural_parser() {
+    TEST_SECTION("Structural Index Parser Tests");
+    
+    const char* documents[] = {
+        "{\"a\":1,\"b\":[true,false,null],\"c\":{\"d\":-1.5e3,\"e\":\"x\\\"y\\\\\"}}",
+        "  [1, 2.5, -0, 1e300, 12345678901234567890, 0123, \"\\u00e9\\ud83d\\ude00\\/\\b\\f\\n\\r\\t\"] ",
+        "\xEF\xBB\xBF{\"bom\":true}",
+        "{\"k\\u0065y\":\"}]\\\\\\\"[{\",\"raw\":\"caf\xC3\xA9\",\"\":\"\"}",
+        "\"just a string\"",
+        "nullx",
+        "[1,2] trailing",
+        "{\"a\":1,}",
+        "[1,,2]",
+        "{\"a\" 1}",
+        "\"unterminated",
+        "\"bad \\q escape\"",
+        "\"lone \\udc00 surrogate\"",
+        "[tru]",
+        "",
+        "   "
+    };
+    int all_match = 1;
+    for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); i++) {
+        size_t length = strlen(documents[i]);
+        // With and without the NUL, and with cJSON's require_null_terminated
+        if (!structural_matches_cjson(documents[i], length, 0) ||
+            !structural_matches_cjson(documents[i], length + 1, 0) ||
+            !structural_matches_cjson(documents[i], length, 1) ||
+            !structural_matches_cjson(documents[i], length + 1, 1)) {
+            printf("    mismatch on document %zu\n", i);
+            all_match = 0;
+        }
+    }
+    TEST_ASSERT(all_match, "Structural parser agrees with cJSON on valid and invalid input");
+    
+    // Strings and escape runs that straddle 64-byte blocks and index refills
+    size_t capacity = 1 << 20;
+    char* large = malloc(capacity);
+    size_t length = 0;
+    length += (size_t)sprintf(large + length, "[");
+    for (int i = 0; i < 6000; i++) {
+        length += (size_t)sprintf(large + length, "%s{\"id\":%d,\"s\":\"%.*s\\\\\\\"\",\"v\":[%d.25,\"\\u00e9\"]}",
+                                  i ? "," : "", i, i % 70, "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", i);
+    }
+    length += (size_t)sprintf(large + length, "]");
+    TEST_ASSERT(structural_matches_cjson(large, length, 0), "Large document parses identically");
+    free(large);
+    
+    // Both parsers stop at the same nesting depth
+    char deep[2 * 1001 + 1];
+    memset(deep, '[', 1001);
+    memset(deep + 1001, ']', 1001);
+    deep[2002] = '\0';
+    TEST_ASSERT(structural_matches_cjson(deep, 2000, 0), "Nesting up to the limit accepted");
+    TEST_ASSERT(structural_matches_cjson(deep, 2002, 0), "Nesting past the limit rejected");
+    
+    const char* invalid_utf8 = "{\"s\":\"\xC0\xAF\"}";
+    cJSON* lenient = json_parse_structural(invalid_utf8, strlen(invalid_utf8), NULL, 0);
+    TEST_ASSERT_NOT_NULL(lenient, "Invalid UTF-8 accepted by default like cJSON");
+    cJSON_Delete(lenient);
+    TEST_ASSERT_NULL(json_parse_structural(invalid_utf8, strlen(invalid_utf8), NULL, JSON_PARSE_VALIDATE_UTF8),
+                     "Invalid UTF-8 rejected when validation is requested");
+    const char* valid_utf8 = "{\"s\":\"caf\xC3\xA9 \xF0\x9F\x98\x80\"}";
+    cJSON* validated = json_parse_structural(valid_utf8, strlen(valid_utf8), NULL, JSON_PARSE_VALIDATE_UTF8);
+    TEST_ASSERT_NOT_NULL(validated, "Valid UTF-8 passes validation");
+    cJSON_Delete(validated);
+    cJSON* terminated = json_parse_structural_string(valid_utf8);
+    TEST_ASSERT_NOT_NULL(terminated, "Null-terminated convenience parse");
+    cJSON_Delete(terminated);
+}
+
+// Every kernel set must give the same answers as the portable one
+void test_simd_dispatch() {
+    TEST_SECTION("SIMD Dispatch Tests");
+    
+    const char* original = cjson_tools_simd_level();
+    printf("Active SIMD level: %s\n", original);
+    TEST_ASSERT_EQUAL(-1, cjson_tools_set_simd_level("mmx"), "Unknown SIMD level rejected");
+    TEST_ASSERT_STRING_EQUAL(original, cjson_tools_simd_level(), "Rejected level leaves dispatch unchanged");
+    
+    // Whitespace and delimiters at every position across a 64-byte block
+    char text[256];
+    for (size_t i = 0; i < sizeof(text) - 1; i++) {
+        text[i] = " \t\n\r"[i % 4];
+    }
+    text[sizeof(text) - 1] = '\0';
+    size_t huge_length = 3 * 1024 * 1024 + 17;
+    char* huge = malloc(huge_length + 1);
+    memset(huge, 'x', huge_length);
+    huge[huge_length] = '\0';
+    const char* document = "{\"a\":[1,2,{\"b\":\"x\\\\\\\"]}\",\"c\":null}],\"d\":\"caf\xC3\xA9\",\"e\":-1.5e3,\"f\":[true,false]}";
+    
+    const char* levels[] = {"scalar", "sse2", "neon", "avx2", "avx512"};
+    int tested = 0;
+    int all_match = 1;
+    for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        if (cjson_tools_set_simd_level(levels[l]) != 0) continue;
+        tested++;
+        
+        for (size_t offset = 0; offset < 70; offset++) {
+            if (strlen_simd(text + offset) != strlen(text + offset)) all_match = 0;
+        }
+        if (strlen_simd(huge + 3) != huge_length - 3) all_match = 0;
+        
+        for (size_t stop = 0; stop < 200; stop += 7) {
+            char saved = text[stop];
+            text[stop] = 'v';
+            for (size_t offset = 0; offset <= stop && offset < 40; offset += 3) {
+                size_t len = sizeof(text) - 1 - offset;
+                if (skip_whitespace_optimized(text + offset, len) != text + stop) all_match = 0;
+            }
+            text[stop] = saved;
+        }
+        if (skip_whitespace_optimized(text, sizeof(text) - 1) != text + sizeof(text) - 1) all_match = 0;
+        
+        const char* delimiters = "\",:{}[]";
+        for (size_t d = 0; d < 7; d++) {
+            for (size_t position = 0; position < 150; position += 11) {
+                huge[position] = delimiters[d];
+                if (find_delimiter_optimized(huge, 200) != huge + position) all_match = 0;
+                huge[position] = 'x';
+            }
+        }
+        // Characters one case bit off the braces are not delimiters
+        huge[5] = ';';
+        huge[6] = 'K';
+        huge[7] = 'M';
+        if (find_delimiter_optimized(huge, 100) != huge + 100) all_match = 0;
+        memset(huge + 5, 'x', 3);
+        
+        if (!structural_matches_cjson(document, strlen(document), 0)) all_match = 0;
+        
+        // Strings that end right at a page boundary, with escapes anywhere in them
+        char* page = (char*)(((uintptr_t)huge + 8191) & ~(uintptr_t)4095);
+        for (size_t length = 0; length < 80; length++) {
+            char* str = page - 1 - length;
+            for (size_t escape = 0; escape <= length; escape += 5) {
+                memset(str, 'x', length);
+                str[length] = '\0';
+                if (escape < length) str[escape] = escape % 2 ? '"' : '\n';
+                cJSON* item = cJSON_CreateStringReference(str);
+                char* expected = cJSON_PrintUnformatted(item);
+                char* text = cjson_tools_print(item, 0);
+                if (!expected || !text || strcmp(expected, text) != 0) all_match = 0;
+                free(expected);
+                free(text);
+                cJSON_Delete(item);
+            }
+        }
+        memset(page - 100, 'x', 100);
+        if (!all_match) {
+            printf("    mismatch at SIMD level %s\n", levels[l]);
+            break;
+        }
+    }
+    free(huge);
+    
+    TEST_ASSERT(tested >= 1, "Portable SIMD level always available");
+    TEST_ASSERT(all_match, "All SIMD levels agree with the scalar kernels");
+    TEST_ASSERT_EQUAL(0, cjson_tools_set_simd_level("auto"), "Automatic SIMD level restored");
+    TEST_ASSERT_STRING_EQUAL(original, cjson_tools_simd_level(), "Automatic level matches the one chosen at load");
+}
+
+// The parallel parse must accept exactly what cJSON accepts for the whole array
+static int parallel_parse_matches_cjson(const char* text, ThreadPool* pool) {
+    cJSON* expected = cJSON_ParseWithLength(text, strlen(text));
+    JsonArrayView records;
+    int status = json_parse_array_parallel(text, strlen(text), pool, &records);
+    
+    int same;
+    if (!expected || !cJSON_IsArray(expected)) {
+        same = status != 0;
+    } else {
+        char* expected_text = cJSON_PrintUnformatted(expected);
+        char* actual_text = status == 0 ? json_array_view_print(&records, 0) : NULL;
+        same = expected_text && actual_text && strcmp(expected_text, actual_text) == 0;
+        free(expected_text);
+        free(actual_text);
+    }
+    if (status == 0) json_array_view_delete(&records);
+    cJSON_Delete(expected);
+    return same;
+}
+
+static cJSON* drop_odd_ids(const cJSON* record, void* user_data) {
+    (void)user_data;
+    const cJSON* id = cJSON_GetObjectItemCaseSensitive(record, "id");
+    if (cJSON_IsNumber(id) && id->valueint % 2) return NULL;
+    return cJSON_Duplicate(record, 1);
+}
+
+void test_parallel_array_parse() {
+    TEST_SECTION("Parallel Array Parsing Tests");
+    
+    const char* text = " [ {\"a\":\"x,]\\\"\"}, [1,[2]] ,3,\"s\" ] trailing";
+    JsonSpan* spans = NULL;
+    int count = 0;
+    TEST_ASSERT_EQUAL(0, json_split_array(text, strlen(text), &spans, &count), "Top-level array split");
+    TEST_ASSERT_EQUAL(4, count, "Commas inside strings and nested arrays do not split");
+    TEST_ASSERT(count == 4 && strncmp(text + spans[1].offset, " [1,[2]] ", spans[1].length) == 0,
+                "Span covers one element");
+    free(spans);
+    
+    TEST_ASSERT_EQUAL(0, json_split_array("[ ]", 3, &spans, &count), "Empty array split");
+    TEST_ASSERT_EQUAL(0, count, "Empty array has no elements");
+    TEST_ASSERT_EQUAL(-1, json_split_array("{\"a\":1}", 7, &spans, &count), "Objects are not split");
+    TEST_ASSERT_EQUAL(-1, json_split_array("[1,2", 4, &spans, &count), "Unterminated array rejected");
+    
+    ThreadPool* pool = thread_pool_create(4);
+    const char* documents[] = {
+        "[]", "[ 1 , true,null ,\"\\u00e9\" ]", "[{\"a\":[1,{\"b\":2}]},{},[]]",
+        "[1,]", "[,1]", "[1 2]", "[1}", "[{]}", "[[1}, 2]", "[\"a\\\"]", "[tru]", "[1] x"
+    };
+    int all_match = 1;
+    for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); i++) {
+        if (!parallel_parse_matches_cjson(documents[i], pool)) {
+            printf("    mismatch on document %zu\n", i);
+            all_match = 0;
+        }
+    }
+    TEST_ASSERT(all_match, "Parallel parse agrees with cJSON on valid and invalid arrays");
+    
+    // Element depth counts the enclosing array, as in one parse of the whole document
+    char deep[2 * 1000 + 1];
+    memset(deep, '[', 1000);
+    memset(deep + 1000, ']', 1000);
+    deep[2000] = '\0';
+    TEST_ASSERT(parallel_parse_matches_cjson(deep, pool), "Nesting limit matches cJSON");
+    deep[999] = ' ';
+    deep[1000] = ' ';
+    TEST_ASSERT(parallel_parse_matches_cjson(deep, pool), "Nesting one below the limit matches cJSON");
+    
+    // Records feed the batch operations without an array node
+    size_t capacity = 1 << 20;
+    char* batch = malloc(capacity);
+    size_t length = (size_t)sprintf(batch, "[");
+    for (int i = 0; i < 2000; i++) {
+        length += (size_t)sprintf(batch + length, "%s{\"id\":%d,\"user\":{\"name\":\"u%d\",\"tags\":[%d,null]}}",
+                                  i ? "," : "", i, i, i);
+    }
+    sprintf(batch + length, "]");
+    
+    cJSON* whole = cJSON_Parse(batch);
+    JsonArrayView records;
+    TEST_ASSERT_EQUAL(0, json_parse_array_parallel(batch, strlen(batch), pool, &records), "Large batch parsed");
+    TEST_ASSERT_EQUAL(2000, records.count, "Every element parsed");
+    
+    char* expected_flat = flatten_parsed_json_text(whole, 0, 0, 0);
+    char* actual_flat = flatten_json_view_text(&records, pool, 0);
+    TEST_ASSERT(expected_flat && actual_flat && strcmp(expected_flat, actual_flat) == 0,
+                "Flattened records match flattening the parsed array");
+    
+    cJSON* expected_schema = generate_schema_from_batch(whole, 0, 0);
+    cJSON* actual_schema = generate_schema_from_view(&records, pool);
+    TEST_ASSERT(cJSON_Compare(expected_schema, actual_schema, 1), "Schema of records matches schema of the array");
+    
+    JsonArrayView even;
+    TEST_ASSERT_EQUAL(0, json_array_view_transform(&records, pool, drop_odd_ids, NULL, &even), "Records transformed");
+    TEST_ASSERT(even.count == 1000 && cJSON_GetObjectItem(even.items[1], "id")->valueint == 2,
+                "Dropped records are left out in order");
+    
+    json_array_view_delete(&even);
+    free(expected_flat);
+    free(actual_flat);
+    cJSON_Delete(expected_schema);
+    cJSON_Delete(actual_schema);
+    json_array_view_delete(&records);
+    cJSON_Delete(whole);
+    free(batch);
+    thread_pool_destroy(pool);
 }
 
 void test_json_schema_generation() {
@@ -395,6 +1249,65 @@ void test_json_schema_generation() {
     cJSON_Delete(json_array);
     free(array_json);
     
+    // Optional nested objects merge the same way however the batch is split
+    cJSON* records = cJSON_CreateArray();
+    for (int i = 0; i < 300; i++) {
+        cJSON* record = cJSON_CreateObject();
+        cJSON_AddNumberToObject(record, "id", i);
+        cJSON_AddNumberToObject(record, "score", i % 2 ? i + 0.5 : i);
+        if (i % 3 == 0) {
+            cJSON* meta = cJSON_AddObjectToObject(record, "meta");
+            cJSON_AddStringToObject(meta, i % 2 ? "odd" : "even", "x");
+        }
+        cJSON_AddItemToArray(records, record);
+    }
+    
+    cJSON* folded = generate_schema_from_batch(records, 0, 0);
+    cJSON* reduced = generate_schema_from_batch(records, 1, 3);
+    TEST_ASSERT(cJSON_Compare(folded, reduced, 1), "Tree-reduced schema matches sequential fold");
+    
+    cJSON* props = cJSON_GetObjectItem(folded, "properties");
+    cJSON* score_type = cJSON_GetObjectItem(cJSON_GetObjectItem(props, "score"), "type");
+    TEST_ASSERT(cJSON_IsString(score_type) && strcmp(score_type->valuestring, "number") == 0,
+                "Integer and float values merge to number");
+    cJSON* meta_props = cJSON_GetObjectItem(cJSON_GetObjectItem(props, "meta"), "properties");
+    TEST_ASSERT(cJSON_GetObjectItem(meta_props, "odd") && cJSON_GetObjectItem(meta_props, "even"),
+                "Optional nested object keeps properties from every record");
+    
+    int meta_required = 0;
+    cJSON* name = NULL;
+    cJSON_ArrayForEach(name, cJSON_GetObjectItem(folded, "required")) {
+        if (strcmp(name->valuestring, "meta") == 0) meta_required = 1;
+    }
+    TEST_ASSERT(!meta_required, "Property missing from some records is not required");
+    
+    cJSON_Delete(folded);
+    cJSON_Delete(reduced);
+    cJSON_Delete(records);
+    
+    // Wide objects: record i lacks key i, so only keys past the batch stay required
+    cJSON* wide = cJSON_CreateArray();
+    for (int i = 0; i < 200; i++) {
+        cJSON* record = cJSON_CreateObject();
+        for (int k = 0; k < 2000; k++) {
+            if (k == i) continue;
+            char key[16];
+            snprintf(key, sizeof(key), "k%d", k);
+            cJSON_AddNumberToObject(record, key, k);
+        }
+        cJSON_AddItemToArray(wide, record);
+    }
+    
+    TIME_START();
+    cJSON* wide_schema = generate_schema_from_batch(wide, 0, 0);
+    TIME_END("Wide object schema merge (2000 keys x 200 records)");
+    TEST_ASSERT_EQUAL(2000, cJSON_GetArraySize(cJSON_GetObjectItem(wide_schema, "properties")),
+                      "Wide schema has every property");
+    TEST_ASSERT_EQUAL(1800, cJSON_GetArraySize(cJSON_GetObjectItem(wide_schema, "required")),
+                      "Wide schema marks only keys present everywhere as required");
+    cJSON_Delete(wide_schema);
+    cJSON_Delete(wide);
+    
     // Test string interface
     char* test_string = create_test_object_json();
     TIME_START();
@@ -413,6 +1326,89 @@ void test_json_schema_generation() {
     
     free(schema_string);
     free(test_string);
+    
+    // Long arrays are sampled at both ends, so a differing last item is seen
+    cJSON* long_array = cJSON_CreateArray();
+    for (int i = 0; i < 100000; i++) {
+        cJSON_AddItemToArray(long_array, cJSON_CreateNumber(i));
+    }
+    cJSON_AddItemToArray(long_array, cJSON_CreateString("tail"));
+    cJSON* long_schema = generate_schema_from_object(long_array);
+    cJSON* long_items = long_schema ? cJSON_GetObjectItem(cJSON_GetObjectItem(long_schema, "items"), "type") : NULL;
+    TEST_ASSERT(cJSON_IsArray(long_items), "Sampling a long array reaches its last item");
+    cJSON_Delete(long_schema);
+    
+    cJSON* short_array = cJSON_CreateIntArray((const int[]){1, 2, 3}, 3);
+    cJSON* short_schema = generate_schema_from_object(short_array);
+    cJSON* short_items = short_schema ? cJSON_GetObjectItem(cJSON_GetObjectItem(short_schema, "items"), "type") : NULL;
+    TEST_ASSERT_STRING_EQUAL("integer", cJSON_GetStringValue(short_items), "Short arrays are sampled whole");
+    cJSON_Delete(short_schema);
+    cJSON_Delete(short_array);
+    cJSON_Delete(long_array);
+}
+
+void test_schema_builder() {
+    TEST_SECTION("Incremental Schema Builder Tests");
+    
+    char* large_json = create_large_test_json(300);
+    cJSON* all = cJSON_Parse(large_json);
+    TEST_ASSERT_NOT_NULL(all, "Builder test batch parsed");
+    
+    // Split the batch into an "old" and a "new" half
+    cJSON* first = cJSON_CreateArray();
+    cJSON* second = cJSON_CreateArray();
+    int index = 0;
+    cJSON* record = NULL;
+    cJSON_ArrayForEach(record, all) {
+        cJSON_AddItemToArray(index++ < 120 ? first : second, cJSON_Duplicate(record, 1));
+    }
+    cJSON* expected = generate_schema_from_batch(all, 0, 0);
+    
+    SchemaBuilder* builder = schema_builder_create();
+    TEST_ASSERT_NOT_NULL(builder, "Schema builder created");
+    cJSON* empty = schema_builder_to_json(builder);
+    TEST_ASSERT(empty && cJSON_GetArraySize(empty) == 0, "Empty builder renders an empty schema");
+    cJSON_Delete(empty);
+    
+    TEST_ASSERT_EQUAL(0, schema_builder_add_batch(builder, first, 0, 0), "First batch added");
+    
+    // Persist, restore and continue with only the new records
+    char* state = schema_builder_serialize(builder);
+    TEST_ASSERT_NOT_NULL(state, "Builder state serialized");
+    SchemaBuilder* restored = schema_builder_deserialize(state);
+    TEST_ASSERT_NOT_NULL(restored, "Builder state deserialized");
+    TEST_ASSERT_EQUAL(120, schema_builder_record_count(restored), "Restored builder keeps its record count");
+    
+    cJSON_ArrayForEach(record, second) {
+        schema_builder_add(restored, record);
+    }
+    cJSON* incremental = schema_builder_to_json(restored);
+    TEST_ASSERT(cJSON_Compare(expected, incremental, 1), "Incremental schema matches full re-run");
+    TEST_ASSERT_EQUAL(300, schema_builder_record_count(restored), "Record count covers both batches");
+    
+    // Partial builders from separate workers combine to the same schema
+    SchemaBuilder* partial = schema_builder_create();
+    schema_builder_add_batch(partial, second, 1, 2);
+    TEST_ASSERT_EQUAL(0, schema_builder_merge(builder, partial), "Builders merged");
+    cJSON* merged = schema_builder_to_json(builder);
+    TEST_ASSERT(cJSON_Compare(expected, merged, 1), "Merged builders match full re-run");
+    TEST_ASSERT_EQUAL(180, schema_builder_record_count(partial), "Merge leaves the other builder intact");
+    
+    TEST_ASSERT_NULL(schema_builder_deserialize("{\"format\": \"other\"}"), "Foreign state rejected");
+    TEST_ASSERT_NULL(schema_builder_deserialize("not json"), "Malformed state rejected");
+    TEST_ASSERT(schema_builder_add_batch(builder, all->child, 0, 0) != 0, "Non-array batch rejected");
+    
+    cJSON_Delete(merged);
+    cJSON_Delete(incremental);
+    cJSON_Delete(expected);
+    free(state);
+    schema_builder_free(partial);
+    schema_builder_free(restored);
+    schema_builder_free(builder);
+    cJSON_Delete(first);
+    cJSON_Delete(second);
+    cJSON_Delete(all);
+    free(large_json);
 }
 
 void test_path_extraction() {
@@ -560,6 +1556,1096 @@ void test_json_utilities() {
 #else
     printf(ANSI_COLOR_YELLOW "ℹ  Regex tests skipped on Windows platform" ANSI_COLOR_RESET "\n");
 #endif
+
+    // Compiled patterns: literal fast paths work on every platform
+    CompiledPattern* prefix = cjson_tools_pattern_compile("^old_");
+    CompiledPattern* suffix = cjson_tools_pattern_compile("_name$");
+    CompiledPattern* exact = cjson_tools_pattern_compile("^new_name$");
+    CompiledPattern* escaped = cjson_tools_pattern_compile("^session\\.page\\..*$");
+    CompiledPattern* contains = cjson_tools_pattern_compile("ame");
+
+    TEST_ASSERT(prefix && suffix && exact && escaped && contains, "Literal patterns compiled");
+    TEST_ASSERT(cjson_tools_pattern_match(prefix, "old_name") && !cjson_tools_pattern_match(prefix, "my_old_name"),
+                "Prefix pattern matches only at start");
+    TEST_ASSERT(cjson_tools_pattern_match(suffix, "old_name") && !cjson_tools_pattern_match(suffix, "name_old"),
+                "Suffix pattern matches only at end");
+    TEST_ASSERT(cjson_tools_pattern_match(exact, "new_name") && !cjson_tools_pattern_match(exact, "new_names"),
+                "Exact pattern requires a full match");
+    TEST_ASSERT(cjson_tools_pattern_match(escaped, "session.page.Home") && !cjson_tools_pattern_match(escaped, "sessionXpage.Home"),
+                "Escaped dots are matched literally");
+    TEST_ASSERT(cjson_tools_pattern_match(contains, "username") && !cjson_tools_pattern_match(contains, "user"),
+                "Unanchored literal matches anywhere");
+
+    cJSON* keys_doc = cJSON_Parse("{\"old_a\":1,\"b\":{\"old_c\":[{\"old_d\":2}]}}");
+    cJSON* compiled_result = replace_keys_compiled(keys_doc, prefix, "renamed");
+    TEST_ASSERT_NOT_NULL(compiled_result, "replace_keys_compiled succeeded");
+    if (compiled_result) {
+        cJSON* nested = cJSON_GetObjectItem(cJSON_GetObjectItem(compiled_result, "b"), "renamed");
+        TEST_ASSERT(cJSON_GetObjectItem(compiled_result, "renamed") && cJSON_IsArray(nested),
+                    "Compiled pattern reused for nested keys");
+        cJSON_Delete(compiled_result);
+    }
+    cJSON_Delete(keys_doc);
+
+    cjson_tools_pattern_free(prefix);
+    cjson_tools_pattern_free(suffix);
+    cjson_tools_pattern_free(exact);
+    cjson_tools_pattern_free(escaped);
+    cjson_tools_pattern_free(contains);
+
+#ifndef __WINDOWS__
+    CompiledPattern* regex = cjson_tools_pattern_compile("^o[a-z]+_[0-9]+$");
+    TEST_ASSERT_NOT_NULL(regex, "Regex pattern compiled");
+    TEST_ASSERT(cjson_tools_pattern_match(regex, "old_42") && !cjson_tools_pattern_match(regex, "old_x"),
+                "Regex pattern matches");
+    cjson_tools_pattern_free(regex);
+
+    TEST_ASSERT_NULL(cjson_tools_pattern_compile("(["), "Invalid regex pattern rejected");
+#endif
+
+    // Array views give indexed access without rescanning the child list
+    cJSON* view_array = cJSON_Parse("[10,20,30,{\"k\":1}]");
+    JsonArrayView view;
+    TEST_ASSERT_EQUAL(0, json_array_view_init(&view, view_array), "Array view built");
+    TEST_ASSERT_EQUAL(4, view.count, "Array view has one entry per child");
+    TEST_ASSERT(view.count == 4 && view.items[2] == cJSON_GetArrayItem(view_array, 2) &&
+                cJSON_IsObject(view.items[3]), "Array view preserves element order");
+    json_array_view_free(&view);
+    TEST_ASSERT(view.items == NULL && view.count == 0, "Array view reset after free");
+
+    cJSON* empty_array = cJSON_CreateArray();
+    TEST_ASSERT(json_array_view_init(&view, empty_array) == 0 && view.count == 0, "Empty array gives empty view");
+    json_array_view_free(&view);
+    cJSON_Delete(empty_array);
+    cJSON_Delete(view_array);
+}
+
+// =============================================================================
+// NDJSON STREAMING TESTS
+// =============================================================================
+
+static FILE* create_ndjson_file(const char* content) {
+    FILE* file = tmpfile();
+    if (file) {
+        fputs(content, file);
+        rewind(file);
+    }
+    return file;
+}
+
+static int count_lines(FILE* file) {
+    int lines = 0;
+    int c;
+    rewind(file);
+    while ((c = fgetc(file)) != EOF) {
+        if (c == '\n') lines++;
+    }
+    rewind(file);
+    return lines;
+}
+
+static cJSON* remove_nulls_transform(const cJSON* record, void* user_data) {
+    (void)user_data;
+    return remove_nulls(record);
+}
+
+void test_ndjson_streaming() {
+    TEST_SECTION("NDJSON Streaming Tests");
+
+    const char* ndjson =
+        "{\"id\":1,\"user\":{\"name\":\"Alice\"}}\n"
+        "\n"
+        "{\"id\":2,\"user\":{\"name\":\"Bob\",\"email\":null}}\r\n"
+        "{\"id\":3,\"tags\":[\"a\",\"b\"]}";
+
+    FILE* input = create_ndjson_file(ndjson);
+    FILE* output = tmpfile();
+    TEST_ASSERT(input != NULL && output != NULL, "Temporary NDJSON files created");
+    if (!input || !output) return;
+
+    TIME_START();
+    long records = flatten_json_stream(input, output, 0, 0);
+    TIME_END("NDJSON flatten stream");
+
+    TEST_ASSERT_EQUAL(3, records, "All NDJSON records flattened (blank lines skipped)");
+    TEST_ASSERT_EQUAL(3, count_lines(output), "One output line per record");
+
+    char line[256];
+    if (fgets(line, sizeof(line), output)) {
+        cJSON* first = cJSON_Parse(line);
+        TEST_ASSERT_NOT_NULL(first, "Streamed output line is valid JSON");
+        if (first) {
+            cJSON* name = cJSON_GetObjectItem(first, "user.name");
+            TEST_ASSERT(name && strcmp(cJSON_GetStringValue(name), "Alice") == 0, "Streamed record is flattened");
+            cJSON_Delete(first);
+        }
+    }
+    fclose(input);
+    fclose(output);
+
+    // Bytes the caller's stream has buffered already are not skipped
+    input = create_ndjson_file("# header\n{\"id\":1}\n{\"id\":2}\n");
+    output = tmpfile();
+    if (input && output) {
+        char header[32];
+        int skipped = fgets(header, sizeof(header), input) != NULL;
+        ungetc(fgetc(input), input);
+        TEST_ASSERT_EQUAL(2, skipped ? flatten_json_stream(input, output, 0, 0) : -1,
+                          "Stream resumes after bytes the caller read");
+        TEST_ASSERT_EQUAL(2, count_lines(output), "Buffered records are all streamed");
+    }
+    if (input) fclose(input);
+    if (output) fclose(output);
+
+    // Records crossing chunk boundaries must be reassembled
+    size_t big_len = NDJSON_CHUNK_SIZE + 1024;
+    char* big = malloc(big_len + 64);
+    if (big) {
+        size_t pos = (size_t)sprintf(big, "{\"k\":\"");
+        memset(big + pos, 'x', big_len);
+        pos += big_len;
+        pos += (size_t)sprintf(big + pos, "\"}\n{\"k\":1}\n");
+
+        input = create_ndjson_file(big);
+        output = tmpfile();
+        records = flatten_json_stream(input, output, 0, 0);
+        TEST_ASSERT_EQUAL(2, records, "Records larger than the read chunk are streamed");
+        fclose(input);
+        fclose(output);
+        free(big);
+    }
+
+#ifndef THREADING_DISABLED
+    input = create_ndjson_file(ndjson);
+    output = tmpfile();
+    records = flatten_json_stream(input, output, 1, 2);
+    TEST_ASSERT_EQUAL(3, records, "NDJSON flatten stream works with threading");
+    TEST_ASSERT_EQUAL(3, count_lines(output), "Threaded stream writes one line per record");
+    fclose(input);
+    fclose(output);
+#endif
+
+    // Schema inference over the stream
+    input = create_ndjson_file(ndjson);
+    cJSON* schema = generate_schema_stream(input);
+    TEST_ASSERT_NOT_NULL(schema, "Schema generated from NDJSON stream");
+    if (schema) {
+        cJSON* properties = cJSON_GetObjectItem(schema, "properties");
+        TEST_ASSERT_NOT_NULL(cJSON_GetObjectItem(properties, "id"), "Stream schema has 'id' property");
+        TEST_ASSERT_NOT_NULL(cJSON_GetObjectItem(properties, "tags"), "Stream schema has 'tags' property");
+        cJSON_Delete(schema);
+    }
+    fclose(input);
+
+    // Generic per-record transform
+    input = create_ndjson_file(ndjson);
+    output = tmpfile();
+    records = process_json_stream(input, output, remove_nulls_transform, NULL);
+    TEST_ASSERT_EQUAL(3, records, "Per-record transform applied to stream");
+    fclose(input);
+    fclose(output);
+
+    // Invalid records stop the stream with an error
+    input = create_ndjson_file("{\"ok\":1}\n{broken\n");
+    output = tmpfile();
+    records = flatten_json_stream(input, output, 0, 0);
+    TEST_ASSERT_EQUAL(-1, records, "Invalid NDJSON record reported as error");
+    fclose(input);
+    fclose(output);
+}
+
+// Errors of one value as compact JSON, or "failed"
+static char* validation_errors_text(const SchemaValidator* validator, const char* text, SchemaValidationMode mode) {
+    cJSON* json = cJSON_Parse(text);
+    cJSON* errors = NULL;
+    int count = json ? schema_validate(validator, json, mode, &errors) : -1;
+    char* printed = count >= 0 && count == cJSON_GetArraySize(errors) ? cJSON_PrintUnformatted(errors) : NULL;
+    cJSON_Delete(errors);
+    cJSON_Delete(json);
+    return printed ? printed : my_strdup("failed");
+}
+
+static int validates_to(const SchemaValidator* validator, const char* text, SchemaValidationMode mode,
+                        const char* expected) {
+    char* errors = validation_errors_text(validator, text, mode);
+    int matches = strcmp(errors, expected) == 0;
+    if (!matches) printf("    got %s, expected %s\n", errors, expected);
+    free(errors);
+    return matches;
+}
+
+void test_schema_validation() {
+    TEST_SECTION("Schema Validation Tests");
+    
+    // A generated schema accepts the records it was inferred from
+    const char* records = "[{\"id\":1,\"name\":\"a\",\"tags\":[\"x\"],\"user\":{\"age\":3}},"
+                          "{\"id\":2,\"name\":\"b\",\"tags\":[\"y\"],\"user\":{\"age\":4,\"nick\":null}}]";
+    cJSON* batch = cJSON_Parse(records);
+    cJSON* schema = generate_schema_from_batch(batch, 0, 0);
+    SchemaValidator* validator = schema_validator_compile(schema);
+    TEST_ASSERT_NOT_NULL(validator, "Generated schema compiled");
+    cJSON_Delete(schema);
+    if (!validator) {
+        cJSON_Delete(batch);
+        return;
+    }
+    TEST_ASSERT_EQUAL(0, schema_validate_batch(validator, batch, SCHEMA_VALIDATE_ALL_ERRORS, 0, 0, NULL),
+                      "Records match the schema inferred from them");
+    
+    TEST_ASSERT(validates_to(validator, "{\"id\":1.5,\"name\":\"a\",\"tags\":[2],\"user\":{\"age\":\"x\"}}",
+                             SCHEMA_VALIDATE_ALL_ERRORS,
+                             "[{\"path\":\"id\",\"message\":\"expected integer, got number\"},"
+                             "{\"path\":\"tags[0]\",\"message\":\"expected string, got integer\"},"
+                             "{\"path\":\"user.age\",\"message\":\"expected integer, got string\"}]"),
+                "Type errors are reported at nested paths");
+    TEST_ASSERT(validates_to(validator, "{\"id\":1.5,\"tags\":[2]}", SCHEMA_VALIDATE_FIRST_ERROR,
+                             "[{\"path\":\"id\",\"message\":\"expected integer, got number\"}]"),
+                "First-error mode stops at the first error");
+    TEST_ASSERT(validates_to(validator, "{\"id\":2e0,\"tags\":[],\"user\":{\"nick\":null,\"age\":1}}",
+                             SCHEMA_VALIDATE_ALL_ERRORS,
+                             "[{\"path\":\"name\",\"message\":\"required property is missing\"}]"),
+                "Missing required properties are reported; 2e0 is an integer");
+    TEST_ASSERT(validates_to(validator, "[1]", SCHEMA_VALIDATE_ALL_ERRORS,
+                             "[{\"path\":\"\",\"message\":\"expected object, got array\"}]"),
+                "A value of the wrong type is not checked further");
+    
+    // Batches agree with and without threads, and first-error mode reports only the first invalid record
+    cJSON* mixed = cJSON_CreateArray();
+    for (int i = 0; i < 3000; i++) {
+        char text[128];
+        snprintf(text, sizeof(text), "{\"id\":%s,\"name\":\"n\",\"tags\":[],\"user\":{\"age\":%d}}",
+                 i % 7 == 3 ? "\"bad\"" : "1", i);
+        cJSON_AddItemToArray(mixed, cJSON_Parse(text));
+    }
+#ifndef THREADING_DISABLED
+    ThreadPool* pool = thread_pool_create(4);
+#else
+    ThreadPool* pool = NULL;
+#endif
+    cJSON* errors[3] = {NULL, NULL, NULL};
+    int invalid[3] = {
+        schema_validate_batch(validator, mixed, SCHEMA_VALIDATE_ALL_ERRORS, 0, 0, &errors[0]),
+        schema_validate_batch(validator, mixed, SCHEMA_VALIDATE_ALL_ERRORS, 1, 4, &errors[1]),
+        schema_validate_batch_with_pool(validator, mixed, SCHEMA_VALIDATE_ALL_ERRORS, pool, &errors[2])
+    };
+    TEST_ASSERT(invalid[0] == 429 && invalid[1] == 429 && invalid[2] == 429, "Every invalid record is counted");
+    TEST_ASSERT(cJSON_Compare(errors[0], errors[1], 1) && cJSON_Compare(errors[0], errors[2], 1),
+                "Threaded batches report the same errors in record order");
+    cJSON* record = cJSON_GetObjectItem(cJSON_GetArrayItem(errors[0], 1), "record");
+    TEST_ASSERT(record && record->valueint == 10, "Errors carry their record index");
+    for (int r = 0; r < 3; r++) cJSON_Delete(errors[r]);
+    
+    cJSON* first = NULL;
+    int first_invalid = schema_validate_batch_with_pool(validator, mixed, SCHEMA_VALIDATE_FIRST_ERROR, pool, &first);
+    record = cJSON_GetObjectItem(cJSON_GetArrayItem(first, 0), "record");
+    TEST_ASSERT(first_invalid == 1 && cJSON_GetArraySize(first) == 1 && record && record->valueint == 3,
+                "First-error batches report the lowest invalid record");
+    cJSON_Delete(first);
+#ifndef THREADING_DISABLED
+    thread_pool_destroy(pool);
+#endif
+    
+    // NDJSON records are numbered from the start of the stream
+    FILE* input = create_ndjson_file("{\"id\":1,\"name\":\"n\",\"tags\":[],\"user\":{\"age\":1}}\n"
+                                     "{\"id\":1}\n{\"id\":\"x\",\"name\":\"n\",\"tags\":[],\"user\":{\"age\":1}}\n");
+    FILE* output = tmpfile();
+    long stream_invalid = schema_validate_stream(validator, input, output, SCHEMA_VALIDATE_ALL_ERRORS, 0, 0);
+    TEST_ASSERT(stream_invalid == 2 && count_lines(output) == 4, "Stream validation writes one error per line");
+    fclose(input);
+    fclose(output);
+    schema_validator_free(validator);
+    cJSON_Delete(mixed);
+    cJSON_Delete(batch);
+    
+    // The Draft-07 subset: type lists, enum, const, required without a property schema, boolean schemas
+    validator = schema_validator_compile_string(
+        "{\"$schema\":\"http://json-schema.org/draft-07/schema#\",\"title\":\"t\",\"type\":\"object\","
+        "\"properties\":{\"kind\":{\"enum\":[\"a\",{\"b\":1}]},\"n\":{\"type\":[\"number\",\"null\"]},"
+        "\"v\":{\"const\":2},\"any\":true,\"none\":false,"
+        "\"list\":{\"type\":\"array\",\"items\":{\"type\":\"integer\"}}},"
+        "\"required\":[\"kind\",\"extra\"],\"additionalProperties\":true}");
+    TEST_ASSERT_NOT_NULL(validator, "Draft-07 subset compiled");
+    if (validator) {
+        TEST_ASSERT(validates_to(validator, "{\"kind\":{\"b\":1},\"n\":null,\"v\":2.0,\"any\":[],\"list\":[1,2],"
+                                           "\"extra\":0,\"other\":\"x\"}",
+                                 SCHEMA_VALIDATE_ALL_ERRORS, "[]"),
+                    "Matching document is valid");
+        TEST_ASSERT(validates_to(validator, "{\"kind\":\"c\",\"n\":\"1\",\"v\":3,\"none\":0,\"list\":[1,1.5]}",
+                                 SCHEMA_VALIDATE_ALL_ERRORS,
+                                 "[{\"path\":\"kind\",\"message\":\"value is not one of the allowed values\"},"
+                                 "{\"path\":\"n\",\"message\":\"expected number or null, got string\"},"
+                                 "{\"path\":\"v\",\"message\":\"value is not one of the allowed values\"},"
+                                 "{\"path\":\"none\",\"message\":\"value is not one of the allowed values\"},"
+                                 "{\"path\":\"list[1]\",\"message\":\"expected integer, got number\"},"
+                                 "{\"path\":\"extra\",\"message\":\"required property is missing\"}]"),
+                    "Enum, const, type list, items and required errors");
+        schema_validator_free(validator);
+    }
+    
+    // Wide objects use more than one required word
+    char wide[8192] = "{\"type\":\"object\",\"required\":[";
+    for (int i = 0; i < 130; i++) {
+        snprintf(wide + strlen(wide), sizeof(wide) - strlen(wide), "%s\"k%d\"", i ? "," : "", i);
+    }
+    strcat(wide, "]}");
+    validator = schema_validator_compile_string(wide);
+    TEST_ASSERT(validator && validates_to(validator, "{\"k0\":1,\"k129\":1}", SCHEMA_VALIDATE_FIRST_ERROR,
+                                          "[{\"path\":\"k1\",\"message\":\"required property is missing\"}]"),
+                "Required properties past the first 64 are checked");
+    cJSON* wide_errors = NULL;
+    cJSON* wide_json = cJSON_Parse("{\"k5\":1}");
+    TEST_ASSERT_EQUAL(129, schema_validate(validator, wide_json, SCHEMA_VALIDATE_ALL_ERRORS, &wide_errors),
+                      "Every missing property is reported");
+    cJSON_Delete(wide_json);
+    cJSON_Delete(wide_errors);
+    schema_validator_free(validator);
+    
+    // Builders compile directly, and keywords outside the subset are rejected
+    SchemaBuilder* builder = schema_builder_create();
+    validator = schema_validator_from_builder(builder);
+    TEST_ASSERT(validator && validates_to(validator, "[null,{\"a\":1}]", SCHEMA_VALIDATE_ALL_ERRORS, "[]"),
+                "An empty builder accepts anything");
+    schema_validator_free(validator);
+    cJSON* sample = cJSON_Parse("{\"a\":1}");
+    schema_builder_add(builder, sample);
+    validator = schema_validator_from_builder(builder);
+    TEST_ASSERT(validator && validates_to(validator, "{\"a\":\"x\"}", SCHEMA_VALIDATE_ALL_ERRORS,
+                                          "[{\"path\":\"a\",\"message\":\"expected integer, got string\"}]"),
+                "A builder's schema is compiled as it stands");
+    schema_validator_free(validator);
+    cJSON_Delete(sample);
+    schema_builder_free(builder);
+    
+    TEST_ASSERT(schema_validator_compile_string("{\"type\":\"object\",\"anyOf\":[]}") == NULL,
+                "Unsupported keywords are rejected");
+    TEST_ASSERT(schema_validator_compile_string("{\"type\":\"date\"}") == NULL, "Unknown types are rejected");
+    TEST_ASSERT(schema_validator_compile_string("{\"enum\":[1],\"const\":1}") == NULL,
+                "enum and const together are rejected");
+}
+
+// x-stats of a schema's property, or of the schema itself for NULL
+static const cJSON* schema_stats_of(const cJSON* schema, const char* property) {
+    if (property) schema = cJSON_GetObjectItem(cJSON_GetObjectItem(schema, "properties"), property);
+    return cJSON_GetObjectItem(schema, "x-stats");
+}
+
+static double stats_number(const cJSON* stats, const char* name) {
+    const cJSON* value = cJSON_GetObjectItem(stats, name);
+    return cJSON_IsNumber(value) ? value->valuedouble : -1.0;
+}
+
+void test_schema_sampling() {
+    TEST_SECTION("Schema Sampling and Statistics Tests");
+    
+    cJSON* batch = cJSON_CreateArray();
+    for (int i = 0; i < 20000; i++) {
+        char text[160];
+        snprintf(text, sizeof(text), "{\"id\":%d,\"name\":\"user%d\",\"level\":\"%s\",\"score\":%d.5,\"note\":%s}",
+                 i, i, i % 3 == 0 ? "low" : i % 3 == 1 ? "mid" : "high", i % 100,
+                 i % 4 == 0 ? "null" : "\"ok\"");
+        cJSON_AddItemToArray(batch, cJSON_Parse(text));
+    }
+    
+    SchemaInferenceOptions options = {0};
+    options.collect_stats = 1;
+    cJSON* schema = generate_schema_from_batch_opts(batch, &options, 0, 0);
+    TEST_ASSERT_NOT_NULL(schema, "Schema with statistics generated");
+    
+    // Distinct counts are estimated within a few percent past the exact range
+    double distinct = stats_number(schema_stats_of(schema, "name"), "distinct");
+    TEST_ASSERT(distinct > 19000 && distinct <= 20000, "Distinct strings estimated within 5%");
+    const cJSON* level = schema_stats_of(schema, "level");
+    TEST_ASSERT(stats_number(level, "distinct") == 3 && cJSON_GetArraySize(cJSON_GetObjectItem(level, "enum")) == 3,
+                "Low-cardinality fields report an exact enum");
+    TEST_ASSERT(cJSON_GetObjectItem(schema_stats_of(schema, "id"), "enum") == NULL,
+                "Enums are dropped past the limit");
+    const cJSON* score = schema_stats_of(schema, "score");
+    TEST_ASSERT(stats_number(score, "minimum") == 0.5 && stats_number(score, "maximum") == 99.5,
+                "Numeric range tracked");
+    const cJSON* name = schema_stats_of(schema, "name");
+    TEST_ASSERT(stats_number(name, "min_length") == 5 && stats_number(name, "max_length") == 9,
+                "String lengths tracked");
+    TEST_ASSERT(stats_number(schema_stats_of(schema, "note"), "null_ratio") == 0.25, "Null ratio tracked");
+    TEST_ASSERT(cJSON_GetObjectItem(schema, "x-sample") == NULL, "Unsampled schemas have no x-sample");
+    
+    // Threads partition the records differently without changing the result
+    cJSON* threaded = generate_schema_from_batch_opts(batch, &options, 1, 4);
+    TEST_ASSERT(cJSON_Compare(schema, threaded, 1), "Threaded statistics match sequential ones");
+    cJSON_Delete(threaded);
+    
+    // Builders keep statistics through merges and serialization
+    SchemaBuilder* halves[2] = {schema_builder_create_with_options(&options),
+                                schema_builder_create_with_options(&options)};
+    cJSON* part = cJSON_CreateArray();
+    for (int i = 0; i < 10000; i++) cJSON_AddItemToArray(part, cJSON_DetachItemFromArray(batch, 10000));
+    schema_builder_add_batch(halves[0], batch, 0, 0);
+    schema_builder_add_batch(halves[1], part, 0, 0);
+    char* state = schema_builder_serialize(halves[1]);
+    SchemaBuilder* restored = schema_builder_deserialize(state);
+    TEST_ASSERT(restored && schema_builder_merge(halves[0], restored) == 0, "Serialized statistics restored");
+    cJSON* merged = schema_builder_to_json(halves[0]);
+    TEST_ASSERT(cJSON_Compare(schema, merged, 1), "Merged builders report the statistics of the whole batch");
+    cJSON_Delete(merged);
+    free(state);
+    schema_builder_free(restored);
+    schema_builder_free(halves[0]);
+    schema_builder_free(halves[1]);
+    while (part->child) cJSON_AddItemToArray(batch, cJSON_DetachItemFromArray(part, 0));
+    cJSON_Delete(part);
+    cJSON_Delete(schema);
+    
+    // Samples are reproducible from the seed and annotated with their size
+    SchemaInferenceOptions sampling = {0};
+    sampling.sample_size = 500;
+    sampling.seed = 42;
+    cJSON* sampled[2] = {generate_schema_from_batch_opts(batch, &sampling, 0, 0),
+                         generate_schema_from_batch_opts(batch, &sampling, 1, 4)};
+    const cJSON* annotation = cJSON_GetObjectItem(sampled[0], "x-sample");
+    TEST_ASSERT(stats_number(annotation, "records") == 20000 && stats_number(annotation, "sampled") == 500,
+                "x-sample reports records seen and analyzed");
+    TEST_ASSERT(cJSON_Compare(sampled[0], sampled[1], 1), "The same seed samples the same records");
+    cJSON_Delete(sampled[0]);
+    cJSON_Delete(sampled[1]);
+    
+    sampling.sample_size = 0;
+    sampling.sample_rate = 0.1;
+    sampling.collect_stats = 1;
+    schema = generate_schema_from_batch_opts(batch, &sampling, 0, 0);
+    double count = stats_number(schema_stats_of(schema, NULL), "count");
+    TEST_ASSERT(count == 2000 && stats_number(cJSON_GetObjectItem(schema, "x-sample"), "sampled") == 2000,
+                "Sample rates analyze that fraction of the records");
+    cJSON_Delete(schema);
+    
+    // Streams sample as they read
+    FILE* input = create_ndjson_file("{\"a\":1}\n{\"a\":2}\n{\"a\":3}\n{\"a\":4}\n{\"a\":5}\n");
+    sampling.sample_rate = 0.0;
+    sampling.sample_size = 2;
+    schema = input ? generate_schema_stream_opts(input, &sampling) : NULL;
+    TEST_ASSERT(stats_number(schema_stats_of(schema, "a"), "count") == 2 &&
+                stats_number(cJSON_GetObjectItem(schema, "x-sample"), "records") == 5,
+                "Stream reservoirs keep sample_size records");
+    cJSON_Delete(schema);
+    if (input) fclose(input);
+    
+    cJSON_Delete(batch);
+}
+
+void test_columnar_output() {
+    TEST_SECTION("Columnar Output Tests");
+
+    ColumnarFormat format;
+    TEST_ASSERT(columnar_format_parse("arrow", &format) == 0 && format == COLUMNAR_ARROW, "Format name parsed");
+    TEST_ASSERT_EQUAL(-1, columnar_format_parse("parquet", &format), "Unknown format rejected");
+
+    // Columns follow first appearance; missing values and nulls are empty fields
+    cJSON* json = cJSON_Parse("[{\"a\":1,\"b\":{\"c\":\"x,y\"}},{\"a\":2.5,\"d\":true,\"b\":{\"c\":\"q\\\"t\"}},"
+                              "{\"a\":null,\"e\":[1,2]}]");
+    FILE* output = tmpfile();
+    TEST_ASSERT(json != NULL && output != NULL, "Columnar input prepared");
+    if (!json || !output) return;
+
+    TEST_ASSERT_EQUAL(3, flatten_json_columnar(json, output, COLUMNAR_CSV, 0, 0), "One CSV row per record");
+    char text[512];
+    rewind(output);
+    size_t length = fread(text, 1, sizeof(text) - 1, output);
+    text[length] = '\0';
+    TEST_ASSERT_STRING_EQUAL("a,b.c,d,e[0],e[1]\n1,\"x,y\",,,\n2.5,\"q\"\"t\",true,,\n,,,1,2\n", text,
+                             "CSV header and rows quoted per RFC 4180");
+    fclose(output);
+
+    output = tmpfile();
+    flatten_json_columnar(cJSON_GetArrayItem(json, 0), output, COLUMNAR_TSV, 0, 0);
+    rewind(output);
+    length = fread(text, 1, sizeof(text) - 1, output);
+    text[length] = '\0';
+    TEST_ASSERT_STRING_EQUAL("a\tb.c\n1\tx,y\n", text, "A single record is a single TSV row");
+    fclose(output);
+
+    // Arrow: schema message, one record batch per batch_rows rows, end-of-stream marker
+    JsonArrayView records;
+    json_array_view_init(&records, json);
+    ColumnarWriter* writer = columnar_writer_create(NULL, COLUMNAR_ARROW, 2);
+    TEST_ASSERT_NOT_NULL(writer, "In-memory Arrow writer created");
+    TEST_ASSERT_EQUAL(0, columnar_writer_add_columns(writer, &records, NULL), "Columns taken from every record");
+    TEST_ASSERT_EQUAL(0, columnar_writer_write(writer, &records, NULL), "Records written as Arrow batches");
+    TEST_ASSERT_EQUAL(-1, columnar_writer_add_columns(writer, &records, NULL), "Columns are fixed once written");
+    TEST_ASSERT_EQUAL(3, columnar_writer_finish(writer), "Arrow writer reports its rows");
+
+    const unsigned char* stream = (const unsigned char*)columnar_writer_output(writer, &length);
+    int messages = 0;
+    size_t position = 0;
+    while (stream && position + 8 <= length) {
+        int32_t prefix[2];
+        memcpy(prefix, stream + position, sizeof(prefix));
+        if (prefix[0] != -1 || prefix[1] == 0 || prefix[1] % 8 != 0) break;
+
+        // The body length is the last field of the Message table
+        const unsigned char* metadata = stream + position + 8;
+        uint32_t root;
+        int64_t body_length;
+        memcpy(&root, metadata, 4);
+        memcpy(&body_length, metadata + root + 8 + 3 * 8, 8);
+        position += 8 + (size_t)prefix[1] + (size_t)body_length;
+        messages++;
+    }
+    TEST_ASSERT_EQUAL(3, messages, "Arrow stream holds a schema and two record batches");
+    TEST_ASSERT(position + 8 == length && memcmp(stream + position, "\xff\xff\xff\xff\0\0\0\0", 8) == 0,
+                "Arrow stream ends with the end-of-stream marker");
+    columnar_writer_free(writer);
+
+    // Paths the first batch did not have are counted, not written
+    cJSON* later = cJSON_Parse("[{\"a\":1},{\"a\":\"text\",\"z\":1}]");
+    JsonArrayView first = {records.items, 1};
+    JsonArrayView rest;
+    json_array_view_init(&rest, later);
+    writer = columnar_writer_create(NULL, COLUMNAR_CSV, 0);
+    columnar_writer_write(writer, &first, NULL);
+    columnar_writer_write(writer, &rest, NULL);
+    TEST_ASSERT_EQUAL(1, columnar_writer_dropped(writer), "Value under a new path counted as dropped");
+    const char* csv = columnar_writer_output(writer, &length);
+    TEST_ASSERT(csv && length == strlen("a,b.c\n1,\"x,y\"\n1,\ntext,\n") &&
+                memcmp(csv, "a,b.c\n1,\"x,y\"\n1,\ntext,\n", length) == 0, "Later batches keep the first columns");
+    columnar_writer_free(writer);
+    json_array_view_free(&rest);
+    cJSON_Delete(later);
+
+    // Threaded NDJSON output matches the inline one
+    size_t capacity = 1 << 20;
+    char* ndjson = malloc(capacity);
+    size_t ndjson_length = 0;
+    for (int i = 0; i < COLUMNAR_BATCH_ROWS + 500; i++) {
+        ndjson_length += (size_t)sprintf(ndjson + ndjson_length, "{\"id\":%d,\"tags\":[\"t%d\",null],\"ok\":%s}\n",
+                                         i, i % 5, i % 2 ? "true" : "false");
+    }
+    char* inline_output = NULL;
+    char* threaded_output = NULL;
+    size_t inline_length = 0, threaded_length = 0;
+    for (int threaded = 0; threaded <= 1; threaded++) {
+        FILE* input = create_ndjson_file(ndjson);
+        output = tmpfile();
+        long rows = flatten_json_stream_columnar(input, output, COLUMNAR_ARROW, threaded, 3);
+        TEST_ASSERT_EQUAL(COLUMNAR_BATCH_ROWS + 500, rows,
+                          threaded ? "Threaded NDJSON stream written as Arrow" : "NDJSON stream written as Arrow");
+        long size = ftell(output);
+        char* copy = malloc(size > 0 ? (size_t)size : 1);
+        rewind(output);
+        size_t read = fread(copy, 1, size > 0 ? (size_t)size : 0, output);
+        if (threaded) {
+            threaded_output = copy;
+            threaded_length = read;
+        } else {
+            inline_output = copy;
+            inline_length = read;
+        }
+        fclose(input);
+        fclose(output);
+    }
+    TEST_ASSERT(inline_length > 0 && inline_length == threaded_length &&
+                memcmp(inline_output, threaded_output, inline_length) == 0, "Threaded Arrow output is identical");
+    free(inline_output);
+    free(threaded_output);
+    free(ndjson);
+
+    json_array_view_free(&records);
+    cJSON_Delete(json);
+}
+
+void test_transformation_pipeline() {
+    TEST_SECTION("Transformation Pipeline Tests");
+
+    const char* json_str =
+        "{\"old_id\":1,\"old_name\":\"\",\"meta\":{\"old_tag\":null,\"status\":\"draft\"},"
+        "\"items\":[null,\"x\",{\"old_v\":2}]}";
+    cJSON* json = cJSON_Parse(json_str);
+    TEST_ASSERT_NOT_NULL(json, "Pipeline input parsed");
+    if (!json) return;
+
+    JsonPipeline* pipeline = json_pipeline_parse("remove-nulls,remove-empty,replace-keys:^old_:new_");
+    TEST_ASSERT_NOT_NULL(pipeline, "Pipeline spec parsed");
+    if (pipeline) {
+        cJSON* fused = json_pipeline_apply(pipeline, json);
+
+        // Same result as chaining the individual passes
+        cJSON* step1 = remove_nulls(json);
+        cJSON* step2 = remove_empty_strings(step1);
+        cJSON* chained = replace_keys(step2, "^old_", "new_");
+        TEST_ASSERT(fused && cJSON_Compare(fused, chained, 1), "Fused pipeline matches chained passes");
+        TEST_ASSERT_NOT_NULL(cJSON_GetObjectItem(fused, "new_"), "Pipeline renames keys");
+        TEST_ASSERT_NULL(cJSON_GetObjectItem(fused, "old_name"), "Pipeline drops empty strings");
+
+        cJSON_Delete(step1);
+        cJSON_Delete(step2);
+        cJSON_Delete(chained);
+        cJSON_Delete(fused);
+        json_pipeline_free(pipeline);
+    }
+
+    // Filters before flatten renumber arrays, replacements after flatten see full paths
+    pipeline = json_pipeline_parse("remove-nulls,flatten,replace-keys:^meta\\.old_v$:unused,replace-values:^draft$:final");
+    TEST_ASSERT_NOT_NULL(pipeline, "Pipeline spec with flatten parsed");
+    if (pipeline) {
+        cJSON* flat = json_pipeline_apply(pipeline, json);
+        TEST_ASSERT_NOT_NULL(flat, "Pipeline with flatten produced output");
+        if (flat) {
+            cJSON* first = cJSON_GetObjectItem(flat, "items[0]");
+            TEST_ASSERT(first && strcmp(cJSON_GetStringValue(first), "x") == 0,
+                        "Array elements removed before flatten do not consume an index");
+            cJSON* status = cJSON_GetObjectItem(flat, "meta.status");
+            TEST_ASSERT(status && strcmp(cJSON_GetStringValue(status), "final") == 0,
+                        "Pipeline replaces values");
+            TEST_ASSERT_NULL(cJSON_GetObjectItem(flat, "meta.old_tag"), "Pipeline removes nulls before flatten");
+            TEST_ASSERT_NOT_NULL(cJSON_GetObjectItem(flat, "items[1].old_v"), "Nested array objects flattened");
+            cJSON_Delete(flat);
+        }
+        json_pipeline_free(pipeline);
+    }
+
+    pipeline = json_pipeline_parse("flatten,remove-nulls");
+    if (pipeline) {
+        cJSON* flat = json_pipeline_apply(pipeline, json);
+        TEST_ASSERT(flat && cJSON_GetObjectItem(flat, "items[1]") != NULL,
+                    "Array elements removed after flatten keep their index");
+        cJSON_Delete(flat);
+        json_pipeline_free(pipeline);
+    }
+
+    // Scalar roots and scalar batch elements wrap as {"": value}, like flatten_json_object
+    pipeline = json_pipeline_parse("flatten");
+    if (pipeline) {
+        cJSON* scalar = cJSON_CreateNumber(5);
+        cJSON* flat = json_pipeline_apply(pipeline, scalar);
+        cJSON* plain = flatten_json_object(scalar);
+        TEST_ASSERT(flat && plain && cJSON_Compare(flat, plain, 1), "Pipeline flattens a scalar root like flatten");
+        cJSON_Delete(flat);
+        cJSON_Delete(plain);
+        cJSON_Delete(scalar);
+
+        cJSON* batch = cJSON_Parse("[1,\"a\",null,{\"b\":{\"c\":2}}]");
+        cJSON* expected = cJSON_Parse("[{\"\":1},{\"\":\"a\"},{\"\":null},{\"b.c\":2}]");
+        flat = batch ? json_pipeline_apply(pipeline, batch) : NULL;
+        TEST_ASSERT(flat && cJSON_Compare(flat, expected, 1), "Pipeline wraps scalar batch elements");
+        cJSON_Delete(flat);
+        cJSON_Delete(expected);
+        cJSON_Delete(batch);
+        json_pipeline_free(pipeline);
+    }
+
+    TEST_ASSERT_NULL(json_pipeline_parse("remove-nulls,bogus"), "Unknown pipeline step rejected");
+    TEST_ASSERT_NULL(json_pipeline_parse("replace-keys:^a"), "Replace step without replacement rejected");
+
+    cJSON_Delete(json);
+}
+
+static int write_test_file(const char* path, const char* content, size_t length) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return -1;
+    size_t written = fwrite(content, 1, length, file);
+    fclose(file);
+    return written == length ? 0 : -1;
+}
+
+// Reads a whole-number counter, or -1 when it is missing
+static double stats_value(const cJSON* stats, const char* section, const char* name) {
+    const cJSON* object = section ? cJSON_GetObjectItemCaseSensitive(stats, section) : stats;
+    const cJSON* value = cJSON_GetObjectItemCaseSensitive(object, name);
+    return cJSON_IsNumber(value) ? value->valuedouble : -1;
+}
+
+void test_runtime_stats() {
+    TEST_SECTION("Runtime Statistics Tests");
+
+    init_global_pools();
+    cjson_tools_reset_stats();
+
+    cJSON* stats = cjson_tools_get_stats();
+    TEST_ASSERT_NOT_NULL(stats, "Statistics reported");
+    if (!stats) return;
+#ifdef STATS_DISABLED
+    TEST_ASSERT(cJSON_IsFalse(cJSON_GetObjectItemCaseSensitive(stats, "enabled")), "Disabled build says so");
+    cJSON_Delete(stats);
+#else
+    TEST_ASSERT(stats_value(stats, NULL, "records") == 0 && stats_value(stats, NULL, "bytes_in") == 0,
+                "Reset zeroes the counters");
+    cJSON_Delete(stats);
+
+    // Parse, transform and serialize each count once, nested calls included
+    const char* input = "[{\"a\":{\"b\":1}},{\"a\":{\"b\":2}},{\"c\":null}]";
+    char* flattened = flatten_json_string_opts(input, 0, 0, 0);
+    TEST_ASSERT_NOT_NULL(flattened, "Batch flattened while counting");
+
+    stats = cjson_tools_get_stats();
+    TEST_ASSERT_EQUAL(3, (int)stats_value(stats, NULL, "records"), "Every record counted once");
+    TEST_ASSERT_EQUAL((int)strlen(input), (int)stats_value(stats, NULL, "bytes_in"), "Input bytes counted");
+    TEST_ASSERT_EQUAL((int)strlen(flattened), (int)stats_value(stats, NULL, "bytes_out"), "Output bytes counted");
+    const cJSON* phases = cJSON_GetObjectItemCaseSensitive(stats, "phases");
+    TEST_ASSERT_EQUAL(1, (int)stats_value(phases, "parse", "calls"), "One parse phase");
+    TEST_ASSERT_EQUAL(1, (int)stats_value(phases, "transform", "calls"), "One transform phase");
+    TEST_ASSERT(stats_value(phases, "serialize", "seconds") >= 0, "Serialize phase reported");
+    cJSON_Delete(stats);
+    free(flattened);
+
+    // Schema batches merge their per-thread partial schemas
+    cJSON* batch = cJSON_CreateArray();
+    for (int i = 0; i < 400; i++) {
+        cJSON* record = cJSON_CreateObject();
+        cJSON_AddNumberToObject(record, "id", i);
+        cJSON_AddItemToArray(batch, record);
+    }
+    cjson_tools_reset_stats();
+    ThreadPool* pool = thread_pool_create(4);
+    cJSON* schema = generate_schema_from_batch_with_pool(batch, pool);
+    TEST_ASSERT_NOT_NULL(schema, "Schema generated while counting");
+    cJSON_Delete(schema);
+
+    stats = cjson_tools_get_stats();
+    phases = cJSON_GetObjectItemCaseSensitive(stats, "phases");
+    TEST_ASSERT_EQUAL(400, (int)stats_value(stats, NULL, "records"), "Schema records counted on the caller only");
+    TEST_ASSERT_EQUAL(1, (int)stats_value(phases, "merge", "calls"), "Schema reduction timed as a merge");
+#ifndef THREADING_DISABLED
+    double queued = stats_value(stats, "tasks", "queued");
+    double run = stats_value(stats, "workers", "tasks");
+    TEST_ASSERT(queued > 0 && run >= 0 && run <= queued, "Pool tasks counted");
+    TEST_ASSERT(stats_value(stats, "tasks", "steals") <= stats_value(stats, "tasks", "steal_attempts"),
+                "Steals never exceed steal attempts");
+    const cJSON* threads = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(stats, "workers"), "threads");
+    TEST_ASSERT(cJSON_GetArraySize(threads) >= 4, "Each live worker reported");
+#endif
+    const cJSON* pools = cJSON_GetObjectItemCaseSensitive(stats, "pools");
+    TEST_ASSERT(cJSON_GetObjectItemCaseSensitive(pools, "property_nodes") != NULL, "Global pools reported by name");
+    cJSON_Delete(stats);
+    thread_pool_destroy(pool);
+    cJSON_Delete(batch);
+
+    char* text = cjson_tools_get_stats_string(0);
+    cJSON* parsed = text ? cJSON_Parse(text) : NULL;
+    TEST_ASSERT(parsed && cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(parsed, "enabled")), "Statistics text is JSON");
+    cJSON_Delete(parsed);
+    free(text);
+#endif
+}
+
+void test_file_input() {
+    TEST_SECTION("File Input Tests");
+
+    const char* path = "cjson_tools_test_input.json";
+
+    // A page-sized file that ends in a bare number must parse without reading past the mapping
+    char page[4096];
+    memset(page, ' ', sizeof(page));
+    memcpy(page + sizeof(page) - 2, "42", 2);
+    TEST_ASSERT_EQUAL(0, write_test_file(path, page, sizeof(page)), "Page-sized test file written");
+
+    JsonInput input;
+    TEST_ASSERT_EQUAL(0, json_input_open_file(&input, path), "Input file opened");
+    TEST_ASSERT_EQUAL(sizeof(page), input.length, "Input length matches file size");
+#ifdef __unix__
+    TEST_ASSERT_NOT_NULL(input.mapping, "Regular file is memory mapped");
+#endif
+    cJSON* number = json_input_parse(&input);
+    json_input_close(&input);
+    TEST_ASSERT(number && cJSON_IsNumber(number) && number->valueint == 42, "Number at end of mapping parsed");
+    cJSON_Delete(number);
+
+    // Larger document: parsed tree stays valid after the mapping is released
+    char* doc = malloc(64 * 1024);
+    if (doc) {
+        size_t pos = (size_t)sprintf(doc, "{\"items\":[");
+        for (int i = 0; i < 2000; i++) {
+            pos += (size_t)sprintf(doc + pos, "%s{\"id\":%d,\"name\":\"item%d\"}", i ? "," : "", i, i);
+        }
+        pos += (size_t)sprintf(doc + pos, "]}");
+        TEST_ASSERT_EQUAL(0, write_test_file(path, doc, pos), "Large test file written");
+
+        cJSON* json = parse_json_file(path);
+        TEST_ASSERT_NOT_NULL(json, "Large file parsed from mapping");
+        if (json) {
+            cJSON* items = cJSON_GetObjectItem(json, "items");
+            cJSON* last = cJSON_GetArrayItem(items, 1999);
+            TEST_ASSERT_EQUAL(2000, cJSON_GetArraySize(items), "All array items parsed");
+            TEST_ASSERT(last && strcmp(cJSON_GetStringValue(cJSON_GetObjectItem(last, "name")), "item1999") == 0,
+                        "Strings remain valid after unmapping");
+            cJSON_Delete(json);
+        }
+
+        char* text = read_json_file(path);
+        TEST_ASSERT(text && strlen(text) == pos && memcmp(text, doc, pos) == 0, "read_json_file returns the whole file");
+        free(text);
+        free(doc);
+    }
+
+    const char* bad = "{\"a\":[1,2,}";
+    write_test_file(path, bad, strlen(bad));
+    TEST_ASSERT_NULL(parse_json_file(path), "Invalid JSON file rejected");
+    TEST_ASSERT_NULL(parse_json_file("cjson_tools_missing_file.json"), "Missing file rejected");
+
+    remove(path);
+}
+
+// Writes text through a compressing stream into a fresh temporary file
+static FILE* compress_to_tmpfile(JsonCodec codec, const char* text, size_t length) {
+    FILE* raw = tmpfile();
+    FILE* stream = raw ? json_stream_open_compressed(raw, codec, 0) : NULL;
+    if (!stream) {
+        if (raw) fclose(raw);
+        return NULL;
+    }
+    size_t written = fwrite(text, 1, length, stream);
+    if (fclose(stream) != 0 || written != length) {
+        fclose(raw);
+        return NULL;
+    }
+    rewind(raw);
+    return raw;
+}
+
+// Reads a stream to its end into a NUL-terminated heap buffer
+static char* read_all(FILE* stream, size_t* length) {
+    size_t capacity = 65536, used = 0, n;
+    char* text = malloc(capacity);
+    while (text && (n = fread(text + used, 1, capacity - used - 1, stream)) > 0) {
+        used += n;
+        if (capacity - used < 2) {
+            char* grown = realloc(text, capacity * 2);
+            if (!grown) {
+                free(text);
+                return NULL;
+            }
+            text = grown;
+            capacity *= 2;
+        }
+    }
+    if (text) text[used] = '\0';
+    if (length) *length = used;
+    return text;
+}
+
+void test_compressed_streams() {
+    TEST_SECTION("Compressed Stream Tests");
+
+    const unsigned char gzip_magic[] = {0x1f, 0x8b, 0x08, 0x00};
+    const unsigned char zstd_magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+    TEST_ASSERT(json_codec_detect(gzip_magic, sizeof(gzip_magic)) == JSON_CODEC_GZIP, "gzip recognized by magic bytes");
+    TEST_ASSERT(json_codec_detect(zstd_magic, sizeof(zstd_magic)) == JSON_CODEC_ZSTD, "zstd recognized by magic bytes");
+    TEST_ASSERT(json_codec_detect("{\"a\":1}", 7) == JSON_CODEC_NONE, "Plain JSON is not compressed");
+    TEST_ASSERT(json_codec_from_path("out.ndjson.gz") == JSON_CODEC_GZIP &&
+                json_codec_from_path("out.json.zst") == JSON_CODEC_ZSTD &&
+                json_codec_from_path("out.json") == JSON_CODEC_NONE, "Codec picked from the extension");
+
+    JsonCodec codec;
+    TEST_ASSERT(json_codec_parse("zstd", &codec) == 0 && codec == JSON_CODEC_ZSTD, "Codec name parsed");
+    TEST_ASSERT_EQUAL(-1, json_codec_parse("lz4", &codec), "Unknown codec rejected");
+    TEST_ASSERT(json_codec_available(JSON_CODEC_NONE), "Plain text always available");
+
+    if (!json_codec_available(JSON_CODEC_GZIP)) {
+        printf("  (gzip not compiled in; skipping stream tests)\n");
+        return;
+    }
+
+    // Enough records for several blocks, each compressed as its own member
+    const int record_count = 40000;
+    size_t capacity = (size_t)record_count * 64;
+    char* ndjson = malloc(capacity);
+    size_t length = 0;
+    for (int i = 0; ndjson && i < record_count; i++) {
+        length += (size_t)sprintf(ndjson + length, "{\"id\":%d,\"user\":{\"name\":\"user%d\"}}\n", i, i);
+    }
+    if (!ndjson) return;
+
+    FILE* compressed = compress_to_tmpfile(JSON_CODEC_GZIP, ndjson, length);
+    TEST_ASSERT_NOT_NULL(compressed, "Output compressed in parallel blocks");
+    if (compressed) {
+        FILE* input = json_stream_open_decompressed(compressed, JSON_CODEC_NONE);
+        size_t decoded_length = 0;
+        char* decoded = input ? read_all(input, &decoded_length) : NULL;
+        TEST_ASSERT(decoded && decoded_length == length && memcmp(decoded, ndjson, length) == 0,
+                    "Concatenated members decode to the original text");
+        free(decoded);
+        if (input) fclose(input);
+
+        // The decoding thread feeds the NDJSON reader directly
+        rewind(compressed);
+        input = json_stream_open_decompressed(compressed, JSON_CODEC_GZIP);
+        FILE* output = tmpfile();
+        long records = input && output ? flatten_json_stream(input, output, 1, 2) : -1;
+        TEST_ASSERT_EQUAL(record_count, records, "Compressed NDJSON streamed through the decoder");
+        TEST_ASSERT_EQUAL(record_count, count_lines(output), "One output line per decoded record");
+        if (input) fclose(input);
+        if (output) fclose(output);
+        fclose(compressed);
+    }
+
+    // Plain input is passed through when the codec is detected
+    FILE* plain = create_ndjson_file("{\"a\":1}\n");
+    FILE* input = plain ? json_stream_open_decompressed(plain, JSON_CODEC_NONE) : NULL;
+    char* passed = input ? read_all(input, NULL) : NULL;
+    TEST_ASSERT(passed && strcmp(passed, "{\"a\":1}\n") == 0, "Plain input passed through unchanged");
+    free(passed);
+    if (input) fclose(input);
+    if (plain) fclose(plain);
+
+    // An empty stream still decompresses
+    compressed = compress_to_tmpfile(JSON_CODEC_GZIP, "", 0);
+    input = compressed ? json_stream_open_decompressed(compressed, JSON_CODEC_GZIP) : NULL;
+    size_t empty_length = 1;
+    char* empty = input ? read_all(input, &empty_length) : NULL;
+    TEST_ASSERT(empty && empty_length == 0, "Empty output is a valid compressed stream");
+    free(empty);
+    if (input) fclose(input);
+    if (compressed) fclose(compressed);
+
+    // Whole-document readers decode files by their magic bytes
+    const char* path = "cjson_tools_test_input.json.gz";
+    const char* doc = "{\"items\":[{\"id\":1},{\"id\":2}]}";
+    compressed = compress_to_tmpfile(JSON_CODEC_GZIP, doc, strlen(doc));
+    size_t file_length = 0;
+    char* file_data = compressed ? read_all(compressed, &file_length) : NULL;
+    if (compressed) fclose(compressed);
+    TEST_ASSERT(file_data && write_test_file(path, file_data, file_length) == 0, "Compressed test file written");
+
+    char* text = read_json_file(path);
+    TEST_ASSERT(text && strcmp(text, doc) == 0, "read_json_file decodes gzip files");
+    free(text);
+
+    JsonInput json_input;
+    TEST_ASSERT_EQUAL(0, json_input_open_file(&json_input, path), "Compressed input opened");
+    TEST_ASSERT_EQUAL(strlen(doc), json_input.length, "Input holds the decoded length");
+    cJSON* json = json_input_parse(&json_input);
+    json_input_close(&json_input);
+    TEST_ASSERT(json && cJSON_GetArraySize(cJSON_GetObjectItem(json, "items")) == 2, "Decoded input parsed");
+    cJSON_Delete(json);
+
+    // A cut-off file is an error, not a shorter document
+    if (file_data && file_length > 12) {
+        write_test_file(path, file_data, file_length - 6);
+        TEST_ASSERT_NULL(read_json_file(path), "Truncated gzip file rejected");
+    }
+    free(file_data);
+    remove(path);
+    free(ndjson);
+}
+
+// Reads back what was written to a tmpfile as a NUL-terminated string
+static char* rewind_and_read(FILE* file) {
+    if (!file || fflush(file) != 0) return NULL;
+    rewind(file);
+    return read_all(file, NULL);
+}
+
+void test_stream_output() {
+    TEST_SECTION("Stream Output Tests");
+
+    // Enough records for several flatten windows and sink flushes
+    cJSON* records = cJSON_CreateArray();
+    for (int i = 0; i < 10000; i++) {
+        cJSON* record = cJSON_CreateObject();
+        cJSON_AddNumberToObject(record, "id", i);
+        cJSON* user = cJSON_AddObjectToObject(record, "user");
+        cJSON_AddStringToObject(user, "name", i % 3 ? "alice" : "b\"ob");
+        cJSON_AddNullToObject(user, "email");
+        cJSON_AddItemToArray(records, record);
+    }
+
+    char* expected = cjson_tools_print(records, 1);
+    FILE* file = tmpfile();
+    TEST_ASSERT_EQUAL(0, cjson_tools_print_stream(records, file, 1), "Document printed to a stream");
+    char* actual = rewind_and_read(file);
+    TEST_ASSERT(expected && actual && strcmp(expected, actual) == 0, "Streamed print matches cjson_tools_print");
+    free(expected);
+    free(actual);
+    if (file) fclose(file);
+
+    for (int threads = 0; threads <= 1; threads++) {
+        expected = flatten_parsed_json_text(records, threads, 4, 0);
+        file = tmpfile();
+        TEST_ASSERT_EQUAL(0, flatten_parsed_json_stream(records, file, threads, 4, 0), "Batch flattened to a stream");
+        actual = rewind_and_read(file);
+        TEST_ASSERT(expected && actual && strcmp(expected, actual) == 0,
+                    threads ? "Parallel windows written in record order" : "Streamed flatten matches the text");
+        free(expected);
+        free(actual);
+        if (file) fclose(file);
+    }
+
+    JsonArrayView view;
+    ThreadPool* pool = thread_pool_create(4);
+    if (json_array_view_init(&view, records) == 0) {
+        expected = flatten_json_view_text(&view, pool, 1);
+        file = tmpfile();
+        TEST_ASSERT_EQUAL(0, flatten_json_view_stream(&view, pool, file, 1), "View flattened to a stream");
+        actual = rewind_and_read(file);
+        TEST_ASSERT(expected && actual && strcmp(expected, actual) == 0, "Streamed view flatten matches the text");
+        free(expected);
+        free(actual);
+        if (file) fclose(file);
+
+        expected = json_array_view_print(&view, 0);
+        file = tmpfile();
+        TEST_ASSERT_EQUAL(0, json_array_view_print_stream(&view, file, 0), "View printed to a stream");
+        actual = rewind_and_read(file);
+        TEST_ASSERT(expected && actual && strcmp(expected, actual) == 0, "Streamed view print matches the text");
+        free(expected);
+        free(actual);
+        if (file) fclose(file);
+        json_array_view_free(&view);
+    }
+    if (pool) thread_pool_destroy(pool);
+
+    // A stream that cannot be written reports the failure
+    TEST_ASSERT(write_test_file("cjson_tools_test_readonly.json", "", 0) == 0, "Read-only target created");
+    FILE* readonly = fopen("cjson_tools_test_readonly.json", "rb");
+    TEST_ASSERT_EQUAL(-1, readonly ? flatten_parsed_json_stream(records, readonly, 0, 0, 1) : -1,
+                      "Write errors reported by streamed flatten");
+    if (readonly) fclose(readonly);
+    remove("cjson_tools_test_readonly.json");
+    cJSON_Delete(records);
+
+    // Async output: more text than the buffer ring holds arrives intact and in order
+    FILE* raw = tmpfile();
+    FILE* async = raw ? json_stream_open_async(raw) : NULL;
+    if (!async) {
+        printf("  (async output unavailable; skipping writer tests)\n");
+        if (raw) fclose(raw);
+        return;
+    }
+
+    const size_t total = (size_t)12 << 20;
+    size_t written = 0;
+    char chunk[4099];
+    int write_ok = 1;
+    while (written < total && write_ok) {
+        for (size_t i = 0; i < sizeof(chunk); i++) chunk[i] = (char)('a' + (written + i) % 26);
+        write_ok = fwrite(chunk, 1, sizeof(chunk), async) == sizeof(chunk);
+        written += sizeof(chunk);
+    }
+    TEST_ASSERT(write_ok, "Writes accepted while the writer thread flushes");
+    TEST_ASSERT_EQUAL(0, fclose(async), "Async stream closed cleanly");
+
+    rewind(raw);
+    size_t length = 0;
+    char* text = read_all(raw, &length);
+    int in_order = text && length == written;
+    for (size_t i = 0; in_order && i < length; i++) in_order = text[i] == (char)('a' + i % 26);
+    TEST_ASSERT(in_order, "Async output written completely and in order");
+    free(text);
+    fclose(raw);
+
+    // Compression layered on top of the async writer
+    if (json_codec_available(JSON_CODEC_GZIP)) {
+        raw = tmpfile();
+        async = raw ? json_stream_open_async(raw) : NULL;
+        FILE* compressed = async ? json_stream_open_compressed(async, JSON_CODEC_GZIP, 0) : NULL;
+        const char* doc = "{\"layered\":true}\n";
+        int ok = compressed && fputs(doc, compressed) != EOF;
+        if (compressed && fclose(compressed) != 0) ok = 0;
+        if (async && fclose(async) != 0) ok = 0;
+        if (raw) rewind(raw);
+        FILE* input = ok ? json_stream_open_decompressed(raw, JSON_CODEC_GZIP) : NULL;
+        char* decoded = input ? read_all(input, NULL) : NULL;
+        TEST_ASSERT(decoded && strcmp(decoded, doc) == 0, "Compressed output written through the async writer");
+        free(decoded);
+        if (input) fclose(input);
+        if (raw) fclose(raw);
+    }
 }
 
 // =============================================================================
@@ -569,7 +2655,246 @@ void test_json_utilities() {
 // Simple task function for threading tests
 static void increment_task(void* arg) {
     volatile int* cnt = (volatile int*)arg;
-    (*cnt)++;
+    __atomic_fetch_add(cnt, 1, __ATOMIC_RELAXED);
+}
+
+typedef struct {
+    int* hits;
+    int max_slot;
+    int bad_slot;
+} RangeCoverage;
+
+static void count_range(void* context, int begin, int end, int slot) {
+    RangeCoverage* coverage = (RangeCoverage*)context;
+    if (slot < 0 || slot > coverage->max_slot) {
+        __atomic_store_n(&coverage->bad_slot, 1, __ATOMIC_RELAXED);
+    }
+    for (int i = begin; i < end; i++) {
+        __atomic_fetch_add(&coverage->hits[i], 1, __ATOMIC_RELAXED);
+    }
+}
+
+#ifdef TEST_SERVER_SUPPORTED
+typedef struct {
+    const char* path;
+    int result;
+    int max_clients;
+} ServerTestThread;
+
+static void* server_test_thread(void* arg) {
+    ServerTestThread* thread = (ServerTestThread*)arg;
+    JsonServerOptions options = {2, thread->max_clients, 0};
+    thread->result = json_server_run(thread->path, &options);
+    return NULL;
+}
+
+static int server_test_connect(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    for (int attempt = 0; attempt < 500; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) return fd;
+        close(fd);
+        struct timespec pause = {0, 10 * 1000 * 1000};
+        nanosleep(&pause, NULL);
+    }
+    return -1;
+}
+
+static int server_test_io(int fd, void* buffer, size_t length, int sending) {
+    char* bytes = (char*)buffer;
+    while (length > 0) {
+        ssize_t count = sending ? write(fd, bytes, length) : read(fd, bytes, length);
+        if (count <= 0) return -1;
+        bytes += count;
+        length -= (size_t)count;
+    }
+    return 0;
+}
+
+static void server_test_put(unsigned char* out, size_t value) {
+    out[0] = (unsigned char)(value >> 24);
+    out[1] = (unsigned char)(value >> 16);
+    out[2] = (unsigned char)(value >> 8);
+    out[3] = (unsigned char)value;
+}
+
+static unsigned int server_test_get(const unsigned char* in) {
+    return ((unsigned int)in[0] << 24) | ((unsigned int)in[1] << 16) | ((unsigned int)in[2] << 8) | in[3];
+}
+
+static int server_test_send(int fd, const char* header, const char* payload) {
+    unsigned char frame[8];
+    server_test_put(frame, strlen(header));
+    server_test_put(frame + 4, strlen(payload));
+    if (server_test_io(fd, frame, sizeof(frame), 1) != 0) return -1;
+    if (server_test_io(fd, (void*)header, strlen(header), 1) != 0) return -1;
+    return server_test_io(fd, (void*)payload, strlen(payload), 1);
+}
+
+// Reads one response; returns the body (caller frees) and sets *status
+static char* server_test_receive(int fd, int* status) {
+    unsigned char frame[8];
+    if (server_test_io(fd, frame, sizeof(frame), 0) != 0) return NULL;
+    *status = (int)server_test_get(frame);
+    unsigned int length = server_test_get(frame + 4);
+    char* body = malloc(length + 1);
+    if (!body) return NULL;
+    if (server_test_io(fd, body, length, 0) != 0) {
+        free(body);
+        return NULL;
+    }
+    body[length] = '\0';
+    return body;
+}
+
+// Holds a pool worker until the gate opens
+static void server_test_gate(void* arg) {
+    volatile int* gate = (volatile int*)arg;
+    while (!__atomic_load_n(gate, __ATOMIC_ACQUIRE)) {
+        struct timespec pause = {0, 1000 * 1000};
+        nanosleep(&pause, NULL);
+    }
+}
+
+static int server_test_call(int fd, const char* header, const char* payload, const char* expected, int expected_status) {
+    int status = -1;
+    if (server_test_send(fd, header, payload) != 0) return 0;
+    char* body = server_test_receive(fd, &status);
+    int matches = body && status == expected_status && (!expected || strcmp(body, expected) == 0);
+    free(body);
+    return matches;
+}
+#endif
+
+void test_server() {
+    TEST_SECTION("Server Mode Tests");
+
+#ifdef TEST_SERVER_SUPPORTED
+    ServerTestThread thread = {"cjson_tools_test_server.sock", -1, 0};
+    pthread_t handle;
+    TEST_ASSERT_EQUAL(0, pthread_create(&handle, NULL, server_test_thread, &thread), "Server thread started");
+
+    int fd = server_test_connect(thread.path);
+    TEST_ASSERT(fd >= 0, "Client connected to the socket");
+    if (fd >= 0) {
+        TEST_ASSERT(server_test_call(fd, "{\"op\":\"ping\"}", "", "{\"op\":\"ping\"}", JSON_SERVER_OK),
+                    "Ping echoes the request header");
+        TEST_ASSERT(server_test_call(fd, "{\"op\":\"flatten\"}", "{\"a\":{\"b\":[1,2]}}",
+                                     "{\"a.b[0]\":1,\"a.b[1]\":2}", JSON_SERVER_OK),
+                    "Flatten request answered");
+        const char* replace = "{\"op\":\"replace-values\",\"pattern\":\"^v_\",\"replacement\":\"w\"}";
+        TEST_ASSERT(server_test_call(fd, replace, "{\"a\":\"v_1\",\"b\":\"x\"}", "{\"a\":\"w\",\"b\":\"x\"}", JSON_SERVER_OK) &&
+                    server_test_call(fd, replace, "[\"v_2\"]", "[\"w\"]", JSON_SERVER_OK),
+                    "Cached pattern reused across requests");
+        TEST_ASSERT(server_test_call(fd, "{\"op\":\"pipeline\",\"steps\":\"remove-nulls,flatten\"}",
+                                     "{\"a\":{\"b\":null,\"c\":1}}", "{\"a.c\":1}", JSON_SERVER_OK),
+                    "Pipeline request answered");
+        const char* validate = "{\"op\":\"validate\",\"schema\":{\"type\":\"object\",\"properties\":"
+                               "{\"id\":{\"type\":\"integer\"}},\"required\":[\"id\"]}}";
+        TEST_ASSERT(server_test_call(fd, validate, "{\"id\":1}", "{\"valid\":true,\"errors\":[]}", JSON_SERVER_OK),
+                    "Valid record accepted");
+        TEST_ASSERT(server_test_call(fd, validate, "{\"id\":\"x\"}", NULL, JSON_SERVER_INVALID),
+                    "Invalid record reported with its own status");
+        TEST_ASSERT(server_test_call(fd, "{\"op\":\"nope\"}", "{}", NULL, JSON_SERVER_ERROR),
+                    "Unknown operation rejected");
+        TEST_ASSERT(server_test_call(fd, "{\"op\":\"flatten\"}", "{\"a\":", NULL, JSON_SERVER_ERROR),
+                    "Malformed payload rejected");
+
+        // Requests written back to back are answered in order
+        int pipelined = server_test_send(fd, "{\"op\":\"flatten\"}", "{\"x\":{\"y\":1}}") == 0 &&
+                        server_test_send(fd, "{\"op\":\"flatten\"}", "{\"x\":{\"y\":2}}") == 0;
+        int status = -1;
+        char* first = pipelined ? server_test_receive(fd, &status) : NULL;
+        char* second = first ? server_test_receive(fd, &status) : NULL;
+        TEST_ASSERT(first && second && strcmp(first, "{\"x.y\":1}") == 0 && strcmp(second, "{\"x.y\":2}") == 0,
+                    "Pipelined requests answered in order");
+        free(first);
+        free(second);
+        close(fd);
+    }
+
+    json_server_stop();
+    pthread_join(handle, NULL);
+    TEST_ASSERT_EQUAL(0, thread.result, "Server returned cleanly after stop");
+    TEST_ASSERT(access(thread.path, F_OK) != 0, "Socket file removed on exit");
+
+    // With every queue of the pool full, requests run inline on the poll thread.
+    // A request blocked mid-payload lets a second request and new connections
+    // arrive together; connections handed back must still fit two slots.
+    ThreadPool* blocked = thread_pool_acquire_shared(2);
+    volatile int gate = 0;
+    TaskLatch filled = {0};
+    // Refilled once the workers hold their first gate task, so no slot frees up later
+    for (int round = 0; round < 2; round++) {
+        for (int queued = 0; queued < (1 << 20); queued++) {
+            if (thread_pool_add_task_latched(blocked, server_test_gate, (void*)&gate, &filled) != 0) break;
+        }
+        struct timespec settle = {0, 50 * 1000 * 1000};
+        nanosleep(&settle, NULL);
+    }
+    ServerTestThread saturated = {"cjson_tools_test_server.sock", -1, 2};
+    pthread_t saturated_handle;
+    TEST_ASSERT_EQUAL(0, pthread_create(&saturated_handle, NULL, server_test_thread, &saturated),
+                      "Server started on a saturated pool");
+
+    int slow = server_test_connect(saturated.path);
+    int quick = server_test_connect(saturated.path);
+    int ok = slow >= 0 && quick >= 0 &&
+             server_test_call(slow, "{\"op\":\"ping\"}", "", NULL, JSON_SERVER_OK) &&
+             server_test_call(quick, "{\"op\":\"ping\"}", "", NULL, JSON_SERVER_OK);
+    TEST_ASSERT(ok, "Both connection slots in use");
+
+    int waiting[2] = {-1, -1};
+    if (ok) {
+        const char* header = "{\"op\":\"flatten\"}";
+        const char* payload = "{\"a\":{\"b\":1}}";
+        unsigned char frame[8];
+        server_test_put(frame, strlen(header));
+        server_test_put(frame + 4, strlen(payload));
+        ok = server_test_io(slow, frame, sizeof(frame), 1) == 0 &&
+             server_test_io(slow, (void*)header, strlen(header), 1) == 0 &&
+             server_test_io(slow, (void*)payload, 4, 1) == 0;
+
+        struct timespec pause = {0, 50 * 1000 * 1000};
+        nanosleep(&pause, NULL);
+        ok = ok && server_test_send(quick, "{\"op\":\"flatten\"}", "{\"x\":{\"y\":2}}") == 0;
+        for (int i = 0; i < 2; i++) waiting[i] = server_test_connect(saturated.path);
+        nanosleep(&pause, NULL);
+        ok = ok && server_test_io(slow, (void*)(payload + 4), strlen(payload) - 4, 1) == 0;
+
+        int status = -1;
+        char* first = ok ? server_test_receive(slow, &status) : NULL;
+        char* second = first ? server_test_receive(quick, &status) : NULL;
+        TEST_ASSERT(first && second && strcmp(first, "{\"a.b\":1}") == 0 && strcmp(second, "{\"x.y\":2}") == 0,
+                    "Inline requests answered while connections queue");
+        free(first);
+        free(second);
+    }
+    if (slow >= 0) close(slow);
+    if (quick >= 0) close(quick);
+
+    // Freed slots admit the queued connections
+    int served = 1;
+    for (int i = 0; i < 2; i++) {
+        served = served && waiting[i] >= 0 &&
+                 server_test_call(waiting[i], "{\"op\":\"flatten\"}", "{\"q\":[1]}", "{\"q[0]\":1}", JSON_SERVER_OK);
+        if (waiting[i] >= 0) close(waiting[i]);
+    }
+    TEST_ASSERT(served, "Queued connections served once slots free up");
+
+    json_server_stop();
+    pthread_join(saturated_handle, NULL);
+    TEST_ASSERT_EQUAL(0, saturated.result, "Saturated server returned cleanly after stop");
+    __atomic_store_n(&gate, 1, __ATOMIC_RELEASE);
+    thread_pool_wait_latch(blocked, &filled);
+    thread_pool_release(blocked);
+#else
+    TEST_ASSERT_EQUAL(-1, json_server_run("cjson_tools_test_server.sock", NULL), "Server unsupported on this platform");
+#endif
 }
 
 void test_threading() {
@@ -603,9 +2928,118 @@ void test_threading() {
         TIME_END("Waiting for task completion");
         
         TEST_ASSERT_EQUAL(10, counter, "All tasks executed correctly");
-        
+
         thread_pool_destroy(pool);
     }
+
+    // A single worker must drain its own queue
+    ThreadPool* single = thread_pool_create(1);
+    TEST_ASSERT_NOT_NULL(single, "Single-thread pool created successfully");
+    if (single) {
+        volatile int counter = 0;
+        for (int i = 0; i < 5; i++) {
+            thread_pool_add_task(single, increment_task, (void*)&counter);
+        }
+        thread_pool_wait(single);
+        TEST_ASSERT_EQUAL(5, counter, "Single-thread pool runs its own tasks");
+        thread_pool_release(single);
+    }
+
+    // Latches track one group of tasks; the second round runs on parked workers
+    ThreadPool* latched = thread_pool_create(3);
+    if (latched) {
+        for (int round = 0; round < 2; round++) {
+            volatile int counter = 0;
+            TaskLatch latch = {0};
+            for (int i = 0; i < 200; i++) {
+                if (thread_pool_add_task_latched(latched, increment_task, (void*)&counter, &latch) != 0) {
+                    increment_task((void*)&counter);
+                }
+            }
+            thread_pool_wait_latch(latched, &latch);
+            TEST_ASSERT_EQUAL(200, counter, round == 0 ? "Latch waits for its tasks"
+                                                       : "Parked workers wake for a new batch");
+            TEST_ASSERT_EQUAL(0, (int)thread_pool_get_queue_size(latched), "Pool drained after latch wait");
+
+            // Long enough for every worker to give up spinning and park
+            clock_t idle_start = clock();
+            while (clock() - idle_start < CLOCKS_PER_SEC / 50) {
+            }
+        }
+        thread_pool_release(latched);
+    }
+
+    // Chunked loops cover every index exactly once, on a pool or inline
+    ThreadPool* ranged = thread_pool_create(3);
+    int hits[5000];
+    for (int round = 0; round < 2; round++) {
+        ThreadPool* target = round == 0 ? ranged : NULL;
+        memset(hits, 0, sizeof(hits));
+        RangeCoverage coverage = {hits, thread_pool_get_thread_count(target), 0};
+        TEST_ASSERT_EQUAL(0, thread_pool_parallel_for(target, 5000, 16, count_range, &coverage),
+                          "Parallel for runs");
+        int exact = 1;
+        for (int i = 0; i < 5000; i++) {
+            if (hits[i] != 1) exact = 0;
+        }
+        TEST_ASSERT(exact, round == 0 ? "Pool parallel for covers each index once"
+                                      : "Inline parallel for covers each index once");
+        TEST_ASSERT(!coverage.bad_slot, "Parallel for slots stay within the thread count");
+    }
+    thread_pool_release(ranged);
+
+    // The shared pool is reused across calls and only grows on demand
+    thread_pool_shutdown_shared();
+    TEST_ASSERT_EQUAL(0, thread_pool_shared_thread_count(), "Shared pool starts out empty");
+
+    ThreadPool* shared = thread_pool_acquire_shared(2);
+    ThreadPool* again = thread_pool_acquire_shared(2);
+    TEST_ASSERT(shared && again && shared->base == again->base, "Shared pool reused across acquisitions");
+    thread_pool_release(again);
+
+    ThreadPool* grown = thread_pool_acquire_shared(3);
+    TEST_ASSERT(grown && shared && grown->base != shared->base, "Shared pool replaced when more threads are requested");
+    TEST_ASSERT_EQUAL(3, thread_pool_shared_thread_count(), "Shared pool grew to the requested size");
+    thread_pool_release(shared);
+    thread_pool_release(grown);
+
+    // A narrower call on the grown pool keeps to its own thread count, caller included
+    ThreadPool* narrow = thread_pool_acquire_shared(2);
+    TEST_ASSERT_EQUAL(2, thread_pool_get_thread_count(narrow), "Shared handle reports the requested threads");
+    memset(hits, 0, sizeof(hits));
+    RangeCoverage capped = {hits, 1, 0};
+    thread_pool_parallel_for(narrow, 5000, 16, count_range, &capped);
+    TEST_ASSERT(!capped.bad_slot, "Shared handle runs no more threads than requested");
+    thread_pool_release(narrow);
+
+    TEST_ASSERT_EQUAL(2, thread_pool_configure_shared(2), "Shared pool resized explicitly");
+    TEST_ASSERT_EQUAL(2, thread_pool_shared_thread_count(), "Shared pool shrinks when configured");
+
+    // Batch calls on shared and caller-owned pools match single-threaded output
+    char* large_json = create_large_test_json(300);
+    cJSON* batch = cJSON_Parse(large_json);
+    ThreadPool* owned = thread_pool_create(2);
+    if (batch && owned) {
+        cJSON* expected = flatten_json_batch(batch, 0, 0);
+        cJSON* on_shared = flatten_json_batch(batch, 1, 2);
+        cJSON* on_owned = flatten_json_batch_with_pool(batch, owned);
+        TEST_ASSERT(cJSON_Compare(expected, on_shared, 1), "Shared-pool batch matches single-threaded");
+        TEST_ASSERT(cJSON_Compare(expected, on_owned, 1), "Caller-owned pool batch matches single-threaded");
+
+        cJSON* schema = generate_schema_from_batch(batch, 0, 0);
+        cJSON* schema_owned = generate_schema_from_batch_with_pool(batch, owned);
+        TEST_ASSERT(cJSON_Compare(schema, schema_owned, 1), "Caller-owned pool schema matches single-threaded");
+
+        cJSON_Delete(expected);
+        cJSON_Delete(on_shared);
+        cJSON_Delete(on_owned);
+        cJSON_Delete(schema);
+        cJSON_Delete(schema_owned);
+    }
+    thread_pool_release(owned);
+    cJSON_Delete(batch);
+    free(large_json);
+    thread_pool_shutdown_shared();
 #else
     printf(ANSI_COLOR_YELLOW "ℹ  Threading tests skipped (threading disabled)" ANSI_COLOR_RESET "\n");
 #endif
@@ -837,12 +3271,31 @@ int main(int argc, char* argv[]) {
     
     // Run all test suites
     test_memory_pools();
+    test_json_arena();
     test_string_utilities();
     test_cpu_detection();
     test_json_flattening();
+    test_json_printer();
+    test_flatten_shape_cache();
+    test_unflatten();
+    test_path_projection();
+    test_structural_parser();
+    test_simd_dispatch();
+    test_parallel_array_parse();
     test_json_schema_generation();
+    test_schema_builder();
     test_path_extraction();
     test_json_utilities();
+    test_ndjson_streaming();
+    test_schema_validation();
+    test_schema_sampling();
+    test_columnar_output();
+    test_transformation_pipeline();
+    test_runtime_stats();
+    test_file_input();
+    test_compressed_streams();
+    test_stream_output();
+    test_server();
     test_threading();
     test_error_handling();
     test_memory_validation();
@@ -5,7 +5,7 @@ This package provides Python bindings for the cJSON-Tools library,
 which includes tools for flattening nested JSON structures, path type analysis,
 generating JSON schemas, filtering JSON data, and advanced performance optimizations including:
 
-- JSON flattening with array indexing support
+- JSON flattening with array indexing support, and unflattening back
 - Path type analysis for schema discovery
 - Remove keys with empty string values
 - Remove keys with null values
@@ -13,30 +13,58 @@ generating JSON schemas, filtering JSON data, and advanced performance optimizat
 - Memory pool management
 - Multi-threaded processing
 - Pretty printing support
+- A client for the warm ``json_tools --serve`` process
 """
 
 from ._cjson_tools import (
+    SchemaBuilder,
+    SchemaValidator,
+    ThreadPool,
     __version__,
+    apply_pipeline,
+    configure_thread_pool,
+    extract_paths,
     flatten_json,
     flatten_json_batch,
+    flatten_json_columnar,
     generate_schema,
     generate_schema_batch,
     get_flattened_paths_with_types,
+    get_stats,
     remove_empty_strings,
     remove_nulls,
     replace_keys,
     replace_values,
+    reset_stats,
+    shutdown_thread_pool,
+    unflatten_json,
+    unflatten_json_batch,
 )
+from .client import Client, ServerError
 
 __all__ = [
+    "Client",
+    "SchemaBuilder",
+    "SchemaValidator",
+    "ServerError",
+    "ThreadPool",
+    "apply_pipeline",
+    "configure_thread_pool",
+    "extract_paths",
     "flatten_json",
     "flatten_json_batch",
+    "flatten_json_columnar",
     "generate_schema",
     "generate_schema_batch",
     "get_flattened_paths_with_types",
+    "get_stats",
     "remove_empty_strings",
     "remove_nulls",
     "replace_keys",
     "replace_values",
+    "reset_stats",
+    "shutdown_thread_pool",
+    "unflatten_json",
+    "unflatten_json_batch",
     "__version__",
 ]
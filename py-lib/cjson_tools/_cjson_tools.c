@@ -3,25 +3,1108 @@
 #include "../../c-lib/include/cjson_tools.h"
 
 #define MODULE_VERSION "1.9.0"
+#define PATTERN_CACHE_MAX 64
+#define PATTERN_CAPSULE_NAME "cjson_tools.pattern"
+
+// Compiled patterns keyed by pattern string, shared by replace_keys/replace_values
+static PyObject* g_pattern_cache = NULL;
+
+static void pattern_capsule_destructor(PyObject* capsule) {
+    cjson_tools_pattern_free(PyCapsule_GetPointer(capsule, PATTERN_CAPSULE_NAME));
+}
+
+/**
+ * Look up or compile a pattern. Returns a new reference to a capsule holding
+ * the compiled pattern, or NULL (without an exception) if it does not compile.
+ * The capsule keeps the pattern alive while the GIL is released.
+ */
+static PyObject* get_cached_pattern(const char* pattern) {
+    PyObject* capsule = PyDict_GetItemString(g_pattern_cache, pattern);
+    if (capsule) {
+        Py_INCREF(capsule);
+        return capsule;
+    }
+
+    CompiledPattern* compiled = cjson_tools_pattern_compile(pattern);
+    if (!compiled) return NULL;
+
+    capsule = PyCapsule_New(compiled, PATTERN_CAPSULE_NAME, pattern_capsule_destructor);
+    if (!capsule) {
+        cjson_tools_pattern_free(compiled);
+        PyErr_Clear();
+        return NULL;
+    }
+
+    // Same policy as the re module: drop everything once the cache is full
+    if (PyDict_Size(g_pattern_cache) >= PATTERN_CACHE_MAX) {
+        PyDict_Clear(g_pattern_cache);
+    }
+    if (PyDict_SetItemString(g_pattern_cache, pattern, capsule) != 0) {
+        PyErr_Clear();
+    }
+    return capsule;
+}
+
+// =============================================================================
+// THREAD POOL OBJECT
+// =============================================================================
+
+/**
+ * Caller-owned worker pool, passed to the batch functions as pool=
+ */
+typedef struct {
+    PyObject_HEAD
+    ThreadPool* pool;
+} ThreadPoolObject;
+
+static void ThreadPool_dealloc(ThreadPoolObject* self) {
+    thread_pool_release(self->pool);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int ThreadPool_init(ThreadPoolObject* self, PyObject* args, PyObject* kwargs) {
+    int num_threads = 0;
+    static char* kwlist[] = {"num_threads", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", kwlist, &num_threads)) {
+        return -1;
+    }
+    if (num_threads < 0) {
+        PyErr_SetString(PyExc_ValueError, "num_threads must be >= 0");
+        return -1;
+    }
+
+    ThreadPool* pool;
+    Py_BEGIN_ALLOW_THREADS
+    pool = thread_pool_create(num_threads);
+    Py_END_ALLOW_THREADS
+
+    if (pool == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to create thread pool");
+        return -1;
+    }
+
+    thread_pool_release(self->pool);
+    self->pool = pool;
+    return 0;
+}
+
+static PyObject* ThreadPool_close(ThreadPoolObject* self, PyObject* unused) {
+    (void)unused;
+    ThreadPool* pool = self->pool;
+    self->pool = NULL;
+
+    // Calls still running on the pool hold their own reference
+    Py_BEGIN_ALLOW_THREADS
+    thread_pool_release(pool);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* ThreadPool_enter(ThreadPoolObject* self, PyObject* unused) {
+    (void)unused;
+    Py_INCREF(self);
+    return (PyObject*)self;
+}
+
+static PyObject* ThreadPool_exit(ThreadPoolObject* self, PyObject* args) {
+    (void)args;
+    return ThreadPool_close(self, NULL);
+}
+
+static PyObject* ThreadPool_get_num_threads(ThreadPoolObject* self, void* closure) {
+    (void)closure;
+    return PyLong_FromLong(thread_pool_get_thread_count(self->pool));
+}
+
+static PyMethodDef ThreadPool_methods[] = {
+    {"close", (PyCFunction)ThreadPool_close, METH_NOARGS,
+     "Stop the worker threads once no call is using them."},
+    {"__enter__", (PyCFunction)ThreadPool_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)ThreadPool_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}  // Sentinel
+};
+
+static PyGetSetDef ThreadPool_getset[] = {
+    {"num_threads", (getter)ThreadPool_get_num_threads, NULL,
+     "Number of worker threads (0 once closed)", NULL},
+    {NULL, NULL, NULL, NULL, NULL}  // Sentinel
+};
+
+static PyTypeObject ThreadPoolType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cjson_tools.ThreadPool",
+    .tp_basicsize = sizeof(ThreadPoolObject),
+    .tp_dealloc = (destructor)ThreadPool_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Reusable worker pool for the batch functions. Args: num_threads=0 (auto)",
+    .tp_methods = ThreadPool_methods,
+    .tp_getset = ThreadPool_getset,
+    .tp_init = (initproc)ThreadPool_init,
+    .tp_new = PyType_GenericNew,
+};
+
+/**
+ * Resolve an optional pool= argument. Returns a new C reference (released by
+ * the caller) in *out, or -1 with an exception set.
+ */
+static int get_pool_argument(PyObject* pool_obj, ThreadPool** out) {
+    *out = NULL;
+    if (pool_obj == NULL || pool_obj == Py_None) {
+        return 0;
+    }
+    if (!PyObject_TypeCheck(pool_obj, &ThreadPoolType)) {
+        PyErr_SetString(PyExc_TypeError, "pool must be a cjson_tools.ThreadPool");
+        return -1;
+    }
+    ThreadPool* pool = ((ThreadPoolObject*)pool_obj)->pool;
+    if (pool == NULL) {
+        PyErr_SetString(PyExc_ValueError, "ThreadPool is closed");
+        return -1;
+    }
+    *out = thread_pool_retain(pool);
+    return 0;
+}
+
+// =============================================================================
+// INPUT AND OUTPUT CONVERSION
+// =============================================================================
+
+/**
+ * A JSON argument: str or a bytes-like object (read in place through the
+ * buffer protocol), or a native dict/list/value converted to cJSON up front.
+ * Set up and released with the GIL held; parsed without it.
+ */
+typedef struct {
+    PyObject* owner;      // str whose UTF-8 buffer is borrowed
+    Py_buffer view;       // Exported buffer of a bytes-like input
+    int has_view;
+    const char* text;     // NULL for native input
+    Py_ssize_t length;
+    int terminated;       // text[length] is the only NUL, so the C string entry points apply
+    cJSON* tree;          // Converted native input, until taken by json_argument_parse
+} JsonArgument;
+
+static cJSON* python_to_cjson(PyObject* obj);
+
+static cJSON* python_container_to_cjson(PyObject* obj) {
+    if (PyDict_Check(obj)) {
+        cJSON* object = cJSON_CreateObject();
+        if (!object) return NULL;
+
+        PyObject* key;
+        PyObject* value;
+        Py_ssize_t pos = 0;
+        while (PyDict_Next(obj, &pos, &key, &value)) {
+            if (!PyUnicode_Check(key)) {
+                PyErr_Format(PyExc_TypeError, "keys must be str, not %.200s", Py_TYPE(key)->tp_name);
+                cJSON_Delete(object);
+                return NULL;
+            }
+            const char* name = PyUnicode_AsUTF8(key);
+            cJSON* item = name ? python_to_cjson(value) : NULL;
+            if (!item || !cJSON_AddItemToObject(object, name, item)) {
+                cJSON_Delete(item);
+                cJSON_Delete(object);
+                return NULL;
+            }
+        }
+        return object;
+    }
+
+    cJSON* array = cJSON_CreateArray();
+    if (!array) return NULL;
+
+    // Lists and tuples; no Python code runs here, so the list cannot change
+    Py_ssize_t size = PySequence_Fast_GET_SIZE(obj);
+    PyObject** items = PySequence_Fast_ITEMS(obj);
+    for (Py_ssize_t i = 0; i < size; i++) {
+        cJSON* item = python_to_cjson(items[i]);
+        if (!item || !cJSON_AddItemToArray(array, item)) {
+            cJSON_Delete(item);
+            cJSON_Delete(array);
+            return NULL;
+        }
+    }
+    return array;
+}
+
+/**
+ * Convert a Python value the way json.dumps would, or return NULL with an
+ * exception set. bool is checked before int since it is a subclass.
+ */
+static cJSON* python_to_cjson(PyObject* obj) {
+    cJSON* item;
+
+    if (obj == Py_None) {
+        item = cJSON_CreateNull();
+    } else if (PyBool_Check(obj)) {
+        item = cJSON_CreateBool(obj == Py_True);
+    } else if (PyLong_Check(obj)) {
+        double value = PyLong_AsDouble(obj);
+        if (value == -1.0 && PyErr_Occurred()) return NULL;
+        item = cJSON_CreateNumber(value);
+    } else if (PyFloat_Check(obj)) {
+        item = cJSON_CreateNumber(PyFloat_AS_DOUBLE(obj));
+    } else if (PyUnicode_Check(obj)) {
+        const char* value = PyUnicode_AsUTF8(obj);
+        if (!value) return NULL;
+        item = cJSON_CreateString(value);
+    } else if (PyDict_Check(obj) || PyList_Check(obj) || PyTuple_Check(obj)) {
+        if (Py_EnterRecursiveCall(" while converting a Python object to JSON")) return NULL;
+        item = python_container_to_cjson(obj);
+        Py_LeaveRecursiveCall();
+    } else {
+        PyErr_Format(PyExc_TypeError, "Object of type %.200s is not JSON serializable",
+                     Py_TYPE(obj)->tp_name);
+        return NULL;
+    }
+
+    if (!item && !PyErr_Occurred()) {
+        PyErr_NoMemory();
+    }
+    return item;
+}
+
+/**
+ * Set up a JSON argument. Returns -1 with an exception set, in which case
+ * nothing needs to be released.
+ */
+static int json_argument_init(PyObject* obj, JsonArgument* arg) {
+    memset(arg, 0, sizeof(*arg));
+
+    if (PyUnicode_Check(obj)) {
+        arg->text = PyUnicode_AsUTF8AndSize(obj, &arg->length);
+        if (!arg->text) return -1;
+        if (strlen(arg->text) != (size_t)arg->length) {
+            PyErr_SetString(PyExc_ValueError, "embedded null character");
+            return -1;
+        }
+        Py_INCREF(obj);
+        arg->owner = obj;
+        arg->terminated = 1;
+        return 0;
+    }
+
+    if (PyObject_CheckBuffer(obj)) {
+        if (PyObject_GetBuffer(obj, &arg->view, PyBUF_SIMPLE) != 0) return -1;
+        arg->has_view = 1;
+        arg->text = arg->view.buf;
+        arg->length = arg->view.len;
+        // bytes and bytearray keep a NUL after their data; other exporters may not
+        arg->terminated = (PyBytes_Check(obj) || PyByteArray_Check(obj)) &&
+                          memchr(arg->text, '\0', (size_t)arg->length) == NULL;
+        return 0;
+    }
+
+    arg->tree = python_to_cjson(obj);
+    return arg->tree ? 0 : -1;
+}
+
+/**
+ * Parse the argument; a converted native tree is handed over instead. The
+ * caller owns the result. Does not need the GIL.
+ */
+static cJSON* json_argument_parse(JsonArgument* arg, int simd_parser) {
+    if (!arg->text) {
+        cJSON* tree = arg->tree;
+        arg->tree = NULL;
+        return tree;
+    }
+    if (simd_parser) {
+        return json_parse_structural(arg->text, (size_t)arg->length, NULL, 0);
+    }
+    return cJSON_ParseWithLength(arg->text, (size_t)arg->length);
+}
+
+/**
+ * Keep only the selected paths of the argument; text input is parsed lazily
+ */
+static cJSON* json_argument_parse_paths(JsonArgument* arg, const JsonPathSet* paths, int per_record) {
+    if (arg->text) {
+        return json_parse_paths(arg->text, (size_t)arg->length, paths, per_record);
+    }
+    cJSON* tree = json_argument_parse(arg, 0);
+    cJSON* extracted = extract_json_paths(tree, paths, per_record);
+    cJSON_Delete(tree);
+    return extracted;
+}
+
+static void json_argument_release(JsonArgument* arg) {
+    cJSON_Delete(arg->tree);
+    if (arg->has_view) {
+        PyBuffer_Release(&arg->view);
+    }
+    Py_XDECREF(arg->owner);
+}
+
+/**
+ * Collect the elements of a list of JSON arguments, each holding its own
+ * references so the list may change while the GIL is released. Returns NULL
+ * with an exception set; *count receives the number of elements.
+ */
+static JsonArgument* json_list_arguments(PyObject* json_list, Py_ssize_t* count) {
+    if (!PyList_Check(json_list)) {
+        PyErr_SetString(PyExc_TypeError, "Expected a list of JSON strings, bytes or objects");
+        return NULL;
+    }
+
+    Py_ssize_t list_size = PyList_GET_SIZE(json_list);
+    JsonArgument* items = PyMem_Calloc(list_size > 0 ? (size_t)list_size : 1, sizeof(JsonArgument));
+    if (items == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    for (Py_ssize_t i = 0; i < list_size; i++) {
+        // Conversion runs no Python code, so the list cannot shrink meanwhile
+        if (json_argument_init(PyList_GET_ITEM(json_list, i), &items[i]) != 0) {
+            while (i-- > 0) {
+                json_argument_release(&items[i]);
+            }
+            PyMem_Free(items);
+            return NULL;
+        }
+    }
+    *count = list_size;
+    return items;
+}
+
+static void json_list_arguments_free(JsonArgument* items, Py_ssize_t count) {
+    for (Py_ssize_t i = 0; i < count; i++) {
+        json_argument_release(&items[i]);
+    }
+    PyMem_Free(items);
+}
+
+/**
+ * Parse collected elements into a new cJSON array without the GIL. Returns
+ * NULL with the index of the invalid element in *failed_index (-1 when out
+ * of memory).
+ */
+static cJSON* json_arguments_to_array(JsonArgument* items, Py_ssize_t count, Py_ssize_t* failed_index) {
+    *failed_index = -1;
+    cJSON* json_array = cJSON_CreateArray();
+    if (json_array == NULL) {
+        return NULL;
+    }
+
+    for (Py_ssize_t i = 0; i < count; i++) {
+        cJSON* json_obj = json_argument_parse(&items[i], 0);
+        if (json_obj == NULL) {
+            *failed_index = i;
+            cJSON_Delete(json_array);
+            return NULL;
+        }
+        cJSON_AddItemToArray(json_array, json_obj);
+    }
+    return json_array;
+}
+
+/**
+ * Parse a list of JSON arguments into a new cJSON array, or return NULL with
+ * an exception set. Only collecting the elements holds the GIL.
+ */
+static cJSON* json_list_to_array(PyObject* json_list) {
+    Py_ssize_t count;
+    JsonArgument* items = json_list_arguments(json_list, &count);
+    if (items == NULL) {
+        return NULL;
+    }
+
+    cJSON* json_array;
+    Py_ssize_t failed_index;
+    Py_BEGIN_ALLOW_THREADS
+    json_array = json_arguments_to_array(items, count, &failed_index);
+    Py_END_ALLOW_THREADS
+
+    json_list_arguments_free(items, count);
+
+    if (json_array == NULL) {
+        if (failed_index >= 0) {
+            PyErr_Format(PyExc_ValueError, "Invalid JSON at index %zd", failed_index);
+        } else {
+            PyErr_SetString(PyExc_MemoryError, "Failed to create JSON array");
+        }
+    }
+    return json_array;
+}
+
+// Integral values print without a fraction, so they come back as int
+#define PY_EXACT_INTEGER_LIMIT 9007199254740992.0  // 2^53
+
+/**
+ * Build native Python objects from a cJSON tree, like json.loads of its text.
+ * Object keys are interned, so records of the same shape share key objects.
+ * cJSON keeps every number as a double: integral values within 2^53 become
+ * int and all others float.
+ */
+static PyObject* cjson_to_python(const cJSON* item) {
+    switch (item->type & 0xFF) {
+        case cJSON_False:
+            Py_RETURN_FALSE;
+        case cJSON_True:
+            Py_RETURN_TRUE;
+        case cJSON_NULL:
+            Py_RETURN_NONE;
+        case cJSON_Number: {
+            double value = item->valuedouble;
+            if (value == floor(value) && fabs(value) < PY_EXACT_INTEGER_LIMIT) {
+                return PyLong_FromLongLong((long long)value);
+            }
+            return PyFloat_FromDouble(value);
+        }
+        case cJSON_String:
+        case cJSON_Raw:
+            return PyUnicode_FromString(item->valuestring ? item->valuestring : "");
+        case cJSON_Array:
+        case cJSON_Object:
+            break;
+        default:
+            Py_RETURN_NONE;
+    }
+
+    if (Py_EnterRecursiveCall(" while converting JSON to a Python object")) {
+        return NULL;
+    }
+
+    PyObject* container;
+    if ((item->type & 0xFF) == cJSON_Array) {
+        container = PyList_New(cJSON_GetArraySize(item));
+        Py_ssize_t index = 0;
+        for (const cJSON* child = item->child; container && child; child = child->next) {
+            PyObject* value = cjson_to_python(child);
+            if (value == NULL) {
+                Py_CLEAR(container);
+                break;
+            }
+            PyList_SET_ITEM(container, index++, value);
+        }
+    } else {
+        container = PyDict_New();
+        for (const cJSON* child = item->child; container && child; child = child->next) {
+            PyObject* key = PyUnicode_InternFromString(child->string ? child->string : "");
+            PyObject* value = key ? cjson_to_python(child) : NULL;
+            if (value == NULL || PyDict_SetItem(container, key, value) != 0) {
+                Py_CLEAR(container);
+            }
+            Py_XDECREF(key);
+            Py_XDECREF(value);
+        }
+    }
+
+    Py_LeaveRecursiveCall();
+    return container;
+}
+
+/**
+ * return_type= selects JSON text ("str", the default) or native Python
+ * objects ("dict"). Returns -1 with an exception set for anything else.
+ */
+static int get_return_type_argument(const char* return_type, int* as_dict) {
+    if (strcmp(return_type, "str") == 0) {
+        *as_dict = 0;
+    } else if (strcmp(return_type, "dict") == 0) {
+        *as_dict = 1;
+    } else {
+        PyErr_Format(PyExc_ValueError, "return_type must be 'str' or 'dict', not '%s'", return_type);
+        return -1;
+    }
+    return 0;
+}
+
+// sample_rate=, sample_size=, seed=, collect_stats= and enum_limit= of the schema calls
+static int get_schema_options_argument(double sample_rate, int sample_size, unsigned long long seed,
+                                       int collect_stats, int enum_limit, SchemaInferenceOptions* options) {
+    if (!(sample_rate >= 0.0 && sample_rate <= 1.0)) {
+        PyErr_SetString(PyExc_ValueError, "sample_rate must be between 0 and 1");
+        return -1;
+    }
+    if (sample_size < 0) {
+        PyErr_SetString(PyExc_ValueError, "sample_size must not be negative");
+        return -1;
+    }
+    options->sample_rate = sample_rate;
+    options->sample_size = sample_size;
+    options->seed = seed;
+    options->collect_stats = collect_stats;
+    options->enum_limit = enum_limit;
+    return 0;
+}
+
+/**
+ * arena=True: everything cJSON allocates during the call comes from a
+ * request-scoped arena that is dropped in one step when the call ends.
+ * Only used while the GIL is released, so no Python code runs inside it.
+ */
+static JsonArena* begin_call_arena(int use_arena, JsonArena** previous) {
+    JsonArena* arena = use_arena ? json_arena_create(0) : NULL;
+    *previous = arena ? json_arena_enter(arena) : NULL;
+    return arena;
+}
+
+static void end_call_arena(JsonArena* arena, JsonArena* previous) {
+    if (arena) {
+        json_arena_leave(previous);
+        json_arena_destroy(arena);
+    }
+}
+
+/**
+ * Leave the call's arena before the GIL is taken back, keeping its memory
+ * for a tree that is still converted to Python objects
+ */
+static void leave_call_arena(JsonArena* arena, JsonArena* previous) {
+    if (arena) {
+        json_arena_leave(previous);
+    }
+}
+
+/**
+ * Build a call's return value: the text, or for return_type="dict" the tree
+ * as Python objects. Frees both, then the arena the call left (which owns
+ * the tree when set).
+ */
+static PyObject* build_call_result(char* text, cJSON* tree, JsonArena* arena) {
+    PyObject* py_result;
+    if (tree) {
+        py_result = cjson_to_python(tree);
+        if (!arena) {
+            cJSON_Delete(tree);
+        }
+    } else if (text) {
+        py_result = PyUnicode_FromString(text);
+        free(text);
+    } else {
+        PyErr_SetString(PyExc_MemoryError, "Failed to format result");
+        py_result = NULL;
+    }
+    if (arena) {
+        json_arena_destroy(arena);
+    }
+    return py_result;
+}
+
+/**
+ * Flattened tree for return_type="dict", matching flatten_parsed_json_text.
+ * Takes ownership of json.
+ */
+static cJSON* flatten_parsed_json_tree(cJSON* json, int use_threads, int num_threads) {
+    if (json->type == cJSON_Array) {
+        // Same quick scan for objects as the text path
+        int has_objects = 0;
+        const cJSON* item = json->child;
+        for (int i = 0; item && i < 50; i++, item = item->next) {
+            if (item->type == cJSON_Object || item->type == cJSON_Array) {
+                has_objects = 1;
+                break;
+            }
+        }
+        if (!has_objects) {
+            return json;
+        }
+    }
+
+    cJSON* flattened = json->type == cJSON_Array ?
+        flatten_json_batch(json, use_threads, num_threads) : flatten_json_object(json);
+    cJSON_Delete(json);
+    return flattened;
+}
+
+// Schema of a parsed object or batch, like generate_schema_from_string_opts
+static cJSON* schema_from_parsed_json(cJSON* json, const SchemaInferenceOptions* options,
+                                      int use_threads, int num_threads) {
+    if (json->type == cJSON_Array) {
+        return generate_schema_from_batch_opts(json, options, use_threads, num_threads);
+    }
+    return generate_schema_from_object_opts(json, options);
+}
+
+/**
+ * Resize the process-wide pool used by threaded calls without pool=
+ */
+static PyObject* py_configure_thread_pool(PyObject* self, PyObject* args, PyObject* kwargs) {
+    (void)self; // Suppress unused parameter warning
+    int num_threads = 0;
+
+    static char* kwlist[] = {"num_threads", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", kwlist, &num_threads)) {
+        return NULL;
+    }
+    if (num_threads < 0) {
+        PyErr_SetString(PyExc_ValueError, "num_threads must be >= 0");
+        return NULL;
+    }
+
+    int result;
+    Py_BEGIN_ALLOW_THREADS
+    result = thread_pool_configure_shared(num_threads);
+    Py_END_ALLOW_THREADS
+
+    if (result < 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to configure thread pool");
+        return NULL;
+    }
+    return PyLong_FromLong(result);
+}
+
+/**
+ * Stop the process-wide pool; the next threaded call starts a new one
+ */
+static PyObject* py_shutdown_thread_pool(PyObject* self, PyObject* unused) {
+    (void)self; // Suppress unused parameter warning
+    (void)unused;
+
+    Py_BEGIN_ALLOW_THREADS
+    thread_pool_shutdown_shared();
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * Library counters and phase timings as a dict
+ */
+static PyObject* py_get_stats(PyObject* self, PyObject* unused) {
+    (void)self; // Suppress unused parameter warning
+    (void)unused;
+
+    cJSON* stats = cjson_tools_get_stats();
+    if (!stats) {
+        return PyErr_NoMemory();
+    }
+    PyObject* result = cjson_to_python(stats);
+    cJSON_Delete(stats);
+    return result;
+}
+
+/**
+ * Zero the library counters and phase timings
+ */
+static PyObject* py_reset_stats(PyObject* self, PyObject* unused) {
+    (void)self; // Suppress unused parameter warning
+    (void)unused;
+
+    cjson_tools_reset_stats();
+    Py_RETURN_NONE;
+}
+
+/**
+ * Flatten a JSON string, bytes-like object or native value
+ */
+static PyObject* py_flatten_json(PyObject* self, PyObject* args, PyObject* kwargs) {
+    (void)self; // Suppress unused parameter warning
+    PyObject* json_obj;
+    int use_threads = 0;
+    int num_threads = 0;
+    int pretty_print = 0;
+    int use_arena = 0;
+    const char* paths_spec = NULL;
+    int simd_parser = 0;
+    const char* return_type = "str";
+    int as_dict;
+
+    static char* kwlist[] = {"json_string", "use_threads", "num_threads", "pretty_print", "arena", "paths",
+                             "simd_parser", "return_type", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iiiizis", kwlist,
+                                    &json_obj, &use_threads, &num_threads, &pretty_print, &use_arena,
+                                    &paths_spec, &simd_parser, &return_type)) {
+        return NULL;
+    }
+    if (get_return_type_argument(return_type, &as_dict) != 0) {
+        return NULL;
+    }
+
+    JsonPathSet* paths = NULL;
+    if (paths_spec) {
+        paths = json_path_set_compile(paths_spec);
+        if (!paths) {
+            PyErr_Format(PyExc_ValueError, "Invalid paths: '%s'", paths_spec);
+            return NULL;
+        }
+    }
+
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
+        json_path_set_free(paths);
+        return NULL;
+    }
+
+    char* result = NULL;
+    cJSON* flattened = NULL;
+    JsonArena* arena;
+    JsonArena* previous_arena;
+
+    // Release GIL during C computation for better parallelism
+    Py_BEGIN_ALLOW_THREADS
+
+    // Initialize memory pools for optimal performance
+    init_global_pools();
+    arena = begin_call_arena(use_arena, &previous_arena);
+
+    // Flattened pairs are written straight to text in the requested format;
+    // with paths only the selected subtrees are parsed at all
+    if (input.terminated && !as_dict && !simd_parser) {
+        // C strings keep the string entry points, which parse big arrays in parallel
+        if (paths) {
+            result = flatten_json_string_paths(input.text, paths, use_threads, num_threads, pretty_print);
+        } else {
+            result = flatten_json_string_opts(input.text, use_threads, num_threads, pretty_print);
+        }
+    } else {
+        cJSON* json = paths ? json_argument_parse_paths(&input, paths, 1) : json_argument_parse(&input, simd_parser);
+        if (json && as_dict) {
+            flattened = flatten_parsed_json_tree(json, use_threads, num_threads);
+        } else if (json) {
+            result = flatten_parsed_json_text(json, use_threads, num_threads, pretty_print);
+            cJSON_Delete(json);
+        }
+    }
+    leave_call_arena(arena, previous_arena);
+    json_path_set_free(paths);
+    Py_END_ALLOW_THREADS
+
+    json_argument_release(&input);
+
+    if (result == NULL && flattened == NULL) {
+        if (arena) {
+            json_arena_destroy(arena);
+        }
+        PyErr_SetString(PyExc_ValueError, "Failed to flatten JSON");
+        return NULL;
+    }
+
+    return build_call_result(result, flattened, arena);
+}
+
+/**
+ * Flatten a batch of JSON objects
+ */
+static PyObject* py_flatten_json_batch(PyObject* self, PyObject* args, PyObject* kwargs) {
+    (void)self; // Suppress unused parameter warning
+    PyObject* json_list;
+    int use_threads = 1;
+    int num_threads = 0;
+    int pretty_print = 0;
+    PyObject* pool_obj = NULL;
+    const char* return_type = "str";
+    int as_dict;
+
+    static char* kwlist[] = {"json_list", "use_threads", "num_threads", "pretty_print", "pool", "return_type", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iiiOs", kwlist,
+                                    &json_list, &use_threads, &num_threads, &pretty_print, &pool_obj,
+                                    &return_type)) {
+        return NULL;
+    }
+    if (get_return_type_argument(return_type, &as_dict) != 0) {
+        return NULL;
+    }
+
+    ThreadPool* pool;
+    if (get_pool_argument(pool_obj, &pool) != 0) {
+        return NULL;
+    }
+
+    Py_ssize_t list_size;
+    JsonArgument* items = json_list_arguments(json_list, &list_size);
+    if (items == NULL) {
+        thread_pool_release(pool);
+        return NULL;
+    }
+
+    // Flatten the batch straight to one text per record, or to trees for dicts
+    cJSON* json_array;
+    Py_ssize_t failed_index;
+    int parsed;
+    char** flattened_texts = NULL;
+    cJSON* flattened_array = NULL;
+
+    // Release GIL during C computation for better parallelism
+    Py_BEGIN_ALLOW_THREADS
+
+    // Initialize memory pools for optimal performance
+    init_global_pools();
+
+    json_array = json_arguments_to_array(items, list_size, &failed_index);
+    parsed = json_array != NULL;
+    if (json_array && as_dict) {
+        flattened_array = pool ? flatten_json_batch_with_pool(json_array, pool) :
+                                 flatten_json_batch(json_array, use_threads, num_threads);
+    } else if (json_array && pool) {
+        flattened_texts = flatten_json_batch_text_with_pool(json_array, pool, pretty_print);
+    } else if (json_array) {
+        flattened_texts = flatten_json_batch_text(json_array, use_threads, num_threads, pretty_print);
+    }
+    thread_pool_release(pool);
+    cJSON_Delete(json_array);
+    Py_END_ALLOW_THREADS
+
+    json_list_arguments_free(items, list_size);
+
+    if (!parsed) {
+        if (failed_index >= 0) {
+            PyErr_Format(PyExc_ValueError, "Invalid JSON at index %zd", failed_index);
+        } else {
+            PyErr_SetString(PyExc_MemoryError, "Failed to create JSON array");
+        }
+        return NULL;
+    }
+
+    if (as_dict) {
+        if (flattened_array == NULL) {
+            PyErr_SetString(PyExc_ValueError, "Failed to flatten JSON batch");
+            return NULL;
+        }
+        return build_call_result(NULL, flattened_array, NULL);
+    }
+
+    if (flattened_texts == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Failed to flatten JSON batch");
+        return NULL;
+    }
+
+    // Pre-allocate result list with known size for better performance
+    PyObject* result_list = PyList_New(list_size);
+    for (Py_ssize_t i = 0; i < list_size; i++) {
+        if (result_list) {
+            PyObject* py_item = PyUnicode_FromString(flattened_texts[i]);
+            if (py_item) {
+                // Use SET_ITEM instead of Append for better performance (steals reference)
+                PyList_SET_ITEM(result_list, i, py_item);
+            } else {
+                Py_CLEAR(result_list);
+            }
+        }
+        free(flattened_texts[i]);
+    }
+    free(flattened_texts);
+
+    return result_list;
+}
+
+/**
+ * Rebuild nested JSON from flattened keys (a str, bytes-like object or native dict)
+ */
+static PyObject* py_unflatten_json(PyObject* self, PyObject* args, PyObject* kwargs) {
+    (void)self; // Suppress unused parameter warning
+    PyObject* json_obj;
+    int use_threads = 0;
+    int num_threads = 0;
+    int pretty_print = 0;
+    int use_arena = 0;
+    const char* return_type = "str";
+    int as_dict;
+
+    static char* kwlist[] = {"json_string", "use_threads", "num_threads", "pretty_print", "arena",
+                             "return_type", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iiiis", kwlist,
+                                    &json_obj, &use_threads, &num_threads, &pretty_print, &use_arena,
+                                    &return_type)) {
+        return NULL;
+    }
+    if (get_return_type_argument(return_type, &as_dict) != 0) {
+        return NULL;
+    }
+
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
+        return NULL;
+    }
+
+    cJSON* json;
+    int parsed;
+    cJSON* unflattened = NULL;
+    char* result = NULL;
+    JsonArena* arena;
+    JsonArena* previous_arena;
+
+    // Release GIL during C computation for better parallelism
+    Py_BEGIN_ALLOW_THREADS
+
+    // Initialize memory pools for optimal performance
+    init_global_pools();
+    arena = begin_call_arena(use_arena, &previous_arena);
+
+    // An array is unflattened record by record
+    json = json_argument_parse(&input, 0);
+    parsed = json != NULL;
+    if (json) {
+        unflattened = unflatten_parsed_json(json, use_threads, num_threads);
+        cJSON_Delete(json);
+    }
+    if (unflattened && !as_dict) {
+        result = cjson_tools_print(unflattened, pretty_print);
+        cJSON_Delete(unflattened);
+        unflattened = NULL;
+    }
+    leave_call_arena(arena, previous_arena);
+    Py_END_ALLOW_THREADS
+
+    json_argument_release(&input);
+
+    if (result == NULL && unflattened == NULL) {
+        if (arena) {
+            json_arena_destroy(arena);
+        }
+        PyErr_SetString(PyExc_ValueError, parsed ? "Failed to unflatten JSON" : "Invalid JSON input");
+        return NULL;
+    }
+
+    return build_call_result(result, unflattened, arena);
+}
+
+/**
+ * Unflatten a batch of flattened JSON objects
+ */
+static PyObject* py_unflatten_json_batch(PyObject* self, PyObject* args, PyObject* kwargs) {
+    (void)self; // Suppress unused parameter warning
+    PyObject* json_list;
+    int use_threads = 1;
+    int num_threads = 0;
+    int pretty_print = 0;
+    PyObject* pool_obj = NULL;
+    const char* return_type = "str";
+    int as_dict;
+
+    static char* kwlist[] = {"json_list", "use_threads", "num_threads", "pretty_print", "pool", "return_type", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iiiOs", kwlist,
+                                    &json_list, &use_threads, &num_threads, &pretty_print, &pool_obj,
+                                    &return_type)) {
+        return NULL;
+    }
+    if (get_return_type_argument(return_type, &as_dict) != 0) {
+        return NULL;
+    }
+
+    ThreadPool* pool;
+    if (get_pool_argument(pool_obj, &pool) != 0) {
+        return NULL;
+    }
+
+    Py_ssize_t list_size;
+    JsonArgument* items = json_list_arguments(json_list, &list_size);
+    if (items == NULL) {
+        thread_pool_release(pool);
+        return NULL;
+    }
+
+    cJSON* json_array;
+    Py_ssize_t failed_index;
+    int parsed;
+    cJSON* unflattened_array = NULL;
+    char** texts = NULL;
+    int complete = 0;
+
+    // Release GIL during C computation for better parallelism
+    Py_BEGIN_ALLOW_THREADS
+
+    // Initialize memory pools for optimal performance
+    init_global_pools();
+
+    json_array = json_arguments_to_array(items, list_size, &failed_index);
+    parsed = json_array != NULL;
+    if (json_array) {
+        unflattened_array = pool ? unflatten_json_batch_with_pool(json_array, pool) :
+                                   unflatten_json_batch(json_array, use_threads, num_threads);
+    }
+    thread_pool_release(pool);
+    cJSON_Delete(json_array);
+
+    // Records are printed while the GIL is still released
+    complete = unflattened_array && cJSON_GetArraySize(unflattened_array) == list_size;
+    if (complete && !as_dict) {
+        texts = calloc(list_size ? (size_t)list_size : 1, sizeof(char*));
+        complete = texts != NULL;
+        Py_ssize_t i = 0;
+        for (const cJSON* record = unflattened_array->child; complete && record; record = record->next) {
+            texts[i] = cjson_tools_print(record, pretty_print);
+            complete = texts[i++] != NULL;
+        }
+        cJSON_Delete(unflattened_array);
+        unflattened_array = NULL;
+    }
+    Py_END_ALLOW_THREADS
+
+    json_list_arguments_free(items, list_size);
+
+    if (!parsed) {
+        if (failed_index >= 0) {
+            PyErr_Format(PyExc_ValueError, "Invalid JSON at index %zd", failed_index);
+        } else {
+            PyErr_SetString(PyExc_MemoryError, "Failed to create JSON array");
+        }
+        return NULL;
+    }
+
+    PyObject* result_list = NULL;
+    if (!complete) {
+        PyErr_SetString(PyExc_ValueError, "Failed to unflatten JSON batch");
+    } else if (as_dict) {
+        return build_call_result(NULL, unflattened_array, NULL);
+    } else {
+        result_list = PyList_New(list_size);
+    }
+
+    for (Py_ssize_t i = 0; texts && i < list_size; i++) {
+        if (result_list) {
+            PyObject* py_item = PyUnicode_FromString(texts[i]);
+            if (py_item) {
+                PyList_SET_ITEM(result_list, i, py_item);
+            } else {
+                Py_CLEAR(result_list);
+            }
+        }
+        free(texts[i]);
+    }
+    free(texts);
+    cJSON_Delete(unflattened_array);
+
+    return result_list;
+}
 
 /**
- * Flatten a JSON string
+ * Generate a JSON schema from a JSON string, bytes-like object or native value
  */
-static PyObject* py_flatten_json(PyObject* self, PyObject* args, PyObject* kwargs) {
+static PyObject* py_generate_schema(PyObject* self, PyObject* args, PyObject* kwargs) {
     (void)self; // Suppress unused parameter warning
-    const char* json_string;
+    PyObject* json_obj;
     int use_threads = 0;
     int num_threads = 0;
-    int pretty_print = 0;
-
-    static char* kwlist[] = {"json_string", "use_threads", "num_threads", "pretty_print", NULL};
+    const char* return_type = "str";
+    int as_dict;
+    double sample_rate = 0.0;
+    int sample_size = 0;
+    unsigned long long seed = 0;
+    int collect_stats = 0;
+    int enum_limit = 0;
+    SchemaInferenceOptions options;
+
+    static char* kwlist[] = {"json_string", "use_threads", "num_threads", "return_type", "sample_rate",
+                             "sample_size", "seed", "collect_stats", "enum_limit", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iisdiKii", kwlist,
+                                    &json_obj, &use_threads, &num_threads, &return_type, &sample_rate,
+                                    &sample_size, &seed, &collect_stats, &enum_limit)) {
+        return NULL;
+    }
+    if (get_return_type_argument(return_type, &as_dict) != 0 ||
+        get_schema_options_argument(sample_rate, sample_size, seed, collect_stats, enum_limit, &options) != 0) {
+        return NULL;
+    }
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|iii", kwlist,
-                                    &json_string, &use_threads, &num_threads, &pretty_print)) {
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
         return NULL;
     }
 
-    char* result;
+    char* result = NULL;
+    cJSON* schema = NULL;
 
     // Release GIL during C computation for better parallelism
     Py_BEGIN_ALLOW_THREADS
@@ -29,100 +1112,77 @@ static PyObject* py_flatten_json(PyObject* self, PyObject* args, PyObject* kwarg
     // Initialize memory pools for optimal performance
     init_global_pools();
 
-    result = flatten_json_string(json_string, use_threads, num_threads);
-    Py_END_ALLOW_THREADS
-
-    if (result == NULL) {
-        PyErr_SetString(PyExc_ValueError, "Failed to flatten JSON");
-        return NULL;
-    }
-
-    // Apply pretty printing if requested
-    char* final_result = result;
-    if (pretty_print) {
-        cJSON* json = cJSON_Parse(result);
+    if (input.terminated && !as_dict) {
+        result = generate_schema_from_string_opts(input.text, &options, use_threads, num_threads);
+    } else {
+        cJSON* json = json_argument_parse(&input, 0);
         if (json) {
-            free(result);
-            final_result = cJSON_Print(json);
+            schema = schema_from_parsed_json(json, &options, use_threads, num_threads);
             cJSON_Delete(json);
         }
+        if (schema && !as_dict) {
+            result = cjson_tools_print(schema, 1);
+            cJSON_Delete(schema);
+            schema = NULL;
+        }
     }
+    Py_END_ALLOW_THREADS
 
-    // Convert the result to a Python string
-    PyObject* py_result = PyUnicode_FromString(final_result);
+    json_argument_release(&input);
 
-    // Free the C string
-    free(final_result);
+    if (result == NULL && schema == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Failed to generate schema");
+        return NULL;
+    }
 
-    return py_result;
+    return build_call_result(result, schema, NULL);
 }
 
 /**
- * Flatten a batch of JSON objects
+ * Generate a JSON schema from a batch of JSON objects
  */
-static PyObject* py_flatten_json_batch(PyObject* self, PyObject* args, PyObject* kwargs) {
+static PyObject* py_generate_schema_batch(PyObject* self, PyObject* args, PyObject* kwargs) {
     (void)self; // Suppress unused parameter warning
     PyObject* json_list;
     int use_threads = 1;
     int num_threads = 0;
-    int pretty_print = 0;
-
-    static char* kwlist[] = {"json_list", "use_threads", "num_threads", "pretty_print", NULL};
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iii", kwlist,
-                                    &json_list, &use_threads, &num_threads, &pretty_print)) {
+    PyObject* pool_obj = NULL;
+    const char* return_type = "str";
+    int as_dict;
+    double sample_rate = 0.0;
+    int sample_size = 0;
+    unsigned long long seed = 0;
+    int collect_stats = 0;
+    int enum_limit = 0;
+    SchemaInferenceOptions options;
+
+    static char* kwlist[] = {"json_list", "use_threads", "num_threads", "pool", "return_type", "sample_rate",
+                             "sample_size", "seed", "collect_stats", "enum_limit", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iiOsdiKii", kwlist,
+                                    &json_list, &use_threads, &num_threads, &pool_obj, &return_type,
+                                    &sample_rate, &sample_size, &seed, &collect_stats, &enum_limit)) {
         return NULL;
     }
-
-    // Check if the input is a list
-    if (!PyList_Check(json_list)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a list of JSON strings");
+    if (get_return_type_argument(return_type, &as_dict) != 0 ||
+        get_schema_options_argument(sample_rate, sample_size, seed, collect_stats, enum_limit, &options) != 0) {
         return NULL;
     }
 
-    Py_ssize_t list_size = PyList_Size(json_list);
-    
-    // Create a JSON array
-    cJSON* json_array = cJSON_CreateArray();
+    cJSON* json_array = json_list_to_array(json_list);
     if (json_array == NULL) {
-        PyErr_SetString(PyExc_MemoryError, "Failed to create JSON array");
         return NULL;
     }
-    
-    // Convert each Python object to a JSON object and add to the array
-    for (Py_ssize_t i = 0; i < list_size; i++) {
-        PyObject* item = PyList_GetItem(json_list, i);
-        
-        // Convert to string if it's not already
-        PyObject* str_item = PyObject_Str(item);
-        if (str_item == NULL) {
-            cJSON_Delete(json_array);
-            return NULL;
-        }
-        
-        const char* json_str = PyUnicode_AsUTF8(str_item);
-        if (json_str == NULL) {
-            Py_DECREF(str_item);
-            cJSON_Delete(json_array);
-            return NULL;
-        }
-        
-        // Parse the JSON string
-        cJSON* json_obj = cJSON_Parse(json_str);
-        Py_DECREF(str_item);
-        
-        if (json_obj == NULL) {
-            PyErr_Format(PyExc_ValueError, "Invalid JSON at index %zd", i);
-            cJSON_Delete(json_array);
-            return NULL;
-        }
-        
-        // Add to the array
-        cJSON_AddItemToArray(json_array, json_obj);
+
+    ThreadPool* pool;
+    if (get_pool_argument(pool_obj, &pool) != 0) {
+        cJSON_Delete(json_array);
+        return NULL;
     }
     
-    // Flatten the batch
-    cJSON* flattened_array;
+    // Generate schema from the batch
+    cJSON* schema;
+    char* schema_str = NULL;
 
     // Release GIL during C computation for better parallelism
     Py_BEGIN_ALLOW_THREADS
@@ -130,370 +1190,752 @@ static PyObject* py_flatten_json_batch(PyObject* self, PyObject* args, PyObject*
     // Initialize memory pools for optimal performance
     init_global_pools();
 
-    flattened_array = flatten_json_batch(json_array, use_threads, num_threads);
-    Py_END_ALLOW_THREADS
-    
-    // Free the input array (but not its contents, as they're now owned by flattened_array)
+    if (pool) {
+        JsonArrayView records;
+        schema = NULL;
+        if (json_array_view_init(&records, json_array) == 0) {
+            schema = generate_schema_from_view_opts(&records, pool, &options);
+            json_array_view_free(&records);
+        }
+        thread_pool_release(pool);
+    } else {
+        schema = generate_schema_from_batch_opts(json_array, &options, use_threads, num_threads);
+    }
+
+    // Free the input array
     cJSON_Delete(json_array);
-    
-    if (flattened_array == NULL) {
-        PyErr_SetString(PyExc_ValueError, "Failed to flatten JSON batch");
-        return NULL;
+
+    if (schema && !as_dict) {
+        schema_str = cjson_tools_print(schema, 1);
+        cJSON_Delete(schema);
+        schema = NULL;
     }
+    Py_END_ALLOW_THREADS
     
-    // Pre-allocate result list with known size for better performance
-    int array_size = cJSON_GetArraySize(flattened_array);
-    PyObject* result_list = PyList_New(array_size);
-    if (result_list == NULL) {
-        cJSON_Delete(flattened_array);
+    if (schema == NULL && schema_str == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Failed to generate schema");
         return NULL;
     }
 
-    // Add each flattened object to the result list using SET_ITEM for better performance
-    for (int i = 0; i < array_size; i++) {
-        cJSON* item = cJSON_GetArrayItem(flattened_array, i);
-        char* item_str = pretty_print ? cJSON_Print(item) : cJSON_PrintUnformatted(item);
+    return build_call_result(schema_str, schema, NULL);
+}
 
-        if (item_str == NULL) {
-            Py_DECREF(result_list);
-            cJSON_Delete(flattened_array);
-            PyErr_SetString(PyExc_MemoryError, "Failed to convert JSON to string");
-            return NULL;
-        }
+// =============================================================================
+// SCHEMA BUILDER OBJECT
+// =============================================================================
 
-        PyObject* py_item = PyUnicode_FromString(item_str);
-        free(item_str);
+/**
+ * Resumable schema inference state. busy is set while a call runs without
+ * the GIL, so a concurrent call on the same builder fails instead of racing.
+ */
+typedef struct {
+    PyObject_HEAD
+    SchemaBuilder* builder;
+    int busy;
+} SchemaBuilderObject;
+
+static PyTypeObject SchemaBuilderType;
+
+static int check_builder_available(SchemaBuilderObject* self) {
+    if (self->builder == NULL) {
+        PyErr_SetString(PyExc_ValueError, "SchemaBuilder is not initialized");
+        return -1;
+    }
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "SchemaBuilder is in use by another thread");
+        return -1;
+    }
+    return 0;
+}
 
-        if (py_item == NULL) {
-            Py_DECREF(result_list);
-            cJSON_Delete(flattened_array);
-            return NULL;
-        }
+static void SchemaBuilder_dealloc(SchemaBuilderObject* self) {
+    schema_builder_free(self->builder);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
 
-        // Use SET_ITEM instead of Append for better performance (steals reference)
-        PyList_SET_ITEM(result_list, i, py_item);
+static int SchemaBuilder_init(SchemaBuilderObject* self, PyObject* args, PyObject* kwargs) {
+    double sample_rate = 0.0;
+    int sample_size = 0;
+    unsigned long long seed = 0;
+    int collect_stats = 0;
+    int enum_limit = 0;
+    SchemaInferenceOptions options;
+    static char* kwlist[] = {"sample_rate", "sample_size", "seed", "collect_stats", "enum_limit", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|diKii", kwlist,
+                                    &sample_rate, &sample_size, &seed, &collect_stats, &enum_limit) ||
+        get_schema_options_argument(sample_rate, sample_size, seed, collect_stats, enum_limit, &options) != 0) {
+        return -1;
     }
-    
-    // Free the flattened array
-    cJSON_Delete(flattened_array);
-    
-    return result_list;
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "SchemaBuilder is in use by another thread");
+        return -1;
+    }
+
+    SchemaBuilder* builder = schema_builder_create_with_options(&options);
+    if (builder == NULL) {
+        PyErr_SetString(PyExc_MemoryError, "Failed to create schema builder");
+        return -1;
+    }
+
+    schema_builder_free(self->builder);
+    self->builder = builder;
+    return 0;
 }
 
-/**
- * Generate a JSON schema from a JSON string
- */
-static PyObject* py_generate_schema(PyObject* self, PyObject* args, PyObject* kwargs) {
-    (void)self; // Suppress unused parameter warning
-    const char* json_string;
-    int use_threads = 0;
+static PyObject* SchemaBuilder_add(SchemaBuilderObject* self, PyObject* args, PyObject* kwargs) {
+    PyObject* json_obj;
+    static char* kwlist[] = {"json_string", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &json_obj)) {
+        return NULL;
+    }
+    if (check_builder_available(self) != 0) {
+        return NULL;
+    }
+
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
+        return NULL;
+    }
+
+    int result = -1;
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
+    cJSON* json = json_argument_parse(&input, 0);
+    if (json) {
+        result = schema_builder_add(self->builder, json);
+        cJSON_Delete(json);
+    }
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+
+    json_argument_release(&input);
+
+    if (result != 0) {
+        PyErr_SetString(PyExc_ValueError, "Invalid JSON");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* SchemaBuilder_add_batch(SchemaBuilderObject* self, PyObject* args, PyObject* kwargs) {
+    PyObject* json_list;
+    int use_threads = 1;
     int num_threads = 0;
+    PyObject* pool_obj = NULL;
 
-    static char* kwlist[] = {"json_string", "use_threads", "num_threads", NULL};
+    static char* kwlist[] = {"json_list", "use_threads", "num_threads", "pool", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|ii", kwlist,
-                                    &json_string, &use_threads, &num_threads)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iiO", kwlist,
+                                    &json_list, &use_threads, &num_threads, &pool_obj)) {
+        return NULL;
+    }
+    // Parsing releases the GIL, so check the builder only once it is done
+    cJSON* json_array = json_list_to_array(json_list);
+    if (json_array == NULL) {
+        return NULL;
+    }
+    if (check_builder_available(self) != 0) {
+        cJSON_Delete(json_array);
         return NULL;
     }
 
-    char* result;
+    ThreadPool* pool;
+    if (get_pool_argument(pool_obj, &pool) != 0) {
+        cJSON_Delete(json_array);
+        return NULL;
+    }
 
-    // Release GIL during C computation for better parallelism
+    int result;
+    self->busy = 1;
     Py_BEGIN_ALLOW_THREADS
+    if (pool) {
+        result = schema_builder_add_batch_with_pool(self->builder, json_array, pool);
+        thread_pool_release(pool);
+    } else {
+        result = schema_builder_add_batch(self->builder, json_array, use_threads, num_threads);
+    }
+    cJSON_Delete(json_array);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
 
-    // Initialize memory pools for optimal performance
-    init_global_pools();
+    if (result != 0) {
+        PyErr_SetString(PyExc_MemoryError, "Failed to add batch to schema builder");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* SchemaBuilder_merge(SchemaBuilderObject* self, PyObject* args, PyObject* kwargs) {
+    PyObject* other_obj;
+    static char* kwlist[] = {"other", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!", kwlist, &SchemaBuilderType, &other_obj)) {
+        return NULL;
+    }
+    SchemaBuilderObject* other = (SchemaBuilderObject*)other_obj;
+    if (check_builder_available(self) != 0 || check_builder_available(other) != 0) {
+        return NULL;
+    }
 
-    result = generate_schema_from_string(json_string, use_threads, num_threads);
+    int result;
+    self->busy = 1;
+    other->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
+    result = schema_builder_merge(self->builder, other->builder);
     Py_END_ALLOW_THREADS
+    self->busy = 0;
+    other->busy = 0;
 
-    if (result == NULL) {
-        PyErr_SetString(PyExc_ValueError, "Failed to generate schema");
+    if (result != 0) {
+        PyErr_SetString(PyExc_MemoryError, "Failed to merge schema builders");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* SchemaBuilder_to_json(SchemaBuilderObject* self, PyObject* unused) {
+    (void)unused;
+    if (check_builder_available(self) != 0) {
+        return NULL;
+    }
+
+    cJSON* schema = schema_builder_to_json(self->builder);
+    char* schema_str = schema ? cjson_tools_print(schema, 1) : NULL;
+    cJSON_Delete(schema);
+
+    if (schema_str == NULL) {
+        PyErr_SetString(PyExc_MemoryError, "Failed to convert schema to string");
         return NULL;
     }
 
-    // Convert the result to a Python string
-    PyObject* py_result = PyUnicode_FromString(result);
+    PyObject* py_result = PyUnicode_FromString(schema_str);
+    free(schema_str);
+    return py_result;
+}
+
+static PyObject* SchemaBuilder_serialize(SchemaBuilderObject* self, PyObject* unused) {
+    (void)unused;
+    if (check_builder_available(self) != 0) {
+        return NULL;
+    }
 
-    // Free the C string
-    free(result);
+    char* state = schema_builder_serialize(self->builder);
+    if (state == NULL) {
+        PyErr_SetString(PyExc_MemoryError, "Failed to serialize schema builder");
+        return NULL;
+    }
 
+    PyObject* py_result = PyUnicode_FromString(state);
+    free(state);
     return py_result;
 }
 
+static PyObject* SchemaBuilder_deserialize(PyObject* cls, PyObject* args, PyObject* kwargs) {
+    const char* state;
+    static char* kwlist[] = {"state", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s", kwlist, &state)) {
+        return NULL;
+    }
+
+    SchemaBuilder* builder;
+    Py_BEGIN_ALLOW_THREADS
+    builder = schema_builder_deserialize(state);
+    Py_END_ALLOW_THREADS
+
+    if (builder == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Invalid schema builder state");
+        return NULL;
+    }
+
+    SchemaBuilderObject* obj = (SchemaBuilderObject*)PyType_GenericAlloc((PyTypeObject*)cls, 0);
+    if (obj == NULL) {
+        schema_builder_free(builder);
+        return NULL;
+    }
+    obj->builder = builder;
+    return (PyObject*)obj;
+}
+
+static PyObject* SchemaBuilder_get_record_count(SchemaBuilderObject* self, void* closure) {
+    (void)closure;
+    return PyLong_FromLong(schema_builder_record_count(self->builder));
+}
+
+static PyMethodDef SchemaBuilder_methods[] = {
+    {"add", (PyCFunction)(void(*)(void))SchemaBuilder_add, METH_VARARGS | METH_KEYWORDS,
+     "Merge one JSON record (str, bytes-like or native object) into the schema. Args: json_string"},
+    {"add_batch", (PyCFunction)(void(*)(void))SchemaBuilder_add_batch, METH_VARARGS | METH_KEYWORDS,
+     "Merge a batch of JSON records into the schema. Args: json_list, use_threads=True, num_threads=0, pool=None"},
+    {"merge", (PyCFunction)(void(*)(void))SchemaBuilder_merge, METH_VARARGS | METH_KEYWORDS,
+     "Merge another SchemaBuilder's state into this one. Args: other"},
+    {"to_json", (PyCFunction)SchemaBuilder_to_json, METH_NOARGS,
+     "Return the current JSON schema as a string."},
+    {"serialize", (PyCFunction)SchemaBuilder_serialize, METH_NOARGS,
+     "Return the builder state as a string for SchemaBuilder.deserialize."},
+    {"deserialize", (PyCFunction)(void(*)(void))SchemaBuilder_deserialize, METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+     "Restore a builder from serialize() output. Args: state"},
+    {NULL, NULL, 0, NULL}  // Sentinel
+};
+
+static PyGetSetDef SchemaBuilder_getset[] = {
+    {"record_count", (getter)SchemaBuilder_get_record_count, NULL,
+     "Number of records merged so far", NULL},
+    {NULL, NULL, NULL, NULL, NULL}  // Sentinel
+};
+
+static PyTypeObject SchemaBuilderType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cjson_tools.SchemaBuilder",
+    .tp_basicsize = sizeof(SchemaBuilderObject),
+    .tp_dealloc = (destructor)SchemaBuilder_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_doc = "Incremental JSON schema inference that can be extended, merged and persisted. Args: sample_rate=0.0, sample_size=0, seed=0, collect_stats=False, enum_limit=0",
+    .tp_methods = SchemaBuilder_methods,
+    .tp_getset = SchemaBuilder_getset,
+    .tp_init = (initproc)SchemaBuilder_init,
+    .tp_new = PyType_GenericNew,
+};
+
+// =============================================================================
+// SCHEMA VALIDATOR OBJECT
+// =============================================================================
+
 /**
- * Generate a JSON schema from a batch of JSON objects
+ * A compiled schema. Validation only reads it, so calls may overlap; active
+ * counts the calls running without the GIL so __init__ cannot free it under them.
  */
-static PyObject* py_generate_schema_batch(PyObject* self, PyObject* args, PyObject* kwargs) {
-    (void)self; // Suppress unused parameter warning
+typedef struct {
+    PyObject_HEAD
+    SchemaValidator* validator;
+    int active;
+} SchemaValidatorObject;
+
+static int check_validator_available(SchemaValidatorObject* self) {
+    if (self->validator == NULL) {
+        PyErr_SetString(PyExc_ValueError, "SchemaValidator is not initialized");
+        return -1;
+    }
+    return 0;
+}
+
+static void SchemaValidator_dealloc(SchemaValidatorObject* self) {
+    schema_validator_free(self->validator);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int SchemaValidator_init(SchemaValidatorObject* self, PyObject* args, PyObject* kwargs) {
+    PyObject* schema_obj;
+    static char* kwlist[] = {"schema", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &schema_obj)) {
+        return -1;
+    }
+    if (self->active) {
+        PyErr_SetString(PyExc_RuntimeError, "SchemaValidator is in use by another thread");
+        return -1;
+    }
+
+    SchemaValidator* validator;
+    if (PyObject_TypeCheck(schema_obj, &SchemaBuilderType)) {
+        SchemaBuilderObject* builder = (SchemaBuilderObject*)schema_obj;
+        if (check_builder_available(builder) != 0) {
+            return -1;
+        }
+        validator = schema_validator_from_builder(builder->builder);
+    } else {
+        JsonArgument input;
+        if (json_argument_init(schema_obj, &input) != 0) {
+            return -1;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        cJSON* schema = json_argument_parse(&input, 0);
+        validator = schema ? schema_validator_compile(schema) : NULL;
+        cJSON_Delete(schema);
+        Py_END_ALLOW_THREADS
+
+        json_argument_release(&input);
+    }
+
+    if (validator == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Invalid or unsupported JSON schema");
+        return -1;
+    }
+
+    schema_validator_free(self->validator);
+    self->validator = validator;
+    return 0;
+}
+
+// Error objects as a list of dicts, consuming errors
+static PyObject* validation_errors_to_python(cJSON* errors) {
+    PyObject* py_result = errors ? cjson_to_python(errors) : NULL;
+    cJSON_Delete(errors);
+    if (py_result == NULL && !PyErr_Occurred()) {
+        PyErr_SetString(PyExc_MemoryError, "Failed to validate JSON");
+    }
+    return py_result;
+}
+
+static PyObject* SchemaValidator_validate(SchemaValidatorObject* self, PyObject* args, PyObject* kwargs) {
+    PyObject* json_obj;
+    int all_errors = 0;
+    static char* kwlist[] = {"json_string", "all_errors", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|p", kwlist, &json_obj, &all_errors)) {
+        return NULL;
+    }
+    if (check_validator_available(self) != 0) {
+        return NULL;
+    }
+
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
+        return NULL;
+    }
+
+    SchemaValidationMode mode = all_errors ? SCHEMA_VALIDATE_ALL_ERRORS : SCHEMA_VALIDATE_FIRST_ERROR;
+    cJSON* errors = NULL;
+    int parsed;
+    self->active++;
+    Py_BEGIN_ALLOW_THREADS
+    cJSON* json = json_argument_parse(&input, 0);
+    parsed = json != NULL;
+    if (json) {
+        schema_validate(self->validator, json, mode, &errors);
+        cJSON_Delete(json);
+    }
+    Py_END_ALLOW_THREADS
+    self->active--;
+
+    json_argument_release(&input);
+
+    if (!parsed) {
+        PyErr_SetString(PyExc_ValueError, "Invalid JSON input");
+        return NULL;
+    }
+    return validation_errors_to_python(errors);
+}
+
+static PyObject* SchemaValidator_validate_batch(SchemaValidatorObject* self, PyObject* args, PyObject* kwargs) {
     PyObject* json_list;
+    int all_errors = 0;
     int use_threads = 1;
     int num_threads = 0;
+    PyObject* pool_obj = NULL;
 
-    static char* kwlist[] = {"json_list", "use_threads", "num_threads", NULL};
+    static char* kwlist[] = {"json_list", "all_errors", "use_threads", "num_threads", "pool", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ii", kwlist,
-                                    &json_list, &use_threads, &num_threads)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|piiO", kwlist,
+                                    &json_list, &all_errors, &use_threads, &num_threads, &pool_obj)) {
         return NULL;
     }
-    
-    // Check if the input is a list
-    if (!PyList_Check(json_list)) {
-        PyErr_SetString(PyExc_TypeError, "Expected a list of JSON strings");
+    if (check_validator_available(self) != 0) {
         return NULL;
     }
-    
-    // Create a JSON array
-    cJSON* json_array = cJSON_CreateArray();
+
+    cJSON* json_array = json_list_to_array(json_list);
     if (json_array == NULL) {
-        PyErr_SetString(PyExc_MemoryError, "Failed to create JSON array");
         return NULL;
     }
-    
-    // Convert each Python object to a JSON object and add to the array
-    Py_ssize_t list_size = PyList_Size(json_list);
-    for (Py_ssize_t i = 0; i < list_size; i++) {
-        PyObject* item = PyList_GetItem(json_list, i);
-        
-        // Convert to string if it's not already
-        PyObject* str_item = PyObject_Str(item);
-        if (str_item == NULL) {
-            cJSON_Delete(json_array);
-            return NULL;
-        }
-        
-        const char* json_str = PyUnicode_AsUTF8(str_item);
-        if (json_str == NULL) {
-            Py_DECREF(str_item);
-            cJSON_Delete(json_array);
-            return NULL;
-        }
-        
-        // Parse the JSON string
-        cJSON* json_obj = cJSON_Parse(json_str);
-        Py_DECREF(str_item);
-        
-        if (json_obj == NULL) {
-            PyErr_Format(PyExc_ValueError, "Invalid JSON at index %zd", i);
-            cJSON_Delete(json_array);
-            return NULL;
-        }
-        
-        // Add to the array
-        cJSON_AddItemToArray(json_array, json_obj);
+
+    ThreadPool* pool;
+    if (get_pool_argument(pool_obj, &pool) != 0) {
+        cJSON_Delete(json_array);
+        return NULL;
     }
-    
-    // Generate schema from the batch
-    cJSON* schema;
 
-    // Release GIL during C computation for better parallelism
-    Py_BEGIN_ALLOW_THREADS
+    SchemaValidationMode mode = all_errors ? SCHEMA_VALIDATE_ALL_ERRORS : SCHEMA_VALIDATE_FIRST_ERROR;
+    cJSON* errors = NULL;
+    self->active++;
+    Py_BEGIN_ALLOW_THREADS
+    if (pool) {
+        schema_validate_batch_with_pool(self->validator, json_array, mode, pool, &errors);
+        thread_pool_release(pool);
+    } else {
+        schema_validate_batch(self->validator, json_array, mode, use_threads, num_threads, &errors);
+    }
+    cJSON_Delete(json_array);
+    Py_END_ALLOW_THREADS
+    self->active--;
+
+    return validation_errors_to_python(errors);
+}
 
-    // Initialize memory pools for optimal performance
-    init_global_pools();
+static PyObject* SchemaValidator_is_valid(SchemaValidatorObject* self, PyObject* args, PyObject* kwargs) {
+    PyObject* json_obj;
+    static char* kwlist[] = {"json_string", NULL};
 
-    schema = generate_schema_from_batch(json_array, use_threads, num_threads);
-    Py_END_ALLOW_THREADS
-    
-    // Free the input array
-    cJSON_Delete(json_array);
-    
-    if (schema == NULL) {
-        PyErr_SetString(PyExc_ValueError, "Failed to generate schema");
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &json_obj)) {
         return NULL;
     }
-    
-    // Convert the result to a Python string
-    char* schema_str = cJSON_Print(schema);
-    cJSON_Delete(schema);
-    
-    if (schema_str == NULL) {
-        PyErr_SetString(PyExc_MemoryError, "Failed to convert schema to string");
+    if (check_validator_available(self) != 0) {
         return NULL;
     }
-    
-    PyObject* py_result = PyUnicode_FromString(schema_str);
-    free(schema_str);
-    
-    return py_result;
+
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
+        return NULL;
+    }
+
+    int result = -1;
+    int parsed;
+    self->active++;
+    Py_BEGIN_ALLOW_THREADS
+    cJSON* json = json_argument_parse(&input, 0);
+    parsed = json != NULL;
+    if (json) {
+        result = schema_validate(self->validator, json, SCHEMA_VALIDATE_FIRST_ERROR, NULL);
+        cJSON_Delete(json);
+    }
+    Py_END_ALLOW_THREADS
+    self->active--;
+
+    json_argument_release(&input);
+
+    if (result < 0) {
+        PyErr_SetString(parsed ? PyExc_MemoryError : PyExc_ValueError,
+                        parsed ? "Failed to validate JSON" : "Invalid JSON input");
+        return NULL;
+    }
+    return PyBool_FromLong(result == 0);
 }
 
+static PyMethodDef SchemaValidator_methods[] = {
+    {"validate", (PyCFunction)(void(*)(void))SchemaValidator_validate, METH_VARARGS | METH_KEYWORDS,
+     "Validate one JSON value and return its errors as a list of {'path', 'message'} dicts. "
+     "Args: json_string, all_errors=False"},
+    {"validate_batch", (PyCFunction)(void(*)(void))SchemaValidator_validate_batch, METH_VARARGS | METH_KEYWORDS,
+     "Validate a batch of records; errors also carry the 'record' index. "
+     "Args: json_list, all_errors=False, use_threads=True, num_threads=0, pool=None"},
+    {"is_valid", (PyCFunction)(void(*)(void))SchemaValidator_is_valid, METH_VARARGS | METH_KEYWORDS,
+     "Return whether one JSON value matches the schema. Args: json_string"},
+    {NULL, NULL, 0, NULL}  // Sentinel
+};
+
+static PyTypeObject SchemaValidatorType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cjson_tools.SchemaValidator",
+    .tp_basicsize = sizeof(SchemaValidatorObject),
+    .tp_dealloc = (destructor)SchemaValidator_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_doc = "A JSON schema (str, bytes, dict or SchemaBuilder) compiled for fast validation",
+    .tp_methods = SchemaValidator_methods,
+    .tp_init = (initproc)SchemaValidator_init,
+    .tp_new = PyType_GenericNew,
+};
+
 /**
- * Get flattened paths with their data types from a JSON string
+ * Get flattened paths with their data types from a JSON string, bytes-like object or native value
  */
 static PyObject* py_get_flattened_paths_with_types(PyObject* self, PyObject* args, PyObject* kwargs) {
     (void)self; // Suppress unused parameter warning
-    const char* json_string;
+    PyObject* json_obj;
     int pretty_print = 0;
+    const char* return_type = "str";
+    int as_dict;
+
+    static char* kwlist[] = {"json_string", "pretty_print", "return_type", NULL};
 
-    static char* kwlist[] = {"json_string", "pretty_print", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|is", kwlist,
+                                    &json_obj, &pretty_print, &return_type)) {
+        return NULL;
+    }
+    if (get_return_type_argument(return_type, &as_dict) != 0) {
+        return NULL;
+    }
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|i", kwlist,
-                                    &json_string, &pretty_print)) {
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
         return NULL;
     }
 
-    char* result;
+    cJSON* paths_with_types = NULL;
+    char* result = NULL;
 
     // Release GIL during C computation
     Py_BEGIN_ALLOW_THREADS
-    result = get_flattened_paths_with_types_string(json_string);
-    Py_END_ALLOW_THREADS
-
-    if (result == NULL) {
-        PyErr_SetString(PyExc_ValueError, "Failed to get flattened paths with types");
-        return NULL;
+    cJSON* json = json_argument_parse(&input, 0);
+    if (json) {
+        paths_with_types = get_flattened_paths_with_types(json);
+        cJSON_Delete(json);
     }
 
-    // Apply pretty printing if requested
-    char* final_result = result;
-    if (pretty_print) {
-        cJSON* json = cJSON_Parse(result);
-        if (json) {
-            free(result);
-            final_result = cJSON_Print(json);
-            cJSON_Delete(json);
+    // Always formatted, whether or not pretty printing was requested
+    if (paths_with_types && !as_dict) {
+        result = cjson_tools_print(paths_with_types, 1);
+        cJSON_Delete(paths_with_types);
+        paths_with_types = NULL;
+        if (result == NULL) {
+            Py_BLOCK_THREADS
+            json_argument_release(&input);
+            PyErr_SetString(PyExc_MemoryError, "Failed to format result");
+            return NULL;
         }
     }
+    Py_END_ALLOW_THREADS
 
-    if (final_result == NULL) {
-        if (result != final_result) free(result);
-        PyErr_SetString(PyExc_MemoryError, "Failed to format result");
+    json_argument_release(&input);
+
+    if (result == NULL && paths_with_types == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Failed to get flattened paths with types");
         return NULL;
     }
 
-    PyObject* py_result = PyUnicode_FromString(final_result);
-    free(final_result);
-
-    return py_result;
+    return build_call_result(result, paths_with_types, NULL);
 }
 
 /**
- * Remove keys with empty string values from a JSON string
+ * Remove keys with empty string values from a JSON string, bytes-like object or native value
  */
 static PyObject* py_remove_empty_strings(PyObject* self, PyObject* args, PyObject* kwargs) {
     (void)self; // Suppress unused parameter warning
-    const char* json_string;
+    PyObject* json_obj;
     int pretty_print = 0;
+    int use_arena = 0;
+    const char* return_type = "str";
+    int as_dict;
+
+    static char* kwlist[] = {"json_string", "pretty_print", "arena", "return_type", NULL};
 
-    static char* kwlist[] = {"json_string", "pretty_print", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iis", kwlist,
+                                    &json_obj, &pretty_print, &use_arena, &return_type)) {
+        return NULL;
+    }
+    if (get_return_type_argument(return_type, &as_dict) != 0) {
+        return NULL;
+    }
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|i", kwlist,
-                                    &json_string, &pretty_print)) {
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
         return NULL;
     }
 
     cJSON* json;
-    cJSON* filtered_json;
-    char* result;
+    cJSON* processed_json;
+    char* result = NULL;
+    JsonArena* arena;
+    JsonArena* previous_arena;
 
     // Release GIL during C computation for better parallelism
     Py_BEGIN_ALLOW_THREADS
 
     // Initialize memory pools for optimal performance
     init_global_pools();
+    arena = begin_call_arena(use_arena, &previous_arena);
 
     // Parse the JSON
-    json = cJSON_Parse(json_string);
+    json = json_argument_parse(&input, 0);
     if (!json) {
+        end_call_arena(arena, previous_arena);
         Py_BLOCK_THREADS
+        json_argument_release(&input);
         PyErr_SetString(PyExc_ValueError, "Invalid JSON input");
         return NULL;
     }
 
     // Apply the filter
-    filtered_json = remove_empty_strings(json);
+    processed_json = remove_empty_strings(json);
     cJSON_Delete(json);
 
-    if (!filtered_json) {
+    if (!processed_json) {
+        end_call_arena(arena, previous_arena);
         Py_BLOCK_THREADS
+        json_argument_release(&input);
         PyErr_SetString(PyExc_ValueError, "Failed to remove empty strings");
         return NULL;
     }
 
-    // Convert back to string
-    if (pretty_print) {
-        result = cJSON_Print(filtered_json);
-    } else {
-        result = cJSON_PrintUnformatted(filtered_json);
+    // Convert back to string unless the tree itself is returned
+    if (!as_dict) {
+        result = cjson_tools_print(processed_json, pretty_print);
+        cJSON_Delete(processed_json);
+        processed_json = NULL;
     }
-
-    cJSON_Delete(filtered_json);
+    leave_call_arena(arena, previous_arena);
     Py_END_ALLOW_THREADS
 
-    if (result == NULL) {
-        PyErr_SetString(PyExc_MemoryError, "Failed to format result");
-        return NULL;
-    }
-
-    PyObject* py_result = PyUnicode_FromString(result);
-    free(result);
+    json_argument_release(&input);
 
-    return py_result;
+    return build_call_result(result, processed_json, arena);
 }
 
 /**
- * Remove keys with null values from a JSON string
+ * Remove keys with null values from a JSON string, bytes-like object or native value
  */
 static PyObject* py_remove_nulls(PyObject* self, PyObject* args, PyObject* kwargs) {
     (void)self; // Suppress unused parameter warning
-    const char* json_string;
+    PyObject* json_obj;
     int pretty_print = 0;
+    int use_arena = 0;
+    const char* return_type = "str";
+    int as_dict;
+
+    static char* kwlist[] = {"json_string", "pretty_print", "arena", "return_type", NULL};
 
-    static char* kwlist[] = {"json_string", "pretty_print", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iis", kwlist,
+                                    &json_obj, &pretty_print, &use_arena, &return_type)) {
+        return NULL;
+    }
+    if (get_return_type_argument(return_type, &as_dict) != 0) {
+        return NULL;
+    }
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|i", kwlist,
-                                    &json_string, &pretty_print)) {
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
         return NULL;
     }
 
     cJSON* json;
-    cJSON* filtered_json;
-    char* result;
+    cJSON* processed_json;
+    char* result = NULL;
+    JsonArena* arena;
+    JsonArena* previous_arena;
 
     // Release GIL during C computation for better parallelism
     Py_BEGIN_ALLOW_THREADS
 
     // Initialize memory pools for optimal performance
     init_global_pools();
+    arena = begin_call_arena(use_arena, &previous_arena);
 
     // Parse the JSON
-    json = cJSON_Parse(json_string);
+    json = json_argument_parse(&input, 0);
     if (!json) {
+        end_call_arena(arena, previous_arena);
         Py_BLOCK_THREADS
+        json_argument_release(&input);
         PyErr_SetString(PyExc_ValueError, "Invalid JSON input");
         return NULL;
     }
 
     // Apply the filter
-    filtered_json = remove_nulls(json);
+    processed_json = remove_nulls(json);
     cJSON_Delete(json);
 
-    if (!filtered_json) {
+    if (!processed_json) {
+        end_call_arena(arena, previous_arena);
         Py_BLOCK_THREADS
+        json_argument_release(&input);
         PyErr_SetString(PyExc_ValueError, "Failed to remove nulls");
         return NULL;
     }
 
-    // Convert back to string
-    if (pretty_print) {
-        result = cJSON_Print(filtered_json);
-    } else {
-        result = cJSON_PrintUnformatted(filtered_json);
+    // Convert back to string unless the tree itself is returned
+    if (!as_dict) {
+        result = cjson_tools_print(processed_json, pretty_print);
+        cJSON_Delete(processed_json);
+        processed_json = NULL;
     }
-
-    cJSON_Delete(filtered_json);
+    leave_call_arena(arena, previous_arena);
     Py_END_ALLOW_THREADS
 
-    if (result == NULL) {
-        PyErr_SetString(PyExc_MemoryError, "Failed to format result");
-        return NULL;
-    }
-
-    PyObject* py_result = PyUnicode_FromString(result);
-    free(result);
+    json_argument_release(&input);
 
-    return py_result;
+    return build_call_result(result, processed_json, arena);
 }
 
 /**
@@ -501,65 +1943,89 @@ static PyObject* py_remove_nulls(PyObject* self, PyObject* args, PyObject* kwarg
  */
 static PyObject* py_replace_keys(PyObject* self, PyObject* args, PyObject* kwargs) {
     (void)self; // Suppress unused parameter warning
-    const char* json_string;
+    PyObject* json_obj;
     const char* pattern;
     const char* replacement;
     int pretty_print = 0;
+    int use_arena = 0;
+    const char* return_type = "str";
+    int as_dict;
+
+    static char* kwlist[] = {"json_string", "pattern", "replacement", "pretty_print", "arena", "return_type", NULL};
 
-    static char* kwlist[] = {"json_string", "pattern", "replacement", "pretty_print", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oss|iis", kwlist,
+                                    &json_obj, &pattern, &replacement, &pretty_print, &use_arena,
+                                    &return_type)) {
+        return NULL;
+    }
+    if (get_return_type_argument(return_type, &as_dict) != 0) {
+        return NULL;
+    }
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "sss|i", kwlist,
-                                    &json_string, &pattern, &replacement, &pretty_print)) {
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
         return NULL;
     }
 
     cJSON* json;
     cJSON* processed_json;
-    char* result;
+    char* result = NULL;
+    JsonArena* arena;
+    JsonArena* previous_arena;
+
+    // Compiled patterns are cached across calls; NULL means it did not compile
+    PyObject* pattern_capsule = get_cached_pattern(pattern);
+    const CompiledPattern* compiled = pattern_capsule ?
+        PyCapsule_GetPointer(pattern_capsule, PATTERN_CAPSULE_NAME) : NULL;
 
     // Release GIL during C computation for better parallelism
     Py_BEGIN_ALLOW_THREADS
 
     // Initialize memory pools for optimal performance
     init_global_pools();
+    arena = begin_call_arena(use_arena, &previous_arena);
 
     // Parse the JSON
-    json = cJSON_Parse(json_string);
+    json = json_argument_parse(&input, 0);
     if (!json) {
+        end_call_arena(arena, previous_arena);
         Py_BLOCK_THREADS
+        json_argument_release(&input);
+        Py_XDECREF(pattern_capsule);
         PyErr_SetString(PyExc_ValueError, "Invalid JSON input");
         return NULL;
     }
 
     // Apply the key replacement
-    processed_json = replace_keys(json, pattern, replacement);
+    if (compiled) {
+        processed_json = replace_keys_compiled(json, compiled, replacement);
+    } else {
+        processed_json = replace_keys(json, pattern, replacement);
+    }
     cJSON_Delete(json);
 
     if (!processed_json) {
+        end_call_arena(arena, previous_arena);
         Py_BLOCK_THREADS
+        json_argument_release(&input);
+        Py_XDECREF(pattern_capsule);
         PyErr_SetString(PyExc_ValueError, "Failed to replace keys (invalid regex pattern?)");
         return NULL;
     }
 
-    // Convert back to string
-    if (pretty_print) {
-        result = cJSON_Print(processed_json);
-    } else {
-        result = cJSON_PrintUnformatted(processed_json);
+    // Convert back to string unless the tree itself is returned
+    if (!as_dict) {
+        result = cjson_tools_print(processed_json, pretty_print);
+        cJSON_Delete(processed_json);
+        processed_json = NULL;
     }
-
-    cJSON_Delete(processed_json);
+    leave_call_arena(arena, previous_arena);
     Py_END_ALLOW_THREADS
 
-    if (result == NULL) {
-        PyErr_SetString(PyExc_MemoryError, "Failed to format result");
-        return NULL;
-    }
-
-    PyObject* py_result = PyUnicode_FromString(result);
-    free(result);
+    json_argument_release(&input);
+    Py_XDECREF(pattern_capsule);
 
-    return py_result;
+    return build_call_result(result, processed_json, arena);
 }
 
 /**
@@ -567,88 +2033,403 @@ static PyObject* py_replace_keys(PyObject* self, PyObject* args, PyObject* kwarg
  */
 static PyObject* py_replace_values(PyObject* self, PyObject* args, PyObject* kwargs) {
     (void)self; // Suppress unused parameter warning
-    const char* json_string;
+    PyObject* json_obj;
     const char* pattern;
     const char* replacement;
     int pretty_print = 0;
+    int use_arena = 0;
+    const char* return_type = "str";
+    int as_dict;
 
-    static char* kwlist[] = {"json_string", "pattern", "replacement", "pretty_print", NULL};
+    static char* kwlist[] = {"json_string", "pattern", "replacement", "pretty_print", "arena", "return_type", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oss|iis", kwlist,
+                                    &json_obj, &pattern, &replacement, &pretty_print, &use_arena,
+                                    &return_type)) {
+        return NULL;
+    }
+    if (get_return_type_argument(return_type, &as_dict) != 0) {
+        return NULL;
+    }
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "sss|i", kwlist,
-                                    &json_string, &pattern, &replacement, &pretty_print)) {
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
         return NULL;
     }
 
     cJSON* json;
     cJSON* processed_json;
-    char* result;
+    char* result = NULL;
+    JsonArena* arena;
+    JsonArena* previous_arena;
+
+    // Compiled patterns are cached across calls; NULL means it did not compile
+    PyObject* pattern_capsule = get_cached_pattern(pattern);
+    const CompiledPattern* compiled = pattern_capsule ?
+        PyCapsule_GetPointer(pattern_capsule, PATTERN_CAPSULE_NAME) : NULL;
 
     // Release GIL during C computation for better parallelism
     Py_BEGIN_ALLOW_THREADS
 
     // Initialize memory pools for optimal performance
     init_global_pools();
+    arena = begin_call_arena(use_arena, &previous_arena);
 
     // Parse the JSON
-    json = cJSON_Parse(json_string);
+    json = json_argument_parse(&input, 0);
     if (!json) {
+        end_call_arena(arena, previous_arena);
         Py_BLOCK_THREADS
+        json_argument_release(&input);
+        Py_XDECREF(pattern_capsule);
         PyErr_SetString(PyExc_ValueError, "Invalid JSON input");
         return NULL;
     }
 
     // Apply the value replacement
-    processed_json = replace_values(json, pattern, replacement);
+    if (compiled) {
+        processed_json = replace_values_compiled(json, compiled, replacement);
+    } else {
+        processed_json = replace_values(json, pattern, replacement);
+    }
     cJSON_Delete(json);
 
     if (!processed_json) {
+        end_call_arena(arena, previous_arena);
         Py_BLOCK_THREADS
+        json_argument_release(&input);
+        Py_XDECREF(pattern_capsule);
         PyErr_SetString(PyExc_ValueError, "Failed to replace values (invalid regex pattern?)");
         return NULL;
     }
 
-    // Convert back to string
-    if (pretty_print) {
-        result = cJSON_Print(processed_json);
-    } else {
-        result = cJSON_PrintUnformatted(processed_json);
+    // Convert back to string unless the tree itself is returned
+    if (!as_dict) {
+        result = cjson_tools_print(processed_json, pretty_print);
+        cJSON_Delete(processed_json);
+        processed_json = NULL;
+    }
+    leave_call_arena(arena, previous_arena);
+    Py_END_ALLOW_THREADS
+
+    json_argument_release(&input);
+    Py_XDECREF(pattern_capsule);
+
+    return build_call_result(result, processed_json, arena);
+}
+
+/**
+ * Apply a sequence of transformations in a single traversal
+ */
+static PyObject* py_apply_pipeline(PyObject* self, PyObject* args, PyObject* kwargs) {
+    (void)self; // Suppress unused parameter warning
+    PyObject* json_obj;
+    const char* steps;
+    int pretty_print = 0;
+    int use_arena = 0;
+    const char* return_type = "str";
+    int as_dict;
+
+    static char* kwlist[] = {"json_string", "steps", "pretty_print", "arena", "return_type", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os|iis", kwlist,
+                                    &json_obj, &steps, &pretty_print, &use_arena, &return_type)) {
+        return NULL;
+    }
+    if (get_return_type_argument(return_type, &as_dict) != 0) {
+        return NULL;
+    }
+
+    JsonPipeline* pipeline = json_pipeline_parse(steps);
+    if (!pipeline) {
+        PyErr_Format(PyExc_ValueError, "Invalid pipeline: '%s'", steps);
+        return NULL;
+    }
+
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
+        json_pipeline_free(pipeline);
+        return NULL;
+    }
+
+    cJSON* json;
+    cJSON* processed_json;
+    char* result = NULL;
+    JsonArena* arena;
+    JsonArena* previous_arena;
+
+    // Release GIL during C computation for better parallelism
+    Py_BEGIN_ALLOW_THREADS
+
+    // Initialize memory pools for optimal performance
+    init_global_pools();
+    arena = begin_call_arena(use_arena, &previous_arena);
+
+    // Parse the JSON
+    json = json_argument_parse(&input, 0);
+    if (!json) {
+        json_pipeline_free(pipeline);
+        end_call_arena(arena, previous_arena);
+        Py_BLOCK_THREADS
+        json_argument_release(&input);
+        PyErr_SetString(PyExc_ValueError, "Invalid JSON input");
+        return NULL;
+    }
+
+    // Run every step in a single traversal
+    processed_json = json_pipeline_apply(pipeline, json);
+    cJSON_Delete(json);
+    json_pipeline_free(pipeline);
+
+    if (!processed_json) {
+        end_call_arena(arena, previous_arena);
+        Py_BLOCK_THREADS
+        json_argument_release(&input);
+        PyErr_SetString(PyExc_ValueError, "Failed to apply pipeline");
+        return NULL;
     }
 
-    cJSON_Delete(processed_json);
+    // Convert back to string unless the tree itself is returned
+    if (!as_dict) {
+        result = cjson_tools_print(processed_json, pretty_print);
+        cJSON_Delete(processed_json);
+        processed_json = NULL;
+    }
+    leave_call_arena(arena, previous_arena);
     Py_END_ALLOW_THREADS
 
-    if (result == NULL) {
-        PyErr_SetString(PyExc_MemoryError, "Failed to format result");
+    json_argument_release(&input);
+
+    return build_call_result(result, processed_json, arena);
+}
+
+/**
+ * Keep only the selected paths of a JSON string, skipping the rest unparsed
+ */
+static PyObject* py_extract_paths(PyObject* self, PyObject* args, PyObject* kwargs) {
+    (void)self; // Suppress unused parameter warning
+    PyObject* json_obj;
+    const char* paths_spec;
+    int per_record = 1;
+    int pretty_print = 0;
+    int use_arena = 0;
+    const char* return_type = "str";
+    int as_dict;
+
+    static char* kwlist[] = {"json_string", "paths", "per_record", "pretty_print", "arena", "return_type", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os|iiis", kwlist,
+                                    &json_obj, &paths_spec, &per_record, &pretty_print, &use_arena,
+                                    &return_type)) {
+        return NULL;
+    }
+    if (get_return_type_argument(return_type, &as_dict) != 0) {
+        return NULL;
+    }
+
+    JsonPathSet* paths = json_path_set_compile(paths_spec);
+    if (!paths) {
+        PyErr_Format(PyExc_ValueError, "Invalid paths: '%s'", paths_spec);
         return NULL;
     }
 
-    PyObject* py_result = PyUnicode_FromString(result);
-    free(result);
+    JsonArgument input;
+    if (json_argument_init(json_obj, &input) != 0) {
+        json_path_set_free(paths);
+        return NULL;
+    }
 
-    return py_result;
+    cJSON* extracted;
+    char* result = NULL;
+    JsonArena* arena;
+    JsonArena* previous_arena;
+
+    // Release GIL during C computation for better parallelism
+    Py_BEGIN_ALLOW_THREADS
+
+    // Initialize memory pools for optimal performance
+    init_global_pools();
+    arena = begin_call_arena(use_arena, &previous_arena);
+
+    extracted = json_argument_parse_paths(&input, paths, per_record);
+    json_path_set_free(paths);
+
+    if (!extracted) {
+        end_call_arena(arena, previous_arena);
+        Py_BLOCK_THREADS
+        json_argument_release(&input);
+        PyErr_SetString(PyExc_ValueError, "Invalid JSON input");
+        return NULL;
+    }
+
+    if (!as_dict) {
+        result = cjson_tools_print(extracted, pretty_print);
+        cJSON_Delete(extracted);
+        extracted = NULL;
+    }
+    leave_call_arena(arena, previous_arena);
+    Py_END_ALLOW_THREADS
+
+    json_argument_release(&input);
+
+    return build_call_result(result, extracted, arena);
+}
+
+
+/**
+ * Flatten JSON records to CSV/TSV text or Apache Arrow IPC stream bytes
+ */
+static PyObject* py_flatten_json_columnar(PyObject* self, PyObject* args, PyObject* kwargs) {
+    (void)self; // Suppress unused parameter warning
+    PyObject* json_obj;
+    const char* format_name = "csv";
+    int use_threads = 1;
+    int num_threads = 0;
+    PyObject* pool_obj = NULL;
+    int batch_rows = 0;
+    ColumnarFormat format;
+
+    static char* kwlist[] = {"json", "format", "use_threads", "num_threads", "pool", "batch_rows", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|siiOi", kwlist,
+                                    &json_obj, &format_name, &use_threads, &num_threads, &pool_obj,
+                                    &batch_rows)) {
+        return NULL;
+    }
+    if (columnar_format_parse(format_name, &format) != 0) {
+        PyErr_Format(PyExc_ValueError, "format must be 'csv', 'tsv' or 'arrow', not '%s'", format_name);
+        return NULL;
+    }
+
+    ThreadPool* pool;
+    if (get_pool_argument(pool_obj, &pool) != 0) {
+        return NULL;
+    }
+
+    // A list holds one record per element; anything else is a single document
+    Py_ssize_t list_size = 0;
+    JsonArgument single;
+    JsonArgument* items;
+    int is_list = PyList_Check(json_obj);
+    if (is_list) {
+        items = json_list_arguments(json_obj, &list_size);
+    } else {
+        items = json_argument_init(json_obj, &single) == 0 ? &single : NULL;
+    }
+    if (items == NULL) {
+        thread_pool_release(pool);
+        return NULL;
+    }
+
+    cJSON* json;
+    Py_ssize_t failed_index = -1;
+    ColumnarWriter* writer = NULL;
+    long rows = -1;
+    PyObject* result = NULL;
+
+    // Release GIL during C computation for better parallelism
+    Py_BEGIN_ALLOW_THREADS
+
+    // Initialize memory pools for optimal performance
+    init_global_pools();
+
+    json = is_list ? json_arguments_to_array(items, list_size, &failed_index) : json_argument_parse(items, 0);
+    if (json) {
+        // An array gives one row per element, anything else a single row
+        JsonArrayView records;
+        cJSON* root = json;
+        int viewed = cJSON_IsArray(json);
+        if (viewed) {
+            viewed = json_array_view_init(&records, json) == 0 ? 1 : -1;
+        } else {
+            records.items = &root;
+            records.count = 1;
+        }
+
+        if (!pool && use_threads && viewed == 1 && records.count >= MIN_BATCH_SIZE_FOR_MT) {
+            pool = thread_pool_acquire_shared(num_threads);
+        }
+        writer = viewed >= 0 ? columnar_writer_create(NULL, format, batch_rows) : NULL;
+        if (writer && columnar_writer_add_columns(writer, &records, pool) == 0 &&
+            columnar_writer_write(writer, &records, pool) == 0) {
+            rows = columnar_writer_finish(writer);
+        }
+        if (viewed == 1) json_array_view_free(&records);
+    }
+    thread_pool_release(pool);
+    cJSON_Delete(json);
+    Py_END_ALLOW_THREADS
+
+    if (is_list) {
+        json_list_arguments_free(items, list_size);
+    } else {
+        json_argument_release(items);
+    }
+
+    if (!json) {
+        if (failed_index >= 0) {
+            PyErr_Format(PyExc_ValueError, "Invalid JSON at index %zd", failed_index);
+        } else if (is_list) {
+            PyErr_SetString(PyExc_MemoryError, "Failed to create JSON array");
+        } else {
+            PyErr_SetString(PyExc_ValueError, "Invalid JSON input");
+        }
+        columnar_writer_free(writer);
+        return NULL;
+    }
+
+    size_t length = 0;
+    const char* output = rows >= 0 ? columnar_writer_output(writer, &length) : NULL;
+    if (output == NULL) {
+        PyErr_SetString(PyExc_MemoryError, "Failed to write columnar output");
+    } else if (format == COLUMNAR_ARROW) {
+        result = PyBytes_FromStringAndSize(output, (Py_ssize_t)length);
+    } else {
+        result = PyUnicode_DecodeUTF8(output, (Py_ssize_t)length, NULL);
+    }
+    columnar_writer_free(writer);
+    return result;
 }
 
 
 // Module method definitions with proper function signatures
 static PyMethodDef CJsonToolsMethods[] = {
     {"flatten_json", (PyCFunction)(void(*)(void))py_flatten_json, METH_VARARGS | METH_KEYWORDS,
-     "Flatten a JSON string into a flat structure. Args: json_string, use_threads=False, num_threads=0, pretty_print=False"},
+     "Flatten JSON (a str, bytes-like object or native dict/list) into a flat structure. Args: json_string, use_threads=False, num_threads=0, pretty_print=False, arena=False, paths=None (e.g. 'a.b,c[*].d'), simd_parser=False, return_type='str' (or 'dict')"},
     {"flatten_json_batch", (PyCFunction)(void(*)(void))py_flatten_json_batch, METH_VARARGS | METH_KEYWORDS,
-     "Flatten a batch of JSON objects into flat structures. Args: json_list, use_threads=True, num_threads=0, pretty_print=False"},
+     "Flatten a batch of JSON objects (str, bytes-like or native) into flat structures. Args: json_list, use_threads=True, num_threads=0, pretty_print=False, pool=None, return_type='str'"},
+    {"unflatten_json", (PyCFunction)(void(*)(void))py_unflatten_json, METH_VARARGS | METH_KEYWORDS,
+     "Rebuild nested JSON from flattened keys (a.b, a[0]); a list is unflattened record by record. Args: json_string, use_threads=False, num_threads=0, pretty_print=False, arena=False, return_type='str' (or 'dict')"},
+    {"unflatten_json_batch", (PyCFunction)(void(*)(void))py_unflatten_json_batch, METH_VARARGS | METH_KEYWORDS,
+     "Unflatten a batch of flattened JSON objects (str, bytes-like or native). Args: json_list, use_threads=True, num_threads=0, pretty_print=False, pool=None, return_type='str'"},
     {"generate_schema", (PyCFunction)(void(*)(void))py_generate_schema, METH_VARARGS | METH_KEYWORDS,
-     "Generate a JSON schema from a JSON string."},
+     "Generate a JSON schema from JSON (a str, bytes-like object or native value). Args: json_string, use_threads=False, num_threads=0, return_type='str', sample_rate=0.0, sample_size=0, seed=0, collect_stats=False, enum_limit=0"},
     {"generate_schema_batch", (PyCFunction)(void(*)(void))py_generate_schema_batch, METH_VARARGS | METH_KEYWORDS,
-     "Generate a JSON schema from a batch of JSON objects."},
+     "Generate a JSON schema from a batch of JSON objects. Args: json_list, use_threads=True, num_threads=0, pool=None, return_type='str', sample_rate=0.0, sample_size=0, seed=0, collect_stats=False, enum_limit=0"},
     {"get_flattened_paths_with_types", (PyCFunction)(void(*)(void))py_get_flattened_paths_with_types, METH_VARARGS | METH_KEYWORDS,
-     "Get flattened paths with their data types from a JSON string. Args: json_string, pretty_print=False"},
+     "Get flattened paths with their data types from a JSON string. Args: json_string, pretty_print=False, return_type='str'"},
     {"remove_empty_strings", (PyCFunction)(void(*)(void))py_remove_empty_strings, METH_VARARGS | METH_KEYWORDS,
-     "Remove keys with empty string values from a JSON string. Args: json_string, pretty_print=False"},
+     "Remove keys with empty string values from a JSON string. Args: json_string, pretty_print=False, arena=False, return_type='str'"},
     {"remove_nulls", (PyCFunction)(void(*)(void))py_remove_nulls, METH_VARARGS | METH_KEYWORDS,
-     "Remove keys with null values from a JSON string. Args: json_string, pretty_print=False"},
+     "Remove keys with null values from a JSON string. Args: json_string, pretty_print=False, arena=False, return_type='str'"},
     {"replace_keys", (PyCFunction)(void(*)(void))py_replace_keys, METH_VARARGS | METH_KEYWORDS,
-     "Replace JSON keys matching a regex pattern. Args: json_string, pattern, replacement, pretty_print=False"},
+     "Replace JSON keys matching a regex pattern. Args: json_string, pattern, replacement, pretty_print=False, arena=False, return_type='str'"},
     {"replace_values", (PyCFunction)(void(*)(void))py_replace_values, METH_VARARGS | METH_KEYWORDS,
-     "Replace JSON string values matching a regex pattern. Args: json_string, pattern, replacement, pretty_print=False"},
+     "Replace JSON string values matching a regex pattern. Args: json_string, pattern, replacement, pretty_print=False, arena=False, return_type='str'"},
+    {"apply_pipeline", (PyCFunction)(void(*)(void))py_apply_pipeline, METH_VARARGS | METH_KEYWORDS,
+     "Apply several transformations in one pass. Args: json_string, steps (e.g. 'remove-nulls,flatten'), pretty_print=False, arena=False, return_type='str'"},
+    {"extract_paths", (PyCFunction)(void(*)(void))py_extract_paths, METH_VARARGS | METH_KEYWORDS,
+     "Keep only the selected paths, skipping other subtrees unparsed. Args: json_string, paths (e.g. 'a.b,c[*].d'), per_record=True, pretty_print=False, arena=False, return_type='str'"},
+    {"flatten_json_columnar", (PyCFunction)(void(*)(void))py_flatten_json_columnar, METH_VARARGS | METH_KEYWORDS,
+     "Flatten JSON records (a list, or an array or single record) to columns: CSV/TSV text or Apache Arrow IPC stream bytes. Args: json, format='csv' (or 'tsv', 'arrow'), use_threads=True, num_threads=0, pool=None, batch_rows=0"},
+    {"configure_thread_pool", (PyCFunction)(void(*)(void))py_configure_thread_pool, METH_VARARGS | METH_KEYWORDS,
+     "Resize the shared worker pool used by threaded calls. Args: num_threads=0 (auto). Returns the thread count"},
+    {"shutdown_thread_pool", (PyCFunction)py_shutdown_thread_pool, METH_NOARGS,
+     "Stop the shared worker pool; the next threaded call starts a new one."},
+    {"get_stats", (PyCFunction)py_get_stats, METH_NOARGS,
+     "Return counters and phase timings (records, bytes, parse/transform/merge/serialize seconds, pool allocations, task and steal counts, per-worker busy/idle time) as a dict."},
+    {"reset_stats", (PyCFunction)py_reset_stats, METH_NOARGS,
+     "Zero the counters and phase timings reported by get_stats."},
     {NULL, NULL, 0, NULL}  // Sentinel
 };
 
@@ -672,6 +2453,45 @@ PyMODINIT_FUNC PyInit__cjson_tools(void) {
         return NULL;
     }
 
+    g_pattern_cache = PyDict_New();
+    if (g_pattern_cache == NULL) {
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    if (PyType_Ready(&ThreadPoolType) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    Py_INCREF(&ThreadPoolType);
+    if (PyModule_AddObject(m, "ThreadPool", (PyObject*)&ThreadPoolType) < 0) {
+        Py_DECREF(&ThreadPoolType);
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    if (PyType_Ready(&SchemaBuilderType) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    Py_INCREF(&SchemaBuilderType);
+    if (PyModule_AddObject(m, "SchemaBuilder", (PyObject*)&SchemaBuilderType) < 0) {
+        Py_DECREF(&SchemaBuilderType);
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    if (PyType_Ready(&SchemaValidatorType) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    Py_INCREF(&SchemaValidatorType);
+    if (PyModule_AddObject(m, "SchemaValidator", (PyObject*)&SchemaValidatorType) < 0) {
+        Py_DECREF(&SchemaValidatorType);
+        Py_DECREF(m);
+        return NULL;
+    }
+
     // Add version
     PyModule_AddStringConstant(m, "__version__", MODULE_VERSION);
 
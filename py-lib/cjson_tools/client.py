@@ -0,0 +1,140 @@
+"""
+Client for a running ``json_tools --serve <socket>`` server.
+
+The server keeps one warm process (thread pool, compiled patterns, pipelines
+and schemas) for many small calls, so a request costs a round trip over a
+Unix socket instead of a process start. Each method sends one request and
+returns the result as JSON text, like the in-process functions.
+
+A client holds one connection and is not thread-safe; give each thread its
+own client to run requests concurrently.
+"""
+
+import json
+import socket
+import struct
+
+_FRAME = struct.Struct(">II")
+
+STATUS_OK = 0
+STATUS_INVALID = 1
+STATUS_ERROR = 2
+
+
+class ServerError(RuntimeError):
+    """Raised when the server rejects a request or cannot process it."""
+
+
+def _payload_bytes(data):
+    if isinstance(data, (bytes, bytearray, memoryview)):
+        return bytes(data)
+    if isinstance(data, str):
+        return data.encode("utf-8")
+    return json.dumps(data, separators=(",", ":")).encode("utf-8")
+
+
+class Client:
+    """Connection to a cJSON-Tools server.
+
+    Args:
+        path: Filesystem path of the server's Unix socket
+        timeout: Seconds to wait for a response (None waits indefinitely)
+    """
+
+    def __init__(self, path, timeout=None):
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            self._socket.settimeout(timeout)
+            self._socket.connect(path)
+        except OSError:
+            self._socket.close()
+            raise
+
+    def close(self):
+        self._socket.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc_info):
+        self.close()
+
+    def _receive(self, length):
+        view = memoryview(bytearray(length))
+        received = 0
+        while received < length:
+            count = self._socket.recv_into(view[received:])
+            if count == 0:
+                raise ConnectionError("server closed the connection")
+            received += count
+        return view.obj
+
+    def request(self, op, data=None, **options):
+        """Sends one request and returns (status, body text).
+
+        Options become the request header next to "op"; data (str, bytes-like
+        or a native value) is the payload.
+        """
+        options["op"] = op
+        header = json.dumps(options, separators=(",", ":")).encode("utf-8")
+        payload = b"" if data is None else _payload_bytes(data)
+        self._socket.sendall(_FRAME.pack(len(header), len(payload)) + header + payload)
+
+        status, length = _FRAME.unpack(self._receive(_FRAME.size))
+        body = self._receive(length).decode("utf-8")
+        if status == STATUS_ERROR:
+            raise ServerError(body)
+        return status, body
+
+    def _call(self, op, data, **options):
+        return self.request(op, data, **options)[1]
+
+    def ping(self):
+        """Round trip without work; returns True when the server answers."""
+        return self.request("ping")[0] == STATUS_OK
+
+    def stats(self):
+        """The server's runtime statistics, as get_stats() reports them."""
+        return json.loads(self._call("stats", None))
+
+    def flatten_json(self, data, pretty_print=False):
+        return self._call("flatten", data, pretty=pretty_print)
+
+    def unflatten_json(self, data, pretty_print=False):
+        return self._call("unflatten", data, pretty=pretty_print)
+
+    def remove_empty_strings(self, data, pretty_print=False):
+        return self._call("remove-empty", data, pretty=pretty_print)
+
+    def remove_nulls(self, data, pretty_print=False):
+        return self._call("remove-nulls", data, pretty=pretty_print)
+
+    def replace_keys(self, data, pattern, replacement, pretty_print=False):
+        return self._call("replace-keys", data, pattern=pattern, replacement=replacement, pretty=pretty_print)
+
+    def replace_values(self, data, pattern, replacement, pretty_print=False):
+        return self._call("replace-values", data, pattern=pattern, replacement=replacement, pretty=pretty_print)
+
+    def apply_pipeline(self, data, steps, pretty_print=False):
+        return self._call("pipeline", data, steps=steps, pretty=pretty_print)
+
+    def generate_schema(self, data, sample_rate=0.0, sample_size=0, seed=0, collect_stats=False, enum_limit=0):
+        return self._call(
+            "schema",
+            data,
+            pretty=True,
+            sample_rate=sample_rate,
+            sample_size=sample_size,
+            seed=seed,
+            collect_stats=collect_stats,
+            enum_limit=enum_limit,
+        )
+
+    def validate(self, data, schema, all_errors=False):
+        """Checks data against schema (str, bytes or dict); an array is a batch.
+
+        Returns the list of errors, empty when everything is valid.
+        """
+        if isinstance(schema, (bytes, bytearray, memoryview)):
+            schema = bytes(schema).decode("utf-8")
+        return json.loads(self._call("validate", data, schema=schema, all_errors=all_errors))["errors"]
@@ -1,5 +1,6 @@
 import os
 import platform
+import subprocess
 
 from setuptools import Extension, find_packages, setup
 
@@ -25,6 +26,22 @@ if not os.path.exists(c_lib_src) or not os.path.exists(c_lib_include):
 libraries = []
 extra_compile_args = []
 extra_link_args = []
+codec_macros = []
+
+
+def has_header(header):
+    """Returns True when the C compiler finds header (for optional codecs)"""
+    compiler = os.environ.get("CC", "cc").split()
+    try:
+        result = subprocess.run(
+            compiler + ["-E", "-include", header, "-x", "c", os.devnull],
+            stdout=subprocess.DEVNULL,
+            stderr=subprocess.DEVNULL,
+        )
+    except OSError:
+        return False
+    return result.returncode == 0
+
 
 # Check if we're on Windows
 is_windows = platform.system() == "Windows"
@@ -70,7 +87,7 @@ elif is_mingw_cross_compile:
     extra_link_args = ["-static-libgcc", "-static-libstdc++", "-lpthread"]
 else:
     # Unix-like systems (Linux, macOS) with target-specific optimizations
-    libraries.append("pthread")
+    libraries.extend(["pthread", "m"])
     extra_compile_args = [
         "-std=c99",
         "-Wall",
@@ -82,28 +99,32 @@ else:
         "-funroll-loops",
     ]
 
-    # Target-specific optimizations
+    # Target-specific optimizations. SIMD kernels are chosen at runtime, so the
+    # default build stays portable; CJSON_TOOLS_NATIVE=1 tunes for this machine.
     import platform
     import sys
 
-    if platform.machine() == "x86_64":
-        extra_compile_args.extend(
-            ["-march=native", "-mtune=native", "-msse4.2", "-mavx2"]
-        )
-    elif platform.machine() in ["aarch64", "arm64"]:
-        # ARM64 optimizations (Linux and macOS)
-        if sys.platform == "darwin":
-            # macOS ARM64 - avoid -march=native which causes issues
-            extra_compile_args.extend(["-mcpu=apple-a14"])
+    if sys.platform == "darwin" and platform.machine() == "arm64":
+        # macOS ARM64 - avoid -march=native which causes issues
+        extra_compile_args.extend(["-mcpu=apple-a14"])
+    elif os.environ.get("CJSON_TOOLS_NATIVE") == "1":
+        if platform.machine() in ["aarch64", "arm64"]:
+            extra_compile_args.extend(["-mcpu=native"])
         else:
-            # Linux ARM64
-            extra_compile_args.extend(["-march=native", "-mcpu=native"])
-    else:
-        # Generic optimizations for other architectures
-        extra_compile_args.extend(["-march=native", "-mtune=native"])
+            extra_compile_args.extend(["-march=native", "-mtune=native"])
 
     extra_link_args = ["-flto"]
 
+    # Compressed input and output: each codec is built in when its header is
+    # found, unless CJSON_TOOLS_ZLIB=0 / CJSON_TOOLS_ZSTD=0
+    for macro, header, library, env in (
+        ("HAVE_ZLIB", "zlib.h", "z", "CJSON_TOOLS_ZLIB"),
+        ("HAVE_ZSTD", "zstd.h", "zstd", "CJSON_TOOLS_ZSTD"),
+    ):
+        if os.environ.get(env, "1") != "0" and has_header(header):
+            codec_macros.append((macro, None))
+            libraries.append(library)
+
 # Define the extension module
 cjson_tools_module = Extension(
     "cjson_tools._cjson_tools",
@@ -128,6 +149,7 @@ cjson_tools_module = Extension(
             ("_GNU_SOURCE", None),
             ("CJSON_TOOLS_NO_MAIN", None),  # Exclude main function
         ]
+        + codec_macros
     ),
 )
 